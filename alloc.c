@@ -10,6 +10,7 @@
  * for the new allocation is.
  */
 #include "cache.h"
+#include "mem-pool.h"
 #include "object.h"
 #include "blob.h"
 #include "tree.h"
@@ -28,24 +29,15 @@ union any_object {
 
 struct alloc_state {
 	int count; /* total number of nodes allocated */
-	int nr;    /* number of nodes left in current allocation */
-	void *p;   /* first free node in current allocation */
+	struct mem_pool pool;
 };
 
 static inline void *alloc_node(struct alloc_state *s, size_t node_size)
 {
-	void *ret;
-
-	if (!s->nr) {
-		s->nr = BLOCKING;
-		s->p = xmalloc(BLOCKING * node_size);
-	}
-	s->nr--;
+	if (!s->pool.block_alloc)
+		mem_pool_init(&s->pool, BLOCKING * node_size);
 	s->count++;
-	ret = s->p;
-	s->p = (char *)s->p + node_size;
-	memset(ret, 0, node_size);
-	return ret;
+	return mem_pool_calloc(&s->pool, 1, node_size);
 }
 
 static struct alloc_state blob_state;
@@ -501,12 +501,107 @@ static int parse_archive_args(int argc, const char **argv,
 	return argc;
 }
 
+/*
+ * Compute the cache file name for this invocation: a SHA-1 over the
+ * unparsed argument vector (which covers the format, prefix,
+ * compression level and pathspecs) plus the resolved commit, so that
+ * a moved tag or ref cannot be served a stale archive.
+ */
+static char *archive_cache_path(const char *cache_dir,
+				const struct strbuf *cmdline,
+				const struct archiver *ar,
+				const struct archiver_args *args)
+{
+	git_SHA_CTX ctx;
+	unsigned char key[20];
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, cmdline->buf, cmdline->len);
+	git_SHA1_Update(&ctx, args->commit_sha1, 20);
+	git_SHA1_Final(key, &ctx);
+	return mkpathdup("%s/%s.%s", cache_dir, sha1_to_hex(key), ar->name);
+}
+
+/*
+ * Write the archive into the cache, then stream the cached copy to
+ * the real output.  Falls back to writing the archive directly if the
+ * cache directory is unusable.
+ */
+static int write_archive_cached(const struct archiver *ar,
+				struct archiver_args *args,
+				const char *cache_dir, const char *cache_file)
+{
+	struct strbuf tmp = STRBUF_INIT;
+	int fd, saved_stdout, err;
+
+	fd = open(cache_file, O_RDONLY);
+	if (fd >= 0) {
+		err = copy_fd(fd, 1);
+		close(fd);
+		return err;
+	}
+
+	if (mkdir(cache_dir, 0777) && errno != EEXIST) {
+		warning("unable to create archive cache directory '%s': %s",
+			cache_dir, strerror(errno));
+		return ar->write_archive(ar, args);
+	}
+	strbuf_addf(&tmp, "%s/tmp_archive_XXXXXX", cache_dir);
+	fd = mkstemp(tmp.buf);
+	if (fd < 0) {
+		warning("unable to create archive cache file in '%s': %s",
+			cache_dir, strerror(errno));
+		strbuf_release(&tmp);
+		return ar->write_archive(ar, args);
+	}
+
+	saved_stdout = dup(1);
+	if (saved_stdout < 0)
+		die_errno("unable to save the output stream");
+	dup2(fd, 1);
+	close(fd);
+	err = ar->write_archive(ar, args);
+	dup2(saved_stdout, 1);
+	close(saved_stdout);
+
+	if (err) {
+		unlink(tmp.buf);
+		strbuf_release(&tmp);
+		return err;
+	}
+	if (rename(tmp.buf, cache_file)) {
+		unlink(tmp.buf);
+		strbuf_release(&tmp);
+		return error("unable to store cached archive '%s': %s",
+			     cache_file, strerror(errno));
+	}
+	strbuf_release(&tmp);
+
+	fd = open(cache_file, O_RDONLY);
+	if (fd < 0)
+		return error("unable to reopen cached archive '%s': %s",
+			     cache_file, strerror(errno));
+	err = copy_fd(fd, 1);
+	close(fd);
+	return err;
+}
+
 int write_archive(int argc, const char **argv, const char *prefix,
 		  int setup_prefix, const char *name_hint, int remote)
 {
 	int nongit = 0;
 	const struct archiver *ar = NULL;
 	struct archiver_args args;
+	struct strbuf cmdline = STRBUF_INIT;
+	char *cache_dir = NULL;
+	int i;
+
+	/*
+	 * Record the arguments before parse_options() consumes them;
+	 * they key the archive cache, if one is configured.
+	 */
+	for (i = 0; i < argc; i++)
+		strbuf_add(&cmdline, argv[i], strlen(argv[i]) + 1);
 
 	if (setup_prefix && prefix == NULL)
 		prefix = setup_git_directory_gently(&nongit);
@@ -530,6 +625,24 @@ int write_archive(int argc, const char **argv, const char *prefix,
 	parse_treeish_arg(argv, &args, prefix, remote);
 	parse_pathspec_arg(argv + 1, &args);
 
+	/*
+	 * Archives of bare trees are stamped with the current time
+	 * and thus never deterministic; only commits can be cached.
+	 */
+	if (!git_config_get_string("archive.cachedir", &cache_dir) &&
+	    cache_dir && *cache_dir && args.commit) {
+		char *cache_file = archive_cache_path(cache_dir, &cmdline,
+						      ar, &args);
+		int err = write_archive_cached(ar, &args, cache_dir,
+					       cache_file);
+		free(cache_file);
+		free(cache_dir);
+		strbuf_release(&cmdline);
+		return err;
+	}
+	free(cache_dir);
+	strbuf_release(&cmdline);
+
 	return ar->write_archive(ar, &args);
 }
 
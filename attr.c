@@ -13,6 +13,7 @@
 #include "attr.h"
 #include "dir.h"
 #include "utf8.h"
+#include "hashmap.h"
 
 const char git_attr__true[] = "(builtin)true";
 const char git_attr__false[] = "\0(builtin)false";
@@ -300,6 +301,103 @@ static struct match_attr *parse_attr_line(const char *line, const char *src,
  * .gitignore
  */
 
+/*
+ * Most patterns in a big .gitattributes file are "simple": they can
+ * only ever match through the path's basename, either as an exact
+ * name without wildcards or as a "*.ext" suffix rule.  Each stack
+ * frame indexes those in two hashmaps so that matching costs two
+ * lookups per path instead of a scan over every rule; the remaining
+ * rules are kept in a (descending) list and evaluated as before.
+ * Interleaving the lookup results with that list preserves the
+ * last-match-wins ordering exactly.
+ */
+struct fast_rule {
+	struct hashmap_entry ent;
+	const char *key;
+	int keylen;
+	int *indices;		/* rule positions, descending */
+	int nr, alloc;
+};
+
+struct attr_fast_index {
+	struct hashmap by_name;
+	struct hashmap by_ext;
+	int *complex;		/* rule positions, descending */
+	int nr_complex;
+	unsigned prepared:1;
+};
+
+static int fast_rule_cmp(const void *entry, const void *entry_or_key,
+			 const void *keydata)
+{
+	const struct fast_rule *a = entry;
+	const struct fast_rule *b = entry_or_key;
+
+	if (a->keylen != b->keylen)
+		return 1;
+	return ignore_case ? strncasecmp(a->key, b->key, a->keylen) :
+			     memcmp(a->key, b->key, a->keylen);
+}
+
+static unsigned int fast_rule_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static struct fast_rule *fast_rule_get(const struct hashmap *map,
+				       const char *key, int keylen)
+{
+	struct fast_rule probe;
+
+	hashmap_entry_init(&probe, fast_rule_hash(key, keylen));
+	probe.key = key;
+	probe.keylen = keylen;
+	return hashmap_get(map, &probe, NULL);
+}
+
+static void fast_rule_add(struct hashmap *map, const char *key, int keylen,
+			  int pos)
+{
+	struct fast_rule *rule = fast_rule_get(map, key, keylen);
+
+	if (!rule) {
+		rule = xcalloc(1, sizeof(*rule));
+		hashmap_entry_init(rule, fast_rule_hash(key, keylen));
+		rule->key = key;
+		rule->keylen = keylen;
+		hashmap_add(map, rule);
+	}
+	ALLOC_GROW(rule->indices, rule->nr + 1, rule->alloc);
+	rule->indices[rule->nr++] = pos;
+}
+
+/*
+ * Returns 0 for rules that need the full matcher, 1 for exact
+ * basenames and 2 for "*.ext" suffixes (a single extension, so the
+ * path side can probe with everything after its last dot).
+ */
+static int simple_pattern_key(const struct pattern *pat,
+			      const char **key, int *keylen)
+{
+	if (!(pat->flags & EXC_FLAG_NODIR) ||
+	    (pat->flags & EXC_FLAG_MUSTBEDIR))
+		return 0;
+	if (pat->nowildcardlen == pat->patternlen) {
+		*key = pat->pattern;
+		*keylen = pat->patternlen;
+		return 1;
+	}
+	if ((pat->flags & EXC_FLAG_ENDSWITH) &&
+	    pat->patternlen > 2 &&
+	    pat->pattern[1] == '.' &&
+	    !memchr(pat->pattern + 2, '.', pat->patternlen - 2)) {
+		*key = pat->pattern + 1;
+		*keylen = pat->patternlen - 1;
+		return 1 + 1;
+	}
+	return 0;
+}
+
 static struct attr_stack {
 	struct attr_stack *prev;
 	char *origin;
@@ -307,6 +405,7 @@ static struct attr_stack {
 	unsigned num_matches;
 	unsigned alloc;
 	struct match_attr **attrs;
+	struct attr_fast_index fast;
 } *attr_stack;
 
 static void free_attr_elem(struct attr_stack *e)
@@ -328,6 +427,20 @@ static void free_attr_elem(struct attr_stack *e)
 		}
 		free(a);
 	}
+	if (e->fast.prepared) {
+		struct hashmap_iter iter;
+		struct fast_rule *rule;
+
+		hashmap_iter_init(&e->fast.by_name, &iter);
+		while ((rule = hashmap_iter_next(&iter)) != NULL)
+			free(rule->indices);
+		hashmap_iter_init(&e->fast.by_ext, &iter);
+		while ((rule = hashmap_iter_next(&iter)) != NULL)
+			free(rule->indices);
+		hashmap_free(&e->fast.by_name, 1);
+		hashmap_free(&e->fast.by_ext, 1);
+		free(e->fast.complex);
+	}
 	free(e->attrs);
 	free(e);
 }
@@ -679,19 +792,100 @@ static int fill_one(const char *what, struct match_attr *a, int rem)
 	return rem;
 }
 
-static int fill(const char *path, int pathlen, int basename_offset,
-		struct attr_stack *stk, int rem)
+static void prepare_fast_index(struct attr_stack *stk)
 {
 	int i;
-	const char *base = stk->origin ? stk->origin : "";
 
-	for (i = stk->num_matches - 1; 0 < rem && 0 <= i; i--) {
+	hashmap_init(&stk->fast.by_name, fast_rule_cmp, 0);
+	hashmap_init(&stk->fast.by_ext, fast_rule_cmp, 0);
+	stk->fast.complex = xmalloc((stk->num_matches ?
+				     stk->num_matches : 1) * sizeof(int));
+	stk->fast.nr_complex = 0;
+	for (i = stk->num_matches - 1; 0 <= i; i--) {
 		struct match_attr *a = stk->attrs[i];
+		const char *key;
+		int keylen;
+
 		if (a->is_macro)
 			continue;
-		if (path_matches(path, pathlen, basename_offset,
-				 &a->u.pat, base, stk->originlen))
-			rem = fill_one("fill", a, rem);
+		switch (simple_pattern_key(&a->u.pat, &key, &keylen)) {
+		case 1:
+			fast_rule_add(&stk->fast.by_name, key, keylen, i);
+			break;
+		case 2:
+			fast_rule_add(&stk->fast.by_ext, key, keylen, i);
+			break;
+		default:
+			stk->fast.complex[stk->fast.nr_complex++] = i;
+			break;
+		}
+	}
+	stk->fast.prepared = 1;
+}
+
+static int fill(const char *path, int pathlen, int basename_offset,
+		struct attr_stack *stk, int rem)
+{
+	const char *base = stk->origin ? stk->origin : "";
+	int isdir = (pathlen && path[pathlen - 1] == '/');
+	const char *basename = path + basename_offset;
+	int basenamelen = pathlen - basename_offset - isdir;
+	const struct fast_rule *name_rule, *ext_rule;
+	const char *dot;
+	int ci = 0, ni = 0, ei = 0;
+
+	if (!stk->fast.prepared)
+		prepare_fast_index(stk);
+
+	name_rule = fast_rule_get(&stk->fast.by_name, basename, basenamelen);
+	for (dot = basename + basenamelen - 1;
+	     basename <= dot && *dot != '.'; dot--)
+		; /* find the last dot, if any */
+	ext_rule = basename <= dot ?
+		fast_rule_get(&stk->fast.by_ext, dot,
+			      basename + basenamelen - dot) : NULL;
+
+	/*
+	 * Walk the complex rules and both lookup results as one
+	 * descending sequence so overriding works as if every rule
+	 * had been scanned.
+	 */
+	while (0 < rem) {
+		int i = -1, from_complex = 0;
+
+		if (ci < stk->fast.nr_complex) {
+			i = stk->fast.complex[ci];
+			from_complex = 1;
+		}
+		if (name_rule && ni < name_rule->nr &&
+		    i < name_rule->indices[ni]) {
+			i = name_rule->indices[ni];
+			from_complex = 0;
+		}
+		if (ext_rule && ei < ext_rule->nr &&
+		    i < ext_rule->indices[ei]) {
+			i = ext_rule->indices[ei];
+			from_complex = 0;
+		}
+		if (i < 0)
+			break;
+		if (from_complex)
+			ci++;
+		else if (name_rule && ni < name_rule->nr &&
+			 name_rule->indices[ni] == i)
+			ni++;
+		else
+			ei++;
+
+		if (from_complex) {
+			struct match_attr *a = stk->attrs[i];
+			if (path_matches(path, pathlen, basename_offset,
+					 &a->u.pat, base, stk->originlen))
+				rem = fill_one("fill", a, rem);
+		} else {
+			/* an indexed rule matches by construction */
+			rem = fill_one("fill", stk->attrs[i], rem);
+		}
 	}
 	return rem;
 }
@@ -191,6 +191,53 @@ static void blk_SHA1_Block(blk_SHA_CTX *ctx, const void *block)
 	ctx->H[4] += E;
 }
 
+#ifdef BLK_SHA1_NI
+#include <cpuid.h>
+
+/*
+ * Check for the x86 SHA extensions (CPUID.(EAX=07H,ECX=0):EBX.SHA
+ * [bit 29]).  SSE4.1, which blk_SHA1_Block_NI() also needs, predates
+ * the SHA extensions on every CPU that has them, but check it anyway.
+ */
+static int sha1_ni_supported(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) ||
+	    !(ecx & (1U << 19))) /* SSE4.1 */
+		return 0;
+	if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 7)
+		return 0;
+	__cpuid_count(7, 0, eax, ebx, ecx, edx);
+	return !!(ebx & (1U << 29)); /* SHA */
+}
+#endif
+
+/*
+ * Process nblk consecutive 64-byte blocks, dispatching to the
+ * hardware-accelerated implementation when the CPU has one.  Handing
+ * whole runs of blocks to one call keeps the dispatch overhead out of
+ * the inner loop and lets bulk writers (csum-file, bulk-checkin)
+ * stream large buffers through the fast path.
+ */
+static void blk_SHA1_Blocks(blk_SHA_CTX *ctx, const void *data, size_t nblk)
+{
+#ifdef BLK_SHA1_NI
+	static int use_sha1_ni = -1;
+
+	if (use_sha1_ni < 0)
+		use_sha1_ni = sha1_ni_supported();
+	if (use_sha1_ni) {
+		blk_SHA1_Block_NI(ctx, data, nblk);
+		return;
+	}
+#endif
+	while (nblk--) {
+		blk_SHA1_Block(ctx, data);
+		data = (const char *)data + 64;
+	}
+}
+
 void blk_SHA1_Init(blk_SHA_CTX *ctx)
 {
 	ctx->size = 0;
@@ -220,12 +267,14 @@ void blk_SHA1_Update(blk_SHA_CTX *ctx, const void *data, unsigned long len)
 		data = ((const char *)data + left);
 		if (lenW)
 			return;
-		blk_SHA1_Block(ctx, ctx->W);
+		blk_SHA1_Blocks(ctx, ctx->W, 1);
 	}
-	while (len >= 64) {
-		blk_SHA1_Block(ctx, data);
-		data = ((const char *)data + 64);
-		len -= 64;
+	if (len >= 64) {
+		size_t nblk = len / 64;
+
+		blk_SHA1_Blocks(ctx, data, nblk);
+		data = ((const char *)data + nblk * 64);
+		len -= nblk * 64;
 	}
 	if (len)
 		memcpy(ctx->W, data, len);
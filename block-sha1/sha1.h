@@ -16,6 +16,15 @@ void blk_SHA1_Init(blk_SHA_CTX *ctx);
 void blk_SHA1_Update(blk_SHA_CTX *ctx, const void *dataIn, unsigned long len);
 void blk_SHA1_Final(unsigned char hashout[20], blk_SHA_CTX *ctx);
 
+#ifdef BLK_SHA1_NI
+/*
+ * Process nblk consecutive 64-byte blocks using the x86 SHA
+ * extensions.  Only valid to call when the CPU supports them; the
+ * runtime dispatch in sha1.c takes care of that.
+ */
+void blk_SHA1_Block_NI(blk_SHA_CTX *ctx, const void *data, size_t nblk);
+#endif
+
 #define git_SHA_CTX	blk_SHA_CTX
 #define git_SHA1_Init	blk_SHA1_Init
 #define git_SHA1_Update	blk_SHA1_Update
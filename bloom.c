@@ -0,0 +1,163 @@
+#include "cache.h"
+#include "bloom.h"
+#include "commit.h"
+#include "diff.h"
+#include "diffcore.h"
+#include "string-list.h"
+
+static uint32_t rotate_left(uint32_t value, int32_t count)
+{
+	uint32_t mask = 8 * sizeof(uint32_t) - 1;
+	count &= mask;
+	return (value << count) | (value >> ((-count) & mask));
+}
+
+/*
+ * Murmur3, 32-bit flavour.  The filter file format depends on every
+ * implementation hashing identically, so do not "improve" this.
+ */
+static uint32_t murmur3(uint32_t seed, const char *data, size_t len)
+{
+	const uint32_t c1 = 0xcc9e2d51;
+	const uint32_t c2 = 0x1b873593;
+	uint32_t hash = seed;
+	uint32_t k;
+	size_t i, tail = len & ~(size_t)3;
+
+	for (i = 0; i < tail; i += 4) {
+		k = (uint32_t)(unsigned char)data[i] |
+		    ((uint32_t)(unsigned char)data[i + 1] << 8) |
+		    ((uint32_t)(unsigned char)data[i + 2] << 16) |
+		    ((uint32_t)(unsigned char)data[i + 3] << 24);
+		k *= c1;
+		k = rotate_left(k, 15);
+		k *= c2;
+		hash ^= k;
+		hash = rotate_left(hash, 13) * 5 + 0xe6546b64;
+	}
+
+	k = 0;
+	switch (len & 3) {
+	case 3:
+		k ^= (uint32_t)(unsigned char)data[tail + 2] << 16;
+	case 2:
+		k ^= (uint32_t)(unsigned char)data[tail + 1] << 8;
+	case 1:
+		k ^= (uint32_t)(unsigned char)data[tail];
+		k *= c1;
+		k = rotate_left(k, 15);
+		k *= c2;
+		hash ^= k;
+	}
+
+	hash ^= (uint32_t)len;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+void fill_bloom_key(const char *data, size_t len, struct bloom_key *key)
+{
+	int i;
+	uint32_t hash0 = murmur3(0x293ae76f, data, len);
+	uint32_t hash1 = murmur3(0x7e646e2c, data, len);
+
+	for (i = 0; i < BLOOM_NR_HASHES; i++)
+		key->hashes[i] = hash0 + i * hash1;
+}
+
+void add_key_to_filter(const struct bloom_key *key,
+		       struct bloom_filter *filter)
+{
+	int i;
+
+	for (i = 0; i < BLOOM_NR_HASHES; i++) {
+		uint32_t bit = key->hashes[i] % (filter->len * CHAR_BIT);
+		filter->data[bit / CHAR_BIT] |= 1 << (bit % CHAR_BIT);
+	}
+}
+
+int bloom_filter_contains(const struct bloom_filter *filter,
+			  const struct bloom_key *key)
+{
+	int i;
+
+	for (i = 0; i < BLOOM_NR_HASHES; i++) {
+		uint32_t bit = key->hashes[i] % (filter->len * CHAR_BIT);
+		if (!(filter->data[bit / CHAR_BIT] & (1 << (bit % CHAR_BIT))))
+			return 0;
+	}
+	return 1;
+}
+
+static void add_path_and_dirs(struct string_list *paths, const char *path)
+{
+	char *copy = xstrdup(path);
+	char *slash;
+
+	string_list_insert(paths, copy);
+	while ((slash = strrchr(copy, '/')) != NULL) {
+		*slash = '\0';
+		string_list_insert(paths, copy);
+	}
+	free(copy);
+}
+
+void compute_changed_paths_filter(struct commit *commit,
+				  struct bloom_filter *filter)
+{
+	struct diff_options diffopt;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	const unsigned char *parent_tree = NULL;
+	int i;
+
+	filter->data = NULL;
+	filter->len = 0;
+
+	if (parse_commit(commit) < 0)
+		return;
+	if (commit->parents) {
+		if (parse_commit(commit->parents->item) < 0)
+			return;
+		parent_tree = commit->parents->item->tree->object.sha1;
+	}
+
+	diff_setup(&diffopt);
+	DIFF_OPT_SET(&diffopt, RECURSIVE);
+	diffopt.output_format = DIFF_FORMAT_NO_OUTPUT;
+	diff_setup_done(&diffopt);
+
+	if (diff_tree_sha1(parent_tree, commit->tree->object.sha1, "",
+			   &diffopt) < 0)
+		return;
+
+	/*
+	 * Store every changed path and each of its leading directories,
+	 * so that a query for either a file or a whole subdirectory can
+	 * be answered.  The string list deduplicates paths shared by
+	 * several entries.
+	 */
+	if (diff_queued_diff.nr <= BLOOM_MAX_CHANGED_PATHS) {
+		for (i = 0; i < diff_queued_diff.nr; i++)
+			add_path_and_dirs(&paths,
+					  diff_queued_diff.queue[i]->two->path);
+	}
+	diff_flush(&diffopt);
+
+	if (paths.nr) {
+		filter->len =
+			(paths.nr * BLOOM_BITS_PER_ENTRY + CHAR_BIT - 1) /
+			CHAR_BIT;
+		filter->data = xcalloc(1, filter->len);
+		for (i = 0; i < paths.nr; i++) {
+			struct bloom_key key;
+			const char *path = paths.items[i].string;
+			fill_bloom_key(path, strlen(path), &key);
+			add_key_to_filter(&key, filter);
+		}
+	}
+	string_list_clear(&paths, 0);
+}
@@ -0,0 +1,48 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+struct commit;
+
+/*
+ * A changed-path Bloom filter records, probabilistically, the set of
+ * paths that a commit modified with respect to its first parent.  A
+ * positive answer from the filter may be wrong, but a negative answer
+ * is definite, which lets a pathspec-limited revision walk skip the
+ * tree diff for most commits that did not touch the path.
+ */
+
+#define BLOOM_NR_HASHES 7
+#define BLOOM_BITS_PER_ENTRY 10
+
+/*
+ * Commits changing more paths than this are stored without a filter;
+ * the revision walk falls back to diffing their trees as usual.
+ */
+#define BLOOM_MAX_CHANGED_PATHS 512
+
+struct bloom_filter {
+	unsigned char *data;
+	size_t len;
+};
+
+struct bloom_key {
+	uint32_t hashes[BLOOM_NR_HASHES];
+};
+
+void fill_bloom_key(const char *data, size_t len, struct bloom_key *key);
+void add_key_to_filter(const struct bloom_key *key,
+		       struct bloom_filter *filter);
+int bloom_filter_contains(const struct bloom_filter *filter,
+			  const struct bloom_key *key);
+
+/*
+ * Compute the filter covering the paths that "commit" changed against
+ * its first parent (or against the empty tree for a root commit),
+ * including all leading directories of each path.  The result is
+ * allocated for the caller to free; a zero-length filter means no
+ * information could be recorded for the commit.
+ */
+void compute_changed_paths_filter(struct commit *commit,
+				  struct bloom_filter *filter);
+
+#endif /* BLOOM_H */
@@ -20,6 +20,7 @@
 #include "xdiff-interface.h"
 #include "ll-merge.h"
 #include "rerere.h"
+#include "bulk-checkin.h"
 
 /*
  *  --check turns on checking that the working tree matches the
@@ -39,6 +40,7 @@ static int p_value = 1;
 static int p_value_known;
 static int check_index;
 static int update_index;
+static int write_result_tree;
 static int cached;
 static int diffstat;
 static int numstat;
@@ -4544,6 +4546,8 @@ int cmd_apply(int argc, const char **argv, const char *prefix_)
 			N_("make sure the patch is applicable to the current index")),
 		OPT_BOOL(0, "cached", &cached,
 			N_("apply a patch without touching the working tree")),
+		OPT_BOOL(0, "write-tree", &write_result_tree,
+			N_("write and report the tree the updated index would commit")),
 		OPT_BOOL(0, "unsafe-paths", &unsafe_paths,
 			N_("accept a patch that touches outside the working area")),
 		OPT_BOOL(0, "apply", &force_apply,
@@ -4613,6 +4617,8 @@ int cmd_apply(int argc, const char **argv, const char *prefix_)
 		apply = 0;
 	if (check_index && is_not_gitdir)
 		die(_("--index outside a repository"));
+	if (write_result_tree && !check_index && !cached)
+		die(_("--write-tree requires --index or --cached"));
 	if (cached) {
 		if (is_not_gitdir)
 			die(_("--cached outside a repository"));
@@ -4621,6 +4627,9 @@ int cmd_apply(int argc, const char **argv, const char *prefix_)
 	if (check_index)
 		unsafe_paths = 0;
 
+	if (check_index)
+		plug_bulk_checkin();
+
 	for (i = 0; i < argc; i++) {
 		const char *arg = argv[i];
 		int fd;
@@ -4670,7 +4679,20 @@ int cmd_apply(int argc, const char **argv, const char *prefix_)
 				whitespace_error);
 	}
 
+	if (check_index)
+		unplug_bulk_checkin();
+
 	if (update_index) {
+		if (write_result_tree && !errs) {
+			/*
+			 * Computing the cache-tree here both answers the
+			 * caller and leaves a valid tree extension in the
+			 * index we are about to write.
+			 */
+			if (update_main_cache_tree(WRITE_TREE_SILENT))
+				die(_("unable to write resulting tree"));
+			printf("%s\n", sha1_to_hex(active_cache_tree->sha1));
+		}
 		if (write_locked_index(&the_index, &lock_file, COMMIT_LOCK))
 			die(_("Unable to write new index file"));
 	}
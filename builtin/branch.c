@@ -372,7 +372,7 @@ static int append_ref(const char *refname, const unsigned char *sha1, int flags,
 		}
 
 		/* Filter with with_commit if specified */
-		if (!is_descendant_of(commit, ref_list->with_commit))
+		if (!commit_contains(commit, ref_list->with_commit))
 			return 0;
 
 		if (merge_filter != NO_FILTER)
@@ -611,7 +611,7 @@ static void show_detached(struct ref_list *ref_list)
 {
 	struct commit *head_commit = lookup_commit_reference_gently(head_sha1, 1);
 
-	if (head_commit && is_descendant_of(head_commit, ref_list->with_commit)) {
+	if (head_commit && commit_contains(head_commit, ref_list->with_commit)) {
 		struct ref_item item;
 		item.name = get_head_description();
 		item.width = utf8_strwidth(item.name);
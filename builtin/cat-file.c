@@ -5,6 +5,7 @@
  */
 #include "cache.h"
 #include "builtin.h"
+#include "blame.h"
 #include "parse-options.h"
 #include "userdiff.h"
 #include "streaming.h"
@@ -225,14 +226,107 @@ static void print_object_or_die(int fd, struct expand_data *data)
 struct batch_options {
 	int enabled;
 	int print_contents;
+	int unordered;
 	const char *format;
 };
 
-static int batch_one_object(const char *obj_name, struct batch_options *opt,
-			    struct expand_data *data)
+static void batch_object_write(struct batch_options *opt,
+			       struct expand_data *data)
 {
 	struct strbuf buf = STRBUF_INIT;
 
+	strbuf_expand(&buf, opt->format, expand_format, data);
+	strbuf_addch(&buf, '\n');
+	write_or_die(1, buf.buf, buf.len);
+	strbuf_release(&buf);
+
+	if (opt->print_contents) {
+		print_object_or_die(1, data);
+		write_or_die(1, "\n", 1);
+	}
+}
+
+/*
+ * In --unordered mode we delay the output until all requests have been
+ * read, so that we can sort them by their location in the pack files
+ * and turn random access into a sequential sweep.
+ */
+struct queued_object {
+	unsigned char sha1[20];
+	enum object_type type;
+	unsigned long size;
+	unsigned long disk_size;
+	unsigned char delta_base_sha1[20];
+	char *rest;
+	struct packed_git *pack;
+	off_t offset;
+};
+
+static struct queued_object *queued_objects;
+static int queued_nr, queued_alloc;
+
+static int queued_object_cmp(const void *va, const void *vb)
+{
+	const struct queued_object *a = va, *b = vb;
+
+	/* Group by pack file, loose objects first. */
+	if (a->pack != b->pack)
+		return a->pack < b->pack ? -1 : 1;
+	if (a->offset != b->offset)
+		return a->offset < b->offset ? -1 : 1;
+	return 0;
+}
+
+static void queue_object(struct expand_data *data)
+{
+	struct queued_object *q;
+
+	ALLOC_GROW(queued_objects, queued_nr + 1, queued_alloc);
+	q = &queued_objects[queued_nr++];
+	hashcpy(q->sha1, data->sha1);
+	q->type = data->type;
+	q->size = data->size;
+	q->disk_size = data->disk_size;
+	hashcpy(q->delta_base_sha1, data->delta_base_sha1);
+	q->rest = data->rest ? xstrdup(data->rest) : NULL;
+	if (data->info.whence == OI_PACKED) {
+		q->pack = data->info.u.packed.pack;
+		q->offset = data->info.u.packed.offset;
+	} else {
+		q->pack = NULL;
+		q->offset = 0;
+	}
+}
+
+static void write_queued_objects(struct batch_options *opt,
+				 struct expand_data *data)
+{
+	int i;
+
+	qsort(queued_objects, queued_nr, sizeof(*queued_objects),
+	      queued_object_cmp);
+
+	for (i = 0; i < queued_nr; i++) {
+		struct queued_object *q = &queued_objects[i];
+
+		hashcpy(data->sha1, q->sha1);
+		data->type = q->type;
+		data->size = q->size;
+		data->disk_size = q->disk_size;
+		hashcpy(data->delta_base_sha1, q->delta_base_sha1);
+		data->rest = q->rest;
+		batch_object_write(opt, data);
+		free(q->rest);
+	}
+
+	free(queued_objects);
+	queued_objects = NULL;
+	queued_nr = queued_alloc = 0;
+}
+
+static int batch_one_object(const char *obj_name, struct batch_options *opt,
+			    struct expand_data *data)
+{
 	if (!obj_name)
 	   return 1;
 
@@ -248,15 +342,10 @@ static int batch_one_object(const char *obj_name, struct batch_options *opt,
 		return 0;
 	}
 
-	strbuf_expand(&buf, opt->format, expand_format, data);
-	strbuf_addch(&buf, '\n');
-	write_or_die(1, buf.buf, buf.len);
-	strbuf_release(&buf);
-
-	if (opt->print_contents) {
-		print_object_or_die(1, data);
-		write_or_die(1, "\n", 1);
-	}
+	if (opt->unordered)
+		queue_object(data);
+	else
+		batch_object_write(opt, data);
 	return 0;
 }
 
@@ -317,6 +406,9 @@ static int batch_objects(struct batch_options *opt)
 			break;
 	}
 
+	if (opt->unordered && !retval)
+		write_queued_objects(opt, &data);
+
 	strbuf_release(&buf);
 	warn_on_object_refname_ambiguity = save_warning;
 	return retval;
@@ -375,6 +467,8 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 		{ OPTION_CALLBACK, 0, "batch-check", &batch, "format",
 			N_("show info about objects fed from the standard input"),
 			PARSE_OPT_OPTARG, batch_option_callback },
+		OPT_BOOL(0, "unordered", &batch.unordered,
+			 N_("with --batch or --batch-check, output in pack order, not input order")),
 		OPT_END()
 	};
 
@@ -402,6 +496,10 @@ int cmd_cat_file(int argc, const char **argv, const char *prefix)
 		usage_with_options(cat_file_usage, options);
 	}
 
+	if (batch.unordered && !batch.enabled) {
+		usage_with_options(cat_file_usage, options);
+	}
+
 	if (batch.enabled)
 		return batch_objects(&batch);
 
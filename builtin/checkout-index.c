@@ -17,6 +17,28 @@ static int to_tempfile;
 static char topath[4][TEMPORARY_FILENAME_LENGTH + 1];
 
 static struct checkout state;
+static struct index_state clone_index;
+
+static void setup_clone_worktree(const char *dir)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *gitdir;
+
+	strbuf_addf(&buf, "%s/.git", dir);
+	gitdir = resolve_gitdir(buf.buf);
+	if (!gitdir)
+		die("'%s' does not look like a worktree", dir);
+	gitdir = xstrdup(gitdir);
+	strbuf_reset(&buf);
+	strbuf_addf(&buf, "%s/index", gitdir);
+	if (read_index_from(&clone_index, buf.buf) < 0)
+		die("cannot read the index of worktree '%s'", dir);
+	strbuf_release(&buf);
+	free((char *)gitdir);
+
+	state.clone_worktree = dir;
+	state.clone_worktree_index = &clone_index;
+}
 
 static void write_tempfile_record(const char *name, const char *prefix)
 {
@@ -183,6 +205,7 @@ int cmd_checkout_index(int argc, const char **argv, const char *prefix)
 	int read_from_stdin = 0;
 	int prefix_length;
 	int force = 0, quiet = 0, not_new = 0;
+	const char *clone_from = NULL;
 	struct option builtin_checkout_index_options[] = {
 		OPT_BOOL('a', "all", &all,
 			N_("check out all files in the index")),
@@ -207,6 +230,8 @@ int cmd_checkout_index(int argc, const char **argv, const char *prefix)
 		OPT_CALLBACK(0, "stage", NULL, NULL,
 			N_("copy out the files from named stage"),
 			option_parse_stage),
+		OPT_STRING(0, "clone-from", &clone_from, N_("dir"),
+			N_("clone identical clean files from an existing worktree")),
 		OPT_END()
 	};
 
@@ -227,6 +252,9 @@ int cmd_checkout_index(int argc, const char **argv, const char *prefix)
 	state.quiet = quiet;
 	state.not_new = not_new;
 
+	if (clone_from)
+		setup_clone_worktree(clone_from);
+
 	if (state.base_dir_len || to_tempfile) {
 		/* when --prefix is specified we do not
 		 * want to update cache.
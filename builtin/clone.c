@@ -17,6 +17,7 @@
 #include "tree-walk.h"
 #include "unpack-trees.h"
 #include "transport.h"
+#include "narrow.h"
 #include "strbuf.h"
 #include "dir.h"
 #include "sigchain.h"
@@ -49,6 +50,8 @@ static int option_verbosity;
 static int option_progress = -1;
 static struct string_list option_config;
 static struct string_list option_reference;
+static struct string_list option_narrow;
+static int option_no_blobs;
 static int option_dissociate;
 
 static int opt_parse_reference(const struct option *opt, const char *arg, int unset)
@@ -93,6 +96,10 @@ static struct option builtin_clone_options[] = {
 		   N_("path to git-upload-pack on the remote")),
 	OPT_STRING(0, "depth", &option_depth, N_("depth"),
 		    N_("create a shallow clone of that depth")),
+	OPT_STRING_LIST(0, "narrow", &option_narrow, N_("path"),
+		    N_("clone only the objects needed for <path>")),
+	OPT_BOOL(0, "no-blobs", &option_no_blobs,
+		    N_("clone commits and trees only, fetch blobs on demand")),
 	OPT_BOOL(0, "single-branch", &option_single_branch,
 		    N_("clone only one branch, HEAD or --branch")),
 	OPT_BOOL(0, "dissociate", &option_dissociate,
@@ -356,6 +363,16 @@ static void copy_or_link_directory(struct strbuf *src, struct strbuf *dest,
 			continue;
 		}
 
+		/*
+		 * The loose-object counter is mutable bookkeeping;
+		 * hardlinking it would let appends in one repository
+		 * inflate the other's count.  The clone starts without
+		 * one and falls back to a scan.
+		 */
+		if (!strcmp(src->buf + src_baselen,
+			    "/info/loose-object-count"))
+			continue;
+
 		if (unlink(dest->buf) && errno != ENOENT)
 			die_errno(_("failed to unlink '%s'"), dest->buf);
 		if (!option_no_hardlinks) {
@@ -610,6 +627,29 @@ static void update_head(const struct ref *our, const struct ref *remote,
 	}
 }
 
+/*
+ * A narrow clone only has the objects for the requested paths, so
+ * point sparse checkout at the same paths; a full checkout would die
+ * on the missing blobs.
+ */
+static void setup_narrow_checkout(void)
+{
+	struct string_list_item *item;
+	FILE *fp;
+
+	if (!option_narrow.nr || option_bare)
+		return;
+	fp = fopen(git_path("info/sparse-checkout"), "w");
+	if (!fp)
+		die_errno(_("could not write '%s'"),
+			  git_path("info/sparse-checkout"));
+	for_each_string_list_item(item, &option_narrow)
+		fprintf(fp, "/%s/\n", item->string);
+	fclose(fp);
+	git_config_set("core.sparsecheckout", "true");
+	core_apply_sparse_checkout = 1;
+}
+
 static int checkout(void)
 {
 	unsigned char sha1[20];
@@ -916,6 +956,16 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 				warning(_("source repository is shallow, ignoring --local"));
 			is_local = 0;
 		}
+		if (option_narrow.nr) {
+			if (option_local > 0)
+				warning(_("--narrow is incompatible with --local"));
+			is_local = 0;
+		}
+		if (option_no_blobs) {
+			if (option_local > 0)
+				warning(_("--no-blobs is incompatible with --local"));
+			is_local = 0;
+		}
 	}
 	if (option_local > 0 && !is_local)
 		warning(_("--local is ignored"));
@@ -929,6 +979,22 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 	if (option_depth)
 		transport_set_option(transport, TRANS_OPT_DEPTH,
 				     option_depth);
+	if (option_narrow.nr) {
+		struct string_list_item *item;
+		struct strbuf narrow = STRBUF_INIT;
+
+		for_each_string_list_item(item, &option_narrow) {
+			check_narrow_path(item->string);
+			strbuf_addf(&narrow, "%s\n", item->string);
+		}
+		transport_set_option(transport, TRANS_OPT_NARROW,
+				     strbuf_detach(&narrow, NULL));
+	}
+	if (option_no_blobs) {
+		if (option_narrow.nr)
+			die(_("--narrow and --no-blobs are incompatible"));
+		transport_set_option(transport, TRANS_OPT_NO_BLOBS, "1");
+	}
 	if (option_single_branch)
 		transport_set_option(transport, TRANS_OPT_FOLLOWTAGS, "1");
 
@@ -938,7 +1004,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		transport_set_option(transport, TRANS_OPT_UPLOADPACK,
 				     option_upload_pack);
 
-	if (transport->smart_options && !option_depth)
+	if (transport->smart_options && !option_depth && !option_narrow.nr &&
+	    !option_no_blobs)
 		transport->smart_options->check_self_contained_and_connected = 1;
 
 	refs = transport_get_remote_refs(transport);
@@ -1004,7 +1071,8 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		transport_fetch_refs(transport, mapped_refs);
 
 	update_remote_refs(refs, mapped_refs, remote_head_points_at,
-			   branch_top.buf, reflog_msg.buf, transport, !is_local);
+			   branch_top.buf, reflog_msg.buf, transport,
+			   !is_local && !option_narrow.nr && !option_no_blobs);
 
 	update_head(our_head_points_at, remote_head, reflog_msg.buf);
 
@@ -1015,6 +1083,10 @@ int cmd_clone(int argc, const char **argv, const char *prefix)
 		dissociate_from_references();
 
 	junk_mode = JUNK_LEAVE_REPO;
+	setup_narrow_checkout();
+	/* record the origin before checkout; it fetches blobs on demand */
+	if (option_no_blobs)
+		register_blobless_origin(repo);
 	err = checkout();
 
 	strbuf_release(&reflog_msg);
@@ -32,6 +32,7 @@
 #include "sequencer.h"
 #include "notes-utils.h"
 #include "mailmap.h"
+#include "bulk-checkin.h"
 
 static const char * const builtin_commit_usage[] = {
 	N_("git commit [<options>] [--] <pathspec>..."),
@@ -115,6 +116,7 @@ static int edit_flag = -1; /* unspecified */
 static int quiet, verbose, no_verify, allow_empty, dry_run, renew_authorship;
 static int no_post_rewrite, allow_empty_message;
 static char *untracked_files_arg, *force_date, *ignore_submodule_arg;
+static char *status_sections_arg;
 static char *sign_commit;
 
 /*
@@ -144,6 +146,7 @@ static enum status_format {
 	STATUS_FORMAT_LONG,
 	STATUS_FORMAT_SHORT,
 	STATUS_FORMAT_PORCELAIN,
+	STATUS_FORMAT_COUNTS,
 
 	STATUS_FORMAT_UNSPECIFIED
 } status_format = STATUS_FORMAT_UNSPECIFIED;
@@ -404,7 +407,7 @@ static const char *prepare_index(int argc, const char **argv, const char *prefix
 		hold_locked_index(&index_lock, 1);
 		refresh_cache_or_die(refresh_flags);
 		if (active_cache_changed
-		    || !cache_tree_fully_valid(active_cache_tree)) {
+		    || !cache_tree_fully_valid(index_cache_tree(&the_index))) {
 			update_main_cache_tree(WRITE_TREE_SILENT);
 			active_cache_changed = 1;
 		}
@@ -457,7 +460,12 @@ static const char *prepare_index(int argc, const char **argv, const char *prefix
 
 	hold_locked_index(&index_lock, 1);
 	add_remove_files(&partial);
-	refresh_cache(REFRESH_QUIET);
+	/*
+	 * Only the named paths can have gone stale; refreshing the
+	 * rest of a large index costs one lstat() per entry for no
+	 * benefit to the commit we are creating.
+	 */
+	refresh_index(&the_index, REFRESH_QUIET, &pathspec, NULL, NULL);
 	update_main_cache_tree(WRITE_TREE_SILENT);
 	if (write_locked_index(&the_index, &index_lock, CLOSE_LOCK))
 		die(_("unable to write new_index file"));
@@ -469,7 +477,7 @@ static const char *prepare_index(int argc, const char **argv, const char *prefix
 
 	create_base_index(current_head);
 	add_remove_files(&partial);
-	refresh_cache(REFRESH_QUIET);
+	refresh_index(&the_index, REFRESH_QUIET, &pathspec, NULL, NULL);
 
 	if (write_locked_index(&the_index, &false_lock, CLOSE_LOCK))
 		die(_("unable to write temporary index file"));
@@ -507,6 +515,9 @@ static int run_status(FILE *fp, const char *index_file, const char *prefix, int
 	case STATUS_FORMAT_PORCELAIN:
 		wt_porcelain_print(s);
 		break;
+	case STATUS_FORMAT_COUNTS:
+		wt_counts_print(s);
+		break;
 	case STATUS_FORMAT_UNSPECIFIED:
 		die("BUG: finalize_deferred_config() should have been called");
 		break;
@@ -1070,6 +1081,37 @@ static void handle_untracked_files_arg(struct wt_status *s)
 		die(_("Invalid untracked files mode '%s'"), untracked_files_arg);
 }
 
+static void handle_sections_arg(struct wt_status *s)
+{
+	struct string_list sections = STRING_LIST_INIT_DUP;
+	enum untracked_status_type untracked = s->show_untracked_files;
+	int i;
+
+	if (!status_sections_arg)
+		return; /* default: collect everything */
+
+	if (untracked == SHOW_NO_UNTRACKED_FILES)
+		untracked = SHOW_NORMAL_UNTRACKED_FILES;
+	s->show_staged_changes = 0;
+	s->show_unstaged_changes = 0;
+	s->show_untracked_files = SHOW_NO_UNTRACKED_FILES;
+
+	string_list_split(&sections, status_sections_arg, ',', -1);
+	for (i = 0; i < sections.nr; i++) {
+		const char *section = sections.items[i].string;
+
+		if (!strcmp(section, "staged"))
+			s->show_staged_changes = 1;
+		else if (!strcmp(section, "unstaged"))
+			s->show_unstaged_changes = 1;
+		else if (!strcmp(section, "untracked"))
+			s->show_untracked_files = untracked;
+		else
+			die(_("Invalid status section '%s'"), section);
+	}
+	string_list_clear(&sections, 0);
+}
+
 static const char *read_commit_message(const char *name)
 {
 	const char *out_enc;
@@ -1327,11 +1369,16 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 		OPT_SET_INT(0, "porcelain", &status_format,
 			    N_("machine-readable output"),
 			    STATUS_FORMAT_PORCELAIN),
+		OPT_SET_INT(0, "counts", &status_format,
+			    N_("show machine-readable counters only"),
+			    STATUS_FORMAT_COUNTS),
 		OPT_SET_INT(0, "long", &status_format,
 			    N_("show status in long format (default)"),
 			    STATUS_FORMAT_LONG),
 		OPT_BOOL('z', "null", &s.null_termination,
 			 N_("terminate entries with NUL")),
+		OPT_STRING(0, "sections", &status_sections_arg, N_("sections"),
+			   N_("limit status to the listed comma-separated sections (staged, unstaged, untracked)")),
 		{ OPTION_STRING, 'u', "untracked-files", &untracked_files_arg,
 		  N_("mode"),
 		  N_("show untracked files, optional modes: all, normal, no. (Default: all)"),
@@ -1356,6 +1403,7 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 	finalize_deferred_config(&s);
 
 	handle_untracked_files_arg(&s);
+	handle_sections_arg(&s);
 	if (show_ignored_in_status)
 		s.show_ignored_files = 1;
 	parse_pathspec(&s.pathspec, 0,
@@ -1366,13 +1414,19 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 	refresh_index(&the_index, REFRESH_QUIET|REFRESH_UNMERGED, &s.pathspec, NULL, NULL);
 
 	fd = hold_locked_index(&index_lock, 0);
-	if (0 <= fd)
-		update_index_if_able(&the_index, &index_lock);
 
 	s.is_initial = get_sha1(s.reference, sha1) ? 1 : 0;
 	s.ignore_submodule_arg = ignore_submodule_arg;
 	wt_status_collect(&s);
 
+	/*
+	 * The collection phase may have filled in data (such as the
+	 * untracked cache) that wants to be written back; do that
+	 * after it has run, not before.
+	 */
+	if (0 <= fd)
+		update_index_if_able(&the_index, &index_lock);
+
 	if (s.relative_paths)
 		s.prefix = prefix;
 
@@ -1383,6 +1437,9 @@ int cmd_status(int argc, const char **argv, const char *prefix)
 	case STATUS_FORMAT_PORCELAIN:
 		wt_porcelain_print(&s);
 		break;
+	case STATUS_FORMAT_COUNTS:
+		wt_counts_print(&s);
+		break;
 	case STATUS_FORMAT_UNSPECIFIED:
 		die("BUG: finalize_deferred_config() should have been called");
 		break;
@@ -1655,6 +1712,8 @@ int cmd_commit(int argc, const char **argv, const char *prefix)
 					  prefix, current_head, &s);
 	if (dry_run)
 		return dry_run_commit(argc, argv, prefix, current_head, &s);
+
+	plug_bulk_checkin();
 	index_file = prepare_index(argc, argv, prefix, current_head, 0);
 
 	/* Set up everything for writing the commit object.  This includes
@@ -1764,6 +1823,9 @@ int cmd_commit(int argc, const char **argv, const char *prefix)
 	strbuf_insert(&sb, 0, reflog_msg, strlen(reflog_msg));
 	strbuf_insert(&sb, strlen(reflog_msg), ": ", 2);
 
+	/* Make sure the new objects hit the disk before HEAD points at them */
+	unplug_bulk_checkin();
+
 	transaction = ref_transaction_begin(&err);
 	if (!transaction ||
 	    ref_transaction_update(transaction, "HEAD", sha1,
@@ -9,6 +9,7 @@
 #include "diff.h"
 #include "hashmap.h"
 #include "argv-array.h"
+#include "string-list.h"
 
 #define SEEN		(1u << 0)
 #define MAX_TAGS	(FLAG_BITS - 1)
@@ -235,6 +236,132 @@ static void show_suffix(int depth, const unsigned char *sha1)
 	printf("-%d-g%s", depth, find_unique_abbrev(sha1, abbrev));
 }
 
+/*
+ * Optional result cache (describe.cache), for callers that run
+ * describe over and over in a repository whose refs rarely change.
+ *
+ * $GIT_DIR/describe-cache holds one header line
+ *
+ *	describe-cache 1 <state>
+ *
+ * followed by "<commit> <depth> <peeled>" lines giving, for each
+ * described commit, the depth and the peeled object of the winning
+ * ref.  <state> is a SHA-1 over every ref (name and value) and over
+ * the options that influence which name wins, so any ref update or a
+ * differently-filtered invocation simply ignores the file and
+ * rewrites it.  A hit costs one binary search plus a lookup in the
+ * already-loaded ref names instead of a history walk.
+ */
+static int use_cache;
+static int cache_dirty;
+static unsigned char cache_state[20];
+static struct string_list cache_entries = STRING_LIST_INIT_DUP;
+
+static int hash_one_ref(const char *path, const unsigned char *sha1, int flag, void *cb_data)
+{
+	git_SHA_CTX *ctx = cb_data;
+
+	git_SHA1_Update(ctx, path, strlen(path) + 1);
+	git_SHA1_Update(ctx, sha1, 20);
+	return 0;
+}
+
+static void compute_cache_state(void)
+{
+	git_SHA_CTX ctx;
+	struct strbuf buf = STRBUF_INIT;
+
+	strbuf_addf(&buf, "all:%d tags:%d first-parent:%d candidates:%d match:%s\n",
+		    all, tags, first_parent, max_candidates,
+		    pattern ? pattern : "");
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, buf.buf, buf.len);
+	for_each_rawref(hash_one_ref, &ctx);
+	git_SHA1_Final(cache_state, &ctx);
+	strbuf_release(&buf);
+}
+
+static void load_describe_cache(void)
+{
+	struct strbuf line = STRBUF_INIT;
+	unsigned char state[20];
+	const char *hex;
+	FILE *fp;
+
+	compute_cache_state();
+	fp = fopen(git_path("describe-cache"), "r");
+	if (!fp)
+		return;
+	if (strbuf_getline(&line, fp, '\n') ||
+	    !skip_prefix(line.buf, "describe-cache 1 ", &hex) ||
+	    get_sha1_hex(hex, state) ||
+	    hashcmp(state, cache_state)) {
+		/* stale or unrecognized; it will be rewritten */
+		strbuf_release(&line);
+		fclose(fp);
+		return;
+	}
+	while (!strbuf_getline(&line, fp, '\n')) {
+		struct string_list_item *item;
+
+		if (line.len < 42 || line.buf[40] != ' ')
+			continue;
+		line.buf[40] = '\0';
+		item = string_list_insert(&cache_entries, line.buf);
+		free(item->util);
+		item->util = xstrdup(line.buf + 41);
+	}
+	strbuf_release(&line);
+	fclose(fp);
+}
+
+static struct commit_name *lookup_describe_cache(const unsigned char *sha1, int *depth)
+{
+	struct string_list_item *item;
+	unsigned char peeled[20];
+	char *end;
+
+	item = string_list_lookup(&cache_entries, sha1_to_hex(sha1));
+	if (!item || !item->util)
+		return NULL;
+	*depth = strtoul(item->util, &end, 10);
+	if (*end != ' ' || get_sha1_hex(end + 1, peeled))
+		return NULL;
+	return find_commit_name(peeled);
+}
+
+static void store_describe_cache(const unsigned char *sha1, const unsigned char *peeled, int depth)
+{
+	struct string_list_item *item;
+
+	item = string_list_insert(&cache_entries, sha1_to_hex(sha1));
+	if (item->util)
+		return;
+	item->util = xstrfmt("%d %s", depth, sha1_to_hex(peeled));
+	cache_dirty = 1;
+}
+
+static void write_describe_cache(void)
+{
+	static struct lock_file cache_lock;
+	FILE *fp;
+	int i;
+
+	if (hold_lock_file_for_update(&cache_lock,
+				      git_path("describe-cache"), 0) < 0)
+		return;	/* somebody else is rewriting it; no harm done */
+	fp = fdopen_lock_file(&cache_lock, "w");
+	if (!fp) {
+		rollback_lock_file(&cache_lock);
+		return;
+	}
+	fprintf(fp, "describe-cache 1 %s\n", sha1_to_hex(cache_state));
+	for (i = 0; i < cache_entries.nr; i++)
+		fprintf(fp, "%s %s\n", cache_entries.items[i].string,
+			(const char *)cache_entries.items[i].util);
+	commit_lock_file(&cache_lock);
+}
+
 static void describe(const char *arg, int last_one)
 {
 	unsigned char sha1[20];
@@ -268,6 +395,22 @@ static void describe(const char *arg, int last_one)
 
 	if (!max_candidates)
 		die(_("no tag exactly matches '%s'"), sha1_to_hex(cmit->object.sha1));
+
+	if (use_cache) {
+		int depth;
+
+		n = lookup_describe_cache(cmit->object.sha1, &depth);
+		if (n) {
+			display_name(n);
+			if (abbrev)
+				show_suffix(depth, cmit->object.sha1);
+			if (dirty)
+				printf("%s", dirty);
+			printf("\n");
+			return;
+		}
+	}
+
 	if (debug)
 		fprintf(stderr, _("searching to describe %s\n"), arg);
 
@@ -385,10 +528,24 @@ static void describe(const char *arg, int last_one)
 		printf("%s", dirty);
 	printf("\n");
 
+	if (use_cache)
+		store_describe_cache(cmit->object.sha1,
+				     all_matches[0].name->peeled,
+				     all_matches[0].depth);
+
 	if (!last_one)
 		clear_commit_marks(cmit, -1);
 }
 
+static int git_describe_config(const char *var, const char *value, void *cb)
+{
+	if (!strcmp(var, "describe.cache")) {
+		use_cache = git_config_bool(var, value);
+		return 0;
+	}
+	return git_default_config(var, value, cb);
+}
+
 int cmd_describe(int argc, const char **argv, const char *prefix)
 {
 	int contains = 0;
@@ -414,7 +571,7 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 		OPT_END(),
 	};
 
-	git_config(git_default_config, NULL);
+	git_config(git_describe_config, NULL);
 	argc = parse_options(argc, argv, prefix, options, describe_usage, 0);
 	if (abbrev < 0)
 		abbrev = DEFAULT_ABBREV;
@@ -454,6 +611,8 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 	for_each_rawref(get_name, NULL);
 	if (!names.size && !always)
 		die(_("No names found, cannot describe anything."));
+	if (use_cache)
+		load_describe_cache();
 
 	if (argc == 0) {
 		if (dirty) {
@@ -478,5 +637,7 @@ int cmd_describe(int argc, const char **argv, const char *prefix)
 		while (argc-- > 0)
 			describe(*argv++, argc == 0);
 	}
+	if (cache_dirty)
+		write_describe_cache();
 	return 0;
 }
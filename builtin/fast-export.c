@@ -19,6 +19,7 @@
 #include "quote.h"
 #include "remote.h"
 #include "blob.h"
+#include "streaming.h"
 
 static const char *fast_export_usage[] = {
 	N_("git fast-export [rev-list-opts]"),
@@ -229,6 +230,27 @@ static void export_blob(const unsigned char *sha1)
 	if (object && object->flags & SHOWN)
 		return;
 
+	if (!anonymize &&
+	    sha1_object_info(sha1, &size) == OBJ_BLOB &&
+	    size > big_file_threshold) {
+		/*
+		 * Stream the data straight from the object store
+		 * instead of inflating the whole blob into memory.
+		 */
+		object = (struct object *)lookup_blob(sha1);
+		if (!object)
+			die("Could not read blob %s", sha1_to_hex(sha1));
+		mark_next_object(object);
+		printf("blob\nmark :%"PRIu32"\ndata %lu\n", last_idnum, size);
+		fflush(stdout);
+		if (stream_blob_to_fd(1, sha1, NULL, 0))
+			die("Could not stream blob %s", sha1_to_hex(sha1));
+		printf("\n");
+		show_progress();
+		object->flags |= SHOWN;
+		return;
+	}
+
 	if (anonymize) {
 		buf = anonymize_blob(&size);
 		object = (struct object *)lookup_blob(sha1);
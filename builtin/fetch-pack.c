@@ -8,7 +8,8 @@
 static const char fetch_pack_usage[] =
 "git fetch-pack [--all] [--stdin] [--quiet | -q] [--keep | -k] [--thin] "
 "[--include-tag] [--upload-pack=<git-upload-pack>] [--depth=<n>] "
-"[--no-progress] [--diag-url] [-v] [<host>:]<directory> [<refs>...]";
+"[--no-progress] [--diag-url] [--resume-to=<path>] [-v] "
+"[<host>:]<directory> [<refs>...]";
 
 static void add_sought_entry_mem(struct ref ***sought, int *nr, int *alloc,
 				 const char *name, int namelen)
@@ -20,6 +21,9 @@ static void add_sought_entry_mem(struct ref ***sought, int *nr, int *alloc,
 		hashcpy(ref->old_sha1, sha1);
 		name += 41;
 		namelen -= 41;
+	} else if (namelen == 40 && !get_sha1_hex(name, sha1)) {
+		/* a bare object name can be sought when the server allows it */
+		hashcpy(ref->old_sha1, sha1);
 	}
 
 	memcpy(ref->name, name, namelen);
@@ -127,6 +131,14 @@ int cmd_fetch_pack(int argc, const char **argv, const char *prefix)
 			args.update_shallow = 1;
 			continue;
 		}
+		if (!strcmp("--no-haves", arg)) {
+			args.no_haves = 1;
+			continue;
+		}
+		if (starts_with(arg, "--resume-to=")) {
+			args.resume_to = arg + 12;
+			continue;
+		}
 		usage(fetch_pack_usage);
 	}
 
@@ -2,6 +2,7 @@
  * "git fetch"
  */
 #include "cache.h"
+#include "lockfile.h"
 #include "refs.h"
 #include "commit.h"
 #include "builtin.h"
@@ -13,6 +14,7 @@
 #include "sigchain.h"
 #include "submodule.h"
 #include "connected.h"
+#include "narrow.h"
 #include "argv-array.h"
 
 static const char * const builtin_fetch_usage[] = {
@@ -34,6 +36,11 @@ static int prune = -1; /* unspecified */
 #define PRUNE_BY_DEFAULT 0 /* do we prune by default? */
 
 static int all, append, dry_run, force, keep, multiple, update_head_ok, verbosity;
+static int atomic_fetch;
+static int max_children = -1; /* unspecified */
+static int fetch_parallel_config = 1;
+static int fetch_quick_check;
+static int submodule_fetch_jobs_config = 1;
 static int progress = -1, recurse_submodules = RECURSE_SUBMODULES_DEFAULT;
 static int tags = TAGS_DEFAULT, unshallow, update_shallow;
 static const char *depth;
@@ -67,6 +74,22 @@ static int git_fetch_config(const char *k, const char *v, void *cb)
 		fetch_prune_config = git_config_bool(k, v);
 		return 0;
 	}
+	if (!strcmp(k, "fetch.quickcheck")) {
+		fetch_quick_check = git_config_bool(k, v);
+		return 0;
+	}
+	if (!strcmp(k, "fetch.parallel")) {
+		fetch_parallel_config = git_config_int(k, v);
+		if (fetch_parallel_config < 0)
+			die(_("fetch.parallel cannot be negative"));
+		return 0;
+	}
+	if (!strcmp(k, "submodule.fetchjobs")) {
+		submodule_fetch_jobs_config = git_config_int(k, v);
+		if (submodule_fetch_jobs_config < 0)
+			die(_("submodule.fetchJobs cannot be negative"));
+		return 0;
+	}
 	return git_default_config(k, v, cb);
 }
 
@@ -100,11 +123,15 @@ static struct option builtin_fetch_options[] = {
 		    N_("do not fetch all tags (--no-tags)"), TAGS_UNSET),
 	OPT_BOOL('p', "prune", &prune,
 		 N_("prune remote-tracking branches no longer on remote")),
+	OPT_INTEGER('j', "jobs", &max_children,
+		    N_("number of remotes or submodules fetched in parallel")),
 	{ OPTION_CALLBACK, 0, "recurse-submodules", NULL, N_("on-demand"),
 		    N_("control recursive fetching of submodules"),
 		    PARSE_OPT_OPTARG, option_parse_recurse_submodules },
 	OPT_BOOL(0, "dry-run", &dry_run,
 		 N_("dry run")),
+	OPT_BOOL(0, "atomic", &atomic_fetch,
+		 N_("update local refs in a single transaction")),
 	OPT_BOOL('k', "keep", &keep, N_("keep downloaded pack")),
 	OPT_BOOL('u', "update-head-ok", &update_head_ok,
 		    N_("allow updating of HEAD ref")),
@@ -397,13 +424,21 @@ static struct ref *get_ref_map(struct transport *transport,
 #define STORE_REF_ERROR_OTHER 1
 #define STORE_REF_ERROR_DF_CONFLICT 2
 
+/*
+ * If --atomic is given, all local ref updates of a fetch are queued
+ * up in this transaction and committed at the end of
+ * store_updated_refs(); otherwise each update gets a transaction of
+ * its own.
+ */
+static struct ref_transaction *transaction;
+
 static int s_update_ref(const char *action,
 			struct ref *ref,
 			int check_old)
 {
 	char msg[1024];
 	char *rla = getenv("GIT_REFLOG_ACTION");
-	struct ref_transaction *transaction;
+	struct ref_transaction *our_transaction = NULL;
 	struct strbuf err = STRBUF_INIT;
 	int ret, df_conflict = 0;
 
@@ -413,25 +448,33 @@ static int s_update_ref(const char *action,
 		rla = default_rla.buf;
 	snprintf(msg, sizeof(msg), "%s: %s", rla, action);
 
-	transaction = ref_transaction_begin(&err);
-	if (!transaction ||
-	    ref_transaction_update(transaction, ref->name,
+	if (!transaction) {
+		our_transaction = ref_transaction_begin(&err);
+		if (!our_transaction)
+			goto fail;
+	}
+
+	if (ref_transaction_update(our_transaction ?
+				   our_transaction : transaction,
+				   ref->name,
 				   ref->new_sha1,
 				   check_old ? ref->old_sha1 : NULL,
 				   0, msg, &err))
 		goto fail;
 
-	ret = ref_transaction_commit(transaction, &err);
-	if (ret) {
-		df_conflict = (ret == TRANSACTION_NAME_CONFLICT);
-		goto fail;
+	if (our_transaction) {
+		ret = ref_transaction_commit(our_transaction, &err);
+		if (ret) {
+			df_conflict = (ret == TRANSACTION_NAME_CONFLICT);
+			goto fail;
+		}
 	}
 
-	ref_transaction_free(transaction);
+	ref_transaction_free(our_transaction);
 	strbuf_release(&err);
 	return 0;
 fail:
-	ref_transaction_free(transaction);
+	ref_transaction_free(our_transaction);
 	error("%s", err.buf);
 	strbuf_release(&err);
 	return df_conflict ? STORE_REF_ERROR_DF_CONFLICT
@@ -580,7 +623,7 @@ static int iterate_ref_map(void *cb_data, unsigned char sha1[20])
 }
 
 static int store_updated_refs(const char *raw_url, const char *remote_name,
-		struct ref *ref_map)
+		struct transport *transport, struct ref *ref_map)
 {
 	FILE *fp;
 	struct commit *commit;
@@ -600,12 +643,32 @@ static int store_updated_refs(const char *raw_url, const char *remote_name,
 	else
 		url = xstrdup("foreign");
 
+	/*
+	 * The transport knows whether index-pack has already proven the
+	 * just-received pack self contained and connected, which lets
+	 * the connectivity check skip rev-list for refs that point into
+	 * that pack.
+	 */
 	rm = ref_map;
-	if (check_everything_connected(iterate_ref_map, 0, &rm)) {
+	if (!is_repository_narrow() && !is_repository_blobless() &&
+	    check_everything_connected_with_transport(iterate_ref_map, 0,
+						      &rm, transport)) {
 		rc = error(_("%s did not send all necessary objects\n"), url);
 		goto abort;
 	}
 
+	if (atomic_fetch && !dry_run) {
+		struct strbuf err = STRBUF_INIT;
+
+		transaction = ref_transaction_begin(&err);
+		if (!transaction) {
+			rc = error("%s", err.buf);
+			strbuf_release(&err);
+			goto abort;
+		}
+		strbuf_release(&err);
+	}
+
 	/*
 	 * We do a pass for each fetch_head_status type in their enum order, so
 	 * merged entries are written before not-for-merge. That lets readers
@@ -718,6 +781,23 @@ static int store_updated_refs(const char *raw_url, const char *remote_name,
 		}
 	}
 
+	if (transaction) {
+		if (rc) {
+			error(_("not committing any ref updates because of "
+				"earlier errors"));
+		} else {
+			struct strbuf err = STRBUF_INIT;
+
+			if (ref_transaction_commit(transaction, &err)) {
+				error("%s", err.buf);
+				rc |= STORE_REF_ERROR_OTHER;
+			}
+			strbuf_release(&err);
+		}
+		ref_transaction_free(transaction);
+		transaction = NULL;
+	}
+
 	if (rc & STORE_REF_ERROR_DF_CONFLICT)
 		error(_("some local refs could not be updated; try running\n"
 		      " 'git remote prune %s' to remove any old, conflicting "
@@ -748,18 +828,120 @@ static int quickfetch(struct ref *ref_map)
 	 */
 	if (depth)
 		return -1;
+	/* narrow and blob-less repositories cannot walk their own trees */
+	if (is_repository_narrow() || is_repository_blobless())
+		return -1;
 	return check_everything_connected(iterate_ref_map, 1, &rm);
 }
 
+struct ref_subset {
+	struct ref **refs;
+	int nr, pos;
+};
+
+static int iterate_ref_subset(void *cb_data, unsigned char sha1[20])
+{
+	struct ref_subset *subset = cb_data;
+
+	if (subset->pos >= subset->nr)
+		return -1; /* end of the list */
+	hashcpy(sha1, subset->refs[subset->pos++]->old_sha1);
+	return 0;
+}
+
+/*
+ * The all-or-nothing quickfetch() failed: at least one wanted tip is
+ * missing or disconnected.  Narrow the transfer down to the refs that
+ * are actually affected, so that a fetch bringing in one new branch
+ * does not re-negotiate for the other ninety-nine we already have.
+ * Returns non-zero if the situation calls for a full fetch after all.
+ */
+static int quickfetch_refs(struct transport *transport, struct ref *ref_map)
+{
+	struct ref_subset present = { NULL, 0, 0 };
+	struct ref **need_fetch = NULL, **saved_next;
+	int present_alloc = 0, need_alloc = 0, nr_need = 0;
+	int i, nr_total = 0, ret = -1;
+	struct ref *rm;
+
+	/* the same situations that defeat quickfetch() defeat us */
+	if (depth || is_repository_narrow() || is_repository_blobless())
+		return -1;
+
+	for (rm = ref_map; rm; rm = rm->next) {
+		if (rm->status == REF_STATUS_REJECT_SHALLOW)
+			continue;
+		nr_total++;
+		if (has_sha1_file(rm->old_sha1)) {
+			ALLOC_GROW(present.refs, present.nr + 1, present_alloc);
+			present.refs[present.nr++] = rm;
+		} else {
+			ALLOC_GROW(need_fetch, nr_need + 1, need_alloc);
+			need_fetch[nr_need++] = rm;
+		}
+	}
+
+	/*
+	 * All tips exist but something below one of them is missing;
+	 * we cannot tell which refs are affected, so replay everything.
+	 */
+	if (!nr_need)
+		goto out;
+
+	/*
+	 * The tips we do have are usually all connected; verify them in
+	 * a single pass and only fall back to one rev-list per ref when
+	 * that fails.
+	 */
+	if (present.nr &&
+	    check_everything_connected(iterate_ref_subset, 1, &present)) {
+		for (i = 0; i < present.nr; i++) {
+			struct ref_subset one = { &present.refs[i], 1, 0 };
+
+			if (check_everything_connected(iterate_ref_subset, 1,
+						       &one)) {
+				ALLOC_GROW(need_fetch, nr_need + 1, need_alloc);
+				need_fetch[nr_need++] = present.refs[i];
+			}
+		}
+	}
+
+	if (nr_need >= nr_total)
+		goto out; /* nothing to skip */
+
+	/*
+	 * Temporarily chain the affected refs into a list of their own;
+	 * the transport only follows the links and updates per-ref
+	 * fields, so the map can be stitched back together afterwards.
+	 */
+	saved_next = xmalloc(nr_need * sizeof(*saved_next));
+	for (i = 0; i < nr_need; i++) {
+		saved_next[i] = need_fetch[i]->next;
+		need_fetch[i]->next =
+			(i + 1 < nr_need) ? need_fetch[i + 1] : NULL;
+	}
+	ret = transport_fetch_refs(transport, need_fetch[0]);
+	for (i = 0; i < nr_need; i++)
+		need_fetch[i]->next = saved_next[i];
+	free(saved_next);
+
+out:
+	free(present.refs);
+	free(need_fetch);
+	return ret;
+}
+
 static int fetch_refs(struct transport *transport, struct ref *ref_map)
 {
 	int ret = quickfetch(ref_map);
+	if (ret)
+		ret = quickfetch_refs(transport, ref_map);
 	if (ret)
 		ret = transport_fetch_refs(transport, ref_map);
 	if (!ret)
 		ret |= store_updated_refs(transport->url,
 				transport->remote->name,
-				ref_map);
+				transport, ref_map);
 	transport_unlock_pack(transport);
 	return ret;
 }
@@ -855,6 +1037,13 @@ static struct transport *prepare_transport(struct remote *remote)
 		set_option(transport, TRANS_OPT_DEPTH, depth);
 	if (update_shallow)
 		set_option(transport, TRANS_OPT_UPDATE_SHALLOW, "yes");
+	/*
+	 * Ask index-pack to tell us whether the incoming pack is self
+	 * contained and connected, so that the connectivity check can
+	 * trust refs pointing into it without running rev-list.
+	 */
+	if (transport->smart_options && !depth)
+		transport->smart_options->check_self_contained_and_connected = 1;
 	return transport;
 }
 
@@ -875,13 +1064,179 @@ static void backfill_tags(struct transport *transport, struct ref *ref_map)
 	}
 }
 
+/*
+ * Collect the advertisement prefixes needed to resolve a single fetch
+ * refspec source.  Unqualified sources are matched against the
+ * advertisement with refname_match(), so cover each location the
+ * rev-parse rules would look in.  Returns -1 if the source may match
+ * refs we cannot predict, in which case the full advertisement is
+ * needed.
+ */
+static int refspec_ref_prefix(struct string_list *prefixes,
+			      const struct refspec *refspec)
+{
+	const char *src = refspec->src;
+
+	if (refspec->exact_sha1)
+		return 0; /* needs no advertisement at all */
+	if (!src || !*src)
+		return 0; /* "HEAD", which is always advertised */
+	if (refspec->pattern) {
+		const char *glob = strchr(src, '*');
+		if (!glob || !starts_with(src, "refs/"))
+			return -1;
+		string_list_append_nodup(prefixes,
+					 xmemdupz(src, glob - src));
+	} else if (starts_with(src, "refs/")) {
+		string_list_append(prefixes, src);
+	} else {
+		string_list_append_nodup(prefixes,
+					 xstrfmt("refs/%s", src));
+		string_list_append_nodup(prefixes,
+					 xstrfmt("refs/tags/%s", src));
+		string_list_append_nodup(prefixes,
+					 xstrfmt("refs/heads/%s", src));
+		string_list_append_nodup(prefixes,
+					 xstrfmt("refs/remotes/%s", src));
+	}
+	return 0;
+}
+
+/*
+ * Figure out which ref prefixes get_ref_map() will need from the
+ * advertisement, mirroring its refspec selection.  Returns 0 (leaving
+ * the list alone) if we cannot predict them, e.g. for sources that
+ * tail-match arbitrary refs.
+ */
+static int gather_ref_prefixes(struct string_list *prefixes,
+			       struct transport *transport,
+			       struct refspec *refs, int ref_count)
+{
+	int i;
+
+	if (ref_count) {
+		for (i = 0; i < ref_count; i++)
+			if (refspec_ref_prefix(prefixes, &refs[i]) < 0)
+				goto cannot_limit;
+	} else {
+		struct remote *remote = transport->remote;
+		struct branch *branch = branch_get(NULL);
+		int has_merge = branch_has_merge_config(branch) &&
+			remote && branch->remote_name &&
+			!strcmp(branch->remote_name, remote->name);
+
+		if (remote && (remote->fetch_refspec_nr || has_merge)) {
+			for (i = 0; i < remote->fetch_refspec_nr; i++)
+				if (refspec_ref_prefix(prefixes,
+						       &remote->fetch[i]) < 0)
+					goto cannot_limit;
+			for (i = 0; has_merge && i < branch->merge_nr; i++) {
+				if (!starts_with(branch->merge[i]->src,
+						 "refs/"))
+					goto cannot_limit;
+				string_list_append(prefixes,
+						   branch->merge[i]->src);
+			}
+		}
+		/* otherwise only HEAD is wanted, which is always sent */
+	}
+	if (tags != TAGS_UNSET)
+		string_list_append(prefixes, "refs/tags/");
+	string_list_append(prefixes, "HEAD");
+	return 1;
+
+cannot_limit:
+	string_list_clear(prefixes, 0);
+	return 0;
+}
+
+/*
+ * Hash the remote ref state we are about to fetch together with the
+ * current values of the local tracking refs.  When this digest
+ * matches the one recorded after the previous fetch, nothing has
+ * changed on either side and the whole fetch can be skipped after
+ * the initial ref advertisement.
+ */
+static void compute_ref_state(struct ref *ref_map, unsigned char *sha1)
+{
+	git_SHA_CTX ctx;
+	struct ref *rm;
+
+	git_SHA1_Init(&ctx);
+	for (rm = ref_map; rm; rm = rm->next) {
+		git_SHA1_Update(&ctx, rm->old_sha1, 20);
+		git_SHA1_Update(&ctx, rm->name, strlen(rm->name) + 1);
+		if (rm->peer_ref) {
+			unsigned char local[20];
+
+			if (read_ref(rm->peer_ref->name, local))
+				hashclr(local);
+			git_SHA1_Update(&ctx, local, 20);
+			git_SHA1_Update(&ctx, rm->peer_ref->name,
+					strlen(rm->peer_ref->name) + 1);
+		}
+	}
+	git_SHA1_Final(sha1, &ctx);
+}
+
+static const char *fetch_state_path(struct transport *transport)
+{
+	if (!transport->remote || !transport->remote->name)
+		return NULL;
+	return git_path("fetch-state/%s", transport->remote->name);
+}
+
+static int ref_state_unchanged(struct transport *transport,
+			       const unsigned char *sha1)
+{
+	const char *path = fetch_state_path(transport);
+	struct strbuf buf = STRBUF_INIT;
+	unsigned char old[20];
+	int ret;
+
+	if (!path)
+		return 0;
+	if (strbuf_read_file(&buf, path, 41) <= 0) {
+		strbuf_release(&buf);
+		return 0;
+	}
+	strbuf_trim(&buf);
+	ret = !get_sha1_hex(buf.buf, old) && !hashcmp(old, sha1);
+	strbuf_release(&buf);
+	return ret;
+}
+
+static void record_ref_state(struct transport *transport,
+			     const unsigned char *sha1)
+{
+	static struct lock_file lock;
+	const char *path = fetch_state_path(transport);
+	struct strbuf buf = STRBUF_INIT;
+	int fd;
+
+	if (!path || safe_create_leading_directories_const(path))
+		return;
+	fd = hold_lock_file_for_update(&lock, path, 0);
+	if (fd < 0)
+		return; /* advisory only */
+	strbuf_addf(&buf, "%s\n", sha1_to_hex(sha1));
+	if (write_in_full(fd, buf.buf, buf.len) < 0)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+	strbuf_release(&buf);
+}
+
 static int do_fetch(struct transport *transport,
 		    struct refspec *refs, int ref_count)
 {
 	struct string_list existing_refs = STRING_LIST_INIT_DUP;
+	struct string_list ref_prefixes = STRING_LIST_INIT_DUP;
 	struct ref *ref_map;
 	struct ref *rm;
 	int autotags = (transport->remote->fetch_tags == 1);
+	int quick_check = fetch_quick_check && prune <= 0 && !dry_run;
+	unsigned char ref_state[20];
 	int retcode = 0;
 
 	for_each_ref(add_existing, &existing_refs);
@@ -896,12 +1251,8 @@ static int do_fetch(struct transport *transport,
 	if (!transport->get_refs_list || !transport->fetch)
 		die(_("Don't know how to fetch from %s"), transport->url);
 
-	/* if not appending, truncate FETCH_HEAD */
-	if (!append && !dry_run) {
-		retcode = truncate_fetch_head();
-		if (retcode)
-			goto cleanup;
-	}
+	if (gather_ref_prefixes(&ref_prefixes, transport, refs, ref_count))
+		transport->ref_prefixes = &ref_prefixes;
 
 	ref_map = get_ref_map(transport, refs, ref_count, tags, &autotags);
 	if (!update_head_ok)
@@ -918,6 +1269,32 @@ static int do_fetch(struct transport *transport,
 		}
 	}
 
+	/*
+	 * If neither end moved since the state we recorded after the
+	 * last fetch, stop right after the ref advertisement; no
+	 * negotiation is set up and FETCH_HEAD is left untouched.
+	 */
+	if (quick_check) {
+		compute_ref_state(ref_map, ref_state);
+		if (ref_state_unchanged(transport, ref_state)) {
+			if (verbosity > 0)
+				fprintf(stderr,
+					_("Nothing changed on %s, skipping fetch\n"),
+					transport->remote->name);
+			free_refs(ref_map);
+			goto cleanup;
+		}
+	}
+
+	/* if not appending, truncate FETCH_HEAD */
+	if (!append && !dry_run) {
+		retcode = truncate_fetch_head();
+		if (retcode) {
+			free_refs(ref_map);
+			goto cleanup;
+		}
+	}
+
 	if (tags == TAGS_DEFAULT && autotags)
 		transport_set_option(transport, TRANS_OPT_FOLLOWTAGS, "1");
 	if (prune) {
@@ -940,6 +1317,11 @@ static int do_fetch(struct transport *transport,
 		retcode = 1;
 		goto cleanup;
 	}
+	if (quick_check) {
+		/* the tracking refs moved; re-hash them for next time */
+		compute_ref_state(ref_map, ref_state);
+		record_ref_state(transport, ref_state);
+	}
 	free_refs(ref_map);
 
 	/* if neither --no-tags nor --tags was specified, do automated tag
@@ -954,6 +1336,8 @@ static int do_fetch(struct transport *transport,
 	}
 
  cleanup:
+	transport->ref_prefixes = NULL;
+	string_list_clear(&ref_prefixes, 0);
 	string_list_clear(&existing_refs, 1);
 	return retcode;
 }
@@ -1038,7 +1422,58 @@ static void add_options_to_argv(struct argv_array *argv)
 
 }
 
-static int fetch_multiple(struct string_list *list)
+struct parallel_fetch {
+	struct string_list *list;
+	int next;
+	int result;
+};
+
+static int fetch_next_remote(struct child_process *cp, struct strbuf *out,
+			     void *cb, void **task_cb)
+{
+	struct parallel_fetch *state = cb;
+	const char *name;
+
+	if (state->next >= state->list->nr)
+		return 0;
+	name = state->list->items[state->next++].string;
+	*task_cb = (void *)name;
+
+	argv_array_pushl(&cp->args, "fetch", "--append", NULL);
+	add_options_to_argv(&cp->args);
+	argv_array_push(&cp->args, name);
+	cp->git_cmd = 1;
+
+	if (verbosity >= 0)
+		strbuf_addf(out, _("Fetching %s\n"), name);
+
+	return 1;
+}
+
+static int fetch_failed_to_start(struct strbuf *out, void *cb, void *task_cb)
+{
+	struct parallel_fetch *state = cb;
+	const char *name = task_cb;
+
+	state->result = 1;
+	strbuf_addf(out, _("Could not fetch %s\n"), name);
+	return 0;
+}
+
+static int fetch_finished(int result, struct strbuf *out,
+			  void *cb, void *task_cb)
+{
+	struct parallel_fetch *state = cb;
+	const char *name = task_cb;
+
+	if (result) {
+		state->result = 1;
+		strbuf_addf(out, _("Could not fetch %s\n"), name);
+	}
+	return 0;
+}
+
+static int fetch_multiple(struct string_list *list, int max_jobs)
 {
 	int i, result = 0;
 	struct argv_array argv = ARGV_ARRAY_INIT;
@@ -1049,6 +1484,16 @@ static int fetch_multiple(struct string_list *list)
 			return errcode;
 	}
 
+	if (max_jobs != 1 && list->nr > 1) {
+		struct parallel_fetch state = { list, 0, 0 };
+
+		run_processes_parallel(max_jobs, fetch_next_remote,
+				       fetch_failed_to_start, fetch_finished,
+				       &state);
+
+		return !!state.result;
+	}
+
 	argv_array_pushl(&argv, "fetch", "--append", NULL);
 	add_options_to_argv(&argv);
 
@@ -1170,7 +1615,9 @@ int cmd_fetch(int argc, const char **argv, const char *prefix)
 		else if (argc > 1)
 			die(_("fetch --all does not make sense with refspecs"));
 		(void) for_each_remote(get_one_remote_for_fetch, &list);
-		result = fetch_multiple(&list);
+		result = fetch_multiple(&list, max_children < 0 ?
+					       fetch_parallel_config :
+					       max_children);
 	} else if (argc == 0) {
 		/* No arguments -- use default remote */
 		remote = remote_get(NULL);
@@ -1180,7 +1627,9 @@ int cmd_fetch(int argc, const char **argv, const char *prefix)
 		for (i = 0; i < argc; i++)
 			if (!add_remote_or_group(argv[i], &list))
 				die(_("No such remote or remote group: %s"), argv[i]);
-		result = fetch_multiple(&list);
+		result = fetch_multiple(&list, max_children < 0 ?
+					       fetch_parallel_config :
+					       max_children);
 	} else {
 		/* Single remote or group */
 		(void) add_remote_or_group(argv[0], &list);
@@ -1188,7 +1637,9 @@ int cmd_fetch(int argc, const char **argv, const char *prefix)
 			/* More than one remote */
 			if (argc > 1)
 				die(_("Fetching a group and specifying refspecs does not make sense"));
-			result = fetch_multiple(&list);
+			result = fetch_multiple(&list, max_children < 0 ?
+						       fetch_parallel_config :
+						       max_children);
 		} else {
 			/* Zero or one remotes */
 			remote = remote_get(argv[0]);
@@ -1203,7 +1654,10 @@ int cmd_fetch(int argc, const char **argv, const char *prefix)
 		result = fetch_populated_submodules(&options,
 						    submodule_prefix,
 						    recurse_submodules,
-						    verbosity < 0);
+						    verbosity < 0,
+						    max_children < 0 ?
+						    submodule_fetch_jobs_config :
+						    max_children);
 		argv_array_clear(&options);
 	}
 
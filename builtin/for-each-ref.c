@@ -830,6 +830,64 @@ static void get_value(struct refinfo *ref, int atom, struct atom_value **v)
 	*v = &ref->value[atom];
 }
 
+/*
+ * Return true if refname matches one of the patterns, which are
+ * matched as prefixes at a "/" boundary or with wildmatch().  An
+ * empty pattern list matches everything.
+ */
+static int match_ref_patterns(const char **patterns, const char *refname)
+{
+	const char **pattern;
+	int namelen;
+
+	if (!*patterns)
+		return 1;
+	namelen = strlen(refname);
+	for (pattern = patterns; *pattern; pattern++) {
+		const char *p = *pattern;
+		int plen = strlen(p);
+
+		if ((plen <= namelen) &&
+		    !strncmp(refname, p, plen) &&
+		    (refname[plen] == '\0' ||
+		     refname[plen] == '/' ||
+		     p[plen-1] == '/'))
+			return 1;
+		if (!wildmatch(p, refname, WM_PATHNAME, NULL))
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * Find the longest prefix we can feed to for_each_rawref_in() so that
+ * the ref cache traversal descends only into the subtree the patterns
+ * can possibly match, instead of walking every ref.  With several
+ * patterns (or none) we punt and return "".
+ */
+static const char *find_pattern_prefix(const char **patterns)
+{
+	const char *pattern, *cp;
+
+	if (!patterns[0] || patterns[1])
+		return "";
+	pattern = patterns[0];
+	for (cp = pattern; *cp && !is_glob_special(*cp); cp++)
+		; /* just looking */
+	/*
+	 * The traversal wants a directory within the ref hierarchy;
+	 * back up to the last "/" before the first wildcard (or the
+	 * end of a literal pattern, which may name a partial
+	 * component such as "refs/tags/v1.0-rc" that still has to be
+	 * matched by match_ref_patterns()).
+	 */
+	while (cp > pattern && cp[-1] != '/')
+		cp--;
+	if (cp == pattern)
+		return "";
+	return xmemdupz(pattern, cp - pattern);
+}
+
 struct grab_ref_cbdata {
 	struct refinfo **grab_array;
 	const char **grab_pattern;
@@ -851,25 +909,8 @@ static int grab_single_ref(const char *refname, const unsigned char *sha1, int f
 		  return 0;
 	}
 
-	if (*cb->grab_pattern) {
-		const char **pattern;
-		int namelen = strlen(refname);
-		for (pattern = cb->grab_pattern; *pattern; pattern++) {
-			const char *p = *pattern;
-			int plen = strlen(p);
-
-			if ((plen <= namelen) &&
-			    !strncmp(refname, p, plen) &&
-			    (refname[plen] == '\0' ||
-			     refname[plen] == '/' ||
-			     p[plen-1] == '/'))
-				break;
-			if (!wildmatch(p, refname, WM_PATHNAME, NULL))
-				break;
-		}
-		if (!*pattern)
-			return 0;
-	}
+	if (!match_ref_patterns(cb->grab_pattern, refname))
+		return 0;
 
 	/*
 	 * We do not open the object yet; sort may only need refname
@@ -1026,6 +1067,43 @@ static void show_ref(struct refinfo *info, const char *format, int quote_style)
 	putchar('\n');
 }
 
+struct stream_ref_cbdata {
+	const char **patterns;
+	const char *format;
+	int quote_style;
+	int maxcount;
+	int shown;
+};
+
+/*
+ * A call-back given to for_each_ref() when the refs can be shown in
+ * iteration order (which is sorted by refname, i.e. the default sort
+ * order).  Format each match as we see it and abort the traversal
+ * once --count is satisfied, without materializing the full ref list.
+ */
+static int show_single_ref(const char *refname, const unsigned char *sha1, int flag, void *cb_data)
+{
+	struct stream_ref_cbdata *cb = cb_data;
+	struct refinfo ref;
+
+	if (flag & REF_BAD_NAME) {
+		  warning("ignoring ref with broken name %s", refname);
+		  return 0;
+	}
+
+	if (!match_ref_patterns(cb->patterns, refname))
+		return 0;
+
+	memset(&ref, 0, sizeof(ref));
+	ref.refname = (char *)refname;
+	hashcpy(ref.objectname, sha1);
+	ref.flag = flag;
+	show_ref(&ref, cb->format, cb->quote_style);
+	free(ref.value);
+
+	return ++cb->shown >= cb->maxcount;
+}
+
 static struct ref_sort *default_sort(void)
 {
 	static const char cstr_name[] = "refname";
@@ -1103,15 +1181,35 @@ int cmd_for_each_ref(int argc, const char **argv, const char *prefix)
 	if (verify_format(format))
 		usage_with_options(for_each_ref_usage, opts);
 
-	if (!sort)
-		sort = default_sort();
-
 	/* for warn_ambiguous_refs */
 	git_config(git_default_config, NULL);
 
+	if (maxcount && !sort) {
+		/*
+		 * Refs come out of the iteration already sorted by
+		 * refname, which is the default sort order; show them
+		 * as we go and stop as soon as we have enough,
+		 * instead of grabbing (and later sorting) them all.
+		 */
+		struct stream_ref_cbdata stream_cbdata;
+
+		memset(&stream_cbdata, 0, sizeof(stream_cbdata));
+		stream_cbdata.patterns = argv;
+		stream_cbdata.format = format;
+		stream_cbdata.quote_style = quote_style;
+		stream_cbdata.maxcount = maxcount;
+		for_each_rawref_in(find_pattern_prefix(argv),
+				   show_single_ref, &stream_cbdata);
+		return 0;
+	}
+
+	if (!sort)
+		sort = default_sort();
+
 	memset(&cbdata, 0, sizeof(cbdata));
 	cbdata.grab_pattern = argv;
-	for_each_rawref(grab_single_ref, &cbdata);
+	for_each_rawref_in(find_pattern_prefix(argv),
+			   grab_single_ref, &cbdata);
 	refs = cbdata.grab_array;
 	num_refs = cbdata.grab_cnt;
 
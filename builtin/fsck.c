@@ -13,6 +13,7 @@
 #include "dir.h"
 #include "progress.h"
 #include "streaming.h"
+#include "thread-utils.h"
 
 #define REACHABLE 0x0001
 #define SEEN      0x0002
@@ -28,6 +29,7 @@ static int keep_cache_objects;
 static unsigned char head_sha1[20];
 static const char *head_points_at;
 static int errors_found;
+static int nr_threads;
 static int write_lost_and_found;
 static int verbose;
 static int show_progress = -1;
@@ -599,6 +601,65 @@ static int fsck_cache_tree(struct cache_tree *it)
 	return err;
 }
 
+#ifndef NO_PTHREADS
+/*
+ * The pack checksum and CRC verification neither needs the object
+ * pool nor the shared pack windows, so it can run one worker per
+ * pack ahead of the serial object-parsing pass, which then skips
+ * the checksum work it has already done.
+ */
+static struct packed_git **checksum_packs;
+static int checksum_nr, checksum_alloc, checksum_cursor, checksum_errors;
+static pthread_mutex_t checksum_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void *checksum_worker(void *data)
+{
+	for (;;) {
+		struct packed_git *p;
+
+		pthread_mutex_lock(&checksum_mutex);
+		if (checksum_cursor >= checksum_nr) {
+			pthread_mutex_unlock(&checksum_mutex);
+			return NULL;
+		}
+		p = checksum_packs[checksum_cursor++];
+		pthread_mutex_unlock(&checksum_mutex);
+
+		if (verify_pack_index(p) || verify_pack_checksums(p)) {
+			pthread_mutex_lock(&checksum_mutex);
+			checksum_errors = 1;
+			pthread_mutex_unlock(&checksum_mutex);
+		}
+	}
+}
+
+static int fsck_pack_checksums_threaded(void)
+{
+	struct packed_git *p;
+	pthread_t *threads;
+	int i, spawn;
+
+	for (p = packed_git; p; p = p->next) {
+		if (open_pack_index(p))
+			continue;
+		ALLOC_GROW(checksum_packs, checksum_nr + 1, checksum_alloc);
+		checksum_packs[checksum_nr++] = p;
+	}
+	spawn = nr_threads < checksum_nr ? nr_threads : checksum_nr;
+	threads = xcalloc(spawn, sizeof(*threads));
+	for (i = 0; i < spawn; i++)
+		if (pthread_create(&threads[i], NULL, checksum_worker, NULL))
+			die("unable to create checksum thread");
+	for (i = 0; i < spawn; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(checksum_packs);
+	checksum_packs = NULL;
+	checksum_nr = checksum_alloc = 0;
+	return checksum_errors;
+}
+#endif
+
 static char const * const fsck_usage[] = {
 	N_("git fsck [<options>] [<object>...]"),
 	NULL
@@ -617,6 +678,8 @@ static struct option fsck_opts[] = {
 	OPT_BOOL(0, "lost-found", &write_lost_and_found,
 				N_("write dangling objects in .git/lost-found")),
 	OPT_BOOL(0, "progress", &show_progress, N_("show progress")),
+	OPT_INTEGER(0, "threads", &nr_threads,
+				N_("number of threads to verify pack checksums with")),
 	OPT_END(),
 };
 
@@ -656,9 +719,19 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 		struct packed_git *p;
 		uint32_t total = 0, count = 0;
 		struct progress *progress = NULL;
+		unsigned verify_flags = 0;
 
 		prepare_packed_git();
 
+#ifndef NO_PTHREADS
+		if (!nr_threads)
+			nr_threads = online_cpus();
+		if (nr_threads > 1) {
+			if (fsck_pack_checksums_threaded())
+				errors_found |= ERROR_PACK;
+			verify_flags |= VERIFY_PACK_SKIP_CHECKSUMS;
+		}
+#endif
 		if (show_progress) {
 			for (p = packed_git; p; p = p->next) {
 				if (open_pack_index(p))
@@ -671,7 +744,7 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 		for (p = packed_git; p; p = p->next) {
 			/* verify gives error messages itself */
 			if (verify_pack(p, fsck_obj_buffer,
-					progress, count))
+					progress, count, verify_flags))
 				errors_found |= ERROR_PACK;
 			count += p->num_objects;
 		}
@@ -724,7 +797,7 @@ int cmd_fsck(int argc, const char **argv, const char *prefix)
 			obj->used = 1;
 			mark_object_reachable(obj);
 		}
-		if (active_cache_tree)
+		if (index_cache_tree(&the_index))
 			fsck_cache_tree(active_cache_tree);
 	}
 
@@ -17,6 +17,7 @@
 #include "sigchain.h"
 #include "argv-array.h"
 #include "commit.h"
+#include "commit-graph.h"
 
 #define FAILED_RUN "failed to run %s"
 
@@ -32,6 +33,8 @@ static int aggressive_window = 250;
 static int gc_auto_threshold = 6700;
 static int gc_auto_pack_limit = 50;
 static int detach_auto = 1;
+static int gc_write_commit_graph;
+static int cruft_packs;
 static const char *prune_expire = "2.weeks.ago";
 
 static struct argv_array pack_refs_cmd = ARGV_ARRAY_INIT;
@@ -71,6 +74,8 @@ static void gc_config(void)
 	git_config_get_int("gc.auto", &gc_auto_threshold);
 	git_config_get_int("gc.autopacklimit", &gc_auto_pack_limit);
 	git_config_get_bool("gc.autodetach", &detach_auto);
+	git_config_get_bool("gc.writecommitgraph", &gc_write_commit_graph);
+	git_config_get_bool("gc.cruftpacks", &cruft_packs);
 
 	if (!git_config_get_string_const("gc.pruneexpire", &prune_expire)) {
 		if (strcmp(prune_expire, "now")) {
@@ -103,6 +108,16 @@ static int too_many_loose_objects(void)
 	if (gc_auto_threshold <= 0)
 		return 0;
 
+	/*
+	 * When the object writers have been keeping the count hint
+	 * up to date we know the exact number without touching the
+	 * object directory at all.
+	 */
+	num_loose = get_loose_object_count();
+	if (num_loose >= 0)
+		return num_loose > gc_auto_threshold;
+	num_loose = 0;
+
 	if (sizeof(path) <= snprintf(path, sizeof(path), "%s/17", objdir)) {
 		warning(_("insanely long object directory %.*s"), 50, objdir);
 		return 0;
@@ -159,6 +174,96 @@ static void add_repack_all_option(void)
 	}
 }
 
+struct cruft_collection {
+	struct strbuf list;
+	time_t newest;
+	int nr;
+};
+
+static int collect_cruft_object(const unsigned char *sha1, const char *path,
+				void *data)
+{
+	struct cruft_collection *cruft = data;
+	struct stat st;
+
+	strbuf_addstr(&cruft->list, sha1_to_hex(sha1));
+	strbuf_addch(&cruft->list, '\n');
+	cruft->nr++;
+	if (!stat(path, &st) && cruft->newest < st.st_mtime)
+		cruft->newest = st.st_mtime;
+	return 0;
+}
+
+/*
+ * Sweep whatever loose objects survived repacking and pruning (i.e.
+ * the unreachable-but-recent ones) into a single "cruft" pack so
+ * that later commands do not have to crawl thousands of loose files
+ * just to ignore them.  The pack's mtime is set to the newest object
+ * it holds; should the next repack explode it again, the objects
+ * come back with that timestamp and still age out eventually.
+ */
+static int pack_cruft_objects(int quiet)
+{
+	struct cruft_collection cruft = { STRBUF_INIT, 0, 0 };
+	struct child_process cmd = CHILD_PROCESS_INIT;
+	struct strbuf line = STRBUF_INIT;
+	static const char *prune_packed_argv[] = {
+		"prune-packed", "-q", NULL
+	};
+	int ret = 0;
+
+	for_each_loose_object(collect_cruft_object, &cruft,
+			      FOR_EACH_OBJECT_LOCAL_ONLY);
+	if (!cruft.nr)
+		goto out;
+
+	argv_array_push(&cmd.args, "pack-objects");
+	if (quiet)
+		argv_array_push(&cmd.args, "-q");
+	argv_array_pushf(&cmd.args, "%s/pack/pack", get_object_directory());
+	cmd.git_cmd = 1;
+	cmd.in = -1;
+	cmd.out = -1;
+
+	if (start_command(&cmd)) {
+		ret = -1;
+		goto out;
+	}
+	if (write_in_full(cmd.in, cruft.list.buf, cruft.list.len) < 0)
+		ret = -1;
+	close(cmd.in);
+	if (strbuf_read(&line, cmd.out, 41) < 0)
+		ret = -1;
+	close(cmd.out);
+	if (finish_command(&cmd))
+		ret = -1;
+	if (ret)
+		goto out;
+
+	strbuf_trim(&line);
+	if (line.len == 40 && cruft.newest) {
+		struct strbuf path = STRBUF_INIT;
+		struct utimbuf utb;
+
+		utb.actime = cruft.newest;
+		utb.modtime = cruft.newest;
+		strbuf_addf(&path, "%s/pack/pack-%s.pack",
+			    get_object_directory(), line.buf);
+		if (utime(path.buf, &utb) < 0)
+			warning(_("failed utime() on %s: %s"),
+				path.buf, strerror(errno));
+		strbuf_release(&path);
+	}
+
+	/* drop the now-redundant loose copies */
+	ret = run_command_v_opt(prune_packed_argv, RUN_GIT_CMD);
+
+out:
+	strbuf_release(&cruft.list);
+	strbuf_release(&line);
+	return ret;
+}
+
 static int need_to_gc(void)
 {
 	/*
@@ -276,6 +381,8 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 			N_("prune unreferenced objects"),
 			PARSE_OPT_OPTARG, NULL, (intptr_t)prune_expire },
 		OPT_BOOL(0, "aggressive", &aggressive, N_("be more thorough (increased runtime)")),
+		OPT_BOOL(0, "cruft", &cruft_packs,
+			 N_("pack unreachable loose objects into a separate pack")),
 		OPT_BOOL(0, "auto", &auto_gc, N_("enable auto-gc mode")),
 		OPT_BOOL(0, "force", &force, N_("force running gc even if there may be another gc running")),
 		OPT_END()
@@ -360,6 +467,14 @@ int cmd_gc(int argc, const char **argv, const char *prefix)
 	if (run_command_v_opt(rerere.argv, RUN_GIT_CMD))
 		return error(FAILED_RUN, rerere.argv[0]);
 
+	if (gc_write_commit_graph)
+		write_commit_graph(get_object_directory());
+
+	if (cruft_packs && pack_cruft_objects(quiet))
+		return error(FAILED_RUN, "pack-objects");
+
+	reset_loose_object_count();
+
 	if (auto_gc && too_many_loose_objects())
 		warning(_("There are too many unreachable loose objects; "
 			"run 'git prune' to remove them."));
@@ -26,16 +26,32 @@ static char const * const grep_usage[] = {
 
 static int use_threads = 1;
 
+/* With --unordered, results may be written in completion order rather
+ * than input order; only relevant when threading is in use.
+ */
+static int unordered;
+
 #ifndef NO_PTHREADS
 #define THREADS 8
 static pthread_t threads[THREADS];
 
+/*
+ * Dedicated object-reading threads that load the data for queued work
+ * items ahead of the matchers.  The object layer serializes its own
+ * global state but lets the zlib inflation run unlocked, so a small
+ * number of readers is enough to keep the inflation stage ahead of
+ * the matchers.
+ */
+#define PREFETCH_THREADS 2
+static pthread_t prefetch_threads[PREFETCH_THREADS];
+
 /* We use one producer thread and THREADS consumer
  * threads. The producer adds struct work_items to 'todo' and the
  * consumers pick work items from the same array.
  */
 struct work_item {
 	struct grep_source source;
+	char loaded;
 	char done;
 	struct strbuf out;
 };
@@ -50,14 +66,35 @@ struct work_item {
  * The ranges are modulo TODO_SIZE.
  */
 #define TODO_SIZE 128
-static struct work_item todo[TODO_SIZE];
+static struct work_item *todo[TODO_SIZE];
 static int todo_start;
 static int todo_end;
 static int todo_done;
 
+/* The work items themselves come from this fixed pool; free_items
+ * stacks the members that are not currently on the ring.  Keeping one
+ * item fewer than the ring has slots guarantees that todo_end can
+ * never lap the oldest live entry.
+ */
+static struct work_item pool[TODO_SIZE - 1];
+static struct work_item *free_items[TODO_SIZE - 1];
+static int nr_free;
+
+/* The work_items in [todo_load, todo_end) have not had their data
+ * read yet; a prefetch thread will pick them up and load them so the
+ * consumer threads do not have to block on the object store.
+ */
+static int todo_load;
+
 /* Has all work items been added? */
 static int all_work_added;
 
+/* With --unordered, finished work items are retired as they complete
+ * rather than in ring order, so completion is tracked by counting.
+ */
+static int nr_added;
+static int nr_done;
+
 /* This lock protects all the variables above. */
 static pthread_mutex_t grep_mutex;
 
@@ -76,6 +113,11 @@ static inline void grep_unlock(void)
 /* Signalled when a new work_item is added to todo. */
 static pthread_cond_t cond_add;
 
+/* Signalled when a prefetch thread has loaded the data for a
+ * work_item.
+ */
+static pthread_cond_t cond_load;
+
 /* Signalled when the result from one work_item is written to
  * stdout.
  */
@@ -89,18 +131,24 @@ static int skip_first_line;
 static void add_work(struct grep_opt *opt, enum grep_source_type type,
 		     const char *name, const char *path, const void *id)
 {
+	struct work_item *w;
+
 	grep_lock();
 
-	while ((todo_end+1) % ARRAY_SIZE(todo) == todo_done) {
+	while (!nr_free) {
 		pthread_cond_wait(&cond_write, &grep_mutex);
 	}
 
-	grep_source_init(&todo[todo_end].source, type, name, path, id);
+	w = free_items[--nr_free];
+	grep_source_init(&w->source, type, name, path, id);
 	if (opt->binary != GREP_BINARY_TEXT)
-		grep_source_load_driver(&todo[todo_end].source);
-	todo[todo_end].done = 0;
-	strbuf_reset(&todo[todo_end].out);
+		grep_source_load_driver(&w->source);
+	w->loaded = 0;
+	w->done = 0;
+	strbuf_reset(&w->out);
+	todo[todo_end] = w;
 	todo_end = (todo_end + 1) % ARRAY_SIZE(todo);
+	nr_added++;
 
 	pthread_cond_signal(&cond_add);
 	grep_unlock();
@@ -111,49 +159,100 @@ static struct work_item *get_work(void)
 	struct work_item *ret;
 
 	grep_lock();
-	while (todo_start == todo_end && !all_work_added) {
-		pthread_cond_wait(&cond_add, &grep_mutex);
+	while (todo_start != todo_end ? !todo[todo_start]->loaded
+				      : !all_work_added) {
+		pthread_cond_wait(&cond_load, &grep_mutex);
 	}
 
 	if (todo_start == todo_end && all_work_added) {
 		ret = NULL;
 	} else {
-		ret = &todo[todo_start];
+		ret = todo[todo_start];
 		todo_start = (todo_start + 1) % ARRAY_SIZE(todo);
 	}
 	grep_unlock();
 	return ret;
 }
 
+static void *run_prefetch(void *arg)
+{
+	while (1) {
+		struct work_item *w;
+
+		grep_lock();
+		while (todo_load == todo_end && !all_work_added) {
+			pthread_cond_wait(&cond_add, &grep_mutex);
+		}
+		if (todo_load == todo_end && all_work_added) {
+			grep_unlock();
+			break;
+		}
+		w = todo[todo_load];
+		todo_load = (todo_load + 1) % ARRAY_SIZE(todo);
+		grep_unlock();
+
+		grep_source_load(&w->source);
+
+		grep_lock();
+		w->loaded = 1;
+		pthread_cond_broadcast(&cond_load);
+		grep_unlock();
+	}
+	return NULL;
+}
+
+/* Write out the results of a finished work item and return it to the
+ * free pool.  The caller must hold grep_mutex.
+ */
+static void flush_work_item(struct work_item *w)
+{
+	if (w->out.len) {
+		const char *p = w->out.buf;
+		size_t len = w->out.len;
+
+		/* Skip the leading hunk mark of the first file. */
+		if (skip_first_line) {
+			while (len) {
+				len--;
+				if (*p++ == '\n')
+					break;
+			}
+			skip_first_line = 0;
+		}
+
+		write_or_die(1, p, len);
+	}
+	grep_source_clear(&w->source);
+	free_items[nr_free++] = w;
+}
+
 static void work_done(struct work_item *w)
 {
 	int old_done;
 
 	grep_lock();
 	w->done = 1;
-	old_done = todo_done;
-	for(; todo[todo_done].done && todo_done != todo_start;
-	    todo_done = (todo_done+1) % ARRAY_SIZE(todo)) {
-		w = &todo[todo_done];
-		if (w->out.len) {
-			const char *p = w->out.buf;
-			size_t len = w->out.len;
-
-			/* Skip the leading hunk mark of the first file. */
-			if (skip_first_line) {
-				while (len) {
-					len--;
-					if (*p++ == '\n')
-						break;
-				}
-				skip_first_line = 0;
-			}
+	nr_done++;
 
-			write_or_die(1, p, len);
-		}
-		grep_source_clear(&w->source);
+	if (unordered) {
+		/*
+		 * Results stream out as each file finishes; a straggler
+		 * holds back neither the output nor the reuse of its
+		 * neighbours' work items.
+		 */
+		flush_work_item(w);
+		pthread_cond_signal(&cond_write);
+		if (all_work_added && nr_done == nr_added)
+			pthread_cond_signal(&cond_result);
+		grep_unlock();
+		return;
 	}
 
+	old_done = todo_done;
+	for (; todo_done != todo_start && todo[todo_done]->done;
+	     todo_done = (todo_done+1) % ARRAY_SIZE(todo))
+		flush_work_item(todo[todo_done]);
+
 	if (old_done != todo_done)
 		pthread_cond_signal(&cond_write);
 
@@ -195,15 +294,26 @@ static void start_threads(struct grep_opt *opt)
 	int i;
 
 	pthread_mutex_init(&grep_mutex, NULL);
-	pthread_mutex_init(&grep_read_mutex, NULL);
 	pthread_mutex_init(&grep_attr_mutex, NULL);
+	enable_obj_read_lock();
 	pthread_cond_init(&cond_add, NULL);
+	pthread_cond_init(&cond_load, NULL);
 	pthread_cond_init(&cond_write, NULL);
 	pthread_cond_init(&cond_result, NULL);
 	grep_use_locks = 1;
 
-	for (i = 0; i < ARRAY_SIZE(todo); i++) {
-		strbuf_init(&todo[i].out, 0);
+	for (i = 0; i < ARRAY_SIZE(pool); i++) {
+		strbuf_init(&pool[i].out, 0);
+		free_items[i] = &pool[i];
+	}
+	nr_free = ARRAY_SIZE(pool);
+
+	for (i = 0; i < ARRAY_SIZE(prefetch_threads); i++) {
+		int err = pthread_create(&prefetch_threads[i], NULL,
+					 run_prefetch, NULL);
+		if (err)
+			die(_("grep: failed to create thread: %s"),
+			    strerror(err));
 	}
 
 	for (i = 0; i < ARRAY_SIZE(threads); i++) {
@@ -229,15 +339,18 @@ static int wait_all(void)
 	all_work_added = 1;
 
 	/* Wait until all work is done. */
-	while (todo_done != todo_end)
+	while (unordered ? nr_done != nr_added : todo_done != todo_end)
 		pthread_cond_wait(&cond_result, &grep_mutex);
 
-	/* Wake up all the consumer threads so they can see that there
-	 * is no more work to do.
+	/* Wake up the prefetch and consumer threads so they can see
+	 * that there is no more work to do.
 	 */
 	pthread_cond_broadcast(&cond_add);
+	pthread_cond_broadcast(&cond_load);
 	grep_unlock();
 
+	for (i = 0; i < ARRAY_SIZE(prefetch_threads); i++)
+		pthread_join(prefetch_threads[i], NULL);
 	for (i = 0; i < ARRAY_SIZE(threads); i++) {
 		void *h;
 		pthread_join(threads[i], &h);
@@ -245,9 +358,10 @@ static int wait_all(void)
 	}
 
 	pthread_mutex_destroy(&grep_mutex);
-	pthread_mutex_destroy(&grep_read_mutex);
 	pthread_mutex_destroy(&grep_attr_mutex);
+	disable_obj_read_lock();
 	pthread_cond_destroy(&cond_add);
+	pthread_cond_destroy(&cond_load);
 	pthread_cond_destroy(&cond_write);
 	pthread_cond_destroy(&cond_result);
 	grep_use_locks = 0;
@@ -270,15 +384,7 @@ static int grep_cmd_config(const char *var, const char *value, void *cb)
 	return st;
 }
 
-static void *lock_and_read_sha1_file(const unsigned char *sha1, enum object_type *type, unsigned long *size)
-{
-	void *data;
 
-	grep_read_lock();
-	data = read_sha1_file(sha1, type, size);
-	grep_read_unlock();
-	return data;
-}
 
 static int grep_sha1(struct grep_opt *opt, const unsigned char *sha1,
 		     const char *filename, int tree_name_len,
@@ -436,7 +542,7 @@ static int grep_tree(struct grep_opt *opt, const struct pathspec *pathspec,
 			void *data;
 			unsigned long size;
 
-			data = lock_and_read_sha1_file(entry.sha1, &type, &size);
+			data = read_sha1_file(entry.sha1, &type, &size);
 			if (!data)
 				die(_("unable to read tree (%s)"),
 				    sha1_to_hex(entry.sha1));
@@ -467,10 +573,8 @@ static int grep_object(struct grep_opt *opt, const struct pathspec *pathspec,
 		struct strbuf base;
 		int hit, len;
 
-		grep_read_lock();
 		data = read_object_with_reference(obj->sha1, tree_type,
 						  &size, NULL);
-		grep_read_unlock();
 
 		if (!data)
 			die(_("unable to read tree (%s)"), sha1_to_hex(obj->sha1));
@@ -729,6 +833,8 @@ int cmd_grep(int argc, const char **argv, const char *prefix)
 			   N_("indicate hit with exit status without output")),
 		OPT_BOOL(0, "all-match", &opt.all_match,
 			N_("show only matches from files that match all patterns")),
+		OPT_BOOL(0, "unordered", &unordered,
+			 N_("print results for each file as soon as it has been searched")),
 		{ OPTION_SET_INT, 0, "debug", &opt.debug, NULL,
 		  N_("show parse tree for grep expression"),
 		  PARSE_OPT_NOARG | PARSE_OPT_HIDDEN, NULL, 1 },
@@ -11,6 +11,7 @@
 #include "exec_cmd.h"
 #include "streaming.h"
 #include "thread-utils.h"
+#include "midx.h"
 
 static const char index_pack_usage[] =
 "git index-pack [-v] [-o <index-file>] [--keep | --keep=<msg>] [--verify] [--strict] (<pack-file> | --stdin [--fix-thin] [<pack-file>])";
@@ -31,21 +32,40 @@ union delta_base {
 };
 
 struct base_data {
+	/* Initialized by make_base(). */
 	struct base_data *base;
-	struct base_data *child;
 	struct object_entry *obj;
-	void *data;
-	unsigned long size;
 	int ref_first, ref_last;
 	int ofs_first, ofs_last;
+	/*
+	 * Threads should increment retain_data if they are about to call
+	 * patch_delta() using this struct's data as a base, and decrement
+	 * this when they are done.  While retain_data is nonzero, this
+	 * struct's data will not be freed even if the delta base cache
+	 * limit is exceeded.
+	 */
+	int retain_data;
+	/*
+	 * The number of direct children that have not been fully resolved
+	 * yet (including descendants of those children).  When this number
+	 * reaches zero, this struct base_data can be freed.
+	 */
+	int children_remaining;
+
+	/* Not initialized by make_base(). */
+	struct base_data *prev, *next;
+	void *data;
+	unsigned long size;
+};
+
+struct base_list {
+	struct base_data *first, *last;
 };
 
 struct thread_local {
 #ifndef NO_PTHREADS
 	pthread_t thread;
 #endif
-	struct base_data *base_cache;
-	size_t base_cache_used;
 	int pack_fd;
 };
 
@@ -83,9 +103,26 @@ static struct progress *progress;
 /* We always read in 4kB chunks. */
 static unsigned char input_buffer[4096];
 static unsigned int input_offset, input_len;
+static enum pack_codec input_codec;
 static off_t consumed_bytes;
 static unsigned deepest_delta;
-static git_SHA_CTX input_ctx;
+static git_hash_ctx input_ctx;
+
+/*
+ * Bases that still have unclaimed delta children form a stack in
+ * work_bases; second-pass threads take children from the base on top of
+ * the stack, so several threads can chew on one big delta subtree at
+ * the same time.  A base whose children have all been claimed moves to
+ * done_bases and stays there, possibly with its data still cached,
+ * until its last descendant has been resolved.  Both lists and the
+ * cache accounting are protected by work_mutex.
+ */
+static struct base_list work_bases;
+static struct base_list done_bases;
+static size_t base_cache_used;
+static size_t base_cache_limit;
+static int nr_dispatched;
+
 static uint32_t input_crc32;
 static int input_fd, output_fd;
 static const char *curr_pack;
@@ -93,7 +130,6 @@ static const char *curr_pack;
 #ifndef NO_PTHREADS
 
 static struct thread_local *thread_data;
-static int nr_dispatched;
 static int threads_active;
 
 static pthread_mutex_t read_mutex;
@@ -112,10 +148,6 @@ static pthread_mutex_t deepest_delta_mutex;
 #define deepest_delta_lock()	lock_mutex(&deepest_delta_mutex)
 #define deepest_delta_unlock()	unlock_mutex(&deepest_delta_mutex)
 
-static pthread_mutex_t type_cas_mutex;
-#define type_cas_lock()		lock_mutex(&type_cas_mutex)
-#define type_cas_unlock()	unlock_mutex(&type_cas_mutex)
-
 static pthread_key_t key;
 
 static inline void lock_mutex(pthread_mutex_t *mutex)
@@ -139,7 +171,6 @@ static void init_thread(void)
 	init_recursive_mutex(&read_mutex);
 	pthread_mutex_init(&counter_mutex, NULL);
 	pthread_mutex_init(&work_mutex, NULL);
-	pthread_mutex_init(&type_cas_mutex, NULL);
 	if (show_stat)
 		pthread_mutex_init(&deepest_delta_mutex, NULL);
 	pthread_key_create(&key, NULL);
@@ -162,7 +193,6 @@ static void cleanup_thread(void)
 	pthread_mutex_destroy(&read_mutex);
 	pthread_mutex_destroy(&counter_mutex);
 	pthread_mutex_destroy(&work_mutex);
-	pthread_mutex_destroy(&type_cas_mutex);
 	if (show_stat)
 		pthread_mutex_destroy(&deepest_delta_mutex);
 	for (i = 0; i < nr_threads; i++)
@@ -185,9 +215,6 @@ static void cleanup_thread(void)
 #define deepest_delta_lock()
 #define deepest_delta_unlock()
 
-#define type_cas_lock()
-#define type_cas_unlock()
-
 #endif
 
 
@@ -247,7 +274,7 @@ static void flush(void)
 	if (input_offset) {
 		if (output_fd >= 0)
 			write_or_die(output_fd, input_buffer, input_offset);
-		git_SHA1_Update(&input_ctx, input_buffer, input_offset);
+		the_hash_algo->update_fn(&input_ctx, input_buffer, input_offset);
 		memmove(input_buffer, input_buffer + input_offset, input_len);
 		input_offset = 0;
 	}
@@ -317,7 +344,7 @@ static const char *open_pack_file(const char *pack_name)
 		output_fd = -1;
 		nothread_data.pack_fd = input_fd;
 	}
-	git_SHA1_Init(&input_ctx);
+	the_hash_algo->init_fn(&input_ctx);
 	return pack_name;
 }
 
@@ -331,6 +358,9 @@ static void parse_pack_header(void)
 	if (!pack_version_ok(hdr->hdr_version))
 		die(_("pack version %"PRIu32" unsupported"),
 			ntohl(hdr->hdr_version));
+	input_codec = pack_version_codec(hdr->hdr_version);
+	if (!pack_codec_name(input_codec))
+		die(_("pack codec %d unsupported"), input_codec);
 
 	nr_objects = ntohl(hdr->hdr_entries);
 	use(sizeof(struct pack_header));
@@ -369,12 +399,27 @@ static void set_thread_data(struct thread_local *data)
 }
 #endif
 
-static struct base_data *alloc_base_data(void)
+static void base_list_push(struct base_list *list, struct base_data *b)
 {
-	struct base_data *base = xcalloc(1, sizeof(struct base_data));
-	base->ref_last = -1;
-	base->ofs_last = -1;
-	return base;
+	b->prev = NULL;
+	b->next = list->first;
+	if (list->first)
+		list->first->prev = b;
+	else
+		list->last = b;
+	list->first = b;
+}
+
+static void base_list_remove(struct base_list *list, struct base_data *b)
+{
+	if (b->prev)
+		b->prev->next = b->next;
+	else
+		list->first = b->next;
+	if (b->next)
+		b->next->prev = b->prev;
+	else
+		list->last = b->prev;
 }
 
 static void free_base_data(struct base_data *c)
@@ -382,44 +427,37 @@ static void free_base_data(struct base_data *c)
 	if (c->data) {
 		free(c->data);
 		c->data = NULL;
-		get_thread_data()->base_cache_used -= c->size;
+		base_cache_used -= c->size;
 	}
 }
 
+/*
+ * Free cached base data until the cache fits within base_cache_limit
+ * again, oldest entries first, but never "retain" nor any base that a
+ * thread is currently patching against.  Called with work_mutex held.
+ */
 static void prune_base_data(struct base_data *retain)
 {
 	struct base_data *b;
-	struct thread_local *data = get_thread_data();
-	for (b = data->base_cache;
-	     data->base_cache_used > delta_base_cache_limit && b;
-	     b = b->child) {
-		if (b->data && b != retain)
-			free_base_data(b);
-	}
-}
 
-static void link_base_data(struct base_data *base, struct base_data *c)
-{
-	if (base)
-		base->child = c;
-	else
-		get_thread_data()->base_cache = c;
+	if (base_cache_used <= base_cache_limit)
+		return;
 
-	c->base = base;
-	c->child = NULL;
-	if (c->data)
-		get_thread_data()->base_cache_used += c->size;
-	prune_base_data(c);
-}
+	for (b = done_bases.last; b; b = b->prev) {
+		if (b->retain_data || b == retain || !b->data)
+			continue;
+		free_base_data(b);
+		if (base_cache_used <= base_cache_limit)
+			return;
+	}
 
-static void unlink_base_data(struct base_data *c)
-{
-	struct base_data *base = c->base;
-	if (base)
-		base->child = NULL;
-	else
-		get_thread_data()->base_cache = NULL;
-	free_base_data(c);
+	for (b = work_bases.last; b; b = b->prev) {
+		if (b->retain_data || b == retain || !b->data)
+			continue;
+		free_base_data(b);
+		if (base_cache_used <= base_cache_limit)
+			return;
+	}
 }
 
 static int is_delta_type(enum object_type type)
@@ -434,14 +472,14 @@ static void *unpack_entry_data(unsigned long offset, unsigned long size,
 	int status;
 	git_zstream stream;
 	void *buf;
-	git_SHA_CTX c;
+	git_hash_ctx c;
 	char hdr[32];
 	int hdrlen;
 
 	if (!is_delta_type(type)) {
 		hdrlen = sprintf(hdr, "%s %lu", typename(type), size) + 1;
-		git_SHA1_Init(&c);
-		git_SHA1_Update(&c, hdr, hdrlen);
+		the_hash_algo->init_fn(&c);
+		the_hash_algo->update_fn(&c, hdr, hdrlen);
 	} else
 		sha1 = NULL;
 	if (type == OBJ_BLOB && size > big_file_threshold)
@@ -461,7 +499,7 @@ static void *unpack_entry_data(unsigned long offset, unsigned long size,
 		status = git_inflate(&stream, 0);
 		use(input_len - stream.avail_in);
 		if (sha1)
-			git_SHA1_Update(&c, last_out, stream.next_out - last_out);
+			the_hash_algo->update_fn(&c, last_out, stream.next_out - last_out);
 		if (buf == fixed_buf) {
 			stream.next_out = buf;
 			stream.avail_out = sizeof(fixed_buf);
@@ -471,7 +509,7 @@ static void *unpack_entry_data(unsigned long offset, unsigned long size,
 		bad_object(offset, _("inflate returned %d"), status);
 	git_inflate_end(&stream);
 	if (sha1)
-		git_SHA1_Final(sha1, &c);
+		the_hash_algo->final_fn(sha1, &c);
 	return buf == fixed_buf ? NULL : buf;
 }
 
@@ -662,6 +700,29 @@ static void find_delta_children(const union delta_base *base,
 	*last_index = last;
 }
 
+static struct base_data *make_base(struct object_entry *obj,
+				   struct base_data *parent)
+{
+	struct base_data *base = xcalloc(1, sizeof(struct base_data));
+	union delta_base base_spec;
+
+	base->base = parent;
+	base->obj = obj;
+
+	hashcpy(base_spec.sha1, obj->idx.sha1);
+	find_delta_children(&base_spec,
+			    &base->ref_first, &base->ref_last, OBJ_REF_DELTA);
+
+	memset(&base_spec, 0, sizeof(base_spec));
+	base_spec.offset = obj->idx.offset;
+	find_delta_children(&base_spec,
+			    &base->ofs_first, &base->ofs_last, OBJ_OFS_DELTA);
+
+	base->children_remaining = base->ref_last - base->ref_first +
+				   base->ofs_last - base->ofs_first + 2;
+	return base;
+}
+
 struct compare_data {
 	struct object_entry *entry;
 	struct git_istream *st;
@@ -807,26 +868,14 @@ static void sha1_object(const void *data, struct object_entry *obj_entry,
 }
 
 /*
- * This function is part of find_unresolved_deltas(). There are two
- * walkers going in the opposite ways.
+ * Make sure c->data holds the inflated object.  In the normal case the
+ * data is still cached from when the base was resolved, but it may have
+ * been pruned because we ran out of base_cache_limit; then we have to
+ * re-deflate parents, possibly up to the top base.
  *
- * The first one in find_unresolved_deltas() traverses down from
- * parent node to children, deflating nodes along the way. However,
- * memory for deflated nodes is limited by delta_base_cache_limit, so
- * at some point parent node's deflated content may be freed.
- *
- * The second walker is this function, which goes from current node up
- * to top parent if necessary to deflate the node. In normal
- * situation, its parent node would be already deflated, so it just
- * needs to apply delta.
- *
- * In the worst case scenario, parent node is no longer deflated because
- * we're running out of delta_base_cache_limit; we need to re-deflate
- * parents, possibly up to the top base.
- *
- * All deflated objects here are subject to be freed if we exceed
- * delta_base_cache_limit, just like in find_unresolved_deltas(), we
- * just need to make sure the last node is not freed.
+ * All deflated objects here are subject to be freed again if we exceed
+ * base_cache_limit, we just need to make sure the last node is not
+ * freed.  Called with work_mutex held.
  */
 static void *get_base_data(struct base_data *c)
 {
@@ -843,7 +892,7 @@ static void *get_base_data(struct base_data *c)
 		if (!delta_nr) {
 			c->data = get_data_from_pack(obj);
 			c->size = obj->size;
-			get_thread_data()->base_cache_used += c->size;
+			base_cache_used += c->size;
 			prune_base_data(c);
 		}
 		for (; delta_nr > 0; delta_nr--) {
@@ -859,7 +908,7 @@ static void *get_base_data(struct base_data *c)
 			free(raw);
 			if (!c->data)
 				bad_object(obj->idx.offset, _("failed to apply delta"));
-			get_thread_data()->base_cache_used += c->size;
+			base_cache_used += c->size;
 			prune_base_data(c);
 		}
 		free(delta);
@@ -867,10 +916,12 @@ static void *get_base_data(struct base_data *c)
 	return c->data;
 }
 
-static void resolve_delta(struct object_entry *delta_obj,
-			  struct base_data *base, struct base_data *result)
+static struct base_data *resolve_delta(struct object_entry *delta_obj,
+				       struct base_data *base)
 {
-	void *base_data, *delta_data;
+	void *delta_data, *result_data;
+	struct base_data *result;
+	unsigned long result_size;
 
 	if (show_stat) {
 		delta_obj->delta_depth = base->obj->delta_depth + 1;
@@ -881,116 +932,26 @@ static void resolve_delta(struct object_entry *delta_obj,
 	}
 	delta_obj->base_object_no = base->obj - objects;
 	delta_data = get_data_from_pack(delta_obj);
-	base_data = get_base_data(base);
-	result->obj = delta_obj;
-	result->data = patch_delta(base_data, base->size,
-				   delta_data, delta_obj->size, &result->size);
+	assert(base->data);
+	result_data = patch_delta(base->data, base->size,
+				  delta_data, delta_obj->size, &result_size);
 	free(delta_data);
-	if (!result->data)
+	if (!result_data)
 		bad_object(delta_obj->idx.offset, _("failed to apply delta"));
-	hash_sha1_file(result->data, result->size,
+	hash_sha1_file(result_data, result_size,
 		       typename(delta_obj->real_type), delta_obj->idx.sha1);
-	sha1_object(result->data, NULL, result->size, delta_obj->real_type,
+	sha1_object(result_data, NULL, result_size, delta_obj->real_type,
 		    delta_obj->idx.sha1);
+
+	result = make_base(delta_obj, base);
+	result->data = result_data;
+	result->size = result_size;
+
 	counter_lock();
 	nr_resolved_deltas++;
 	counter_unlock();
-}
-
-/*
- * Standard boolean compare-and-swap: atomically check whether "*type" is
- * "want"; if so, swap in "set" and return true. Otherwise, leave it untouched
- * and return false.
- */
-static int compare_and_swap_type(enum object_type *type,
-				 enum object_type want,
-				 enum object_type set)
-{
-	enum object_type old;
-
-	type_cas_lock();
-	old = *type;
-	if (old == want)
-		*type = set;
-	type_cas_unlock();
-
-	return old == want;
-}
-
-static struct base_data *find_unresolved_deltas_1(struct base_data *base,
-						  struct base_data *prev_base)
-{
-	if (base->ref_last == -1 && base->ofs_last == -1) {
-		union delta_base base_spec;
-
-		hashcpy(base_spec.sha1, base->obj->idx.sha1);
-		find_delta_children(&base_spec,
-				    &base->ref_first, &base->ref_last, OBJ_REF_DELTA);
-
-		memset(&base_spec, 0, sizeof(base_spec));
-		base_spec.offset = base->obj->idx.offset;
-		find_delta_children(&base_spec,
-				    &base->ofs_first, &base->ofs_last, OBJ_OFS_DELTA);
-
-		if (base->ref_last == -1 && base->ofs_last == -1) {
-			free(base->data);
-			return NULL;
-		}
-
-		link_base_data(prev_base, base);
-	}
-
-	if (base->ref_first <= base->ref_last) {
-		struct object_entry *child = objects + deltas[base->ref_first].obj_no;
-		struct base_data *result = alloc_base_data();
-
-		if (!compare_and_swap_type(&child->real_type, OBJ_REF_DELTA,
-					   base->obj->real_type))
-			die("BUG: child->real_type != OBJ_REF_DELTA");
-
-		resolve_delta(child, base, result);
-		if (base->ref_first == base->ref_last && base->ofs_last == -1)
-			free_base_data(base);
-
-		base->ref_first++;
-		return result;
-	}
-
-	if (base->ofs_first <= base->ofs_last) {
-		struct object_entry *child = objects + deltas[base->ofs_first].obj_no;
-		struct base_data *result = alloc_base_data();
-
-		assert(child->real_type == OBJ_OFS_DELTA);
-		child->real_type = base->obj->real_type;
-		resolve_delta(child, base, result);
-		if (base->ofs_first == base->ofs_last)
-			free_base_data(base);
-
-		base->ofs_first++;
-		return result;
-	}
-
-	unlink_base_data(base);
-	return NULL;
-}
-
-static void find_unresolved_deltas(struct base_data *base)
-{
-	struct base_data *new_base, *prev_base = NULL;
-	for (;;) {
-		new_base = find_unresolved_deltas_1(base, prev_base);
 
-		if (new_base) {
-			prev_base = base;
-			base = new_base;
-		} else {
-			free(base);
-			base = prev_base;
-			if (!base)
-				return;
-			prev_base = base->base;
-		}
-	}
+	return result;
 }
 
 static int compare_delta_entry(const void *a, const void *b)
@@ -1004,39 +965,128 @@ static int compare_delta_entry(const void *a, const void *b)
 				   objects[delta_b->obj_no].type);
 }
 
-static void resolve_base(struct object_entry *obj)
-{
-	struct base_data *base_obj = alloc_base_data();
-	base_obj->obj = obj;
-	base_obj->data = NULL;
-	find_unresolved_deltas(base_obj);
-}
-
-#ifndef NO_PTHREADS
 static void *threaded_second_pass(void *data)
 {
-	set_thread_data(data);
+#ifndef NO_PTHREADS
+	if (threads_active)
+		set_thread_data(data);
+#endif
 	for (;;) {
-		int i;
+		struct base_data *parent = NULL;
+		struct object_entry *child_obj;
+		struct base_data *child;
+
 		counter_lock();
 		display_progress(progress, nr_resolved_deltas);
 		counter_unlock();
+
 		work_lock();
-		while (nr_dispatched < nr_objects &&
-		       is_delta_type(objects[nr_dispatched].type))
-			nr_dispatched++;
-		if (nr_dispatched >= nr_objects) {
-			work_unlock();
-			break;
+		if (!work_bases.first) {
+			/*
+			 * Take an undispatched non-delta object from the
+			 * object array as a new work source.
+			 */
+			while (nr_dispatched < nr_objects &&
+			       is_delta_type(objects[nr_dispatched].type))
+				nr_dispatched++;
+			if (nr_dispatched >= nr_objects) {
+				work_unlock();
+				break;
+			}
+			child_obj = &objects[nr_dispatched++];
+		} else {
+			/*
+			 * Peek at the top of the work stack and claim one
+			 * child of that base.  Other threads may claim the
+			 * remaining children concurrently, so even a single
+			 * long delta subtree keeps everybody busy.
+			 */
+			parent = work_bases.first;
+
+			if (parent->ref_first <= parent->ref_last) {
+				child_obj = objects + deltas[parent->ref_first++].obj_no;
+				if (child_obj->real_type != OBJ_REF_DELTA)
+					die("BUG: child->real_type != OBJ_REF_DELTA");
+				child_obj->real_type = parent->obj->real_type;
+			} else {
+				child_obj = objects + deltas[parent->ofs_first++].obj_no;
+				assert(child_obj->real_type == OBJ_OFS_DELTA);
+				child_obj->real_type = parent->obj->real_type;
+			}
+
+			if (parent->ref_first > parent->ref_last &&
+			    parent->ofs_first > parent->ofs_last) {
+				/* No unclaimed children are left. */
+				base_list_remove(&work_bases, parent);
+				base_list_push(&done_bases, parent);
+			}
+
+			/*
+			 * Make sure the base data is still around; it may
+			 * have been pruned.  Doing this inside the mutex is
+			 * unfortunate, but it only happens when the delta
+			 * base cache limit was exceeded.
+			 */
+			get_base_data(parent);
+			parent->retain_data++;
 		}
-		i = nr_dispatched++;
 		work_unlock();
 
-		resolve_base(&objects[i]);
+		if (parent) {
+			child = resolve_delta(child_obj, parent);
+			if (!child->children_remaining) {
+				free(child->data);
+				child->data = NULL;
+			}
+		} else {
+			child = make_base(child_obj, NULL);
+			if (child->children_remaining) {
+				/*
+				 * Inflate the new base while outside the
+				 * mutex; other threads will want its data as
+				 * soon as it goes on the work stack.
+				 */
+				child->data = get_data_from_pack(child_obj);
+				child->size = child_obj->size;
+			}
+		}
+
+		work_lock();
+		if (parent)
+			parent->retain_data--;
+		if (child->data) {
+			/*
+			 * This child has children of its own: make it a
+			 * work source.
+			 */
+			base_list_push(&work_bases, child);
+			base_cache_used += child->size;
+			prune_base_data(NULL);
+		} else {
+			/*
+			 * This child is a leaf (or a base nothing deltifies
+			 * against).  It may have been the last unresolved
+			 * descendant of its ancestors; free those that are
+			 * now done with.
+			 */
+			struct base_data *p = child->base;
+
+			free(child);
+			while (p) {
+				struct base_data *parent_of_p = p->base;
+
+				if (--p->children_remaining)
+					break;
+				base_list_remove(&done_bases, p);
+				free_base_data(p);
+				free(p);
+				p = parent_of_p;
+			}
+		}
+		work_unlock();
 	}
 	return NULL;
 }
-#endif
 
 /*
  * First pass:
@@ -1076,7 +1126,7 @@ static void parse_pack_objects(unsigned char *sha1)
 
 	/* Check pack integrity */
 	flush();
-	git_SHA1_Final(sha1, &input_ctx);
+	the_hash_algo->final_fn(sha1, &input_ctx);
 	if (hashcmp(fill(20), sha1))
 		die(_("pack is corrupted (SHA1 mismatch)"));
 	use(20);
@@ -1110,7 +1160,9 @@ static void parse_pack_objects(unsigned char *sha1)
  */
 static void resolve_deltas(void)
 {
+#ifndef NO_PTHREADS
 	int i;
+#endif
 
 	if (!nr_deltas)
 		return;
@@ -1122,8 +1174,9 @@ static void resolve_deltas(void)
 	if (verbose)
 		progress = start_progress(_("Resolving deltas"), nr_deltas);
 
-#ifndef NO_PTHREADS
 	nr_dispatched = 0;
+	base_cache_limit = delta_base_cache_limit * nr_threads;
+#ifndef NO_PTHREADS
 	if (nr_threads > 1 || getenv("GIT_FORCE_THREADS")) {
 		init_thread();
 		for (i = 0; i < nr_threads; i++) {
@@ -1139,15 +1192,8 @@ static void resolve_deltas(void)
 		return;
 	}
 #endif
-
-	for (i = 0; i < nr_objects; i++) {
-		struct object_entry *obj = &objects[i];
-
-		if (is_delta_type(obj->type))
-			continue;
-		resolve_base(obj);
-		display_progress(progress, nr_resolved_deltas);
-	}
+	threaded_second_pass(&nothread_data);
+	display_progress(progress, nr_resolved_deltas);
 }
 
 /*
@@ -1285,20 +1331,28 @@ static void fix_unresolved_deltas(struct sha1file *f, int nr_unresolved)
 	for (i = 0; i < n; i++) {
 		struct delta_entry *d = sorted_by_pos[i];
 		enum object_type type;
-		struct base_data *base_obj = alloc_base_data();
+		void *data;
+		unsigned long size;
 
 		if (objects[d->obj_no].real_type != OBJ_REF_DELTA)
 			continue;
-		base_obj->data = read_sha1_file(d->base.sha1, &type, &base_obj->size);
-		if (!base_obj->data)
+		data = read_sha1_file(d->base.sha1, &type, &size);
+		if (!data)
 			continue;
 
-		if (check_sha1_signature(d->base.sha1, base_obj->data,
-				base_obj->size, typename(type)))
+		if (check_sha1_signature(d->base.sha1, data, size,
+					 typename(type)))
 			die(_("local object %s is corrupt"), sha1_to_hex(d->base.sha1));
-		base_obj->obj = append_obj_to_pack(f, d->base.sha1,
-					base_obj->data, base_obj->size, type);
-		find_unresolved_deltas(base_obj);
+
+		/*
+		 * Add the base to the end of the object array and let
+		 * the second-pass machinery pick it up from there, so
+		 * its delta subtree is resolved exactly like any other.
+		 */
+		append_obj_to_pack(f, d->base.sha1, data, size, type);
+		free(data);
+		threaded_second_pass(NULL);
+
 		display_progress(progress, nr_resolved_deltas);
 	}
 	free(sorted_by_pos);
@@ -1306,12 +1360,13 @@ static void fix_unresolved_deltas(struct sha1file *f, int nr_unresolved)
 
 static void final(const char *final_pack_name, const char *curr_pack_name,
 		  const char *final_index_name, const char *curr_index_name,
+		  const char *curr_rev_name,
 		  const char *keep_name, const char *keep_msg,
 		  unsigned char *sha1)
 {
 	const char *report = "pack";
 	char name[PATH_MAX];
-	int err;
+	int err, write_midx = 0, in_odb = 0;
 
 	if (!from_stdin) {
 		close(input_fd);
@@ -1351,12 +1406,29 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 			snprintf(name, sizeof(name), "%s/pack/pack-%s.pack",
 				 get_object_directory(), sha1_to_hex(sha1));
 			final_pack_name = name;
+			in_odb = 1;
 		}
 		if (move_temp_to_file(curr_pack_name, final_pack_name))
 			die(_("cannot store pack file"));
 	} else if (from_stdin)
 		chmod(final_pack_name, 0444);
 
+	if (curr_rev_name) {
+		char revname[PATH_MAX];
+		size_t len;
+
+		/* keep the sidecar next to the index it describes */
+		if (strip_suffix(final_index_name ? final_index_name : "",
+				 ".idx", &len))
+			snprintf(revname, sizeof(revname), "%.*s.rev",
+				 (int)len, final_index_name);
+		else
+			snprintf(revname, sizeof(revname), "%s/pack/pack-%s.rev",
+				 get_object_directory(), sha1_to_hex(sha1));
+		if (move_temp_to_file(curr_rev_name, revname))
+			die(_("cannot store reverse index file"));
+	}
+
 	if (final_index_name != curr_index_name) {
 		if (!final_index_name) {
 			snprintf(name, sizeof(name), "%s/pack/pack-%s.idx",
@@ -1368,6 +1440,16 @@ static void final(const char *final_pack_name, const char *curr_pack_name,
 	} else
 		chmod(final_index_name, 0444);
 
+	/*
+	 * A pack added to the object database invalidates the
+	 * multi-pack-index; fold the new pack in right away so that
+	 * lookups keep hitting a single index.
+	 */
+	if (in_odb &&
+	    !git_config_get_bool("core.multipackindex", &write_midx) &&
+	    write_midx)
+		write_midx_file(get_object_directory());
+
 	if (!from_stdin) {
 		printf("%s\n", sha1_to_hex(sha1));
 	} else {
@@ -1400,6 +1482,13 @@ static int git_index_pack_config(const char *k, const char *v, void *cb)
 			die(_("bad pack.indexversion=%"PRIu32), opts->version);
 		return 0;
 	}
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			opts->flags |= WRITE_REV;
+		else
+			opts->flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "pack.threads")) {
 		nr_threads = git_config_int(k, v);
 		if (nr_threads < 0)
@@ -1533,6 +1622,7 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 {
 	int i, fix_thin_pack = 0, verify = 0, stat_only = 0;
 	const char *curr_index;
+	const char *curr_rev = NULL;
 	const char *index_name = NULL, *pack_name = NULL;
 	const char *keep_name = NULL, *keep_msg = NULL;
 	struct strbuf index_name_buf = STRBUF_INIT,
@@ -1686,11 +1776,15 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 	for (i = 0; i < nr_objects; i++)
 		idx_objects[i] = &objects[i].idx;
 	curr_index = write_idx_file(index_name, idx_objects, nr_objects, &opts, pack_sha1);
+	if (!verify)
+		curr_rev = write_rev_file(NULL, idx_objects, nr_objects,
+					  pack_sha1, &opts);
 	free(idx_objects);
 
 	if (!verify)
 		final(pack_name, curr_pack,
 		      index_name, curr_index,
+		      curr_rev,
 		      keep_name, keep_msg,
 		      pack_sha1);
 	else
@@ -1702,6 +1796,7 @@ int cmd_index_pack(int argc, const char **argv, const char *prefix)
 		free((void *) curr_pack);
 	if (index_name == NULL)
 		free((void *) curr_index);
+	free((void *) curr_rev);
 
 	/*
 	 * Let the caller know this pack is not self contained
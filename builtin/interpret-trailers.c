@@ -12,17 +12,45 @@
 #include "trailer.h"
 
 static const char * const git_interpret_trailers_usage[] = {
-	N_("git interpret-trailers [--trim-empty] [(--trailer <token>[(=|:)<value>])...] [<file>...]"),
+	N_("git interpret-trailers [--trim-empty] [--batch] [(--trailer <token>[(=|:)<value>])...] [<file>...]"),
 	NULL
 };
 
+/*
+ * Read NUL-delimited messages from stdin and process each one,
+ * writing the results back NUL-delimited in the same order.  An
+ * unterminated final record is accepted (and not NUL-terminated on
+ * output either).
+ */
+static void batch_trailers(int trim_empty, struct string_list *trailers)
+{
+	struct strbuf input = STRBUF_INIT;
+	const char *p, *end;
+
+	if (strbuf_read(&input, fileno(stdin), 0) < 0)
+		die_errno(_("could not read from stdin"));
+
+	for (p = input.buf; p < input.buf + input.len; p = end + 1) {
+		end = memchr(p, '\0', input.buf + input.len - p);
+		if (!end)
+			end = input.buf + input.len;
+		process_trailers_buffer(p, end - p, trim_empty, trailers);
+		if (end < input.buf + input.len)
+			putchar('\0');
+	}
+	strbuf_release(&input);
+}
+
 int cmd_interpret_trailers(int argc, const char **argv, const char *prefix)
 {
 	int trim_empty = 0;
+	int batch = 0;
 	struct string_list trailers = STRING_LIST_INIT_DUP;
 
 	struct option options[] = {
 		OPT_BOOL(0, "trim-empty", &trim_empty, N_("trim empty trailers")),
+		OPT_BOOL(0, "batch", &batch,
+			 N_("process NUL-delimited messages from stdin")),
 		OPT_STRING_LIST(0, "trailer", &trailers, N_("trailer"),
 				N_("trailer(s) to add")),
 		OPT_END()
@@ -31,7 +59,12 @@ int cmd_interpret_trailers(int argc, const char **argv, const char *prefix)
 	argc = parse_options(argc, argv, prefix, options,
 			     git_interpret_trailers_usage, 0);
 
-	if (argc) {
+	if (batch) {
+		if (argc)
+			usage_msg_opt(_("--batch does not take file arguments"),
+				      git_interpret_trailers_usage, options);
+		batch_trailers(trim_empty, &trailers);
+	} else if (argc) {
 		int i;
 		for (i = 0; i < argc; i++)
 			process_trailers(argv[i], trim_empty, &trailers);
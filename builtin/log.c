@@ -11,6 +11,7 @@
 #include "revision.h"
 #include "log-tree.h"
 #include "builtin.h"
+#include "blame.h"
 #include "tag.h"
 #include "reflog-walk.h"
 #include "patch-ids.h"
@@ -37,6 +37,9 @@ static char *ps_matched;
 static const char *with_tree;
 static int exc_given;
 static int exclude_args;
+static int skip_count;
+static int max_count = -1;
+static int limit_reached;
 
 static const char *tag_cached = "";
 static const char *tag_unmerged = "";
@@ -47,6 +50,28 @@ static const char *tag_modified = "";
 static const char *tag_skip_worktree = "";
 static const char *tag_resolve_undo = "";
 
+/*
+ * Charge one output record against --skip/--max-count.  Returns non-zero
+ * when the record must not be shown; once the budget is used up,
+ * limit_reached tells the iteration loops to stop early.
+ */
+static int skip_or_done(void)
+{
+	if (limit_reached)
+		return 1;
+	if (skip_count) {
+		skip_count--;
+		return 1;
+	}
+	if (!max_count) {
+		limit_reached = 1;
+		return 1;
+	}
+	if (max_count > 0)
+		max_count--;
+	return 0;
+}
+
 static void write_name(const char *name)
 {
 	/*
@@ -67,6 +92,9 @@ static void show_dir_entry(const char *tag, struct dir_entry *ent)
 	if (!dir_path_match(ent, &pathspec, len, ps_matched))
 		return;
 
+	if (skip_or_done())
+		return;
+
 	fputs(tag, stdout);
 	write_name(ent->name);
 }
@@ -77,6 +105,8 @@ static void show_other_files(struct dir_struct *dir)
 
 	for (i = 0; i < dir->nr; i++) {
 		struct dir_entry *ent = dir->entries[i];
+		if (limit_reached)
+			break;
 		if (!cache_name_is_other(ent->name, ent->len))
 			continue;
 		show_dir_entry(tag_other, ent);
@@ -86,9 +116,9 @@ static void show_other_files(struct dir_struct *dir)
 static void show_killed_files(struct dir_struct *dir)
 {
 	int i;
-	for (i = 0; i < dir->nr; i++) {
+	for (i = 0; i < dir->nr && !limit_reached; i++) {
 		struct dir_entry *ent = dir->entries[i];
-		char *cp, *sp;
+		const char *cp, *sp;
 		int pos, len, killed = 0;
 
 		for (cp = ent->name; cp - ent->name < ent->len; cp = sp + 1) {
@@ -144,6 +174,9 @@ static void show_ce_entry(const char *tag, const struct cache_entry *ce)
 			    S_ISDIR(ce->ce_mode) || S_ISGITLINK(ce->ce_mode)))
 		return;
 
+	if (skip_or_done())
+		return;
+
 	if (tag && *tag && show_valid_bit &&
 	    (ce->ce_flags & CE_VALID)) {
 		static char alttag[4];
@@ -186,7 +219,7 @@ static void show_ru_info(void)
 {
 	struct string_list_item *item;
 
-	if (!the_index.resolve_undo)
+	if (!index_resolve_undo(&the_index))
 		return;
 
 	for_each_string_list_item(item, the_index.resolve_undo) {
@@ -203,6 +236,11 @@ static void show_ru_info(void)
 		for (i = 0; i < 3; i++) {
 			if (!ui->mode[i])
 				continue;
+			if (skip_or_done()) {
+				if (limit_reached)
+					return;
+				continue;
+			}
 			printf("%s%06o %s %d\t", tag_resolve_undo, ui->mode[i],
 			       find_unique_abbrev(ui->sha1[i], abbrev),
 			       i + 1);
@@ -232,7 +270,7 @@ static void show_files(struct dir_struct *dir)
 			show_killed_files(dir);
 	}
 	if (show_cached || show_stage) {
-		for (i = 0; i < active_nr; i++) {
+		for (i = 0; i < active_nr && !limit_reached; i++) {
 			const struct cache_entry *ce = active_cache[i];
 			if ((dir->flags & DIR_SHOW_IGNORED) &&
 			    !ce_excluded(dir, ce))
@@ -246,7 +284,7 @@ static void show_files(struct dir_struct *dir)
 		}
 	}
 	if (show_deleted || show_modified) {
-		for (i = 0; i < active_nr; i++) {
+		for (i = 0; i < active_nr && !limit_reached; i++) {
 			const struct cache_entry *ce = active_cache[i];
 			struct stat st;
 			int err;
@@ -458,6 +496,10 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 			N_("if any <file> is not in the index, treat this as an error")),
 		OPT_STRING(0, "with-tree", &with_tree, N_("tree-ish"),
 			N_("pretend that paths removed since <tree-ish> are still present")),
+		OPT_INTEGER(0, "skip", &skip_count,
+			N_("skip the first <n> entries")),
+		OPT_INTEGER(0, "max-count", &max_count,
+			N_("stop after showing <n> entries")),
 		OPT__ABBREV(&abbrev),
 		OPT_BOOL(0, "debug", &debug_mode, N_("show debugging data")),
 		OPT_END()
@@ -501,6 +543,10 @@ int cmd_ls_files(int argc, const char **argv, const char *cmd_prefix)
 		show_stage = 1;
 	if (dir.exclude_per_dir)
 		exc_given = 1;
+	if (skip_count < 0)
+		die("--skip requires a non-negative value");
+	if (error_unmatch && (skip_count || max_count >= 0))
+		die("--skip and --max-count are incompatible with --error-unmatch");
 
 	if (require_work_tree && !is_inside_work_tree())
 		setup_work_tree();
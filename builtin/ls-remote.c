@@ -38,6 +38,7 @@ int cmd_ls_remote(int argc, const char **argv, const char *prefix)
 	int status = 0;
 	const char *uploadpack = NULL;
 	const char **pattern = NULL;
+	struct string_list ref_prefixes = STRING_LIST_INIT_NODUP;
 
 	struct remote *remote;
 	struct transport *transport;
@@ -92,13 +93,31 @@ int cmd_ls_remote(int argc, const char **argv, const char *prefix)
 
 	if (argv[i]) {
 		int j;
+		int can_limit = 1;
 		pattern = xcalloc(argc - i + 1, sizeof(const char *));
 		for (j = i; j < argc; j++) {
 			int len = strlen(argv[j]);
 			char *p = xmalloc(len + 3);
 			sprintf(p, "*/%s", argv[j]);
 			pattern[j - i] = p;
+			/*
+			 * A full refname without wildcards can double
+			 * as an advertisement prefix; anything else
+			 * may tail-match refs we cannot predict, so
+			 * ask for the full advertisement.
+			 */
+			if (!starts_with(argv[j], "refs/") ||
+			    strpbrk(argv[j], "*?["))
+				can_limit = 0;
 		}
+		if (can_limit)
+			for (j = i; j < argc; j++)
+				string_list_append(&ref_prefixes, argv[j]);
+	} else if (flags & (REF_TAGS | REF_HEADS)) {
+		if (flags & REF_HEADS)
+			string_list_append(&ref_prefixes, "refs/heads/");
+		if (flags & REF_TAGS)
+			string_list_append(&ref_prefixes, "refs/tags/");
 	}
 	remote = remote_get(dest);
 	if (!remote) {
@@ -117,6 +136,8 @@ int cmd_ls_remote(int argc, const char **argv, const char *prefix)
 	transport = transport_get(remote, NULL);
 	if (uploadpack != NULL)
 		transport_set_option(transport, TRANS_OPT_UPLOADPACK, uploadpack);
+	if (ref_prefixes.nr)
+		transport->ref_prefixes = &ref_prefixes;
 
 	ref = transport_get_remote_refs(transport);
 	if (transport_disconnect(transport))
@@ -23,6 +23,9 @@ static int ls_options;
 static struct pathspec pathspec;
 static int chomp_prefix;
 static const char *ls_tree_prefix;
+static int skip_count;
+static int max_count = -1;
+static int limit_reached;
 
 static const  char * const ls_tree_usage[] = {
 	N_("git ls-tree [<options>] <tree-ish> [<path>...]"),
@@ -90,6 +93,22 @@ static int show_tree(const unsigned char *sha1, struct strbuf *base,
 	else if (ls_options & LS_TREE_ONLY)
 		return 0;
 
+	/*
+	 * Charge this entry against --skip/--max-count; returning a
+	 * negative value once the budget is used up makes
+	 * read_tree_recursive() abandon the rest of the walk.
+	 */
+	if (skip_count) {
+		skip_count--;
+		return retval;
+	}
+	if (!max_count) {
+		limit_reached = 1;
+		return -1;
+	}
+	if (max_count > 0)
+		max_count--;
+
 	if (!(ls_options & LS_NAME_ONLY)) {
 		if (ls_options & LS_SHOW_SIZE) {
 			char size_text[24];
@@ -143,6 +162,10 @@ int cmd_ls_tree(int argc, const char **argv, const char *prefix)
 		OPT_BOOL(0, "full-tree", &full_tree,
 			 N_("list entire tree; not just current directory "
 			    "(implies --full-name)")),
+		OPT_INTEGER(0, "skip", &skip_count,
+			    N_("skip the first <n> entries")),
+		OPT_INTEGER(0, "max-count", &max_count,
+			    N_("stop after showing <n> entries")),
 		OPT__ABBREV(&abbrev),
 		OPT_END()
 	};
@@ -154,6 +177,8 @@ int cmd_ls_tree(int argc, const char **argv, const char *prefix)
 
 	argc = parse_options(argc, argv, prefix, ls_tree_options,
 			     ls_tree_usage, 0);
+	if (skip_count < 0)
+		die("--skip requires a non-negative value");
 	if (full_tree) {
 		ls_tree_prefix = prefix = NULL;
 		chomp_prefix = 0;
@@ -184,5 +209,7 @@ int cmd_ls_tree(int argc, const char **argv, const char *prefix)
 	tree = parse_tree_indirect(sha1);
 	if (!tree)
 		die("not a tree object");
-	return !!read_tree_recursive(tree, "", 0, 0, &pathspec, show_tree, NULL);
+	if (read_tree_recursive(tree, "", 0, 0, &pathspec, show_tree, NULL))
+		return !limit_reached;
+	return 0;
 }
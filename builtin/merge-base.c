@@ -27,6 +27,7 @@ static int show_merge_base(struct commit **rev, int rev_nr, int show_all)
 
 static const char * const merge_base_usage[] = {
 	N_("git merge-base [-a | --all] <commit> <commit>..."),
+	N_("git merge-base [-a | --all] --batch"),
 	N_("git merge-base [-a | --all] --octopus <commit>..."),
 	N_("git merge-base --independent <commit>..."),
 	N_("git merge-base --is-ancestor <commit> <commit>"),
@@ -48,6 +49,66 @@ static struct commit *get_commit_reference(const char *arg)
 	return r;
 }
 
+/*
+ * Read one query per line from stdin and answer each on a line of its
+ * own, so that a caller with many pairs to resolve pays for commit
+ * parsing (and the commit-graph, when one exists) once instead of
+ * once per process.  An empty output line means the commits on the
+ * corresponding input line share no common ancestor.
+ */
+static int handle_batch(int show_all)
+{
+	struct strbuf line = STRBUF_INIT;
+	struct commit **rev = NULL;
+	int rev_alloc = 0;
+	int ret = 0;
+
+	while (strbuf_getline(&line, stdin, '\n') != EOF) {
+		struct commit_list *result, *r;
+		const char *p = line.buf;
+		int rev_nr = 0;
+
+		while (*p) {
+			const char *end;
+			char *name;
+
+			while (isspace(*p))
+				p++;
+			if (!*p)
+				break;
+			end = p;
+			while (*end && !isspace(*end))
+				end++;
+			name = xmemdupz(p, end - p);
+			ALLOC_GROW(rev, rev_nr + 1, rev_alloc);
+			rev[rev_nr++] = get_commit_reference(name);
+			free(name);
+			p = end;
+		}
+		if (!rev_nr)
+			continue;
+		if (rev_nr < 2)
+			die("two or more commits per line are needed: '%s'",
+			    line.buf);
+
+		result = get_merge_bases_many(rev[0], rev_nr - 1, rev + 1);
+		if (!result)
+			ret = 1;
+		for (r = result; r; r = r->next) {
+			printf("%s%s", r == result ? "" : " ",
+			       sha1_to_hex(r->item->object.sha1));
+			if (!show_all)
+				break;
+		}
+		putchar('\n');
+		maybe_flush_or_die(stdout, "stdout");
+		free_commit_list(result);
+	}
+	free(rev);
+	strbuf_release(&line);
+	return ret;
+}
+
 static int handle_independent(int count, const char **args)
 {
 	struct commit_list *revs = NULL;
@@ -212,6 +273,8 @@ int cmd_merge_base(int argc, const char **argv, const char *prefix)
 
 	struct option options[] = {
 		OPT_BOOL('a', "all", &show_all, N_("output all common ancestors")),
+		OPT_CMDMODE(0, "batch", &cmdmode,
+			    N_("read many queries from stdin, one per line"), 'b'),
 		OPT_CMDMODE(0, "octopus", &cmdmode,
 			    N_("find ancestors for a single n-way merge"), 'o'),
 		OPT_CMDMODE(0, "independent", &cmdmode,
@@ -237,6 +300,12 @@ int cmd_merge_base(int argc, const char **argv, const char *prefix)
 	if (cmdmode == 'r' && show_all)
 		die("--independent cannot be used with --all");
 
+	if (cmdmode == 'b') {
+		if (argc)
+			usage_with_options(merge_base_usage, options);
+		return handle_batch(show_all);
+	}
+
 	if (cmdmode == 'o')
 		return handle_octopus(argc, argv, show_all);
 
@@ -2,10 +2,14 @@
 #include "tree-walk.h"
 #include "xdiff-interface.h"
 #include "blob.h"
+#include "commit.h"
 #include "exec_cmd.h"
 #include "merge-blobs.h"
+#include "merge-recursive.h"
 
-static const char merge_tree_usage[] = "git merge-tree <base-tree> <branch1> <branch2>";
+static const char merge_tree_usage[] =
+"git merge-tree <base-tree> <branch1> <branch2>\n"
+"   or: git merge-tree --write-tree <branch1> <branch2>";
 
 struct merge_list {
 	struct merge_list *next;
@@ -25,7 +29,7 @@ static void add_merge_entry(struct merge_list *entry)
 	merge_result_end = &entry->next;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base);
+static void trivial_merge_trees(struct tree_desc t[3], const char *base);
 
 static const char *explanation(struct merge_list *entry)
 {
@@ -104,7 +108,7 @@ static void show_diff(struct merge_list *entry)
 	xdemitconf_t xecfg;
 	xdemitcb_t ecb;
 
-	xpp.flags = 0;
+	memset(&xpp, 0, sizeof(xpp));
 	memset(&xecfg, 0, sizeof(xecfg));
 	xecfg.ctxlen = 3;
 	ecb.outf = show_outf;
@@ -218,7 +222,7 @@ static void unresolved_directory(const struct traverse_info *info,
 	buf2 = fill_tree_descriptor(t+2, ENTRY_SHA1(n + 2));
 #undef ENTRY_SHA1
 
-	merge_trees(t, newbase);
+	trivial_merge_trees(t, newbase);
 
 	free(buf0);
 	free(buf1);
@@ -335,7 +339,7 @@ static int threeway_callback(int n, unsigned long mask, unsigned long dirmask, s
 	return mask;
 }
 
-static void merge_trees(struct tree_desc t[3], const char *base)
+static void trivial_merge_trees(struct tree_desc t[3], const char *base)
 {
 	struct traverse_info info;
 
@@ -357,18 +361,67 @@ static void *get_tree_descriptor(struct tree_desc *desc, const char *rev)
 	return buf;
 }
 
+static struct commit *get_commit_or_die(const char *rev)
+{
+	unsigned char sha1[20];
+	struct commit *commit;
+
+	if (get_sha1(rev, sha1))
+		die("unknown rev %s", rev);
+	commit = lookup_commit_reference(sha1);
+	if (!commit)
+		die("%s is not a commit", rev);
+	return commit;
+}
+
+/*
+ * Run a full recursive merge purely in core and report the result:
+ * the resulting tree on a clean merge, the conflicting index stages
+ * (in the same format as "git ls-files -u") otherwise.  Neither the
+ * index file nor any working tree is touched, so this works in bare
+ * repositories.
+ */
+static int real_merge(const char *branch1, const char *branch2)
+{
+	struct commit *result;
+	struct merge_options o;
+	int clean, i;
+
+	init_merge_options(&o);
+	o.verbosity = -1;	/* no "Merging ..." chatter on plumbing output */
+	o.no_worktree = 1;
+	o.branch1 = branch1;
+	o.branch2 = branch2;
+
+	clean = merge_recursive(&o, get_commit_or_die(branch1),
+				get_commit_or_die(branch2), NULL, &result);
+	if (clean) {
+		printf("%s\n", sha1_to_hex(result->tree->object.sha1));
+		return 0;
+	}
+	for (i = 0; i < active_nr; i++) {
+		const struct cache_entry *ce = active_cache[i];
+		if (ce_stage(ce))
+			printf("%06o %s %d\t%s\n", ce->ce_mode,
+			       sha1_to_hex(ce->sha1), ce_stage(ce), ce->name);
+	}
+	return 1;
+}
+
 int cmd_merge_tree(int argc, const char **argv, const char *prefix)
 {
 	struct tree_desc t[3];
 	void *buf1, *buf2, *buf3;
 
+	if (argc == 4 && !strcmp(argv[1], "--write-tree"))
+		return real_merge(argv[2], argv[3]);
 	if (argc != 4)
 		usage(merge_tree_usage);
 
 	buf1 = get_tree_descriptor(t+0, argv[1]);
 	buf2 = get_tree_descriptor(t+1, argv[2]);
 	buf3 = get_tree_descriptor(t+2, argv[3]);
-	merge_trees(t, "");
+	trivial_merge_trees(t, "");
 	free(buf1);
 	free(buf2);
 	free(buf3);
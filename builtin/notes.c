@@ -924,8 +924,10 @@ static int prune(int argc, const char **argv, const char *prefix)
 
 	prune_notes(t, (verbose ? NOTES_PRUNE_VERBOSE : 0) |
 		(show_only ? NOTES_PRUNE_VERBOSE|NOTES_PRUNE_DRYRUN : 0) );
-	if (!show_only)
+	if (!show_only) {
 		commit_notes(t, "Notes removed by 'git notes prune'");
+		write_notes_index(t);
+	}
 	free_notes(t);
 	return 0;
 }
@@ -22,7 +22,10 @@
 #include "pack-bitmap.h"
 #include "reachable.h"
 #include "sha1-array.h"
+#include "string-list.h"
 #include "argv-array.h"
+#include "delta-islands.h"
+#include "hashmap.h"
 
 static const char *pack_usage[] = {
 	N_("git pack-objects --stdout [options...] [< ref-list | < object-list]"),
@@ -37,6 +40,13 @@ static const char *pack_usage[] = {
  */
 static struct packing_data to_pack;
 
+#define DELTA(obj) oe_delta(&to_pack, obj)
+#define DELTA_CHILD(obj) oe_delta_child(&to_pack, obj)
+#define DELTA_SIBLING(obj) oe_delta_sibling(&to_pack, obj)
+#define SET_DELTA(obj, val) oe_set_delta(&to_pack, obj, val)
+#define SET_DELTA_CHILD(obj, val) oe_set_delta_child(&to_pack, obj, val)
+#define SET_DELTA_SIBLING(obj, val) oe_set_delta_sibling(&to_pack, obj, val)
+
 static struct pack_idx_entry **written_list;
 static uint32_t nr_result, nr_written;
 
@@ -60,6 +70,7 @@ static int num_preferred_base;
 static struct progress *progress_state;
 static int pack_compression_level = Z_DEFAULT_COMPRESSION;
 static int pack_compression_seen;
+static int pack_codec = PACK_CODEC_ZLIB;
 
 static struct packed_git *reuse_packfile;
 static uint32_t reuse_packfile_objects;
@@ -67,12 +78,105 @@ static off_t reuse_packfile_offset;
 
 static int use_bitmap_index = 1;
 static int write_bitmap_index;
+static int use_delta_islands;
 static uint16_t write_bitmap_options;
+static struct string_list filter_paths = STRING_LIST_INIT_NODUP;
+static int no_blobs;
 
 static unsigned long delta_cache_size = 0;
 static unsigned long max_delta_cache_size = 256 * 1024 * 1024;
 static unsigned long cache_max_small_delta_size = 1000;
 
+/*
+ * Cached delta data used to hang directly off of struct object_entry,
+ * but only a bounded amount of it (max_delta_cache_size) ever exists
+ * at once, while the entry array covers every object in the
+ * repository.  Keep it in a side table instead, keyed by the entry's
+ * index in to_pack.objects (which is stable by the time deltas are
+ * being searched).  Mutations must hold cache_lock() during the
+ * threaded delta search; lookups of an entry owned by the current
+ * thread may then use the returned node without the lock, since
+ * hashmap nodes do not move on rehash.
+ */
+struct cached_delta {
+	struct hashmap_entry ent;
+	uint32_t index;
+	unsigned long z_size;	/* nonzero once the data is deflated */
+	void *data;
+};
+
+static struct hashmap cached_deltas;
+
+static int cached_delta_cmp(const void *entry, const void *entry_or_key,
+			    const void *keydata)
+{
+	const struct cached_delta *a = entry;
+	const struct cached_delta *b = entry_or_key;
+
+	return a->index != b->index;
+}
+
+static uint32_t entry_index(const struct object_entry *e)
+{
+	return (uint32_t)(e - to_pack.objects);
+}
+
+static struct cached_delta *find_cached_delta(const struct object_entry *e)
+{
+	struct cached_delta key;
+
+	if (!cached_deltas.tablesize)
+		return NULL;
+	hashmap_entry_init(&key, entry_index(e));
+	key.index = entry_index(e);
+	return hashmap_get(&cached_deltas, &key, NULL);
+}
+
+static void set_cached_delta(struct object_entry *e, void *data)
+{
+	struct cached_delta *cached;
+
+	if (!cached_deltas.tablesize)
+		hashmap_init(&cached_deltas, cached_delta_cmp, 0);
+	cached = find_cached_delta(e);
+	if (!cached) {
+		cached = xmalloc(sizeof(*cached));
+		hashmap_entry_init(cached, entry_index(e));
+		cached->index = entry_index(e);
+		hashmap_add(&cached_deltas, cached);
+	} else {
+		free(cached->data);
+	}
+	cached->z_size = 0;
+	cached->data = data;
+}
+
+static int drop_cached_delta(struct object_entry *e)
+{
+	struct cached_delta *cached = find_cached_delta(e);
+
+	if (!cached)
+		return 0;
+	hashmap_remove(&cached_deltas, cached, NULL);
+	free(cached->data);
+	free(cached);
+	return 1;
+}
+
+static void *detach_cached_delta(struct object_entry *e, unsigned long *z_size)
+{
+	struct cached_delta *cached = find_cached_delta(e);
+	void *data;
+
+	if (!cached)
+		return NULL;
+	hashmap_remove(&cached_deltas, cached, NULL);
+	data = cached->data;
+	*z_size = cached->z_size;
+	free(cached);
+	return data;
+}
+
 static unsigned long window_memory_limit = 0;
 
 /*
@@ -107,9 +211,9 @@ static void *get_delta(struct object_entry *entry)
 	buf = read_sha1_file(entry->idx.sha1, &type, &size);
 	if (!buf)
 		die("unable to read %s", sha1_to_hex(entry->idx.sha1));
-	base_buf = read_sha1_file(entry->delta->idx.sha1, &type, &base_size);
+	base_buf = read_sha1_file(DELTA(entry)->idx.sha1, &type, &base_size);
 	if (!base_buf)
-		die("unable to read %s", sha1_to_hex(entry->delta->idx.sha1));
+		die("unable to read %s", sha1_to_hex(DELTA(entry)->idx.sha1));
 	delta_buf = diff_delta(base_buf, base_size,
 			       buf, size, &delta_size, 0);
 	if (!delta_buf || delta_size != entry->delta_size)
@@ -233,18 +337,291 @@ static void copy_pack_data(struct sha1file *f,
 }
 
 /* Return 0 if we will bust the pack-size limit */
+
+/*
+ * Write-phase deflate pipeline.  Once the delta search is done, the
+ * writer thread still deflates every payload it could not reuse,
+ * which leaves a long single-threaded tail on big repacks.  The
+ * writer reads raw payloads a bounded distance ahead of the write
+ * cursor and queues them here; worker threads deflate them while the
+ * writer sequences, hashes and writes earlier objects.  All object
+ * database access stays on the writer thread, so the read paths need
+ * no extra locking.
+ *
+ * The pipeline only runs without a pack size limit; a pack split can
+ * retroactively turn a delta unusable, which would invalidate work
+ * queued ahead of the cursor.
+ */
+#define DEFLATE_WINDOW 64
+#define DEFLATE_BUFFER_LIMIT (32 * 1024 * 1024)
+
+struct deflate_job {
+	struct hashmap_entry ent;
+	uint32_t index;
+	struct deflate_job *next;
+	void *data;		/* raw payload, deflated in place */
+	unsigned long size;	/* uncompressed payload size */
+	unsigned long datalen;	/* deflated size, valid once done */
+	enum object_type type;
+	unsigned is_delta:1;
+	unsigned done:1;
+};
+
+#ifndef NO_PTHREADS
+
+static struct hashmap deflate_jobs;
+static struct deflate_job *deflate_todo;
+static struct deflate_job **deflate_todo_tail = &deflate_todo;
+static pthread_mutex_t deflate_mutex;
+static pthread_cond_t deflate_todo_cond;
+static pthread_cond_t deflate_done_cond;
+static pthread_t *deflate_threads;
+static int deflate_nr_threads;
+static int deflate_shutdown;
+static unsigned long deflate_buffered;
+static uint32_t deflate_lookahead;
+
+static int deflate_job_cmp(const void *entry, const void *entry_or_key,
+			   const void *keydata)
+{
+	const struct deflate_job *a = entry;
+	const struct deflate_job *b = entry_or_key;
+
+	return a->index != b->index;
+}
+
+static void *deflate_worker(void *arg)
+{
+	pthread_mutex_lock(&deflate_mutex);
+	while (1) {
+		struct deflate_job *job;
+
+		while (!deflate_todo && !deflate_shutdown)
+			pthread_cond_wait(&deflate_todo_cond, &deflate_mutex);
+		if (!deflate_todo)
+			break;
+		job = deflate_todo;
+		deflate_todo = job->next;
+		if (!deflate_todo)
+			deflate_todo_tail = &deflate_todo;
+		pthread_mutex_unlock(&deflate_mutex);
+
+		job->datalen = do_compress(&job->data, job->size);
+
+		pthread_mutex_lock(&deflate_mutex);
+		job->done = 1;
+		pthread_cond_broadcast(&deflate_done_cond);
+	}
+	pthread_mutex_unlock(&deflate_mutex);
+	return NULL;
+}
+
+static void deflate_enqueue(struct object_entry *e, void *data,
+			    unsigned long size, enum object_type type,
+			    int is_delta)
+{
+	struct deflate_job *job = xcalloc(1, sizeof(*job));
+
+	hashmap_entry_init(job, entry_index(e));
+	job->index = entry_index(e);
+	job->data = data;
+	job->size = size;
+	job->type = type;
+	job->is_delta = is_delta;
+
+	pthread_mutex_lock(&deflate_mutex);
+	hashmap_add(&deflate_jobs, job);
+	*deflate_todo_tail = job;
+	deflate_todo_tail = &job->next;
+	deflate_buffered += size;
+	pthread_cond_signal(&deflate_todo_cond);
+	pthread_mutex_unlock(&deflate_mutex);
+}
+
+/*
+ * Mirror of the usable_delta/to_reuse decisions in write_object(),
+ * evaluated ahead of time.  With no pack size limit a delta is
+ * usable exactly when the entry has one, so the prediction can only
+ * go stale through the recursive-delta safety valve, which the
+ * consumer handles by falling back to the inline path.
+ */
+static int deflate_want(struct object_entry *e)
+{
+	if (e->preferred_base || e->idx.offset)
+		return 0;
+	if (reuse_object && e->in_pack &&
+	    e->in_pack->pack_codec ==
+	    (pack_to_stdout ? PACK_CODEC_ZLIB : pack_codec)) {
+		if (e->type == OBJ_REF_DELTA || e->type == OBJ_OFS_DELTA)
+			return 0;	/* reused as-is */
+		if (e->type == e->in_pack_type && !DELTA(e))
+			return 0;	/* reused undeltified */
+	}
+	if (!DELTA(e) && e->type == OBJ_BLOB &&
+	    e->size > big_file_threshold)
+		return 0;		/* will be streamed */
+	return 1;
+}
+
+static void deflate_read_ahead(struct object_entry **write_order,
+			       uint32_t cursor)
+{
+	if (!deflate_nr_threads)
+		return;
+	while (deflate_lookahead < to_pack.nr_objects &&
+	       deflate_lookahead < cursor + DEFLATE_WINDOW) {
+		struct object_entry *e = write_order[deflate_lookahead];
+		unsigned long raw = DELTA(e) ? e->delta_size : e->size;
+		int full;
+
+		if (!deflate_want(e) || raw > DEFLATE_BUFFER_LIMIT) {
+			deflate_lookahead++;
+			continue;
+		}
+
+		pthread_mutex_lock(&deflate_mutex);
+		full = deflate_buffered + raw > DEFLATE_BUFFER_LIMIT;
+		pthread_mutex_unlock(&deflate_mutex);
+		if (full)
+			break;	/* resume once the writer drains some */
+
+		if (DELTA(e)) {
+			struct cached_delta *cd = find_cached_delta(e);
+			unsigned long z_size;
+			void *data;
+
+			if (cd && cd->z_size) {
+				/* already deflated during the search */
+				deflate_lookahead++;
+				continue;
+			}
+			data = cd ? detach_cached_delta(e, &z_size) :
+				    get_delta(e);
+			deflate_enqueue(e, data, e->delta_size,
+					OBJ_REF_DELTA, 1);
+		} else {
+			enum object_type type;
+			unsigned long size;
+			void *data;
+
+			data = read_sha1_file(e->idx.sha1, &type, &size);
+			if (!data) {
+				/* let the writer die with its message */
+				deflate_lookahead++;
+				continue;
+			}
+			deflate_enqueue(e, data, size, type, 0);
+		}
+		deflate_lookahead++;
+	}
+}
+
+static struct deflate_job *deflate_take(struct object_entry *e)
+{
+	struct deflate_job key;
+	struct deflate_job *job;
+
+	if (!deflate_nr_threads)
+		return NULL;
+	hashmap_entry_init(&key, entry_index(e));
+	key.index = entry_index(e);
+	pthread_mutex_lock(&deflate_mutex);
+	job = hashmap_get(&deflate_jobs, &key, NULL);
+	if (job) {
+		while (!job->done)
+			pthread_cond_wait(&deflate_done_cond, &deflate_mutex);
+		hashmap_remove(&deflate_jobs, job, NULL);
+		deflate_buffered -= job->size;
+	}
+	pthread_mutex_unlock(&deflate_mutex);
+	return job;
+}
+
+static void start_deflate_pipeline(void)
+{
+	int i, threads;
+
+	if (pack_size_limit)
+		return;
+	threads = delta_search_threads ? delta_search_threads :
+		  online_cpus();
+	if (threads <= 1)
+		return;
+	hashmap_init(&deflate_jobs, deflate_job_cmp, 0);
+	pthread_mutex_init(&deflate_mutex, NULL);
+	pthread_cond_init(&deflate_todo_cond, NULL);
+	pthread_cond_init(&deflate_done_cond, NULL);
+	deflate_threads = xcalloc(threads, sizeof(*deflate_threads));
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&deflate_threads[i], NULL,
+				   deflate_worker, NULL))
+			die("unable to create thread: %s", strerror(errno));
+	deflate_nr_threads = threads;
+}
+
+static void stop_deflate_pipeline(void)
+{
+	struct hashmap_iter iter;
+	struct deflate_job *job;
+	int i;
+
+	if (!deflate_nr_threads)
+		return;
+	pthread_mutex_lock(&deflate_mutex);
+	deflate_shutdown = 1;
+	pthread_cond_broadcast(&deflate_todo_cond);
+	pthread_mutex_unlock(&deflate_mutex);
+	for (i = 0; i < deflate_nr_threads; i++)
+		pthread_join(deflate_threads[i], NULL);
+	free(deflate_threads);
+	deflate_threads = NULL;
+	deflate_nr_threads = 0;
+	pthread_mutex_destroy(&deflate_mutex);
+	pthread_cond_destroy(&deflate_todo_cond);
+	pthread_cond_destroy(&deflate_done_cond);
+
+	/* objects written through another path never took their job */
+	hashmap_iter_init(&deflate_jobs, &iter);
+	while ((job = hashmap_iter_next(&iter)) != NULL)
+		free(job->data);
+	hashmap_free(&deflate_jobs, 1);
+}
+
+#else
+
+#define deflate_read_ahead(order, cursor)
+#define deflate_take(entry) ((struct deflate_job *)NULL)
+#define start_deflate_pipeline()
+#define stop_deflate_pipeline()
+
+#endif
+
 static unsigned long write_no_reuse_object(struct sha1file *f, struct object_entry *entry,
 					   unsigned long limit, int usable_delta)
 {
 	unsigned long size, datalen;
+	unsigned long z_delta_size = 0;
 	unsigned char header[10], dheader[10];
 	unsigned hdrlen;
 	enum object_type type;
-	void *buf;
+	void *buf, *cached;
 	struct git_istream *st = NULL;
+	struct deflate_job *job = deflate_take(entry);
+
+	if (job && job->is_delta != (usable_delta != 0)) {
+		/* the pipeline's prediction went stale; redo inline */
+		free(job->data);
+		free(job);
+		job = NULL;
+	}
 
 	if (!usable_delta) {
-		if (entry->type == OBJ_BLOB &&
+		if (job) {
+			buf = job->data;
+			size = job->size;
+			type = job->type;
+			z_delta_size = job->datalen;
+		} else if (entry->type == OBJ_BLOB &&
 		    entry->size > big_file_threshold &&
 		    (st = open_istream(entry->idx.sha1, &type, &size, NULL)) != NULL)
 			buf = NULL;
@@ -257,26 +634,30 @@ static unsigned long write_no_reuse_object(struct sha1file *f, struct object_ent
 		 * make sure no cached delta data remains from a
 		 * previous attempt before a pack split occurred.
 		 */
-		free(entry->delta_data);
-		entry->delta_data = NULL;
-		entry->z_delta_size = 0;
-	} else if (entry->delta_data) {
+		drop_cached_delta(entry);
+	} else if (job) {
 		size = entry->delta_size;
-		buf = entry->delta_data;
-		entry->delta_data = NULL;
-		type = (allow_ofs_delta && entry->delta->idx.offset) ?
+		buf = job->data;
+		z_delta_size = job->datalen;
+		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
+			OBJ_OFS_DELTA : OBJ_REF_DELTA;
+	} else if ((cached = detach_cached_delta(entry, &z_delta_size)) != NULL) {
+		size = entry->delta_size;
+		buf = cached;
+		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	} else {
 		buf = get_delta(entry);
 		size = entry->delta_size;
-		type = (allow_ofs_delta && entry->delta->idx.offset) ?
+		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	}
+	free(job);
 
 	if (st)	/* large blob case, just assume we don't compress well */
 		datalen = size;
-	else if (entry->z_delta_size)
-		datalen = entry->z_delta_size;
+	else if (z_delta_size)
+		datalen = z_delta_size;
 	else
 		datalen = do_compress(&buf, size);
 
@@ -292,7 +673,7 @@ static unsigned long write_no_reuse_object(struct sha1file *f, struct object_ent
 		 * encoding of the relative offset for the delta
 		 * base from this object's position in the pack.
 		 */
-		off_t ofs = entry->idx.offset - entry->delta->idx.offset;
+		off_t ofs = entry->idx.offset - DELTA(entry)->idx.offset;
 		unsigned pos = sizeof(dheader) - 1;
 		dheader[pos] = ofs & 127;
 		while (ofs >>= 7)
@@ -318,7 +699,7 @@ static unsigned long write_no_reuse_object(struct sha1file *f, struct object_ent
 			return 0;
 		}
 		sha1write(f, header, hdrlen);
-		sha1write(f, entry->delta->idx.sha1, 20);
+		sha1write(f, DELTA(entry)->idx.sha1, 20);
 		hdrlen += 20;
 	} else {
 		if (limit && hdrlen + datalen + 20 >= limit) {
@@ -353,8 +734,8 @@ static unsigned long write_reuse_object(struct sha1file *f, struct object_entry
 	unsigned char header[10], dheader[10];
 	unsigned hdrlen;
 
-	if (entry->delta)
-		type = (allow_ofs_delta && entry->delta->idx.offset) ?
+	if (DELTA(entry))
+		type = (allow_ofs_delta && DELTA(entry)->idx.offset) ?
 			OBJ_OFS_DELTA : OBJ_REF_DELTA;
 	hdrlen = encode_in_pack_object_header(type, entry->size, header);
 
@@ -379,7 +760,7 @@ static unsigned long write_reuse_object(struct sha1file *f, struct object_entry
 	}
 
 	if (type == OBJ_OFS_DELTA) {
-		off_t ofs = entry->idx.offset - entry->delta->idx.offset;
+		off_t ofs = entry->idx.offset - DELTA(entry)->idx.offset;
 		unsigned pos = sizeof(dheader) - 1;
 		dheader[pos] = ofs & 127;
 		while (ofs >>= 7)
@@ -398,7 +779,7 @@ static unsigned long write_reuse_object(struct sha1file *f, struct object_entry
 			return 0;
 		}
 		sha1write(f, header, hdrlen);
-		sha1write(f, entry->delta->idx.sha1, 20);
+		sha1write(f, DELTA(entry)->idx.sha1, 20);
 		hdrlen += 20;
 		reused_delta++;
 	} else {
@@ -437,13 +818,13 @@ static unsigned long write_object(struct sha1file *f,
 	else
 		limit = pack_size_limit - write_offset;
 
-	if (!entry->delta)
+	if (!DELTA(entry))
 		usable_delta = 0;	/* no delta */
 	else if (!pack_size_limit)
 	       usable_delta = 1;	/* unlimited packfile */
-	else if (entry->delta->idx.offset == (off_t)-1)
+	else if (DELTA(entry)->idx.offset == (off_t)-1)
 		usable_delta = 0;	/* base was written to another pack */
-	else if (entry->delta->idx.offset)
+	else if (DELTA(entry)->idx.offset)
 		usable_delta = 1;	/* base already exists in this pack */
 	else
 		usable_delta = 0;	/* base could end up in another pack */
@@ -452,13 +833,16 @@ static unsigned long write_object(struct sha1file *f,
 		to_reuse = 0;	/* explicit */
 	else if (!entry->in_pack)
 		to_reuse = 0;	/* can't reuse what we don't have */
+	else if (entry->in_pack->pack_codec !=
+		 (pack_to_stdout ? PACK_CODEC_ZLIB : pack_codec))
+		to_reuse = 0;	/* raw data is in a different codec */
 	else if (entry->type == OBJ_REF_DELTA || entry->type == OBJ_OFS_DELTA)
 				/* check_object() decided it for us ... */
 		to_reuse = usable_delta;
 				/* ... but pack split may override that */
 	else if (entry->type != entry->in_pack_type)
 		to_reuse = 0;	/* pack has delta which is unusable */
-	else if (entry->delta)
+	else if (DELTA(entry))
 		to_reuse = 0;	/* we want to pack afresh */
 	else
 		to_reuse = 1;	/* we have it in-pack undeltified,
@@ -510,12 +894,12 @@ static enum write_one_status write_one(struct sha1file *f,
 	}
 
 	/* if we are deltified, write out base object first. */
-	if (e->delta) {
+	if (DELTA(e)) {
 		e->idx.offset = 1; /* now recurse */
-		switch (write_one(f, e->delta, offset)) {
+		switch (write_one(f, DELTA(e), offset)) {
 		case WRITE_ONE_RECURSIVE:
 			/* we cannot depend on this one */
-			e->delta = NULL;
+			SET_DELTA(e, NULL);
 			break;
 		default:
 			break;
@@ -544,12 +928,12 @@ static int mark_tagged(const char *path, const unsigned char *sha1, int flag,
 		       void *cb_data)
 {
 	unsigned char peeled[20];
-	struct object_entry *entry = packlist_find(&to_pack, sha1, NULL);
+	struct object_entry *entry = packlist_find(&to_pack, sha1);
 
 	if (entry)
 		entry->tagged = 1;
 	if (!peel_ref(path, peeled)) {
-		entry = packlist_find(&to_pack, peeled, NULL);
+		entry = packlist_find(&to_pack, peeled);
 		if (entry)
 			entry->tagged = 1;
 	}
@@ -577,34 +961,34 @@ static void add_descendants_to_write_order(struct object_entry **wo,
 			/* add this node... */
 			add_to_write_order(wo, endp, e);
 			/* all its siblings... */
-			for (s = e->delta_sibling; s; s = s->delta_sibling) {
+			for (s = DELTA_SIBLING(e); s; s = DELTA_SIBLING(s)) {
 				add_to_write_order(wo, endp, s);
 			}
 		}
 		/* drop down a level to add left subtree nodes if possible */
-		if (e->delta_child) {
+		if (DELTA_CHILD(e)) {
 			add_to_order = 1;
-			e = e->delta_child;
+			e = DELTA_CHILD(e);
 		} else {
 			add_to_order = 0;
 			/* our sibling might have some children, it is next */
-			if (e->delta_sibling) {
-				e = e->delta_sibling;
+			if (DELTA_SIBLING(e)) {
+				e = DELTA_SIBLING(e);
 				continue;
 			}
 			/* go back to our parent node */
-			e = e->delta;
-			while (e && !e->delta_sibling) {
+			e = DELTA(e);
+			while (e && !DELTA_SIBLING(e)) {
 				/* we're on the right side of a subtree, keep
 				 * going up until we can go right again */
-				e = e->delta;
+				e = DELTA(e);
 			}
 			if (!e) {
 				/* done- we hit our original root node */
 				return;
 			}
 			/* pass it off to sibling at this level */
-			e = e->delta_sibling;
+			e = DELTA_SIBLING(e);
 		}
 	};
 }
@@ -615,7 +999,7 @@ static void add_family_to_write_order(struct object_entry **wo,
 {
 	struct object_entry *root;
 
-	for (root = e; root->delta; root = root->delta)
+	for (root = e; DELTA(root); root = DELTA(root))
 		; /* nothing */
 	add_descendants_to_write_order(wo, endp, root);
 }
@@ -630,8 +1014,8 @@ static struct object_entry **compute_write_order(void)
 	for (i = 0; i < to_pack.nr_objects; i++) {
 		objects[i].tagged = 0;
 		objects[i].filled = 0;
-		objects[i].delta_child = NULL;
-		objects[i].delta_sibling = NULL;
+		SET_DELTA_CHILD(&objects[i], NULL);
+		SET_DELTA_SIBLING(&objects[i], NULL);
 	}
 
 	/*
@@ -641,11 +1025,11 @@ static struct object_entry **compute_write_order(void)
 	 */
 	for (i = to_pack.nr_objects; i > 0;) {
 		struct object_entry *e = &objects[--i];
-		if (!e->delta)
+		if (!DELTA(e))
 			continue;
 		/* Mark me as the first child */
-		e->delta_sibling = e->delta->delta_child;
-		e->delta->delta_child = e;
+		SET_DELTA_SIBLING(e, DELTA_CHILD(DELTA(e)));
+		SET_DELTA_CHILD(DELTA(e), e);
 	}
 
 	/*
@@ -707,37 +1091,41 @@ static struct object_entry **compute_write_order(void)
 
 static off_t write_reused_pack(struct sha1file *f)
 {
-	unsigned char buffer[8192];
-	off_t to_write, total;
-	int fd;
+	struct pack_window *w_curs = NULL;
+	off_t offset, to_write, total;
 
 	if (!is_pack_valid(reuse_packfile))
 		die("packfile is invalid: %s", reuse_packfile->pack_name);
 
-	fd = git_open_noatime(reuse_packfile->pack_name);
-	if (fd < 0)
-		die_errno("unable to open packfile for reuse: %s",
-			  reuse_packfile->pack_name);
-
-	if (lseek(fd, sizeof(struct pack_header), SEEK_SET) == -1)
-		die_errno("unable to seek in reused packfile");
-
 	if (reuse_packfile_offset < 0)
 		reuse_packfile_offset = reuse_packfile->pack_size - 20;
 
-	total = to_write = reuse_packfile_offset - sizeof(struct pack_header);
+	offset = sizeof(struct pack_header);
+	total = to_write = reuse_packfile_offset - offset;
+	set_pack_access_pattern(PACK_ACCESS_SEQUENTIAL);
 
+	/*
+	 * Feed the reused span to the output straight from the pack
+	 * windows, so nothing is read() into a scratch buffer first.
+	 * The bytes still flow through sha1write() because the
+	 * trailing checksum of the pack we emit must cover them; that
+	 * rules out sendfile(), but the checksum is computed directly
+	 * on the mapped pages.
+	 */
 	while (to_write) {
-		int read_pack = xread(fd, buffer, sizeof(buffer));
-
-		if (read_pack <= 0)
-			die_errno("unable to read from reused packfile");
+		unsigned long avail;
+		unsigned char *in = use_pack(reuse_packfile, &w_curs,
+					     offset, &avail);
 
-		if (read_pack > to_write)
-			read_pack = to_write;
+		/* chunked only to keep the progress meter moving */
+		if (avail > (1 << 22))
+			avail = 1 << 22;
+		if (avail > to_write)
+			avail = to_write;
 
-		sha1write(f, buffer, read_pack);
-		to_write -= read_pack;
+		sha1write(f, in, avail);
+		offset += avail;
+		to_write -= avail;
 
 		/*
 		 * We don't know the actual number of objects written,
@@ -752,7 +1140,8 @@ static off_t write_reused_pack(struct sha1file *f)
 		display_progress(progress_state, written);
 	}
 
-	close(fd);
+	set_pack_access_pattern(PACK_ACCESS_NORMAL);
+	unuse_pack(&w_curs);
 	written = reuse_packfile_objects;
 	display_progress(progress_state, written);
 	return reuse_packfile_offset - sizeof(struct pack_header);
@@ -771,6 +1160,7 @@ static void write_pack_file(void)
 		progress_state = start_progress(_("Writing objects"), nr_result);
 	written_list = xmalloc(to_pack.nr_objects * sizeof(*written_list));
 	write_order = compute_write_order();
+	start_deflate_pipeline();
 
 	do {
 		unsigned char sha1[20];
@@ -781,7 +1171,9 @@ static void write_pack_file(void)
 		else
 			f = create_tmp_packfile(&pack_tmp_name);
 
-		offset = write_pack_header(f, nr_remaining);
+		offset = write_pack_header(f, nr_remaining,
+					   pack_to_stdout ?
+					   PACK_CODEC_ZLIB : pack_codec);
 
 		if (reuse_packfile) {
 			off_t packfile_size;
@@ -794,6 +1186,7 @@ static void write_pack_file(void)
 		nr_written = 0;
 		for (; i < to_pack.nr_objects; i++) {
 			struct object_entry *e = write_order[i];
+			deflate_read_ahead(write_order, i);
 			if (write_one(f, e, &offset) == WRITE_ONE_BREAK)
 				break;
 			display_progress(progress_state, written);
@@ -877,6 +1270,7 @@ static void write_pack_file(void)
 		nr_remaining -= nr_written;
 	} while (nr_remaining && i < to_pack.nr_objects);
 
+	stop_deflate_pipeline();
 	free(written_list);
 	free(write_order);
 	stop_progress(&progress_state);
@@ -918,12 +1312,11 @@ static int no_try_delta(const char *path)
  * few lines later when we want to add the new entry.
  */
 static int have_duplicate_entry(const unsigned char *sha1,
-				int exclude,
-				uint32_t *index_pos)
+				int exclude)
 {
 	struct object_entry *entry;
 
-	entry = packlist_find(&to_pack, sha1, index_pos);
+	entry = packlist_find(&to_pack, sha1);
 	if (!entry)
 		return 0;
 
@@ -987,13 +1380,12 @@ static void create_object_entry(const unsigned char *sha1,
 				uint32_t hash,
 				int exclude,
 				int no_try_delta,
-				uint32_t index_pos,
 				struct packed_git *found_pack,
 				off_t found_offset)
 {
 	struct object_entry *entry;
 
-	entry = packlist_alloc(&to_pack, sha1, index_pos);
+	entry = packlist_alloc(&to_pack, sha1);
 	entry->hash = hash;
 	if (type)
 		entry->type = type;
@@ -1018,9 +1410,8 @@ static int add_object_entry(const unsigned char *sha1, enum object_type type,
 {
 	struct packed_git *found_pack;
 	off_t found_offset;
-	uint32_t index_pos;
 
-	if (have_duplicate_entry(sha1, exclude, &index_pos))
+	if (have_duplicate_entry(sha1, exclude))
 		return 0;
 
 	if (!want_object_in_pack(sha1, exclude, &found_pack, &found_offset)) {
@@ -1034,7 +1425,7 @@ static int add_object_entry(const unsigned char *sha1, enum object_type type,
 
 	create_object_entry(sha1, type, pack_name_hash(name),
 			    exclude, name && no_try_delta(name),
-			    index_pos, found_pack, found_offset);
+			    found_pack, found_offset);
 
 	display_progress(progress_state, nr_result);
 	return 1;
@@ -1045,12 +1436,10 @@ static int add_object_entry_from_bitmap(const unsigned char *sha1,
 					int flags, uint32_t name_hash,
 					struct packed_git *pack, off_t offset)
 {
-	uint32_t index_pos;
-
-	if (have_duplicate_entry(sha1, 0, &index_pos))
+	if (have_duplicate_entry(sha1, 0))
 		return 0;
 
-	create_object_entry(sha1, type, name_hash, 0, 0, index_pos, pack, offset);
+	create_object_entry(sha1, type, name_hash, 0, 0, pack, offset);
 
 	display_progress(progress_state, nr_result);
 	return 1;
@@ -1325,6 +1714,39 @@ static void cleanup_preferred_base(void)
 	done_pbase_paths_num = done_pbase_paths_alloc = 0;
 }
 
+#ifndef NO_PTHREADS
+
+static pthread_mutex_t read_mutex;
+#define read_lock()		pthread_mutex_lock(&read_mutex)
+#define read_unlock()		pthread_mutex_unlock(&read_mutex)
+
+static pthread_mutex_t cache_mutex;
+#define cache_lock()		pthread_mutex_lock(&cache_mutex)
+#define cache_unlock()		pthread_mutex_unlock(&cache_mutex)
+
+static pthread_mutex_t progress_mutex;
+#define progress_lock()		pthread_mutex_lock(&progress_mutex)
+#define progress_unlock()	pthread_mutex_unlock(&progress_mutex)
+
+#else
+
+#define read_lock()		(void)0
+#define read_unlock()		(void)0
+#define cache_lock()		(void)0
+#define cache_unlock()		(void)0
+#define progress_lock()		(void)0
+#define progress_unlock()	(void)0
+
+#endif
+
+/*
+ * May run on multiple threads at once; everything that touches the
+ * object store -- pack windows, the revindex, loose objects -- is
+ * serialized through read_mutex, while reading the mapped pack data
+ * itself happens unlocked so that the page faults of several threads
+ * can overlap.  Mutating the shared delta-reuse chains takes
+ * cache_mutex.
+ */
 static void check_object(struct object_entry *entry)
 {
 	if (entry->in_pack) {
@@ -1336,16 +1758,20 @@ static void check_object(struct object_entry *entry)
 		unsigned long avail;
 		off_t ofs;
 		unsigned char *buf, c;
+		enum object_type in_pack_type;
 
+		read_lock();
 		buf = use_pack(p, &w_curs, entry->in_pack_offset, &avail);
+		read_unlock();
 
 		/*
 		 * We want in_pack_type even if we do not reuse delta
 		 * since non-delta representations could still be reused.
 		 */
 		used = unpack_object_header_buffer(buf, avail,
-						   &entry->in_pack_type,
+						   &in_pack_type,
 						   &entry->size);
+		entry->in_pack_type = in_pack_type;
 		if (used == 0)
 			goto give_up;
 
@@ -1361,17 +1787,24 @@ static void check_object(struct object_entry *entry)
 			entry->in_pack_header_size = used;
 			if (entry->type < OBJ_COMMIT || entry->type > OBJ_BLOB)
 				goto give_up;
+			read_lock();
 			unuse_pack(&w_curs);
+			read_unlock();
 			return;
 		case OBJ_REF_DELTA:
-			if (reuse_delta && !entry->preferred_base)
+			if (reuse_delta && !entry->preferred_base) {
+				read_lock();
 				base_ref = use_pack(p, &w_curs,
 						entry->in_pack_offset + used, NULL);
+				read_unlock();
+			}
 			entry->in_pack_header_size = used + 20;
 			break;
 		case OBJ_OFS_DELTA:
+			read_lock();
 			buf = use_pack(p, &w_curs,
 				       entry->in_pack_offset + used, NULL);
+			read_unlock();
 			used_0 = 0;
 			c = buf[used_0++];
 			ofs = c & 127;
@@ -1393,7 +1826,9 @@ static void check_object(struct object_entry *entry)
 			}
 			if (reuse_delta && !entry->preferred_base) {
 				struct revindex_entry *revidx;
+				read_lock();
 				revidx = find_pack_revindex(p, ofs);
+				read_unlock();
 				if (!revidx)
 					goto give_up;
 				base_ref = nth_packed_object_sha1(p, revidx->nr);
@@ -1402,7 +1837,8 @@ static void check_object(struct object_entry *entry)
 			break;
 		}
 
-		if (base_ref && (base_entry = packlist_find(&to_pack, base_ref, NULL))) {
+		if (base_ref && (base_entry = packlist_find(&to_pack, base_ref)) &&
+		    in_same_island(entry->idx.sha1, base_entry->idx.sha1)) {
 			/*
 			 * If base_ref was set above that means we wish to
 			 * reuse delta data, and we even found that base
@@ -1414,11 +1850,15 @@ static void check_object(struct object_entry *entry)
 			 * circular deltas.
 			 */
 			entry->type = entry->in_pack_type;
-			entry->delta = base_entry;
+			SET_DELTA(entry, base_entry);
 			entry->delta_size = entry->size;
-			entry->delta_sibling = base_entry->delta_child;
-			base_entry->delta_child = entry;
+			cache_lock();
+			SET_DELTA_SIBLING(entry, DELTA_CHILD(base_entry));
+			SET_DELTA_CHILD(base_entry, entry);
+			cache_unlock();
+			read_lock();
 			unuse_pack(&w_curs);
+			read_unlock();
 			return;
 		}
 
@@ -1428,11 +1868,15 @@ static void check_object(struct object_entry *entry)
 			 * final object type is.  Let's extract the actual
 			 * object size from the delta header.
 			 */
+			read_lock();
 			entry->size = get_size_from_delta(p, &w_curs,
 					entry->in_pack_offset + entry->in_pack_header_size);
+			read_unlock();
 			if (entry->size == 0)
 				goto give_up;
+			read_lock();
 			unuse_pack(&w_curs);
+			read_unlock();
 			return;
 		}
 
@@ -1442,10 +1886,14 @@ static void check_object(struct object_entry *entry)
 		 * at this point...
 		 */
 		give_up:
+		read_lock();
 		unuse_pack(&w_curs);
+		read_unlock();
 	}
 
+	read_lock();
 	entry->type = sha1_object_info(entry->idx.sha1, &entry->size);
+	read_unlock();
 	/*
 	 * The error condition is checked in prepare_pack().  This is
 	 * to permit a missing preferred base object to be ignored
@@ -1471,6 +1919,81 @@ static int pack_offset_sort(const void *_a, const void *_b)
 			(a->in_pack_offset > b->in_pack_offset);
 }
 
+static void check_objects(struct object_entry **list, uint32_t nr)
+{
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		struct object_entry *entry = list[i];
+		check_object(entry);
+		if (big_file_threshold < entry->size)
+			entry->no_try_delta = 1;
+	}
+}
+
+#ifndef NO_PTHREADS
+
+static void init_threaded_search(void);
+static void cleanup_threaded_search(void);
+
+struct check_objects_work {
+	pthread_t thread;
+	struct object_entry **list;
+	uint32_t nr;
+};
+
+static void *threaded_check_objects(void *arg)
+{
+	struct check_objects_work *work = arg;
+
+	check_objects(work->list, work->nr);
+	return NULL;
+}
+
+/*
+ * Spread the offset-sorted entries over the delta search threads in
+ * contiguous slices, which keeps each thread inside one region of one
+ * packfile.  The win comes from overlapping the page faults on cold
+ * pack data; the object store accesses themselves are serialized in
+ * check_object().
+ */
+static void ll_check_objects(struct object_entry **list, uint32_t nr)
+{
+	struct check_objects_work *work;
+	uint32_t start;
+	int i, nr_threads = delta_search_threads;
+
+	if (nr_threads <= 1 || nr < 4096) {
+		check_objects(list, nr);
+		return;
+	}
+
+	init_threaded_search();
+
+	work = xcalloc(nr_threads, sizeof(*work));
+	for (i = 0, start = 0; i < nr_threads; i++) {
+		uint32_t sub_size = nr / (nr_threads - i);
+
+		work[i].list = list + start;
+		work[i].nr = sub_size;
+		start += sub_size;
+		nr -= sub_size;
+
+		if (pthread_create(&work[i].thread, NULL,
+				   threaded_check_objects, &work[i]))
+			die("unable to create thread: %s", strerror(errno));
+	}
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(work[i].thread, NULL);
+	free(work);
+
+	cleanup_threaded_search();
+}
+
+#else
+#define ll_check_objects(list, nr)	check_objects(list, nr)
+#endif
+
 static void get_object_details(void)
 {
 	uint32_t i;
@@ -1481,12 +2004,7 @@ static void get_object_details(void)
 		sorted_by_offset[i] = to_pack.objects + i;
 	qsort(sorted_by_offset, to_pack.nr_objects, sizeof(*sorted_by_offset), pack_offset_sort);
 
-	for (i = 0; i < to_pack.nr_objects; i++) {
-		struct object_entry *entry = sorted_by_offset[i];
-		check_object(entry);
-		if (big_file_threshold < entry->size)
-			entry->no_try_delta = 1;
-	}
+	ll_check_objects(sorted_by_offset, to_pack.nr_objects);
 
 	free(sorted_by_offset);
 }
@@ -1547,31 +2065,6 @@ static int delta_cacheable(unsigned long src_size, unsigned long trg_size,
 	return 0;
 }
 
-#ifndef NO_PTHREADS
-
-static pthread_mutex_t read_mutex;
-#define read_lock()		pthread_mutex_lock(&read_mutex)
-#define read_unlock()		pthread_mutex_unlock(&read_mutex)
-
-static pthread_mutex_t cache_mutex;
-#define cache_lock()		pthread_mutex_lock(&cache_mutex)
-#define cache_unlock()		pthread_mutex_unlock(&cache_mutex)
-
-static pthread_mutex_t progress_mutex;
-#define progress_lock()		pthread_mutex_lock(&progress_mutex)
-#define progress_unlock()	pthread_mutex_unlock(&progress_mutex)
-
-#else
-
-#define read_lock()		(void)0
-#define read_unlock()		(void)0
-#define cache_lock()		(void)0
-#define cache_unlock()		(void)0
-#define progress_lock()		(void)0
-#define progress_unlock()	(void)0
-
-#endif
-
 static int try_delta(struct unpacked *trg, struct unpacked *src,
 		     unsigned max_depth, unsigned long *mem_usage)
 {
@@ -1586,6 +2079,10 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	if (trg_entry->type != src_entry->type)
 		return -1;
 
+	/* Keep deltas within their islands so they stay reusable. */
+	if (!in_same_island(trg_entry->idx.sha1, src_entry->idx.sha1))
+		return 0;
+
 	/*
 	 * We do not bother to try a delta that we discarded on an
 	 * earlier try, but only when reusing delta data.  Note that
@@ -1607,7 +2104,7 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 
 	/* Now some size filtering heuristics. */
 	trg_size = trg_entry->size;
-	if (!trg_entry->delta) {
+	if (!DELTA(trg_entry)) {
 		max_size = trg_size/2 - 20;
 		ref_depth = 1;
 	} else {
@@ -1679,7 +2176,7 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	if (!delta_buf)
 		return 0;
 
-	if (trg_entry->delta) {
+	if (DELTA(trg_entry)) {
 		/* Prefer only shallower same-sized deltas. */
 		if (delta_size == trg_entry->delta_size &&
 		    src->depth + 1 >= trg->depth) {
@@ -1689,26 +2186,22 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 	}
 
 	/*
-	 * Handle memory allocation outside of the cache
-	 * accounting lock.  Compiler will optimize the strangeness
-	 * away when NO_PTHREADS is defined.
+	 * All cached_deltas mutations must happen under the cache
+	 * accounting lock; the hashmap itself is not thread safe.
 	 */
-	free(trg_entry->delta_data);
 	cache_lock();
-	if (trg_entry->delta_data) {
+	if (drop_cached_delta(trg_entry))
 		delta_cache_size -= trg_entry->delta_size;
-		trg_entry->delta_data = NULL;
-	}
 	if (delta_cacheable(src_size, trg_size, delta_size)) {
 		delta_cache_size += delta_size;
+		set_cached_delta(trg_entry, xrealloc(delta_buf, delta_size));
 		cache_unlock();
-		trg_entry->delta_data = xrealloc(delta_buf, delta_size);
 	} else {
 		cache_unlock();
 		free(delta_buf);
 	}
 
-	trg_entry->delta = src_entry;
+	SET_DELTA(trg_entry, src_entry);
 	trg_entry->delta_size = delta_size;
 	trg->depth = src->depth + 1;
 
@@ -1717,13 +2210,13 @@ static int try_delta(struct unpacked *trg, struct unpacked *src,
 
 static unsigned int check_delta_limit(struct object_entry *me, unsigned int n)
 {
-	struct object_entry *child = me->delta_child;
+	struct object_entry *child = DELTA_CHILD(me);
 	unsigned int m = n;
 	while (child) {
 		unsigned int c = check_delta_limit(child, n + 1);
 		if (m < c)
 			m = c;
-		child = child->delta_sibling;
+		child = DELTA_SIBLING(child);
 	}
 	return m;
 }
@@ -1793,7 +2286,7 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		 * otherwise they would become too deep.
 		 */
 		max_depth = depth;
-		if (entry->delta_child) {
+		if (DELTA_CHILD(entry)) {
 			max_depth -= check_delta_limit(entry, 0);
 			if (max_depth <= 0)
 				goto next;
@@ -1830,20 +2323,33 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		 * instead, as we can afford spending more time compressing
 		 * between writes at that moment.
 		 */
-		if (entry->delta_data && !pack_to_stdout) {
-			entry->z_delta_size = do_compress(&entry->delta_data,
-							  entry->delta_size);
+		if (!pack_to_stdout) {
+			struct cached_delta *cached;
+
 			cache_lock();
-			delta_cache_size -= entry->delta_size;
-			delta_cache_size += entry->z_delta_size;
+			cached = find_cached_delta(entry);
 			cache_unlock();
+			if (cached && !cached->z_size) {
+				/*
+				 * No other thread touches this entry's cached
+				 * delta, and hashmap nodes stay put across
+				 * rehashing, so the compression itself can
+				 * happen outside the lock.
+				 */
+				cached->z_size = do_compress(&cached->data,
+							     entry->delta_size);
+				cache_lock();
+				delta_cache_size -= entry->delta_size;
+				delta_cache_size += cached->z_size;
+				cache_unlock();
+			}
 		}
 
 		/* if we made n a delta, and if n is already at max
 		 * depth, leaving it in the window is pointless.  we
 		 * should evict it first.
 		 */
-		if (entry->delta && max_depth <= n->depth)
+		if (DELTA(entry) && max_depth <= n->depth)
 			continue;
 
 		/*
@@ -1851,7 +2357,7 @@ static void find_deltas(struct object_entry **list, unsigned *list_size,
 		 * currently deltified object, to keep it longer.  It will
 		 * be the first base object to be attempted next.
 		 */
-		if (entry->delta) {
+		if (DELTA(entry)) {
 			struct unpacked swap = array[best_base];
 			int dist = (window + idx - best_base) % window;
 			int dst = best_base;
@@ -2105,7 +2611,7 @@ static int add_ref_tag(const char *path, const unsigned char *sha1, int flag, vo
 
 	if (starts_with(path, "refs/tags/") && /* is a tag? */
 	    !peel_ref(path, peeled)        && /* peelable? */
-	    packlist_find(&to_pack, peeled, NULL))      /* object packed? */
+	    packlist_find(&to_pack, peeled))      /* object packed? */
 		add_object_entry(sha1, OBJ_TAG, NULL, 0);
 	return 0;
 }
@@ -2116,6 +2622,9 @@ static void prepare_pack(int window, int depth)
 	uint32_t i, nr_deltas;
 	unsigned n;
 
+	if (use_delta_islands)
+		resolve_tree_islands(progress, &to_pack);
+
 	get_object_details();
 
 	/*
@@ -2137,7 +2646,7 @@ static void prepare_pack(int window, int depth)
 	for (i = 0; i < to_pack.nr_objects; i++) {
 		struct object_entry *entry = to_pack.objects + i;
 
-		if (entry->delta)
+		if (DELTA(entry))
 			/* This happens if we decided to reuse existing
 			 * delta from a pack.  "reuse_delta &&" is implied.
 			 */
@@ -2205,6 +2714,16 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		pack_compression_seen = 1;
 		return 0;
 	}
+	if (!strcmp(k, "pack.codec")) {
+		int codec;
+		if (!v)
+			return config_error_nonbool(k);
+		codec = parse_pack_codec(v);
+		if (codec < 0)
+			die("unknown pack codec %s", v);
+		pack_codec = codec;
+		return 0;
+	}
 	if (!strcmp(k, "pack.deltacachesize")) {
 		max_delta_cache_size = git_config_int(k, v);
 		return 0;
@@ -2223,6 +2742,13 @@ static int git_pack_config(const char *k, const char *v, void *cb)
 		use_bitmap_index = git_config_bool(k, v);
 		return 0;
 	}
+	if (!strcmp(k, "pack.writereverseindex")) {
+		if (git_config_bool(k, v))
+			pack_idx_opts.flags |= WRITE_REV;
+		else
+			pack_idx_opts.flags &= ~WRITE_REV;
+		return 0;
+	}
 	if (!strcmp(k, "pack.threads")) {
 		delta_search_threads = git_config_int(k, v);
 		if (delta_search_threads < 0)
@@ -2284,6 +2810,9 @@ static void show_commit(struct commit *commit, void *data)
 
 	if (write_bitmap_index)
 		index_commit_for_bitmap(commit);
+
+	if (use_delta_islands)
+		propagate_island_marks(commit);
 }
 
 static void show_object(struct object *obj,
@@ -2296,6 +2825,19 @@ static void show_object(struct object *obj,
 	add_object_entry(obj->sha1, obj->type, name, 0);
 	obj->flags |= OBJECT_ADDED;
 
+	if (use_delta_islands) {
+		const char *p;
+		unsigned depth = 0;
+		struct object_entry *ent;
+
+		for (p = strchr(name, '/'); p; p = strchr(p + 1, '/'))
+			depth++;
+
+		ent = packlist_find(&to_pack, obj->sha1);
+		if (ent && depth > ent->tree_depth)
+			ent->tree_depth = depth;
+	}
+
 	/*
 	 * We will have generated the hash from the name,
 	 * but not saved a pointer to it - we can free it
@@ -2443,7 +2985,7 @@ static void loosen_unused_packed_objects(struct rev_info *revs)
 
 		for (i = 0; i < p->num_objects; i++) {
 			sha1 = nth_packed_object_sha1(p, i);
-			if (!packlist_find(&to_pack, sha1, NULL) &&
+			if (!packlist_find(&to_pack, sha1) &&
 			    !has_sha1_pack_kept_or_nonlocal(sha1) &&
 			    !loosened_object_can_be_discarded(sha1, p->mtime))
 				if (force_object_loose(sha1, p->mtime))
@@ -2498,15 +3040,49 @@ static void get_object_list(int ac, const char **av)
 {
 	struct rev_info revs;
 	char line[1000];
-	int flags = 0;
+	int i, flags = 0;
 
 	init_revisions(&revs, NULL);
 	save_commit_buffer = 0;
 	setup_revisions(ac, av, &revs, NULL);
 
+	for (i = 0; i < ac; i++) {
+		if (strcmp(av[i], "--all"))
+			continue;
+		/*
+		 * A whole-repository walk will visit just about every
+		 * object; size the lookup tables up front instead of
+		 * growing and re-hashing them as we go.
+		 */
+		prealloc_object_hash(approximate_object_count());
+		packlist_presize(&to_pack, approximate_object_count());
+		break;
+	}
+
+	if (filter_paths.nr) {
+		static struct argv_array paths = ARGV_ARRAY_INIT;
+		int i;
+
+		for (i = 0; i < filter_paths.nr; i++)
+			argv_array_push(&paths, filter_paths.items[i].string);
+		/*
+		 * list-objects limits the walk by the pathspec in
+		 * diffopt.  All trees are still packed, so receivers
+		 * can read any commit; only blobs outside the paths
+		 * are left out.
+		 */
+		parse_pathspec(&revs.diffopt.pathspec, 0, 0, "", paths.argv);
+		revs.narrow_objects = 1;
+	}
+	if (no_blobs)
+		revs.blob_objects = 0;
+
 	/* make sure shallows are read */
 	is_repository_shallow();
 
+	if (use_delta_islands)
+		load_delta_islands();
+
 	while (fgets(line, sizeof(line), stdin) != NULL) {
 		int len = strlen(line);
 		if (len && line[len - 1] == '\n')
@@ -2678,6 +3254,10 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			 N_("create thin packs")),
 		OPT_BOOL(0, "shallow", &shallow,
 			 N_("create packs suitable for shallow fetches")),
+		OPT_STRING_LIST(0, "filter-path", &filter_paths, N_("path"),
+			 N_("limit traversed trees and blobs to <path>")),
+		OPT_BOOL(0, "no-blobs", &no_blobs,
+			 N_("do not pack any blobs")),
 		OPT_BOOL(0, "honor-pack-keep", &ignore_packed_keep,
 			 N_("ignore packs that have companion .keep file")),
 		OPT_INTEGER(0, "compression", &pack_compression_level,
@@ -2686,6 +3266,8 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 			    N_("do not hide commits by grafts"), 0),
 		OPT_BOOL(0, "use-bitmap-index", &use_bitmap_index,
 			 N_("use a bitmap index if available to speed up counting objects")),
+		OPT_BOOL(0, "delta-islands", &use_delta_islands,
+			 N_("respect islands during delta compression")),
 		OPT_BOOL(0, "write-bitmap-index", &write_bitmap_index,
 			 N_("write a bitmap index together with the pack index")),
 		OPT_END(),
@@ -2769,6 +3351,19 @@ int cmd_pack_objects(int argc, const char **argv, const char *prefix)
 	if (!use_internal_rev_list || !pack_to_stdout || is_repository_shallow())
 		use_bitmap_index = 0;
 
+	/* bitmaps know nothing about paths or blobless packs */
+	if (filter_paths.nr || no_blobs) {
+		use_bitmap_index = 0;
+		write_bitmap_index = 0;
+	}
+
+	/*
+	 * Island marks are propagated during the object walk, which the
+	 * bitmap shortcut skips.
+	 */
+	if (use_delta_islands)
+		use_bitmap_index = 0;
+
 	if (pack_to_stdout || !rev_list_all)
 		write_bitmap_index = 0;
 
@@ -7,6 +7,8 @@
 #include "parse-options.h"
 #include "progress.h"
 #include "dir.h"
+#include "sha1-array.h"
+#include "lockfile.h"
 
 static const char * const prune_usage[] = {
 	N_("git prune [-n] [-v] [--expire <time>] [--] [<head>...]"),
@@ -17,6 +19,67 @@ static int verbose;
 static unsigned long expire;
 static int show_progress = -1;
 
+static struct sha1_array fresh_objects = SHA1_ARRAY_INIT;
+static struct strbuf fresh_log = STRBUF_INIT;
+static int have_object_time_log;
+
+/*
+ * Load the advisory creation-time log that write_sha1_file() appends
+ * to (see core.logObjectTimes).  Only entries young enough to survive
+ * the current expiry are kept: membership in fresh_objects proves an
+ * object is too young to prune without stat()ing it, and everything
+ * else falls back to lstat() in prune_object(), so a stale or missing
+ * entry costs a stat but never prunes wrongly.
+ */
+static void load_object_time_log(void)
+{
+	char *path = mkpathdup("%s/info/object-times", get_object_directory());
+	FILE *fp = fopen(path, "r");
+	char line[64];
+
+	free(path);
+	if (!fp)
+		return;
+	while (fgets(line, sizeof(line), fp)) {
+		char *end;
+		unsigned long timestamp = strtoul(line, &end, 10);
+		unsigned char sha1[20];
+
+		if (*end != ' ' || get_sha1_hex(end + 1, sha1))
+			continue;
+		if (timestamp <= expire)
+			continue;
+		sha1_array_append(&fresh_objects, sha1);
+		strbuf_addf(&fresh_log, "%lu %s\n", timestamp,
+			    sha1_to_hex(sha1));
+	}
+	fclose(fp);
+	have_object_time_log = 1;
+}
+
+/*
+ * Rewrite the log with only the entries that are still fresh, so it
+ * stays proportional to the number of recently written objects.
+ */
+static void write_object_time_log(void)
+{
+	static struct lock_file lock;
+	char *path;
+	int fd;
+
+	if (!have_object_time_log || show_only)
+		return;
+	path = mkpathdup("%s/info/object-times", get_object_directory());
+	fd = hold_lock_file_for_update(&lock, path, 0);
+	free(path);
+	if (fd < 0)
+		return;
+	if (write_in_full(fd, fresh_log.buf, fresh_log.len) < 0)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+}
+
 static int prune_tmp_file(const char *fullpath)
 {
 	struct stat st;
@@ -43,6 +106,10 @@ static int prune_object(const unsigned char *sha1, const char *fullpath,
 	if (lookup_object(sha1))
 		return 0;
 
+	/* The creation-time log already proved it too young to prune */
+	if (sha1_array_lookup(&fresh_objects, sha1) >= 0)
+		return 0;
+
 	if (lstat(fullpath, &st)) {
 		/* report errors, but do not stop pruning */
 		error("Could not stat '%s'", fullpath);
@@ -138,8 +205,10 @@ int cmd_prune(int argc, const char **argv, const char *prefix)
 
 	mark_reachable_objects(&revs, 1, expire, progress);
 	stop_progress(&progress);
+	load_object_time_log();
 	for_each_loose_file_in_objdir(get_object_directory(), prune_object,
 				      prune_cruft, prune_subdir, NULL);
+	write_object_time_log();
 
 	prune_packed_objects(show_only ? PRUNE_PACKED_DRY_RUN : 0);
 	remove_temporary_files(get_object_directory());
@@ -19,6 +19,7 @@
 #include "tag.h"
 #include "gpg-interface.h"
 #include "sigchain.h"
+#include "tmp-objdir.h"
 
 static const char receive_pack_usage[] = "git receive-pack <git-dir>";
 
@@ -38,6 +39,7 @@ static int receive_fsck_objects = -1;
 static int transfer_fsck_objects = -1;
 static int receive_unpack_limit = -1;
 static int transfer_unpack_limit = -1;
+static struct tmp_objdir *tmp_objdir;
 static int advertise_atomic_push = 1;
 static int unpack_limit = 100;
 static int report_status;
@@ -53,6 +55,12 @@ static const char *service_dir;
 static const char *head_name;
 static void *head_name_to_free;
 static int sent_capabilities;
+/*
+ * "hook.<name>.refPrefix" entries; each item is a ref prefix with
+ * item->util naming the hook it applies to.  A hook with at least one
+ * entry is only told about refs matching one of its prefixes.
+ */
+static struct string_list hook_ref_prefixes = STRING_LIST_INIT_DUP;
 static int shallow_update;
 static const char *alt_shallow_file;
 static struct strbuf push_cert = STRBUF_INIT;
@@ -90,6 +98,8 @@ static enum deny_action parse_deny_action(const char *var, const char *value)
 
 static int receive_pack_config(const char *var, const char *value, void *cb)
 {
+	const char *subsection, *key;
+	int subsection_len;
 	int status = parse_hide_refs_config(var, value, "receive");
 
 	if (status)
@@ -168,16 +178,30 @@ static int receive_pack_config(const char *var, const char *value, void *cb)
 		return 0;
 	}
 
+	if (!parse_config_key(var, "hook", &subsection, &subsection_len,
+			      &key) &&
+	    subsection && !strcmp(key, "refprefix")) {
+		struct string_list_item *item;
+
+		if (!value)
+			return config_error_nonbool(var);
+		item = string_list_append(&hook_ref_prefixes, value);
+		item->util = xmemdupz(subsection, subsection_len);
+		return 0;
+	}
+
 	return git_default_config(var, value, cb);
 }
 
+static struct packet_writer writer;
+
 static void show_ref(const char *path, const unsigned char *sha1)
 {
 	if (ref_is_hidden(path))
 		return;
 
 	if (sent_capabilities) {
-		packet_write(1, "%s %s\n", sha1_to_hex(sha1), path);
+		packet_writer_write(&writer, "%s %s\n", sha1_to_hex(sha1), path);
 	} else {
 		struct strbuf cap = STRBUF_INIT;
 
@@ -189,9 +213,11 @@ static void show_ref(const char *path, const unsigned char *sha1)
 			strbuf_addstr(&cap, " ofs-delta");
 		if (push_cert_nonce)
 			strbuf_addf(&cap, " push-cert=%s", push_cert_nonce);
+		if (!stateless_rpc)
+			strbuf_addstr(&cap, " push-negotiate");
 		strbuf_addf(&cap, " agent=%s", git_user_agent_sanitized());
-		packet_write(1, "%s %s%c%s\n",
-			     sha1_to_hex(sha1), path, 0, cap.buf);
+		packet_writer_write(&writer, "%s %s%c%s\n",
+				    sha1_to_hex(sha1), path, 0, cap.buf);
 		strbuf_release(&cap);
 		sent_capabilities = 1;
 	}
@@ -228,6 +254,9 @@ static void collect_one_alternate_ref(const struct ref *ref, void *data)
 static void write_head_info(void)
 {
 	struct sha1_array sa = SHA1_ARRAY_INIT;
+
+	packet_writer_init(&writer, 1);
+	packet_writer_cork(&writer);
 	for_each_alternate_ref(collect_one_alternate_ref, &sa);
 	sha1_array_for_each_unique(&sa, show_one_alternate_sha1, NULL);
 	sha1_array_clear(&sa);
@@ -235,10 +264,11 @@ static void write_head_info(void)
 	if (!sent_capabilities)
 		show_ref("capabilities^{}", null_sha1);
 
-	advertise_shallow_grafts(1);
+	advertise_shallow_grafts(&writer);
 
 	/* EOF */
-	packet_flush(1);
+	packet_writer_flush(&writer);
+	packet_writer_uncork(&writer);
 }
 
 struct command {
@@ -522,6 +552,28 @@ static void prepare_push_cert_sha1(struct child_process *proc)
 	}
 }
 
+/*
+ * Should the named hook be told about this ref?  A hook that has not
+ * declared any interest hears about everything; one with
+ * hook.<name>.refPrefix entries only about refs matching one of them.
+ * Serialization for (and with the update hook, running of) the hook
+ * is skipped entirely for refs it is not interested in.
+ */
+static int hook_interested_in(const char *hook_name, const char *refname)
+{
+	struct string_list_item *item;
+	int declared = 0;
+
+	for_each_string_list_item(item, &hook_ref_prefixes) {
+		if (strcmp(item->util, hook_name))
+			continue;
+		declared = 1;
+		if (starts_with(refname, item->string))
+			return 1;
+	}
+	return !declared;
+}
+
 typedef int (*feed_fn)(void *, const char **, size_t *);
 static int run_and_feed_hook(const char *hook_name, feed_fn feed, void *feed_state)
 {
@@ -580,6 +632,7 @@ static int run_and_feed_hook(const char *hook_name, feed_fn feed, void *feed_sta
 
 struct receive_hook_feed_state {
 	struct command *cmd;
+	const char *hook_name;
 	int skip_broken;
 	struct strbuf buf;
 };
@@ -590,7 +643,9 @@ static int feed_receive_hook(void *state_, const char **bufp, size_t *sizep)
 	struct command *cmd = state->cmd;
 
 	while (cmd &&
-	       state->skip_broken && (cmd->error_string || cmd->did_not_exist))
+	       ((state->skip_broken &&
+		 (cmd->error_string || cmd->did_not_exist)) ||
+		!hook_interested_in(state->hook_name, cmd->ref_name)))
 		cmd = cmd->next;
 	if (!cmd)
 		return -1; /* EOF */
@@ -614,6 +669,7 @@ static int run_receive_hook(struct command *commands, const char *hook_name,
 
 	strbuf_init(&state.buf, 0);
 	state.cmd = commands;
+	state.hook_name = hook_name;
 	state.skip_broken = skip_broken;
 	if (feed_receive_hook(&state, NULL, NULL))
 		return 0;
@@ -632,6 +688,8 @@ static int run_update_hook(struct command *cmd)
 	argv[0] = find_hook("update");
 	if (!argv[0])
 		return 0;
+	if (!hook_interested_in("update", cmd->ref_name))
+		return 0;
 
 	argv[1] = cmd->ref_name;
 	argv[2] = sha1_to_hex(cmd->old_sha1);
@@ -1002,6 +1060,30 @@ static const char *update(struct command *cmd, struct shallow_info *si)
 	}
 }
 
+/*
+ * Bump $GIT_DIR/notify-stamp after refs moved, so that
+ * "git upload-notify" watchers rescan and tell their clients.  The
+ * stamp grows by a byte per update, not just an mtime touch, to stay
+ * visible to watchers even when two pushes land in the same second.
+ */
+static void touch_notify_stamp(struct command *commands)
+{
+	struct command *cmd;
+	int fd;
+
+	for (cmd = commands; cmd; cmd = cmd->next)
+		if (!cmd->error_string && !cmd->did_not_exist)
+			break;
+	if (!cmd)
+		return;
+	fd = open(git_path("notify-stamp"), O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd < 0)
+		return; /* advisory only */
+	if (write_in_full(fd, "U", 1) < 0)
+		; /* ignore; watchers fall back to the mtime */
+	close(fd);
+}
+
 static void run_update_post_hook(struct command *commands)
 {
 	struct command *cmd;
@@ -1287,6 +1369,8 @@ static void execute_commands(struct command *commands,
 	if (unpacker_error) {
 		for (cmd = commands; cmd; cmd = cmd->next)
 			cmd->error_string = "unpacker error";
+		tmp_objdir_destroy(tmp_objdir);
+		tmp_objdir = NULL;
 		return;
 	}
 
@@ -1302,9 +1386,25 @@ static void execute_commands(struct command *commands,
 			if (!cmd->error_string)
 				cmd->error_string = "pre-receive hook declined";
 		}
+		tmp_objdir_destroy(tmp_objdir);
+		tmp_objdir = NULL;
 		return;
 	}
 
+	/*
+	 * Now we'll start writing out refs, which means the objects need
+	 * to be in their final positions so that other processes can see them.
+	 */
+	if (tmp_objdir_migrate(tmp_objdir) < 0) {
+		for (cmd = commands; cmd; cmd = cmd->next) {
+			if (!cmd->error_string)
+				cmd->error_string = "unable to migrate objects to permanent storage";
+		}
+		tmp_objdir = NULL;
+		return;
+	}
+	tmp_objdir = NULL;
+
 	check_aliased_updates(commands);
 
 	free(head_name_to_free);
@@ -1368,17 +1468,59 @@ static void queue_commands_from_cert(struct command **tail,
 	}
 }
 
+/*
+ * A "probe <sha1>" line asks whether we already have the named commit;
+ * the client uses our answers to trim the pack it is about to send.
+ * Respond with an "ack <sha1>" for each commit we have and end our
+ * answers with a flush.
+ */
+static void answer_probes(struct sha1_array *probes)
+{
+	int i;
+
+	for (i = 0; i < probes->nr; i++) {
+		struct object *o = parse_object(probes->sha1[i]);
+		if (o && o->type == OBJ_COMMIT)
+			packet_write(1, "ack %s", sha1_to_hex(probes->sha1[i]));
+	}
+	packet_flush(1);
+}
+
 static struct command *read_head_info(struct sha1_array *shallow)
 {
 	struct command *commands = NULL;
 	struct command **p = &commands;
+	struct sha1_array probes = SHA1_ARRAY_INIT;
+	int negotiated = 0;
 	for (;;) {
 		char *line;
 		int len, linelen;
 
 		line = packet_read_line(0, &len);
-		if (!line)
+		if (!line) {
+			/*
+			 * An initial probe section is terminated by its
+			 * own flush; answer it and go on to read the
+			 * actual commands.
+			 */
+			if (probes.nr && !negotiated) {
+				answer_probes(&probes);
+				sha1_array_clear(&probes);
+				negotiated = 1;
+				continue;
+			}
 			break;
+		}
+
+		if (len == 46 && starts_with(line, "probe ") &&
+		    !commands && !negotiated) {
+			unsigned char sha1[20];
+			if (get_sha1_hex(line + 6, sha1))
+				die("protocol error: expected probe sha, got '%s'",
+				    line + 6);
+			sha1_array_append(&probes, sha1);
+			continue;
+		}
 
 		if (len == 48 && starts_with(line, "shallow ")) {
 			unsigned char sha1[20];
@@ -1484,6 +1626,22 @@ static const char *unpack(int err_fd, struct shallow_info *si)
 		argv_array_push(&child.args, alt_shallow_file);
 	}
 
+	tmp_objdir = tmp_objdir_create();
+	if (!tmp_objdir) {
+		if (err_fd > 0)
+			close(err_fd);
+		return "unable to create temporary object directory";
+	}
+	tmp_objdir_export_env(tmp_objdir);
+
+	/*
+	 * Objects in the quarantine are not yet part of the main object
+	 * store, so any child process or hook we spawn while it is active
+	 * writes there.  Make them visible to us via our alternates, so
+	 * that we can see them and connectivity-check them.
+	 */
+	tmp_objdir_add_as_alternate(tmp_objdir);
+
 	if (ntohl(hdr.hdr_entries) < unpack_limit) {
 		argv_array_pushl(&child.args, "unpack-objects", hdr_arg, NULL);
 		if (quiet)
@@ -1745,6 +1903,7 @@ int cmd_receive_pack(int argc, const char **argv, const char *prefix)
 			report(commands, unpack_status);
 		run_receive_hook(commands, "post-receive", 1);
 		run_update_post_hook(commands);
+		touch_notify_stamp(commands);
 		if (auto_gc) {
 			const char *argv_gc_auto[] = {
 				"gc", "--auto", "--quiet", NULL,
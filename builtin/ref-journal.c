@@ -0,0 +1,46 @@
+#include "builtin.h"
+#include "cache.h"
+#include "parse-options.h"
+
+static const char * const ref_journal_usage[] = {
+	N_("git ref-journal [--since=<sequence>]"),
+	NULL
+};
+
+int cmd_ref_journal(int argc, const char **argv, const char *prefix)
+{
+	const char *since_arg = NULL;
+	uintmax_t since = 0;
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+	struct option options[] = {
+		OPT_STRING(0, "since", &since_arg, N_("sequence"),
+			   N_("show only records after this sequence number")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, options, ref_journal_usage, 0);
+	if (argc)
+		usage_with_options(ref_journal_usage, options);
+	if (since_arg) {
+		char *end;
+		since = strtoumax(since_arg, &end, 10);
+		if (*end || end == since_arg)
+			die(_("invalid sequence number: %s"), since_arg);
+	}
+
+	fp = fopen(git_path("ref-journal"), "r");
+	if (!fp) {
+		if (errno == ENOENT)
+			return 0;	/* no updates journaled yet */
+		die_errno(_("could not open ref journal"));
+	}
+	while (strbuf_getline(&line, fp, '\n') != EOF) {
+		if (strtoumax(line.buf, NULL, 10) <= since)
+			continue;
+		puts(line.buf);
+	}
+	fclose(fp);
+	strbuf_release(&line);
+	return 0;
+}
@@ -4,6 +4,7 @@
 #include "parse-options.h"
 #include "run-command.h"
 #include "sigchain.h"
+#include "midx.h"
 #include "strbuf.h"
 #include "string-list.h"
 #include "argv-array.h"
@@ -11,6 +12,8 @@
 static int delta_base_offset = 1;
 static int pack_kept_objects = -1;
 static int write_bitmaps;
+static int use_delta_islands;
+static const char *pack_expire = "now";
 static char *packdir, *packtmp;
 
 static const char *const git_repack_usage[] = {
@@ -33,6 +36,12 @@ static int repack_config(const char *var, const char *value, void *cb)
 		write_bitmaps = git_config_bool(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "repack.usedeltaislands")) {
+		use_delta_islands = git_config_bool(var, value);
+		return 0;
+	}
+	if (!strcmp(var, "repack.packexpire"))
+		return git_config_string(&pack_expire, var, value);
 	return git_default_config(var, value, cb);
 }
 
@@ -94,7 +103,8 @@ static void get_non_kept_pack_filenames(struct string_list *fname_list)
 
 		fname = xmemdupz(e->d_name, len);
 
-		if (!file_exists(mkpath("%s/%s.keep", packdir, fname)))
+		if (!file_exists(mkpath("%s/%s.keep", packdir, fname)) &&
+		    !file_exists(mkpath("%s/%s.redundant", packdir, fname)))
 			string_list_append_nodup(fname_list, fname);
 		else
 			free(fname);
@@ -104,7 +114,8 @@ static void get_non_kept_pack_filenames(struct string_list *fname_list)
 
 static void remove_redundant_pack(const char *dir_name, const char *base_name)
 {
-	const char *exts[] = {".pack", ".idx", ".keep", ".bitmap"};
+	const char *exts[] = {".pack", ".idx", ".keep", ".bitmap", ".rev",
+			      ".redundant"};
 	int i;
 	struct strbuf buf = STRBUF_INIT;
 	size_t plen;
@@ -120,9 +131,147 @@ static void remove_redundant_pack(const char *dir_name, const char *base_name)
 	strbuf_release(&buf);
 }
 
+/*
+ * Deleting a pack that another process still has open is not safe:
+ * pack windows are mapped lazily, so a reader that found an object in
+ * the old pack may fault on it long after "-d" would have unlinked
+ * the file.  When repack.packExpire grants a grace period we leave
+ * the redundant pack (and its idx) in place and only drop a
+ * ".redundant" marker next to it; racing readers keep finding their
+ * objects through the old pack in the meantime.  An existing marker
+ * is left untouched so that repeated repacks do not keep resetting
+ * the clock.
+ */
+static void mark_redundant_pack(const char *dir_name, const char *base_name)
+{
+	char *path = mkpathdup("%s/%s.redundant", dir_name, base_name);
+
+	if (!file_exists(path)) {
+		int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0444);
+		if (fd < 0)
+			warning(_("failed to mark '%s' as redundant"), path);
+		else
+			close(fd);
+	}
+	free(path);
+}
+
+/*
+ * Remove packs whose ".redundant" marker is older than the expiry
+ * cutoff.  With the default repack.packExpire of "now" this also
+ * cleans up packs that were marked under an earlier, more generous
+ * configuration.
+ */
+static void remove_expired_redundant_packs(unsigned long expire)
+{
+	DIR *dir;
+	struct dirent *e;
+	struct stat st;
+
+	if (!(dir = opendir(packdir)))
+		return;
+
+	while ((e = readdir(dir)) != NULL) {
+		size_t len;
+		char *base;
+
+		if (!strip_suffix(e->d_name, ".redundant", &len))
+			continue;
+		if (stat(mkpath("%s/%s", packdir, e->d_name), &st) ||
+		    st.st_mtime >= (time_t)expire)
+			continue;
+		base = xmemdupz(e->d_name, len);
+		remove_redundant_pack(packdir, base);
+		free(base);
+	}
+	closedir(dir);
+}
+
 #define ALL_INTO_ONE 1
 #define LOOSEN_UNREACHABLE 2
 
+static int pack_size_cmp(const void *a_, const void *b_)
+{
+	struct packed_git *a = *(struct packed_git **)a_;
+	struct packed_git *b = *(struct packed_git **)b_;
+
+	if (a->pack_size < b->pack_size)
+		return -1;
+	if (a->pack_size > b->pack_size)
+		return 1;
+	return 0;
+}
+
+/*
+ * Pick the packs to roll up for --geometric.  Sorted by size, the
+ * packs we keep must form a geometric progression: each one at least
+ * "factor" times larger than all smaller packs combined.  The
+ * smallest pack that breaks the progression, and everything below
+ * it, gets rolled into one new pack; anything larger -- in
+ * particular the big base pack -- is never rewritten.  The basenames
+ * of the rolled-up packs are added to "to_delete" so that "-d" can
+ * remove them once the replacement exists.
+ */
+static struct packed_git **find_geometric_rollup(int factor, int *nr_out,
+						 struct string_list *to_delete)
+{
+	struct packed_git *p, **packs = NULL;
+	int nr = 0, alloc = 0, i, split = 0;
+	off_t sum = 0;
+
+	prepare_packed_git();
+	for (p = packed_git; p; p = p->next) {
+		size_t len;
+
+		if (!p->pack_local || p->pack_keep)
+			continue;
+		/* do not roll a retained redundant pack back in */
+		if (strip_suffix(p->pack_name, ".pack", &len) &&
+		    file_exists(mkpath("%.*s.redundant", (int)len,
+				       p->pack_name)))
+			continue;
+		ALLOC_GROW(packs, nr + 1, alloc);
+		packs[nr++] = p;
+	}
+	qsort(packs, nr, sizeof(*packs), pack_size_cmp);
+
+	for (i = 0; i < nr; i++) {
+		if (i && packs[i]->pack_size < (off_t)factor * sum)
+			split = i;
+		sum += packs[i]->pack_size;
+	}
+
+	*nr_out = split ? split + 1 : 0;
+	for (i = 0; i < *nr_out; i++) {
+		const char *base = strrchr(packs[i]->pack_name, '/');
+		size_t len;
+
+		base = base ? base + 1 : packs[i]->pack_name;
+		if (strip_suffix(base, ".pack", &len))
+			string_list_append_nodup(to_delete,
+						 xmemdupz(base, len));
+	}
+	return packs;
+}
+
+static void feed_rollup_objects(int fd, struct packed_git **packs, int nr)
+{
+	FILE *out = xfdopen(fd, "w");
+	int i;
+	uint32_t n;
+
+	for (i = 0; i < nr; i++) {
+		struct packed_git *p = packs[i];
+
+		if (open_pack_index(p))
+			die("cannot open pack index for %s", p->pack_name);
+		for (n = 0; n < p->num_objects; n++)
+			fprintf(out, "%s\n",
+				sha1_to_hex(nth_packed_object_sha1(p, n)));
+	}
+	fclose(out);
+}
+
 int cmd_repack(int argc, const char **argv, const char *prefix)
 {
 	struct {
@@ -132,6 +281,7 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 		{".pack"},
 		{".idx"},
 		{".bitmap", 1},
+		{".rev", 1},
 	};
 	struct child_process cmd = CHILD_PROCESS_INIT;
 	struct string_list_item *item;
@@ -150,9 +300,12 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 	const char *depth = NULL;
 	const char *max_pack_size = NULL;
 	int no_reuse_delta = 0, no_reuse_object = 0;
-	int no_update_server_info = 0;
+	int no_update_server_info = 0, write_midx = 0;
 	int quiet = 0;
 	int local = 0;
+	int geometric_factor = 0;
+	struct packed_git **rollup = NULL;
+	int rollup_nr = 0;
 
 	struct option builtin_repack_options[] = {
 		OPT_BIT('a', NULL, &pack_everything,
@@ -185,6 +338,10 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 				N_("maximum size of each packfile")),
 		OPT_BOOL(0, "pack-kept-objects", &pack_kept_objects,
 				N_("repack objects in packs marked with .keep")),
+		OPT_BOOL('i', "delta-islands", &use_delta_islands,
+				N_("pass --delta-islands to git-pack-objects")),
+		OPT_INTEGER('g', "geometric", &geometric_factor,
+				N_("find a geometric progression with factor <N>")),
 		OPT_END()
 	};
 
@@ -196,6 +353,13 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 	if (pack_kept_objects < 0)
 		pack_kept_objects = write_bitmaps;
 
+	if (geometric_factor) {
+		if (pack_everything)
+			die(_("--geometric is incompatible with -a and -A"));
+		/* rolling up a subset of packs cannot produce a full bitmap */
+		write_bitmaps = 0;
+	}
+
 	packdir = mkpathdup("%s/pack", get_object_directory());
 	packtmp = mkpathdup("%s/.tmp-%d-pack", packdir, (int)getpid());
 
@@ -206,9 +370,11 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 	if (!pack_kept_objects)
 		argv_array_push(&cmd.args, "--honor-pack-keep");
 	argv_array_push(&cmd.args, "--non-empty");
-	argv_array_push(&cmd.args, "--all");
-	argv_array_push(&cmd.args, "--reflog");
-	argv_array_push(&cmd.args, "--indexed-objects");
+	if (!geometric_factor) {
+		argv_array_push(&cmd.args, "--all");
+		argv_array_push(&cmd.args, "--reflog");
+		argv_array_push(&cmd.args, "--indexed-objects");
+	}
 	if (window)
 		argv_array_pushf(&cmd.args, "--window=%s", window);
 	if (window_memory)
@@ -223,6 +389,8 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 		argv_array_pushf(&cmd.args, "--no-reuse-object");
 	if (write_bitmaps)
 		argv_array_push(&cmd.args, "--write-bitmap-index");
+	if (use_delta_islands)
+		argv_array_push(&cmd.args, "--delta-islands");
 
 	if (pack_everything & ALL_INTO_ONE) {
 		get_non_kept_pack_filenames(&existing_packs);
@@ -240,6 +408,14 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 				argv_array_push(&cmd.env_array, "GIT_REF_PARANOIA=1");
 			}
 		}
+	} else if (geometric_factor) {
+		rollup = find_geometric_rollup(geometric_factor, &rollup_nr,
+					       &existing_packs);
+		if (rollup_nr < 2) {
+			if (!quiet)
+				printf("Nothing to roll up.\n");
+			return 0;
+		}
 	} else {
 		argv_array_push(&cmd.args, "--unpacked");
 		argv_array_push(&cmd.args, "--incremental");
@@ -256,12 +432,33 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 
 	cmd.git_cmd = 1;
 	cmd.out = -1;
-	cmd.no_stdin = 1;
+	if (geometric_factor)
+		cmd.in = -1;
+	else
+		cmd.no_stdin = 1;
 
 	ret = start_command(&cmd);
 	if (ret)
 		return ret;
 
+	if (geometric_factor) {
+		int i;
+
+		feed_rollup_objects(cmd.in, rollup, rollup_nr);
+		/*
+		 * Drop our own references to the packs we are about to
+		 * replace, so that the prune-packed run at the end does
+		 * not trip over them once "-d" deletes the files.
+		 */
+		for (i = 0; i < rollup_nr; i++) {
+			char *name = xstrdup(rollup[i]->pack_name);
+
+			free_pack_by_name(name);
+			free(name);
+		}
+		free(rollup);
+	}
+
 	out = xfdopen(cmd.out, "r");
 	while (strbuf_getline(&line, out, '\n') != EOF) {
 		if (line.len != 40)
@@ -380,6 +577,10 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 
 	if (delete_redundant) {
 		int opts = 0;
+		unsigned long expire = strcmp(pack_expire, "never") ?
+			approxidate(pack_expire) : 0;
+		int grace = !!strcmp(pack_expire, "now");
+
 		string_list_sort(&names);
 		for_each_string_list_item(item, &existing_packs) {
 			char *sha1;
@@ -387,9 +588,14 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 			if (len < 40)
 				continue;
 			sha1 = item->string + len - 40;
-			if (!string_list_has_string(&names, sha1))
+			if (string_list_has_string(&names, sha1))
+				continue;
+			if (grace)
+				mark_redundant_pack(packdir, item->string);
+			else
 				remove_redundant_pack(packdir, item->string);
 		}
+		remove_expired_redundant_packs(expire);
 		if (!quiet && isatty(2))
 			opts |= PRUNE_PACKED_VERBOSE;
 		prune_packed_objects(opts);
@@ -398,6 +604,10 @@ int cmd_repack(int argc, const char **argv, const char *prefix)
 	if (!no_update_server_info)
 		update_server_info(0);
 	remove_temporary_files();
+
+	if (!git_config_get_bool("core.multipackindex", &write_midx) &&
+	    write_midx)
+		write_midx_file(get_object_directory());
 	string_list_clear(&names, 0);
 	string_list_clear(&rollback, 0);
 	string_list_clear(&existing_packs, 0);
@@ -9,6 +9,8 @@
 #include "log-tree.h"
 #include "graph.h"
 #include "bisect.h"
+#include "thread-utils.h"
+#include "rev-cache.h"
 
 static const char rev_list_usage[] =
 "git rev-list [OPTION] <commit-id>... [ -- paths... ]\n"
@@ -37,6 +39,10 @@ static const char rev_list_usage[] =
 "    --parents\n"
 "    --children\n"
 "    --objects | --objects-edge\n"
+"    --object-type=<type>\n"
+"    --min-object-size=<n>\n"
+"    --max-object-size=<n>\n"
+"    --threads=<n>\n"
 "    --unpacked\n"
 "    --header | --pretty\n"
 "    --abbrev=<n> | --no-abbrev\n"
@@ -45,7 +51,8 @@ static const char rev_list_usage[] =
 "  special purpose:\n"
 "    --bisect\n"
 "    --bisect-vars\n"
-"    --bisect-all"
+"    --bisect-all\n"
+"    --count-cache=(show|flush)"
 ;
 
 static void finish_commit(struct commit *commit, void *data);
@@ -59,6 +66,12 @@ static void show_commit(struct commit *commit, void *data)
 		return;
 	}
 
+	if (revs->filter_object_type &&
+	    revs->filter_object_type != OBJ_COMMIT) {
+		finish_commit(commit, data);
+		return;
+	}
+
 	graph_show_commit(revs->graph);
 
 	if (revs->count) {
@@ -258,6 +271,17 @@ static int show_bisect_vars(struct rev_list_info *info, int reaches, int all)
 	return 0;
 }
 
+static int show_object_none(
+	const unsigned char *sha1,
+	enum object_type type,
+	int exclude,
+	uint32_t name_hash,
+	struct packed_git *found_pack,
+	off_t found_offset)
+{
+	return 1;
+}
+
 static int show_object_fast(
 	const unsigned char *sha1,
 	enum object_type type,
@@ -270,10 +294,49 @@ static int show_object_fast(
 	return 1;
 }
 
+static void show_counts(struct rev_info *revs)
+{
+	if (revs->left_right && revs->cherry_mark)
+		printf("%d\t%d\t%d\n", revs->count_left, revs->count_right, revs->count_same);
+	else if (revs->left_right)
+		printf("%d\t%d\n", revs->count_left, revs->count_right);
+	else if (revs->cherry_mark)
+		printf("%d\t%d\n", revs->count_left + revs->count_right, revs->count_same);
+	else
+		printf("%d\n", revs->count_left + revs->count_right);
+}
+
+/*
+ * Key a count query by what it asked (the command line, which the
+ * revision parser rewrites, so it is hashed up front) and by what the
+ * named tips resolved to, so that a key can never yield an answer
+ * that a ref update has made stale.
+ */
+static void count_cache_key(struct rev_info *revs, struct strbuf *query,
+			    unsigned char *key)
+{
+	git_SHA_CTX ctx;
+	int i;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, query->buf, query->len);
+	for (i = 0; i < revs->pending.nr; i++) {
+		struct object *obj = revs->pending.objects[i].item;
+		unsigned flags = obj->flags;
+
+		git_SHA1_Update(&ctx, obj->sha1, 20);
+		git_SHA1_Update(&ctx, &flags, sizeof(flags));
+	}
+	git_SHA1_Final(key, &ctx);
+}
+
 int cmd_rev_list(int argc, const char **argv, const char *prefix)
 {
 	struct rev_info revs;
 	struct rev_list_info info;
+	struct strbuf query = STRBUF_INIT;
+	unsigned char cache_key[20];
+	int have_cache_key = 0;
 	int i;
 	int bisect_list = 0;
 	int bisect_show_vars = 0;
@@ -284,6 +347,8 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	init_revisions(&revs, prefix);
 	revs.abbrev = DEFAULT_ABBREV;
 	revs.commit_format = CMIT_FMT_UNSPECIFIED;
+	for (i = 1; i < argc; i++)
+		strbuf_add(&query, argv[i], strlen(argv[i]) + 1);
 	argc = setup_revisions(argc, argv, &revs, NULL);
 
 	memset(&info, 0, sizeof(info));
@@ -324,10 +389,31 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 			use_bitmap_index = 1;
 			continue;
 		}
+		if (starts_with(arg, "--threads=")) {
+			revs.traverse_threads = atoi(arg + 10);
+			if (revs.traverse_threads < 0)
+				die("invalid number of threads specified (%d)",
+				    revs.traverse_threads);
+			if (!revs.traverse_threads)
+				revs.traverse_threads = online_cpus();
+#ifdef NO_PTHREADS
+			if (revs.traverse_threads > 1) {
+				warning("no threads support, ignoring %s", arg);
+				revs.traverse_threads = 1;
+			}
+#endif
+			continue;
+		}
 		if (!strcmp(arg, "--test-bitmap")) {
 			test_bitmap_walk(&revs);
 			return 0;
 		}
+		if (!strcmp(arg, "--count-cache=show"))
+			return rev_cache_show();
+		if (!strcmp(arg, "--count-cache=flush")) {
+			rev_cache_clear();
+			return 0;
+		}
 		usage(rev_list_usage);
 
 	}
@@ -355,22 +441,47 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	if (bisect_list)
 		revs.limited = 1;
 
+	/*
+	 * A count produces no output during the walk itself (unless a
+	 * graph or objects were asked for), so for those queries the
+	 * whole answer can come from the cache.
+	 */
+	if (rev_cache_enabled() && revs.count && !revs.graph &&
+	    !revs.tag_objects && !revs.tree_objects && !revs.blob_objects &&
+	    !bisect_list) {
+		count_cache_key(&revs, &query, cache_key);
+		have_cache_key = 1;
+		if (rev_cache_lookup(cache_key, &revs.count_left,
+				     &revs.count_right, &revs.count_same)) {
+			show_counts(&revs);
+			return 0;
+		}
+	}
+	strbuf_release(&query);
+
 	if (use_bitmap_index) {
 		if (revs.count && !revs.left_right && !revs.cherry_mark) {
 			uint32_t commit_count;
 			if (!prepare_bitmap_walk(&revs)) {
 				count_bitmap_commit_list(&commit_count, NULL, NULL, NULL);
+				if (have_cache_key)
+					rev_cache_store(cache_key,
+							commit_count, 0, 0);
 				printf("%d\n", commit_count);
 				return 0;
 			}
 		} else if (revs.tag_objects && revs.tree_objects && revs.blob_objects) {
 			if (!prepare_bitmap_walk(&revs)) {
-				traverse_bitmap_commit_list(&show_object_fast);
+				traverse_bitmap_commit_list(info.flags & REV_LIST_QUIET ?
+							    &show_object_none :
+							    &show_object_fast);
 				return 0;
 			}
 		}
 	}
 
+	if (revs.tree_objects)
+		prealloc_object_hash(approximate_object_count());
 	if (prepare_revision_walk(&revs))
 		die("revision walk setup failed");
 	if (revs.tree_objects)
@@ -389,14 +500,10 @@ int cmd_rev_list(int argc, const char **argv, const char *prefix)
 	traverse_commit_list(&revs, show_commit, show_object, &info);
 
 	if (revs.count) {
-		if (revs.left_right && revs.cherry_mark)
-			printf("%d\t%d\t%d\n", revs.count_left, revs.count_right, revs.count_same);
-		else if (revs.left_right)
-			printf("%d\t%d\n", revs.count_left, revs.count_right);
-		else if (revs.cherry_mark)
-			printf("%d\t%d\n", revs.count_left + revs.count_right, revs.count_same);
-		else
-			printf("%d\n", revs.count_left + revs.count_right);
+		if (have_cache_key)
+			rev_cache_store(cache_key, revs.count_left,
+					revs.count_right, revs.count_same);
+		show_counts(&revs);
 	}
 
 	return 0;
@@ -111,8 +111,12 @@ int cmd_send_pack(int argc, const char **argv, const char *prefix)
 	unsigned int reject_reasons;
 	int progress = -1;
 	int from_stdin = 0;
+	int negotiate;
 	struct push_cas_option cas = {0};
 
+	if (!git_config_get_bool("push.negotiate", &negotiate))
+		args.push_negotiate = negotiate;
+
 	argv++;
 	for (i = 1; i < argc; i++, argv++) {
 		const char *arg = *argv;
@@ -0,0 +1,334 @@
+/*
+ * "git serve-commands" -- a resident process that runs plumbing
+ * commands on behalf of short-lived clients.
+ *
+ * Automation that issues thousands of small plumbing calls pays the
+ * price of exec()ing a fresh git for every one of them.  The server
+ * started by this command performs repository discovery once, then
+ * accepts requests over a unix domain socket.  For each request it
+ * forks; the child inherits the server's address space, attaches the
+ * client's stdin/stdout/stderr (passed over the socket), and runs the
+ * named builtin in-process through the same dispatch table git.c
+ * uses.  Running each command in a fresh fork of the server means a
+ * die() only takes down that command, and no in-core state survives
+ * from one request to the next, so index and ref updates made by one
+ * command are always visible to the next.
+ */
+#include "builtin.h"
+#include "unix-socket.h"
+#include "sigchain.h"
+#include "quote.h"
+#include "parse-options.h"
+
+#ifndef NO_UNIX_SOCKETS
+
+static const char *socket_path;
+
+static void cleanup_socket(void)
+{
+	if (socket_path)
+		unlink(socket_path);
+}
+
+static void cleanup_socket_on_signal(int sig)
+{
+	cleanup_socket();
+	sigchain_pop(sig);
+	raise(sig);
+}
+
+/*
+ * Pass (or receive) the three stdio file descriptors over the
+ * socket, together with a single data byte to carry the control
+ * message.
+ */
+static int send_stdio_fds(int fd)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct cmsghdr *cmsg;
+	int *fds;
+	char byte = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(&u, 0, sizeof(u));
+	iov.iov_base = &byte;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+	fds = (int *)CMSG_DATA(cmsg);
+	fds[0] = 0;
+	fds[1] = 1;
+	fds[2] = 2;
+
+	if (sendmsg(fd, &msg, 0) != 1)
+		return error("unable to send stdio to command server: %s",
+			     strerror(errno));
+	return 0;
+}
+
+static int recv_stdio_fds(int fd, int *fds)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+	} u;
+	struct cmsghdr *cmsg;
+	char byte;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &byte;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = u.buf;
+	msg.msg_controllen = sizeof(u.buf);
+
+	if (recvmsg(fd, &msg, 0) != 1)
+		return error("client hung up before passing stdio");
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+	    cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+		return error("client did not pass its stdio descriptors");
+	memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+	return 0;
+}
+
+/*
+ * Run one request in a fresh child of the server.  The child gets
+ * the client's stdio, moves to the directory the client called from
+ * so that relative pathspecs keep working, and exits with the
+ * builtin's status.
+ */
+static int run_client_command(const char *cwd, char *cmdline, int *fds)
+{
+	pid_t pid;
+	int status;
+
+	pid = fork();
+	if (pid < 0)
+		return error("fork failed: %s", strerror(errno));
+	if (!pid) {
+		const char **argv = NULL;
+		int argc = 0, alloc = 0;
+
+		/* the atexit() cleanup must not unlink the socket */
+		socket_path = NULL;
+		if (dup2(fds[0], 0) < 0 || dup2(fds[1], 1) < 0 ||
+		    dup2(fds[2], 2) < 0)
+			die_errno("unable to attach client stdio");
+		close(fds[0]);
+		close(fds[1]);
+		close(fds[2]);
+		if (chdir(cwd))
+			die_errno("unable to chdir to '%s'", cwd);
+		if (sq_dequote_to_argv(cmdline, &argv, &argc, &alloc) || !argc)
+			die("bogus command line from client");
+		status = run_builtin_command(argc, argv);
+		exit(status < 0 ? 128 : status);
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	close(fds[2]);
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return error("waitpid failed: %s", strerror(errno));
+	}
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
+
+/*
+ * One request per connection: the client first passes its stdio
+ * descriptors, then sends
+ *
+ *	cwd <absolute-directory>
+ *	argv <sq-quoted command line>
+ *
+ * The descriptors must come first; once a stdio stream starts
+ * buffering socket data, a plain read() would silently throw away
+ * the ancillary data carrying them.  The reply is a single
+ * "status <n>" line once the command has finished.  A request whose
+ * command line is just "exit" stops the server.  Returns non-zero
+ * when the server should keep running.
+ */
+static int serve_one_client(int client)
+{
+	struct strbuf cwd = STRBUF_INIT;
+	struct strbuf cmdline = STRBUF_INIT;
+	FILE *in, *out;
+	int client2, fds[3], keep_going = 1;
+	const char *p;
+
+	if (recv_stdio_fds(client, fds)) {
+		close(client);
+		return 1;
+	}
+	client2 = dup(client);
+	if (client2 < 0) {
+		warning("dup failed: %s", strerror(errno));
+		close(client);
+		goto close_fds;
+	}
+	in = xfdopen(client, "r");
+	out = xfdopen(client2, "w");
+
+	if (strbuf_getline(&cwd, in, '\n') == EOF ||
+	    !skip_prefix(cwd.buf, "cwd ", &p))
+		goto done;
+	strbuf_remove(&cwd, 0, p - cwd.buf);
+
+	if (strbuf_getline(&cmdline, in, '\n') == EOF ||
+	    !skip_prefix(cmdline.buf, "argv ", &p))
+		goto done;
+	strbuf_remove(&cmdline, 0, p - cmdline.buf);
+
+	if (!strcmp(cmdline.buf, "'exit'")) {
+		fprintf(out, "status 0\n");
+		keep_going = 0;
+		goto done;
+	}
+
+	fprintf(out, "status %d\n",
+		run_client_command(cwd.buf, cmdline.buf, fds));
+	fds[0] = fds[1] = fds[2] = -1;
+
+done:
+	fclose(in);
+	fclose(out);
+	strbuf_release(&cwd);
+	strbuf_release(&cmdline);
+close_fds:
+	if (fds[0] >= 0) {
+		close(fds[0]);
+		close(fds[1]);
+		close(fds[2]);
+	}
+	return keep_going;
+}
+
+static void serve_commands(const char *path)
+{
+	int fd;
+
+	fd = unix_stream_listen(path);
+	if (fd < 0)
+		die_errno("unable to bind to '%s'", path);
+
+	printf("ok\n");
+	fflush(stdout);
+
+	for (;;) {
+		int client = accept(fd, NULL, NULL);
+		if (client < 0) {
+			if (errno == EINTR)
+				continue;
+			warning("accept failed: %s", strerror(errno));
+			continue;
+		}
+		if (!serve_one_client(client))
+			break;
+	}
+	close(fd);
+	unlink(path);
+}
+
+static int call_command(const char *path, const char **argv)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct strbuf cwd = STRBUF_INIT;
+	struct strbuf reply = STRBUF_INIT;
+	int fd, status;
+	FILE *in;
+	const char *p;
+
+	fd = unix_stream_connect(path);
+	if (fd < 0)
+		die_errno("unable to connect to '%s'", path);
+
+	if (send_stdio_fds(fd))
+		exit(128);
+	if (strbuf_getcwd(&cwd))
+		die_errno("unable to get current directory");
+	strbuf_addf(&buf, "cwd %s\nargv", cwd.buf);
+	sq_quote_argv(&buf, argv, 0);
+	strbuf_addch(&buf, '\n');
+	if (write_in_full(fd, buf.buf, buf.len) != buf.len)
+		die_errno("unable to send request");
+
+	in = xfdopen(fd, "r");
+	if (strbuf_getline(&reply, in, '\n') == EOF ||
+	    !skip_prefix(reply.buf, "status ", &p))
+		die("command server did not report a status");
+	status = atoi(p);
+	fclose(in);
+	strbuf_release(&buf);
+	strbuf_release(&reply);
+	return status;
+}
+
+static const char * const serve_commands_usage[] = {
+	N_("git serve-commands <socket>"),
+	N_("git serve-commands --call <socket> <command> [<args>...]"),
+	NULL
+};
+
+int cmd_serve_commands(int argc, const char **argv, const char *prefix)
+{
+	int call = 0;
+	const struct option options[] = {
+		OPT_BOOL(0, "call", &call,
+			 N_("send a command to a running server")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, options,
+			     serve_commands_usage,
+			     PARSE_OPT_STOP_AT_NON_OPTION);
+	if (argc < 1)
+		usage_with_options(serve_commands_usage, options);
+
+	if (call) {
+		if (argc < 2)
+			usage_with_options(serve_commands_usage, options);
+		return call_command(argv[0], argv + 1);
+	}
+
+	if (argc != 1)
+		usage_with_options(serve_commands_usage, options);
+	setup_git_directory();
+	git_config(git_default_config, NULL);
+
+	socket_path = argv[0];
+	atexit(cleanup_socket);
+	sigchain_push_common(cleanup_socket_on_signal);
+
+	serve_commands(socket_path);
+	return 0;
+}
+
+#else /* NO_UNIX_SOCKETS */
+
+int cmd_serve_commands(int argc, const char **argv, const char *prefix)
+{
+	die(_("serve-commands is not supported on this platform "
+	      "(it needs unix domain sockets)"));
+}
+
+#endif
@@ -27,6 +27,20 @@ static int compare_by_number(const void *a1, const void *a2)
 		return -1;
 }
 
+/* In summary mode the util field holds a bare commit counter. */
+static int compare_by_counter(const void *a1, const void *a2)
+{
+	const struct string_list_item *i1 = a1, *i2 = a2;
+	uintptr_t n1 = (uintptr_t)i1->util, n2 = (uintptr_t)i2->util;
+
+	if (n1 < n2)
+		return 1;
+	else if (n1 == n2)
+		return 0;
+	else
+		return -1;
+}
+
 static void insert_one_record(struct shortlog *log,
 			      const char *author,
 			      const char *oneline)
@@ -56,6 +70,17 @@ static void insert_one_record(struct shortlog *log,
 		strbuf_addf(&namemailbuf, " <%.*s>", (int)maillen, mailbuf);
 
 	item = string_list_insert(&log->list, namemailbuf.buf);
+
+	if (log->summary) {
+		/*
+		 * Only the number of commits per author is wanted; do
+		 * not format and store the subject lines.
+		 */
+		item->util = (void *)((uintptr_t)item->util + 1);
+		strbuf_release(&namemailbuf);
+		return;
+	}
+
 	if (item->util == NULL)
 		item->util = xcalloc(1, sizeof(struct string_list));
 
@@ -109,27 +134,32 @@ static void read_from_stdin(struct shortlog *log)
 
 void shortlog_add_commit(struct shortlog *log, struct commit *commit)
 {
-	const char *author = NULL, *buffer;
-	struct strbuf buf = STRBUF_INIT;
+	struct strbuf author = STRBUF_INIT;
 	struct strbuf ufbuf = STRBUF_INIT;
-
-	pp_commit_easy(CMIT_FMT_RAW, commit, &buf);
-	buffer = buf.buf;
+	const char *msg, *buffer;
+	int found_author = 0;
+
+	/*
+	 * Read the headers straight out of the (possibly re-encoded)
+	 * commit buffer instead of pretty-printing a full raw copy of
+	 * the commit only to scan it again.
+	 */
+	msg = logmsg_reencode(commit, NULL, get_log_output_encoding());
+	buffer = msg;
 	while (*buffer && *buffer != '\n') {
-		const char *eol = strchr(buffer, '\n');
-
-		if (eol == NULL)
-			eol = buffer + strlen(buffer);
-		else
-			eol++;
+		const char *eol = strchrnul(buffer, '\n');
 
-		if (starts_with(buffer, "author "))
-			author = buffer + 7;
-		buffer = eol;
+		if (starts_with(buffer, "author ")) {
+			strbuf_add(&author, buffer + 7, eol - (buffer + 7));
+			found_author = 1;
+		}
+		buffer = *eol ? eol + 1 : eol;
 	}
-	if (!author) {
+	if (!found_author) {
 		warning(_("Missing author: %s"),
 		    sha1_to_hex(commit->object.sha1));
+		unuse_commit_buffer(commit, msg);
+		strbuf_release(&author);
 		return;
 	}
 	if (log->user_format) {
@@ -145,9 +175,10 @@ void shortlog_add_commit(struct shortlog *log, struct commit *commit)
 	} else if (*buffer) {
 		buffer++;
 	}
-	insert_one_record(log, author, !*buffer ? "<none>" : buffer);
+	insert_one_record(log, author.buf, !*buffer ? "<none>" : buffer);
 	strbuf_release(&ufbuf);
-	strbuf_release(&buf);
+	strbuf_release(&author);
+	unuse_commit_buffer(commit, msg);
 }
 
 static void get_from_rev(struct rev_info *rev, struct shortlog *log)
@@ -294,27 +325,30 @@ void shortlog_output(struct shortlog *log)
 
 	if (log->sort_by_number)
 		qsort(log->list.items, log->list.nr, sizeof(struct string_list_item),
-			compare_by_number);
+			log->summary ? compare_by_counter : compare_by_number);
 	for (i = 0; i < log->list.nr; i++) {
 		struct string_list *onelines = log->list.items[i].util;
 
 		if (log->summary) {
-			printf("%6d\t%s\n", onelines->nr, log->list.items[i].string);
-		} else {
-			printf("%s (%d):\n", log->list.items[i].string, onelines->nr);
-			for (j = onelines->nr - 1; j >= 0; j--) {
-				const char *msg = onelines->items[j].string;
-
-				if (log->wrap_lines) {
-					strbuf_reset(&sb);
-					add_wrapped_shortlog_msg(&sb, msg, log);
-					fwrite(sb.buf, sb.len, 1, stdout);
-				}
-				else
-					printf("      %s\n", msg);
+			printf("%6d\t%s\n", (int)(uintptr_t)onelines,
+			       log->list.items[i].string);
+			log->list.items[i].util = NULL;
+			continue;
+		}
+
+		printf("%s (%d):\n", log->list.items[i].string, onelines->nr);
+		for (j = onelines->nr - 1; j >= 0; j--) {
+			const char *msg = onelines->items[j].string;
+
+			if (log->wrap_lines) {
+				strbuf_reset(&sb);
+				add_wrapped_shortlog_msg(&sb, msg, log);
+				fwrite(sb.buf, sb.len, 1, stdout);
 			}
-			putchar('\n');
+			else
+				printf("      %s\n", msg);
 		}
+		putchar('\n');
 
 		onelines->strdup_strings = 1;
 		string_list_clear(onelines, 0);
@@ -483,6 +483,9 @@ static void unpack_all(void)
 	if (!pack_version_ok(hdr->hdr_version))
 		die("unknown pack file version %"PRIu32,
 			ntohl(hdr->hdr_version));
+	if (!pack_codec_name(pack_version_codec(hdr->hdr_version)))
+		die("unknown pack codec %d",
+		    pack_version_codec(hdr->hdr_version));
 	use(sizeof(struct pack_header));
 
 	if (!quiet)
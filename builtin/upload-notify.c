@@ -0,0 +1,156 @@
+/*
+ * Serve ref change notifications to a connected client.
+ *
+ * The client registers any number of "watch <pattern>" pkt-lines and
+ * then reads "change <old-sha1> <new-sha1> <refname>" pkt-lines as
+ * matching refs move.  Instead of re-advertising all refs to every
+ * poller, we watch $GIT_DIR/notify-stamp, which receive-pack bumps
+ * whenever it updates a ref, and only rescan the refs when the stamp
+ * moves (or on every tick when no stamp exists yet).
+ */
+#include "builtin.h"
+#include "pkt-line.h"
+#include "refs.h"
+#include "string-list.h"
+#include "parse-options.h"
+#include "wildmatch.h"
+
+static const char * const upload_notify_usage[] = {
+	N_("git upload-notify [--once] [--interval=<n>] <dir>"),
+	NULL
+};
+
+static struct string_list patterns = STRING_LIST_INIT_DUP;
+
+static int ref_matches(const char *name)
+{
+	struct string_list_item *item;
+
+	for_each_string_list_item(item, &patterns)
+		if (!wildmatch(item->string, name, 0, NULL))
+			return 1;
+	return 0;
+}
+
+static int collect_ref(const char *name, const unsigned char *sha1,
+		       int flag, void *data)
+{
+	struct string_list *list = data;
+
+	if (ref_matches(name))
+		string_list_insert(list, name)->util =
+			xstrdup(sha1_to_hex(sha1));
+	return 0;
+}
+
+static int emit_changes(struct string_list *old, struct string_list *new)
+{
+	static const char *null_hex = "0000000000000000000000000000000000000000";
+	struct string_list_item *item;
+	int nr = 0;
+
+	for_each_string_list_item(item, new) {
+		struct string_list_item *prev = string_list_lookup(old, item->string);
+
+		if (prev && !strcmp(prev->util, item->util))
+			continue;
+		packet_write(1, "change %s %s %s\n",
+			     prev ? (char *)prev->util : null_hex,
+			     (char *)item->util, item->string);
+		nr++;
+	}
+	for_each_string_list_item(item, old) {
+		if (string_list_lookup(new, item->string))
+			continue;
+		packet_write(1, "change %s %s %s\n",
+			     (char *)item->util, null_hex, item->string);
+		nr++;
+	}
+	if (nr)
+		packet_flush(1);
+	return nr;
+}
+
+static void read_watch_requests(void)
+{
+	for (;;) {
+		char *line = packet_read_line(0, NULL);
+
+		if (!line)
+			break;
+		if (!starts_with(line, "watch "))
+			die("git upload-notify: protocol error, "
+			    "expected watch, got '%s'", line);
+		string_list_append(&patterns, line + 6);
+	}
+	if (!patterns.nr)
+		string_list_append(&patterns, "refs/*");
+}
+
+/*
+ * Returns 1 when the stamp moved (or is unusable and we must rescan),
+ * 0 when it provably did not change since the last call.
+ */
+static int stamp_changed(void)
+{
+	static struct stat last;
+	static int have_last;
+	struct stat st;
+
+	if (stat(git_path("notify-stamp"), &st))
+		return 1;
+	if (have_last && st.st_mtime == last.st_mtime &&
+	    st.st_size == last.st_size)
+		return 0;
+	last = st;
+	have_last = 1;
+	return 1;
+}
+
+int cmd_upload_notify(int argc, const char **argv, const char *prefix)
+{
+	struct string_list snapshot = STRING_LIST_INIT_DUP;
+	int once = 0;
+	int interval = 1;
+	struct option options[] = {
+		OPT_BOOL(0, "once", &once,
+			 N_("exit after reporting the first batch of changes")),
+		OPT_INTEGER(0, "interval", &interval,
+			    N_("seconds to sleep between ref scans")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, prefix, options,
+			     upload_notify_usage, 0);
+	if (argc != 1)
+		usage_with_options(upload_notify_usage, options);
+	if (interval < 1)
+		interval = 1;
+
+	if (!enter_repo(argv[0], 0))
+		die("'%s' does not appear to be a git repository", argv[0]);
+
+	read_watch_requests();
+
+	stamp_changed();
+	for_each_ref(collect_ref, &snapshot);
+	packet_write(1, "watching\n");
+	packet_flush(1);
+
+	for (;;) {
+		struct string_list current = STRING_LIST_INIT_DUP;
+		int nr;
+
+		sleep(interval);
+		if (!stamp_changed())
+			continue;
+		invalidate_cached_refs();
+		for_each_ref(collect_ref, &current);
+		nr = emit_changes(&snapshot, &current);
+		string_list_clear(&snapshot, 1);
+		snapshot = current;
+		if (nr && once)
+			break;
+	}
+	return 0;
+}
@@ -2,9 +2,11 @@
 #include "cache.h"
 #include "run-command.h"
 #include "parse-options.h"
+#include "pack-revindex.h"
 
 #define VERIFY_PACK_VERBOSE 01
 #define VERIFY_PACK_STAT_ONLY 02
+#define VERIFY_PACK_STATS 04
 
 static int verify_one_pack(const char *path, unsigned int flags)
 {
@@ -50,8 +52,220 @@ static int verify_one_pack(const char *path, unsigned int flags)
 	return err;
 }
 
+/*
+ * --stats mode: aggregate statistics computed straight from the idx
+ * and the pack entry headers, without inflating any object data.
+ * Chain depths beyond MAX_CHAIN are lumped into one bucket, the same
+ * cutoff "index-pack --verify-stat" uses for its histogram.
+ */
+#define MAX_CHAIN 50
+
+struct pack_stats {
+	uint32_t type_count[OBJ_TAG + 1];
+	uintmax_t type_size[OBJ_TAG + 1];
+	uintmax_t type_disk[OBJ_TAG + 1];
+	uint32_t deltas;
+	uint32_t chain_histogram[MAX_CHAIN + 1];
+	uint32_t chain_deeper;
+	uint32_t max_depth;
+};
+
+static off_t stats_delta_base(struct packed_git *p,
+			      struct pack_window **w_curs,
+			      off_t curpos, enum object_type type,
+			      off_t obj_offset)
+{
+	unsigned char *base_info = use_pack(p, w_curs, curpos, NULL);
+	off_t base_offset;
+
+	if (type == OBJ_OFS_DELTA) {
+		unsigned used = 0;
+		unsigned char c = base_info[used++];
+		base_offset = c & 127;
+		while (c & 128) {
+			base_offset += 1;
+			if (!base_offset || MSB(base_offset, 7))
+				return 0;  /* overflow */
+			c = base_info[used++];
+			base_offset = (base_offset << 7) + (c & 127);
+		}
+		base_offset = obj_offset - base_offset;
+		if (base_offset <= 0 || base_offset >= obj_offset)
+			return 0;  /* out of bound */
+	} else {
+		/* the base entry _must_ be in the same pack */
+		base_offset = find_pack_entry_one(base_info, p);
+	}
+	return base_offset;
+}
+
+/*
+ * Compute the delta depth and underlying type of the object at
+ * revindex position pos, memoizing every object visited on the way
+ * down so each object's chain is walked at most once.  chain[] holds
+ * depth + 1 (0 means "not yet known"), rtype[] the resolved type.
+ */
+static void resolve_chain(struct packed_git *p, struct pack_revindex *rix,
+			  struct pack_window **w_curs, int pos,
+			  uint32_t *chain, unsigned char *rtype)
+{
+	int *stack = NULL;
+	int stack_nr = 0, stack_alloc = 0;
+	uint32_t base_depth;
+	unsigned char base_type;
+
+	for (;;) {
+		off_t offset, curpos, base;
+		unsigned long size;
+		enum object_type type;
+
+		if (chain[pos]) {
+			base_depth = chain[pos] - 1;
+			base_type = rtype[pos];
+			break;
+		}
+		offset = curpos = rix->revindex[pos].offset;
+		type = unpack_object_header(p, w_curs, &curpos, &size);
+		if (type != OBJ_OFS_DELTA && type != OBJ_REF_DELTA) {
+			chain[pos] = 1;
+			rtype[pos] = type;
+			base_depth = 0;
+			base_type = type;
+			break;
+		}
+		base = stats_delta_base(p, w_curs, curpos, type, offset);
+		if (!base)
+			die("broken delta chain at offset %"PRIuMAX" in %s",
+			    (uintmax_t)offset, p->pack_name);
+		ALLOC_GROW(stack, stack_nr + 1, stack_alloc);
+		stack[stack_nr++] = pos;
+		pos = find_revindex_position(rix, base);
+		if (pos < 0)
+			die("delta base is not the start of an object in %s",
+			    p->pack_name);
+	}
+
+	while (stack_nr) {
+		pos = stack[--stack_nr];
+		chain[pos] = ++base_depth + 1;
+		rtype[pos] = base_type;
+	}
+	free(stack);
+}
+
+static void show_pack_stats(const struct pack_stats *stats)
+{
+	enum object_type t;
+	uint32_t depth;
+
+	for (t = OBJ_COMMIT; t <= OBJ_TAG; t++) {
+		printf("%s-count: %"PRIu32"\n", typename(t),
+		       stats->type_count[t]);
+		printf("%s-size: %"PRIuMAX"\n", typename(t),
+		       stats->type_size[t]);
+		printf("%s-disk: %"PRIuMAX"\n", typename(t),
+		       stats->type_disk[t]);
+	}
+	printf("delta-count: %"PRIu32"\n", stats->deltas);
+	printf("max-chain-depth: %"PRIu32"\n", stats->max_depth);
+	for (depth = 1; depth <= MAX_CHAIN; depth++) {
+		if (stats->chain_histogram[depth])
+			printf("chain-depth-%"PRIu32": %"PRIu32"\n",
+			       depth, stats->chain_histogram[depth]);
+	}
+	if (stats->chain_deeper)
+		printf("chain-depth-deeper: %"PRIu32"\n",
+		       stats->chain_deeper);
+}
+
+static int stats_one_pack(const char *path)
+{
+	struct strbuf arg = STRBUF_INIT;
+	struct packed_git *p;
+	struct pack_revindex *rix;
+	struct pack_window *w_curs = NULL;
+	struct pack_stats stats;
+	uint32_t *chain;
+	unsigned char *rtype;
+	uint32_t i, nr;
+
+	/*
+	 * In addition to "foo.idx" we accept "foo.pack" and "foo";
+	 * normalize these forms to "foo.idx" for add_packed_git().
+	 */
+	strbuf_addstr(&arg, path);
+	if (!strbuf_strip_suffix(&arg, ".idx"))
+		strbuf_strip_suffix(&arg, ".pack");
+	strbuf_addstr(&arg, ".idx");
+
+	p = add_packed_git(arg.buf, arg.len, 1);
+	if (!p) {
+		error("packfile %s not found", arg.buf);
+		strbuf_release(&arg);
+		return -1;
+	}
+	install_packed_git(p);
+	if (open_pack_index(p)) {
+		error("packfile %s index unavailable", arg.buf);
+		strbuf_release(&arg);
+		return -1;
+	}
+
+	nr = p->num_objects;
+	chain = xcalloc(nr, sizeof(*chain));
+	rtype = xcalloc(nr, 1);
+	rix = revindex_for_pack(p);
+
+	memset(&stats, 0, sizeof(stats));
+	for (i = 0; i < nr; i++) {
+		off_t offset = rix->revindex[i].offset;
+		off_t disk = rix->revindex[i + 1].offset - offset;
+		off_t curpos = offset;
+		unsigned long size;
+		enum object_type type;
+		uint32_t depth;
+
+		type = unpack_object_header(p, &w_curs, &curpos, &size);
+		if (type == OBJ_OFS_DELTA || type == OBJ_REF_DELTA) {
+			if (!chain[i])
+				resolve_chain(p, rix, &w_curs, i,
+					      chain, rtype);
+			stats.deltas++;
+		} else if (!chain[i]) {
+			chain[i] = 1;
+			rtype[i] = type;
+		}
+
+		depth = chain[i] - 1;
+		if (depth > stats.max_depth)
+			stats.max_depth = depth;
+		if (depth > MAX_CHAIN)
+			stats.chain_deeper++;
+		else if (depth)
+			stats.chain_histogram[depth]++;
+
+		type = rtype[i];
+		if (type < OBJ_COMMIT || type > OBJ_TAG)
+			die("object at offset %"PRIuMAX" in %s has bad type %d",
+			    (uintmax_t)offset, p->pack_name, type);
+		stats.type_count[type]++;
+		stats.type_size[type] += size;
+		stats.type_disk[type] += disk;
+	}
+	unuse_pack(&w_curs);
+
+	printf("pack: %s\n", p->pack_name);
+	printf("objects: %"PRIu32"\n", nr);
+	show_pack_stats(&stats);
+
+	free(chain);
+	free(rtype);
+	strbuf_release(&arg);
+	return 0;
+}
+
 static const char * const verify_pack_usage[] = {
-	N_("git verify-pack [-v | --verbose] [-s | --stat-only] <pack>..."),
+	N_("git verify-pack [-v | --verbose] [-s | --stat-only] [--stats] <pack>..."),
 	NULL
 };
 
@@ -65,6 +279,9 @@ int cmd_verify_pack(int argc, const char **argv, const char *prefix)
 			VERIFY_PACK_VERBOSE),
 		OPT_BIT('s', "stat-only", &flags, N_("show statistics only"),
 			VERIFY_PACK_STAT_ONLY),
+		OPT_BIT(0, "stats", &flags,
+			N_("show aggregate statistics without verifying"),
+			VERIFY_PACK_STATS),
 		OPT_END()
 	};
 
@@ -74,7 +291,10 @@ int cmd_verify_pack(int argc, const char **argv, const char *prefix)
 	if (argc < 1)
 		usage_with_options(verify_pack_usage, verify_pack_options);
 	for (i = 0; i < argc; i++) {
-		if (verify_one_pack(argv[i], flags))
+		if (flags & VERIFY_PACK_STATS) {
+			if (stats_one_pack(argv[i]))
+				err = 1;
+		} else if (verify_one_pack(argv[i], flags))
 			err = 1;
 	}
 
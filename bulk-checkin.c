@@ -6,6 +6,8 @@
 #include "csum-file.h"
 #include "pack.h"
 #include "strbuf.h"
+#include "object.h"
+#include "hashmap.h"
 
 static int pack_compression_level = Z_DEFAULT_COMPRESSION;
 
@@ -22,8 +24,45 @@ static struct bulk_checkin_state {
 	uint32_t nr_written;
 } state;
 
+/*
+ * Small objects that went into the bulk-checkin packfile instead of
+ * becoming loose.  Until the pack is installed in the object store,
+ * readers in this process have to find them here.
+ */
+struct pending_object {
+	struct hashmap_entry entry;
+	enum object_type type;
+	unsigned long size;
+	off_t data_offset;
+	unsigned long z_size;
+	unsigned char sha1[20];
+};
+
+static struct hashmap pending_objects;
+
+static int pending_object_cmp(const void *entry, const void *entry_or_key,
+			      const void *unused_keydata)
+{
+	const struct pending_object *a = entry;
+	const struct pending_object *b = entry_or_key;
+
+	return hashcmp(a->sha1, b->sha1);
+}
+
+static struct pending_object *find_pending_object(const unsigned char *sha1)
+{
+	struct pending_object key;
+
+	if (!pending_objects.size)
+		return NULL;
+	hashmap_entry_init(&key, sha1hash(sha1));
+	hashcpy(key.sha1, sha1);
+	return hashmap_get(&pending_objects, &key, NULL);
+}
+
 static void finish_bulk_checkin(struct bulk_checkin_state *state)
 {
+	unsigned plugged = state->plugged;
 	struct object_id oid;
 	struct strbuf packname = STRBUF_INIT;
 	int i;
@@ -53,8 +92,14 @@ static void finish_bulk_checkin(struct bulk_checkin_state *state)
 		free(state->written[i]);
 
 clear_exit:
+	hashmap_free(&pending_objects, 1);
 	free(state->written);
 	memset(state, 0, sizeof(*state));
+	/*
+	 * A pack-size-limit rollover finishes the pack mid-transaction;
+	 * keep diverting objects until the caller really unplugs.
+	 */
+	state->plugged = plugged;
 
 	strbuf_release(&packname);
 	/* Make objects we just wrote available to ourselves */
@@ -94,7 +139,7 @@ static int already_written(struct bulk_checkin_state *state, unsigned char sha1[
  * with a new pack.
  */
 static int stream_to_pack(struct bulk_checkin_state *state,
-			  git_SHA_CTX *ctx, off_t *already_hashed_to,
+			  git_hash_ctx *ctx, off_t *already_hashed_to,
 			  int fd, size_t size, enum object_type type,
 			  const char *path, unsigned flags)
 {
@@ -125,7 +170,7 @@ static int stream_to_pack(struct bulk_checkin_state *state,
 				if (rsize < hsize)
 					hsize = rsize;
 				if (hsize)
-					git_SHA1_Update(ctx, ibuf, hsize);
+					the_hash_algo->update_fn(ctx, ibuf, hsize);
 				*already_hashed_to = offset;
 			}
 			s.next_in = ibuf;
@@ -178,7 +223,7 @@ static void prepare_to_stream(struct bulk_checkin_state *state,
 	reset_pack_idx_option(&state->pack_idx_opts);
 
 	/* Pretend we are going to write only one object */
-	state->offset = write_pack_header(state->f, 1);
+	state->offset = write_pack_header(state->f, 1, PACK_CODEC_ZLIB);
 	if (!state->offset)
 		die_errno("unable to write pack header");
 }
@@ -190,7 +235,7 @@ static int deflate_to_pack(struct bulk_checkin_state *state,
 			   unsigned flags)
 {
 	off_t seekback, already_hashed_to;
-	git_SHA_CTX ctx;
+	git_hash_ctx ctx;
 	unsigned char obuf[16384];
 	unsigned header_len;
 	struct sha1file_checkpoint checkpoint;
@@ -202,8 +247,8 @@ static int deflate_to_pack(struct bulk_checkin_state *state,
 
 	header_len = sprintf((char *)obuf, "%s %" PRIuMAX,
 			     typename(type), (uintmax_t)size) + 1;
-	git_SHA1_Init(&ctx);
-	git_SHA1_Update(&ctx, obuf, header_len);
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, obuf, header_len);
 
 	/* Note: idx is non-NULL when we are writing */
 	if ((flags & HASH_WRITE_OBJECT) != 0)
@@ -234,7 +279,7 @@ static int deflate_to_pack(struct bulk_checkin_state *state,
 		if (lseek(fd, seekback, SEEK_SET) == (off_t) -1)
 			return error("cannot seek back");
 	}
-	git_SHA1_Final(result_sha1, &ctx);
+	the_hash_algo->final_fn(result_sha1, &ctx);
 	if (!idx)
 		return 0;
 
@@ -253,6 +298,171 @@ static int deflate_to_pack(struct bulk_checkin_state *state,
 	return 0;
 }
 
+/*
+ * Deflate an in-core buffer to the packfile in state.  Like
+ * stream_to_pack(), signal a failure by returning a negative value
+ * when the resulting pack would exceed the pack size limit and this
+ * is not the first object in the pack, so that the caller can
+ * truncate the pack, open a new one and try again.
+ */
+static int deflate_buf_to_pack(struct bulk_checkin_state *state,
+			       const void *buf, unsigned long len,
+			       enum object_type type,
+			       off_t *data_offset, unsigned long *z_size)
+{
+	git_zstream s;
+	unsigned char obuf[16384];
+	unsigned hdrlen;
+	int status;
+	off_t start = state->offset;
+
+	hdrlen = encode_in_pack_object_header(type, len, obuf);
+
+	memset(&s, 0, sizeof(s));
+	git_deflate_init(&s, pack_compression_level);
+	s.next_in = (unsigned char *)buf;
+	s.avail_in = len;
+	s.next_out = obuf + hdrlen;
+	s.avail_out = sizeof(obuf) - hdrlen;
+
+	for (;;) {
+		status = git_deflate(&s, Z_FINISH);
+		if (!s.avail_out || status == Z_STREAM_END) {
+			size_t written = s.next_out - obuf;
+
+			/* would we bust the size limit? */
+			if (state->nr_written &&
+			    pack_size_limit_cfg &&
+			    pack_size_limit_cfg < state->offset + written) {
+				git_deflate_abort(&s);
+				return -1;
+			}
+
+			sha1write(state->f, obuf, written);
+			state->offset += written;
+			s.next_out = obuf;
+			s.avail_out = sizeof(obuf);
+		}
+		if (status == Z_STREAM_END)
+			break;
+		if (status != Z_OK && status != Z_BUF_ERROR)
+			die("unexpected deflate failure: %d", status);
+	}
+	git_deflate_end(&s);
+
+	*data_offset = start + hdrlen;
+	*z_size = state->offset - start - hdrlen;
+	return 0;
+}
+
+int bulk_checkin_write_object(const unsigned char *sha1, const void *buf,
+			      unsigned long len, const char *type)
+{
+	struct pending_object *obj;
+	struct pack_idx_entry *idx;
+	struct sha1file_checkpoint checkpoint;
+	off_t data_offset = 0;
+	unsigned long z_size = 0;
+	int otype;
+
+	if (!state.plugged || !loose_object_threshold ||
+	    len > loose_object_threshold)
+		return -1;
+	otype = type_from_string_gently(type, -1, 1);
+	if (otype < 0)
+		return -1; /* nonstandard types go loose as before */
+	if (already_written(&state, (unsigned char *)sha1))
+		return 0;
+
+	idx = xcalloc(1, sizeof(*idx));
+
+	while (1) {
+		prepare_to_stream(&state, HASH_WRITE_OBJECT);
+		sha1file_checkpoint(state.f, &checkpoint);
+		idx->offset = state.offset;
+		crc32_begin(state.f);
+		if (!deflate_buf_to_pack(&state, buf, len, otype,
+					 &data_offset, &z_size))
+			break;
+		/*
+		 * Writing this object to the current pack will make
+		 * it too big; truncate it, start a new pack, and
+		 * write into it.
+		 */
+		sha1file_truncate(state.f, &checkpoint);
+		state.offset = checkpoint.offset;
+		finish_bulk_checkin(&state);
+	}
+
+	idx->crc32 = crc32_end(state.f);
+	hashcpy(idx->sha1, sha1);
+	ALLOC_GROW(state.written, state.nr_written + 1, state.alloc_written);
+	state.written[state.nr_written++] = idx;
+
+	obj = xcalloc(1, sizeof(*obj));
+	hashmap_entry_init(obj, sha1hash(sha1));
+	hashcpy(obj->sha1, sha1);
+	obj->type = otype;
+	obj->size = len;
+	obj->data_offset = data_offset;
+	obj->z_size = z_size;
+	if (!pending_objects.tablesize)
+		hashmap_init(&pending_objects, pending_object_cmp, 0);
+	hashmap_add(&pending_objects, obj);
+	return 0;
+}
+
+static void *read_pending_object(struct pending_object *obj)
+{
+	git_zstream s;
+	void *zbuf, *result;
+	int status;
+
+	/*
+	 * The deflated bytes may still be sitting in the sha1file
+	 * buffer; push them out so we can read them back.
+	 */
+	sha1flush(state.f);
+
+	zbuf = xmalloc(obj->z_size);
+	if (pread_in_full(state.f->fd, zbuf, obj->z_size,
+			  obj->data_offset) != obj->z_size)
+		die_errno("unable to read back object %s from bulk-checkin pack",
+			  sha1_to_hex(obj->sha1));
+
+	result = xmallocz(obj->size);
+	memset(&s, 0, sizeof(s));
+	git_inflate_init(&s);
+	s.next_in = zbuf;
+	s.avail_in = obj->z_size;
+	s.next_out = result;
+	s.avail_out = obj->size;
+	status = git_inflate(&s, Z_FINISH);
+	git_inflate_end(&s);
+	if (status != Z_STREAM_END || s.total_out != obj->size)
+		die("object %s in bulk-checkin pack is corrupt",
+		    sha1_to_hex(obj->sha1));
+	free(zbuf);
+	return result;
+}
+
+int bulk_checkin_pending_object(const unsigned char *sha1,
+				enum object_type *type, unsigned long *size,
+				void **contents)
+{
+	struct pending_object *obj = find_pending_object(sha1);
+
+	if (!obj)
+		return 0;
+	if (type)
+		*type = obj->type;
+	if (size)
+		*size = obj->size;
+	if (contents)
+		*contents = read_pending_object(obj);
+	return 1;
+}
+
 int index_bulk_checkin(unsigned char *sha1,
 		       int fd, size_t size, enum object_type type,
 		       const char *path, unsigned flags)
@@ -264,9 +474,62 @@ int index_bulk_checkin(unsigned char *sha1,
 	return status;
 }
 
+static int deferred_object_fsyncs;
+
+int bulk_checkin_defer_fsync(int fd)
+{
+	if (fsync_object_files != FSYNC_OBJECT_FILES_BATCH || !state.plugged)
+		return 0;
+	/*
+	 * Kick off writeback now so that the single fsync at unplug
+	 * time finds as little dirty data as possible; the barrier it
+	 * creates is what makes all of these objects durable.
+	 */
+#ifdef HAVE_SYNC_FILE_RANGE
+	sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	deferred_object_fsyncs++;
+	return 1;
+}
+
+static void flush_deferred_fsyncs(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	int fd;
+
+	if (!deferred_object_fsyncs)
+		return;
+	deferred_object_fsyncs = 0;
+
+	/*
+	 * An fsync of any file on the object store's filesystem
+	 * forces the preceding object writes out of the disk cache as
+	 * well, so a scratch file gives us one flush for the whole
+	 * batch.
+	 */
+	strbuf_addf(&path, "%s/object_flush_XXXXXX", get_object_directory());
+	fd = xmkstemp(path.buf);
+	fsync_or_die(fd, "loose object flush");
+	if (close(fd))
+		die_errno("error when closing loose object flush file");
+	unlink_or_warn(path.buf);
+	strbuf_release(&path);
+}
+
 void plug_bulk_checkin(void)
 {
+	static int installed_atexit;
+
 	state.plugged = 1;
+	/*
+	 * If the command dies or forgets to unplug before exiting, we
+	 * still must not lose objects that the index or a ref may
+	 * already be referring to.
+	 */
+	if (!installed_atexit) {
+		atexit(unplug_bulk_checkin);
+		installed_atexit = 1;
+	}
 }
 
 void unplug_bulk_checkin(void)
@@ -274,4 +537,5 @@ void unplug_bulk_checkin(void)
 	state.plugged = 0;
 	if (state.f)
 		finish_bulk_checkin(&state);
+	flush_deferred_fsyncs();
 }
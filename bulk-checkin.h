@@ -8,6 +8,34 @@ extern int index_bulk_checkin(unsigned char sha1[],
 			      int fd, size_t size, enum object_type type,
 			      const char *path, unsigned flags);
 
+/*
+ * While bulk-checkin is plugged and core.looseObjectThreshold is set,
+ * divert an object that would have been written loose into the
+ * bulk-checkin packfile instead.  Returns 0 when the object has been
+ * taken care of, or a negative value when the caller should write it
+ * loose as usual.
+ */
+extern int bulk_checkin_write_object(const unsigned char *sha1,
+				     const void *buf, unsigned long len,
+				     const char *type);
+
+/*
+ * Look up an object that sits in the not-yet-installed bulk-checkin
+ * packfile.  Returns 1 (filling in any of the non-NULL out
+ * parameters) if the object is pending there, 0 otherwise.
+ */
+extern int bulk_checkin_pending_object(const unsigned char *sha1,
+				       enum object_type *type,
+				       unsigned long *size, void **contents);
+
+/*
+ * With core.fsyncObjectFiles=batch, a loose object written inside a
+ * plugged section does not need its own fsync; returns 1 if the
+ * caller may skip it, and unplug_bulk_checkin() issues one flush for
+ * the whole batch.
+ */
+extern int bulk_checkin_defer_fsync(int fd);
+
 extern void plug_bulk_checkin(void);
 extern void unplug_bulk_checkin(void);
 
@@ -3,6 +3,7 @@
 #include "tree.h"
 #include "tree-walk.h"
 #include "cache-tree.h"
+#include "narrow.h"
 
 #ifndef DEBUG
 #define DEBUG 0
@@ -146,9 +147,34 @@ static int do_invalidate_path(struct cache_tree *it, const char *path)
 	return 1;
 }
 
+/*
+ * The TREE extension is kept raw at index load time and parsed here
+ * on first use, so commands that never look at the cache tree do not
+ * pay for parsing it.
+ */
+struct cache_tree *index_cache_tree(struct index_state *istate)
+{
+	if (!istate->cache_tree && istate->cache_tree_data) {
+		istate->cache_tree = cache_tree_read(istate->cache_tree_data,
+						     istate->cache_tree_data_size);
+		free(istate->cache_tree_data);
+		istate->cache_tree_data = NULL;
+		istate->cache_tree_data_size = 0;
+	}
+	return istate->cache_tree;
+}
+
+void cache_tree_discard(struct index_state *istate)
+{
+	cache_tree_free(&istate->cache_tree);
+	free(istate->cache_tree_data);
+	istate->cache_tree_data = NULL;
+	istate->cache_tree_data_size = 0;
+}
+
 void cache_tree_invalidate_path(struct index_state *istate, const char *path)
 {
-	if (do_invalidate_path(istate->cache_tree, path))
+	if (do_invalidate_path(index_cache_tree(istate), path))
 		istate->cache_changed |= CACHE_TREE_CHANGED;
 }
 
@@ -354,7 +380,9 @@ static int update_one(struct cache_tree *it,
 			entlen = pathlen - baselen;
 			i++;
 		}
-		if (mode != S_IFGITLINK && !missing_ok && !has_sha1_file(sha1)) {
+		/* a blob-less repository fetches missing blobs on demand */
+		if (mode != S_IFGITLINK && !missing_ok &&
+		    !is_repository_blobless() && !has_sha1_file(sha1)) {
 			strbuf_release(&buffer);
 			if (expected_missing)
 				return -1;
@@ -418,7 +446,7 @@ static int update_one(struct cache_tree *it,
 
 int cache_tree_update(struct index_state *istate, int flags)
 {
-	struct cache_tree *it = istate->cache_tree;
+	struct cache_tree *it = index_cache_tree(istate);
 	struct cache_entry **cache = istate->cache;
 	int entries = istate->cache_nr;
 	int skip, i = verify_cache(cache, entries, flags);
@@ -609,9 +637,9 @@ int write_cache_as_tree(unsigned char *sha1, int flags, const char *prefix)
 	if (entries < 0)
 		return WRITE_TREE_UNREADABLE_INDEX;
 	if (flags & WRITE_TREE_IGNORE_CACHE_TREE)
-		cache_tree_free(&(active_cache_tree));
+		cache_tree_discard(&the_index);
 
-	if (!active_cache_tree)
+	if (!index_cache_tree(&the_index))
 		active_cache_tree = cache_tree();
 
 	was_valid = cache_tree_fully_valid(active_cache_tree);
@@ -674,12 +702,161 @@ static void prime_cache_tree_rec(struct cache_tree *it, struct tree *tree)
 
 void prime_cache_tree(struct index_state *istate, struct tree *tree)
 {
-	cache_tree_free(&istate->cache_tree);
+	cache_tree_discard(istate);
 	istate->cache_tree = cache_tree();
 	prime_cache_tree_rec(istate->cache_tree, tree);
 	istate->cache_changed |= CACHE_TREE_CHANGED;
 }
 
+/*
+ * Walk one level of the index together with the corresponding tree
+ * object, repairing invalid cache-tree nodes whose entries turn out
+ * to be identical to the tree by adopting the tree's SHA-1 instead
+ * of recomputing it.  "tree" may be NULL when this level has no
+ * counterpart; we then only recurse to count the entries we span.
+ *
+ * Returns the number of index entries this level covers.  "*matched"
+ * is set when the level was proven identical to "tree" and the node
+ * has been marked valid.
+ */
+static int repair_one(struct cache_tree *it,
+		      struct tree *tree,
+		      struct cache_entry **cache,
+		      int entries,
+		      const char *base,
+		      int baselen,
+		      int *matched)
+{
+	struct tree_desc desc;
+	struct name_entry entry;
+	int match = !!tree;
+	int te_valid = 0;
+	int i;
+
+	if (0 <= it->entry_count && has_sha1_file(it->sha1)) {
+		*matched = tree && !hashcmp(it->sha1, tree->object.sha1);
+		return it->entry_count;
+	}
+
+	if (tree)
+		init_tree_desc(&desc, tree->buffer, tree->size);
+	for (i = 0; i < it->subtree_nr; i++)
+		it->down[i]->used = 0;
+
+	i = 0;
+	while (i < entries) {
+		const struct cache_entry *ce = cache[i];
+		struct cache_tree_sub *sub;
+		const char *path, *slash;
+		int pathlen, entlen, found;
+
+		path = ce->name;
+		pathlen = ce_namelen(ce);
+		if (pathlen <= baselen || memcmp(base, path, baselen))
+			break; /* at the end of this level */
+
+		slash = strchr(path + baselen, '/');
+		entlen = slash ? slash - (path + baselen) : pathlen - baselen;
+
+		/*
+		 * Advance to the tree entry with this name; anything we
+		 * step over exists only in the tree, so the level does
+		 * not match, but we keep walking so that subdirectories
+		 * further down this level still find their counterparts.
+		 */
+		found = 0;
+		while (tree) {
+			int cmp;
+			if (!te_valid) {
+				if (!tree_entry(&desc, &entry))
+					break;
+				te_valid = 1;
+			}
+			cmp = base_name_compare(entry.path,
+						tree_entry_len(&entry),
+						entry.mode,
+						path + baselen, entlen,
+						slash ? S_IFDIR : ce->ce_mode);
+			if (cmp < 0) {
+				match = 0;
+				te_valid = 0;
+				continue;
+			}
+			found = !cmp;
+			break;
+		}
+		if (!found)
+			match = 0;
+
+		if (slash) {
+			struct tree *subtree = NULL;
+			int subcnt, submatch = 0;
+
+			if (found) {
+				subtree = lookup_tree(entry.sha1);
+				if (!subtree || parse_tree(subtree)) {
+					subtree = NULL;
+					match = 0;
+				}
+				te_valid = 0;
+			}
+			sub = find_subtree(it, path + baselen, entlen, 1);
+			if (!sub->cache_tree)
+				sub->cache_tree = cache_tree();
+			subcnt = repair_one(sub->cache_tree, subtree,
+					    cache + i, entries - i,
+					    path, baselen + entlen + 1,
+					    &submatch);
+			if (!submatch)
+				match = 0;
+			i += subcnt;
+			sub->used = 1;
+		}
+		else {
+			if (found) {
+				if (hashcmp(entry.sha1, ce->sha1) ||
+				    entry.mode != ce->ce_mode)
+					match = 0;
+				te_valid = 0;
+			}
+			if (ce_stage(ce) ||
+			    (ce->ce_flags & (CE_REMOVE | CE_INTENT_TO_ADD)))
+				match = 0;
+			i++;
+		}
+	}
+	if (match && (te_valid || tree_entry(&desc, &entry)))
+		match = 0; /* the tree has entries the index does not */
+
+	if (match) {
+		discard_unused_subtrees(it);
+		hashcpy(it->sha1, tree->object.sha1);
+		it->entry_count = i;
+	}
+	*matched = match;
+	return i;
+}
+
+/*
+ * Borrow tree SHA-1s from "tree" (typically what HEAD points at) for
+ * invalid cache-tree nodes whose index entries did not actually
+ * change, so that a subsequent cache_tree_update() does not rehash
+ * them.  cache_tree_invalidate_path() invalidates the whole path
+ * spine, so after a small change most invalidated subtrees still
+ * match the committed tree exactly.
+ */
+void cache_tree_repair_from_tree(struct index_state *istate, struct tree *tree)
+{
+	int matched;
+
+	if (!index_cache_tree(istate))
+		istate->cache_tree = cache_tree();
+	if (parse_tree(tree))
+		return;
+	repair_one(istate->cache_tree, tree,
+		   istate->cache, istate->cache_nr, "", 0, &matched);
+}
+
 /*
  * find the cache_tree that corresponds to the current level without
  * exploding the full path into textual form.  The root of the
@@ -714,7 +891,19 @@ int cache_tree_matches_traversal(struct cache_tree *root,
 
 int update_main_cache_tree(int flags)
 {
-	if (!the_index.cache_tree)
+	if (!index_cache_tree(&the_index))
 		the_index.cache_tree = cache_tree();
+	if (!cache_tree_fully_valid(the_index.cache_tree)) {
+		unsigned char sha1[20];
+		struct tree *tree;
+
+		/*
+		 * Before rehashing invalidated subtrees, try to borrow
+		 * them from HEAD; most of them usually did not change.
+		 */
+		if (!get_sha1("HEAD^{tree}", sha1) &&
+		    (tree = lookup_tree(sha1)) != NULL)
+			cache_tree_repair_from_tree(&the_index, tree);
+	}
 	return cache_tree_update(&the_index, flags);
 }
@@ -23,6 +23,10 @@ struct cache_tree {
 
 struct cache_tree *cache_tree(void);
 void cache_tree_free(struct cache_tree **);
+/* Return the index's cache tree, parsing the TREE extension on first use. */
+struct cache_tree *index_cache_tree(struct index_state *);
+/* Drop the index's cache tree, parsed or not. */
+void cache_tree_discard(struct index_state *);
 void cache_tree_invalidate_path(struct index_state *, const char *);
 struct cache_tree_sub *cache_tree_sub(struct cache_tree *, const char *);
 
@@ -48,6 +52,7 @@ int update_main_cache_tree(int);
 
 int write_cache_as_tree(unsigned char *sha1, int flags, const char *prefix);
 void prime_cache_tree(struct index_state *, struct tree *);
+void cache_tree_repair_from_tree(struct index_state *, struct tree *);
 
 extern int cache_tree_matches_traversal(struct cache_tree *, struct name_entry *ent, struct traverse_info *info);
 
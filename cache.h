@@ -18,9 +18,12 @@
 #define git_SHA1_Final	SHA1_Final
 #endif
 
+#include "hash.h"
+
 #include <zlib.h>
 typedef struct git_zstream {
 	z_stream z;
+	z_stream *zp; /* borrowed inflate state; see zlib.c */
 	unsigned long avail_in;
 	unsigned long avail_out;
 	unsigned long total_in;
@@ -43,12 +46,8 @@ int git_deflate_end_gently(git_zstream *);
 int git_deflate(git_zstream *, int flush);
 unsigned long git_deflate_bound(git_zstream *, unsigned long);
 
-/* The length in bytes and in hex digits of an object name (SHA-1 value). */
-#define GIT_SHA1_RAWSZ 20
-#define GIT_SHA1_HEXSZ (2 * GIT_SHA1_RAWSZ)
-
 struct object_id {
-	unsigned char hash[GIT_SHA1_RAWSZ];
+	unsigned char hash[GIT_MAX_RAWSZ];
 };
 
 #if defined(DT_UNKNOWN) && !defined(NO_D_TYPE_IN_DIRENT)
@@ -149,6 +148,13 @@ struct stat_data {
 
 struct cache_entry {
 	struct hashmap_entry ent;
+	/*
+	 * Set if the entry was carved out of the owning index_state's
+	 * entry pool; such entries are freed wholesale with the pool.
+	 * Kept before ce_stat_data so that copy_cache_entry() leaves
+	 * it alone.
+	 */
+	unsigned int pooled;
 	struct stat_data ce_stat_data;
 	unsigned int ce_mode;
 	unsigned int ce_flags;
@@ -178,6 +184,7 @@ struct cache_entry {
 #define CE_ADDED             (1 << 19)
 
 #define CE_HASHED            (1 << 20)
+#define CE_FSMONITOR_VALID   (1 << 21)
 #define CE_WT_REMOVE         (1 << 22) /* remove in work directory */
 #define CE_CONFLICTED        (1 << 23)
 
@@ -297,18 +304,36 @@ static inline unsigned int canon_mode(unsigned int mode)
 #define RESOLVE_UNDO_CHANGED	(1 << 4)
 #define CACHE_TREE_CHANGED	(1 << 5)
 #define SPLIT_INDEX_ORDERED	(1 << 6)
+#define FSMONITOR_CHANGED	(1 << 7)
+#define UNTRACKED_CHANGED	(1 << 8)
 
 struct split_index;
+struct untracked_cache;
+struct mem_pool;
 struct index_state {
 	struct cache_entry **cache;
+	struct mem_pool *entry_pool;
 	unsigned int version;
 	unsigned int cache_nr, cache_alloc, cache_changed;
 	struct string_list *resolve_undo;
 	struct cache_tree *cache_tree;
+	/*
+	 * Raw TREE and REUC extension payloads, kept unparsed until
+	 * index_cache_tree() or index_resolve_undo() is asked for
+	 * them; commands that never look at an extension never pay
+	 * for parsing it.
+	 */
+	void *cache_tree_data;
+	size_t cache_tree_data_size;
+	void *resolve_undo_data;
+	size_t resolve_undo_data_size;
 	struct split_index *split_index;
+	struct untracked_cache *untracked;
 	struct cache_time timestamp;
 	unsigned name_hash_initialized : 1,
-		 initialized : 1;
+		 initialized : 1,
+		 fsmonitor_has_run_once : 1;
+	uint64_t fsmonitor_last_update;
 	struct hashmap name_hash;
 	struct hashmap dir_hash;
 	unsigned char sha1[20];
@@ -378,6 +403,7 @@ static inline enum object_type object_type(unsigned int mode)
 
 /* Double-check local_repo_env below if you add to this list. */
 #define GIT_DIR_ENVIRONMENT "GIT_DIR"
+#define GIT_COMMON_DIR_ENVIRONMENT "GIT_COMMON_DIR"
 #define GIT_NAMESPACE_ENVIRONMENT "GIT_NAMESPACE"
 #define GIT_WORK_TREE_ENVIRONMENT "GIT_WORK_TREE"
 #define GIT_PREFIX_ENVIRONMENT "GIT_PREFIX"
@@ -431,6 +457,7 @@ extern int is_inside_git_dir(void);
 extern char *git_work_tree_cfg;
 extern int is_inside_work_tree(void);
 extern const char *get_git_dir(void);
+extern const char *get_git_common_dir(void);
 extern int is_git_directory(const char *path);
 extern char *get_object_directory(void);
 extern char *get_index_file(void);
@@ -443,6 +470,14 @@ extern const char *read_gitfile(const char *path);
 extern const char *resolve_gitdir(const char *suspect);
 extern void set_git_work_tree(const char *tree);
 
+/*
+ * Append to sb the $GIT_COMMON_DIR of the repository whose $GIT_DIR
+ * is gitdir: either the directory named by gitdir's "commondir" file
+ * (used by linked worktrees to point back at the main repository), or
+ * gitdir itself.
+ */
+extern void get_common_dir(struct strbuf *sb, const char *gitdir);
+
 #define ALTERNATE_DB_ENVIRONMENT "GIT_ALTERNATE_OBJECT_DIRECTORIES"
 
 extern const char **get_pathspec(const char *prefix, const char **pathspec);
@@ -491,6 +526,7 @@ extern int daemonize(void);
 struct lock_file;
 extern int read_index(struct index_state *);
 extern int read_index_preload(struct index_state *, const struct pathspec *pathspec);
+extern void preload_index(struct index_state *, const struct pathspec *pathspec);
 extern int do_read_index(struct index_state *istate, const char *path,
 			 int must_exist); /* for testting only! */
 extern int read_index_from(struct index_state *, const char *path);
@@ -500,6 +536,8 @@ extern int read_index_unmerged(struct index_state *);
 #define CLOSE_LOCK		(1 << 1)
 extern int write_locked_index(struct index_state *, struct lock_file *lock, unsigned flags);
 extern int discard_index(struct index_state *);
+/* Free a cache entry, unless it lives in an index_state's entry pool. */
+extern void discard_cache_entry(struct cache_entry *ce);
 extern int unmerged_index(const struct index_state *);
 extern int verify_path(const char *path);
 extern struct cache_entry *index_dir_exists(struct index_state *istate, const char *name, int namelen);
@@ -602,6 +640,10 @@ extern size_t packed_git_window_size;
 extern size_t packed_git_limit;
 extern size_t delta_base_cache_limit;
 extern unsigned long big_file_threshold;
+extern unsigned long loose_object_threshold;
+extern unsigned long tree_cache_limit;
+extern int packed_git_huge_pages;
+extern const char *object_info_server;
 extern unsigned long pack_size_limit_cfg;
 
 /*
@@ -614,9 +656,16 @@ extern unsigned long pack_size_limit_cfg;
  */
 extern int check_replace_refs;
 
+#define FSYNC_OBJECT_FILES_OFF 0
+#define FSYNC_OBJECT_FILES_ON 1
+#define FSYNC_OBJECT_FILES_BATCH 2
 extern int fsync_object_files;
+extern int log_object_times;
 extern int core_preload_index;
+extern const char *core_fsmonitor;
+extern int core_untracked_cache;
 extern int core_apply_sparse_checkout;
+extern int core_sparse_checkout_cone;
 extern int precomposed_unicode;
 extern int protect_hfs;
 extern int protect_ntfs;
@@ -676,10 +725,19 @@ extern char *notes_ref_name;
 
 extern int grafts_replace_parents;
 
+/*
+ * Repositories are created at GIT_REPO_VERSION; we also understand
+ * repositories up to GIT_REPO_VERSION_READ, provided every
+ * "extensions.*" key found in their config is one we know about.
+ */
 #define GIT_REPO_VERSION 0
+#define GIT_REPO_VERSION_READ 1
 extern int repository_format_version;
 extern int check_repository_format(void);
 
+/* The hash function the current repository names its objects with. */
+extern const struct git_hash_algo *the_hash_algo;
+
 #define MTIME_CHANGED	0x0001
 #define CTIME_CHANGED	0x0002
 #define OWNER_CHANGED	0x0004
@@ -880,6 +938,14 @@ static inline void *read_sha1_file(const unsigned char *sha1, enum object_type *
  */
 extern const unsigned char *do_lookup_replace_object(const unsigned char *sha1);
 
+/*
+ * Throw away the lazily-built replacement map, e.g. after a ref under
+ * refs/replace/ has been written in this process, so that the next
+ * lookup rebuilds it.  If the map had turned out empty (which
+ * short-circuits check_replace_refs), the check is re-enabled.
+ */
+extern void invalidate_replace_refs(void);
+
 /*
  * If object sha1 should be replaced, return the replacement object's
  * name (replaced recursively, if necessary).  The return value is
@@ -927,6 +993,22 @@ extern int has_sha1_pack(const unsigned char *sha1);
  */
 extern int has_sha1_file(const unsigned char *sha1);
 
+/*
+ * Object reads assume a single-threaded caller by default.  A command
+ * that wants several threads to read objects concurrently must call
+ * enable_obj_read_lock() before spawning them; every entry point into
+ * the object read path then serializes on an internal mutex.  The
+ * mutex is recursive, since object reads can nest, and it is released
+ * around zlib inflation (where the pack window in use is pinned and
+ * cannot be unmapped), which is where concurrent readers overlap.
+ * obj_read_lock() can also be used directly to protect short sections
+ * that touch the object database from reader threads.
+ */
+extern void enable_obj_read_lock(void);
+extern void disable_obj_read_lock(void);
+extern void obj_read_lock(void);
+extern void obj_read_unlock(void);
+
 /*
  * Return true iff an alternate object database has a loose object
  * with the specified name.  This function does not respect replace
@@ -1055,6 +1137,16 @@ extern int get_sha1_mb(const char *str, unsigned char *sha1);
  */
 extern int refname_match(const char *abbrev_name, const char *full_name);
 
+/*
+ * Call fn on each full name that abbrev_name could stand for, in the
+ * order of ref_rev_parse_rules, stopping early when fn returns a
+ * non-zero value (which is then returned).  The name passed to fn is
+ * only valid for the duration of that call.
+ */
+extern int refname_expand(const char *abbrev_name,
+			  int (*fn)(const char *full_name, void *cb_data),
+			  void *cb_data);
+
 extern int create_symref(const char *ref, const char *refs_heads_master, const char *logmsg);
 extern int validate_headref(const char *ref);
 
@@ -1144,6 +1236,16 @@ struct checkout {
 	struct index_state *istate;
 	const char *base_dir;
 	int base_dir_len;
+	/*
+	 * When clone_worktree is set, regular files whose blob would be
+	 * written out verbatim are cloned (reflinked or copied) from the
+	 * file of the same name under that directory, provided the file
+	 * is clean according to clone_worktree_index; otherwise we fall
+	 * back to reading the blob from the object store as usual.
+	 */
+	const char *clone_worktree;
+	struct index_state *clone_worktree_index;
+	struct delayed_checkout *delayed_checkout;
 	unsigned force:1,
 		 quiet:1,
 		 not_new:1,
@@ -1152,6 +1254,8 @@ struct checkout {
 
 #define TEMPORARY_FILENAME_LENGTH 25
 extern int checkout_entry(struct cache_entry *ce, const struct checkout *state, char *topath);
+extern void enable_delayed_checkout(struct checkout *state);
+extern int finish_delayed_checkout(struct checkout *state);
 
 struct cache_def {
 	struct strbuf path;
@@ -1180,6 +1284,14 @@ extern struct alternate_object_database {
 extern void prepare_alt_odb(void);
 extern void read_info_alternates(const char * relative_base, int depth);
 extern void add_to_alternates_file(const char *reference);
+
+/*
+ * Add the directory to the in-memory list of alternates (along with any
+ * recursive alternates it points to), but do not modify the on-disk alternates
+ * file.
+ */
+extern void add_to_alternates_memory(const char *reference);
+
 typedef int alt_odb_fn(struct alternate_object_database *, void *);
 extern int foreach_alt_odb(alt_odb_fn, void*);
 
@@ -1198,12 +1310,14 @@ extern struct packed_git {
 	off_t pack_size;
 	const void *index_data;
 	size_t index_size;
+	uint32_t *sha1_prefixes;
 	uint32_t num_objects;
 	uint32_t num_bad_objects;
 	unsigned char *bad_object_sha1;
 	int index_version;
 	time_t mtime;
 	int pack_fd;
+	unsigned char pack_codec;	/* enum pack_codec */
 	unsigned pack_local:1,
 		 pack_keep:1,
 		 freshened:1,
@@ -1226,6 +1340,7 @@ extern void (*report_garbage)(const char *desc, const char *path);
 
 extern void prepare_packed_git(void);
 extern void reprepare_packed_git(void);
+extern unsigned long approximate_object_count(void);
 extern void install_packed_git(struct packed_git *pack);
 
 extern struct packed_git *find_sha1_pack(const unsigned char *sha1,
@@ -1246,6 +1361,28 @@ extern int open_pack_index(struct packed_git *);
 extern void close_pack_index(struct packed_git *);
 
 extern unsigned char *use_pack(struct packed_git *, struct pack_window **, off_t, unsigned long *);
+
+/*
+ * Tell the pack window machinery how the upcoming accesses will look,
+ * so freshly mapped windows can be madvise()d accordingly.  The hint
+ * sticks until changed; callers that go sequential for a bounded span
+ * (verify-pack, the pack reuse writer) should restore
+ * PACK_ACCESS_NORMAL when they are done.
+ */
+enum pack_access_pattern {
+	PACK_ACCESS_NORMAL = 0,
+	PACK_ACCESS_SEQUENTIAL,
+	PACK_ACCESS_RANDOM
+};
+extern void set_pack_access_pattern(enum pack_access_pattern);
+
+/*
+ * Ask the OS to start paging in the given pack span, e.g. the extent
+ * of a delta chain that is about to be resolved.  Only spans already
+ * covered by open windows are touched; a no-op where madvise() is not
+ * available.
+ */
+extern void pack_window_prefetch(struct packed_git *, off_t start, off_t end);
 extern void close_pack_windows(struct packed_git *);
 extern void unuse_pack(struct pack_window **);
 extern void free_pack_by_name(const char *);
@@ -1331,6 +1468,17 @@ typedef int each_packed_object_fn(const unsigned char *sha1,
 				  uint32_t pos,
 				  void *data);
 extern int for_each_loose_object(each_loose_object_fn, void *, unsigned flags);
+
+/*
+ * The loose object count hint kept in objects/info/loose-object-count.
+ * get_loose_object_count() returns the number of loose objects written
+ * since the hint was last reset, or -1 when no hint exists and the
+ * caller has to estimate by scanning.  reset_loose_object_count()
+ * rebuilds the hint from an actual scan of the object directory; gc
+ * calls it when it is done removing things.
+ */
+extern int get_loose_object_count(void);
+extern void reset_loose_object_count(void);
 extern int for_each_packed_object(each_packed_object_fn, void *, unsigned flags);
 
 struct object_info {
@@ -1387,6 +1535,21 @@ struct git_config_source {
 	const char *blob;
 };
 
+enum config_scope {
+	CONFIG_SCOPE_UNKNOWN = 0,
+	CONFIG_SCOPE_SYSTEM,
+	CONFIG_SCOPE_GLOBAL,
+	CONFIG_SCOPE_REPO,
+	CONFIG_SCOPE_CMDLINE,
+};
+
+/*
+ * During a config callback, report where the current variable is
+ * coming from, so that dangerous settings can be ignored when they
+ * appear in the repository-level configuration.
+ */
+extern enum config_scope current_config_scope(void);
+
 typedef int (*config_fn_t)(const char *, const char *, void *);
 extern int git_default_config(const char *, const char *, void *);
 extern int git_config_from_file(config_fn_t fn, const char *, void *);
@@ -1506,10 +1669,14 @@ extern int git_config_get_bool(const char *key, int *dest);
 extern int git_config_get_bool_or_int(const char *key, int *is_bool, int *dest);
 extern int git_config_get_maybe_bool(const char *key, int *dest);
 extern int git_config_get_pathname(const char *key, const char **dest);
+extern int git_config_get_index_threads(int *dest);
+extern int git_config_get_split_index(void);
+extern int git_config_get_max_percent_split_change(void);
 
 struct key_value_info {
 	const char *filename;
 	int linenr;
+	enum config_scope scope;
 };
 
 extern NORETURN void git_die_config(const char *key, const char *err, ...) __attribute__((format(printf, 2, 3)));
@@ -1528,9 +1695,12 @@ extern void maybe_flush_or_die(FILE *, const char *);
 __attribute__((format (printf, 2, 3)))
 extern void fprintf_or_die(FILE *, const char *fmt, ...);
 extern int copy_fd(int ifd, int ofd);
+extern int write_file(const char *path, int fatal, const char *fmt, ...)
+	__attribute__((format (printf, 3, 4)));
 extern int copy_file(const char *dst, const char *src, int mode);
 extern int copy_file_with_time(const char *dst, const char *src, int mode);
 extern void write_or_die(int fd, const void *buf, size_t count);
+extern void write_or_die_iov(int fd, struct iovec *iov, int iovcnt);
 extern int write_or_whine(int fd, const void *buf, size_t count, const char *msg);
 extern int write_or_whine_pipe(int fd, const void *buf, size_t count, const char *msg);
 extern void fsync_or_die(int fd, const char *);
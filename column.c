@@ -25,6 +25,10 @@ static int item_length(unsigned int colopts, const char *s)
 	int len, i = 0;
 	struct strbuf str = STRBUF_INIT;
 
+	/* the common case: no escapes to strip */
+	if (!strstr(s, "\033["))
+		return utf8_strwidth(s);
+
 	strbuf_addstr(&str, s);
 	while ((s = strstr(str.buf + i, "\033[")) != NULL) {
 		int len = strspn(s + 2, "0123456789;");
@@ -107,19 +111,30 @@ static void shrink_columns(struct column_data *data)
 	compute_column_width(data);
 }
 
-/* Display without layout when not enabled */
+/*
+ * Display without layout when not enabled.  The whole listing is
+ * buffered and written out in one go; one stdio call per item is
+ * measurable on huge lists.
+ */
 static void display_plain(const struct string_list *list,
 			  const char *indent, const char *nl)
 {
+	struct strbuf out = STRBUF_INIT;
 	int i;
 
-	for (i = 0; i < list->nr; i++)
-		printf("%s%s%s", indent, list->items[i].string, nl);
+	for (i = 0; i < list->nr; i++) {
+		strbuf_addstr(&out, indent);
+		strbuf_addstr(&out, list->items[i].string);
+		strbuf_addstr(&out, nl);
+	}
+	fwrite(out.buf, 1, out.len, stdout);
+	strbuf_release(&out);
 }
 
-/* Print a cell to stdout with all necessary leading/traling space */
+/* Add a cell to 'out' with all necessary leading/traling space */
 static int display_cell(struct column_data *data, int initial_width,
-			const char *empty_cell, int x, int y)
+			const char *empty_cell, int x, int y,
+			struct strbuf *out)
 {
 	int i, len, newline;
 
@@ -143,10 +158,10 @@ static int display_cell(struct column_data *data, int initial_width,
 	else
 		newline = x == data->cols - 1 || i == data->list->nr - 1;
 
-	printf("%s%s%s",
-	       x == 0 ? data->opts.indent : "",
-	       data->list->items[i].string,
-	       newline ? data->opts.nl : empty_cell + len);
+	if (x == 0)
+		strbuf_addstr(out, data->opts.indent);
+	strbuf_addstr(out, data->list->items[i].string);
+	strbuf_addstr(out, newline ? data->opts.nl : empty_cell + len);
 	return 0;
 }
 
@@ -156,6 +171,7 @@ static void display_table(const struct string_list *list,
 			  const struct column_options *opts)
 {
 	struct column_data data;
+	struct strbuf out = STRBUF_INIT;
 	int x, y, i, initial_width;
 	char *empty_cell;
 
@@ -178,10 +194,13 @@ static void display_table(const struct string_list *list,
 	empty_cell[initial_width] = '\0';
 	for (y = 0; y < data.rows; y++) {
 		for (x = 0; x < data.cols; x++)
-			if (display_cell(&data, initial_width, empty_cell, x, y))
+			if (display_cell(&data, initial_width, empty_cell,
+					 x, y, &out))
 				break;
 	}
+	fwrite(out.buf, 1, out.len, stdout);
 
+	strbuf_release(&out);
 	free(data.len);
 	free(data.width);
 	free(empty_cell);
@@ -0,0 +1,418 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "commit.h"
+#include "tree.h"
+#include "refs.h"
+#include "csum-file.h"
+#include "commit-slab.h"
+#include "bloom.h"
+#include "commit-graph.h"
+
+#define GRAPH_SIGNATURE 0x43475048 /* "CGPH" */
+#define GRAPH_VERSION 2
+
+#define GRAPH_PARENT_NONE 0xffffffff
+#define GRAPH_PARENT_OCTOPUS 0xfffffffe
+
+/*
+ * Each record holds the tree sha1, the graph positions of up to two
+ * parents, the generation number and the committer date.  Commits with
+ * more than two parents are written with GRAPH_PARENT_OCTOPUS in the
+ * second slot and are parsed from the object database as usual.
+ */
+#define GRAPH_DATA_WIDTH 40
+#define GRAPH_HEADER_SIZE 12
+
+/*
+ * Version 2 appends the changed-path Bloom filters: one big-endian
+ * 32-bit cumulative end offset per commit, followed by the
+ * concatenated filter data.  A commit whose offset range is empty has
+ * no filter.  Version 1 files, which lack the section, are still read.
+ */
+static struct commit_graph {
+	void *map;
+	size_t map_size;
+	uint32_t nr_commits;
+	const unsigned char *oid_list;
+	const unsigned char *data;
+	const unsigned char *bloom_index;
+	const unsigned char *bloom_data;
+	size_t bloom_data_len;
+} commit_graph;
+
+/* -1: disabled or missing, 0: not yet tried, 1: loaded */
+static int graph_state;
+
+define_commit_slab(graph_gen_slab, uint32_t);
+static struct graph_gen_slab graph_gen;
+static int graph_gen_initialized;
+
+static uint32_t *generation_slot(const struct commit *commit)
+{
+	if (!graph_gen_initialized) {
+		init_graph_gen_slab(&graph_gen);
+		graph_gen_initialized = 1;
+	}
+	return graph_gen_slab_at(&graph_gen, commit);
+}
+
+static int graph_lookup(const unsigned char *sha1, uint32_t *pos);
+static int prepare_commit_graph(void);
+
+uint32_t commit_graph_generation(const struct commit *commit)
+{
+	uint32_t *slot = generation_slot(commit);
+	uint32_t pos;
+
+	if (*slot)
+		return *slot == GENERATION_NUMBER_INFINITY ? 0 : *slot;
+
+	/*
+	 * A commit that was parsed from the object database never had
+	 * its generation filled in; look it up in the graph file now.
+	 * Misses are remembered so repeated queries stay cheap.
+	 */
+	if (!prepare_commit_graph() ||
+	    !graph_lookup(commit->object.sha1, &pos)) {
+		*slot = GENERATION_NUMBER_INFINITY;
+		return 0;
+	}
+	*slot = get_be32(commit_graph.data +
+			 (size_t)pos * GRAPH_DATA_WIDTH + 28);
+	return *slot;
+}
+
+static int prepare_commit_graph(void)
+{
+	struct stat st;
+	int fd, use_graph = 1;
+	uint32_t hdr_version, hdr_nr;
+	size_t base_size;
+	unsigned char *data;
+
+	if (graph_state)
+		return graph_state > 0;
+	graph_state = -1;
+
+	if (!git_config_get_bool("core.commitgraph", &use_graph) && !use_graph)
+		return 0;
+
+	fd = open(git_path("objects/info/commit-graph"), O_RDONLY);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) || st.st_size < GRAPH_HEADER_SIZE + 20) {
+		close(fd);
+		return 0;
+	}
+	data = xmmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	hdr_version = get_be32(data + 4);
+	hdr_nr = get_be32(data + 8);
+	if (get_be32(data) != GRAPH_SIGNATURE ||
+	    (hdr_version != 1 && hdr_version != GRAPH_VERSION)) {
+		warning("commit-graph file has unknown format; ignoring it");
+		munmap(data, st.st_size);
+		return 0;
+	}
+
+	base_size = GRAPH_HEADER_SIZE + (size_t)hdr_nr * (20 + GRAPH_DATA_WIDTH);
+	if (hdr_version >= 2) {
+		/*
+		 * The bloom data length is taken from the last index
+		 * entry; the total file size must match it exactly.
+		 */
+		if (st.st_size >= base_size + (size_t)hdr_nr * 4 + 20) {
+			commit_graph.bloom_index = data + base_size;
+			commit_graph.bloom_data = commit_graph.bloom_index +
+						  (size_t)hdr_nr * 4;
+			commit_graph.bloom_data_len = hdr_nr ?
+				get_be32(commit_graph.bloom_index +
+					 (size_t)(hdr_nr - 1) * 4) : 0;
+		}
+		base_size += (size_t)hdr_nr * 4 + commit_graph.bloom_data_len;
+	}
+	if (st.st_size != base_size + 20) {
+		warning("commit-graph file is truncated; ignoring it");
+		munmap(data, st.st_size);
+		commit_graph.bloom_index = NULL;
+		commit_graph.bloom_data = NULL;
+		commit_graph.bloom_data_len = 0;
+		return 0;
+	}
+
+	commit_graph.map = data;
+	commit_graph.map_size = st.st_size;
+	commit_graph.nr_commits = hdr_nr;
+	commit_graph.oid_list = data + GRAPH_HEADER_SIZE;
+	commit_graph.data = commit_graph.oid_list + (size_t)hdr_nr * 20;
+	graph_state = 1;
+	return 1;
+}
+
+static int graph_lookup(const unsigned char *sha1, uint32_t *pos)
+{
+	uint32_t lo = 0, hi = commit_graph.nr_commits;
+
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(sha1, commit_graph.oid_list + (size_t)mi * 20);
+		if (!cmp) {
+			*pos = mi;
+			return 1;
+		}
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+static struct commit *commit_at_pos(uint32_t pos)
+{
+	if (pos >= commit_graph.nr_commits)
+		die("invalid parent position %"PRIu32" in commit-graph", pos);
+	return lookup_commit(commit_graph.oid_list + (size_t)pos * 20);
+}
+
+int parse_commit_in_graph(struct commit *item)
+{
+	const unsigned char *rec;
+	uint32_t pos, p1, p2;
+	struct commit_list **pptr;
+
+	if (!item || item->object.parsed)
+		return !!item->object.parsed;
+	if (!prepare_commit_graph())
+		return 0;
+	if (!graph_lookup(item->object.sha1, &pos))
+		return 0;
+
+	rec = commit_graph.data + (size_t)pos * GRAPH_DATA_WIDTH;
+	p1 = get_be32(rec + 20);
+	p2 = get_be32(rec + 24);
+	if (p2 == GRAPH_PARENT_OCTOPUS)
+		return 0;
+
+	item->tree = lookup_tree(rec);
+	item->date = ((unsigned long)get_be32(rec + 32) << 16 << 16) |
+		     get_be32(rec + 36);
+	*generation_slot(item) = get_be32(rec + 28);
+
+	pptr = &item->parents;
+	if (p1 != GRAPH_PARENT_NONE)
+		pptr = &commit_list_insert(commit_at_pos(p1), pptr)->next;
+	if (p2 != GRAPH_PARENT_NONE)
+		commit_list_insert(commit_at_pos(p2), pptr);
+
+	item->object.parsed = 1;
+	return 1;
+}
+
+int get_changed_paths_filter(const struct commit *commit,
+			     struct bloom_filter *filter)
+{
+	uint32_t pos, start = 0, end;
+
+	if (!prepare_commit_graph() || !commit_graph.bloom_index)
+		return 0;
+	if (!graph_lookup(commit->object.sha1, &pos))
+		return 0;
+
+	if (pos)
+		start = get_be32(commit_graph.bloom_index +
+				 (size_t)(pos - 1) * 4);
+	end = get_be32(commit_graph.bloom_index + (size_t)pos * 4);
+	if (end <= start || end > commit_graph.bloom_data_len)
+		return 0;
+
+	filter->data = (unsigned char *)commit_graph.bloom_data + start;
+	filter->len = end - start;
+	return 1;
+}
+
+define_commit_slab(graph_pos_slab, int);
+
+struct write_commit_graph_context {
+	struct commit **commits;
+	int nr, alloc;
+	struct graph_pos_slab pos;
+};
+
+static int add_ref_to_list(const char *refname, const unsigned char *sha1,
+			   int flags, void *cb_data)
+{
+	struct commit_list **stack = cb_data;
+	struct commit *commit = lookup_commit_reference_gently(sha1, 1);
+
+	if (commit)
+		commit_list_insert(commit, stack);
+	return 0;
+}
+
+static void close_reachable(struct write_commit_graph_context *ctx,
+			    struct commit_list **stack)
+{
+	while (*stack) {
+		struct commit_list *parent;
+		struct commit *commit = pop_commit(stack);
+		int *pos = graph_pos_slab_at(&ctx->pos, commit);
+
+		if (*pos)
+			continue;
+		if (parse_commit(commit))
+			die("unable to parse commit %s",
+			    sha1_to_hex(commit->object.sha1));
+		*pos = -1;
+		ALLOC_GROW(ctx->commits, ctx->nr + 1, ctx->alloc);
+		ctx->commits[ctx->nr++] = commit;
+		for (parent = commit->parents; parent; parent = parent->next)
+			commit_list_insert(parent->item, stack);
+	}
+}
+
+static int commit_sha1_cmp(const void *a_, const void *b_)
+{
+	const struct commit *a = *(const struct commit *const *)a_;
+	const struct commit *b = *(const struct commit *const *)b_;
+	return hashcmp(a->object.sha1, b->object.sha1);
+}
+
+static void compute_generation_numbers(struct write_commit_graph_context *ctx)
+{
+	struct commit_list *stack = NULL;
+	int i;
+
+	for (i = 0; i < ctx->nr; i++) {
+		commit_list_insert(ctx->commits[i], &stack);
+		while (stack) {
+			struct commit *commit = stack->item;
+			struct commit_list *parent;
+			uint32_t max_gen = 0;
+			int all_parents_computed = 1;
+
+			for (parent = commit->parents; parent; parent = parent->next) {
+				uint32_t gen = *generation_slot(parent->item);
+				/*
+				 * The slot records a lookup miss against
+				 * the old graph file as "infinity"; that
+				 * still means we have to compute it.
+				 */
+				if (!gen || gen == GENERATION_NUMBER_INFINITY) {
+					all_parents_computed = 0;
+					commit_list_insert(parent->item, &stack);
+					break;
+				}
+				if (gen > max_gen)
+					max_gen = gen;
+			}
+			if (all_parents_computed) {
+				pop_commit(&stack);
+				if (max_gen >= GENERATION_NUMBER_MAX)
+					max_gen = GENERATION_NUMBER_MAX - 1;
+				*generation_slot(commit) = max_gen + 1;
+			}
+		}
+	}
+}
+
+static uint32_t parent_graph_pos(struct write_commit_graph_context *ctx,
+				 struct commit *parent)
+{
+	int pos = *graph_pos_slab_at(&ctx->pos, parent);
+	if (pos <= 0)
+		die("BUG: commit-graph parent %s not in commit list",
+		    sha1_to_hex(parent->object.sha1));
+	return pos - 1;
+}
+
+static void write_graph_record(struct sha1file *f,
+			       struct write_commit_graph_context *ctx,
+			       struct commit *commit)
+{
+	struct commit_list *parent = commit->parents;
+	unsigned char buf[GRAPH_DATA_WIDTH - 20];
+	uint32_t p1 = GRAPH_PARENT_NONE, p2 = GRAPH_PARENT_NONE;
+
+	if (parent) {
+		p1 = parent_graph_pos(ctx, parent->item);
+		parent = parent->next;
+	}
+	if (parent) {
+		p2 = parent_graph_pos(ctx, parent->item);
+		if (parent->next)
+			p2 = GRAPH_PARENT_OCTOPUS;
+	}
+
+	sha1write(f, commit->tree->object.sha1, 20);
+	put_be32(buf, p1);
+	put_be32(buf + 4, p2);
+	put_be32(buf + 8, *generation_slot(commit));
+	put_be32(buf + 12, (uint32_t)(commit->date >> 16 >> 16));
+	put_be32(buf + 16, (uint32_t)commit->date);
+	sha1write(f, buf, sizeof(buf));
+}
+
+void write_commit_graph(const char *obj_dir)
+{
+	struct write_commit_graph_context ctx;
+	struct commit_list *stack = NULL;
+	static struct lock_file lk;
+	struct strbuf path = STRBUF_INIT;
+	struct sha1file *f;
+	struct bloom_filter *filters;
+	uint32_t filter_offset = 0;
+	unsigned char buf[GRAPH_HEADER_SIZE];
+	int fd, i;
+
+	memset(&ctx, 0, sizeof(ctx));
+	init_graph_pos_slab(&ctx.pos);
+
+	for_each_ref(add_ref_to_list, &stack);
+	close_reachable(&ctx, &stack);
+	qsort(ctx.commits, ctx.nr, sizeof(*ctx.commits), commit_sha1_cmp);
+	for (i = 0; i < ctx.nr; i++)
+		*graph_pos_slab_at(&ctx.pos, ctx.commits[i]) = i + 1;
+	compute_generation_numbers(&ctx);
+
+	filters = xcalloc(ctx.nr ? ctx.nr : 1, sizeof(*filters));
+	for (i = 0; i < ctx.nr; i++)
+		compute_changed_paths_filter(ctx.commits[i], &filters[i]);
+
+	strbuf_addf(&path, "%s/info", obj_dir);
+	if (mkdir(path.buf, 0777) < 0 && errno != EEXIST)
+		die_errno("unable to create directory %s", path.buf);
+	strbuf_addstr(&path, "/commit-graph");
+
+	fd = hold_lock_file_for_update(&lk, path.buf, LOCK_DIE_ON_ERROR);
+	f = sha1fd(xdup(fd), path.buf);
+
+	put_be32(buf, GRAPH_SIGNATURE);
+	put_be32(buf + 4, GRAPH_VERSION);
+	put_be32(buf + 8, ctx.nr);
+	sha1write(f, buf, sizeof(buf));
+	for (i = 0; i < ctx.nr; i++)
+		sha1write(f, ctx.commits[i]->object.sha1, 20);
+	for (i = 0; i < ctx.nr; i++)
+		write_graph_record(f, &ctx, ctx.commits[i]);
+	for (i = 0; i < ctx.nr; i++) {
+		filter_offset += filters[i].len;
+		put_be32(buf, filter_offset);
+		sha1write(f, buf, 4);
+	}
+	for (i = 0; i < ctx.nr; i++) {
+		if (filters[i].len)
+			sha1write(f, filters[i].data, filters[i].len);
+		free(filters[i].data);
+	}
+	free(filters);
+	sha1close(f, NULL, CSUM_CLOSE | CSUM_FSYNC);
+
+	if (commit_lock_file(&lk))
+		die_errno("unable to write commit-graph file");
+
+	clear_graph_pos_slab(&ctx.pos);
+	free(ctx.commits);
+	strbuf_release(&path);
+}
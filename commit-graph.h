@@ -0,0 +1,45 @@
+#ifndef COMMIT_GRAPH_H
+#define COMMIT_GRAPH_H
+
+struct bloom_filter;
+struct commit;
+
+/*
+ * Generation numbers stored in the graph file are capped at
+ * GENERATION_NUMBER_MAX.  A commit that is not covered by the file has
+ * no known generation; walks that need a number for it must assume
+ * GENERATION_NUMBER_INFINITY, since it may sit above anything covered.
+ */
+#define GENERATION_NUMBER_MAX 0x3fffffff
+#define GENERATION_NUMBER_INFINITY 0xffffffff
+
+/*
+ * Fill in the parents, tree and committer date of "item" from the
+ * serialized commit graph, if one exists and covers the commit.
+ * Returns non-zero (and marks the object parsed) on success, zero if
+ * the caller must fall back to reading the commit object itself.
+ */
+int parse_commit_in_graph(struct commit *item);
+
+/*
+ * Generation number of a commit loaded from the graph file, or zero
+ * if the commit is not covered by it.  Root commits have generation 1.
+ */
+uint32_t commit_graph_generation(const struct commit *commit);
+
+/*
+ * Point "filter" at the changed-path Bloom filter stored in the graph
+ * file for "commit".  Returns zero if there is no graph, the graph
+ * predates filters, or no filter was recorded for the commit; the
+ * filter data borrows the mmap'd graph and must not be freed.
+ */
+int get_changed_paths_filter(const struct commit *commit,
+			     struct bloom_filter *filter);
+
+/*
+ * Write $GIT_OBJECT_DIRECTORY/info/commit-graph covering every commit
+ * reachable from the current refs.  Dies on write errors.
+ */
+void write_commit_graph(const char *obj_dir);
+
+#endif /* COMMIT_GRAPH_H */
@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "tag.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "pkt-line.h"
 #include "utf8.h"
 #include "diff.h"
@@ -8,6 +9,7 @@
 #include "notes.h"
 #include "gpg-interface.h"
 #include "mergesort.h"
+#include "string-list.h"
 #include "commit-slab.h"
 #include "prio-queue.h"
 #include "sha1-lookup.h"
@@ -368,6 +370,8 @@ int parse_commit(struct commit *item)
 		return -1;
 	if (item->object.parsed)
 		return 0;
+	if (parse_commit_in_graph(item))
+		return 0;
 	buffer = read_sha1_file(item->object.sha1, &type, &size);
 	if (!buffer)
 		return error("Could not read %s",
@@ -762,6 +766,31 @@ void sort_in_topological_order(struct commit_list **list, enum rev_sort_order so
 
 static const unsigned all_flags = (PARENT1 | PARENT2 | STALE | RESULT);
 
+/*
+ * Generation number to use in cutoff computations; a commit that the
+ * graph file does not cover may sit above anything it does cover.
+ */
+static uint32_t generation_number(const struct commit *commit)
+{
+	uint32_t generation = commit_graph_generation(commit);
+	return generation ? generation : GENERATION_NUMBER_INFINITY;
+}
+
+static int compare_commits_by_gen_then_commit_date(const void *a_,
+						   const void *b_, void *unused)
+{
+	const struct commit *a = a_, *b = b_;
+	uint32_t gen_a = generation_number(a);
+	uint32_t gen_b = generation_number(b);
+
+	/* older generations last, as with the date comparison */
+	if (gen_a < gen_b)
+		return 1;
+	else if (gen_a > gen_b)
+		return -1;
+	return compare_commits_by_commit_date(a_, b_, unused);
+}
+
 static int queue_has_nonstale(struct prio_queue *queue)
 {
 	int i;
@@ -773,10 +802,17 @@ static int queue_has_nonstale(struct prio_queue *queue)
 	return 0;
 }
 
-/* all input commits in one and twos[] must have been parsed! */
-static struct commit_list *paint_down_to_common(struct commit *one, int n, struct commit **twos)
+/*
+ * All input commits in one and twos[] must have been parsed!
+ *
+ * Commits below "min_generation" are not explored; pass zero when the
+ * full paint is needed.
+ */
+static struct commit_list *paint_down_to_common(struct commit *one, int n,
+						struct commit **twos,
+						uint32_t min_generation)
 {
-	struct prio_queue queue = { compare_commits_by_commit_date };
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
 	struct commit_list *result = NULL;
 	int i;
 
@@ -797,6 +833,14 @@ static struct commit_list *paint_down_to_common(struct commit *one, int n, struc
 		struct commit_list *parents;
 		int flags;
 
+		/*
+		 * The queue hands commits out in order of decreasing
+		 * generation, so once we dip below the cutoff nothing
+		 * the caller cares about is left to be painted.
+		 */
+		if (min_generation && generation_number(commit) < min_generation)
+			break;
+
 		flags = commit->object.flags & (PARENT1 | PARENT2 | STALE);
 		if (flags == (PARENT1 | PARENT2)) {
 			if (!(commit->object.flags & RESULT)) {
@@ -823,6 +867,95 @@ static struct commit_list *paint_down_to_common(struct commit *one, int n, struc
 	return result;
 }
 
+/*
+ * Count the commits reachable from only one of the two tips by
+ * painting PARENT1/PARENT2 down the history, the same way
+ * paint_down_to_common() does.  Commits are handed out in order of
+ * decreasing generation, so by the time one is taken off the queue
+ * its flags are final and it can be counted right away; once both
+ * flags meet the commit and everything below it is common and the
+ * walk goes stale.
+ */
+/*
+ * Without generation numbers the queue degrades to commit-date order,
+ * and skewed clocks can hand us a common ancestor before the paint
+ * from both tips has reached it.  Like limit_list() in revision.c, we
+ * keep walking for a few extra rounds once everything in the queue
+ * looks finished, so that late paint can still correct the flags.
+ */
+#define COUNT_SLOP 5
+
+void count_commit_ahead_behind(struct commit *ours, struct commit *theirs,
+			       int *num_ours, int *num_theirs)
+{
+	struct prio_queue queue = { compare_commits_by_gen_then_commit_date };
+	struct commit_list *seen = NULL, *s;
+	int slop = COUNT_SLOP;
+
+	*num_ours = *num_theirs = 0;
+	if (ours == theirs)
+		return;
+	if (parse_commit(ours) || parse_commit(theirs))
+		return;
+
+	ours->object.flags |= PARENT1;
+	theirs->object.flags |= PARENT2;
+	prio_queue_put(&queue, ours);
+	prio_queue_put(&queue, theirs);
+
+	while (queue.nr) {
+		struct commit *commit;
+		struct commit_list *parents;
+		int flags;
+
+		if (queue_has_nonstale(&queue))
+			slop = COUNT_SLOP;
+		else if (slop-- <= 0)
+			break;
+
+		commit = prio_queue_get(&queue);
+		flags = commit->object.flags & (PARENT1 | PARENT2 | STALE);
+		if ((flags & (PARENT1 | PARENT2)) == (PARENT1 | PARENT2)) {
+			commit->object.flags |= STALE;
+			flags |= STALE;
+		}
+		if (!(commit->object.flags & RESULT)) {
+			commit->object.flags |= RESULT;
+			commit_list_insert(commit, &seen);
+		}
+
+		for (parents = commit->parents; parents; parents = parents->next) {
+			struct commit *p = parents->item;
+
+			if ((p->object.flags & flags) == flags)
+				continue;
+			if (parse_commit(p))
+				continue;
+			p->object.flags |= flags;
+			prio_queue_put(&queue, p);
+		}
+	}
+
+	/*
+	 * Count from the final flags only; a commit may have been
+	 * popped while painted from one side and repainted from the
+	 * other later.
+	 */
+	for (s = seen; s; s = s->next) {
+		int flags = s->item->object.flags & (PARENT1 | PARENT2);
+
+		if (flags == PARENT1)
+			(*num_ours)++;
+		else if (flags == PARENT2)
+			(*num_theirs)++;
+	}
+
+	free_commit_list(seen);
+	clear_prio_queue(&queue);
+	clear_commit_marks(ours, all_flags);
+	clear_commit_marks(theirs, all_flags);
+}
+
 static struct commit_list *merge_bases_many(struct commit *one, int n, struct commit **twos)
 {
 	struct commit_list *list = NULL;
@@ -845,7 +978,7 @@ static struct commit_list *merge_bases_many(struct commit *one, int n, struct co
 			return NULL;
 	}
 
-	list = paint_down_to_common(one, n, twos);
+	list = paint_down_to_common(one, n, twos, 0);
 
 	while (list) {
 		struct commit_list *next = list->next;
@@ -906,15 +1039,23 @@ static int remove_redundant(struct commit **array, int cnt)
 	for (i = 0; i < cnt; i++) {
 		struct commit_list *common;
 
+		uint32_t min_generation;
+
 		if (redundant[i])
 			continue;
+		min_generation = commit_graph_generation(array[i]);
 		for (j = filled = 0; j < cnt; j++) {
+			uint32_t generation;
 			if (i == j || redundant[j])
 				continue;
 			filled_index[filled] = j;
 			work[filled++] = array[j];
+			generation = commit_graph_generation(array[j]);
+			if (generation < min_generation)
+				min_generation = generation;
 		}
-		common = paint_down_to_common(array[i], filled, work);
+		common = paint_down_to_common(array[i], filled, work,
+					      min_generation);
 		if (array[i]->object.flags & PARENT2)
 			redundant[i] = 1;
 		for (j = 0; j < filled; j++)
@@ -1018,6 +1159,143 @@ int is_descendant_of(struct commit *commit, struct commit_list *with_commit)
 	return 0;
 }
 
+static int in_commit_list(const struct commit_list *want, struct commit *c)
+{
+	for (; want; want = want->next)
+		if (!hashcmp(want->item->object.sha1, c->object.sha1))
+			return 1;
+	return 0;
+}
+
+/*
+ * The contains cache remembers, per commit, whether a previous query
+ * found a "want" commit among its ancestors.  Zero means the question
+ * has not been answered yet, so that a freshly allocated slab slice
+ * starts out all-unknown.
+ */
+enum contains_result {
+	CONTAINS_UNKNOWN = 0,
+	CONTAINS_NO,
+	CONTAINS_YES
+};
+
+define_commit_slab(contains_cache, char);
+
+static struct contains_cache contains_cache;
+static int contains_cache_ready;
+
+/*
+ * Test whether the candidate or one of its parents is contained in the
+ * list.  Do not recurse to find out, though, but return "unknown" if
+ * inconclusive.
+ */
+static enum contains_result contains_test(struct commit *candidate,
+					  const struct commit_list *want)
+{
+	char *cached = contains_cache_at(&contains_cache, candidate);
+
+	/* If we already have the answer cached, return that. */
+	if (*cached)
+		return *cached;
+
+	/* or are we it? */
+	if (in_commit_list(want, candidate)) {
+		*cached = CONTAINS_YES;
+		return CONTAINS_YES;
+	}
+
+	/* Otherwise, we don't know; prepare to recurse */
+	if (parse_commit(candidate) < 0)
+		return CONTAINS_NO;
+	return CONTAINS_UNKNOWN;
+}
+
+/*
+ * Mimicking the real stack, this stack lives on the heap, avoiding stack
+ * overflows.
+ *
+ * At each recursion step, the stack items points to the commits whose
+ * ancestors are to be inspected.
+ */
+struct contains_stack {
+	int nr, alloc;
+	struct contains_stack_entry {
+		struct commit *commit;
+		struct commit_list *parents;
+	} *contains_stack;
+};
+
+static void push_to_contains_stack(struct commit *candidate,
+				   struct contains_stack *contains_stack)
+{
+	int index = contains_stack->nr++;
+	ALLOC_GROW(contains_stack->contains_stack, contains_stack->nr,
+		   contains_stack->alloc);
+	contains_stack->contains_stack[index].commit = candidate;
+	contains_stack->contains_stack[index].parents = candidate->parents;
+}
+
+static enum contains_result contains(struct commit *candidate,
+				     const struct commit_list *want)
+{
+	struct contains_stack contains_stack = { 0, 0, NULL };
+	enum contains_result result = contains_test(candidate, want);
+
+	if (result != CONTAINS_UNKNOWN)
+		return result;
+
+	push_to_contains_stack(candidate, &contains_stack);
+	while (contains_stack.nr) {
+		struct contains_stack_entry *entry = &contains_stack.contains_stack[contains_stack.nr - 1];
+		struct commit *commit = entry->commit;
+		struct commit_list *parents = entry->parents;
+
+		if (!parents) {
+			*contains_cache_at(&contains_cache, commit) = CONTAINS_NO;
+			contains_stack.nr--;
+		}
+		/*
+		 * If we just popped the stack, parents->item has been marked,
+		 * therefore contains_test will return a meaningful yes/no.
+		 */
+		else switch (contains_test(parents->item, want)) {
+		case CONTAINS_YES:
+			*contains_cache_at(&contains_cache, commit) = CONTAINS_YES;
+			contains_stack.nr--;
+			break;
+		case CONTAINS_NO:
+			entry->parents = parents->next;
+			break;
+		case CONTAINS_UNKNOWN:
+			push_to_contains_stack(parents->item, &contains_stack);
+			break;
+		}
+	}
+	free(contains_stack.contains_stack);
+	return contains_test(candidate, want);
+}
+
+/*
+ * Is "commit" a descendant of one of the elements on the "with_commit"
+ * list?
+ *
+ * Unlike is_descendant_of(), the answer for every commit visited on the
+ * way is cached across calls, so asking the same question about many
+ * commits (e.g. every ref tip) walks each part of the history at most
+ * once.  The cache assumes "with_commit" stays the same for the life of
+ * the process.
+ */
+int commit_contains(struct commit *commit, const struct commit_list *with_commit)
+{
+	if (!with_commit)
+		return 1;
+	if (!contains_cache_ready) {
+		init_contains_cache(&contains_cache);
+		contains_cache_ready = 1;
+	}
+	return contains(commit, with_commit) == CONTAINS_YES;
+}
+
 /*
  * Is "commit" an ancestor of one of the "references"?
  */
@@ -1025,14 +1303,29 @@ int in_merge_bases_many(struct commit *commit, int nr_reference, struct commit *
 {
 	struct commit_list *bases;
 	int ret = 0, i;
+	uint32_t generation, max_generation = 0;
 
 	if (parse_commit(commit))
 		return ret;
-	for (i = 0; i < nr_reference; i++)
+	for (i = 0; i < nr_reference; i++) {
 		if (parse_commit(reference[i]))
 			return ret;
+		generation = generation_number(reference[i]);
+		if (generation > max_generation)
+			max_generation = generation;
+	}
 
-	bases = paint_down_to_common(commit, nr_reference, reference);
+	/*
+	 * An ancestor can never have a higher generation number than
+	 * its descendants, so with a graph file there is often no need
+	 * to walk at all.
+	 */
+	generation = commit_graph_generation(commit);
+	if (generation > max_generation)
+		return ret;
+
+	bases = paint_down_to_common(commit, nr_reference, reference,
+				     generation);
 	if (commit->object.flags & PARENT2)
 		ret = 1;
 	clear_commit_marks(commit, all_flags);
@@ -1231,6 +1524,107 @@ free_return:
 	free(buf);
 }
 
+/*
+ * Cache of past "gpg --verify" outcomes for commit objects, enabled
+ * by gpg.verifyCache.  A commit's payload and embedded signature are
+ * immutable, so a recorded outcome can only go stale when the gpg
+ * keyring or trust settings change -- which is why the cache is
+ * opt-in.  Each line of .git/info/signature-cache holds
+ * "<sha1> <result> <key> <signer>", with "-" standing in for a
+ * missing key or signer.  Only the parsed outcome is cached; the raw
+ * gpg output (e.g. for the %GG format placeholder) is not.
+ */
+static struct string_list sig_cache = STRING_LIST_INIT_DUP;
+static int sig_cache_enabled = -1;
+
+static int use_signature_cache(void)
+{
+	if (sig_cache_enabled < 0) {
+		int val;
+		sig_cache_enabled = !git_config_get_bool("gpg.verifycache",
+							 &val) && val;
+	}
+	return sig_cache_enabled;
+}
+
+static void load_signature_cache(void)
+{
+	static int loaded;
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+
+	if (loaded)
+		return;
+	loaded = 1;
+	fp = fopen(git_path("info/signature-cache"), "r");
+	if (!fp)
+		return;
+	while (strbuf_getline(&line, fp, '\n') != EOF) {
+		if (line.len < 42 || line.buf[40] != ' ')
+			continue;
+		line.buf[40] = '\0';
+		string_list_append(&sig_cache, line.buf)->util =
+			xstrdup(line.buf + 41);
+	}
+	fclose(fp);
+	string_list_sort(&sig_cache);
+	strbuf_release(&line);
+}
+
+static int signature_cache_get(const unsigned char *sha1,
+			       struct signature_check *sigc)
+{
+	struct string_list_item *item;
+	const char *val, *key, *signer;
+
+	item = string_list_lookup(&sig_cache, sha1_to_hex(sha1));
+	if (!item)
+		return 0;
+	val = item->util;
+	if (!val[0] || val[1] != ' ')
+		return 0;
+	key = val + 2;
+	signer = strchr(key, ' ');
+	if (!signer)
+		return 0;
+	sigc->result = val[0];
+	if (signer - key != 1 || key[0] != '-')
+		sigc->key = xmemdupz(key, signer - key);
+	signer++;
+	if (strcmp(signer, "-"))
+		sigc->signer = xstrdup(signer);
+	return 1;
+}
+
+static void signature_cache_add(const unsigned char *sha1,
+				const struct signature_check *sigc)
+{
+	struct strbuf line = STRBUF_INIT;
+	int fd;
+
+	if (sigc->result != 'G' && sigc->result != 'B' && sigc->result != 'U')
+		return;
+	if (sigc->signer && strpbrk(sigc->signer, "\n\r"))
+		return;
+	strbuf_addf(&line, "%c %s %s", sigc->result,
+		    sigc->key ? sigc->key : "-",
+		    sigc->signer ? sigc->signer : "-");
+	string_list_insert(&sig_cache, sha1_to_hex(sha1))->util =
+		xstrdup(line.buf);
+
+	/* best effort; concurrent appenders at worst duplicate a line */
+	fd = open(git_path("info/signature-cache"),
+		  O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd >= 0) {
+		struct strbuf out = STRBUF_INIT;
+		strbuf_addf(&out, "%s %s\n", sha1_to_hex(sha1), line.buf);
+		write_in_full(fd, out.buf, out.len);
+		close(fd);
+		strbuf_release(&out);
+	}
+	strbuf_release(&line);
+}
+
 void check_commit_signature(const struct commit *commit, struct signature_check *sigc)
 {
 	struct strbuf payload = STRBUF_INIT;
@@ -1241,6 +1635,12 @@ void check_commit_signature(const struct commit *commit, struct signature_check
 
 	sigc->result = 'N';
 
+	if (use_signature_cache()) {
+		load_signature_cache();
+		if (signature_cache_get(commit->object.sha1, sigc))
+			goto out;
+	}
+
 	if (parse_signed_commit(commit, &payload, &signature) <= 0)
 		goto out;
 	status = verify_signed_buffer(payload.buf, payload.len,
@@ -1252,6 +1652,8 @@ void check_commit_signature(const struct commit *commit, struct signature_check
 	sigc->gpg_output = strbuf_detach(&gpg_output, NULL);
 	sigc->gpg_status = strbuf_detach(&gpg_status, NULL);
 	parse_gpg_output(sigc);
+	if (use_signature_cache())
+		signature_cache_add(commit->object.sha1, sigc);
 
  out:
 	strbuf_release(&gpg_status);
@@ -203,6 +203,8 @@ struct commit *pop_most_recent_commit(struct commit_list **list,
 struct commit *pop_commit(struct commit_list **stack);
 
 void clear_commit_marks(struct commit *commit, unsigned int mark);
+void count_commit_ahead_behind(struct commit *ours, struct commit *theirs,
+			       int *num_ours, int *num_theirs);
 void clear_commit_marks_many(int nr, struct commit **commit, unsigned int mark);
 void clear_commit_marks_for_object_array(struct object_array *a, unsigned mark);
 
@@ -254,6 +256,10 @@ extern int for_each_commit_graft(each_commit_graft_fn, void *);
 extern int is_repository_shallow(void);
 extern struct commit_list *get_shallow_commits(struct object_array *heads,
 		int depth, int shallow_flag, int not_shallow_flag);
+extern struct commit_list *get_cached_shallow_commits(struct object_array *heads,
+		int depth, int shallow_flag);
+extern void cache_shallow_commits(struct object_array *heads, int depth,
+		const struct commit_list *result, int not_shallow_flag);
 extern void set_alternate_shallow_file(const char *path, int override);
 extern int write_shallow_commits(struct strbuf *out, int use_pack_protocol,
 				 const struct sha1_array *extra);
@@ -261,7 +267,8 @@ extern void setup_alternate_shallow(struct lock_file *shallow_lock,
 				    const char **alternate_shallow_file,
 				    const struct sha1_array *extra);
 extern const char *setup_temporary_shallow(const struct sha1_array *extra);
-extern void advertise_shallow_grafts(int);
+struct packet_writer;
+extern void advertise_shallow_grafts(struct packet_writer *);
 
 struct shallow_info {
 	struct sha1_array *shallow;
@@ -289,6 +296,7 @@ extern void prune_shallow(int show_only);
 extern struct trace_key trace_shallow;
 
 int is_descendant_of(struct commit *, struct commit_list *);
+int commit_contains(struct commit *, const struct commit_list *);
 int in_merge_bases(struct commit *, struct commit *);
 int in_merge_bases_many(struct commit *, int, struct commit **);
 
@@ -0,0 +1,17 @@
+#include "../git-compat-util.h"
+
+ssize_t gitwritev(int fd, const struct iovec *iov, int iovcnt)
+{
+	ssize_t total = 0;
+	int i;
+
+	for (i = 0; i < iovcnt; i++) {
+		ssize_t cnt = write(fd, iov[i].iov_base, iov[i].iov_len);
+		if (cnt < 0)
+			return total ? total : -1;
+		total += cnt;
+		if (cnt < iov[i].iov_len)
+			break;
+	}
+	return total;
+}
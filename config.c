@@ -39,6 +39,22 @@ struct config_source {
 
 static struct config_source *cf;
 
+/*
+ * Where the current variable comes from: tracked while the files are
+ * being parsed, and remembered per value in the configset so that
+ * callbacks iterating an already loaded configset see it too.
+ */
+static enum config_scope current_parsing_scope;
+static const struct key_value_info *current_config_kvi;
+
+enum config_scope current_config_scope(void)
+{
+	if (current_config_kvi)
+		return current_config_kvi->scope;
+	else
+		return current_parsing_scope;
+}
+
 static int zlib_compression_seen;
 
 /*
@@ -790,11 +806,29 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.looseobjectthreshold")) {
+		loose_object_threshold = git_config_ulong(var, value);
+		return 0;
+	}
+
+	if (!strcmp(var, "core.packedgithugepages")) {
+		packed_git_huge_pages = git_config_bool(var, value);
+		return 0;
+	}
+
+	if (!strcmp(var, "core.objectinfoserver"))
+		return git_config_pathname(&object_info_server, var, value);
+
 	if (!strcmp(var, "core.packedgitlimit")) {
 		packed_git_limit = git_config_ulong(var, value);
 		return 0;
 	}
 
+	if (!strcmp(var, "core.treecachelimit")) {
+		tree_cache_limit = git_config_ulong(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.deltabasecachelimit")) {
 		delta_base_cache_limit = git_config_ulong(var, value);
 		return 0;
@@ -872,7 +906,19 @@ static int git_default_core_config(const char *var, const char *value)
 	}
 
 	if (!strcmp(var, "core.fsyncobjectfiles")) {
-		fsync_object_files = git_config_bool(var, value);
+		int is_bool = git_config_maybe_bool(var, value);
+		if (0 <= is_bool)
+			fsync_object_files = is_bool;
+		else if (value && !strcasecmp(value, "batch"))
+			fsync_object_files = FSYNC_OBJECT_FILES_BATCH;
+		else
+			die("bad config value '%s' for variable '%s'",
+			    value ? value : "", var);
+		return 0;
+	}
+
+	if (!strcmp(var, "core.logobjecttimes")) {
+		log_object_times = git_config_bool(var, value);
 		return 0;
 	}
 
@@ -881,6 +927,14 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.fsmonitor"))
+		return git_config_pathname(&core_fsmonitor, var, value);
+
+	if (!strcmp(var, "core.untrackedcache")) {
+		core_untracked_cache = git_config_bool(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.createobject")) {
 		if (!strcmp(value, "rename"))
 			object_creation_mode = OBJECT_CREATION_USES_RENAMES;
@@ -896,6 +950,11 @@ static int git_default_core_config(const char *var, const char *value)
 		return 0;
 	}
 
+	if (!strcmp(var, "core.sparsecheckoutcone")) {
+		core_sparse_checkout_cone = git_config_bool(var, value);
+		return 0;
+	}
+
 	if (!strcmp(var, "core.precomposeunicode")) {
 		precomposed_unicode = git_config_bool(var, value);
 		return 0;
@@ -1060,6 +1119,253 @@ static int do_config_from(struct config_source *top, config_fn_t fn, void *data)
 	return ret;
 }
 
+
+/*
+ * Binary pre-parsed config cache.  Parsing a config file goes through
+ * the character-at-a-time lexer on every invocation of every git
+ * command; for a large system config that adds up.  After a full
+ * successful parse we drop the ordered key/value list into a cache
+ * file and later invocations replay it straight into the callback,
+ * skipping the lexer.
+ *
+ * Cache files live only in the directory named by
+ * $GIT_CONFIG_CACHE_DIR, keyed by a hash of the config file's path;
+ * when the variable is unset nothing is written or read.  Dropping a
+ * file next to its source was tried first and is a trap: a worktree
+ * .gitmodules would grow an untracked sibling, and repository
+ * comparisons (and backups) see byte churn in $GIT_DIR for what is
+ * only ever a parse shortcut.
+ *
+ * The cache is advisory: it is validated against the size and mtime
+ * of the source file, must itself be strictly newer than the source
+ * (a cache written in the same second as a config modification cannot
+ * be proven fresh), and any structural doubt makes the reader fall
+ * back to the real parser, which rewrites it.  The file never leaves
+ * the machine, so fields are stored in native byte order.
+ */
+static int store_aux(const char *key, const char *value, void *cb);
+
+#define CONFIG_CACHE_SIGNATURE 0x47434643	/* "GCFC" */
+#define CONFIG_CACHE_VERSION 1
+
+struct config_cache_header {
+	uint32_t signature;
+	uint32_t version;
+	uint32_t nr;
+	uint32_t pad;
+	uint64_t src_size;
+	uint64_t src_mtime;
+};
+
+/*
+ * Each entry is a 32-bit line number, key length and value length
+ * followed by the NUL-terminated key and value; a value length of
+ * 0xffffffff marks a valueless (boolean) key with no value bytes.
+ */
+struct config_cache_collect {
+	config_fn_t fn;
+	void *data;
+	struct strbuf entries;
+	uint32_t nr;
+};
+
+static int config_cache_collect_fn(const char *key, const char *value,
+				   void *cb)
+{
+	struct config_cache_collect *collect = cb;
+	uint32_t linenr = cf->linenr;
+	uint32_t keylen = strlen(key);
+	uint32_t vallen = value ? strlen(value) : 0xffffffff;
+
+	strbuf_add(&collect->entries, &linenr, 4);
+	strbuf_add(&collect->entries, &keylen, 4);
+	strbuf_add(&collect->entries, &vallen, 4);
+	strbuf_add(&collect->entries, key, keylen + 1);
+	if (value)
+		strbuf_add(&collect->entries, value, vallen + 1);
+	collect->nr++;
+
+	return collect->fn(key, value, collect->data);
+}
+
+/*
+ * Where the cache for the given config file lives, or NULL when
+ * caching is not enabled.  The name is a hash of the file's canonical
+ * path, so every config file on the system gets its own slot in the
+ * one cache directory.
+ */
+static char *config_cache_path(const char *filename)
+{
+	const char *cache_dir = getenv("GIT_CONFIG_CACHE_DIR");
+	const char *real;
+	git_SHA_CTX ctx;
+	unsigned char hash[20];
+
+	if (!cache_dir || !*cache_dir)
+		return NULL;
+	real = real_path_if_valid(filename);
+	if (!real)
+		return NULL;
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, real, strlen(real));
+	git_SHA1_Final(hash, &ctx);
+	return xstrfmt("%s/%s.cache", cache_dir, sha1_to_hex(hash));
+}
+
+static void write_config_cache(const char *path, struct stat *st,
+			       struct config_cache_collect *collect)
+{
+	struct strbuf tmp = STRBUF_INIT;
+	struct config_cache_header hdr;
+	int fd;
+
+	strbuf_addf(&tmp, "%s.%"PRIuMAX, path, (uintmax_t)getpid());
+	fd = open(tmp.buf, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0)
+		goto out;	/* read-only location; never mind */
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.signature = CONFIG_CACHE_SIGNATURE;
+	hdr.version = CONFIG_CACHE_VERSION;
+	hdr.nr = collect->nr;
+	hdr.src_size = st->st_size;
+	hdr.src_mtime = st->st_mtime;
+
+	if (write_in_full(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	    write_in_full(fd, collect->entries.buf,
+			  collect->entries.len) != collect->entries.len ||
+	    close(fd) < 0 ||
+	    adjust_shared_perm(tmp.buf) ||
+	    rename(tmp.buf, path))
+		unlink_or_warn(tmp.buf);
+out:
+	strbuf_release(&tmp);
+}
+
+static int config_cache_check(const char *buf, size_t len, uint32_t nr)
+{
+	size_t pos = 0;
+	uint32_t i;
+
+	for (i = 0; i < nr; i++) {
+		uint32_t keylen, vallen;
+
+		if (len - pos < 12)
+			return -1;
+		memcpy(&keylen, buf + pos + 4, 4);
+		memcpy(&vallen, buf + pos + 8, 4);
+		pos += 12;
+		if (keylen >= len - pos || buf[pos + keylen])
+			return -1;
+		pos += keylen + 1;
+		if (vallen != 0xffffffff) {
+			if (vallen >= len - pos || buf[pos + vallen])
+				return -1;
+			pos += vallen + 1;
+		}
+	}
+	return pos == len ? 0 : -1;
+}
+
+/*
+ * Returns 1 and sets *ret when a valid cache was replayed; 0 sends
+ * the caller to the real parser.
+ */
+static int git_config_from_cache(config_fn_t fn, const char *filename,
+				 void *data, int *ret)
+{
+	struct config_cache_header hdr;
+	struct config_source top;
+	struct stat st, cache_st;
+	char *path, *buf = NULL;
+	size_t len, pos;
+	uint32_t i;
+	int fd;
+
+	if (fn == store_aux)
+		return 0;	/* the set/replace path needs stream offsets */
+	if (git_env_bool("GIT_CONFIG_NOCACHE", 0))
+		return 0;
+	if (stat(filename, &st))
+		return 0;	/* let the normal path report this */
+
+	path = config_cache_path(filename);
+	if (!path)
+		return 0;
+	fd = open(path, O_RDONLY);
+	free(path);
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &cache_st) ||
+	    cache_st.st_mtime <= st.st_mtime ||
+	    cache_st.st_size < sizeof(hdr))
+		goto bogus;
+	len = xsize_t(cache_st.st_size);
+	buf = xmalloc(len);
+	if (read_in_full(fd, buf, len) != len)
+		goto bogus;
+	close(fd);
+	fd = -1;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+	if (hdr.signature != CONFIG_CACHE_SIGNATURE ||
+	    hdr.version != CONFIG_CACHE_VERSION ||
+	    hdr.src_size != (uint64_t)st.st_size ||
+	    hdr.src_mtime != (uint64_t)st.st_mtime ||
+	    config_cache_check(buf + sizeof(hdr), len - sizeof(hdr), hdr.nr))
+		goto bogus;
+
+	/*
+	 * Push a source so that callbacks see the right name and line
+	 * number and relative include.path still resolves.
+	 */
+	memset(&top, 0, sizeof(top));
+	top.prev = cf;
+	top.name = filename;
+	top.path = filename;
+	top.die_on_error = 1;
+	top.linenr = 1;
+	strbuf_init(&top.value, 0);
+	strbuf_init(&top.var, 0);
+	cf = &top;
+
+	*ret = 0;
+	pos = sizeof(hdr);
+	for (i = 0; i < hdr.nr; i++) {
+		uint32_t linenr, keylen, vallen;
+		const char *key, *value;
+
+		memcpy(&linenr, buf + pos, 4);
+		memcpy(&keylen, buf + pos + 4, 4);
+		memcpy(&vallen, buf + pos + 8, 4);
+		pos += 12;
+		key = buf + pos;
+		pos += keylen + 1;
+		if (vallen == 0xffffffff)
+			value = NULL;
+		else {
+			value = buf + pos;
+			pos += vallen + 1;
+		}
+		cf->linenr = linenr;
+		*ret = fn(key, value, data);
+		if (*ret)
+			break;
+	}
+
+	cf = top.prev;
+	strbuf_release(&top.value);
+	strbuf_release(&top.var);
+	free(buf);
+	return 1;
+
+bogus:
+	if (fd >= 0)
+		close(fd);
+	free(buf);
+	return 0;
+}
+
 static int do_config_from_file(config_fn_t fn,
 		const char *name, const char *path, FILE *f, void *data)
 {
@@ -1086,10 +1392,31 @@ int git_config_from_file(config_fn_t fn, const char *filename, void *data)
 	int ret = -1;
 	FILE *f;
 
+	if (git_config_from_cache(fn, filename, data, &ret))
+		return ret;
+
 	f = fopen(filename, "r");
 	if (f) {
-		ret = do_config_from_file(fn, filename, filename, f, data);
+		struct config_cache_collect collect;
+		struct stat st;
+		int have_stat = !fstat(fileno(f), &st);
+
+		collect.fn = fn;
+		collect.data = data;
+		collect.nr = 0;
+		strbuf_init(&collect.entries, 0);
+		ret = do_config_from_file(config_cache_collect_fn,
+					  filename, filename, f, &collect);
 		fclose(f);
+		if (!ret && have_stat &&
+		    !git_env_bool("GIT_CONFIG_NOCACHE", 0)) {
+			char *path = config_cache_path(filename);
+			if (path) {
+				write_config_cache(path, &st, &collect);
+				free(path);
+			}
+		}
+		strbuf_release(&collect.entries);
 	}
 	return ret;
 }
@@ -1190,12 +1517,14 @@ int git_config_early(config_fn_t fn, void *data, const char *repo_config)
 
 	home_config_paths(&user_config, &xdg_config, "config");
 
+	current_parsing_scope = CONFIG_SCOPE_SYSTEM;
 	if (git_config_system() && !access_or_die(git_etc_gitconfig(), R_OK, 0)) {
 		ret += git_config_from_file(fn, git_etc_gitconfig(),
 					    data);
 		found += 1;
 	}
 
+	current_parsing_scope = CONFIG_SCOPE_GLOBAL;
 	if (xdg_config && !access_or_die(xdg_config, R_OK, ACCESS_EACCES_OK)) {
 		ret += git_config_from_file(fn, xdg_config, data);
 		found += 1;
@@ -1206,11 +1535,13 @@ int git_config_early(config_fn_t fn, void *data, const char *repo_config)
 		found += 1;
 	}
 
+	current_parsing_scope = CONFIG_SCOPE_REPO;
 	if (repo_config && !access_or_die(repo_config, R_OK, 0)) {
 		ret += git_config_from_file(fn, repo_config, data);
 		found += 1;
 	}
 
+	current_parsing_scope = CONFIG_SCOPE_CMDLINE;
 	switch (git_config_from_parameters(fn, data)) {
 	case -1: /* error */
 		die(_("unable to parse command-line config"));
@@ -1221,6 +1552,7 @@ int git_config_early(config_fn_t fn, void *data, const char *repo_config)
 		found++;
 		break;
 	}
+	current_parsing_scope = CONFIG_SCOPE_UNKNOWN;
 
 	free(xdg_config);
 	free(user_config);
@@ -1289,10 +1621,13 @@ static void configset_iter(struct config_set *cs, config_fn_t fn, void *data)
 		entry = list->items[i].e;
 		value_index = list->items[i].value_index;
 		values = &entry->value_list;
+
+		current_config_kvi = values->items[value_index].util;
 		if (fn(entry->key, values->items[value_index].string, data) < 0) {
 			kv_info = values->items[value_index].util;
 			git_die_config_linenr(entry->key, kv_info->filename, kv_info->linenr);
 		}
+		current_config_kvi = NULL;
 	}
 }
 
@@ -1360,6 +1695,7 @@ static int configset_add_value(struct config_set *cs, const char *key, const cha
 		kv_info->filename = NULL;
 		kv_info->linenr = -1;
 	}
+	kv_info->scope = current_parsing_scope;
 	si->util = kv_info;
 
 	return 0;
@@ -1594,6 +1930,61 @@ int git_config_get_pathname(const char *key, const char **dest)
 	return ret;
 }
 
+/*
+ * How many index load threads "index.threads" asks for; 0 means "pick
+ * automatically" and 1 disables threading.  Returns non-zero when the
+ * user did not express a preference.
+ */
+int git_config_get_index_threads(int *dest)
+{
+	int is_bool, val;
+
+	val = git_env_ulong("GIT_TEST_INDEX_THREADS", 0);
+	if (val) {
+		*dest = val;
+		return 0;
+	}
+
+	if (!git_config_get_bool_or_int("index.threads", &is_bool, &val)) {
+		if (is_bool)
+			*dest = val ? 0 : 1;
+		else
+			*dest = val;
+		return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Whether "core.splitIndex" asks for the split index; returns -1 when
+ * the user did not express a preference.
+ */
+int git_config_get_split_index(void)
+{
+	int val;
+
+	if (!git_config_get_maybe_bool("core.splitindex", &val))
+		return val;
+
+	return -1;
+}
+
+int git_config_get_max_percent_split_change(void)
+{
+	int val = -1;
+
+	if (!git_config_get_int("splitindex.maxpercentchange", &val)) {
+		if (0 <= val && val <= 100)
+			return val;
+
+		return error("splitIndex.maxPercentChange value '%d' "
+			     "should be between 0 and 100", val);
+	}
+
+	return -1;
+}
+
 NORETURN
 void git_die_config_linenr(const char *key, const char *filename, int linenr)
 {
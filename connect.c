@@ -662,6 +662,44 @@ static struct child_process no_fork = CHILD_PROCESS_INIT;
  * will hopefully be changed in a libification effort, to return NULL when
  * the connection failed).
  */
+/*
+ * Append the extra arguments for the daemon request, hidden behind an
+ * additional NUL: ref prefixes the caller asked us to forward (see
+ * transport_set_ref_prefixes()).  Daemons that do not understand
+ * extra arguments stop parsing at the second NUL and advertise
+ * everything, which is always a safe superset.
+ */
+static void add_extra_args(struct strbuf *request)
+{
+	const char *env = getenv("GIT_REF_PREFIXES");
+	struct string_list prefixes = STRING_LIST_INIT_DUP;
+	int i;
+
+	if (!env || !*env)
+		return;
+	strbuf_addch(request, '\0');
+	string_list_split(&prefixes, env, ' ', -1);
+	for (i = 0; i < prefixes.nr; i++)
+		strbuf_addf(request, "ref-prefix=%s%c",
+			    prefixes.items[i].string, 0);
+	string_list_clear(&prefixes, 0);
+}
+
+/*
+ * Like packet_write(), but taking a pre-formatted payload that may
+ * contain NUL bytes.
+ */
+static void packet_write_strbuf(int fd, const struct strbuf *buf)
+{
+	char head[5];
+
+	if (buf->len > LARGE_PACKET_MAX - 4)
+		die("protocol error: impossibly long line");
+	snprintf(head, sizeof(head), "%04x", (unsigned)buf->len + 4);
+	write_or_die(fd, head, 4);
+	write_or_die(fd, buf->buf, buf->len);
+}
+
 struct child_process *git_connect(int fd[2], const char *url,
 				  const char *prog, int flags)
 {
@@ -669,6 +707,7 @@ struct child_process *git_connect(int fd[2], const char *url,
 	struct child_process *conn = &no_fork;
 	enum protocol protocol;
 	struct strbuf cmd = STRBUF_INIT;
+	struct strbuf request = STRBUF_INIT;
 
 	/* Without this we cannot rely on waitpid() to tell
 	 * what happened to our children.
@@ -707,11 +746,14 @@ struct child_process *git_connect(int fd[2], const char *url,
 		 *
 		 * Note: Do not add any other headers here!  Doing so
 		 * will cause older git-daemon servers to crash.
+		 * Extra arguments go behind a second NUL below, where
+		 * daemons that do not know them stop parsing.
 		 */
-		packet_write(fd[1],
-			     "%s %s%chost=%s%c",
-			     prog, path, 0,
-			     target_host, 0);
+		strbuf_addf(&request, "%s %s%chost=%s%c",
+			    prog, path, 0, target_host, 0);
+		add_extra_args(&request);
+		packet_write_strbuf(fd[1], &request);
+		strbuf_release(&request);
 		free(target_host);
 	} else {
 		conn = xmalloc(sizeof(*conn));
@@ -26,7 +26,7 @@ static int check_everything_connected_real(sha1_iterate_fn fn,
 					   const char *shallow_file)
 {
 	struct child_process rev_list = CHILD_PROCESS_INIT;
-	const char *argv[9];
+	const char *argv[10];
 	char commit[41];
 	unsigned char sha1[20];
 	int err = 0, ac = 0;
@@ -56,6 +56,14 @@ static int check_everything_connected_real(sha1_iterate_fn fn,
 	argv[ac++] = "--stdin";
 	argv[ac++] = "--not";
 	argv[ac++] = "--all";
+	/*
+	 * If reachability bitmaps cover the "--not --all" side, rev-list
+	 * only has to walk the frontier where the new history attaches
+	 * to the old, instead of the full object graph below our refs.
+	 * When no bitmap is usable rev-list silently falls back to the
+	 * ordinary walk, so this is always safe to ask for.
+	 */
+	argv[ac++] = "--use-bitmap-index";
 	if (quiet)
 		argv[ac++] = "--quiet";
 	argv[ac] = NULL;
@@ -3,6 +3,8 @@
 #include "run-command.h"
 #include "quote.h"
 #include "sigchain.h"
+#include "pkt-line.h"
+#include "hashmap.h"
 
 /*
  * convert.c - convert a file when checking it out and checking it in.
@@ -376,8 +378,8 @@ static int filter_buffer_or_fd(int in, int out, void *data)
 	return (write_err || status);
 }
 
-static int apply_filter(const char *path, const char *src, size_t len, int fd,
-                        struct strbuf *dst, const char *cmd)
+static int apply_single_file_filter(const char *path, const char *src, size_t len,
+				    int fd, struct strbuf *dst, const char *cmd)
 {
 	/*
 	 * Create a pipeline to have the command filter the buffer's
@@ -390,12 +392,6 @@ static int apply_filter(const char *path, const char *src, size_t len, int fd,
 	struct async async;
 	struct filter_params params;
 
-	if (!cmd)
-		return 0;
-
-	if (!dst)
-		return 1;
-
 	memset(&async, 0, sizeof(async));
 	async.proc = filter_buffer_or_fd;
 	async.data = &params;
@@ -430,14 +426,378 @@ static int apply_filter(const char *path, const char *src, size_t len, int fd,
 	return ret;
 }
 
+#define CAP_CLEAN    (1u<<0)
+#define CAP_SMUDGE   (1u<<1)
+#define CAP_DELAY    (1u<<2)
+
+/*
+ * A long-running filter process, started once per "filter.<driver>.process"
+ * command and fed one file after another over a pkt-line conversation, so
+ * that filtering many paths does not fork one process per path.
+ */
+struct cmd2process {
+	struct hashmap_entry ent; /* must be the first member! */
+	const char *cmd;
+	unsigned int supported_capabilities;
+	struct child_process process;
+};
+
+static int cmd_process_map_initialized;
+static struct hashmap cmd_process_map;
+
+static int cmd2process_cmp(const void *entry, const void *entry_or_key,
+			   const void *unused_keydata)
+{
+	const struct cmd2process *e1 = entry;
+	const struct cmd2process *e2 = entry_or_key;
+
+	return strcmp(e1->cmd, e2->cmd);
+}
+
+static struct cmd2process *find_multi_file_filter_entry(const char *cmd)
+{
+	struct cmd2process key;
+
+	hashmap_entry_init(&key, strhash(cmd));
+	key.cmd = cmd;
+	return hashmap_get(&cmd_process_map, &key, NULL);
+}
+
+static void kill_multi_file_filter(struct cmd2process *entry)
+{
+	if (!entry)
+		return;
+	entry->process.clean_on_exit = 0;
+	kill(entry->process.pid, SIGTERM);
+	finish_command(&entry->process);
+	hashmap_remove(&cmd_process_map, entry, NULL);
+	free(entry);
+}
+
+static char *multi_file_filter_read_line(int fd, int *len)
+{
+	*len = packet_read(fd, NULL, NULL,
+			   packet_buffer, sizeof(packet_buffer),
+			   PACKET_READ_GENTLE_ON_EOF |
+			   PACKET_READ_CHOMP_NEWLINE);
+	if (*len <= 0)
+		return NULL;
+	return packet_buffer;
+}
+
+/*
+ * Read a "status=<foo>" list terminated by a flush packet.  An empty
+ * list leaves the previous status in place, which lets the filter say
+ * "same as before" after sending the content back.
+ */
+static int multi_file_filter_read_status(int fd, struct strbuf *status)
+{
+	for (;;) {
+		int len;
+		const char *line = multi_file_filter_read_line(fd, &len);
+
+		if (!line) {
+			if (len < 0)
+				return -1;
+			return 0;
+		}
+		if (starts_with(line, "status=")) {
+			strbuf_reset(status);
+			strbuf_addstr(status, line + 7);
+		}
+	}
+}
+
+static struct cmd2process *start_multi_file_filter(const char *cmd)
+{
+	int err, seen_welcome = 0, seen_version = 0, len;
+	struct cmd2process *entry;
+	struct child_process *process;
+	const char *argv[] = { cmd, NULL };
+	const char *line;
+
+	entry = xcalloc(1, sizeof(*entry));
+	entry->cmd = cmd;
+	process = &entry->process;
+
+	child_process_init(process);
+	process->argv = argv;
+	process->use_shell = 1;
+	process->in = -1;
+	process->out = -1;
+	process->clean_on_exit = 1;
+
+	if (start_command(process)) {
+		error("cannot fork to run external filter '%s'", cmd);
+		free(entry);
+		return NULL;
+	}
+
+	hashmap_entry_init(entry, strhash(cmd));
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = packet_write_fmt_gently(process->in, "git-filter-client\n") ||
+	      packet_write_fmt_gently(process->in, "version=2\n") ||
+	      packet_flush_gently(process->in);
+	if (err)
+		goto done;
+
+	err = -1;
+	while ((line = multi_file_filter_read_line(process->out, &len))) {
+		if (!strcmp(line, "git-filter-server"))
+			seen_welcome = 1;
+		else if (!strcmp(line, "version=2"))
+			seen_version = 1;
+	}
+	if (len < 0 || !seen_welcome || !seen_version)
+		goto done;
+
+	err = packet_write_fmt_gently(process->in, "capability=clean\n") ||
+	      packet_write_fmt_gently(process->in, "capability=smudge\n") ||
+	      packet_write_fmt_gently(process->in, "capability=delay\n") ||
+	      packet_flush_gently(process->in);
+	if (err)
+		goto done;
+
+	err = -1;
+	while ((line = multi_file_filter_read_line(process->out, &len))) {
+		if (!strcmp(line, "capability=clean"))
+			entry->supported_capabilities |= CAP_CLEAN;
+		else if (!strcmp(line, "capability=smudge"))
+			entry->supported_capabilities |= CAP_SMUDGE;
+		else if (!strcmp(line, "capability=delay"))
+			entry->supported_capabilities |= CAP_DELAY;
+	}
+	if (len < 0)
+		goto done;
+	err = 0;
+
+done:
+	sigchain_pop(SIGPIPE);
+
+	if (err) {
+		error("initialization for external filter '%s' failed", cmd);
+		kill_multi_file_filter(entry);
+		return NULL;
+	}
+
+	hashmap_add(&cmd_process_map, entry);
+	return entry;
+}
+
+static int apply_multi_file_filter(const char *path, const char *src, size_t len,
+				   int fd, struct strbuf *dst, const char *cmd,
+				   unsigned int wanted_capability,
+				   struct delayed_checkout *dco)
+{
+	int err;
+	int can_delay = 0;
+	struct cmd2process *entry;
+	struct child_process *process;
+	struct strbuf nbuf = STRBUF_INIT;
+	struct strbuf filter_status = STRBUF_INIT;
+	const char *filter_type;
+
+	if (!cmd_process_map_initialized) {
+		cmd_process_map_initialized = 1;
+		hashmap_init(&cmd_process_map, cmd2process_cmp, 0);
+		entry = NULL;
+	} else {
+		entry = find_multi_file_filter_entry(cmd);
+	}
+
+	fflush(NULL);
+
+	if (!entry) {
+		entry = start_multi_file_filter(cmd);
+		if (!entry)
+			return 0;
+	}
+	process = &entry->process;
+
+	if (!(entry->supported_capabilities & wanted_capability))
+		return 0;
+
+	if (wanted_capability & CAP_CLEAN)
+		filter_type = "clean";
+	else if (wanted_capability & CAP_SMUDGE)
+		filter_type = "smudge";
+	else
+		die("BUG: filter capability %u is not supported", wanted_capability);
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = strlen(path) > LARGE_PACKET_DATA_MAX - strlen("pathname=\n");
+	if (err) {
+		error("path name too long for external filter");
+		goto done;
+	}
+
+	err = packet_write_fmt_gently(process->in, "command=%s\n", filter_type) ||
+	      packet_write_fmt_gently(process->in, "pathname=%s\n", path);
+	if (err)
+		goto done;
+
+	if ((entry->supported_capabilities & CAP_DELAY) &&
+	    dco && dco->state == CE_CAN_DELAY) {
+		can_delay = 1;
+		err = packet_write_fmt_gently(process->in, "can-delay=1\n");
+		if (err)
+			goto done;
+	}
+
+	err = packet_flush_gently(process->in);
+	if (err)
+		goto done;
+
+	if (fd >= 0)
+		err = write_packetized_from_fd(fd, process->in);
+	else
+		err = write_packetized_from_buf(src, len, process->in);
+	if (err)
+		goto done;
+
+	err = multi_file_filter_read_status(process->out, &filter_status);
+	if (err)
+		goto done;
+
+	if (can_delay && !strcmp(filter_status.buf, "delayed")) {
+		/*
+		 * The filter will hand the content over later;
+		 * remember who owes us what.
+		 */
+		string_list_insert(&dco->filters, cmd);
+		string_list_insert(&dco->paths, path);
+	} else {
+		err = strcmp(filter_status.buf, "success");
+		if (err)
+			goto done;
+
+		err = read_packetized_to_strbuf(process->out, &nbuf) < 0;
+		if (err)
+			goto done;
+
+		err = multi_file_filter_read_status(process->out, &filter_status);
+		if (err)
+			goto done;
+		err = strcmp(filter_status.buf, "success");
+	}
+
+done:
+	sigchain_pop(SIGPIPE);
+
+	if (err) {
+		if (!strcmp(filter_status.buf, "error")) {
+			/* the filter signaled a problem with the file */
+		} else if (!strcmp(filter_status.buf, "abort")) {
+			/*
+			 * The filter asked to be excused from doing
+			 * "command" for the rest of this session.
+			 */
+			entry->supported_capabilities &= ~wanted_capability;
+		} else {
+			/*
+			 * Something went wrong with the protocol or
+			 * the filter died; it cannot be trusted with
+			 * further files.
+			 */
+			error("external filter '%s' failed", cmd);
+			kill_multi_file_filter(entry);
+		}
+	} else {
+		strbuf_swap(dst, &nbuf);
+	}
+	strbuf_release(&nbuf);
+	strbuf_release(&filter_status);
+	return !err;
+}
+
+int async_query_available_blobs(const char *cmd,
+				struct string_list *available_paths)
+{
+	int err, len;
+	const char *line;
+	struct cmd2process *entry;
+	struct child_process *process;
+	struct strbuf filter_status = STRBUF_INIT;
+
+	entry = cmd_process_map_initialized ?
+		find_multi_file_filter_entry(cmd) : NULL;
+	if (!entry)
+		return error("external filter '%s' is not available anymore "
+			     "although not all paths have been filtered", cmd);
+	process = &entry->process;
+
+	sigchain_push(SIGPIPE, SIG_IGN);
+
+	err = packet_write_fmt_gently(process->in,
+				      "command=list_available_blobs\n") ||
+	      packet_flush_gently(process->in);
+	if (err)
+		goto done;
+
+	while ((line = multi_file_filter_read_line(process->out, &len))) {
+		if (starts_with(line, "pathname="))
+			string_list_insert(available_paths, line + 9);
+	}
+	err = len < 0;
+	if (err)
+		goto done;
+
+	err = multi_file_filter_read_status(process->out, &filter_status);
+	if (err)
+		goto done;
+	err = strcmp(filter_status.buf, "success");
+
+done:
+	sigchain_pop(SIGPIPE);
+
+	if (err) {
+		error("external filter '%s' failed", cmd);
+		kill_multi_file_filter(entry);
+	}
+	strbuf_release(&filter_status);
+	return !err;
+}
+
 static struct convert_driver {
 	const char *name;
 	struct convert_driver *next;
 	const char *smudge;
 	const char *clean;
+	const char *process;
 	int required;
 } *user_convert, **user_convert_tail;
 
+static int apply_filter(const char *path, const char *src, size_t len, int fd,
+			struct strbuf *dst, struct convert_driver *drv,
+			unsigned int wanted_capability,
+			struct delayed_checkout *dco)
+{
+	const char *cmd = NULL;
+
+	if (!drv)
+		return 0;
+
+	if (!dst)
+		return 1;
+
+	if ((wanted_capability & CAP_CLEAN) && !drv->process && drv->clean)
+		cmd = drv->clean;
+	else if ((wanted_capability & CAP_SMUDGE) && !drv->process && drv->smudge)
+		cmd = drv->smudge;
+
+	if (cmd && *cmd)
+		return apply_single_file_filter(path, src, len, fd, dst, cmd);
+	else if (drv->process && *drv->process)
+		return apply_multi_file_filter(path, src, len, fd, dst,
+					       drv->process, wanted_capability,
+					       dco);
+
+	return 0;
+}
+
 static int read_convert_config(const char *var, const char *value, void *cb)
 {
 	const char *key, *name;
@@ -475,6 +835,9 @@ static int read_convert_config(const char *var, const char *value, void *cb)
 	if (!strcmp("clean", key))
 		return git_config_string(&drv->clean, var, value);
 
+	if (!strcmp("process", key))
+		return git_config_string(&drv->process, var, value);
+
 	if (!strcmp("required", key)) {
 		drv->required = git_config_bool(var, value);
 		return 0;
@@ -769,24 +1132,21 @@ int would_convert_to_git_filter_fd(const char *path)
 	if (!ca.drv->required)
 		return 0;
 
-	return apply_filter(path, NULL, 0, -1, NULL, ca.drv->clean);
+	return apply_filter(path, NULL, 0, -1, NULL, ca.drv, CAP_CLEAN, NULL);
 }
 
 int convert_to_git(const char *path, const char *src, size_t len,
                    struct strbuf *dst, enum safe_crlf checksafe)
 {
 	int ret = 0;
-	const char *filter = NULL;
 	int required = 0;
 	struct conv_attrs ca;
 
 	convert_attrs(&ca, path);
-	if (ca.drv) {
-		filter = ca.drv->clean;
+	if (ca.drv)
 		required = ca.drv->required;
-	}
 
-	ret |= apply_filter(path, src, len, -1, dst, filter);
+	ret |= apply_filter(path, src, len, -1, dst, ca.drv, CAP_CLEAN, NULL);
 	if (!ret && required)
 		die("%s: clean filter '%s' failed", path, ca.drv->name);
 
@@ -810,9 +1170,9 @@ void convert_to_git_filter_fd(const char *path, int fd, struct strbuf *dst,
 	convert_attrs(&ca, path);
 
 	assert(ca.drv);
-	assert(ca.drv->clean);
+	assert(ca.drv->clean || ca.drv->process);
 
-	if (!apply_filter(path, NULL, 0, fd, dst, ca.drv->clean))
+	if (!apply_filter(path, NULL, 0, fd, dst, ca.drv, CAP_CLEAN, NULL))
 		die("%s: clean filter '%s' failed", path, ca.drv->name);
 
 	ca.crlf_action = input_crlf_action(ca.crlf_action, ca.eol_attr);
@@ -822,16 +1182,17 @@ void convert_to_git_filter_fd(const char *path, int fd, struct strbuf *dst,
 
 static int convert_to_working_tree_internal(const char *path, const char *src,
 					    size_t len, struct strbuf *dst,
-					    int normalizing)
+					    int normalizing,
+					    struct delayed_checkout *dco)
 {
 	int ret = 0, ret_filter = 0;
-	const char *filter = NULL;
+	int filter_smudge = 0;
 	int required = 0;
 	struct conv_attrs ca;
 
 	convert_attrs(&ca, path);
 	if (ca.drv) {
-		filter = ca.drv->smudge;
+		filter_smudge = !!(ca.drv->smudge || ca.drv->process);
 		required = ca.drv->required;
 	}
 
@@ -844,7 +1205,7 @@ static int convert_to_working_tree_internal(const char *path, const char *src,
 	 * CRLF conversion can be skipped if normalizing, unless there
 	 * is a smudge filter.  The filter might expect CRLFs.
 	 */
-	if (filter || !normalizing) {
+	if (filter_smudge || !normalizing) {
 		ca.crlf_action = input_crlf_action(ca.crlf_action, ca.eol_attr);
 		ret |= crlf_to_worktree(path, src, len, dst, ca.crlf_action);
 		if (ret) {
@@ -853,21 +1214,28 @@ static int convert_to_working_tree_internal(const char *path, const char *src,
 		}
 	}
 
-	ret_filter = apply_filter(path, src, len, -1, dst, filter);
+	ret_filter = apply_filter(path, src, len, -1, dst, ca.drv, CAP_SMUDGE, dco);
 	if (!ret_filter && required)
 		die("%s: smudge filter %s failed", path, ca.drv->name);
 
 	return ret | ret_filter;
 }
 
+int async_convert_to_working_tree(const char *path, const char *src, size_t len,
+				  struct strbuf *dst,
+				  struct delayed_checkout *dco)
+{
+	return convert_to_working_tree_internal(path, src, len, dst, 0, dco);
+}
+
 int convert_to_working_tree(const char *path, const char *src, size_t len, struct strbuf *dst)
 {
-	return convert_to_working_tree_internal(path, src, len, dst, 0);
+	return convert_to_working_tree_internal(path, src, len, dst, 0, NULL);
 }
 
 int renormalize_buffer(const char *path, const char *src, size_t len, struct strbuf *dst)
 {
-	int ret = convert_to_working_tree_internal(path, src, len, dst, 1);
+	int ret = convert_to_working_tree_internal(path, src, len, dst, 1, NULL);
 	if (ret) {
 		src = dst->buf;
 		len = dst->len;
@@ -1307,7 +1675,7 @@ struct stream_filter *get_stream_filter(const char *path, const unsigned char *s
 
 	convert_attrs(&ca, path);
 
-	if (ca.drv && (ca.drv->smudge || ca.drv->clean))
+	if (ca.drv && (ca.drv->smudge || ca.drv->clean || ca.drv->process))
 		return filter;
 
 	if (ca.ident)
@@ -4,6 +4,8 @@
 #ifndef CONVERT_H
 #define CONVERT_H
 
+#include "string-list.h"
+
 enum safe_crlf {
 	SAFE_CRLF_FALSE = 0,
 	SAFE_CRLF_FAIL = 1,
@@ -33,11 +35,35 @@ enum eol {
 
 extern enum eol core_eol;
 
+enum ce_delay_state {
+	CE_NO_DELAY = 0,
+	CE_CAN_DELAY = 1,
+	CE_RETRY = 2
+};
+
+/*
+ * Bookkeeping for paths whose long-running process filter answered
+ * "status=delayed" during checkout; see the delay capability in
+ * linkgit:gitattributes[5] and finish_delayed_checkout().
+ */
+struct delayed_checkout {
+	enum ce_delay_state state;
+	/* process commands that have delayed at least one path */
+	struct string_list filters;
+	/* delayed paths; util points at the cache_entry to retry */
+	struct string_list paths;
+};
+
 /* returns 1 if *dst was used */
 extern int convert_to_git(const char *path, const char *src, size_t len,
 			  struct strbuf *dst, enum safe_crlf checksafe);
 extern int convert_to_working_tree(const char *path, const char *src,
 				   size_t len, struct strbuf *dst);
+extern int async_convert_to_working_tree(const char *path, const char *src,
+					 size_t len, struct strbuf *dst,
+					 struct delayed_checkout *dco);
+extern int async_query_available_blobs(const char *cmd,
+				       struct string_list *available_paths);
 extern int renormalize_buffer(const char *path, const char *src, size_t len,
 			      struct strbuf *dst);
 static inline int would_convert_to_git(const char *path)
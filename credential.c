@@ -263,15 +263,75 @@ static int credential_do(struct credential *c, const char *helper,
 	return r;
 }
 
+/*
+ * Credentials that were approved earlier in this process; a later
+ * fill for the same protocol/host/path reuses them instead of running
+ * the helper chain (or prompting) again.  Callers that talk to many
+ * URLs on the same host would otherwise fork one helper per request.
+ */
+static struct credential *session_cache;
+static int session_cache_nr, session_cache_alloc;
+
+static struct credential *session_cache_lookup(const struct credential *want)
+{
+	int i;
+
+	for (i = 0; i < session_cache_nr; i++) {
+		struct credential *have = session_cache + i;
+		if (have->username && have->password &&
+		    credential_match(want, have))
+			return have;
+	}
+	return NULL;
+}
+
+static void session_cache_store(const struct credential *c)
+{
+	struct credential *copy;
+
+	if (session_cache_lookup(c))
+		return;
+	ALLOC_GROW(session_cache, session_cache_nr + 1, session_cache_alloc);
+	copy = &session_cache[session_cache_nr++];
+	credential_init(copy);
+	copy->protocol = xstrdup_or_null(c->protocol);
+	copy->host = xstrdup_or_null(c->host);
+	copy->path = xstrdup_or_null(c->path);
+	copy->username = xstrdup_or_null(c->username);
+	copy->password = xstrdup_or_null(c->password);
+}
+
+static void session_cache_drop(const struct credential *c)
+{
+	int i;
+
+	for (i = 0; i < session_cache_nr; i++) {
+		if (!credential_match(c, &session_cache[i]))
+			continue;
+		credential_clear(&session_cache[i]);
+		session_cache[i--] = session_cache[--session_cache_nr];
+	}
+}
+
 void credential_fill(struct credential *c)
 {
 	int i;
+	struct credential *cached;
 
 	if (c->username && c->password)
 		return;
 
 	credential_apply_config(c);
 
+	cached = session_cache_lookup(c);
+	if (cached) {
+		if (!c->username)
+			c->username = xstrdup(cached->username);
+		free(c->password);
+		c->password = xstrdup(cached->password);
+		return;
+	}
+
 	for (i = 0; i < c->helpers.nr; i++) {
 		credential_do(c, c->helpers.items[i].string, "get");
 		if (c->username && c->password)
@@ -299,6 +359,7 @@ void credential_approve(struct credential *c)
 
 	for (i = 0; i < c->helpers.nr; i++)
 		credential_do(c, c->helpers.items[i].string, "store");
+	session_cache_store(c);
 	c->approved = 1;
 }
 
@@ -310,6 +371,7 @@ void credential_reject(struct credential *c)
 
 	for (i = 0; i < c->helpers.nr; i++)
 		credential_do(c, c->helpers.items[i].string, "erase");
+	session_cache_drop(c);
 
 	free(c->username);
 	c->username = NULL;
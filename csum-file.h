@@ -8,7 +8,7 @@ struct sha1file {
 	int fd;
 	int check_fd;
 	unsigned int offset;
-	git_SHA_CTX ctx;
+	git_hash_ctx ctx;
 	off_t total;
 	struct progress *tp;
 	const char *name;
@@ -20,7 +20,7 @@ struct sha1file {
 /* Checkpoint */
 struct sha1file_checkpoint {
 	off_t offset;
-	git_SHA_CTX ctx;
+	git_hash_ctx ctx;
 };
 
 extern void sha1file_checkpoint(struct sha1file *, struct sha1file_checkpoint *);
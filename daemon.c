@@ -475,10 +475,17 @@ static int receive_pack(void)
 	return run_service_command(argv);
 }
 
+static int upload_notify(void)
+{
+	static const char *argv[] = { "upload-notify", ".", NULL };
+	return run_service_command(argv);
+}
+
 static struct daemon_service daemon_service[] = {
 	{ "upload-archive", "uploadarch", upload_archive, 0, 1 },
 	{ "upload-pack", "uploadpack", upload_pack, 1, 1 },
 	{ "receive-pack", "receivepack", receive_pack, 0, 1 },
+	{ "upload-notify", "uploadnotify", upload_notify, 0, 1 },
 };
 
 static void enable_service(const char *name, int ena)
@@ -562,6 +569,33 @@ static void canonicalize_client(struct strbuf *out, const char *in)
 	strbuf_tolower(out);
 }
 
+/*
+ * Newer clients hide additional arguments behind a second NUL byte,
+ * where older daemons stopped looking.  Collect the ones we
+ * understand and silently ignore the rest so that future extensions
+ * keep working against us.
+ */
+static void parse_extra_args(char *extra_args, int buflen)
+{
+	char *end = extra_args + buflen;
+	struct strbuf ref_prefixes = STRBUF_INIT;
+
+	while (extra_args < end && *extra_args) {
+		const char *arg = extra_args;
+		const char *val;
+
+		extra_args += strlen(extra_args) + 1;
+		if (skip_prefix(arg, "ref-prefix=", &val) && *val) {
+			if (ref_prefixes.len)
+				strbuf_addch(&ref_prefixes, ' ');
+			strbuf_addstr(&ref_prefixes, val);
+		}
+	}
+	if (ref_prefixes.len)
+		setenv("GIT_REF_PREFIXES", ref_prefixes.buf, 1);
+	strbuf_release(&ref_prefixes);
+}
+
 /*
  * Read the host as supplied by the client connection.
  */
@@ -592,6 +626,9 @@ static void parse_host_arg(struct hostinfo *hi, char *extra_args, int buflen)
 		}
 		if (extra_args < end && *extra_args)
 			die("Invalid request");
+		if (extra_args + 1 < end)
+			parse_extra_args(extra_args + 1,
+					 end - (extra_args + 1));
 	}
 }
 
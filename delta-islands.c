@@ -0,0 +1,437 @@
+#include "cache.h"
+#include "commit.h"
+#include "tag.h"
+#include "tree.h"
+#include "tree-walk.h"
+#include "refs.h"
+#include "pack.h"
+#include "pack-objects.h"
+#include "khash.h"
+#include "string-list.h"
+#include "sha1-array.h"
+#include "progress.h"
+#include "delta-islands.h"
+
+struct island_bitmap {
+	uint32_t refcount;
+	uint32_t bits[FLEX_ARRAY];
+};
+
+KHASH_INIT(sha1_bitmap, const unsigned char *, struct island_bitmap *, 1,
+	   sha1hash, __kh_oid_cmp)
+
+static kh_sha1_bitmap_t *island_marks;
+static unsigned island_counter;
+
+static uint32_t island_bitmap_size;
+
+/*
+ * Every ref tip belongs to one island; an object's bitmap records the
+ * islands it is reachable from.  The bitmaps are shared copy-on-write
+ * since most objects in one fork carry identical marks.
+ */
+static struct island_bitmap *island_bitmap_new(const struct island_bitmap *old)
+{
+	size_t size = sizeof(struct island_bitmap) +
+		(island_bitmap_size * sizeof(uint32_t));
+	struct island_bitmap *b = xcalloc(1, size);
+
+	if (old)
+		memcpy(b, old, size);
+
+	b->refcount = 1;
+	return b;
+}
+
+static void island_bitmap_or(struct island_bitmap *a,
+			     const struct island_bitmap *b)
+{
+	uint32_t i;
+
+	for (i = 0; i < island_bitmap_size; ++i)
+		a->bits[i] |= b->bits[i];
+}
+
+static int island_bitmap_is_subset(struct island_bitmap *self,
+				   struct island_bitmap *super)
+{
+	uint32_t i;
+
+	if (self == super)
+		return 1;
+
+	for (i = 0; i < island_bitmap_size; ++i) {
+		if ((self->bits[i] & super->bits[i]) != self->bits[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+#define ISLAND_BITMAP_BLOCK(x) (x / 32)
+#define ISLAND_BITMAP_MASK(x) (1 << (x % 32))
+
+static void island_bitmap_set(struct island_bitmap *self, uint32_t i)
+{
+	self->bits[ISLAND_BITMAP_BLOCK(i)] |= ISLAND_BITMAP_MASK(i);
+}
+
+int in_same_island(const unsigned char *trg, const unsigned char *src)
+{
+	khiter_t trg_pos, src_pos;
+
+	/* If we aren't using islands, assume everything goes together. */
+	if (!island_marks)
+		return 1;
+
+	/*
+	 * If we don't have a bitmap for the target, we can delta it
+	 * against anything -- it's not an important object
+	 */
+	trg_pos = kh_get_sha1_bitmap(island_marks, trg);
+	if (trg_pos >= kh_end(island_marks))
+		return 1;
+
+	/*
+	 * if the source (our delta base) doesn't have a bitmap,
+	 * we don't want to base any deltas on it!
+	 */
+	src_pos = kh_get_sha1_bitmap(island_marks, src);
+	if (src_pos >= kh_end(island_marks))
+		return 0;
+
+	return island_bitmap_is_subset(kh_value(island_marks, trg_pos),
+				       kh_value(island_marks, src_pos));
+}
+
+static int set_island_marks(const unsigned char *sha1,
+			    struct island_bitmap *marks)
+{
+	struct island_bitmap *b;
+	khiter_t pos;
+	int hash_ret;
+
+	pos = kh_put_sha1_bitmap(island_marks, sha1, &hash_ret);
+	if (hash_ret) {
+		/*
+		 * We don't have one yet; make a copy-on-write of the
+		 * parent.
+		 */
+		marks->refcount++;
+		kh_value(island_marks, pos) = marks;
+		return 1;
+	}
+
+	/*
+	 * We do have it. Make sure it matches; otherwise, we need to
+	 * mark it with the parent's bits, too (making a copy if
+	 * necessary).
+	 */
+	b = kh_value(island_marks, pos);
+	if (island_bitmap_is_subset(marks, b))
+		return 0;
+
+	if (b->refcount > 1) {
+		b->refcount--;
+		b = island_bitmap_new(b);
+		kh_value(island_marks, pos) = b;
+	}
+	island_bitmap_or(b, marks);
+	return 1;
+}
+
+static void mark_remote_island(struct sha1_array *shas, unsigned island_nr)
+{
+	struct island_bitmap *marks = island_bitmap_new(NULL);
+	int i;
+
+	island_bitmap_set(marks, island_nr);
+
+	for (i = 0; i < shas->nr; i++) {
+		const unsigned char *sha1 = shas->sha1[i];
+		struct object *obj = parse_object(sha1);
+
+		if (!obj)
+			continue;
+
+		set_island_marks(obj->sha1, marks);
+
+		while (obj && obj->type == OBJ_TAG) {
+			obj = ((struct tag *)obj)->tagged;
+			if (obj) {
+				parse_object(obj->sha1);
+				set_island_marks(obj->sha1, marks);
+			}
+		}
+	}
+
+	if (!--marks->refcount)
+		free(marks);
+}
+
+struct tree_islands_todo {
+	struct object_entry *entry;
+	unsigned int depth;
+};
+
+static int tree_depth_compare(const void *a, const void *b)
+{
+	const struct tree_islands_todo *todo_a = a;
+	const struct tree_islands_todo *todo_b = b;
+
+	return todo_a->depth - todo_b->depth;
+}
+
+void resolve_tree_islands(int progress, struct packing_data *to_pack)
+{
+	struct progress *progress_state = NULL;
+	struct tree_islands_todo *todo;
+	int nr = 0;
+	int i;
+
+	if (!island_marks)
+		return;
+
+	/*
+	 * We process only trees, as commits and tags have already been
+	 * handled (and passed their marks on to root trees, as well).
+	 * Process them shallowest first, so that marks propagate down
+	 * the tree namespace before we hit the subtrees.
+	 */
+	todo = xmalloc(to_pack->nr_objects * sizeof(*todo));
+	for (i = 0; i < to_pack->nr_objects; i++) {
+		if (to_pack->objects[i].type == OBJ_TREE) {
+			todo[nr].entry = &to_pack->objects[i];
+			todo[nr].depth = to_pack->objects[i].tree_depth;
+			nr++;
+		}
+	}
+	qsort(todo, nr, sizeof(*todo), tree_depth_compare);
+
+	if (progress)
+		progress_state = start_progress(_("Propagating island marks"), nr);
+
+	for (i = 0; i < nr; i++) {
+		struct object_entry *ent = todo[i].entry;
+		struct island_bitmap *root_marks;
+		struct tree *tree;
+		struct tree_desc desc;
+		struct name_entry entry;
+		khiter_t pos;
+
+		pos = kh_get_sha1_bitmap(island_marks, ent->idx.sha1);
+		if (pos >= kh_end(island_marks))
+			continue;
+
+		root_marks = kh_value(island_marks, pos);
+
+		tree = lookup_tree(ent->idx.sha1);
+		if (!tree || parse_tree(tree) < 0)
+			die(_("bad tree object %s"), sha1_to_hex(ent->idx.sha1));
+
+		init_tree_desc(&desc, tree->buffer, tree->size);
+		while (tree_entry(&desc, &entry)) {
+			struct object_entry *obj;
+
+			if (S_ISGITLINK(entry.mode))
+				continue;
+
+			obj = packlist_find(to_pack, entry.sha1);
+			if (!obj)
+				continue;
+
+			set_island_marks(obj->idx.sha1, root_marks);
+		}
+
+		free_tree_buffer(tree);
+
+		display_progress(progress_state, i + 1);
+	}
+
+	stop_progress(&progress_state);
+	free(todo);
+}
+
+struct remote_island {
+	uint64_t hash;
+	struct sha1_array shas;
+};
+
+static struct string_list remote_islands = STRING_LIST_INIT_DUP;
+static regex_t *island_regexes;
+static unsigned int island_regexes_alloc, island_regexes_nr;
+
+static int island_config_callback(const char *k, const char *v, void *cb)
+{
+	if (!strcmp(k, "pack.island")) {
+		struct strbuf re = STRBUF_INIT;
+
+		if (!v)
+			return config_error_nonbool(k);
+
+		ALLOC_GROW(island_regexes, island_regexes_nr + 1,
+			   island_regexes_alloc);
+
+		if (*v != '^')
+			strbuf_addch(&re, '^');
+		strbuf_addstr(&re, v);
+
+		if (regcomp(&island_regexes[island_regexes_nr], re.buf,
+			    REG_EXTENDED))
+			die(_("failed to load island regex for '%s': %s"),
+			    k, re.buf);
+
+		strbuf_release(&re);
+		island_regexes_nr++;
+		return 0;
+	}
+
+	return 0;
+}
+
+static void add_ref_to_island(const char *island_name,
+			      const unsigned char *sha1)
+{
+	uint64_t sha_core;
+	struct remote_island *rl = NULL;
+	struct string_list_item *item;
+
+	item = string_list_insert(&remote_islands, island_name);
+	if (!item->util)
+		item->util = xcalloc(1, sizeof(struct remote_island));
+	rl = item->util;
+
+	memcpy(&sha_core, sha1, sizeof(uint64_t));
+	rl->hash += sha_core;
+
+	sha1_array_append(&rl->shas, sha1);
+}
+
+static int find_island_for_ref(const char *refname,
+			       const unsigned char *sha1,
+			       int flags, void *data)
+{
+	/*
+	 * We should advertise 'ARRAY_SIZE(matches) - 1' as the max,
+	 * so we can diagnose below a config with more capture groups
+	 * than we support.
+	 */
+	regmatch_t matches[16];
+	int i, m;
+	struct strbuf island_name = STRBUF_INIT;
+
+	/* walk backwards to get last-one-wins ordering */
+	for (i = island_regexes_nr - 1; i >= 0; i--) {
+		if (!regexec(&island_regexes[i], refname,
+			     ARRAY_SIZE(matches), matches, 0))
+			break;
+	}
+
+	if (i < 0)
+		return 0;
+
+	if (matches[ARRAY_SIZE(matches) - 1].rm_so != -1)
+		warning(_("island regex from config has "
+			  "too many capture groups (max=%d)"),
+			(int)ARRAY_SIZE(matches) - 2);
+
+	for (m = 1; m < ARRAY_SIZE(matches); m++) {
+		regmatch_t *match = &matches[m];
+
+		if (match->rm_so == -1)
+			continue;
+
+		if (island_name.len)
+			strbuf_addch(&island_name, '-');
+
+		strbuf_add(&island_name, refname + match->rm_so,
+			   match->rm_eo - match->rm_so);
+	}
+
+	add_ref_to_island(island_name.buf, sha1);
+	strbuf_release(&island_name);
+	return 0;
+}
+
+static void deduplicate_islands(void)
+{
+	struct remote_island **list;
+	unsigned int island_count, dst, src, ref, i = 0;
+	struct string_list_item *item;
+
+	island_count = remote_islands.nr;
+	list = xmalloc(island_count * sizeof(struct remote_island *));
+
+	for_each_string_list_item(item, &remote_islands)
+		list[i++] = item->util;
+
+	/*
+	 * Islands with identical tips (e.g. thousands of up-to-date
+	 * forks of one repository) are collapsed into one, keeping
+	 * the bitmaps narrow.
+	 */
+	for (ref = 0; ref + 1 < island_count; ref++) {
+		for (src = ref + 1, dst = src; src < island_count; src++) {
+			if (list[ref]->hash == list[src]->hash)
+				continue;
+
+			if (src != dst)
+				list[dst] = list[src];
+
+			dst++;
+		}
+		island_count = dst;
+	}
+
+	island_bitmap_size = (island_count / 32) + 1;
+
+	for (i = 0; i < island_count; ++i)
+		mark_remote_island(&list[i]->shas, island_counter++);
+
+	free(list);
+}
+
+void load_delta_islands(void)
+{
+	island_marks = kh_init_sha1_bitmap();
+	island_counter = 0;
+
+	git_config(island_config_callback, NULL);
+	for_each_ref(find_island_for_ref, NULL);
+	deduplicate_islands();
+}
+
+void propagate_island_marks(struct commit *commit)
+{
+	khiter_t pos = kh_get_sha1_bitmap(island_marks, commit->object.sha1);
+
+	if (pos < kh_end(island_marks)) {
+		struct commit_list *p;
+		struct island_bitmap *root_marks = kh_value(island_marks, pos);
+
+		parse_commit(commit);
+		set_island_marks(commit->tree->object.sha1, root_marks);
+		for (p = commit->parents; p; p = p->next)
+			set_island_marks(p->item->object.sha1, root_marks);
+	}
+}
+
+void free_island_marks(void)
+{
+	struct island_bitmap *bitmap;
+
+	if (!island_marks)
+		return;
+
+	kh_foreach_value(island_marks, bitmap, {
+		if (!--bitmap->refcount)
+			free(bitmap);
+	});
+	kh_destroy_sha1_bitmap(island_marks);
+	island_marks = NULL;
+
+	/*
+	 * The sha1s of the ref tips are the hash keys and must outlive
+	 * the table, so the remote_islands list is kept around.
+	 */
+}
@@ -0,0 +1,19 @@
+#ifndef DELTA_ISLANDS_H
+#define DELTA_ISLANDS_H
+
+struct commit;
+struct packing_data;
+
+/*
+ * Delta islands partition the object space along ref namespaces (see
+ * the pack.island configuration), so that no object is ever deltified
+ * against a base that is only reachable from some other island.  The
+ * on-disk deltas then stay reusable when serving any single island.
+ */
+int in_same_island(const unsigned char *trg, const unsigned char *src);
+void resolve_tree_islands(int progress, struct packing_data *to_pack);
+void load_delta_islands(void);
+void propagate_island_marks(struct commit *commit);
+void free_island_marks(void);
+
+#endif /* DELTA_ISLANDS_H */
@@ -382,6 +382,18 @@ create_delta(const struct delta_index *index,
 					ref_size = top - src;
 				if (ref_size <= msize)
 					break;
+				/*
+				 * Extend the match a word at a time; a
+				 * fixed-size memcmp compiles down to a
+				 * single comparison on most targets.
+				 * Finish the tail byte-wise to find the
+				 * exact end of the match.
+				 */
+				while (ref_size >= 8 && !memcmp(src, ref, 8)) {
+					src += 8;
+					ref += 8;
+					ref_size -= 8;
+				}
 				while (ref_size-- && *src++ == *ref)
 					ref++;
 				if (msize < ref - entry->ptr) {
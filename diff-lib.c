@@ -84,6 +84,50 @@ static int match_stat_with_submodule(struct diff_options *diffopt,
 	return changed;
 }
 
+/*
+ * Collect the submodules that the walk in run_diff_files() will
+ * dirty-check, applying the same per-submodule ignore configuration it
+ * would, and run their "git status" children on a parallel pool up
+ * front.  The walk then finds the answers in the cache inside
+ * is_submodule_modified() instead of launching one child at a time.
+ */
+static void prefetch_submodule_dirty_checks(struct rev_info *revs,
+					    unsigned ce_option)
+{
+	struct string_list submodules = STRING_LIST_INIT_NODUP;
+	struct diff_options *diffopt = &revs->diffopt;
+	int i;
+
+	for (i = 0; i < active_nr; i++) {
+		struct cache_entry *ce = active_cache[i];
+		unsigned orig_flags;
+		struct stat st;
+		int changed;
+
+		if (!S_ISGITLINK(ce->ce_mode) || ce_stage(ce))
+			continue;
+		if (!ce_path_match(ce, &revs->prune_data, NULL))
+			continue;
+		if (check_removed(ce, &st))
+			continue;
+		changed = ce_match_stat(ce, &st, ce_option);
+
+		orig_flags = diffopt->flags;
+		if (!DIFF_OPT_TST(diffopt, OVERRIDE_SUBMODULE_CONFIG))
+			set_diffopt_flags_from_submodule_config(diffopt, ce->name);
+		if (!DIFF_OPT_TST(diffopt, IGNORE_SUBMODULES) &&
+		    !DIFF_OPT_TST(diffopt, IGNORE_DIRTY_SUBMODULES) &&
+		    (!changed || DIFF_OPT_TST(diffopt, DIRTY_SUBMODULES)))
+			string_list_append(&submodules, ce->name)->util =
+				(void *)(intptr_t)!!DIFF_OPT_TST(diffopt,
+					IGNORE_UNTRACKED_IN_SUBMODULES);
+		diffopt->flags = orig_flags;
+	}
+
+	prefetch_submodule_dirtiness(&submodules, 0);
+	string_list_clear(&submodules, 0);
+}
+
 int run_diff_files(struct rev_info *revs, unsigned int option)
 {
 	int entries, i;
@@ -95,6 +139,18 @@ int run_diff_files(struct rev_info *revs, unsigned int option)
 
 	if (diff_unmerged_stage < 0)
 		diff_unmerged_stage = 2;
+
+	/*
+	 * Do the stat() part of the work with a thread pool up front,
+	 * marking the unmodified entries up to date; the walk below
+	 * then only has to look at entries that may really differ.
+	 * Callers that already preloaded lose nothing: the pool skips
+	 * whatever is already marked.
+	 */
+	preload_index(&the_index, &revs->prune_data);
+
+	prefetch_submodule_dirty_checks(revs, ce_option);
+
 	entries = active_nr;
 	for (i = 0; i < entries; i++) {
 		unsigned int oldmode, newmode;
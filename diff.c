@@ -17,6 +17,10 @@
 #include "ll-merge.h"
 #include "string-list.h"
 #include "argv-array.h"
+#include "thread-utils.h"
+#ifndef NO_PTHREADS
+#include <pthread.h>
+#endif
 
 #ifdef NO_FAST_WORKING_DIRECTORY
 #define FAST_WORKING_DIRECTORY 0
@@ -36,6 +40,7 @@ int diff_auto_refresh_index = 1;
 static int diff_mnemonic_prefix;
 static int diff_no_prefix;
 static int diff_stat_graph_width;
+static int diff_stat_binary_bytes;
 static int diff_dirstat_permille_default = 30;
 static struct diff_options default_diff_options;
 static long diff_algorithm;
@@ -199,6 +204,10 @@ int git_diff_ui_config(const char *var, const char *value, void *cb)
 		diff_stat_graph_width = git_config_int(var, value);
 		return 0;
 	}
+	if (!strcmp(var, "diff.statbinarybytes")) {
+		diff_stat_binary_bytes = git_config_bool(var, value);
+		return 0;
+	}
 	if (!strcmp(var, "diff.external"))
 		return git_config_string(&external_diff_cmd_cfg, var, value);
 	if (!strcmp(var, "diff.wordregex"))
@@ -1354,7 +1363,10 @@ struct diffstat_t {
 		unsigned is_binary:1;
 		unsigned is_renamed:1;
 		unsigned is_interesting:1;
+		unsigned has_bytes_changed:1;
 		uintmax_t added, deleted;
+		/* delta-derived literal bytes for a binary pair */
+		uintmax_t bytes_changed;
 	} **files;
 };
 
@@ -1660,6 +1672,9 @@ static void show_stats(struct diffstat_t *data, struct diff_options *options)
 			fprintf(options->file, "%s%"PRIuMAX"%s",
 				add_c, added, reset);
 			fprintf(options->file, " bytes");
+			if (file->has_bytes_changed)
+				fprintf(options->file, " (%"PRIuMAX" changed)",
+					file->bytes_changed);
 			fprintf(options->file, "\n");
 			continue;
 		}
@@ -2420,6 +2435,46 @@ static void builtin_diff(const char *name_a,
 	return;
 }
 
+/*
+ * How many bytes of "two" are not copied from "one", judged by the
+ * same rabin-fingerprint delta pack-objects would compute: the sum
+ * of the literal insertions in the delta.  This is a much better
+ * answer to "how much changed?" for binary files than the raw before
+ * and after sizes.
+ */
+static uintmax_t binary_bytes_changed(mmfile_t *one, mmfile_t *two)
+{
+	const unsigned char *data, *top;
+	unsigned long delta_size;
+	uintmax_t changed = 0;
+	void *delta;
+
+	delta = diff_delta(one->ptr, one->size, two->ptr, two->size,
+			   &delta_size, 0);
+	if (!delta)
+		return two->size;
+	data = delta;
+	top = data + delta_size;
+	get_delta_hdr_size(&data, top);
+	get_delta_hdr_size(&data, top);
+	while (data < top) {
+		unsigned char cmd = *data++;
+		if (cmd & 0x80) {
+			/* a copy; skip its offset and size bytes */
+			int i;
+			for (i = 0x01; i <= 0x40; i <<= 1)
+				if (cmd & i)
+					data++;
+		} else if (cmd) {
+			changed += cmd;
+			data += cmd;
+		} else
+			break;	/* corrupt; we made this, should not happen */
+	}
+	free(delta);
+	return changed;
+}
+
 static void builtin_diffstat(const char *name_a, const char *name_b,
 			     struct diff_filespec *one,
 			     struct diff_filespec *two,
@@ -2455,6 +2510,13 @@ static void builtin_diffstat(const char *name_a, const char *name_b,
 		} else {
 			data->added = diff_filespec_size(two);
 			data->deleted = diff_filespec_size(one);
+			if (diff_stat_binary_bytes &&
+			    fill_mmfile(&mf1, one) >= 0 &&
+			    fill_mmfile(&mf2, two) >= 0) {
+				data->bytes_changed =
+					binary_bytes_changed(&mf1, &mf2);
+				data->has_bytes_changed = 1;
+			}
 		}
 	}
 
@@ -2555,12 +2617,15 @@ static void builtin_checkdiff(const char *name_a, const char *name_b,
 
 struct diff_filespec *alloc_filespec(const char *path)
 {
-	int namelen = strlen(path);
-	struct diff_filespec *spec = xmalloc(sizeof(*spec) + namelen + 1);
+	struct diff_filespec *spec;
 
-	memset(spec, 0, sizeof(*spec));
-	spec->path = (char *)(spec + 1);
-	memcpy(spec->path, path, namelen+1);
+	spec = xcalloc(1, sizeof(*spec));
+	/*
+	 * A rename-heavy diff allocates the same pathname for many
+	 * filespecs; share one interned copy instead of embedding a
+	 * private one in each.
+	 */
+	spec->path = (char *)strintern(path);
 	spec->count = 1;
 	spec->is_binary = -1;
 	return spec;
@@ -2797,8 +2862,10 @@ void diff_free_filespec_blob(struct diff_filespec *s)
 void diff_free_filespec_data(struct diff_filespec *s)
 {
 	diff_free_filespec_blob(s);
-	free(s->cnt_data);
+	if (!s->cnt_data_cached)
+		free(s->cnt_data);
 	s->cnt_data = NULL;
+	s->cnt_data_cached = 0;
 }
 
 static void prep_temp_blob(const char *path, struct diff_tempfile *temp,
@@ -4244,6 +4311,161 @@ static void flush_one_pair(struct diff_filepair *p, struct diff_options *opt)
 	}
 }
 
+#ifndef NO_PTHREADS
+
+/*
+ * The stat for one filepair needs nothing but the two blobs and an
+ * xdiff count pass, independent of every other pair.  Once
+ * enable_obj_read_lock() is in effect the object store may be read
+ * from several threads, so the per-pair numbers can be computed on a
+ * small worker pool and spliced together in queue order afterwards.
+ */
+
+/* minimum number of pairs that justifies spawning workers */
+#define DIFFSTAT_THREAD_COST 8
+
+struct diffstat_job {
+	struct diff_filepair *pair;
+	struct diffstat_t stat;
+};
+
+static struct {
+	struct diffstat_job *jobs;
+	int nr, next;
+	struct diff_options *options;
+	pthread_mutex_t lock;
+} diffstat_pool;
+
+static void *diffstat_worker(void *unused)
+{
+	for (;;) {
+		int i;
+
+		pthread_mutex_lock(&diffstat_pool.lock);
+		i = diffstat_pool.next++;
+		pthread_mutex_unlock(&diffstat_pool.lock);
+		if (i >= diffstat_pool.nr)
+			return NULL;
+		diff_flush_stat(diffstat_pool.jobs[i].pair,
+				diffstat_pool.options,
+				&diffstat_pool.jobs[i].stat);
+	}
+}
+
+/*
+ * Workers must not touch the working tree or the attribute machinery;
+ * do everything that would up front.  Returns -1 if this pair cannot
+ * be handed to a worker at all.
+ */
+static int diffstat_prepare_pair(struct diff_filepair *p)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		struct diff_filespec *s = i ? p->two : p->one;
+
+		if (DIFF_FILE_VALID(s) && !s->sha1_valid)
+			return -1; /* would hash the working tree file */
+		diff_filespec_load_driver(s); /* attribute lookup */
+		/*
+		 * If the blob contents would be taken from an
+		 * up-to-date working tree file, load them now: that
+		 * path runs convert_to_git() and the attribute stack.
+		 */
+		if (DIFF_FILE_VALID(s) && !S_ISDIR(s->mode) &&
+		    !S_ISGITLINK(s->mode) && !s->data &&
+		    reuse_worktree_file(s->path, s->sha1, 0) &&
+		    diff_populate_filespec(s, 0))
+			return -1;
+	}
+	return 0;
+}
+
+static int compute_diffstats_threaded(struct diff_options *options,
+				      struct diff_queue_struct *q,
+				      struct diffstat_t *diffstat)
+{
+	int i, nr = 0, nr_threads;
+	pthread_t *threads;
+	struct diffstat_job *jobs;
+
+	nr_threads = online_cpus();
+	if (nr_threads < 2)
+		return -1;
+
+	jobs = xcalloc(q->nr, sizeof(*jobs));
+	for (i = 0; i < q->nr; i++) {
+		struct diff_filepair *p = q->queue[i];
+
+		if (!check_pair_status(p))
+			continue;
+		if (diffstat_prepare_pair(p)) {
+			free(jobs);
+			return -1;
+		}
+		jobs[nr++].pair = p;
+	}
+	if (nr < DIFFSTAT_THREAD_COST) {
+		free(jobs);
+		return -1;
+	}
+
+	diffstat_pool.jobs = jobs;
+	diffstat_pool.nr = nr;
+	diffstat_pool.next = 0;
+	diffstat_pool.options = options;
+	pthread_mutex_init(&diffstat_pool.lock, NULL);
+	enable_obj_read_lock();
+
+	if (nr_threads > nr / 2)
+		nr_threads = nr / 2;
+	threads = xmalloc(nr_threads * sizeof(*threads));
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, diffstat_worker, NULL))
+			die("unable to create diffstat thread");
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(threads[i], NULL))
+			die("unable to join diffstat thread");
+
+	disable_obj_read_lock();
+	pthread_mutex_destroy(&diffstat_pool.lock);
+
+	/* splice the per-pair results together in queue order */
+	for (i = 0; i < nr; i++) {
+		struct diffstat_t *st = &jobs[i].stat;
+		int j;
+
+		for (j = 0; j < st->nr; j++) {
+			ALLOC_GROW(diffstat->files, diffstat->nr + 1,
+				   diffstat->alloc);
+			diffstat->files[diffstat->nr++] = st->files[j];
+		}
+		free(st->files);
+	}
+	free(threads);
+	free(jobs);
+	return 0;
+}
+#endif
+
+static void compute_diffstats(struct diff_options *options,
+			      struct diff_queue_struct *q,
+			      struct diffstat_t *diffstat)
+{
+	int i;
+
+#ifndef NO_PTHREADS
+	if (!compute_diffstats_threaded(options, q, diffstat))
+		return;
+#endif
+	for (i = 0; i < q->nr; i++) {
+		struct diff_filepair *p = q->queue[i];
+
+		if (check_pair_status(p))
+			diff_flush_stat(p, options, diffstat);
+	}
+}
+
 static void show_file_mode_name(FILE *file, const char *newdelete, struct diff_filespec *fs)
 {
 	if (fs->mode)
@@ -4474,7 +4696,7 @@ static int is_summary_empty(const struct diff_queue_struct *q)
 }
 
 static const char rename_limit_warning[] =
-"inexact rename detection was skipped due to too many files.";
+"inexact rename detection was limited to likely candidates due to too many files.";
 
 static const char degrade_cc_to_c_warning[] =
 "only found copies from modified paths due to too many files.";
@@ -4529,11 +4751,7 @@ void diff_flush(struct diff_options *options)
 		struct diffstat_t diffstat;
 
 		memset(&diffstat, 0, sizeof(struct diffstat_t));
-		for (i = 0; i < q->nr; i++) {
-			struct diff_filepair *p = q->queue[i];
-			if (check_pair_status(p))
-				diff_flush_stat(p, options, &diffstat);
-		}
+		compute_diffstats(options, q, &diffstat);
 		if (output_format & DIFF_FORMAT_NUMSTAT)
 			show_numstat(&diffstat, options);
 		if (output_format & DIFF_FORMAT_DIFFSTAT)
@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "diff.h"
 #include "diffcore.h"
+#include "hashmap.h"
 
 /*
  * Idea here is very simple.
@@ -163,6 +164,112 @@ static struct spanhash_top *hash_chars(struct diff_filespec *one)
 	return hash;
 }
 
+/*
+ * A spanhash table depends only on the blob contents and on whether
+ * we treat them as text, so the same file version can share one table
+ * no matter how many times it is scored -- a recursive merge redoes
+ * the rename pass for every virtual ancestor, for example.  Entries
+ * live for the life of the process; a filespec borrowing one marks
+ * cnt_data_cached so diff_free_filespec_data() leaves it alone.
+ */
+struct spanhash_cache_entry {
+	struct hashmap_entry ent;
+	unsigned char sha1[20];
+	unsigned is_text;
+	struct spanhash_top *top;
+};
+
+static struct hashmap spanhash_cache;
+static int spanhash_cache_ready;
+
+static int spanhash_cache_cmp(const void *entry, const void *entry_or_key,
+			      const void *unused_keydata)
+{
+	const struct spanhash_cache_entry *a = entry;
+	const struct spanhash_cache_entry *b = entry_or_key;
+
+	return hashcmp(a->sha1, b->sha1) || a->is_text != b->is_text;
+}
+
+static struct spanhash_top *get_spanhash(struct diff_filespec *one,
+					 int *cached)
+{
+	struct spanhash_cache_entry key, *entry;
+
+	/*
+	 * Without a known blob name (e.g. a working tree file) there
+	 * is nothing stable to key the cache on.
+	 */
+	if (!one->sha1_valid) {
+		*cached = 0;
+		return hash_chars(one);
+	}
+
+	if (!spanhash_cache_ready) {
+		hashmap_init(&spanhash_cache, spanhash_cache_cmp, 0);
+		spanhash_cache_ready = 1;
+	}
+	hashmap_entry_init(&key, sha1hash(one->sha1));
+	hashcpy(key.sha1, one->sha1);
+	key.is_text = !diff_filespec_is_binary(one);
+	entry = hashmap_get(&spanhash_cache, &key, NULL);
+	if (!entry) {
+		entry = xmalloc(sizeof(*entry));
+		hashmap_entry_init(entry, sha1hash(one->sha1));
+		hashcpy(entry->sha1, one->sha1);
+		entry->is_text = key.is_text;
+		entry->top = hash_chars(one);
+		hashmap_add(&spanhash_cache, entry);
+	}
+	*cached = 1;
+	return entry->top;
+}
+
+/*
+ * Build and cache the spanhash table for a filespec up front, so
+ * that a later diffcore_count_changes() call on it is pure
+ * computation on the cached tables.  The filespec must have its
+ * data populated; the blob may be freed again once this returns.
+ */
+void diffcore_count_prehash(struct diff_filespec *one)
+{
+	int cached;
+
+	if (one->cnt_data)
+		return;
+	one->cnt_data = get_spanhash(one, &cached);
+	one->cnt_data_cached = cached;
+}
+
+/*
+ * Fill sketch[] with the "n" smallest span hash values of a
+ * prehashed filespec, padded with UINT_MAX when the file has fewer
+ * spans.  Files that share a meaningful amount of content share most
+ * of these values, which makes the sketch usable as a cheap
+ * candidate filter before running the full similarity estimate.
+ */
+void diffcore_count_sketch(struct diff_filespec *one,
+			   unsigned int *sketch, int n)
+{
+	struct spanhash_top *top = one->cnt_data;
+	int i, j, lim;
+
+	for (i = 0; i < n; i++)
+		sketch[i] = UINT_MAX;
+	if (!top)
+		return;
+	lim = 1 << top->alloc_log2;
+	for (i = 0; i < lim; i++) {
+		unsigned int val = top->data[i].hashval;
+
+		if (!top->data[i].cnt || sketch[n - 1] <= val)
+			continue;
+		for (j = n - 1; j && val < sketch[j - 1]; j--)
+			sketch[j] = sketch[j - 1];
+		sketch[j] = val;
+	}
+}
+
 int diffcore_count_changes(struct diff_filespec *src,
 			   struct diff_filespec *dst,
 			   void **src_count_p,
@@ -179,16 +286,25 @@ int diffcore_count_changes(struct diff_filespec *src,
 	if (src_count_p)
 		src_count = *src_count_p;
 	if (!src_count) {
-		src_count = hash_chars(src);
-		if (src_count_p)
+		if (src_count_p) {
+			/* both callers hand us &src->cnt_data */
+			int cached;
+			src_count = get_spanhash(src, &cached);
+			src->cnt_data_cached = cached;
 			*src_count_p = src_count;
+		} else
+			src_count = hash_chars(src);
 	}
 	if (dst_count_p)
 		dst_count = *dst_count_p;
 	if (!dst_count) {
-		dst_count = hash_chars(dst);
-		if (dst_count_p)
+		if (dst_count_p) {
+			int cached;
+			dst_count = get_spanhash(dst, &cached);
+			dst->cnt_data_cached = cached;
 			*dst_count_p = dst_count;
+		} else
+			dst_count = hash_chars(dst);
 	}
 	sc = la = 0;
 
@@ -7,6 +7,7 @@
 #include "diffcore.h"
 #include "xdiff-interface.h"
 #include "kwset.h"
+#include "hashmap.h"
 
 typedef int (*pickaxe_fn)(mmfile_t *one, mmfile_t *two,
 			  struct diff_options *o,
@@ -113,6 +114,86 @@ static int has_changes(mmfile_t *one, mmfile_t *two,
 	return one_contains != two_contains;
 }
 
+/*
+ * The number of needle hits in a blob depends only on its contents,
+ * but a "log -S" walk counts the same blob once for every commit that
+ * changes the file's other side, reconstructing its delta chain each
+ * time.  Remember the count per blob for the duration of the walk so
+ * each unique blob is inflated and scanned at most once.
+ */
+struct count_cache_entry {
+	struct hashmap_entry ent;
+	unsigned char sha1[20];
+	unsigned int cnt;
+};
+
+static struct hashmap count_cache;
+static int count_cache_ready;
+
+static int count_cache_cmp(const void *entry, const void *entry_or_key,
+			   const void *unused_keydata)
+{
+	const struct count_cache_entry *a = entry;
+	const struct count_cache_entry *b = entry_or_key;
+
+	return hashcmp(a->sha1, b->sha1);
+}
+
+/*
+ * Cached counts are only valid for one needle; throw them away if
+ * this run searches for something else than the last one did.
+ */
+static void prepare_count_cache(struct diff_options *o)
+{
+	static char *last_needle;
+	static int last_flags;
+	int flags = (!!(o->pickaxe_opts & DIFF_PICKAXE_REGEX) << 1) |
+		!!DIFF_OPT_TST(o, PICKAXE_IGNORE_CASE);
+
+	if (count_cache_ready &&
+	    (strcmp(last_needle, o->pickaxe) || flags != last_flags)) {
+		hashmap_free(&count_cache, 1);
+		count_cache_ready = 0;
+	}
+	if (!count_cache_ready) {
+		hashmap_init(&count_cache, count_cache_cmp, 0);
+		count_cache_ready = 1;
+		free(last_needle);
+		last_needle = xstrdup(o->pickaxe);
+		last_flags = flags;
+	}
+}
+
+static unsigned int cached_contains(struct diff_filespec *spec,
+				    regex_t *regexp, kwset_t kws)
+{
+	struct count_cache_entry key, *entry;
+	mmfile_t mf;
+
+	if (!spec->sha1_valid) {
+		/* no stable name to key on; count the working tree file */
+		diff_populate_filespec(spec, 0);
+		mf.ptr = spec->data;
+		mf.size = spec->size;
+		return contains(&mf, regexp, kws);
+	}
+
+	hashmap_entry_init(&key, sha1hash(spec->sha1));
+	hashcpy(key.sha1, spec->sha1);
+	entry = hashmap_get(&count_cache, &key, NULL);
+	if (!entry) {
+		diff_populate_filespec(spec, 0);
+		mf.ptr = spec->data;
+		mf.size = spec->size;
+		entry = xmalloc(sizeof(*entry));
+		hashmap_entry_init(entry, sha1hash(spec->sha1));
+		hashcpy(entry->sha1, spec->sha1);
+		entry->cnt = contains(&mf, regexp, kws);
+		hashmap_add(&count_cache, entry);
+	}
+	return entry->cnt;
+}
+
 static int pickaxe_match(struct diff_filepair *p, struct diff_options *o,
 			 regex_t *regexp, kwset_t kws, pickaxe_fn fn)
 {
@@ -143,6 +224,22 @@ static int pickaxe_match(struct diff_filepair *p, struct diff_options *o,
 	if (textconv_one == textconv_two && diff_unmodified_pair(p))
 		return 0;
 
+	/*
+	 * The -S counting path goes through the per-blob count cache;
+	 * textconv output depends on the filter as well as the blob,
+	 * so it takes the uncached route below.
+	 */
+	if (fn == has_changes && !textconv_one && !textconv_two) {
+		unsigned int one_contains = DIFF_FILE_VALID(p->one) ?
+			cached_contains(p->one, regexp, kws) : 0;
+		unsigned int two_contains = DIFF_FILE_VALID(p->two) ?
+			cached_contains(p->two, regexp, kws) : 0;
+
+		diff_free_filespec_data(p->one);
+		diff_free_filespec_data(p->two);
+		return one_contains != two_contains;
+	}
+
 	mf1.size = fill_textconv(textconv_one, p->one, &mf1.ptr);
 	mf2.size = fill_textconv(textconv_two, p->two, &mf2.ptr);
 
@@ -226,6 +323,9 @@ void diffcore_pickaxe(struct diff_options *o)
 		kwsprep(kws);
 	}
 
+	if (!(opts & DIFF_PICKAXE_KIND_G))
+		prepare_count_cache(o);
+
 	/* Might want to warn when both S and G are on; I don't care... */
 	pickaxe(&diff_queued_diff, o, regexp, kws,
 		(opts & DIFF_PICKAXE_KIND_G) ? diff_grep : has_changes);
@@ -6,6 +6,7 @@
 #include "diffcore.h"
 #include "hashmap.h"
 #include "progress.h"
+#include "thread-utils.h"
 
 /* Table of rename/copy destinations */
 
@@ -441,6 +442,296 @@ static int find_renames(struct diff_score *mx, int dst_cnt, int minimum_score, i
 	return count;
 }
 
+/*
+ * A matrix cell is pure computation once both filespecs carry their
+ * spanhash tables, but building those tables reads objects and (for
+ * the binary heuristic) attributes, neither of which is safe off the
+ * main thread.  Hash each candidate here, up front; the blob itself
+ * is not needed once the table exists.
+ */
+static void prehash_filespec(struct diff_filespec *spec)
+{
+	if (!S_ISREG(spec->mode) || spec->cnt_data)
+		return;
+	if (diff_populate_filespec(spec, 0))
+		return;
+	diffcore_count_prehash(spec);
+	diff_free_filespec_blob(spec);
+}
+
+/*
+ * When the rename matrix is too big for the exhaustive search, prune
+ * it instead of giving up: bucket the sources by the smallest span
+ * hash values of their contents, and score each destination only
+ * against the sources it shares a bucket with.  A true rename pair
+ * shares most of its spans, so it is all but guaranteed to share one
+ * of these values, while unrelated files almost never collide in all
+ * of them.
+ */
+#define RENAME_SKETCH_SIZE 16
+
+struct sketch_bucket {
+	struct hashmap_entry entry;
+	unsigned int val;
+	int nr, alloc;
+	int *srcs;
+};
+
+static void sketch_bucket_add(struct hashmap *table, unsigned int val, int src)
+{
+	struct sketch_bucket *b;
+
+	b = hashmap_get_from_hash(table, val, NULL);
+	while (b && b->val != val)
+		b = hashmap_get_next(table, b);
+	if (!b) {
+		b = xcalloc(1, sizeof(*b));
+		b->val = val;
+		hashmap_entry_init(b, val);
+		hashmap_add(table, b);
+	}
+	ALLOC_GROW(b->srcs, b->nr + 1, b->alloc);
+	b->srcs[b->nr++] = src;
+}
+
+static int find_pruned_renames(struct diff_options *options, int minimum_score,
+			       int num_create)
+{
+	struct hashmap buckets;
+	struct hashmap_iter iter;
+	struct sketch_bucket *b;
+	unsigned int sketch[RENAME_SKETCH_SIZE];
+	unsigned int *stamp;
+	struct diff_score *mx;
+	int i, j, k, dst_cnt, count;
+
+	hashmap_init(&buckets, NULL, rename_src_nr);
+	for (i = 0; i < rename_src_nr; i++) {
+		struct diff_filespec *one = rename_src[i].p->one;
+
+		prehash_filespec(one);
+		if (!one->cnt_data)
+			continue;
+		diffcore_count_sketch(one, sketch, RENAME_SKETCH_SIZE);
+		for (j = 0; j < RENAME_SKETCH_SIZE; j++) {
+			if (sketch[j] == UINT_MAX)
+				break;
+			sketch_bucket_add(&buckets, sketch[j], i);
+		}
+	}
+
+	stamp = xcalloc(rename_src_nr, sizeof(*stamp));
+	mx = xcalloc(num_create * NUM_CANDIDATE_PER_DST, sizeof(*mx));
+
+	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
+		struct diff_filespec *two = rename_dst[i].two;
+		struct diff_score *m;
+
+		if (rename_dst[i].pair)
+			continue; /* dealt with exact match already. */
+
+		m = &mx[dst_cnt * NUM_CANDIDATE_PER_DST];
+		for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+			m[j].dst = -1;
+		dst_cnt++;
+
+		prehash_filespec(two);
+		if (!two->cnt_data)
+			continue;
+		diffcore_count_sketch(two, sketch, RENAME_SKETCH_SIZE);
+
+		for (j = 0; j < RENAME_SKETCH_SIZE; j++) {
+			if (sketch[j] == UINT_MAX)
+				break;
+			b = hashmap_get_from_hash(&buckets, sketch[j], NULL);
+			while (b && b->val != sketch[j])
+				b = hashmap_get_next(&buckets, b);
+			if (!b)
+				continue;
+			for (k = 0; k < b->nr; k++) {
+				int s = b->srcs[k];
+				struct diff_filespec *one = rename_src[s].p->one;
+				struct diff_score this_src;
+
+				if (stamp[s] == i + 1)
+					continue; /* scored already */
+				stamp[s] = i + 1;
+
+				this_src.score = estimate_similarity(one, two,
+								     minimum_score);
+				this_src.name_score = basename_same(one, two);
+				this_src.dst = i;
+				this_src.src = s;
+				record_if_better(m, &this_src);
+			}
+		}
+	}
+
+	qsort(mx, dst_cnt * NUM_CANDIDATE_PER_DST, sizeof(*mx), score_compare);
+
+	count = find_renames(mx, dst_cnt, minimum_score, 0);
+	if (options->detect_rename == DIFF_DETECT_COPY)
+		count += find_renames(mx, dst_cnt, minimum_score, 1);
+
+	free(mx);
+	free(stamp);
+	hashmap_iter_init(&buckets, &iter);
+	while ((b = hashmap_iter_next(&iter)))
+		free(b->srcs);
+	hashmap_free(&buckets, 1);
+	return count;
+}
+
+#ifndef NO_PTHREADS
+
+/*
+ * Mirror the thread caps used for the preloaded index: do not go
+ * overboard on parallelism, and make sure each thread has enough
+ * matrix cells to chew on to be worth its startup cost.
+ */
+#define MAX_SCORING_THREADS (20)
+#define SCORING_THREAD_COST (500)
+
+static int num_scoring_threads(int num_create)
+{
+	int threads;
+
+	if (git_config_get_int("diff.renamethreads", &threads))
+		threads = 0;
+	if (threads < 1) {
+		/*
+		 * Automatic mode: one thread per core, but only once
+		 * the matrix is big enough to repay the startup cost.
+		 * An explicitly configured count is honored as-is.
+		 */
+		threads = online_cpus();
+		while (threads > 1 &&
+		       num_create / threads * rename_src_nr < SCORING_THREAD_COST)
+			threads--;
+	}
+	if (threads > MAX_SCORING_THREADS)
+		threads = MAX_SCORING_THREADS;
+	if (threads > num_create)
+		threads = num_create;
+	return threads;
+}
+
+struct scoring_thread_data {
+	pthread_t pthread;
+	int *pending;		/* indices into rename_dst[] */
+	struct diff_score *mx;
+	int offset, nr;
+	int minimum_score;
+	int skip_unmodified;
+	struct progress *progress;
+	unsigned *progress_done;
+};
+
+static pthread_mutex_t scoring_progress_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void score_dst_candidates(int dst_index, struct diff_score *m,
+				 int minimum_score, int skip_unmodified)
+{
+	struct diff_filespec *two = rename_dst[dst_index].two;
+	int j;
+
+	for (j = 0; j < NUM_CANDIDATE_PER_DST; j++)
+		m[j].dst = -1;
+
+	for (j = 0; j < rename_src_nr; j++) {
+		struct diff_filespec *one = rename_src[j].p->one;
+		struct diff_score this_src;
+
+		if (skip_unmodified &&
+		    diff_unmodified_pair(rename_src[j].p))
+			continue;
+
+		/*
+		 * A side that could not be prehashed (unreadable blob,
+		 * non-regular file) would score zero against anything;
+		 * skip it rather than let estimate_similarity() fall
+		 * back to loading data from a worker thread.
+		 */
+		if (!one->cnt_data || !two->cnt_data)
+			continue;
+
+		this_src.score = estimate_similarity(one, two,
+						     minimum_score);
+		this_src.name_score = basename_same(one, two);
+		this_src.dst = dst_index;
+		this_src.src = j;
+		record_if_better(m, &this_src);
+	}
+}
+
+static void *scoring_thread(void *data_)
+{
+	struct scoring_thread_data *p = data_;
+	int i;
+
+	for (i = 0; i < p->nr; i++) {
+		int row = p->offset + i;
+
+		score_dst_candidates(p->pending[row],
+				     p->mx + row * NUM_CANDIDATE_PER_DST,
+				     p->minimum_score, p->skip_unmodified);
+		if (p->progress) {
+			pthread_mutex_lock(&scoring_progress_mutex);
+			*p->progress_done += rename_src_nr;
+			display_progress(p->progress, *p->progress_done);
+			pthread_mutex_unlock(&scoring_progress_mutex);
+		}
+	}
+	return NULL;
+}
+
+static void score_matrix_threaded(struct diff_score *mx, int num_create,
+				  int threads, int minimum_score,
+				  int skip_unmodified,
+				  struct progress *progress)
+{
+	struct scoring_thread_data *data;
+	unsigned progress_done = 0;
+	int *pending;
+	int i, nr, work, offset;
+
+	pending = xmalloc(num_create * sizeof(*pending));
+	for (nr = i = 0; i < rename_dst_nr; i++) {
+		if (rename_dst[i].pair)
+			continue; /* dealt with exact match already. */
+		prehash_filespec(rename_dst[i].two);
+		pending[nr++] = i;
+	}
+	for (i = 0; i < rename_src_nr; i++)
+		prehash_filespec(rename_src[i].p->one);
+
+	data = xcalloc(threads, sizeof(*data));
+	work = DIV_ROUND_UP(nr, threads);
+	offset = 0;
+	for (i = 0; i < threads; i++) {
+		struct scoring_thread_data *p = data + i;
+
+		p->pending = pending;
+		p->mx = mx;
+		p->offset = offset;
+		p->nr = work < nr - offset ? work : nr - offset;
+		p->minimum_score = minimum_score;
+		p->skip_unmodified = skip_unmodified;
+		p->progress = progress;
+		p->progress_done = &progress_done;
+		offset += p->nr;
+		if (pthread_create(&p->pthread, NULL, scoring_thread, p))
+			die("unable to create rename scoring thread");
+	}
+	for (i = 0; i < threads; i++)
+		if (pthread_join(data[i].pthread, NULL))
+			die("unable to join rename scoring thread");
+	free(data);
+	free(pending);
+}
+
+#endif /* !NO_PTHREADS */
+
 void diffcore_rename(struct diff_options *options)
 {
 	int detect_rename = options->detect_rename;
@@ -522,6 +813,8 @@ void diffcore_rename(struct diff_options *options)
 
 	switch (too_many_rename_candidates(num_create, options)) {
 	case 1:
+		rename_count += find_pruned_renames(options, minimum_score,
+						    num_create);
 		goto cleanup;
 	case 2:
 		options->degraded_cc_to_c = 1;
@@ -538,6 +831,21 @@ void diffcore_rename(struct diff_options *options)
 	}
 
 	mx = xcalloc(num_create * NUM_CANDIDATE_PER_DST, sizeof(*mx));
+
+#ifndef NO_PTHREADS
+	{
+		int threads = num_scoring_threads(num_create);
+
+		if (threads > 1) {
+			score_matrix_threaded(mx, num_create, threads,
+					      minimum_score, skip_unmodified,
+					      progress);
+			dst_cnt = num_create;
+			goto score_done;
+		}
+	}
+#endif
+
 	for (dst_cnt = i = 0; i < rename_dst_nr; i++) {
 		struct diff_filespec *two = rename_dst[i].two;
 		struct diff_score *m;
@@ -573,6 +881,9 @@ void diffcore_rename(struct diff_options *options)
 		dst_cnt++;
 		display_progress(progress, (i+1)*rename_src_nr);
 	}
+#ifndef NO_PTHREADS
+ score_done:
+#endif
 	stop_progress(&progress);
 
 	/* cost matrix sorted by most to least similar pair */
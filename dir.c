@@ -19,6 +19,9 @@ struct path_simplify {
 	const char *path;
 };
 
+/* Set while filling a dir_struct whenever untracked cache data changed */
+static int untracked_cache_dirty;
+
 /*
  * Tells read_directory_recursive how a file or directory should be treated.
  * Values are ordered by significance, e.g. if a directory contains both
@@ -33,9 +36,12 @@ enum path_treatment {
 };
 
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
-	const char *path, int len,
+	const char *path, int len, struct untracked_dir *ucd,
 	int check_only, const struct path_simplify *simplify);
 static int get_dtype(struct dirent *de, const char *path, int len);
+static int simplify_away(const char *path, int pathlen,
+			 const struct path_simplify *simplify);
+static void invalidate_all_untracked(struct untracked_dir *ucd);
 
 /* helper string functions with support for the ignore_case flag */
 int strcmp_icase(const char *a, const char *b)
@@ -357,6 +363,13 @@ static int do_match_pathspec(const struct pathspec *ps,
 				retval = how;
 			if (seen && seen[i] < how)
 				seen[i] = how;
+			/*
+			 * Without a seen[] array to fill in there is
+			 * nothing to learn from the remaining pathspecs
+			 * once the best possible match has been found.
+			 */
+			if (!seen && retval == MATCHED_EXACTLY)
+				break;
 		}
 	}
 	return retval;
@@ -479,6 +492,310 @@ void parse_exclude_pattern(const char **pattern,
 	*patternlen = len;
 }
 
+/*
+ * Most patterns in a big exclude list are "simple": they can only
+ * ever match through the path's basename, either as an exact name
+ * without wildcards or as a "*.ext" suffix.  Each exclude_list
+ * indexes those in two hashmaps so that matching a path costs two
+ * lookups plus a scan over the few remaining patterns, instead of a
+ * scan over every pattern on the list.
+ */
+struct simple_pattern {
+	struct hashmap_entry ent;
+	const char *key;
+	int keylen;
+	int pos;		/* position of the last such pattern */
+};
+
+static int simple_pattern_cmp(const void *entry, const void *entry_or_key,
+			      const void *keydata)
+{
+	const struct simple_pattern *a = entry;
+	const struct simple_pattern *b = entry_or_key;
+
+	if (a->keylen != b->keylen)
+		return 1;
+	return ignore_case ? strncasecmp(a->key, b->key, a->keylen) :
+			     memcmp(a->key, b->key, a->keylen);
+}
+
+static unsigned int simple_pattern_hash(const char *key, int keylen)
+{
+	return ignore_case ? memihash(key, keylen) : memhash(key, keylen);
+}
+
+static struct simple_pattern *simple_pattern_get(const struct hashmap *map,
+						 const char *key, int keylen)
+{
+	struct simple_pattern probe;
+
+	hashmap_entry_init(&probe, simple_pattern_hash(key, keylen));
+	probe.key = key;
+	probe.keylen = keylen;
+	return hashmap_get(map, &probe, NULL);
+}
+
+static void simple_pattern_add(struct hashmap *map, const char *key,
+			       int keylen, int pos)
+{
+	struct simple_pattern *p = simple_pattern_get(map, key, keylen);
+
+	if (p)
+		return;	/* a later, overriding pattern is already indexed */
+	p = xmalloc(sizeof(*p));
+	hashmap_entry_init(p, simple_pattern_hash(key, keylen));
+	p->key = key;
+	p->keylen = keylen;
+	p->pos = pos;
+	hashmap_add(map, p);
+}
+
+/*
+ * Returns 0 for patterns that need match_basename()/match_pathname(),
+ * 1 for exact basenames and 2 for "*.ext" suffixes (a single
+ * extension, so the path side can probe with everything after its
+ * last dot).
+ */
+static int simple_exclude_key(const struct exclude *x,
+			      const char **key, int *keylen)
+{
+	if (!(x->flags & EXC_FLAG_NODIR) || (x->flags & EXC_FLAG_MUSTBEDIR))
+		return 0;
+	if (x->nowildcardlen == x->patternlen) {
+		*key = x->pattern;
+		*keylen = x->patternlen;
+		return 1;
+	}
+	if ((x->flags & EXC_FLAG_ENDSWITH) &&
+	    x->patternlen > 2 &&
+	    x->pattern[1] == '.' &&
+	    !memchr(x->pattern + 2, '.', x->patternlen - 2)) {
+		*key = x->pattern + 1;
+		*keylen = x->patternlen - 1;
+		return 2;
+	}
+	return 0;
+}
+
+static void prepare_exclude_index(struct exclude_list *el)
+{
+	struct exclude_index *idx = &el->index;
+	int i;
+
+	hashmap_init(&idx->by_name, simple_pattern_cmp, 0);
+	hashmap_init(&idx->by_ext, simple_pattern_cmp, 0);
+	idx->rest = xmalloc((el->nr ? el->nr : 1) * sizeof(int));
+	idx->nr_rest = 0;
+	for (i = el->nr - 1; 0 <= i; i--) {
+		const char *key;
+		int keylen;
+
+		switch (simple_exclude_key(el->excludes[i], &key, &keylen)) {
+		case 1:
+			simple_pattern_add(&idx->by_name, key, keylen, i);
+			break;
+		case 2:
+			simple_pattern_add(&idx->by_ext, key, keylen, i);
+			break;
+		default:
+			idx->rest[idx->nr_rest++] = i;
+			break;
+		}
+	}
+	idx->prepared = 1;
+}
+
+static void clear_exclude_index(struct exclude_list *el)
+{
+	if (!el->index.prepared)
+		return;
+	hashmap_free(&el->index.by_name, 1);
+	hashmap_free(&el->index.by_ext, 1);
+	free(el->index.rest);
+	memset(&el->index, 0, sizeof(el->index));
+}
+
+/*
+ * Cone-mode pattern support, used for sparse checkout.  The caller
+ * turns on el->use_cone_patterns before loading the list; each added
+ * pattern must then fit the restricted shape written by cone-style
+ * sparse-checkout files (with W standing for the literal "*"
+ * wildcard):
+ *
+ *	/W	include the files in the root
+ *	!/W/	but none of the root directories
+ *	/A/	include the files directly in A
+ *	!/A/W/	but none of A's subdirectories
+ *	/A/B/	include everything under A/B
+ *
+ * which reduces matching a path to hash lookups on its leading
+ * directories.  Any other pattern falls back to the generic matcher
+ * for the whole list.
+ */
+struct cone_entry {
+	struct hashmap_entry ent;
+	int pathlen;
+	char path[FLEX_ARRAY];
+};
+
+static int cone_entry_cmp(const void *entry, const void *entry_or_key,
+			  const void *keydata)
+{
+	const struct cone_entry *a = entry;
+	const struct cone_entry *b = entry_or_key;
+
+	if (a->pathlen != b->pathlen)
+		return 1;
+	return memcmp(a->path, keydata ? keydata : b->path, a->pathlen);
+}
+
+static int cone_set_contains(struct hashmap *set, const char *path, int pathlen)
+{
+	struct cone_entry key;
+
+	if (!set->tablesize)
+		return 0;
+	hashmap_entry_init(&key, memhash(path, pathlen));
+	key.pathlen = pathlen;
+	return !!hashmap_get(set, &key, path);
+}
+
+static void cone_set_add(struct hashmap *set, const char *path, int pathlen)
+{
+	struct cone_entry *e;
+
+	if (cone_set_contains(set, path, pathlen))
+		return;
+	if (!set->tablesize)
+		hashmap_init(set, cone_entry_cmp, 0);
+	e = xmalloc(sizeof(*e) + pathlen + 1);
+	hashmap_entry_init(e, memhash(path, pathlen));
+	e->pathlen = pathlen;
+	memcpy(e->path, path, pathlen);
+	e->path[pathlen] = '\0';
+	hashmap_add(set, e);
+}
+
+static void cone_set_remove(struct hashmap *set, const char *path, int pathlen)
+{
+	struct cone_entry key;
+
+	if (!set->tablesize)
+		return;
+	hashmap_entry_init(&key, memhash(path, pathlen));
+	key.pathlen = pathlen;
+	free(hashmap_remove(set, &key, path));
+}
+
+/* Is any leading directory of path in the set? */
+static int cone_set_contains_ancestor(struct hashmap *set, const char *path,
+				      int pathlen)
+{
+	int i;
+
+	for (i = pathlen - 1; i > 0; i--)
+		if (path[i] == '/' && cone_set_contains(set, path, i))
+			return 1;
+	return 0;
+}
+
+static void cone_clear_sets(struct exclude_list *el)
+{
+	if (el->recursive_set.tablesize)
+		hashmap_free(&el->recursive_set, 1);
+	if (el->parent_set.tablesize)
+		hashmap_free(&el->parent_set, 1);
+	memset(&el->recursive_set, 0, sizeof(el->recursive_set));
+	memset(&el->parent_set, 0, sizeof(el->parent_set));
+}
+
+static void add_exclude_to_cone_sets(struct exclude_list *el, struct exclude *x)
+{
+	if (!el->use_cone_patterns)
+		return;
+
+	if (x->patternlen == 2 && !strcmp(x->pattern, "/*")) {
+		if (!x->flags) {
+			/* everything, until narrowed below */
+			el->full_cone = 1;
+			return;
+		}
+		if (x->flags == (EXC_FLAG_NEGATIVE | EXC_FLAG_MUSTBEDIR)) {
+			/* no root directories */
+			el->full_cone = 0;
+			return;
+		}
+	} else if (x->patternlen > 1 && x->pattern[0] == '/') {
+		if (x->flags == (EXC_FLAG_NEGATIVE | EXC_FLAG_MUSTBEDIR) &&
+		    x->patternlen > 3 &&
+		    x->nowildcardlen == x->patternlen - 1 &&
+		    x->pattern[x->patternlen - 1] == '*' &&
+		    x->pattern[x->patternlen - 2] == '/') {
+			/* negative wildcard: A/B keeps only its own files */
+			cone_set_remove(&el->recursive_set,
+					x->pattern + 1, x->patternlen - 3);
+			cone_set_add(&el->parent_set,
+				     x->pattern + 1, x->patternlen - 3);
+			return;
+		}
+		if (x->flags == EXC_FLAG_MUSTBEDIR &&
+		    x->nowildcardlen == x->patternlen) {
+			/* directory pattern: everything under A/B, A is a parent */
+			int i;
+
+			cone_set_add(&el->recursive_set,
+				     x->pattern + 1, x->patternlen - 1);
+			for (i = 2; i < x->patternlen; i++)
+				if (x->pattern[i] == '/')
+					cone_set_add(&el->parent_set,
+						     x->pattern + 1, i - 1);
+			return;
+		}
+	}
+
+	warning(_("unrecognized pattern: '%s'"), x->pattern);
+	warning(_("disabling cone pattern matching"));
+	cone_clear_sets(el);
+	el->use_cone_patterns = 0;
+}
+
+/*
+ * Cone-mode counterpart of is_excluded_from_list(): decide the fate
+ * of a path with hash lookups on its leading directories.  Returns 1
+ * for include, 0 for exclude and -1 for "descend and decide each
+ * entry on its own" (a directory of which only the immediate files
+ * are included).
+ */
+static int cone_mode_match(struct exclude_list *el, const char *pathname,
+			   int pathlen, int dtype)
+{
+	int dirlen;
+
+	if (el->full_cone)
+		return 1;
+
+	if (dtype == DT_DIR) {
+		if (cone_set_contains(&el->recursive_set, pathname, pathlen) ||
+		    cone_set_contains_ancestor(&el->recursive_set,
+					       pathname, pathlen))
+			return 1;
+		if (cone_set_contains(&el->parent_set, pathname, pathlen))
+			return -1;
+		return 0;
+	}
+
+	for (dirlen = pathlen - 1; dirlen > 0; dirlen--)
+		if (pathname[dirlen] == '/')
+			break;
+	if (!dirlen)
+		return 1;	/* files in the root are always included */
+	if (cone_set_contains(&el->parent_set, pathname, dirlen) ||
+	    cone_set_contains(&el->recursive_set, pathname, dirlen) ||
+	    cone_set_contains_ancestor(&el->recursive_set, pathname, dirlen))
+		return 1;
+	return 0;
+}
+
 void add_exclude(const char *string, const char *base,
 		 int baselen, struct exclude_list *el, int srcpos)
 {
@@ -508,6 +825,8 @@ void add_exclude(const char *string, const char *base,
 	ALLOC_GROW(el->excludes, el->nr + 1, el->alloc);
 	el->excludes[el->nr++] = x;
 	x->el = el;
+	clear_exclude_index(el);
+	add_exclude_to_cone_sets(el, x);
 }
 
 static void *read_skip_worktree_file_from_index(const char *path, size_t *size)
@@ -544,10 +863,14 @@ void clear_exclude_list(struct exclude_list *el)
 		free(el->excludes[i]);
 	free(el->excludes);
 	free(el->filebuf);
+	clear_exclude_index(el);
+	cone_clear_sets(el);
 
 	el->nr = 0;
 	el->excludes = NULL;
 	el->filebuf = NULL;
+	el->use_cone_patterns = 0;
+	el->full_cone = 0;
 }
 
 static void trim_trailing_spaces(char *buf)
@@ -758,13 +1081,38 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 						       int *dtype,
 						       struct exclude_list *el)
 {
-	int i;
+	struct exclude_index *idx = &el->index;
+	struct simple_pattern *sp;
+	int basenamelen = pathlen - (basename - pathname);
+	const char *dot;
+	int best = -1, i;
 
 	if (!el->nr)
 		return NULL;	/* undefined */
 
-	for (i = el->nr - 1; 0 <= i; i--) {
-		struct exclude *x = el->excludes[i];
+	if (!idx->prepared)
+		prepare_exclude_index(el);
+
+	sp = simple_pattern_get(&idx->by_name, basename, basenamelen);
+	if (sp)
+		best = sp->pos;
+	for (dot = basename + basenamelen - 1;
+	     basename <= dot && *dot != '.'; dot--)
+		; /* find the last dot, if any */
+	if (basename <= dot) {
+		sp = simple_pattern_get(&idx->by_ext, dot,
+					basename + basenamelen - dot);
+		if (sp && best < sp->pos)
+			best = sp->pos;
+	}
+
+	/*
+	 * Indexed patterns match by construction, so of those only the
+	 * last one can win; the unindexed patterns after it still have
+	 * to be tried in reverse order through the full matchers.
+	 */
+	for (i = 0; i < idx->nr_rest && best < idx->rest[i]; i++) {
+		struct exclude *x = el->excludes[idx->rest[i]];
 		const char *exclude = x->pattern;
 		int prefix = x->nowildcardlen;
 
@@ -776,8 +1124,7 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 		}
 
 		if (x->flags & EXC_FLAG_NODIR) {
-			if (match_basename(basename,
-					   pathlen - (basename - pathname),
+			if (match_basename(basename, basenamelen,
 					   exclude, prefix, x->patternlen,
 					   x->flags))
 				return x;
@@ -790,6 +1137,8 @@ static struct exclude *last_exclude_matching_from_list(const char *pathname,
 				   exclude, prefix, x->patternlen, x->flags))
 			return x;
 	}
+	if (0 <= best)
+		return el->excludes[best];
 	return NULL; /* undecided */
 }
 
@@ -802,6 +1151,10 @@ int is_excluded_from_list(const char *pathname,
 			  struct exclude_list *el)
 {
 	struct exclude *exclude;
+
+	if (el->use_cone_patterns)
+		return cone_mode_match(el, pathname, pathlen,
+				       dtype ? *dtype : DT_UNKNOWN);
 	exclude = last_exclude_matching_from_list(pathname, pathlen, basename, dtype, el);
 	if (exclude)
 		return exclude->flags & EXC_FLAG_NEGATIVE ? 0 : 1;
@@ -975,10 +1328,14 @@ static struct dir_entry *dir_entry_new(const char *pathname, int len)
 {
 	struct dir_entry *ent;
 
-	ent = xmalloc(sizeof(*ent) + len + 1);
+	/*
+	 * Directory walks visit the same paths over and over (and a
+	 * dir_struct is never freed anyway), so keep a single interned
+	 * copy of each name instead of one per entry.
+	 */
+	ent = xmalloc(sizeof(*ent));
 	ent->len = len;
-	memcpy(ent->name, pathname, len);
-	ent->name[len] = 0;
+	ent->name = memintern(pathname, len);
 	return ent;
 }
 
@@ -1106,8 +1463,155 @@ static enum exist_status directory_exists_in_index(const char *dirname, int len)
  *      as a directory.
  *  (c) otherwise, we recurse into it.
  */
+static struct untracked_dir *lookup_untracked(struct untracked_dir *ucd,
+					      const char *name, int len,
+					      int create)
+{
+	int i;
+	struct untracked_dir *d;
+
+	if (!ucd)
+		return NULL;
+	for (i = 0; i < ucd->dirs_nr; i++)
+		if (!strncmp(ucd->dirs[i]->name, name, len) &&
+		    !ucd->dirs[i]->name[len])
+			return ucd->dirs[i];
+	if (!create)
+		return NULL;
+
+	d = xcalloc(1, sizeof(*d) + len + 1);
+	memcpy(d->name, name, len);
+	ALLOC_GROW(ucd->dirs, ucd->dirs_nr + 1, ucd->dirs_alloc);
+	ucd->dirs[ucd->dirs_nr++] = d;
+	return d;
+}
+
+static void invalidate_untracked_dir(struct untracked_dir *ucd)
+{
+	int i;
+
+	ucd->valid = 0;
+	for (i = 0; i < ucd->untracked_nr; i++)
+		free(ucd->untracked[i]);
+	ucd->untracked_nr = 0;
+}
+
+static void free_untracked_dir(struct untracked_dir *ucd)
+{
+	int i;
+
+	invalidate_untracked_dir(ucd);
+	free(ucd->untracked);
+	for (i = 0; i < ucd->dirs_nr; i++)
+		free_untracked_dir(ucd->dirs[i]);
+	free(ucd->dirs);
+	free(ucd);
+}
+
+static void record_untracked_stat(struct dir_struct *dir,
+				  struct untracked_dir *ucd,
+				  const char *base, int baselen)
+{
+	struct stat st;
+	struct strbuf gi = STRBUF_INIT;
+
+	if (stat(baselen ? base : ".", &st)) {
+		ucd->valid = 0;
+		return;
+	}
+	ucd->mtime_sec = st.st_mtime;
+	ucd->mtime_nsec = ST_MTIME_NSEC(st);
+	ucd->ino = st.st_ino;
+
+	strbuf_add(&gi, base, baselen);
+	strbuf_addstr(&gi, dir->exclude_per_dir);
+	if (lstat(gi.buf, &st)) {
+		ucd->gi_sec = ucd->gi_nsec = ucd->gi_ino = ucd->gi_size = 0;
+	} else {
+		ucd->gi_sec = st.st_mtime;
+		ucd->gi_nsec = ST_MTIME_NSEC(st);
+		ucd->gi_ino = st.st_ino;
+		ucd->gi_size = st.st_size;
+	}
+	strbuf_release(&gi);
+	ucd->valid = 1;
+}
+
+static int untracked_dir_stat_fresh(const struct untracked_dir *ucd,
+				    const char *base, int baselen)
+{
+	struct stat st;
+
+	if (stat(baselen ? base : ".", &st))
+		return 0;
+	return ucd->mtime_sec == (uint32_t)st.st_mtime &&
+		ucd->mtime_nsec == ST_MTIME_NSEC(st) &&
+		ucd->ino == (uint32_t)st.st_ino;
+}
+
+static int untracked_dir_excludes_fresh(struct dir_struct *dir,
+					const struct untracked_dir *ucd,
+					const char *base, int baselen)
+{
+	struct stat st;
+	struct strbuf gi = STRBUF_INIT;
+	int fresh;
+
+	strbuf_add(&gi, base, baselen);
+	strbuf_addstr(&gi, dir->exclude_per_dir);
+	if (lstat(gi.buf, &st))
+		fresh = !ucd->gi_sec && !ucd->gi_nsec &&
+			!ucd->gi_ino && !ucd->gi_size;
+	else
+		fresh = ucd->gi_sec == (uint32_t)st.st_mtime &&
+			ucd->gi_nsec == ST_MTIME_NSEC(st) &&
+			ucd->gi_ino == (uint32_t)st.st_ino &&
+			ucd->gi_size == (uint32_t)st.st_size;
+	strbuf_release(&gi);
+	return fresh;
+}
+
+/*
+ * Replay the cached results of the last scan of this directory:
+ * re-add the untracked entries found then and descend into the
+ * subdirectories that were recursed into, each of which revalidates
+ * itself the same way.
+ */
+static enum path_treatment replay_untracked_dir(struct dir_struct *dir,
+	struct untracked_dir *ucd,
+	const char *base, int baselen,
+	const struct path_simplify *simplify)
+{
+	enum path_treatment state, dir_state = path_none;
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	for (i = 0; i < ucd->untracked_nr; i++) {
+		strbuf_setlen(&path, 0);
+		strbuf_add(&path, base, baselen);
+		strbuf_addstr(&path, ucd->untracked[i]);
+		if (!simplify_away(path.buf, path.len, simplify)) {
+			dir_add_name(dir, path.buf, path.len);
+			dir_state = path_untracked;
+		}
+	}
+	for (i = 0; i < ucd->dirs_nr; i++) {
+		strbuf_setlen(&path, 0);
+		strbuf_add(&path, base, baselen);
+		strbuf_addstr(&path, ucd->dirs[i]->name);
+		strbuf_addch(&path, '/');
+		state = read_directory_recursive(dir, path.buf, path.len,
+						 ucd->dirs[i], 0, simplify);
+		if (state > dir_state)
+			dir_state = state;
+	}
+	strbuf_release(&path);
+	return dir_state;
+}
+
 static enum path_treatment treat_directory(struct dir_struct *dir,
-	const char *dirname, int len, int exclude,
+	struct untracked_dir *ucd,
+	const char *dirname, int len, int baselen, int exclude,
 	const struct path_simplify *simplify)
 {
 	/* The "len-1" is to strip the final '/' */
@@ -1134,7 +1638,10 @@ static enum path_treatment treat_directory(struct dir_struct *dir,
 	if (!(dir->flags & DIR_HIDE_EMPTY_DIRECTORIES))
 		return exclude ? path_excluded : path_untracked;
 
-	return read_directory_recursive(dir, dirname, len, 1, simplify);
+	return read_directory_recursive(dir, dirname, len,
+					lookup_untracked(ucd, dirname + baselen,
+							 len - 1 - baselen, 0),
+					1, simplify);
 }
 
 /*
@@ -1250,7 +1757,8 @@ static int get_dtype(struct dirent *de, const char *path, int len)
 }
 
 static enum path_treatment treat_one_path(struct dir_struct *dir,
-					  struct strbuf *path,
+					  struct untracked_dir *ucd,
+					  struct strbuf *path, int baselen,
 					  const struct path_simplify *simplify,
 					  int dtype, struct dirent *de)
 {
@@ -1302,8 +1810,8 @@ static enum path_treatment treat_one_path(struct dir_struct *dir,
 		return path_none;
 	case DT_DIR:
 		strbuf_addch(path, '/');
-		return treat_directory(dir, path->buf, path->len, exclude,
-			simplify);
+		return treat_directory(dir, ucd, path->buf, path->len, baselen,
+			exclude, simplify);
 	case DT_REG:
 	case DT_LNK:
 		return exclude ? path_excluded : path_untracked;
@@ -1311,6 +1819,7 @@ static enum path_treatment treat_one_path(struct dir_struct *dir,
 }
 
 static enum path_treatment treat_path(struct dir_struct *dir,
+				      struct untracked_dir *ucd,
 				      struct dirent *de,
 				      struct strbuf *path,
 				      int baselen,
@@ -1326,7 +1835,7 @@ static enum path_treatment treat_path(struct dir_struct *dir,
 		return path_none;
 
 	dtype = DTYPE(de);
-	return treat_one_path(dir, path, simplify, dtype, de);
+	return treat_one_path(dir, ucd, path, baselen, simplify, dtype, de);
 }
 
 /*
@@ -1342,6 +1851,7 @@ static enum path_treatment treat_path(struct dir_struct *dir,
  */
 static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 				    const char *base, int baselen,
+				    struct untracked_dir *ucd,
 				    int check_only,
 				    const struct path_simplify *simplify)
 {
@@ -1349,23 +1859,54 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	enum path_treatment state, subdir_state, dir_state = path_none;
 	struct dirent *de;
 	struct strbuf path = STRBUF_INIT;
+	int record = ucd && !check_only;
 
 	strbuf_add(&path, base, baselen);
 
+	if (ucd) {
+		/*
+		 * Exclude rules are inherited, so a changed per-dir
+		 * exclude file taints the cached results of the whole
+		 * subtree, not just this directory.
+		 */
+		if (!untracked_dir_excludes_fresh(dir, ucd, base, baselen)) {
+			invalidate_all_untracked(ucd);
+			untracked_cache_dirty = 1;
+		} else if (ucd->valid &&
+			   untracked_dir_stat_fresh(ucd, base, baselen)) {
+			if (check_only) {
+				strbuf_release(&path);
+				return ucd->state;
+			}
+			dir_state = replay_untracked_dir(dir, ucd, base,
+							 baselen, simplify);
+			strbuf_release(&path);
+			return dir_state;
+		}
+	}
+	if (record) {
+		invalidate_untracked_dir(ucd);
+		untracked_cache_dirty = 1;
+	}
+
 	fdir = opendir(path.len ? path.buf : ".");
 	if (!fdir)
 		goto out;
 
 	while ((de = readdir(fdir)) != NULL) {
 		/* check how the file or directory should be treated */
-		state = treat_path(dir, de, &path, baselen, simplify);
+		state = treat_path(dir, ucd, de, &path, baselen, simplify);
 		if (state > dir_state)
 			dir_state = state;
 
 		/* recurse into subdir if instructed by treat_path */
 		if (state == path_recurse) {
 			subdir_state = read_directory_recursive(dir, path.buf,
-				path.len, check_only, simplify);
+				path.len,
+				lookup_untracked(record ? ucd : NULL,
+						 path.buf + baselen,
+						 path.len - 1 - baselen, 1),
+				check_only, simplify);
 			if (subdir_state > dir_state)
 				dir_state = subdir_state;
 		}
@@ -1378,6 +1919,13 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 			continue;
 		}
 
+		if (record && state == path_untracked) {
+			ALLOC_GROW(ucd->untracked, ucd->untracked_nr + 1,
+				   ucd->untracked_alloc);
+			ucd->untracked[ucd->untracked_nr++] =
+				xstrdup(path.buf + baselen);
+		}
+
 		/* add the path to the appropriate result list */
 		switch (state) {
 		case path_excluded:
@@ -1401,6 +1949,10 @@ static enum path_treatment read_directory_recursive(struct dir_struct *dir,
 	}
 	closedir(fdir);
  out:
+	if (record) {
+		ucd->state = dir_state;
+		record_untracked_stat(dir, ucd, base, baselen);
+	}
 	strbuf_release(&path);
 
 	return dir_state;
@@ -1469,7 +2021,7 @@ static int treat_leading_path(struct dir_struct *dir,
 			break;
 		if (simplify_away(sb.buf, sb.len, simplify))
 			break;
-		if (treat_one_path(dir, &sb, simplify,
+		if (treat_one_path(dir, NULL, &sb, 0, simplify,
 				   DT_DIR, NULL) == path_none)
 			break; /* do not recurse into it */
 		if (len <= baselen) {
@@ -1482,9 +2034,274 @@ static int treat_leading_path(struct dir_struct *dir,
 	return rc;
 }
 
+static void stat_exclude_file(const char *path, uint32_t ss[4])
+{
+	struct stat st;
+
+	if (!path || lstat(path, &st)) {
+		ss[0] = ss[1] = ss[2] = ss[3] = 0;
+		return;
+	}
+	ss[0] = st.st_mtime;
+	ss[1] = ST_MTIME_NSEC(st);
+	ss[2] = st.st_ino;
+	ss[3] = st.st_size;
+}
+
+static void invalidate_all_untracked(struct untracked_dir *ucd)
+{
+	int i;
+
+	invalidate_untracked_dir(ucd);
+	for (i = 0; i < ucd->dirs_nr; i++)
+		invalidate_all_untracked(ucd->dirs[i]);
+}
+
+/*
+ * Decide whether the untracked cache applies to this directory
+ * listing at all.  The cache only describes a full scan from the
+ * top level with the standard ".gitignore" machinery and without
+ * any of the "show/collect ignored" modes, and it is dropped
+ * wholesale when the global exclude files change.
+ */
+static struct untracked_dir *validate_untracked_cache(struct dir_struct *dir,
+						      int base_len,
+						      const struct pathspec *pathspec)
+{
+	struct untracked_cache *uc = dir->untracked;
+	uint32_t ss[4];
+
+	untracked_cache_dirty = 0;
+	if (!uc)
+		return NULL;
+	if (base_len || (pathspec && pathspec->nr))
+		return NULL;
+	if (dir->flags & ~(DIR_SHOW_OTHER_DIRECTORIES |
+			   DIR_HIDE_EMPTY_DIRECTORIES))
+		return NULL;
+	if (!dir->exclude_per_dir || strcmp(dir->exclude_per_dir, ".gitignore"))
+		return NULL;
+
+	if (!uc->root) {
+		uc->root = xcalloc(1, sizeof(*uc->root) + 1);
+		uc->dir_flags = dir->flags;
+		stat_exclude_file(git_path("info/exclude"), uc->ss_info_exclude);
+		stat_exclude_file(excludes_file, uc->ss_excludes_file);
+		uc->changed = 1;
+		return uc->root;
+	}
+	if (uc->dir_flags != dir->flags)
+		return NULL;
+
+	stat_exclude_file(git_path("info/exclude"), ss);
+	if (memcmp(ss, uc->ss_info_exclude, sizeof(ss))) {
+		memcpy(uc->ss_info_exclude, ss, sizeof(ss));
+		invalidate_all_untracked(uc->root);
+		uc->changed = 1;
+	}
+	stat_exclude_file(excludes_file, ss);
+	if (memcmp(ss, uc->ss_excludes_file, sizeof(ss))) {
+		memcpy(uc->ss_excludes_file, ss, sizeof(ss));
+		invalidate_all_untracked(uc->root);
+		uc->changed = 1;
+	}
+	return uc->root;
+}
+
+void free_untracked_cache(struct untracked_cache *uc)
+{
+	if (!uc)
+		return;
+	if (uc->root)
+		free_untracked_dir(uc->root);
+	free(uc);
+}
+
+void untracked_cache_invalidate_path(struct index_state *istate,
+				     const char *path)
+{
+	struct untracked_dir *d;
+	const char *sep;
+
+	if (!istate->untracked || !istate->untracked->root)
+		return;
+	d = istate->untracked->root;
+	d->valid = 0;
+	while (d && (sep = strchr(path, '/')) != NULL) {
+		d = lookup_untracked(d, path, sep - path, 0);
+		if (d)
+			d->valid = 0;
+		path = sep + 1;
+	}
+	istate->untracked->changed = 1;
+}
+
+static void write_one_dir(struct strbuf *out, struct untracked_dir *ucd)
+{
+	unsigned char buf[4];
+	int i;
+
+	strbuf_addstr(out, ucd->name);
+	strbuf_addch(out, '\0');
+	strbuf_addch(out, ucd->valid ? 1 : 0);
+	put_be32(buf, ucd->state);
+	strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->mtime_sec); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->mtime_nsec); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->ino); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->gi_sec); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->gi_nsec); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->gi_ino); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->gi_size); strbuf_add(out, buf, 4);
+	put_be32(buf, ucd->untracked_nr);
+	strbuf_add(out, buf, 4);
+	for (i = 0; i < ucd->untracked_nr; i++) {
+		strbuf_addstr(out, ucd->untracked[i]);
+		strbuf_addch(out, '\0');
+	}
+	put_be32(buf, ucd->dirs_nr);
+	strbuf_add(out, buf, 4);
+	for (i = 0; i < ucd->dirs_nr; i++)
+		write_one_dir(out, ucd->dirs[i]);
+}
+
+void write_untracked_extension(struct strbuf *out, struct untracked_cache *uc)
+{
+	unsigned char buf[4];
+
+	put_be32(buf, 1); /* version */
+	strbuf_add(out, buf, 4);
+	put_be32(buf, uc->dir_flags);
+	strbuf_add(out, buf, 4);
+	put_be32(buf, uc->root ? 1 : 0);
+	strbuf_add(out, buf, 4);
+	if (!uc->root)
+		return;
+	put_be32(buf, uc->ss_info_exclude[0]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_info_exclude[1]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_info_exclude[2]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_info_exclude[3]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_excludes_file[0]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_excludes_file[1]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_excludes_file[2]); strbuf_add(out, buf, 4);
+	put_be32(buf, uc->ss_excludes_file[3]); strbuf_add(out, buf, 4);
+	write_one_dir(out, uc->root);
+}
+
+struct read_ucd_state {
+	const unsigned char *cur, *end;
+	int error;
+};
+
+static uint32_t read_ucd_be32(struct read_ucd_state *rs)
+{
+	uint32_t v;
+
+	if (rs->end - rs->cur < 4) {
+		rs->error = 1;
+		return 0;
+	}
+	v = get_be32(rs->cur);
+	rs->cur += 4;
+	return v;
+}
+
+static struct untracked_dir *read_one_dir(struct read_ucd_state *rs, int depth)
+{
+	struct untracked_dir *ucd;
+	const unsigned char *eos;
+	uint32_t nr, i;
+
+	if (rs->error || depth > PATH_MAX / 2) {
+		rs->error = 1;
+		return NULL;
+	}
+	eos = memchr(rs->cur, 0, rs->end - rs->cur);
+	if (!eos || rs->end - eos < 2) {
+		rs->error = 1;
+		return NULL;
+	}
+	ucd = xcalloc(1, sizeof(*ucd) + (eos - rs->cur) + 1);
+	memcpy(ucd->name, rs->cur, eos - rs->cur);
+	rs->cur = eos + 1;
+	ucd->valid = *rs->cur++ ? 1 : 0;
+	ucd->state = read_ucd_be32(rs);
+	ucd->mtime_sec = read_ucd_be32(rs);
+	ucd->mtime_nsec = read_ucd_be32(rs);
+	ucd->ino = read_ucd_be32(rs);
+	ucd->gi_sec = read_ucd_be32(rs);
+	ucd->gi_nsec = read_ucd_be32(rs);
+	ucd->gi_ino = read_ucd_be32(rs);
+	ucd->gi_size = read_ucd_be32(rs);
+
+	nr = read_ucd_be32(rs);
+	for (i = 0; i < nr && !rs->error; i++) {
+		eos = memchr(rs->cur, 0, rs->end - rs->cur);
+		if (!eos) {
+			rs->error = 1;
+			break;
+		}
+		ALLOC_GROW(ucd->untracked, ucd->untracked_nr + 1,
+			   ucd->untracked_alloc);
+		ucd->untracked[ucd->untracked_nr++] =
+			xstrdup((const char *)rs->cur);
+		rs->cur = eos + 1;
+	}
+
+	nr = read_ucd_be32(rs);
+	for (i = 0; i < nr && !rs->error; i++) {
+		struct untracked_dir *sub = read_one_dir(rs, depth + 1);
+		if (!sub)
+			break;
+		ALLOC_GROW(ucd->dirs, ucd->dirs_nr + 1, ucd->dirs_alloc);
+		ucd->dirs[ucd->dirs_nr++] = sub;
+	}
+	if (rs->error) {
+		free_untracked_dir(ucd);
+		return NULL;
+	}
+	return ucd;
+}
+
+struct untracked_cache *read_untracked_extension(const void *data,
+						 unsigned long sz)
+{
+	struct untracked_cache *uc;
+	struct read_ucd_state rs;
+	int i;
+
+	rs.cur = data;
+	rs.end = rs.cur + sz;
+	rs.error = 0;
+
+	if (read_ucd_be32(&rs) != 1)
+		return NULL;
+	uc = xcalloc(1, sizeof(*uc));
+	uc->dir_flags = read_ucd_be32(&rs);
+	if (!read_ucd_be32(&rs)) {
+		if (rs.error) {
+			free(uc);
+			return NULL;
+		}
+		return uc;
+	}
+	for (i = 0; i < 4; i++)
+		uc->ss_info_exclude[i] = read_ucd_be32(&rs);
+	for (i = 0; i < 4; i++)
+		uc->ss_excludes_file[i] = read_ucd_be32(&rs);
+	uc->root = read_one_dir(&rs, 0);
+	if (!uc->root || rs.error) {
+		free_untracked_cache(uc);
+		error("corrupt untracked cache extension; ignoring it");
+		return NULL;
+	}
+	return uc;
+}
+
 int read_directory(struct dir_struct *dir, const char *path, int len, const struct pathspec *pathspec)
 {
 	struct path_simplify *simplify;
+	struct untracked_dir *untracked;
 
 	/*
 	 * Check out create_simplify()
@@ -1507,10 +2324,13 @@ int read_directory(struct dir_struct *dir, const char *path, int len, const stru
 	 * subset of positive ones, which has no impacts on
 	 * create_simplify().
 	 */
+	untracked = validate_untracked_cache(dir, len, pathspec);
 	simplify = create_simplify(pathspec ? pathspec->_raw : NULL);
 	if (!len || treat_leading_path(dir, path, len, simplify))
-		read_directory_recursive(dir, path, len, 0, simplify);
+		read_directory_recursive(dir, path, len, untracked, 0, simplify);
 	free_simplify(simplify);
+	if (dir->untracked && untracked_cache_dirty)
+		dir->untracked->changed = 1;
 	qsort(dir->entries, dir->nr, sizeof(struct dir_entry *), cmp_name);
 	qsort(dir->ignored, dir->ignored_nr, sizeof(struct dir_entry *), cmp_name);
 	return dir->nr;
@@ -4,10 +4,11 @@
 /* See Documentation/technical/api-directory-listing.txt */
 
 #include "strbuf.h"
+#include "hashmap.h"
 
 struct dir_entry {
 	unsigned int len;
-	char name[FLEX_ARRAY]; /* more */
+	const char *name; /* interned; see dir_entry_new() */
 };
 
 #define EXC_FLAG_NODIR 1
@@ -36,6 +37,21 @@ struct exclude {
 	int srcpos;
 };
 
+/*
+ * Lookup index over the "simple" patterns of an exclude_list: exact
+ * basenames without wildcards and single-extension "*.ext" suffixes.
+ * Built lazily by dir.c the first time the list is matched against a
+ * path and thrown away whenever the list changes; see
+ * prepare_exclude_index().
+ */
+struct exclude_index {
+	struct hashmap by_name;
+	struct hashmap by_ext;
+	int *rest;		/* unindexed pattern positions, descending */
+	int nr_rest;
+	unsigned prepared : 1;
+};
+
 /*
  * Each excludes file will be parsed into a fresh exclude_list which
  * is appended to the relevant exclude_list_group (either EXC_DIRS or
@@ -54,6 +70,23 @@ struct exclude_list {
 	const char *src;
 
 	struct exclude **excludes;
+
+	struct exclude_index index;
+
+	/*
+	 * In cone mode the patterns are restricted to directory
+	 * prefixes, so matching a path needs only hash lookups on its
+	 * leading directories instead of a scan over the pattern
+	 * list: "recursive_set" holds directories whose contents are
+	 * included in full, "parent_set" directories of which only
+	 * the immediate files are included.  A pattern that does not
+	 * fit the cone shape turns use_cone_patterns back off for the
+	 * whole list.
+	 */
+	unsigned use_cone_patterns;
+	unsigned full_cone;
+	struct hashmap recursive_set;
+	struct hashmap parent_set;
 };
 
 /*
@@ -73,6 +106,36 @@ struct exclude_list_group {
 	struct exclude_list *el;
 };
 
+/*
+ * Untracked cache: one node per directory that has been scanned for
+ * untracked files.  A node is valid as long as the directory's own
+ * stat data and its per-directory exclude file are unchanged; a valid
+ * node lets read_directory_recursive() replay the untracked entries
+ * found last time without calling opendir()/readdir() at all.
+ */
+struct untracked_dir {
+	struct untracked_dir **dirs;
+	int dirs_nr, dirs_alloc;
+	char **untracked;
+	int untracked_nr, untracked_alloc;
+	unsigned int valid : 1;
+	unsigned int state; /* enum path_treatment of the last full scan */
+	/* stat data of the directory itself */
+	uint32_t mtime_sec, mtime_nsec, ino;
+	/* stat data of the per-directory exclude file (zeros if absent) */
+	uint32_t gi_sec, gi_nsec, gi_ino, gi_size;
+	char name[FLEX_ARRAY]; /* path component, "" for the root */
+};
+
+struct untracked_cache {
+	struct untracked_dir *root;
+	unsigned int dir_flags;
+	/* stat data of $GIT_DIR/info/exclude and core.excludesfile */
+	uint32_t ss_info_exclude[4];
+	uint32_t ss_excludes_file[4];
+	unsigned int changed : 1;
+};
+
 struct dir_struct {
 	int nr, alloc;
 	int ignored_nr, ignored_alloc;
@@ -91,6 +154,9 @@ struct dir_struct {
 	/* Exclude info */
 	const char *exclude_per_dir;
 
+	/* Opted-in untracked cache, or NULL */
+	struct untracked_cache *untracked;
+
 	/*
 	 * We maintain three groups of exclude pattern lists:
 	 *
@@ -188,6 +254,16 @@ extern int is_empty_dir(const char *dir);
 
 extern void setup_standard_excludes(struct dir_struct *dir);
 
+/* Untracked cache */
+struct index_state;
+extern struct untracked_cache *read_untracked_extension(const void *data,
+							unsigned long sz);
+extern void write_untracked_extension(struct strbuf *out,
+				      struct untracked_cache *uc);
+extern void free_untracked_cache(struct untracked_cache *uc);
+extern void untracked_cache_invalidate_path(struct index_state *istate,
+					    const char *path);
+
 #define REMOVE_DIR_EMPTY_ONLY 01
 #define REMOVE_DIR_KEEP_NESTED_GIT 02
 #define REMOVE_DIR_KEEP_TOPLEVEL 04
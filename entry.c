@@ -3,6 +3,13 @@
 #include "dir.h"
 #include "streaming.h"
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+
 static void create_directories(const char *path, int path_len,
 			       const struct checkout *state)
 {
@@ -136,6 +143,73 @@ static int streaming_write_entry(const struct cache_entry *ce, char *path,
 	return result;
 }
 
+static int clone_regular_file(int dst_fd, int src_fd)
+{
+#ifdef FICLONE
+	/*
+	 * On filesystems with reflink support this shares the extents
+	 * of the source file instead of writing fresh data blocks.
+	 */
+	if (!ioctl(dst_fd, FICLONE, src_fd))
+		return 0;
+#endif
+	return copy_fd(src_fd, dst_fd);
+}
+
+static int clone_entry_from_worktree(const struct cache_entry *ce, char *path,
+				     const struct checkout *state,
+				     int to_tempfile,
+				     int *fstat_done, struct stat *statbuf)
+{
+	struct index_state *src_index = state->clone_worktree_index;
+	const struct cache_entry *src;
+	struct strbuf srcpath = STRBUF_INIT;
+	struct stat src_st;
+	int pos, src_fd, dst_fd, ret;
+
+	pos = index_name_pos(src_index, ce->name, ce_namelen(ce));
+	if (pos < 0)
+		return -1;
+	src = src_index->cache[pos];
+	if (ce_stage(src) ||
+	    (src->ce_mode & S_IFMT) != S_IFREG ||
+	    hashcmp(src->sha1, ce->sha1))
+		return -1;
+
+	strbuf_addf(&srcpath, "%s/%s", state->clone_worktree, ce->name);
+
+	/*
+	 * Only a source file whose cached stat information still
+	 * matches is known to hold the blob bytes verbatim.
+	 */
+	if (lstat(srcpath.buf, &src_st) ||
+	    !S_ISREG(src_st.st_mode) ||
+	    ie_match_stat(src_index, src, &src_st, 0)) {
+		strbuf_release(&srcpath);
+		return -1;
+	}
+
+	src_fd = open(srcpath.buf, O_RDONLY);
+	strbuf_release(&srcpath);
+	if (src_fd < 0)
+		return -1;
+	dst_fd = open_output_fd(path, ce, to_tempfile);
+	if (dst_fd < 0) {
+		close(src_fd);
+		return -1;
+	}
+
+	ret = clone_regular_file(dst_fd, src_fd);
+	close(src_fd);
+	if (!ret)
+		*fstat_done = fstat_output(dst_fd, state, statbuf);
+	if (close(dst_fd))
+		ret = -1;
+	if (ret)
+		unlink(path);
+	return ret;
+}
+
 static int write_entry(struct cache_entry *ce,
 		       char *path, const struct checkout *state, int to_tempfile)
 {
@@ -149,6 +223,11 @@ static int write_entry(struct cache_entry *ce,
 
 	if (ce_mode_s_ifmt == S_IFREG) {
 		struct stream_filter *filter = get_stream_filter(ce->name, ce->sha1);
+		if (state->clone_worktree &&
+		    filter && is_null_stream_filter(filter) &&
+		    !clone_entry_from_worktree(ce, path, state, to_tempfile,
+					       &fstat_done, &st))
+			goto finish;
 		if (filter &&
 		    !streaming_write_entry(ce, path, filter,
 					   state, to_tempfile,
@@ -176,11 +255,33 @@ static int write_entry(struct cache_entry *ce,
 		/*
 		 * Convert from git internal format to working tree format
 		 */
-		if (ce_mode_s_ifmt == S_IFREG &&
-		    convert_to_working_tree(ce->name, new, size, &buf)) {
-			free(new);
-			new = strbuf_detach(&buf, &newsize);
-			size = newsize;
+		if (ce_mode_s_ifmt == S_IFREG) {
+			struct delayed_checkout *dco = state->delayed_checkout;
+
+			if (dco && dco->state != CE_NO_DELAY) {
+				ret = async_convert_to_working_tree(ce->name, new,
+								    size, &buf, dco);
+				if (ret &&
+				    string_list_has_string(&dco->paths, ce->name)) {
+					/*
+					 * The filter took the content and
+					 * will hand it back later; remember
+					 * the entry so finish_delayed_checkout()
+					 * can retry it.
+					 */
+					string_list_lookup(&dco->paths,
+							   ce->name)->util = ce;
+					free(new);
+					goto delayed;
+				}
+			} else
+				ret = convert_to_working_tree(ce->name, new,
+							      size, &buf);
+			if (ret) {
+				free(new);
+				new = strbuf_detach(&buf, &newsize);
+				size = newsize;
+			}
 		}
 
 		fd = open_output_fd(path, ce, to_tempfile);
@@ -217,6 +318,7 @@ finish:
 		ce->ce_flags |= CE_UPDATE_IN_BASE;
 		state->istate->cache_changed |= CE_ENTRY_CHANGED;
 	}
+delayed:
 	return 0;
 }
 
@@ -237,6 +339,93 @@ static int check_path(const char *path, int len, struct stat *st, int skiplen)
 	return lstat(path, st);
 }
 
+void enable_delayed_checkout(struct checkout *state)
+{
+	if (!state->delayed_checkout) {
+		struct delayed_checkout *dco;
+
+		dco = state->delayed_checkout = xmalloc(sizeof(*dco));
+		dco->state = CE_CAN_DELAY;
+		string_list_init(&dco->filters, 0);
+		string_list_init(&dco->paths, 1);
+	}
+}
+
+static int remove_available_paths(struct string_list_item *item, void *cb_data)
+{
+	struct string_list *available_paths = cb_data;
+	struct string_list_item *available;
+
+	available = string_list_lookup(available_paths, item->string);
+	if (available)
+		available->util = item->util;
+	return !available;
+}
+
+int finish_delayed_checkout(struct checkout *state)
+{
+	int errs = 0;
+	struct string_list_item *filter, *path;
+	struct delayed_checkout *dco = state->delayed_checkout;
+
+	if (!dco)
+		return 0;
+
+	dco->state = CE_RETRY;
+	while (dco->filters.nr > 0) {
+		for_each_string_list_item(filter, &dco->filters) {
+			struct string_list available_paths = STRING_LIST_INIT_DUP;
+
+			if (!async_query_available_blobs(filter->string,
+							 &available_paths)) {
+				/* the filter is dead; its paths fail below */
+				errs = 1;
+				filter->string = "";
+				continue;
+			}
+			if (!available_paths.nr) {
+				/* nothing left to come from this filter */
+				filter->string = "";
+				continue;
+			}
+
+			/*
+			 * Move the cache entries of the now available
+			 * paths out of the delayed list and check them
+			 * out; this time the filter has to answer
+			 * right away.
+			 */
+			filter_string_list(&dco->paths, 0,
+					   &remove_available_paths,
+					   &available_paths);
+
+			for_each_string_list_item(path, &available_paths) {
+				struct cache_entry *ce = path->util;
+
+				if (!ce) {
+					errs = error("external filter '%s' signaled that '%s' is available although it has not been delayed earlier",
+						     filter->string, path->string);
+					continue;
+				}
+				errs |= checkout_entry(ce, state, NULL);
+			}
+			string_list_clear(&available_paths, 0);
+		}
+		string_list_remove_empty_items(&dco->filters, 0);
+	}
+
+	for_each_string_list_item(path, &dco->paths) {
+		error("'%s' was not filtered properly", path->string);
+		errs = 1;
+	}
+	string_list_clear(&dco->filters, 0);
+	string_list_clear(&dco->paths, 0);
+	free(dco);
+	state->delayed_checkout = NULL;
+
+	return errs;
+}
+
 /*
  * Write the contents from ce out to the working tree.
  *
@@ -19,10 +19,21 @@
  */
 #include "git-compat-util.h"
 #include "ewok.h"
+#include "ewok_rlw.h"
 
 #define MASK(x) ((eword_t)1 << (x % BITS_IN_WORD))
 #define BLOCK(x) (x / BITS_IN_WORD)
 
+static void bitmap_grow(struct bitmap *self, size_t word_alloc)
+{
+	if (word_alloc <= self->word_alloc)
+		return;
+	self->words = ewah_realloc(self->words, word_alloc * sizeof(eword_t));
+	memset(self->words + self->word_alloc, 0x0,
+		(word_alloc - self->word_alloc) * sizeof(eword_t));
+	self->word_alloc = word_alloc;
+}
+
 struct bitmap *bitmap_new(void)
 {
 	struct bitmap *bitmap = ewah_malloc(sizeof(struct bitmap));
@@ -93,26 +104,45 @@ struct ewah_bitmap *bitmap_to_ewah(struct bitmap *bitmap)
 struct bitmap *ewah_to_bitmap(struct ewah_bitmap *ewah)
 {
 	struct bitmap *bitmap = bitmap_new();
-	struct ewah_iterator it;
-	eword_t blowup;
-	size_t i = 0;
-
-	ewah_iterator_init(&it, ewah);
-
-	while (ewah_iterator_next(&blowup, &it)) {
-		if (i >= bitmap->word_alloc) {
-			bitmap->word_alloc *= 1.5;
-			bitmap->words = ewah_realloc(
-				bitmap->words, bitmap->word_alloc * sizeof(eword_t));
-		}
-
-		bitmap->words[i++] = blowup;
+	const eword_t *buffer = ewah->buffer;
+	size_t pointer = 0, i = 0;
+
+	/*
+	 * Decode whole run-length words at a time instead of pulling
+	 * single words through an iterator: a run of ones becomes one
+	 * memset(), a run of zeroes is skipped over (freshly grown
+	 * words are already zeroed), and literal words are copied
+	 * verbatim.
+	 */
+	while (pointer < ewah->buffer_size) {
+		eword_t rlw = buffer[pointer];
+		size_t run_len = rlw_get_running_len(&rlw);
+		size_t literals = rlw_get_literal_words(&rlw);
+
+		bitmap_grow(bitmap, i + run_len + literals);
+		if (rlw_get_run_bit(&rlw))
+			memset(bitmap->words + i, 0xff,
+				run_len * sizeof(eword_t));
+		i += run_len;
+		memcpy(bitmap->words + i, buffer + pointer + 1,
+			literals * sizeof(eword_t));
+		i += literals;
+		pointer += literals + 1;
 	}
 
 	bitmap->word_alloc = i;
 	return bitmap;
 }
 
+struct bitmap *bitmap_dup(const struct bitmap *src)
+{
+	struct bitmap *dst = bitmap_new();
+
+	bitmap_grow(dst, src->word_alloc);
+	memcpy(dst->words, src->words, src->word_alloc * sizeof(eword_t));
+	return dst;
+}
+
 void bitmap_and_not(struct bitmap *self, struct bitmap *other)
 {
 	const size_t count = (self->word_alloc < other->word_alloc) ?
@@ -126,24 +156,34 @@ void bitmap_and_not(struct bitmap *self, struct bitmap *other)
 
 void bitmap_or_ewah(struct bitmap *self, struct ewah_bitmap *other)
 {
-	size_t original_size = self->word_alloc;
 	size_t other_final = (other->bit_size / BITS_IN_WORD) + 1;
-	size_t i = 0;
-	struct ewah_iterator it;
-	eword_t word;
-
-	if (self->word_alloc < other_final) {
-		self->word_alloc = other_final;
-		self->words = ewah_realloc(self->words,
-			self->word_alloc * sizeof(eword_t));
-		memset(self->words + original_size, 0x0,
-			(self->word_alloc - original_size) * sizeof(eword_t));
+	const eword_t *buffer = other->buffer;
+	size_t pointer = 0, i = 0;
+
+	bitmap_grow(self, other_final);
+
+	/*
+	 * As in ewah_to_bitmap(), decode block-wise: runs of zeroes
+	 * cannot change `self` and are skipped, runs of ones are one
+	 * memset(), and only the literal words are OR'ed in one by
+	 * one.
+	 */
+	while (pointer < other->buffer_size) {
+		eword_t rlw = buffer[pointer];
+		size_t run_len = rlw_get_running_len(&rlw);
+		size_t literals = rlw_get_literal_words(&rlw);
+		size_t k;
+
+		bitmap_grow(self, i + run_len + literals);
+		if (rlw_get_run_bit(&rlw))
+			memset(self->words + i, 0xff,
+				run_len * sizeof(eword_t));
+		i += run_len;
+		for (k = 0; k < literals; k++)
+			self->words[i + k] |= buffer[pointer + 1 + k];
+		i += literals;
+		pointer += literals + 1;
 	}
-
-	ewah_iterator_init(&it, other);
-
-	while (ewah_iterator_next(&word, &it))
-		self->words[i++] |= word;
 }
 
 void bitmap_each_bit(struct bitmap *self, ewah_callback callback, void *data)
@@ -555,8 +555,16 @@ static struct object_entry *new_object(unsigned char *sha1)
 {
 	struct object_entry *e;
 
-	if (blocks->next_free == blocks->end)
+	if (blocks->next_free == blocks->end) {
 		alloc_objects(object_entry_alloc);
+		/*
+		 * Grow the arenas geometrically so that imports with
+		 * tens of millions of objects do not allocate (and
+		 * chain through) tens of thousands of little pools.
+		 */
+		if (object_entry_alloc < 1024 * 1024)
+			object_entry_alloc *= 2;
+	}
 
 	e = blocks->next_free++;
 	hashcpy(e->idx.sha1, sha1);
@@ -1016,6 +1024,24 @@ static void cycle_packfile(void)
 	start_packfile();
 }
 
+/*
+ * Scratch buffer for deflated object data, reused across calls to
+ * store_object() so that every stored object does not pay for a
+ * malloc/free round-trip of up to deflateBound(size) bytes.
+ */
+static void *deflate_buf;
+static size_t deflate_buf_size;
+
+static void *deflate_scratch(size_t len)
+{
+	if (deflate_buf_size < len) {
+		free(deflate_buf);
+		deflate_buf = xmalloc(len);
+		deflate_buf_size = len;
+	}
+	return deflate_buf;
+}
+
 static int store_object(
 	enum object_type type,
 	struct strbuf *dat,
@@ -1071,7 +1097,7 @@ static int store_object(
 		s.avail_in = dat->len;
 	}
 	s.avail_out = git_deflate_bound(&s, s.avail_in);
-	s.next_out = out = xmalloc(s.avail_out);
+	s.next_out = out = deflate_scratch(s.avail_out);
 	while (git_deflate(&s, Z_FINISH) == Z_OK)
 		; /* nothing */
 	git_deflate_end(&s);
@@ -1093,7 +1119,7 @@ static int store_object(
 			s.next_in = (void *)dat->buf;
 			s.avail_in = dat->len;
 			s.avail_out = git_deflate_bound(&s, s.avail_in);
-			s.next_out = out = xrealloc(out, s.avail_out);
+			s.next_out = out = deflate_scratch(s.avail_out);
 			while (git_deflate(&s, Z_FINISH) == Z_OK)
 				; /* nothing */
 			git_deflate_end(&s);
@@ -1136,7 +1162,6 @@ static int store_object(
 
 	e->idx.crc32 = crc32_end(pack_file);
 
-	free(out);
 	free(delta);
 	if (last) {
 		if (last->no_swap) {
@@ -15,6 +15,7 @@
 #include "version.h"
 #include "prio-queue.h"
 #include "sha1-array.h"
+#include "narrow.h"
 
 static int transfer_unpack_limit = -1;
 static int fetch_unpack_limit = -1;
@@ -24,8 +25,16 @@ static int no_done;
 static int fetch_fsck_objects = -1;
 static int transfer_fsck_objects = -1;
 static int agent_supported;
+static const char *negotiation_algorithm;
+static int negotiation_skipping;
 static struct lock_file shallow_lock;
 static const char *alternate_shallow_file;
+static struct string_list narrow_list = STRING_LIST_INIT_DUP;
+static int use_resume;
+static char *resume_pack_file;
+static char *resume_info_file;
+static off_t resume_expect;
+static int resume_capture;
 
 /* Remember to update object flag allocation in object.h */
 #define COMPLETE	(1U << 0)
@@ -45,6 +54,22 @@ static int marked;
 static struct prio_queue rev_list = { compare_commits_by_commit_date };
 static int non_common_revs, multi_ack, use_sideband, allow_tip_sha1_in_want;
 
+/*
+ * With the "skipping" negotiation algorithm, commits on rev_list
+ * carry two counters in their ->util field: how many more commits
+ * to walk past before the next "have" is sent (the ttl), and the
+ * size of the current step, so that each sent "have" can make the
+ * next step exponentially larger.
+ */
+#define SKIP_TTL(commit) ((uintptr_t)(commit)->util & 0xffff)
+#define SKIP_STEP(commit) ((uintptr_t)(commit)->util >> 16)
+#define MAX_SKIP_STEP 0x7fff
+
+static void set_skip(struct commit *commit, uintptr_t ttl, uintptr_t step)
+{
+	commit->util = (void *)((step << 16) | ttl);
+}
+
 static void rev_list_push(struct commit *commit, int mark)
 {
 	if (!(commit->object.flags & mark)) {
@@ -125,6 +150,7 @@ static const unsigned char *get_rev(void)
 	while (commit == NULL) {
 		unsigned int mark;
 		struct commit_list *parents;
+		uintptr_t ttl = 0, step = 0;
 
 		if (rev_list.nr == 0 || non_common_revs == 0)
 			return NULL;
@@ -133,6 +159,11 @@ static const unsigned char *get_rev(void)
 		parse_commit(commit);
 		parents = commit->parents;
 
+		if (negotiation_skipping) {
+			ttl = SKIP_TTL(commit);
+			step = SKIP_STEP(commit);
+		}
+
 		commit->object.flags |= POPPED;
 		if (!(commit->object.flags & COMMON))
 			non_common_revs--;
@@ -144,13 +175,29 @@ static const unsigned char *get_rev(void)
 		} else if (commit->object.flags & COMMON_REF)
 			/* send "have", and ignore ancestors */
 			mark = COMMON | SEEN;
-		else
+		else {
 			/* send "have", also for its ancestors */
 			mark = SEEN;
+			if (negotiation_skipping) {
+				if (ttl) {
+					/* walk past this one without a "have" */
+					ttl--;
+					commit = NULL;
+				} else {
+					step = step * 2 + 1;
+					if (step > MAX_SKIP_STEP)
+						step = MAX_SKIP_STEP;
+					ttl = step;
+				}
+			}
+		}
 
 		while (parents) {
-			if (!(parents->item->object.flags & SEEN))
+			if (!(parents->item->object.flags & SEEN)) {
+				if (negotiation_skipping && !(mark & COMMON))
+					set_skip(parents->item, ttl, step);
 				rev_list_push(parents->item, mark);
+			}
 			if (mark & COMMON)
 				mark_common(parents->item, 1, 0);
 			parents = parents->next;
@@ -263,8 +310,10 @@ static int find_common(struct fetch_pack_args *args,
 		for_each_ref(clear_marks, NULL);
 	marked = 1;
 
-	for_each_ref(rev_list_insert_ref, NULL);
-	for_each_alternate_ref(insert_one_alternate_ref, NULL);
+	if (!args->no_haves) {
+		for_each_ref(rev_list_insert_ref, NULL);
+		for_each_alternate_ref(insert_one_alternate_ref, NULL);
+	}
 
 	fetching = 0;
 	for ( ; refs ; refs = refs->next) {
@@ -298,6 +347,8 @@ static int find_common(struct fetch_pack_args *args,
 			if (args->use_thin_pack) strbuf_addstr(&c, " thin-pack");
 			if (args->no_progress)   strbuf_addstr(&c, " no-progress");
 			if (args->include_tag)   strbuf_addstr(&c, " include-tag");
+			if (args->no_blobs)      strbuf_addstr(&c, " no-blobs");
+			if (use_resume)         strbuf_addstr(&c, " resume");
 			if (prefer_ofs_delta)   strbuf_addstr(&c, " ofs-delta");
 			if (agent_supported)    strbuf_addf(&c, " agent=%s",
 							    git_user_agent_sanitized());
@@ -318,6 +369,11 @@ static int find_common(struct fetch_pack_args *args,
 		write_shallow_commits(&req_buf, 1, NULL);
 	if (args->depth > 0)
 		packet_buf_write(&req_buf, "deepen %d", args->depth);
+	if (narrow_list.nr) {
+		struct string_list_item *item;
+		for_each_string_list_item(item, &narrow_list)
+			packet_buf_write(&req_buf, "narrow %s\n", item->string);
+	}
 	packet_buf_flush(&req_buf);
 	state_len = req_buf.len;
 
@@ -658,6 +714,87 @@ static int sideband_demux(int in, int out, void *data)
 	return ret;
 }
 
+/*
+ * Resumable transfer state lives next to the path given with
+ * --resume-to: the raw pack bytes accumulate in the file itself and
+ * "<path>.info" records the pack identity the server announced
+ * together with the refs the pack was requested for, so that a later
+ * run can continue the download and still report the refs the cached
+ * pack actually contains.
+ */
+static void set_resume_state_paths(const char *base)
+{
+	resume_pack_file = xstrdup(base);
+	resume_info_file = xstrfmt("%s.info", base);
+}
+
+static void write_resume_info(const char *id, const struct ref *refs)
+{
+	static struct lock_file lock;
+	const struct ref *ref;
+	struct strbuf sb = STRBUF_INIT;
+	int fd;
+
+	strbuf_addf(&sb, "pack %s\n", id);
+	for (ref = refs; ref; ref = ref->next)
+		strbuf_addf(&sb, "ref %s %s\n",
+			    sha1_to_hex(ref->old_sha1), ref->name);
+	fd = hold_lock_file_for_update(&lock, resume_info_file,
+				       LOCK_DIE_ON_ERROR);
+	if (write_in_full(fd, sb.buf, sb.len) != sb.len ||
+	    commit_lock_file(&lock))
+		die_errno("cannot write resume state to '%s'",
+			  resume_info_file);
+	strbuf_release(&sb);
+}
+
+static struct ref *read_resume_info(char *id)
+{
+	struct ref *refs = NULL, **tail = &refs;
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+
+	fp = fopen(resume_info_file, "r");
+	if (!fp)
+		return NULL;
+	*id = '\0';
+	while (strbuf_getline(&line, fp, '\n') != EOF) {
+		const char *arg;
+		unsigned char sha1[20];
+
+		if (skip_prefix(line.buf, "pack ", &arg)) {
+			if (get_sha1_hex(arg, sha1) || arg[40])
+				break;
+			memcpy(id, arg, 41);
+			continue;
+		}
+		if (skip_prefix(line.buf, "ref ", &arg) &&
+		    !get_sha1_hex(arg, sha1) && arg[40] == ' ') {
+			struct ref *ref = alloc_ref(arg + 41);
+			hashcpy(ref->old_sha1, sha1);
+			*tail = ref;
+			tail = &ref->next;
+			continue;
+		}
+		break;
+	}
+	fclose(fp);
+	strbuf_release(&line);
+	if (!*id || !refs) {
+		free_refs(refs);
+		return NULL;
+	}
+	return refs;
+}
+
+static void clear_resume_state(void)
+{
+	unlink(resume_pack_file);
+	unlink(resume_info_file);
+	resume_capture = 0;
+	resume_expect = 0;
+}
+
 static int get_pack(struct fetch_pack_args *args,
 		    int xd[2], char **pack_lockfile)
 {
@@ -668,6 +805,7 @@ static int get_pack(struct fetch_pack_args *args,
 	const char **av, *cmd_name;
 	int do_keep = args->keep_pack;
 	struct child_process cmd = CHILD_PROCESS_INIT;
+	int pack_in;
 	int ret;
 
 	memset(&demux, 0, sizeof(demux));
@@ -686,13 +824,52 @@ static int get_pack(struct fetch_pack_args *args,
 	else
 		demux.out = xd[0];
 
+	if (resume_capture) {
+		/*
+		 * Spool the incoming bytes to the resume file before
+		 * feeding them to index-pack, so that whatever arrived
+		 * before a dropped connection survives for a later run
+		 * to continue from.
+		 */
+		char buf[8192];
+		struct stat st;
+		ssize_t sz;
+		int spool = open(resume_pack_file,
+				 O_WRONLY | O_CREAT | O_APPEND, 0666);
+
+		if (spool < 0)
+			die_errno("cannot open '%s'", resume_pack_file);
+		while ((sz = xread(demux.out, buf, sizeof(buf))) > 0)
+			if (write_in_full(spool, buf, sz) != sz)
+				die_errno("cannot write to '%s'",
+					  resume_pack_file);
+		if (sz < 0)
+			die_errno("error reading pack data");
+		if (fstat(spool, &st))
+			die_errno("cannot stat '%s'", resume_pack_file);
+		close(spool);
+		if (use_sideband) {
+			close(demux.out);
+			if (finish_async(&demux))
+				die("error in sideband demultiplexer");
+		}
+		if (resume_expect && st.st_size != resume_expect)
+			die("resumed pack is incomplete (%"PRIuMAX" of %"PRIuMAX" bytes);"
+			    " re-run to continue the transfer",
+			    (uintmax_t)st.st_size, (uintmax_t)resume_expect);
+		pack_in = open(resume_pack_file, O_RDONLY);
+		if (pack_in < 0)
+			die_errno("cannot open '%s'", resume_pack_file);
+	} else
+		pack_in = demux.out;
+
 	cmd.argv = argv;
 	av = argv;
 	*hdr_arg = 0;
 	if (!args->keep_pack && unpack_limit) {
 		struct pack_header header;
 
-		if (read_pack_header(demux.out, &header))
+		if (read_pack_header(pack_in, &header))
 			die("protocol error: bad pack header");
 		snprintf(hdr_arg, sizeof(hdr_arg),
 			 "--pack_header=%"PRIu32",%"PRIu32,
@@ -743,7 +920,7 @@ static int get_pack(struct fetch_pack_args *args,
 		*av++ = "--strict";
 	*av++ = NULL;
 
-	cmd.in = demux.out;
+	cmd.in = pack_in;
 	cmd.git_cmd = 1;
 	if (start_command(&cmd))
 		die("fetch-pack: unable to fork off %s", cmd_name);
@@ -752,7 +929,7 @@ static int get_pack(struct fetch_pack_args *args,
 		close(cmd.out);
 	}
 
-	if (!use_sideband)
+	if (!use_sideband && !resume_capture)
 		/* Closed by start_command() */
 		xd[0] = -1;
 
@@ -763,11 +940,63 @@ static int get_pack(struct fetch_pack_args *args,
 			ret == 0;
 	else
 		die("%s failed", cmd_name);
-	if (use_sideband && finish_async(&demux))
+	if (use_sideband && !resume_capture && finish_async(&demux))
 		die("error in sideband demultiplexer");
 	return 0;
 }
 
+/*
+ * Continue an interrupted resumable transfer: ask the server for the
+ * tail of the identified pack and report the refs recorded when the
+ * transfer began.  Returns NULL (with the stale state cleared) when
+ * the server no longer has the pack, in which case the caller starts
+ * over with an ordinary request on the same connection.
+ */
+static struct ref *resume_cached_pack(struct fetch_pack_args *args,
+				      int fd[2], char **pack_lockfile)
+{
+	char id[41];
+	struct ref *refs = read_resume_info(id);
+	struct stat st;
+	off_t offset = 0;
+	uintmax_t size;
+	char *line, *end;
+	const char *arg;
+
+	if (!refs)
+		return NULL;
+	if (!stat(resume_pack_file, &st))
+		offset = st.st_size;
+
+	packet_write(fd[1], "resume %s %"PRIuMAX"\n", id, (uintmax_t)offset);
+	packet_flush(fd[1]);
+
+	line = packet_read_line(fd[0], NULL);
+	if (!line || !skip_prefix(line, "resume-id ", &arg))
+		die("git fetch-pack: expected resume-id, got '%s'",
+		    line ? line : "EOF");
+	if (!strcmp(arg, "none")) {
+		warning("server no longer has the cached pack; restarting transfer");
+		clear_resume_state();
+		free_refs(refs);
+		return NULL;
+	}
+	if (strncmp(arg, id, 40) || arg[40] != ' ')
+		die("git fetch-pack: server offered pack '%s', expected '%s'",
+		    arg, id);
+	size = strtoumax(arg + 41, &end, 10);
+	if (end == arg + 41 || *end || size < offset)
+		die("git fetch-pack: invalid resume-id line '%s'", line);
+
+	use_sideband = 2;
+	resume_capture = 1;
+	resume_expect = size;
+	if (get_pack(args, fd, pack_lockfile))
+		die("git fetch-pack: fetch failed.");
+	clear_resume_state();
+	return refs;
+}
+
 static int cmp_ref_by_name(const void *a_, const void *b_)
 {
 	const struct ref *a = *((const struct ref **)a_);
@@ -792,6 +1021,38 @@ static struct ref *do_fetch_pack(struct fetch_pack_args *args,
 
 	if (is_repository_shallow() && !server_supports("shallow"))
 		die("Server does not support shallow clients");
+
+	/*
+	 * A narrow repository must keep requesting the same slice, so
+	 * combine the recorded paths with any newly requested ones and
+	 * insist the server understands them.
+	 */
+	if (args->narrow_paths) {
+		struct string_list_item *item;
+		struct string_list requested = STRING_LIST_INIT_DUP;
+
+		string_list_split(&requested, args->narrow_paths, '\n', -1);
+		for_each_string_list_item(item, &requested) {
+			if (!*item->string)
+				continue;
+			check_narrow_path(item->string);
+			string_list_insert(&narrow_list, item->string);
+		}
+		string_list_clear(&requested, 0);
+	}
+	get_narrow_paths(&narrow_list);
+	if (narrow_list.nr && !server_supports("narrow"))
+		die("Server does not support narrow clients");
+
+	/*
+	 * A blob-less repository must stay blob-less across fetches;
+	 * the exception is a no-haves fetch, which is how we ask the
+	 * origin for the very blobs we were promised.
+	 */
+	if (!args->no_haves && is_repository_blobless())
+		args->no_blobs = 1;
+	if (args->no_blobs && !server_supports("no-blobs"))
+		die("Server does not support blob-less clients");
 	if (server_supports("multi_ack_detailed")) {
 		if (args->verbose)
 			fprintf(stderr, "Server supports multi_ack_detailed\n");
@@ -842,6 +1103,19 @@ static struct ref *do_fetch_pack(struct fetch_pack_args *args,
 				agent_len, agent_feature);
 	}
 
+	if (args->resume_to && !args->stateless_rpc &&
+	    server_supports("resume")) {
+		struct ref *resumed;
+
+		set_resume_state_paths(args->resume_to);
+		resumed = resume_cached_pack(args, fd, pack_lockfile);
+		if (resumed) {
+			free_refs(ref);
+			return resumed;
+		}
+		use_resume = 1;
+	}
+
 	if (everything_local(args, &ref, sought, nr_sought)) {
 		packet_flush(fd[1]);
 		goto all_done;
@@ -862,8 +1136,37 @@ static struct ref *do_fetch_pack(struct fetch_pack_args *args,
 		alternate_shallow_file = setup_temporary_shallow(si->shallow);
 	else
 		alternate_shallow_file = NULL;
+	if (use_resume) {
+		/*
+		 * The server tells us up front whether this transfer can
+		 * be resumed; record the pack identity before any pack
+		 * data arrives so it survives a dropped connection.
+		 */
+		char *line = packet_read_line(fd[0], NULL);
+		const char *arg;
+
+		if (!line || !skip_prefix(line, "resume-id ", &arg))
+			die("git fetch-pack: expected resume-id, got '%s'",
+			    line ? line : "EOF");
+		if (strcmp(arg, "none")) {
+			unsigned char sha1[20];
+
+			if (get_sha1_hex(arg, sha1))
+				die("git fetch-pack: invalid resume-id line '%s'",
+				    line);
+			write_resume_info(arg, ref);
+			if (unlink(resume_pack_file) && errno != ENOENT)
+				die_errno("cannot remove stale '%s'",
+					  resume_pack_file);
+			resume_capture = 1;
+		}
+	}
 	if (get_pack(args, fd, pack_lockfile))
 		die("git fetch-pack: fetch failed.");
+	if (resume_capture)
+		clear_resume_state();
+	if (narrow_list.nr)
+		register_narrow_paths(&narrow_list);
 
  all_done:
 	return ref;
@@ -876,6 +1179,8 @@ static void fetch_pack_config(void)
 	git_config_get_bool("repack.usedeltabaseoffset", &prefer_ofs_delta);
 	git_config_get_bool("fetch.fsckobjects", &fetch_fsck_objects);
 	git_config_get_bool("transfer.fsckobjects", &transfer_fsck_objects);
+	git_config_get_string_const("fetch.negotiationalgorithm",
+				    &negotiation_algorithm);
 
 	git_config(git_default_config, NULL);
 }
@@ -1020,6 +1325,15 @@ struct ref *fetch_pack(struct fetch_pack_args *args,
 	struct shallow_info si;
 
 	fetch_pack_setup();
+	if (args->negotiation_algorithm)
+		negotiation_algorithm = args->negotiation_algorithm;
+	if (negotiation_algorithm) {
+		if (!strcmp(negotiation_algorithm, "skipping"))
+			negotiation_skipping = 1;
+		else if (strcmp(negotiation_algorithm, "default"))
+			warning("unknown fetch negotiation algorithm '%s'; "
+				"using 'default'", negotiation_algorithm);
+	}
 	if (nr_sought)
 		nr_sought = remove_duplicates_in_refs(sought, nr_sought);
 
@@ -8,6 +8,14 @@ struct sha1_array;
 
 struct fetch_pack_args {
 	const char *uploadpack;
+	const char *negotiation_algorithm;
+	/* newline-separated paths to narrow the fetch to */
+	const char *narrow_paths;
+	/*
+	 * Path where resumable transfer state is kept; an interrupted
+	 * download can be continued by a later run using the same path.
+	 */
+	const char *resume_to;
 	int unpacklimit;
 	int depth;
 	unsigned quiet:1;
@@ -25,6 +33,15 @@ struct fetch_pack_args {
 	unsigned self_contained_and_connected:1;
 	unsigned cloning:1;
 	unsigned update_shallow:1;
+	/* ask the server to leave all blobs out of the pack */
+	unsigned no_blobs:1;
+	/*
+	 * Advertise nothing as common, so the server packs the wants
+	 * even when they are reachable from our refs; used when
+	 * asking the origin of a blob-less repository for objects we
+	 * were promised.
+	 */
+	unsigned no_haves:1;
 };
 
 /*
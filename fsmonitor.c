@@ -0,0 +1,197 @@
+#include "cache.h"
+#include "dir.h"
+#include "ewah/ewok.h"
+#include "run-command.h"
+#include "strbuf.h"
+#include "fsmonitor.h"
+
+#define INDEX_EXTENSION_VERSION	1
+#define HOOK_INTERFACE_VERSION	1
+
+static void fsmonitor_ewah_callback(size_t pos, void *is)
+{
+	struct index_state *istate = is;
+
+	if (pos < istate->cache_nr)
+		istate->cache[pos]->ce_flags &= ~CE_FSMONITOR_VALID;
+}
+
+void read_fsmonitor_extension(struct index_state *istate, const void *data,
+			      unsigned long sz)
+{
+	const unsigned char *index = data;
+	const unsigned char *end = index + sz;
+	struct ewah_bitmap *fsmonitor_dirty;
+	int i;
+	uint32_t hdr_version;
+	uint32_t ewah_size;
+	int ret;
+
+	if (sz < sizeof(uint32_t) + 8 + sizeof(uint32_t)) {
+		error("corrupt fsmonitor extension (too short)");
+		return;
+	}
+
+	hdr_version = get_be32(index);
+	index += sizeof(uint32_t);
+	if (hdr_version != INDEX_EXTENSION_VERSION) {
+		error("bad fsmonitor version %d", hdr_version);
+		return;
+	}
+
+	istate->fsmonitor_last_update =
+		((uint64_t)get_be32(index) << 16 << 16) | get_be32(index + 4);
+	index += 8;
+
+	ewah_size = get_be32(index);
+	index += sizeof(uint32_t);
+
+	fsmonitor_dirty = ewah_new();
+	ret = ewah_read_mmap(fsmonitor_dirty, index, ewah_size);
+	if (ret != ewah_size) {
+		ewah_free(fsmonitor_dirty);
+		error("failed to parse fsmonitor extension");
+		istate->fsmonitor_last_update = 0;
+		return;
+	}
+	index += ewah_size;
+	if (index + 20 < end) {
+		ewah_free(fsmonitor_dirty);
+		error("corrupt fsmonitor extension (too long)");
+		istate->fsmonitor_last_update = 0;
+		return;
+	}
+
+	/* Mark all entries valid, then knock out the recorded dirty ones */
+	for (i = 0; i < istate->cache_nr; i++)
+		istate->cache[i]->ce_flags |= CE_FSMONITOR_VALID;
+	ewah_each_bit(fsmonitor_dirty, fsmonitor_ewah_callback, istate);
+	ewah_free(fsmonitor_dirty);
+}
+
+static int ewah_strbuf_write(void *out, const void *buf, size_t len)
+{
+	strbuf_add(out, buf, len);
+	return len;
+}
+
+void write_fsmonitor_extension(struct strbuf *sb, struct index_state *istate)
+{
+	unsigned char buf[12];
+	uint64_t tm = istate->fsmonitor_last_update;
+	struct ewah_bitmap *bitmap;
+	int i;
+	size_t fixup, ewah_start;
+
+	put_be32(buf, INDEX_EXTENSION_VERSION);
+	put_be32(buf + 4, (uint32_t)(tm >> 16 >> 16));
+	put_be32(buf + 8, (uint32_t)tm);
+	strbuf_add(sb, buf, sizeof(buf));
+
+	fixup = sb->len;
+	strbuf_add(sb, buf, sizeof(uint32_t)); /* we'll fix this up later */
+
+	ewah_start = sb->len;
+	bitmap = ewah_new();
+	for (i = 0; i < istate->cache_nr; i++)
+		if (!(istate->cache[i]->ce_flags & CE_FSMONITOR_VALID))
+			ewah_set(bitmap, i);
+	if (ewah_serialize_to(bitmap, ewah_strbuf_write, sb) < 0)
+		die("failed to serialize fsmonitor bitmap");
+	ewah_free(bitmap);
+
+	/* fix up size field */
+	put_be32(buf, sb->len - ewah_start);
+	memcpy(sb->buf + fixup, buf, sizeof(uint32_t));
+}
+
+/*
+ * Call the query-fsmonitor hook passing the time of the last saved results.
+ */
+static int query_fsmonitor(int version, uint64_t last_update,
+			   struct strbuf *query_result)
+{
+	struct child_process cp = CHILD_PROCESS_INIT;
+	char ver[64];
+	char date[64];
+	const char *argv[4];
+
+	if (!(argv[0] = core_fsmonitor))
+		return -1;
+
+	snprintf(ver, sizeof(ver), "%d", version);
+	snprintf(date, sizeof(date), "%" PRIuMAX, (uintmax_t)last_update);
+	argv[1] = ver;
+	argv[2] = date;
+	argv[3] = NULL;
+	cp.argv = argv;
+	cp.use_shell = 1;
+
+	return capture_command(&cp, query_result, 1024);
+}
+
+static void fsmonitor_refresh_callback(struct index_state *istate, const char *name)
+{
+	int pos = index_name_pos(istate, name, strlen(name));
+
+	if (pos >= 0)
+		istate->cache[pos]->ce_flags &= ~CE_FSMONITOR_VALID;
+}
+
+void refresh_fsmonitor(struct index_state *istate)
+{
+	struct strbuf query_result = STRBUF_INIT;
+	int query_success = 0;
+	size_t bol = 0; /* beginning of line */
+	uint64_t last_update;
+	char *buf;
+	int i;
+
+	if (!core_fsmonitor || istate->fsmonitor_has_run_once)
+		return;
+	istate->fsmonitor_has_run_once = 1;
+
+	/*
+	 * This could be racy so save the date/time now and query_fsmonitor
+	 * should be inclusive to ensure we don't miss potential changes.
+	 */
+	last_update = getnanotime();
+
+	/*
+	 * If we have a last update time, call query_fsmonitor for the set of
+	 * changes since that time, else assume everything is possibly dirty
+	 * and check it all.
+	 */
+	if (istate->fsmonitor_last_update) {
+		query_success = !query_fsmonitor(HOOK_INTERFACE_VERSION,
+			istate->fsmonitor_last_update, &query_result);
+		trace_performance_since(last_update, "fsmonitor process '%s'",
+			core_fsmonitor);
+	}
+
+	if (query_success && query_result.buf[0] != '/') {
+		/* Mark all entries returned by the monitor as dirty */
+		buf = query_result.buf;
+		bol = 0;
+		for (i = 0; i < query_result.len; i++) {
+			if (buf[i] != '\0')
+				continue;
+			fsmonitor_refresh_callback(istate, buf + bol);
+			bol = i + 1;
+		}
+		if (bol < query_result.len)
+			fsmonitor_refresh_callback(istate, buf + bol);
+	} else {
+		/*
+		 * We failed to get a response or the monitor requested a
+		 * full scan; forget everything we thought we knew.
+		 */
+		for (i = 0; i < istate->cache_nr; i++)
+			istate->cache[i]->ce_flags &= ~CE_FSMONITOR_VALID;
+	}
+	strbuf_release(&query_result);
+
+	/* Now that we've updated istate, save the last_update time */
+	istate->fsmonitor_last_update = last_update;
+	istate->cache_changed |= FSMONITOR_CHANGED;
+}
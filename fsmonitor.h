@@ -0,0 +1,27 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+struct index_state;
+struct strbuf;
+
+/*
+ * Parse the CACHE_EXT_FSMONITOR extension: mark every cache entry
+ * that was clean when the index was written with CE_FSMONITOR_VALID
+ * and remember when the filesystem monitor was last consulted.
+ */
+void read_fsmonitor_extension(struct index_state *istate, const void *data,
+			      unsigned long sz);
+
+/* Serialize the extension; only called when core.fsmonitor is set. */
+void write_fsmonitor_extension(struct strbuf *sb, struct index_state *istate);
+
+/*
+ * Invoke the core.fsmonitor hook once per index and drop
+ * CE_FSMONITOR_VALID from every entry the monitor reports as
+ * modified since the last query.  If the hook is unset, fails, or
+ * asks for a full scan, every entry is invalidated and refresh
+ * behaves exactly as before.
+ */
+void refresh_fsmonitor(struct index_state *istate);
+
+#endif /* FSMONITOR_H */
@@ -842,6 +842,11 @@ To restore the original branch and stop patching run \"\$cmdline --abort\"."
 
 	say "$(eval_gettext "Applying: \$FIRSTLINE")"
 
+	# "git apply --write-tree" reports the tree the updated index
+	# would commit, saving us a separate "git write-tree" that would
+	# re-read the whole index; a cleared $tree means we must compute
+	# it ourselves later.
+	tree=
 	case "$resolved" in
 	'')
 		# When we are allowed to fall back to 3-way later, don't give
@@ -851,7 +856,7 @@ To restore the original branch and stop patching run \"\$cmdline --abort\"."
 		then
 			squelch='>/dev/null 2>&1 '
 		fi
-		eval "git apply $squelch$git_apply_opt"' --index "$dotest/patch"'
+		tree=$(eval "git apply $squelch$git_apply_opt"' --index --write-tree "$dotest/patch"')
 		apply_status=$?
 		;;
 	t)
@@ -891,6 +896,7 @@ did you forget to use 'git add'?"
 		    }
 		    # clear apply_status -- we have successfully merged.
 		    apply_status=0
+		    tree=
 		fi
 	fi
 	if test $apply_status != 0
@@ -907,9 +913,14 @@ did you forget to use 'git add'?"
 	if test -x "$GIT_DIR"/hooks/pre-applypatch
 	then
 		"$GIT_DIR"/hooks/pre-applypatch || stop_here $this
+		# the hook may have updated the index
+		tree=
 	fi
 
-	tree=$(git write-tree) &&
+	if test -z "$tree"
+	then
+		tree=$(git write-tree)
+	fi &&
 	commit=$(
 		if test -n "$ignore_date"
 		then
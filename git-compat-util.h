@@ -141,6 +141,9 @@
 #include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#ifndef NO_WRITEV
+#include <sys/uio.h>
+#endif
 #include <termios.h>
 #ifndef NO_SYS_SELECT_H
 #include <sys/select.h>
@@ -523,6 +526,15 @@ extern int git_lstat(const char *, struct stat *);
 #define pread git_pread
 extern ssize_t git_pread(int fd, void *buf, size_t count, off_t offset);
 #endif
+
+#ifdef NO_WRITEV
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+#define writev gitwritev
+extern ssize_t gitwritev(int fd, const struct iovec *iov, int iovcnt);
+#endif
 /*
  * Forward decl that will remind us if its twin in cache.h changes.
  * This function is used in compat/pread.c.  But we can't include
@@ -461,6 +461,71 @@ record_in_rewritten() {
 	esac
 }
 
+# Collect the run of plain "pick" commands at the front of the todo
+# list into $batch_shas (full sha1s) and $batch_count.  The run ends at
+# the first command that is not a pick, names an unresolvable commit
+# (the one-at-a-time machinery has the error message for that), or
+# picks an empty commit (which needs its own --allow-empty).
+collect_pick_batch () {
+	batch_shas=
+	batch_count=0
+	while read -r batch_command batch_sha1 batch_rest
+	do
+		case "$batch_command" in
+		pick|p) ;;
+		*) break ;;
+		esac
+		full=$(git rev-parse --verify --quiet "$batch_sha1") || break
+		is_empty_commit "$full" && break
+		batch_shas="$batch_shas $full"
+		batch_count=$(($batch_count + 1))
+	done <"$todo"
+}
+
+# Hand a run of consecutive picks to a single cherry-pick invocation;
+# the sequencer replays them one after another inside one process, so
+# the repository setup, config parsing and index read happen once per
+# run instead of once per pick.  The bookkeeping the one-at-a-time
+# machinery does per pick is reconstructed afterwards from the commits
+# that actually landed.
+do_pick_batch () {
+	batch_base=$(git rev-parse HEAD)
+	ff=--ff
+	test -z "$force_rebase" || ff=
+	batch_status=0
+	output eval git cherry-pick \
+		${gpg_sign_opt:+$(git rev-parse --sq-quote "$gpg_sign_opt")} \
+		"$strategy_args" $ff $batch_shas || batch_status=$?
+
+	set -- $batch_shas
+	for new in $(git rev-list --reverse "$batch_base"..HEAD)
+	do
+		mark_action_done
+		if test $# = 1 && test $batch_status = 0
+		then
+			# The last pick of a fully successful run; let
+			# record_in_rewritten decide whether to flush or
+			# to wait for a following squash/fixup.
+			record_in_rewritten "$1"
+		else
+			echo "$1 $new" >> "$rewritten_list"
+		fi
+		shift
+	done
+
+	if test $batch_status != 0
+	then
+		# The sequencer stopped at the first pick it could not
+		# apply and kept its own continuation state, which would
+		# get in the way of the rest of the rebase; drop it and
+		# report the stop the way a one-at-a-time pick would.
+		rm -rf "$GIT_DIR"/sequencer
+		read -r command sha1 rest <"$todo"
+		mark_action_done
+		die_with_patch $sha1 "Could not apply $sha1... $rest"
+	fi
+}
+
 do_pick () {
 	if test "$(git rev-parse HEAD)" = "$squash_onto"
 	then
@@ -495,9 +560,21 @@ do_next () {
 	pick|p)
 		comment_for_reflog pick
 
-		mark_action_done
-		do_pick $sha1 "$rest"
-		record_in_rewritten $sha1
+		batch_count=0
+		if test ! -d "$rewritten" &&
+			{ test -z "$squash_onto" ||
+			  test "$(git rev-parse HEAD)" != "$squash_onto"; }
+		then
+			collect_pick_batch
+		fi
+		if test $batch_count -gt 1
+		then
+			do_pick_batch
+		else
+			mark_action_done
+			do_pick $sha1 "$rest"
+			record_in_rewritten $sha1
+		fi
 		;;
 	reword|r)
 		comment_for_reflog reword
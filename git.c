@@ -2,6 +2,7 @@
 #include "exec_cmd.h"
 #include "help.h"
 #include "run-command.h"
+#include "trace-event.h"
 
 const char git_usage_string[] =
 	"git [--version] [--help] [-C <path>] [-c name=value]\n"
@@ -348,6 +349,7 @@ static int run_builtin(struct cmd_struct *p, int argc, const char **argv)
 	trace_argv_printf(argv, "trace: built-in: git");
 
 	status = p->fn(argc, argv, prefix);
+	trace_event_cmd_exit(status);
 	if (status)
 		return status;
 
@@ -383,6 +385,8 @@ static struct cmd_struct commands[] = {
 	{ "check-mailmap", cmd_check_mailmap, RUN_SETUP },
 	{ "check-ref-format", cmd_check_ref_format },
 	{ "checkout", cmd_checkout, RUN_SETUP | NEED_WORK_TREE },
+	{ "checkout--worker", cmd_checkout__worker,
+		RUN_SETUP | NEED_WORK_TREE },
 	{ "checkout-index", cmd_checkout_index,
 		RUN_SETUP | NEED_WORK_TREE},
 	{ "cherry", cmd_cherry, RUN_SETUP },
@@ -448,6 +452,7 @@ static struct cmd_struct commands[] = {
 	{ "push", cmd_push, RUN_SETUP },
 	{ "read-tree", cmd_read_tree, RUN_SETUP },
 	{ "receive-pack", cmd_receive_pack },
+	{ "ref-journal", cmd_ref_journal, RUN_SETUP },
 	{ "reflog", cmd_reflog, RUN_SETUP },
 	{ "remote", cmd_remote, RUN_SETUP },
 	{ "remote-ext", cmd_remote_ext },
@@ -461,6 +466,7 @@ static struct cmd_struct commands[] = {
 	{ "revert", cmd_revert, RUN_SETUP | NEED_WORK_TREE },
 	{ "rm", cmd_rm, RUN_SETUP },
 	{ "send-pack", cmd_send_pack, RUN_SETUP },
+	{ "serve-commands", cmd_serve_commands },
 	{ "shortlog", cmd_shortlog, RUN_SETUP_GENTLY | USE_PAGER },
 	{ "show", cmd_show, RUN_SETUP },
 	{ "show-branch", cmd_show_branch, RUN_SETUP },
@@ -477,6 +483,7 @@ static struct cmd_struct commands[] = {
 	{ "update-server-info", cmd_update_server_info, RUN_SETUP },
 	{ "upload-archive", cmd_upload_archive },
 	{ "upload-archive--writer", cmd_upload_archive_writer },
+	{ "upload-notify", cmd_upload_notify },
 	{ "var", cmd_var, RUN_SETUP_GENTLY },
 	{ "verify-commit", cmd_verify_commit, RUN_SETUP },
 	{ "verify-pack", cmd_verify_pack },
@@ -502,6 +509,24 @@ int is_builtin(const char *s)
 	return !!get_builtin(s);
 }
 
+/*
+ * Run a builtin in the current process on behalf of "git
+ * serve-commands", which has already taken care of process setup.
+ * Commands that must not run inside an existing repository are
+ * refused.  Returns the command's exit status.
+ */
+int run_builtin_command(int argc, const char **argv)
+{
+	struct cmd_struct *builtin;
+
+	builtin = get_builtin(argv[0]);
+	if (!builtin)
+		return error("'%s' is not a builtin command", argv[0]);
+	if (builtin->option & NO_SETUP)
+		return error("'%s' cannot be run by a command server", argv[0]);
+	return run_builtin(builtin, argc, argv);
+}
+
 static void handle_builtin(int argc, const char **argv)
 {
 	const char *cmd = argv[0];
@@ -641,6 +666,8 @@ int main(int argc, char **av)
 
 	trace_command_performance(argv);
 
+	trace_event_cmd_start(argv);
+
 	/*
 	 * "git-xxxx" is the same as "git xxxx", but we obviously:
 	 *
@@ -4,6 +4,7 @@
 #include "graph.h"
 #include "diff.h"
 #include "revision.h"
+#include "hashmap.h"
 
 /* Internal API */
 
@@ -83,6 +84,48 @@ static void strbuf_write_column(struct strbuf *sb, const struct column *c,
 		strbuf_addstr(sb, column_get_color_code(column_colors_max));
 }
 
+/*
+ * A hashmap entry recording at which index in the columns (or
+ * new_columns) array the column for a given commit lives, so that
+ * looking up a commit's column is O(1) instead of a scan over all
+ * active columns.
+ */
+struct column_slot {
+	struct hashmap_entry ent;
+	const struct commit *commit;
+	int index;
+};
+
+static int column_slot_cmp(const void *entry, const void *entry_or_key,
+			   const void *keydata)
+{
+	const struct column_slot *a = entry;
+	const struct column_slot *b = entry_or_key;
+
+	return a->commit != b->commit;
+}
+
+static struct column_slot *column_slot_get(const struct hashmap *map,
+					   const struct commit *commit)
+{
+	struct column_slot key;
+
+	hashmap_entry_init(&key, sha1hash(commit->object.sha1));
+	key.commit = commit;
+	return hashmap_get(map, &key, NULL);
+}
+
+static void column_slot_add(struct hashmap *map,
+			    const struct commit *commit, int index)
+{
+	struct column_slot *slot = xmalloc(sizeof(*slot));
+
+	hashmap_entry_init(slot, sha1hash(commit->object.sha1));
+	slot->commit = commit;
+	slot->index = index;
+	hashmap_add(map, slot);
+}
+
 struct git_graph {
 	/*
 	 * The commit currently being processed
@@ -162,6 +205,16 @@ struct git_graph {
 	 * Only valid when state is GRAPH_COLLAPSING.
 	 */
 	struct column *new_columns;
+	/*
+	 * Maps each commit that owns an entry in the columns array to
+	 * its index in that array.  Kept in sync with columns by
+	 * graph_update_columns().
+	 */
+	struct hashmap column_map;
+	/*
+	 * The same, for the new_columns array.
+	 */
+	struct hashmap new_column_map;
 	/*
 	 * An array that tracks the current state of each
 	 * character in the output line during state GRAPH_COLLAPSING.
@@ -238,6 +291,8 @@ struct git_graph *graph_init(struct rev_info *opt)
 				 graph->column_capacity);
 	graph->new_columns = xmalloc(sizeof(struct column) *
 				     graph->column_capacity);
+	hashmap_init(&graph->column_map, column_slot_cmp, 0);
+	hashmap_init(&graph->new_column_map, column_slot_cmp, 0);
 	graph->mapping = xmalloc(sizeof(int) * 2 * graph->column_capacity);
 	graph->new_mapping = xmalloc(sizeof(int) * 2 * graph->column_capacity);
 
@@ -361,11 +416,10 @@ static void graph_increment_column_color(struct git_graph *graph)
 static unsigned short graph_find_commit_color(const struct git_graph *graph,
 					      const struct commit *commit)
 {
-	int i;
-	for (i = 0; i < graph->num_columns; i++) {
-		if (graph->columns[i].commit == commit)
-			return graph->columns[i].color;
-	}
+	struct column_slot *slot = column_slot_get(&graph->column_map, commit);
+
+	if (slot)
+		return graph->columns[slot->index].color;
 	return graph_get_current_column_color(graph);
 }
 
@@ -373,23 +427,24 @@ static void graph_insert_into_new_columns(struct git_graph *graph,
 					  struct commit *commit,
 					  int *mapping_index)
 {
-	int i;
+	struct column_slot *slot;
 
 	/*
 	 * If the commit is already in the new_columns list, we don't need to
 	 * add it.  Just update the mapping correctly.
 	 */
-	for (i = 0; i < graph->num_new_columns; i++) {
-		if (graph->new_columns[i].commit == commit) {
-			graph->mapping[*mapping_index] = i;
-			*mapping_index += 2;
-			return;
-		}
+	slot = column_slot_get(&graph->new_column_map, commit);
+	if (slot) {
+		graph->mapping[*mapping_index] = slot->index;
+		*mapping_index += 2;
+		return;
 	}
 
 	/*
 	 * This commit isn't already in new_columns.  Add it.
 	 */
+	column_slot_add(&graph->new_column_map, commit,
+			graph->num_new_columns);
 	graph->new_columns[graph->num_new_columns].commit = commit;
 	graph->new_columns[graph->num_new_columns].color = graph_find_commit_color(graph, commit);
 	graph->mapping[*mapping_index] = graph->num_new_columns;
@@ -436,6 +491,7 @@ static void graph_update_columns(struct git_graph *graph)
 {
 	struct commit_list *parent;
 	struct column *tmp_columns;
+	struct hashmap tmp_map;
 	int max_new_columns;
 	int mapping_idx;
 	int i, seen_this, is_commit_in_columns;
@@ -455,6 +511,17 @@ static void graph_update_columns(struct git_graph *graph)
 	graph->new_columns = tmp_columns;
 	graph->num_new_columns = 0;
 
+	/*
+	 * The index map built for new_columns describes what is now the
+	 * columns array, so it swaps along with it.  The map for the
+	 * next commit's columns starts out empty.
+	 */
+	tmp_map = graph->column_map;
+	graph->column_map = graph->new_column_map;
+	graph->new_column_map = tmp_map;
+	hashmap_free(&graph->new_column_map, 1);
+	hashmap_init(&graph->new_column_map, column_slot_cmp, 0);
+
 	/*
 	 * Now update new_columns and mapping with the information for the
 	 * commit after this one.
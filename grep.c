@@ -5,7 +5,6 @@
 #include "diff.h"
 #include "diffcore.h"
 
-static int grep_source_load(struct grep_source *gs);
 static int grep_source_is_binary(struct grep_source *gs);
 
 static struct grep_opt grep_defaults;
@@ -1183,11 +1182,6 @@ static inline void grep_attr_unlock(void)
 		pthread_mutex_unlock(&grep_attr_mutex);
 }
 
-/*
- * Same as git_attr_mutex, but protecting the thread-unsafe object db access.
- */
-pthread_mutex_t grep_read_mutex;
-
 #else
 #define grep_attr_lock()
 #define grep_attr_unlock()
@@ -1374,11 +1368,12 @@ static int fill_textconv_grep(struct userdiff_driver *driver,
 	/*
 	 * fill_textconv is not remotely thread-safe; it may load objects
 	 * behind the scenes, and it modifies the global diff tempfile
-	 * structure.
+	 * structure.  The object read lock gives us the mutual exclusion
+	 * we need with the other object readers.
 	 */
-	grep_read_lock();
+	obj_read_lock();
 	size = fill_textconv(driver, df, &buf);
-	grep_read_unlock();
+	obj_read_unlock();
 	free_filespec(df);
 
 	/*
@@ -1665,6 +1660,7 @@ void grep_source_init(struct grep_source *gs, enum grep_source_type type,
 	gs->path = xstrdup_or_null(path);
 	gs->buf = NULL;
 	gs->size = 0;
+	gs->load_error = 0;
 	gs->driver = NULL;
 
 	switch (type) {
@@ -1710,9 +1706,7 @@ static int grep_source_load_sha1(struct grep_source *gs)
 {
 	enum object_type type;
 
-	grep_read_lock();
 	gs->buf = read_sha1_file(gs->identifier, &type, &gs->size);
-	grep_read_unlock();
 
 	if (!gs->buf)
 		return error(_("'%s': unable to read %s"),
@@ -1756,20 +1750,35 @@ static int grep_source_load_file(struct grep_source *gs)
 	return 0;
 }
 
-static int grep_source_load(struct grep_source *gs)
+int grep_source_load(struct grep_source *gs)
 {
+	int ret;
+
 	if (gs->buf)
 		return 0;
+	/*
+	 * Do not retry (and re-report) a failed load; with threaded
+	 * grep the source may have been loaded ahead of us already.
+	 */
+	if (gs->load_error)
+		return -1;
 
 	switch (gs->type) {
 	case GREP_SOURCE_FILE:
-		return grep_source_load_file(gs);
+		ret = grep_source_load_file(gs);
+		break;
 	case GREP_SOURCE_SHA1:
-		return grep_source_load_sha1(gs);
+		ret = grep_source_load_sha1(gs);
+		break;
 	case GREP_SOURCE_BUF:
-		return gs->buf ? 0 : -1;
+		ret = gs->buf ? 0 : -1;
+		break;
+	default:
+		die("BUG: invalid grep_source type");
 	}
-	die("BUG: invalid grep_source type");
+	if (ret)
+		gs->load_error = 1;
+	return ret;
 }
 
 void grep_source_load_driver(struct grep_source *gs)
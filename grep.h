@@ -166,6 +166,7 @@ struct grep_source {
 
 	char *buf;
 	unsigned long size;
+	int load_error;
 
 	char *path; /* for attribute lookups */
 	struct userdiff_driver *driver;
@@ -177,6 +178,7 @@ void grep_source_init(struct grep_source *gs, enum grep_source_type type,
 void grep_source_clear_data(struct grep_source *gs);
 void grep_source_clear(struct grep_source *gs);
 void grep_source_load_driver(struct grep_source *gs);
+int grep_source_load(struct grep_source *gs);
 
 
 int grep_source(struct grep_opt *opt, struct grep_source *gs);
@@ -191,23 +193,7 @@ extern int grep_threads_ok(const struct grep_opt *opt);
  */
 extern int grep_use_locks;
 extern pthread_mutex_t grep_attr_mutex;
-extern pthread_mutex_t grep_read_mutex;
 
-static inline void grep_read_lock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_lock(&grep_read_mutex);
-}
-
-static inline void grep_read_unlock(void)
-{
-	if (grep_use_locks)
-		pthread_mutex_unlock(&grep_read_mutex);
-}
-
-#else
-#define grep_read_lock()
-#define grep_read_unlock()
 #endif
 
 #endif
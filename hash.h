@@ -0,0 +1,66 @@
+#ifndef HASH_H
+#define HASH_H
+
+/*
+ * Object names are still SHA-1 everywhere, but code that hashes
+ * object data should go through the algorithm description below
+ * instead of calling git_SHA1_*() directly, so that a repository
+ * can eventually select a different hash function at run time.
+ */
+
+/* The length in bytes and in hex digits of an object name (SHA-1 value). */
+#define GIT_SHA1_RAWSZ 20
+#define GIT_SHA1_HEXSZ (2 * GIT_SHA1_RAWSZ)
+
+/* The longest hash we support; used to size buffers. */
+#define GIT_MAX_RAWSZ GIT_SHA1_RAWSZ
+#define GIT_MAX_HEXSZ GIT_SHA1_HEXSZ
+
+#define GIT_HASH_UNKNOWN 0
+#define GIT_HASH_SHA1 1
+/* Number of algorithms supported (including unknown). */
+#define GIT_HASH_NALGOS 2
+
+/* A suitable hashing context for any supported algorithm. */
+typedef union git_hash_ctx {
+	git_SHA_CTX sha1;
+} git_hash_ctx;
+
+typedef void (*git_hash_init_fn)(git_hash_ctx *ctx);
+typedef void (*git_hash_update_fn)(git_hash_ctx *ctx, const void *in, size_t len);
+typedef void (*git_hash_final_fn)(unsigned char *hash, git_hash_ctx *ctx);
+
+struct git_hash_algo {
+	/*
+	 * The name of the algorithm, as appears in the config file
+	 * and in messages.
+	 */
+	const char *name;
+
+	/* A four-byte version identifier, used in pack indices. */
+	uint32_t format_id;
+
+	/* The length of the hash in binary. */
+	size_t rawsz;
+
+	/* The length of the hash in hex characters. */
+	size_t hexsz;
+
+	/* The hash initialization function. */
+	git_hash_init_fn init_fn;
+
+	/* The hash update function. */
+	git_hash_update_fn update_fn;
+
+	/* The hash finalization function. */
+	git_hash_final_fn final_fn;
+};
+extern const struct git_hash_algo hash_algos[GIT_HASH_NALGOS];
+
+/*
+ * Return the GIT_HASH_* constant for the named algorithm, or
+ * GIT_HASH_UNKNOWN if it is not recognized.
+ */
+extern int hash_algo_by_name(const char *name);
+
+#endif
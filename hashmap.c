@@ -50,6 +50,23 @@ unsigned int memihash(const void *buf, size_t len)
 	return hash;
 }
 
+/*
+ * Incorporate another chunk of data into a memihash
+ * computed earlier.
+ */
+unsigned int memihash_cont(unsigned int hash_seed, const void *buf, size_t len)
+{
+	unsigned int hash = hash_seed;
+	unsigned char *ucbuf = (unsigned char *) buf;
+	while (len--) {
+		unsigned int c = *ucbuf++;
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		hash = (hash * FNV32_PRIME) ^ c;
+	}
+	return hash;
+}
+
 #define HASHMAP_INITIAL_SIZE 64
 /* grow / shrink by 2^2 */
 #define HASHMAP_RESIZE_BITS 2
@@ -87,12 +104,51 @@ static inline unsigned int bucket(const struct hashmap *map,
 	return key->hash & (map->tablesize - 1);
 }
 
+/*
+ * Move up to 'nr' buckets from the old table into the current one.
+ * Frees the old table once the last bucket has been migrated.
+ */
+static void migrate_buckets(struct hashmap *map, unsigned int nr)
+{
+	while (map->old_table && nr--) {
+		struct hashmap_entry *e = map->old_table[map->migrate_pos];
+		while (e) {
+			struct hashmap_entry *next = e->next;
+			unsigned int b = bucket(map, e);
+			e->next = map->table[b];
+			map->table[b] = e;
+			e = next;
+		}
+		map->old_table[map->migrate_pos] = NULL;
+		if (++map->migrate_pos >= map->old_tablesize) {
+			free(map->old_table);
+			map->old_table = NULL;
+		}
+	}
+}
+
+/*
+ * Migrate two buckets per insertion or removal; entries trickle in
+ * slower than that, so a pending resize always completes before the
+ * next one is due.
+ */
+#define HASHMAP_MIGRATE_PER_OP 2
+
 static void rehash(struct hashmap *map, unsigned int newsize)
 {
 	unsigned int i, oldsize = map->tablesize;
 	struct hashmap_entry **oldtable = map->table;
 
+	/* finish any resize that is still in flight */
+	migrate_buckets(map, map->old_tablesize);
+
 	alloc_table(map, newsize);
+	if (map->incremental_resize) {
+		map->old_table = oldtable;
+		map->old_tablesize = oldsize;
+		map->migrate_pos = 0;
+		return;
+	}
 	for (i = 0; i < oldsize; i++) {
 		struct hashmap_entry *e = oldtable[i];
 		while (e) {
@@ -106,12 +162,23 @@ static void rehash(struct hashmap *map, unsigned int newsize)
 	free(oldtable);
 }
 
+static inline unsigned int old_bucket(const struct hashmap *map,
+		const struct hashmap_entry *key)
+{
+	return key->hash & (map->old_tablesize - 1);
+}
+
 static inline struct hashmap_entry **find_entry_ptr(const struct hashmap *map,
 		const struct hashmap_entry *key, const void *keydata)
 {
 	struct hashmap_entry **e = &map->table[bucket(map, key)];
 	while (*e && !entry_equals(map, *e, key, keydata))
 		e = &(*e)->next;
+	if (!*e && map->old_table) {
+		e = &map->old_table[old_bucket(map, key)];
+		while (*e && !entry_equals(map, *e, key, keydata))
+			e = &(*e)->next;
+	}
 	return e;
 }
 
@@ -126,6 +193,9 @@ void hashmap_init(struct hashmap *map, hashmap_cmp_fn equals_function,
 	unsigned int size = HASHMAP_INITIAL_SIZE;
 	map->size = 0;
 	map->cmpfn = equals_function ? equals_function : always_equal;
+	map->old_table = NULL;
+	map->old_tablesize = map->migrate_pos = 0;
+	map->incremental_resize = 0;
 
 	/* calculate initial table size and allocate the table */
 	initial_size = (unsigned int) ((uint64_t) initial_size * 100
@@ -147,6 +217,7 @@ void hashmap_free(struct hashmap *map, int free_entries)
 			free(e);
 	}
 	free(map->table);
+	free(map->old_table);
 	memset(map, 0, sizeof(*map));
 }
 
@@ -157,10 +228,26 @@ void *hashmap_get(const struct hashmap *map, const void *key, const void *keydat
 
 void *hashmap_get_next(const struct hashmap *map, const void *entry)
 {
-	struct hashmap_entry *e = ((struct hashmap_entry *) entry)->next;
+	const struct hashmap_entry *key = entry;
+	struct hashmap_entry *e = key->next;
 	for (; e; e = e->next)
-		if (entry_equals(map, entry, e, NULL))
+		if (entry_equals(map, key, e, NULL))
 			return e;
+	if (map->old_table) {
+		unsigned int b = old_bucket(map, key);
+		/*
+		 * During an incremental resize, duplicates may be split
+		 * between the two tables.  Continue into the old bucket,
+		 * unless 'entry' itself came from it (then we have seen
+		 * the new-table duplicates already and are done).
+		 */
+		for (e = map->old_table[b]; e; e = e->next)
+			if (e == key)
+				return NULL;
+		for (e = map->old_table[b]; e; e = e->next)
+			if (entry_equals(map, key, e, NULL))
+				return e;
+	}
 	return NULL;
 }
 
@@ -168,6 +255,8 @@ void hashmap_add(struct hashmap *map, void *entry)
 {
 	unsigned int b = bucket(map, entry);
 
+	migrate_buckets(map, HASHMAP_MIGRATE_PER_OP);
+
 	/* add entry */
 	((struct hashmap_entry *) entry)->next = map->table[b];
 	map->table[b] = entry;
@@ -181,7 +270,11 @@ void hashmap_add(struct hashmap *map, void *entry)
 void *hashmap_remove(struct hashmap *map, const void *key, const void *keydata)
 {
 	struct hashmap_entry *old;
-	struct hashmap_entry **e = find_entry_ptr(map, key, keydata);
+	struct hashmap_entry **e;
+
+	migrate_buckets(map, HASHMAP_MIGRATE_PER_OP);
+
+	e = find_entry_ptr(map, key, keydata);
 	if (!*e)
 		return NULL;
 
@@ -215,15 +308,21 @@ void *hashmap_iter_next(struct hashmap_iter *iter)
 {
 	struct hashmap_entry *current = iter->next;
 	for (;;) {
+		unsigned int pos;
 		if (current) {
 			iter->next = current->next;
 			return current;
 		}
 
-		if (iter->tablepos >= iter->map->tablesize)
+		/* positions beyond the table continue into the old table */
+		pos = iter->tablepos++;
+		if (pos < iter->map->tablesize)
+			current = iter->map->table[pos];
+		else if (iter->map->old_table &&
+			 pos - iter->map->tablesize < iter->map->old_tablesize)
+			current = iter->map->old_table[pos - iter->map->tablesize];
+		else
 			return NULL;
-
-		current = iter->map->table[iter->tablepos++];
 	}
 }
 
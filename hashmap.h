@@ -12,6 +12,8 @@ extern unsigned int strhash(const char *buf);
 extern unsigned int strihash(const char *buf);
 extern unsigned int memhash(const void *buf, size_t len);
 extern unsigned int memihash(const void *buf, size_t len);
+extern unsigned int memihash_cont(unsigned int hash_seed, const void *buf,
+		size_t len);
 
 static inline unsigned int sha1hash(const unsigned char *sha1)
 {
@@ -36,8 +38,17 @@ typedef int (*hashmap_cmp_fn)(const void *entry, const void *entry_or_key,
 
 struct hashmap {
 	struct hashmap_entry **table;
+
+	/*
+	 * Previous table that is still being migrated to 'table'; only
+	 * non-NULL in incremental resize mode while a resize is in
+	 * progress.  Entries live in exactly one of the two tables.
+	 */
+	struct hashmap_entry **old_table;
 	hashmap_cmp_fn cmpfn;
 	unsigned int size, tablesize, grow_at, shrink_at;
+	unsigned int old_tablesize, migrate_pos;
+	unsigned int incremental_resize;
 };
 
 struct hashmap_iter {
@@ -52,6 +63,17 @@ extern void hashmap_init(struct hashmap *map, hashmap_cmp_fn equals_function,
 		size_t initial_size);
 extern void hashmap_free(struct hashmap *map, int free_entries);
 
+/*
+ * Amortize resizing over subsequent hashmap_add()/hashmap_remove()
+ * calls instead of reinserting all entries at once, to avoid a
+ * latency spike when a large table grows.  Lookups during a pending
+ * resize check both tables and are slightly slower.
+ */
+static inline void hashmap_set_incremental_resize(struct hashmap *map, int value)
+{
+	map->incremental_resize = value;
+}
+
 /* hashmap_entry functions */
 
 static inline void hashmap_entry_init(void *entry, unsigned int hash)
@@ -8,6 +8,9 @@
 #include "string-list.h"
 #include "url.h"
 #include "argv-array.h"
+#ifdef HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 static const char content_type[] = "Content-Type";
 static const char content_length[] = "Content-Length";
@@ -160,11 +163,44 @@ static void send_strbuf(const char *type, struct strbuf *buf)
 	write_or_die(1, buf->buf, buf->len);
 }
 
+#ifdef HAVE_SENDFILE
+/*
+ * Copy the file to stdout in the kernel; returns -1 without having
+ * written anything when sendfile(2) cannot handle this file or
+ * destination, so the caller can fall back to a read/write loop.
+ */
+static int send_local_file_sendfile(int fd, off_t size, const char *p)
+{
+	off_t ofs = 0;
+
+	while (ofs < size) {
+		ssize_t n = sendfile(1, fd, &ofs, size - ofs);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (!ofs && (errno == EINVAL || errno == ENOSYS))
+				return -1;
+			die_errno("Cannot send '%s'", p);
+		}
+		if (!n && ofs < size)
+			die("Cannot send '%s': file truncated", p);
+	}
+	return 0;
+}
+#else
+static int send_local_file_sendfile(int fd, off_t size, const char *p)
+{
+	return -1;
+}
+#endif
+
+#define SEND_BUFFER_MAX (2 * 1024 * 1024)
+
 static void send_local_file(const char *the_type, const char *name)
 {
 	const char *p = git_path("%s", name);
 	size_t buf_alloc = 8192;
-	char *buf = xmalloc(buf_alloc);
+	char *buf;
 	int fd;
 	struct stat sb;
 
@@ -179,6 +215,16 @@ static void send_local_file(const char *the_type, const char *name)
 	hdr_date(last_modified, sb.st_mtime);
 	end_headers();
 
+	if (!send_local_file_sendfile(fd, sb.st_size, p)) {
+		close(fd);
+		return;
+	}
+
+	/* Size the copy buffer to the response, within reason. */
+	if (buf_alloc < sb.st_size)
+		buf_alloc = (sb.st_size < SEND_BUFFER_MAX)
+			? xsize_t(sb.st_size) : SEND_BUFFER_MAX;
+	buf = xmalloc(buf_alloc);
 	for (;;) {
 		ssize_t n = xread(fd, buf, buf_alloc);
 		if (n < 0)
@@ -418,7 +418,9 @@ static int http_fetch_pack(struct walker *walker, struct alt_base *repo, unsigne
 	preq->lst = &repo->packs;
 	preq->slot->results = &results;
 
-	if (start_active_slot(preq->slot)) {
+	if (!http_pack_request_run_ranged(preq)) {
+		/* body fetched by parallel range requests */
+	} else if (start_active_slot(preq->slot)) {
 		run_active_slot(preq->slot);
 		if (results.curl_result != CURLE_OK) {
 			error("Unable to get pack file %s\n%s", preq->url,
@@ -18,10 +18,11 @@ size_t http_post_buffer = 16 * LARGE_PACKET_MAX;
 #define LIBCURL_CAN_HANDLE_AUTH_ANY
 #endif
 
-static int min_curl_sessions = 1;
+static int min_curl_sessions = -1;
 static int curl_session_count;
 #ifdef USE_CURL_MULTI
 static int max_requests = -1;
+static int max_ranges = 1;
 static CURLM *curlm;
 #endif
 #ifndef NO_CURL_EASY_DUPHANDLE
@@ -220,6 +221,10 @@ static int http_options(const char *var, const char *value, void *cb)
 		max_requests = git_config_int(var, value);
 		return 0;
 	}
+	if (!strcmp("http.maxranges", var)) {
+		max_ranges = git_config_int(var, value);
+		return 0;
+	}
 #endif
 	if (!strcmp("http.lowspeedlimit", var)) {
 		curl_low_speed_limit = (long)git_config_int(var, value);
@@ -456,8 +461,11 @@ void http_init(struct remote *remote, const char *url, int proactive_auth)
 #ifdef USE_CURL_MULTI
 	{
 		char *http_max_requests = getenv("GIT_HTTP_MAX_REQUESTS");
+		char *http_max_ranges = getenv("GIT_HTTP_MAX_RANGES");
 		if (http_max_requests != NULL)
 			max_requests = atoi(http_max_requests);
+		if (http_max_ranges != NULL)
+			max_ranges = atoi(http_max_ranges);
 	}
 
 	curlm = curl_multi_init();
@@ -495,6 +503,20 @@ void http_init(struct remote *remote, const char *url, int proactive_auth)
 		max_requests = DEFAULT_MAX_REQUESTS;
 #endif
 
+	/*
+	 * Unless the user asked for less, keep one idle curl handle per
+	 * request slot around for the whole session, so that keep-alive
+	 * connections survive from one request to the next instead of
+	 * being torn down as soon as a slot drains.
+	 */
+	if (min_curl_sessions < 0) {
+#ifdef USE_CURL_MULTI
+		min_curl_sessions = max_requests;
+#else
+		min_curl_sessions = 1;
+#endif
+	}
+
 	if (getenv("GIT_CURL_FTP_NO_EPSV"))
 		curl_ftp_no_epsv = 1;
 
@@ -1574,6 +1596,175 @@ abort:
 	return NULL;
 }
 
+#ifdef USE_CURL_MULTI
+/*
+ * A packfile body has no natural request boundaries, but a dumb
+ * server that supports Range requests will happily serve slices of
+ * it.  Splitting the body over several concurrent range requests
+ * keeps a long fat pipe full instead of stalling on one TCP stream.
+ */
+#define PARALLEL_RANGE_MIN (1024 * 1024)
+
+struct http_pack_part {
+	int fd;
+	off_t expected;
+	off_t written;
+	struct active_request_slot *slot;
+	struct slot_results results;
+	struct curl_slist *range_header;
+};
+
+static size_t fwrite_pack_part(char *ptr, size_t eltsize, size_t nmemb,
+			       void *data)
+{
+	struct http_pack_part *part = data;
+	size_t size = eltsize * nmemb;
+	size_t posn = 0;
+
+	while (posn < size) {
+		ssize_t retval = xwrite(part->fd, ptr + posn, size - posn);
+		if (retval < 0)
+			return posn;
+		posn += retval;
+	}
+	part->written += size;
+	return size;
+}
+
+static off_t http_fetch_size(const char *url)
+{
+	struct active_request_slot *slot;
+	struct slot_results results;
+	double filesize = -1;
+
+	slot = get_active_slot();
+	slot->results = &results;
+	curl_easy_setopt(slot->curl, CURLOPT_URL, url);
+	curl_easy_setopt(slot->curl, CURLOPT_NOBODY, 1);
+	curl_easy_setopt(slot->curl, CURLOPT_HTTPHEADER, no_pragma_header);
+	if (start_active_slot(slot))
+		run_active_slot(slot);
+	if (!slot->curl)
+		return -1;
+	/* the handle is reused; do not leave it in HEAD mode */
+	curl_easy_setopt(slot->curl, CURLOPT_NOBODY, 0);
+	if (results.curl_result != CURLE_OK)
+		return -1;
+	curl_easy_getinfo(slot->curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD,
+			  &filesize);
+	if (filesize <= 0)
+		return -1;
+	return (off_t)filesize;
+}
+
+int http_pack_request_run_ranged(struct http_pack_request *preq)
+{
+	struct http_pack_part *parts;
+	off_t prev_posn, size, chunk;
+	int i, nparts, err = 0;
+	char range[RANGE_HEADER_SIZE];
+
+	if (max_ranges < 2)
+		return -1;
+
+	fflush(preq->packfile);
+	prev_posn = ftell(preq->packfile);
+
+	size = http_fetch_size(preq->url);
+	if (size <= prev_posn)
+		return -1;
+
+	nparts = (size - prev_posn + PARALLEL_RANGE_MIN - 1) /
+		 PARALLEL_RANGE_MIN;
+	if (nparts > max_ranges)
+		nparts = max_ranges;
+	if (nparts > max_requests)
+		nparts = max_requests;
+	if (nparts < 2)
+		return -1;
+
+	if (http_is_verbose)
+		fprintf(stderr, "Fetching pack %s with %d range requests\n",
+			sha1_to_hex(preq->target->sha1), nparts);
+
+	chunk = (size - prev_posn + nparts - 1) / nparts;
+	parts = xcalloc(nparts, sizeof(*parts));
+	for (i = 0; i < nparts; i++) {
+		struct http_pack_part *part = parts + i;
+		off_t start = prev_posn + (off_t)i * chunk;
+		off_t end = start + chunk - 1;
+
+		if (end > size - 1)
+			end = size - 1;
+		part->expected = end - start + 1;
+
+		part->fd = open(preq->tmpfile, O_WRONLY);
+		if (part->fd < 0 ||
+		    lseek(part->fd, start, SEEK_SET) != start) {
+			err = -1;
+			break;
+		}
+
+		sprintf(range, "Range: bytes=%" PRIuMAX "-%" PRIuMAX,
+			(uintmax_t)start, (uintmax_t)end);
+		part->range_header = curl_slist_append(NULL, range);
+
+		part->slot = get_active_slot();
+		part->slot->results = &part->results;
+		curl_easy_setopt(part->slot->curl, CURLOPT_FILE, part);
+		curl_easy_setopt(part->slot->curl, CURLOPT_WRITEFUNCTION,
+				 fwrite_pack_part);
+		curl_easy_setopt(part->slot->curl, CURLOPT_URL, preq->url);
+		curl_easy_setopt(part->slot->curl, CURLOPT_HTTPHEADER,
+				 part->range_header);
+		if (!start_active_slot(part->slot)) {
+			part->slot = NULL;
+			err = -1;
+			break;
+		}
+	}
+
+	for (i = 0; i < nparts; i++) {
+		struct http_pack_part *part = parts + i;
+
+		if (!part->slot)
+			continue;
+		run_active_slot(part->slot);
+		/*
+		 * A server that ignores the Range header sends the
+		 * whole body with a 200; every part would then have
+		 * written the full pack at its own offset, so treat
+		 * anything but a partial response as a failure.
+		 */
+		if (part->results.curl_result != CURLE_OK ||
+		    part->results.http_code != 206 ||
+		    part->written != part->expected)
+			err = -1;
+	}
+
+	for (i = 0; i < nparts; i++) {
+		if (parts[i].fd >= 0) {
+			if (err)
+				/*
+				 * Leave no holes behind; the caller
+				 * falls back to a single resumed
+				 * request starting at prev_posn.
+				 */
+				ftruncate(parts[i].fd, prev_posn);
+			close(parts[i].fd);
+		}
+		curl_slist_free_all(parts[i].range_header);
+	}
+	free(parts);
+	return err;
+}
+#else
+int http_pack_request_run_ranged(struct http_pack_request *preq)
+{
+	return -1;
+}
+#endif
+
 /* Helpers for fetching objects (loose) */
 static size_t fwrite_sha1_file(char *ptr, size_t eltsize, size_t nmemb,
 			       void *data)
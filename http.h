@@ -196,6 +196,16 @@ struct http_pack_request {
 
 extern struct http_pack_request *new_http_pack_request(
 	struct packed_git *target, const char *base_url);
+
+/*
+ * Try to download the pack body with several parallel range requests
+ * (up to http.maxRanges), writing it in place of the single request
+ * that new_http_pack_request() prepared.  Returns 0 when the whole
+ * body was fetched; on any error the file is truncated back to where
+ * it started and non-zero is returned, and the caller should fall
+ * back to running preq->slot as usual.
+ */
+extern int http_pack_request_run_ranged(struct http_pack_request *preq);
 extern int finish_http_pack_request(struct http_pack_request *preq);
 extern void release_http_pack_request(struct http_pack_request *preq);
 
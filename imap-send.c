@@ -166,7 +166,8 @@ enum CAPABILITY {
 	LITERALPLUS,
 	NAMESPACE,
 	STARTTLS,
-	AUTH_CRAM_MD5
+	AUTH_CRAM_MD5,
+	MULTIAPPEND
 };
 
 static const char *cap_list[] = {
@@ -176,6 +177,7 @@ static const char *cap_list[] = {
 	"NAMESPACE",
 	"STARTTLS",
 	"AUTH=CRAM-MD5",
+	"MULTIAPPEND",
 };
 
 #define RESP_OK    0
@@ -579,8 +581,9 @@ static struct imap_cmd *issue_imap_cmd(struct imap_store *ctx,
 }
 
 __attribute__((format (printf, 3, 4)))
-static int imap_exec(struct imap_store *ctx, struct imap_cmd_cb *cb,
-		     const char *fmt, ...)
+static struct imap_cmd *issue_imap_cmd_fmt(struct imap_store *ctx,
+					   struct imap_cmd_cb *cb,
+					   const char *fmt, ...)
 {
 	va_list ap;
 	struct imap_cmd *cmdp;
@@ -588,15 +591,12 @@ static int imap_exec(struct imap_store *ctx, struct imap_cmd_cb *cb,
 	va_start(ap, fmt);
 	cmdp = issue_imap_cmd(ctx, cb, fmt, ap);
 	va_end(ap);
-	if (!cmdp)
-		return RESP_BAD;
-
-	return get_cmd_result(ctx, cmdp);
+	return cmdp;
 }
 
 __attribute__((format (printf, 3, 4)))
-static int imap_exec_m(struct imap_store *ctx, struct imap_cmd_cb *cb,
-		       const char *fmt, ...)
+static int imap_exec(struct imap_store *ctx, struct imap_cmd_cb *cb,
+		     const char *fmt, ...)
 {
 	va_list ap;
 	struct imap_cmd *cmdp;
@@ -605,13 +605,9 @@ static int imap_exec_m(struct imap_store *ctx, struct imap_cmd_cb *cb,
 	cmdp = issue_imap_cmd(ctx, cb, fmt, ap);
 	va_end(ap);
 	if (!cmdp)
-		return DRV_STORE_BAD;
+		return RESP_BAD;
 
-	switch (get_cmd_result(ctx, cmdp)) {
-	case RESP_BAD: return DRV_STORE_BAD;
-	case RESP_NO: return DRV_MSG_BAD;
-	default: return DRV_OK;
-	}
+	return get_cmd_result(ctx, cmdp);
 }
 
 static int skip_imap_list_l(char **sp, int level)
@@ -1204,15 +1200,19 @@ static void lf_to_crlf(struct strbuf *msg)
 }
 
 /*
- * Store msg to IMAP.  Also detach and free the data from msg->data,
- * leaving msg->data empty.
+ * Issue an APPEND for msg without waiting for the result, so that
+ * several uploads can be in flight at once.  With LITERAL+ the whole
+ * message goes out immediately; without it the server's continuation
+ * prompt forces a round-trip per message as before.  Also detach and
+ * free the data from msg->data, leaving msg->data empty.
  */
-static int imap_store_msg(struct imap_store *ctx, struct strbuf *msg)
+static struct imap_cmd *imap_queue_msg(struct imap_store *ctx,
+				       struct strbuf *msg)
 {
 	struct imap *imap = ctx->imap;
 	struct imap_cmd_cb cb;
 	const char *prefix, *box;
-	int ret;
+	struct imap_cmd *cmdp;
 
 	lf_to_crlf(msg);
 	memset(&cb, 0, sizeof(cb));
@@ -1222,12 +1222,51 @@ static int imap_store_msg(struct imap_store *ctx, struct strbuf *msg)
 
 	box = ctx->name;
 	prefix = !strcmp(box, "INBOX") ? "" : ctx->prefix;
-	ret = imap_exec_m(ctx, &cb, "APPEND \"%s%s\" ", prefix, box);
+	cmdp = issue_imap_cmd_fmt(ctx, &cb, "APPEND \"%s%s\" ", prefix, box);
 	imap->caps = imap->rcaps;
-	if (ret != DRV_OK)
-		return ret;
+	return cmdp;
+}
 
-	return DRV_OK;
+/*
+ * Upload a whole batch of messages as one MULTIAPPEND (RFC 3502)
+ * command.  The payload must already be formatted as a sequence of
+ * " {<len>+}\r\n<data>" literals; this needs LITERAL+ on top of
+ * MULTIAPPEND, since we never wait for continuation prompts.
+ */
+static struct imap_cmd *issue_multiappend(struct imap_store *ctx,
+					  const struct strbuf *payload)
+{
+	struct imap *imap = ctx->imap;
+	struct imap_cmd *cmd;
+	const char *prefix, *box;
+	char buf[1024];
+	int bufl;
+
+	box = ctx->name;
+	prefix = !strcmp(box, "INBOX") ? "" : ctx->prefix;
+
+	cmd = xcalloc(1, sizeof(*cmd));
+	cmd->tag = ++imap->nexttag;
+	cmd->cmd = xstrfmt("APPEND \"%s%s\" (multiple messages)",
+			   prefix, box);
+
+	bufl = nfsnprintf(buf, sizeof(buf), "%d APPEND \"%s%s\"",
+			  cmd->tag, prefix, box);
+	if (0 < verbosity)
+		printf(">>> %s {...}\n", buf);
+	if (socket_write(&imap->buf.sock, buf, bufl) != bufl ||
+	    socket_write(&imap->buf.sock, payload->buf,
+			 payload->len) != (int)payload->len ||
+	    socket_write(&imap->buf.sock, "\r\n", 2) != 2) {
+		free(cmd->cmd);
+		free(cmd);
+		return NULL;
+	}
+	cmd->next = NULL;
+	*imap->in_progress_append = cmd;
+	imap->in_progress_append = &cmd->next;
+	imap->num_in_progress++;
+	return cmd;
 }
 
 static void wrap_in_html(struct strbuf *msg)
@@ -1357,13 +1396,17 @@ static void git_imap_config(void)
 	git_config_get_string("imap.authmethod", &server.auth_method);
 }
 
+/* APPENDs allowed in flight before we start reaping results */
+#define PIPELINE_DEPTH 32
+
 static int append_msgs_to_imap(struct imap_server_conf *server,
 			       struct strbuf* all_msgs, int total)
 {
 	struct strbuf msg = STRBUF_INIT;
 	struct imap_store *ctx = NULL;
+	struct imap *imap;
 	int ofs = 0;
-	int r;
+	int err = 0;
 	int n = 0;
 
 	ctx = imap_open_store(server, server->folder);
@@ -1372,27 +1415,71 @@ static int append_msgs_to_imap(struct imap_server_conf *server,
 		return 1;
 	}
 	ctx->name = server->folder;
+	imap = ctx->imap;
 
 	fprintf(stderr, "sending %d message%s\n", total, (total != 1) ? "s" : "");
-	while (1) {
-		unsigned percent = n * 100 / total;
-
-		fprintf(stderr, "%4u%% (%d/%d) done\r", percent, n, total);
 
-		if (!split_msg(all_msgs, &msg, &ofs))
-			break;
-		if (server->use_html)
-			wrap_in_html(&msg);
-		r = imap_store_msg(ctx, &msg);
-		if (r != DRV_OK)
-			break;
-		n++;
+	if (CAP(MULTIAPPEND) && CAP(LITERALPLUS)) {
+		/*
+		 * One command for the whole series; the messages are
+		 * all in memory already, so batching them costs
+		 * nothing extra.  Note that MULTIAPPEND is atomic:
+		 * either every message is stored or none is.
+		 */
+		struct strbuf payload = STRBUF_INIT;
+		struct imap_cmd *cmd;
+
+		while (split_msg(all_msgs, &msg, &ofs)) {
+			if (server->use_html)
+				wrap_in_html(&msg);
+			lf_to_crlf(&msg);
+			strbuf_addf(&payload, " {%d+}\r\n", (int)msg.len);
+			strbuf_addbuf(&payload, &msg);
+			n++;
+		}
+		cmd = issue_multiappend(ctx, &payload);
+		strbuf_release(&payload);
+		if (!cmd || get_cmd_result(ctx, cmd) != RESP_OK)
+			err = 1;
+	} else {
+		/*
+		 * Queue up to PIPELINE_DEPTH APPENDs before waiting
+		 * for results, so that with LITERAL+ the upload is
+		 * bounded by bandwidth instead of one round-trip per
+		 * message.
+		 */
+		while (!err && split_msg(all_msgs, &msg, &ofs)) {
+			if (server->use_html)
+				wrap_in_html(&msg);
+			if (!imap_queue_msg(ctx, &msg)) {
+				err = 1;
+				break;
+			}
+			n++;
+			while (imap->num_in_progress >= PIPELINE_DEPTH) {
+				int r = get_cmd_result(ctx, NULL);
+				if (r != RESP_OK)
+					err = 1;
+				if (r == RESP_BAD)
+					goto drained;
+			}
+			fprintf(stderr, "%4u%% (%d/%d) done\r",
+				n * 100 / total, n, total);
+		}
+		while (imap->num_in_progress) {
+			int r = get_cmd_result(ctx, NULL);
+			if (r != RESP_OK)
+				err = 1;
+			if (r == RESP_BAD)
+				break;
+		}
 	}
+drained:
 	fprintf(stderr, "\n");
 
 	imap_close_store(ctx);
 
-	return 0;
+	return err;
 }
 
 #ifdef USE_CURL_FOR_IMAP_SEND
@@ -80,6 +80,7 @@ struct kwset
   struct trie *next[NCHAR];	/* Table of children of the root. */
   char *target;			/* Target string if there's only one. */
   int mind2;			/* Used in Boyer-Moore search for one string. */
+  int rare_offset;		/* Offset of the rarest target byte. */
   unsigned char const *trans;  /* Character translation table. */
 };
 
@@ -373,6 +374,49 @@ treenext (struct tree const *tree, struct trie *next[])
   next[tree->label] = tree->trie;
 }
 
+/* Rough frequency of each byte in text and source code, used to pick
+   the least common byte of a keyword to scan for.  The exact values do
+   not matter much; what matters is that bytes like punctuation and
+   capitals rank far below lowercase letters and whitespace. */
+static unsigned char const freq[NCHAR] = {
+    1,   1,   1,   1,   1,   1,   1,   1,
+    1,  80, 120,   1,   1,   1,   1,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,
+  255,   8,  20,  10,   5,   8,  10,  15,
+   20,  20,  15,  10,  25,  30,  25,  25,
+   45,  40,  30,  20,  20,  20,  20,  20,
+   20,  25,  15,  20,  10,  20,  15,   5,
+    3,  35,   8,  17,  20,  50,  13,  11,
+   22,  31,   2,   5,  22,  15,  30,  32,
+   12,   2,  27,  28,  37,  16,   6,  10,
+    2,  10,   2,   8,   5,   8,   2,  30,
+    2, 140,  35,  70,  80, 200,  55,  45,
+   90, 125,   8,  20,  90,  60, 120, 130,
+   50,   7, 110, 115, 150,  65,  25,  40,
+   10,  40,   6,  10,   5,  10,   2,   1,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+    4,   4,   4,   4,   4,   4,   4,   4,
+};
+
+/* How common the rarest byte of the target may be for the memchr scan
+   to be worth it over the Boyer-Moore skip loop in bmexec. */
+#define RARE_BYTE_LIMIT 50
+
 /* Compute the shift for each trie node, as well as the delta
    table and next cache for the given keyword set. */
 const char *
@@ -416,6 +460,12 @@ kwsprep (kwset_t kws)
 	if (kwset->target[i] == c)
 	  break;
       kwset->mind2 = kwset->mind - (i + 1);
+      /* Remember the statistically rarest byte of the target for
+	 the memchr-driven scan in bmexec. */
+      kwset->rare_offset = 0;
+      for (i = 1; i < kwset->mind; ++i)
+	if (freq[U(kwset->target[i])] < freq[U(kwset->target[kwset->rare_offset])])
+	  kwset->rare_offset = i;
     }
   else
     {
@@ -490,6 +540,32 @@ kwsprep (kwset_t kws)
   return NULL;
 }
 
+/* Scan for the single target by jumping between occurrences of its
+   rarest byte with memchr, which the C library vectorizes, and
+   verifying candidates with memcmp.  When that byte really is rare in
+   the text this skips long stretches at SIMD speed, where the
+   Boyer-Moore loop below inspects a byte per shift. */
+static size_t
+memchr_exec (struct kwset const *kwset, char const *text, size_t size)
+{
+  int len = kwset->mind;
+  int tail = len - kwset->rare_offset;
+  char const *lim = text + size;
+  char const *tp = text + kwset->rare_offset;
+
+  while (lim - tp >= tail)
+    {
+      tp = memchr (tp, kwset->target[kwset->rare_offset],
+		   lim - tp - tail + 1);
+      if (!tp)
+	return -1;
+      if (memcmp (tp - kwset->rare_offset, kwset->target, len) == 0)
+	return tp - kwset->rare_offset - text;
+      ++tp;
+    }
+  return -1;
+}
+
 /* Fast boyer-moore search. */
 static size_t
 bmexec (kwset_t kws, char const *text, size_t size)
@@ -511,6 +587,8 @@ bmexec (kwset_t kws, char const *text, size_t size)
       tp = memchr (text, kwset->target[0], size);
       return tp ? tp - text : -1;
     }
+  if (freq[U(kwset->target[kwset->rare_offset])] <= RARE_BYTE_LIMIT)
+    return memchr_exec (kwset, text, size);
 
   d1 = kwset->delta;
   sp = kwset->target + len;
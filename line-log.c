@@ -988,6 +988,83 @@ static void dump_diff_hacky(struct rev_info *rev, struct line_log_data *range)
 	}
 }
 
+/*
+ * Cache of blob-pair line diffs, keyed by the sha1s of the two blobs.
+ * A -L walk revisits the same pair whenever a merge evaluates the
+ * candidate ranges against each of its parents, and again when the
+ * same file states recur elsewhere in history; the xdiff run depends
+ * only on the blob contents, so its result can be reused verbatim.
+ */
+struct blob_pair_diff {
+	struct hashmap_entry ent;
+	unsigned char one[20];
+	unsigned char two[20];
+	struct diff_ranges diff;
+};
+
+static struct hashmap blob_pair_diff_cache;
+
+static int blob_pair_diff_cmp(const struct blob_pair_diff *a,
+			      const struct blob_pair_diff *b,
+			      const void *unused)
+{
+	return hashcmp(a->one, b->one) || hashcmp(a->two, b->two);
+}
+
+static void clear_blob_pair_diff_cache(void)
+{
+	struct hashmap_iter iter;
+	struct blob_pair_diff *entry;
+
+	if (!blob_pair_diff_cache.tablesize)
+		return;
+	hashmap_iter_init(&blob_pair_diff_cache, &iter);
+	while ((entry = hashmap_iter_next(&iter)))
+		diff_ranges_release(&entry->diff);
+	hashmap_free(&blob_pair_diff_cache, 1);
+	memset(&blob_pair_diff_cache, 0, sizeof(blob_pair_diff_cache));
+}
+
+static struct diff_ranges *cached_pair_diff(struct diff_filepair *pair)
+{
+	struct blob_pair_diff key, *found;
+	mmfile_t file_parent, file_target;
+
+	if (!blob_pair_diff_cache.tablesize)
+		hashmap_init(&blob_pair_diff_cache,
+			     (hashmap_cmp_fn) blob_pair_diff_cmp, 0);
+
+	hashcpy(key.one, pair->one->sha1_valid ? pair->one->sha1 : null_sha1);
+	hashcpy(key.two, pair->two->sha1);
+	hashmap_entry_init(&key, sha1hash(key.two));
+	found = hashmap_get(&blob_pair_diff_cache, &key, NULL);
+	if (found)
+		return &found->diff;
+
+	diff_populate_filespec(pair->two, 0);
+	file_target.ptr = pair->two->data;
+	file_target.size = pair->two->size;
+
+	if (pair->one->sha1_valid) {
+		diff_populate_filespec(pair->one, 0);
+		file_parent.ptr = pair->one->data;
+		file_parent.size = pair->one->size;
+	} else {
+		file_parent.ptr = "";
+		file_parent.size = 0;
+	}
+
+	found = xmalloc(sizeof(*found));
+	hashmap_entry_init(found, sha1hash(key.two));
+	hashcpy(found->one, key.one);
+	hashcpy(found->two, key.two);
+	diff_ranges_init(&found->diff);
+	collect_diff(&file_parent, &file_target, &found->diff);
+	hashmap_add(&blob_pair_diff_cache, found);
+
+	return &found->diff;
+}
+
 /*
  * Unlike most other functions, this destructively operates on
  * 'range'.
@@ -999,8 +1076,8 @@ static int process_diff_filepair(struct rev_info *rev,
 {
 	struct line_log_data *rg = range;
 	struct range_set tmp;
-	struct diff_ranges diff;
-	mmfile_t file_parent, file_target;
+	struct diff_ranges *diff;
+	static struct diff_ranges empty_diff;
 
 	assert(pair->two->path);
 	while (rg) {
@@ -1016,33 +1093,22 @@ static int process_diff_filepair(struct rev_info *rev,
 		return 0;
 
 	assert(pair->two->sha1_valid);
-	diff_populate_filespec(pair->two, 0);
-	file_target.ptr = pair->two->data;
-	file_target.size = pair->two->size;
-
-	if (pair->one->sha1_valid) {
-		diff_populate_filespec(pair->one, 0);
-		file_parent.ptr = pair->one->data;
-		file_parent.size = pair->one->size;
-	} else {
-		file_parent.ptr = "";
-		file_parent.size = 0;
-	}
-
-	diff_ranges_init(&diff);
-	collect_diff(&file_parent, &file_target, &diff);
+	if (pair->one->sha1_valid &&
+	    !hashcmp(pair->one->sha1, pair->two->sha1))
+		/* identical blobs cannot move any lines */
+		diff = &empty_diff;
+	else
+		diff = cached_pair_diff(pair);
 
 	/* NEEDSWORK should apply some heuristics to prevent mismatches */
 	free(rg->path);
 	rg->path = xstrdup(pair->one->path);
 
 	range_set_init(&tmp, 0);
-	range_set_map_across_diff(&tmp, &rg->ranges, &diff, diff_out);
+	range_set_map_across_diff(&tmp, &rg->ranges, diff, diff_out);
 	range_set_release(&rg->ranges);
 	range_set_move(&rg->ranges, &tmp);
 
-	diff_ranges_release(&diff);
-
 	return ((*diff_out)->parent.nr > 0);
 }
 
@@ -1252,5 +1318,8 @@ int line_log_filter(struct rev_info *rev)
 
 	rev->commits = out;
 
+	/* all range mapping is done; the output phase needs no diffs */
+	clear_blob_pair_diff_cache();
+
 	return 0;
 }
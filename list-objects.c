@@ -7,6 +7,34 @@
 #include "tree-walk.h"
 #include "revision.h"
 #include "list-objects.h"
+#include "thread-utils.h"
+
+/*
+ * Enumeration-time filtering of the objects handed to the show
+ * callback.  The type is known from the walk itself, and blob sizes
+ * come from sha1_object_info(), which reads the pack entry header or
+ * the loose object header rather than inflating the content.
+ * Filtered objects are still marked SEEN and trees are still walked
+ * into, so the traversal is unaffected; only the output shrinks.
+ */
+static int object_shown(struct rev_info *revs, struct object *obj)
+{
+	if (revs->filter_object_type &&
+	    revs->filter_object_type != obj->type)
+		return 0;
+	if (obj->type == OBJ_BLOB &&
+	    (revs->filter_min_size || revs->filter_max_size)) {
+		unsigned long size;
+
+		if (sha1_object_info(obj->sha1, &size) < 0)
+			return 1; /* let the reader report the breakage */
+		if (size < revs->filter_min_size)
+			return 0;
+		if (revs->filter_max_size && revs->filter_max_size < size)
+			return 0;
+	}
+	return 1;
+}
 
 static void process_blob(struct rev_info *revs,
 			 struct blob *blob,
@@ -24,6 +52,8 @@ static void process_blob(struct rev_info *revs,
 	if (obj->flags & (UNINTERESTING | SEEN))
 		return;
 	obj->flags |= SEEN;
+	if (!object_shown(revs, obj))
+		return;
 	show(obj, path, name, cb_data);
 }
 
@@ -87,7 +117,8 @@ static void process_tree(struct rev_info *revs,
 		die("bad tree object %s", sha1_to_hex(obj->sha1));
 	}
 	obj->flags |= SEEN;
-	show(obj, path, name, cb_data);
+	if (object_shown(revs, obj))
+		show(obj, path, name, cb_data);
 	me.up = path;
 	me.elem = name;
 	me.elem_len = strlen(name);
@@ -104,9 +135,17 @@ static void process_tree(struct rev_info *revs,
 		if (match != all_entries_interesting) {
 			match = tree_entry_interesting(&entry, base, 0,
 						       &revs->diffopt.pathspec);
-			if (match == all_entries_not_interesting)
-				break;
-			if (match == entry_not_interesting)
+			if (match == all_entries_not_interesting) {
+				if (!revs->narrow_objects)
+					break;
+				match = entry_not_interesting;
+			}
+			/*
+			 * A narrow walk keeps the whole tree structure
+			 * and lets the pathspec prune blobs only.
+			 */
+			if (match == entry_not_interesting &&
+			    !(revs->narrow_objects && S_ISDIR(entry.mode)))
 				continue;
 		}
 
@@ -185,15 +224,213 @@ static void add_pending_tree(struct rev_info *revs, struct tree *tree)
 	add_pending_object(revs, &tree->object, "");
 }
 
+#ifndef NO_PTHREADS
+/*
+ * Parallel tree walk.  Trees are handed out to a small pool of walker
+ * threads, so that the zlib inflation of one tree can overlap the
+ * entry scanning of another.  Object lookups, flag updates and the
+ * show callback are serialized by walk_mutex, and object reading by
+ * read_mutex, the same split builtin/pack-objects.c uses for its
+ * delta search threads.  Walkers show each object with a NULL
+ * name_path and the full path in "name", which path_name() renders
+ * the same way as the chain the recursive walk builds up.
+ */
+struct tree_task {
+	struct tree_task *next;
+	struct tree *tree;
+	char *name;		/* full path of the tree itself */
+};
+
+struct walker_data {
+	struct rev_info *revs;
+	show_object_fn show;
+	void *cb_data;
+};
+
+static struct tree_task *task_queue;
+static int walkers_working;
+static pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t task_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t walk_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t read_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void push_tree_task(struct tree *tree, const char *base, const char *name)
+{
+	struct tree_task *task = xmalloc(sizeof(*task));
+
+	task->tree = tree;
+	task->name = *base ? xstrfmt("%s%s", base, name) : xstrdup(name);
+	pthread_mutex_lock(&task_mutex);
+	task->next = task_queue;
+	task_queue = task;
+	pthread_cond_signal(&task_cond);
+	pthread_mutex_unlock(&task_mutex);
+}
+
+static void walk_one_tree(struct walker_data *wd, struct tree_task *task)
+{
+	struct rev_info *revs = wd->revs;
+	struct object *obj = &task->tree->object;
+	struct tree_desc desc;
+	struct name_entry entry;
+	struct strbuf base = STRBUF_INIT;
+	enum interesting match = revs->diffopt.pathspec.nr == 0 ?
+		all_entries_interesting : entry_not_interesting;
+	int parsed;
+
+	if (!obj)
+		die("bad tree object");
+
+	/*
+	 * Claim the tree before parsing it, so that no two walkers
+	 * ever inflate (and later free) the same tree buffer.
+	 */
+	pthread_mutex_lock(&walk_mutex);
+	if (obj->flags & (UNINTERESTING | SEEN)) {
+		pthread_mutex_unlock(&walk_mutex);
+		return;
+	}
+	obj->flags |= SEEN;
+	pthread_mutex_unlock(&walk_mutex);
+
+	pthread_mutex_lock(&read_mutex);
+	parsed = parse_tree(task->tree);
+	pthread_mutex_unlock(&read_mutex);
+	if (parsed < 0) {
+		if (revs->ignore_missing_links)
+			return;
+		die("bad tree object %s", sha1_to_hex(obj->sha1));
+	}
+
+	pthread_mutex_lock(&walk_mutex);
+	if (object_shown(revs, obj))
+		wd->show(obj, NULL, task->name, wd->cb_data);
+	pthread_mutex_unlock(&walk_mutex);
+
+	if (*task->name)
+		strbuf_addf(&base, "%s/", task->name);
+
+	init_tree_desc(&desc, task->tree->buffer, task->tree->size);
+	while (tree_entry(&desc, &entry)) {
+		if (match != all_entries_interesting) {
+			match = tree_entry_interesting(&entry, &base, 0,
+						       &revs->diffopt.pathspec);
+			if (match == all_entries_not_interesting)
+				break;
+			if (match == entry_not_interesting)
+				continue;
+		}
+
+		if (S_ISDIR(entry.mode)) {
+			struct tree *sub;
+
+			pthread_mutex_lock(&walk_mutex);
+			sub = lookup_tree(entry.sha1);
+			pthread_mutex_unlock(&walk_mutex);
+			push_tree_task(sub, base.buf, entry.path);
+		} else if (S_ISGITLINK(entry.mode)) {
+			; /* nothing to do, as in process_gitlink() */
+		} else if (revs->blob_objects) {
+			struct object *leaf;
+
+			pthread_mutex_lock(&walk_mutex);
+			leaf = &lookup_blob(entry.sha1)->object;
+			if (!leaf)
+				die("bad blob object");
+			if (!(leaf->flags & (UNINTERESTING | SEEN))) {
+				int shown;
+
+				leaf->flags |= SEEN;
+				/*
+				 * A size filter reads the object store;
+				 * object reading is what read_mutex
+				 * serializes.
+				 */
+				pthread_mutex_lock(&read_mutex);
+				shown = object_shown(revs, leaf);
+				pthread_mutex_unlock(&read_mutex);
+				if (shown) {
+					char *name = xstrfmt("%s%s", base.buf,
+							     entry.path);
+					wd->show(leaf, NULL, name, wd->cb_data);
+					free(name);
+				}
+			}
+			pthread_mutex_unlock(&walk_mutex);
+		}
+	}
+	strbuf_release(&base);
+	free_tree_buffer(task->tree);
+}
+
+static void *tree_walker(void *arg)
+{
+	struct walker_data *wd = arg;
+
+	pthread_mutex_lock(&task_mutex);
+	for (;;) {
+		struct tree_task *task;
+
+		if (task_queue) {
+			task = task_queue;
+			task_queue = task->next;
+			walkers_working++;
+			pthread_mutex_unlock(&task_mutex);
+
+			walk_one_tree(wd, task);
+			free(task->name);
+			free(task);
+
+			pthread_mutex_lock(&task_mutex);
+			walkers_working--;
+			if (!task_queue && !walkers_working)
+				pthread_cond_broadcast(&task_cond);
+		} else if (walkers_working) {
+			pthread_cond_wait(&task_cond, &task_mutex);
+		} else
+			break;
+	}
+	pthread_mutex_unlock(&task_mutex);
+	return NULL;
+}
+
+static void traverse_pending_trees_parallel(struct rev_info *revs,
+					    show_object_fn show_object,
+					    void *data)
+{
+	struct walker_data wd;
+	pthread_t *threads;
+	int nr_threads = revs->traverse_threads;
+	int i;
+
+	wd.revs = revs;
+	wd.show = show_object;
+	wd.cb_data = data;
+
+	threads = xcalloc(nr_threads, sizeof(*threads));
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_create(&threads[i], NULL, tree_walker, &wd))
+			die("unable to create tree walker thread");
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+#endif
+
 void traverse_commit_list(struct rev_info *revs,
 			  show_commit_fn show_commit,
 			  show_object_fn show_object,
 			  void *data)
 {
 	int i;
+	int parallel = 0;
 	struct commit *commit;
 	struct strbuf base;
 
+#ifndef NO_PTHREADS
+	if (revs->traverse_threads > 1 && revs->tree_objects)
+		parallel = 1;
+#endif
 	strbuf_init(&base, PATH_MAX);
 	while ((commit = get_revision(revs)) != NULL) {
 		/*
@@ -213,12 +450,19 @@ void traverse_commit_list(struct rev_info *revs,
 			continue;
 		if (obj->type == OBJ_TAG) {
 			obj->flags |= SEEN;
-			show_object(obj, NULL, name, data);
+			if (object_shown(revs, obj))
+				show_object(obj, NULL, name, data);
 			continue;
 		}
 		if (!path)
 			path = "";
 		if (obj->type == OBJ_TREE) {
+#ifndef NO_PTHREADS
+			if (parallel) {
+				push_tree_task((struct tree *)obj, "", path);
+				continue;
+			}
+#endif
 			process_tree(revs, (struct tree *)obj, show_object,
 				     NULL, &base, path, data);
 			continue;
@@ -231,6 +475,10 @@ void traverse_commit_list(struct rev_info *revs,
 		die("unknown pending object %s (%s)",
 		    sha1_to_hex(obj->sha1), name);
 	}
+#ifndef NO_PTHREADS
+	if (parallel)
+		traverse_pending_trees_parallel(revs, show_object, data);
+#endif
 	object_array_clear(&revs->pending);
 	strbuf_release(&base);
 }
@@ -9,6 +9,7 @@
 #include "xdiff-interface.h"
 #include "run-command.h"
 #include "ll-merge.h"
+#include "delta.h"
 
 struct ll_merge_driver;
 
@@ -30,6 +31,202 @@ struct ll_merge_driver {
 	char *cmdline;
 };
 
+/*
+ * Chunk-based binary merge.  Each side is expressed as a delta
+ * against the common ancestor (the same rabin-fingerprint deltas
+ * pack-objects computes), the deltas are turned into replacement
+ * ranges on the ancestor, and when the two sides touched disjoint
+ * ranges the merge is performed by applying both sets of edits.
+ */
+struct binary_edit {
+	unsigned long begin, end;	/* replaced range in the ancestor */
+	struct strbuf data;		/* the replacement bytes */
+};
+
+struct binary_edit_list {
+	struct binary_edit *edits;
+	int nr, alloc;
+};
+
+static void add_binary_edit(struct binary_edit_list *list,
+			    unsigned long begin, unsigned long end,
+			    struct strbuf *data)
+{
+	struct binary_edit *edit;
+
+	ALLOC_GROW(list->edits, list->nr + 1, list->alloc);
+	edit = &list->edits[list->nr++];
+	edit->begin = begin;
+	edit->end = end;
+	strbuf_init(&edit->data, 0);
+	strbuf_swap(&edit->data, data);
+}
+
+static void clear_binary_edits(struct binary_edit_list *list)
+{
+	int i;
+
+	for (i = 0; i < list->nr; i++)
+		strbuf_release(&list->edits[i].data);
+	free(list->edits);
+	memset(list, 0, sizeof(*list));
+}
+
+/*
+ * Describe "side" as an ordered list of non-overlapping replacements
+ * on "orig".  Deltas whose copies go backwards (the delta machinery
+ * may reuse an earlier stretch for repeated content) do not map onto
+ * such a list; give up on those rather than guess.
+ */
+static int extract_binary_edits(mmfile_t *orig, mmfile_t *side,
+				struct binary_edit_list *list)
+{
+	struct strbuf pending = STRBUF_INIT;
+	const unsigned char *data, *top;
+	unsigned long delta_size, srcpos = 0;
+	void *delta;
+
+	delta = diff_delta(orig->ptr, orig->size, side->ptr, side->size,
+			   &delta_size, 0);
+	if (!delta)
+		return -1;
+	data = delta;
+	top = data + delta_size;
+	/* skip the source and target size headers */
+	get_delta_hdr_size(&data, top);
+	get_delta_hdr_size(&data, top);
+
+	while (data < top) {
+		unsigned char cmd = *data++;
+		if (cmd & 0x80) {
+			unsigned long cp_off = 0, cp_size = 0;
+			if (cmd & 0x01) cp_off = *data++;
+			if (cmd & 0x02) cp_off |= (*data++ << 8);
+			if (cmd & 0x04) cp_off |= (*data++ << 16);
+			if (cmd & 0x08) cp_off |= ((unsigned) *data++ << 24);
+			if (cmd & 0x10) cp_size = *data++;
+			if (cmd & 0x20) cp_size |= (*data++ << 8);
+			if (cmd & 0x40) cp_size |= (*data++ << 16);
+			if (cp_size == 0) cp_size = 0x10000;
+			if (cp_off < srcpos || cp_off + cp_size > orig->size)
+				goto fail;
+			if (cp_off > srcpos || pending.len)
+				add_binary_edit(list, srcpos, cp_off, &pending);
+			srcpos = cp_off + cp_size;
+		} else if (cmd) {
+			strbuf_add(&pending, data, cmd);
+			data += cmd;
+		} else
+			goto fail;
+	}
+	if (srcpos < orig->size || pending.len)
+		add_binary_edit(list, srcpos, orig->size, &pending);
+	free(delta);
+	strbuf_release(&pending);
+	return 0;
+
+fail:
+	free(delta);
+	strbuf_release(&pending);
+	return -1;
+}
+
+static int same_binary_edit(const struct binary_edit *a,
+			    const struct binary_edit *b)
+{
+	return a->begin == b->begin && a->end == b->end &&
+		a->data.len == b->data.len &&
+		!memcmp(a->data.buf, b->data.buf, a->data.len);
+}
+
+/*
+ * Interleave the two edit lists over the ancestor.  Each list is
+ * sorted and internally disjoint, so checking the two heads at every
+ * step catches any overlap between the sides.
+ */
+static int apply_binary_edits(mmbuffer_t *result, mmfile_t *orig,
+			      struct binary_edit_list *ours,
+			      struct binary_edit_list *theirs)
+{
+	struct strbuf out = STRBUF_INIT;
+	unsigned long pos = 0;
+	int i = 0, j = 0;
+
+	while (i < ours->nr || j < theirs->nr) {
+		struct binary_edit *a = i < ours->nr ? &ours->edits[i] : NULL;
+		struct binary_edit *b = j < theirs->nr ? &theirs->edits[j] : NULL;
+		struct binary_edit *e;
+
+		if (a && b && same_binary_edit(a, b)) {
+			/* both sides made the identical change */
+			e = a;
+			i++;
+			j++;
+		} else if (a && b &&
+			   ((a->begin < b->end && b->begin < a->end) ||
+			    a->begin == b->begin)) {
+			/*
+			 * Overlapping replacements, or two insertions
+			 * at the same spot whose order we cannot know.
+			 */
+			strbuf_release(&out);
+			return -1;
+		} else if (!b || (a && a->begin < b->begin)) {
+			e = a;
+			i++;
+		} else {
+			e = b;
+			j++;
+		}
+
+		strbuf_add(&out, orig->ptr + pos, e->begin - pos);
+		strbuf_addbuf(&out, &e->data);
+		pos = e->end;
+	}
+	strbuf_add(&out, orig->ptr + pos, orig->size - pos);
+	result->size = out.len;
+	result->ptr = strbuf_detach(&out, NULL);
+	return 0;
+}
+
+static void binary_take_whole(mmbuffer_t *result, mmfile_t *side)
+{
+	result->ptr = xmalloc(side->size ? side->size : 1);
+	result->size = side->size;
+	memcpy(result->ptr, side->ptr, side->size);
+}
+
+static int merge_binary_edits(mmbuffer_t *result, mmfile_t *orig,
+			      mmfile_t *src1, mmfile_t *src2)
+{
+	struct binary_edit_list ours = { NULL, 0, 0 };
+	struct binary_edit_list theirs = { NULL, 0, 0 };
+	int ret = -1;
+
+	if (src1->size == src2->size &&
+	    !memcmp(src1->ptr, src2->ptr, src1->size)) {
+		binary_take_whole(result, src1);
+		return 0;
+	}
+	if (orig->size == src1->size &&
+	    !memcmp(orig->ptr, src1->ptr, orig->size)) {
+		binary_take_whole(result, src2);
+		return 0;
+	}
+	if (orig->size == src2->size &&
+	    !memcmp(orig->ptr, src2->ptr, orig->size)) {
+		binary_take_whole(result, src1);
+		return 0;
+	}
+
+	if (!extract_binary_edits(orig, src1, &ours) &&
+	    !extract_binary_edits(orig, src2, &theirs))
+		ret = apply_binary_edits(result, orig, &ours, &theirs);
+	clear_binary_edits(&ours);
+	clear_binary_edits(&theirs);
+	return ret;
+}
+
 /*
  * Built-in low-levels
  */
@@ -53,6 +250,8 @@ static int ll_binary_merge(const struct ll_merge_driver *drv_unused,
 	} else {
 		switch (opts->variant) {
 		default:
+			if (!merge_binary_edits(result, orig, src1, src2))
+				return 0;
 			warning("Cannot merge binary files: %s (%s vs. %s)",
 				path, name1, name2);
 			/* fallthru */
@@ -103,6 +302,7 @@ static int ll_xdl_merge(const struct ll_merge_driver *drv_unused,
 	xmp.level = XDL_MERGE_ZEALOUS;
 	xmp.favor = opts->variant;
 	xmp.xpp.flags = opts->xdl_opts;
+	xmp.xpp.parallel_lines = xdiff_parallel_lines();
 	if (git_xmerge_style >= 0)
 		xmp.style = git_xmerge_style;
 	if (marker_size > 0)
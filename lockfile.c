@@ -4,6 +4,7 @@
 #include "cache.h"
 #include "lockfile.h"
 #include "sigchain.h"
+#include "trace-event.h"
 
 static struct lock_file *volatile lock_file_list;
 
@@ -142,7 +143,11 @@ static int lock_file(struct lock_file *lk, const char *path, int flags)
 	strbuf_addstr(&lk->filename, LOCK_SUFFIX);
 	lk->fd = open(lk->filename.buf, O_RDWR | O_CREAT | O_EXCL, 0666);
 	if (lk->fd < 0) {
+		int save_errno = errno;
+		if (errno == EEXIST)
+			trace_event_counter_add("lock_contention", 1);
 		strbuf_reset(&lk->filename);
+		errno = save_errno;
 		return -1;
 	}
 	lk->owner = getpid();
@@ -1,6 +1,7 @@
 #include "cache.h"
 #include "diff.h"
 #include "commit.h"
+#include "commit-graph.h"
 #include "tag.h"
 #include "graph.h"
 #include "log-tree.h"
@@ -638,8 +639,20 @@ void show_log(struct rev_info *opt)
 		show_mergetag(opt, commit);
 	}
 
-	if (!get_cached_commit_buffer(commit, NULL))
-		return;
+	if (!get_cached_commit_buffer(commit, NULL)) {
+		unsigned long size;
+		const void *buffer;
+
+		/*
+		 * A commit parsed from the commit-graph file has no
+		 * message attached to it, and an earlier traversal may
+		 * have discarded the buffer of a commit it did not
+		 * expect to be shown; read the object now that we know
+		 * we are going to show it.
+		 */
+		buffer = get_commit_buffer(commit, &size);
+		set_commit_buffer(commit, (void *)buffer, size);
+	}
 
 	if (opt->show_notes) {
 		int raw;
@@ -66,53 +66,80 @@ static int namemap_cmp(const char *a, const char *b)
 	return strcasecmp(a, b);
 }
 
-static void add_mapping(struct string_list *map,
-			char *new_name, char *new_email,
-			char *old_name, char *old_email)
+/*
+ * A parsed but not yet merged mailmap line.  Lines are collected
+ * from all sources first and sorted in one go, so that the map can
+ * be built by appending instead of paying an insertion sort (a
+ * memmove over the tail of the array) for every entry.
+ */
+struct mailmap_line {
+	char *new_name, *new_email, *old_name, *old_email;
+	int seq;
+};
+
+struct mailmap_lines {
+	struct mailmap_line *line;
+	int nr, alloc;
+};
+
+static int mailmap_line_cmp(const void *a_, const void *b_)
+{
+	const struct mailmap_line *a = a_, *b = b_;
+	int cmp = strcasecmp(a->old_email, b->old_email);
+	if (cmp)
+		return cmp;
+	/* qsort is not stable; keep the lines for one address in order */
+	return a->seq - b->seq;
+}
+
+static void add_mapping(struct string_list *map, struct mailmap_line *ml)
 {
 	struct mailmap_entry *me;
 	struct string_list_item *item;
 
-	if (old_email == NULL) {
-		old_email = new_email;
-		new_email = NULL;
-	}
-
-	item = string_list_insert(map, old_email);
-	if (item->util) {
-		me = (struct mailmap_entry *)item->util;
+	/*
+	 * The lines arrive sorted by old_email, so all mappings for
+	 * one address are adjacent and the map stays sorted under
+	 * plain appends.
+	 */
+	if (map->nr &&
+	    !strcasecmp(map->items[map->nr - 1].string, ml->old_email)) {
+		me = (struct mailmap_entry *)map->items[map->nr - 1].util;
 	} else {
+		item = string_list_append(map, ml->old_email);
 		me = xcalloc(1, sizeof(struct mailmap_entry));
 		me->namemap.strdup_strings = 1;
 		me->namemap.cmp = namemap_cmp;
 		item->util = me;
 	}
 
-	if (old_name == NULL) {
-		debug_mm("mailmap: adding (simple) entry for '%s'\n", old_email);
+	if (ml->old_name == NULL) {
+		debug_mm("mailmap: adding (simple) entry for '%s'\n",
+			 ml->old_email);
 
 		/* Replace current name and new email for simple entry */
-		if (new_name) {
+		if (ml->new_name) {
 			free(me->name);
-			me->name = xstrdup(new_name);
+			me->name = xstrdup(ml->new_name);
 		}
-		if (new_email) {
+		if (ml->new_email) {
 			free(me->email);
-			me->email = xstrdup(new_email);
+			me->email = xstrdup(ml->new_email);
 		}
 	} else {
 		struct mailmap_info *mi = xcalloc(1, sizeof(struct mailmap_info));
-		debug_mm("mailmap: adding (complex) entry for '%s'\n", old_email);
-		if (new_name)
-			mi->name = xstrdup(new_name);
-		if (new_email)
-			mi->email = xstrdup(new_email);
-		string_list_insert(&me->namemap, old_name)->util = mi;
+		debug_mm("mailmap: adding (complex) entry for '%s'\n",
+			 ml->old_email);
+		if (ml->new_name)
+			mi->name = xstrdup(ml->new_name);
+		if (ml->new_email)
+			mi->email = xstrdup(ml->new_email);
+		string_list_insert(&me->namemap, ml->old_name)->util = mi;
 	}
 
 	debug_mm("mailmap:  '%s' <%s> -> '%s' <%s>\n",
-		 debug_str(old_name), old_email,
-		 debug_str(new_name), debug_str(new_email));
+		 debug_str(ml->old_name), ml->old_email,
+		 debug_str(ml->new_name), debug_str(ml->new_email));
 }
 
 static char *parse_name_and_email(char *buffer, char **name,
@@ -144,7 +171,7 @@ static char *parse_name_and_email(char *buffer, char **name,
 	return (*right == '\0' ? NULL : right);
 }
 
-static void read_mailmap_line(struct string_list *map, char *buffer,
+static void read_mailmap_line(struct mailmap_lines *lines, char *buffer,
 			      char **repo_abbrev)
 {
 	char *name1 = NULL, *email1 = NULL, *name2 = NULL, *email2 = NULL;
@@ -173,11 +200,26 @@ static void read_mailmap_line(struct string_list *map, char *buffer,
 	if ((name2 = parse_name_and_email(buffer, &name1, &email1, 0)) != NULL)
 		parse_name_and_email(name2, &name2, &email2, 1);
 
-	if (email1)
-		add_mapping(map, name1, email1, name2, email2);
+	if (email1) {
+		struct mailmap_line *ml;
+
+		ALLOC_GROW(lines->line, lines->nr + 1, lines->alloc);
+		ml = &lines->line[lines->nr];
+		ml->seq = lines->nr;
+		if (!email2) {
+			ml->old_email = xstrdup(email1);
+			ml->new_email = NULL;
+		} else {
+			ml->old_email = xstrdup(email2);
+			ml->new_email = xstrdup(email1);
+		}
+		ml->new_name = name1 ? xstrdup(name1) : NULL;
+		ml->old_name = name2 ? xstrdup(name2) : NULL;
+		lines->nr++;
+	}
 }
 
-static int read_mailmap_file(struct string_list *map, const char *filename,
+static int read_mailmap_file(struct mailmap_lines *lines, const char *filename,
 			     char **repo_abbrev)
 {
 	char buffer[1024];
@@ -195,12 +237,12 @@ static int read_mailmap_file(struct string_list *map, const char *filename,
 	}
 
 	while (fgets(buffer, sizeof(buffer), f) != NULL)
-		read_mailmap_line(map, buffer, repo_abbrev);
+		read_mailmap_line(lines, buffer, repo_abbrev);
 	fclose(f);
 	return 0;
 }
 
-static void read_mailmap_string(struct string_list *map, char *buf,
+static void read_mailmap_string(struct mailmap_lines *lines, char *buf,
 				char **repo_abbrev)
 {
 	while (*buf) {
@@ -209,12 +251,12 @@ static void read_mailmap_string(struct string_list *map, char *buf,
 		if (*end)
 			*end++ = '\0';
 
-		read_mailmap_line(map, buf, repo_abbrev);
+		read_mailmap_line(lines, buf, repo_abbrev);
 		buf = end;
 	}
 }
 
-static int read_mailmap_blob(struct string_list *map,
+static int read_mailmap_blob(struct mailmap_lines *lines,
 			     const char *name,
 			     char **repo_abbrev)
 {
@@ -234,7 +276,7 @@ static int read_mailmap_blob(struct string_list *map,
 	if (type != OBJ_BLOB)
 		return error("mailmap is not a blob: %s", name);
 
-	read_mailmap_string(map, buf, repo_abbrev);
+	read_mailmap_string(lines, buf, repo_abbrev);
 
 	free(buf);
 	return 0;
@@ -242,7 +284,8 @@ static int read_mailmap_blob(struct string_list *map,
 
 int read_mailmap(struct string_list *map, char **repo_abbrev)
 {
-	int err = 0;
+	struct mailmap_lines lines = { NULL, 0, 0 };
+	int err = 0, i;
 
 	map->strdup_strings = 1;
 	map->cmp = namemap_cmp;
@@ -250,9 +293,21 @@ int read_mailmap(struct string_list *map, char **repo_abbrev)
 	if (!git_mailmap_blob && is_bare_repository())
 		git_mailmap_blob = "HEAD:.mailmap";
 
-	err |= read_mailmap_file(map, ".mailmap", repo_abbrev);
-	err |= read_mailmap_blob(map, git_mailmap_blob, repo_abbrev);
-	err |= read_mailmap_file(map, git_mailmap_file, repo_abbrev);
+	err |= read_mailmap_file(&lines, ".mailmap", repo_abbrev);
+	err |= read_mailmap_blob(&lines, git_mailmap_blob, repo_abbrev);
+	err |= read_mailmap_file(&lines, git_mailmap_file, repo_abbrev);
+
+	qsort(lines.line, lines.nr, sizeof(*lines.line), mailmap_line_cmp);
+	for (i = 0; i < lines.nr; i++) {
+		struct mailmap_line *ml = &lines.line[i];
+
+		add_mapping(map, ml);
+		free(ml->new_name);
+		free(ml->new_email);
+		free(ml->old_name);
+		free(ml->old_email);
+	}
+	free(lines.line);
 	return err;
 }
 
@@ -0,0 +1,80 @@
+#include "cache.h"
+#include "mem-pool.h"
+
+#define MIN_BLOCK_SIZE (8 * 1024)
+
+static struct mp_block *mem_pool_new_block(struct mem_pool *pool,
+					   size_t block_size)
+{
+	struct mp_block *p;
+
+	p = xmalloc(sizeof(struct mp_block) + block_size);
+	p->next_block = pool->mp_block;
+	p->next_free = (char *)p->space;
+	p->end = p->next_free + block_size;
+	pool->mp_block = p;
+	return p;
+}
+
+void mem_pool_init(struct mem_pool *pool, size_t block_alloc)
+{
+	if (pool->block_alloc)
+		return;
+	if (block_alloc < MIN_BLOCK_SIZE)
+		block_alloc = MIN_BLOCK_SIZE;
+	pool->block_alloc = block_alloc;
+	pool->mp_block = NULL;
+}
+
+void *mem_pool_alloc(struct mem_pool *pool, size_t len)
+{
+	struct mp_block *p = pool->mp_block;
+	void *ret;
+
+	/* round up to a multiple of the block's natural alignment */
+	len = (len + sizeof(uintmax_t) - 1) & ~(sizeof(uintmax_t) - 1);
+
+	if (!pool->block_alloc)
+		mem_pool_init(pool, 0);
+	if (!p || (size_t)(p->end - p->next_free) < len)
+		p = mem_pool_new_block(pool, len > pool->block_alloc ?
+				       len : pool->block_alloc);
+
+	ret = p->next_free;
+	p->next_free += len;
+	return ret;
+}
+
+void *mem_pool_calloc(struct mem_pool *pool, size_t count, size_t size)
+{
+	size_t len = count * size;
+	void *ret = mem_pool_alloc(pool, len);
+
+	memset(ret, 0, len);
+	return ret;
+}
+
+void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src)
+{
+	struct mp_block *p = src->mp_block;
+
+	if (p) {
+		while (p->next_block)
+			p = p->next_block;
+		p->next_block = dst->mp_block;
+		dst->mp_block = src->mp_block;
+	}
+	src->mp_block = NULL;
+}
+
+void mem_pool_discard(struct mem_pool *pool)
+{
+	struct mp_block *p = pool->mp_block;
+
+	while (p) {
+		struct mp_block *next = p->next_block;
+		free(p);
+		p = next;
+	}
+	pool->mp_block = NULL;
+}
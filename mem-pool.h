@@ -0,0 +1,51 @@
+#ifndef MEM_POOL_H
+#define MEM_POOL_H
+
+/*
+ * A simple block-chained arena allocator for objects that are freed
+ * all at once (or never): allocations are carved out of a few large
+ * blocks instead of going through malloc one by one, and there is no
+ * way to free an individual allocation.  Discarding the pool releases
+ * everything; a pool that lives until exit need not be discarded at
+ * all.
+ */
+
+struct mp_block {
+	struct mp_block *next_block;
+	char *next_free;
+	char *end;
+	uintmax_t space[FLEX_ARRAY]; /* more */
+};
+
+struct mem_pool {
+	struct mp_block *mp_block;
+
+	/* size used for newly allocated blocks */
+	size_t block_alloc;
+};
+
+/*
+ * Prepare a pool that will hand out blocks of approximately
+ * block_alloc bytes; callers that know how much they are going to
+ * allocate can pass their estimate to get a single right-sized block.
+ * Calling this on a pool that is already set up is a no-op.
+ */
+extern void mem_pool_init(struct mem_pool *pool, size_t block_alloc);
+
+/* Allocate len bytes; the memory is suitably aligned but not zeroed. */
+extern void *mem_pool_alloc(struct mem_pool *pool, size_t len);
+
+/* Allocate and zero count * size bytes. */
+extern void *mem_pool_calloc(struct mem_pool *pool, size_t count, size_t size);
+
+/*
+ * Move all memory owned by src into dst, leaving src empty.  Useful
+ * when worker threads fill private pools whose contents must outlive
+ * the thread.
+ */
+extern void mem_pool_combine(struct mem_pool *dst, struct mem_pool *src);
+
+/* Free every block; all memory handed out by the pool becomes invalid. */
+extern void mem_pool_discard(struct mem_pool *pool);
+
+#endif
@@ -242,7 +242,7 @@ static int git_merge_trees(int index_only,
 	init_tree_desc_from_tree(t+2, merge);
 
 	rc = unpack_trees(3, t, &opts);
-	cache_tree_free(&active_cache_tree);
+	cache_tree_discard(&the_index);
 	return rc;
 }
 
@@ -475,7 +475,8 @@ static struct string_list *get_renames(struct merge_options *o,
 				       struct tree *o_tree,
 				       struct tree *a_tree,
 				       struct tree *b_tree,
-				       struct string_list *entries)
+				       struct string_list *entries,
+				       struct string_list *adds)
 {
 	int i;
 	struct string_list *renames;
@@ -501,6 +502,8 @@ static struct string_list *get_renames(struct merge_options *o,
 		struct string_list_item *item;
 		struct rename *re;
 		struct diff_filepair *pair = diff_queued_diff.queue[i];
+		if (pair->status == 'A' && adds)
+			string_list_insert(adds, pair->two->path);
 		if (pair->status != 'R') {
 			diff_free_filepair(pair);
 			continue;
@@ -530,6 +533,121 @@ static struct string_list *get_renames(struct merge_options *o,
 	return renames;
 }
 
+/*
+ * Return the directory portion of path, or "" for a path at the top
+ * level; the caller owns the returned string.
+ */
+static char *get_leading_dir(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+	return slash ? xmemdupz(path, slash - path) : xstrdup("");
+}
+
+/*
+ * Aggregate the file renames of one side into directory-level
+ * transforms.  A directory that no longer exists on that side and
+ * whose files moved predominantly to one other directory is
+ * considered renamed to it; the resulting entries map the old
+ * directory name to the new one.
+ */
+static void get_directory_renames(struct string_list *renames,
+				  struct tree *tree,
+				  struct string_list *dir_renames)
+{
+	int i, j;
+
+	for (i = 0; i < renames->nr; i++) {
+		struct rename *re = renames->items[i].util;
+		char *src_dir = get_leading_dir(re->pair->one->path);
+		char *dst_dir = get_leading_dir(re->pair->two->path);
+		struct string_list_item *item;
+		struct string_list *counts;
+
+		/* the top-level directory cannot be renamed */
+		if (!*src_dir || !strcmp(src_dir, dst_dir)) {
+			free(src_dir);
+			free(dst_dir);
+			continue;
+		}
+		item = string_list_lookup(dir_renames, src_dir);
+		if (!item) {
+			item = string_list_insert(dir_renames, src_dir);
+			item->util = xcalloc(1, sizeof(struct string_list));
+			((struct string_list *)item->util)->strdup_strings = 1;
+		}
+		counts = item->util;
+		item = string_list_lookup(counts, dst_dir);
+		if (!item)
+			item = string_list_insert(counts, dst_dir);
+		item->util = (void *)((intptr_t)item->util + 1);
+		free(src_dir);
+		free(dst_dir);
+	}
+
+	/*
+	 * Keep only directories that are gone from this side and have
+	 * an unambiguous destination.
+	 */
+	for (i = 0; i < dir_renames->nr; i++) {
+		struct string_list_item *entry = &dir_renames->items[i];
+		struct string_list *counts = entry->util;
+		const char *best = NULL;
+		intptr_t best_count = 0;
+		int ambiguous = 0;
+		unsigned char sha1[20];
+		unsigned mode;
+
+		for (j = 0; j < counts->nr; j++) {
+			intptr_t count = (intptr_t)counts->items[j].util;
+			if (count > best_count) {
+				best = counts->items[j].string;
+				best_count = count;
+				ambiguous = 0;
+			} else if (count == best_count)
+				ambiguous = 1;
+		}
+		if (ambiguous ||
+		    !get_tree_entry(tree->object.sha1, entry->string,
+				    sha1, &mode))
+			entry->util = NULL;
+		else
+			entry->util = xstrdup(best);
+		string_list_clear(counts, 0);
+		free(counts);
+	}
+}
+
+/*
+ * If path lies inside a directory the other side renamed, return the
+ * corresponding path over there; the longest matching directory
+ * prefix wins.  Returns NULL when no rename applies.
+ */
+static char *apply_dir_rename(struct string_list *dir_renames,
+			      const char *path)
+{
+	int i;
+	size_t best_len = 0;
+	const char *new_dir = NULL;
+
+	for (i = 0; i < dir_renames->nr; i++) {
+		const char *dir = dir_renames->items[i].string;
+		size_t len = strlen(dir);
+
+		if (!dir_renames->items[i].util)
+			continue;
+		if (len < best_len ||
+		    strncmp(path, dir, len) || path[len] != '/')
+			continue;
+		best_len = len;
+		new_dir = dir_renames->items[i].util;
+	}
+	if (!new_dir)
+		return NULL;
+	if (!*new_dir)
+		return xstrdup(path + best_len + 1);
+	return xstrfmt("%s/%s", new_dir, path + best_len + 1);
+}
+
 static int update_stages(const char *path, const struct diff_filespec *o,
 			 const struct diff_filespec *a,
 			 const struct diff_filespec *b)
@@ -578,7 +696,7 @@ static int remove_file(struct merge_options *o, int clean,
 		       const char *path, int no_wd)
 {
 	int update_cache = o->call_depth || clean;
-	int update_working_directory = !o->call_depth && !no_wd;
+	int update_working_directory = !o->call_depth && !o->no_worktree && !no_wd;
 
 	if (update_cache) {
 		if (remove_file_from_cache(path))
@@ -741,7 +859,7 @@ static void update_file_flags(struct merge_options *o,
 			      int update_cache,
 			      int update_wd)
 {
-	if (o->call_depth)
+	if (o->call_depth || o->no_worktree)
 		update_wd = 0;
 
 	if (update_wd) {
@@ -1016,7 +1134,7 @@ static void handle_change_delete(struct merge_options *o,
 				 const char *change, const char *change_past)
 {
 	char *renamed = NULL;
-	if (dir_in_way(path, !o->call_depth)) {
+	if (dir_in_way(path, !o->call_depth && !o->no_worktree)) {
 		renamed = unique_path(o, path, a_sha ? o->branch1 : o->branch2);
 	}
 
@@ -1144,7 +1262,7 @@ static void handle_file(struct merge_options *o,
 		remove_file(o, 0, rename->path, 0);
 		dst_name = unique_path(o, rename->path, cur_branch);
 	} else {
-		if (dir_in_way(rename->path, !o->call_depth)) {
+		if (dir_in_way(rename->path, !o->call_depth && !o->no_worktree)) {
 			dst_name = unique_path(o, rename->path, cur_branch);
 			output(o, 1, _("%s is a directory in %s adding as %s instead"),
 			       rename->path, other_branch, dst_name);
@@ -1267,6 +1385,71 @@ static void conflict_rename_rename_2to1(struct merge_options *o,
 	}
 }
 
+/*
+ * Paths added on one side below a directory the other side renamed
+ * away are carried along with the rename, so that a large
+ * reorganization merges in one pass instead of leaving stray paths
+ * in the old location.
+ */
+static void apply_directory_renames(struct merge_options *o,
+				    struct tree *tree,
+				    struct string_list *adds,
+				    struct string_list *dir_renames,
+				    const char *add_branch,
+				    const char *rename_branch)
+{
+	int i;
+
+	if (!dir_renames->nr)
+		return;
+	for (i = 0; i < adds->nr; i++) {
+		const char *path = adds->items[i].string;
+		char *new_path = apply_dir_rename(dir_renames, path);
+		unsigned char sha1[20];
+		unsigned mode;
+		int pos;
+
+		if (!new_path)
+			continue;
+
+		/*
+		 * Only move a path that was trivially resolved to the
+		 * added blob; a conflicted path is left for the usual
+		 * machinery.
+		 */
+		pos = cache_name_pos(path, strlen(path));
+		if (pos < 0 ||
+		    get_tree_entry(tree->object.sha1, path, sha1, &mode) ||
+		    hashcmp(active_cache[pos]->sha1, sha1)) {
+			free(new_path);
+			continue;
+		}
+
+		pos = cache_name_pos(new_path, strlen(new_path));
+		if (pos < 0)
+			pos = -pos - 1;
+		if (pos < active_nr &&
+		    !strcmp(active_cache[pos]->name, new_path)) {
+			output(o, 1, _("CONFLICT (implicit dir rename): "
+				       "%s added in %s would follow the "
+				       "directory rename to %s, which "
+				       "already exists; leaving it in "
+				       "place."),
+			       path, add_branch, new_path);
+			free(new_path);
+			continue;
+		}
+
+		output(o, 1, _("Path updated: %s added in %s inside a "
+			       "directory that was renamed in %s; moving "
+			       "it to %s."),
+		       path, add_branch, rename_branch, new_path);
+		remove_file(o, 1, path, 0);
+		update_file(o, 1, sha1, mode, new_path);
+		free(new_path);
+	}
+}
+
 static int process_renames(struct merge_options *o,
 			   struct string_list *a_renames,
 			   struct string_list *b_renames)
@@ -1614,7 +1797,7 @@ static int merge_content(struct merge_options *o,
 			 o->branch2 == rename_conflict_info->branch1) ?
 			pair1->two->path : pair1->one->path;
 
-		if (dir_in_way(path, !o->call_depth))
+		if (dir_in_way(path, !o->call_depth && !o->no_worktree))
 			df_conflict_remains = 1;
 	}
 	mfi = merge_file_special_markers(o, &one, &a, &b,
@@ -1762,7 +1945,7 @@ static int process_entry(struct merge_options *o,
 			sha = b_sha;
 			conf = _("directory/file");
 		}
-		if (dir_in_way(path, !o->call_depth)) {
+		if (dir_in_way(path, !o->call_depth && !o->no_worktree)) {
 			char *new_path = unique_path(o, path, add_branch);
 			clean_merge = 0;
 			output(o, 1, _("CONFLICT (%s): There is a directory with name %s in %s. "
@@ -1816,7 +1999,8 @@ int merge_trees(struct merge_options *o,
 		return 1;
 	}
 
-	code = git_merge_trees(o->call_depth, common, head, merge);
+	code = git_merge_trees(o->call_depth || o->no_worktree,
+			       common, head, merge);
 
 	if (code != 0) {
 		if (show(o, 4) || o->call_depth)
@@ -1829,6 +2013,8 @@ int merge_trees(struct merge_options *o,
 
 	if (unmerged_cache()) {
 		struct string_list *entries, *re_head, *re_merge;
+		struct string_list adds_head = STRING_LIST_INIT_DUP;
+		struct string_list adds_merge = STRING_LIST_INIT_DUP;
 		int i;
 		string_list_clear(&o->current_file_set, 1);
 		string_list_clear(&o->current_directory_set, 1);
@@ -1837,8 +2023,27 @@ int merge_trees(struct merge_options *o,
 
 		entries = get_unmerged();
 		record_df_conflict_files(o, entries);
-		re_head  = get_renames(o, head, common, head, merge, entries);
-		re_merge = get_renames(o, merge, common, head, merge, entries);
+		re_head  = get_renames(o, head, common, head, merge, entries,
+				       o->detect_directory_renames ?
+				       &adds_head : NULL);
+		re_merge = get_renames(o, merge, common, head, merge, entries,
+				       o->detect_directory_renames ?
+				       &adds_merge : NULL);
+		if (o->detect_directory_renames) {
+			struct string_list dir_re_head = STRING_LIST_INIT_DUP;
+			struct string_list dir_re_merge = STRING_LIST_INIT_DUP;
+
+			get_directory_renames(re_head, head, &dir_re_head);
+			get_directory_renames(re_merge, merge, &dir_re_merge);
+			apply_directory_renames(o, head, &adds_head,
+						&dir_re_merge,
+						o->branch1, o->branch2);
+			apply_directory_renames(o, merge, &adds_merge,
+						&dir_re_head,
+						o->branch2, o->branch1);
+			string_list_clear(&dir_re_head, 1);
+			string_list_clear(&dir_re_merge, 1);
+		}
 		clean = process_renames(o, re_head, re_merge);
 		for (i = entries->nr-1; 0 <= i; i--) {
 			const char *path = entries->items[i].string;
@@ -1857,6 +2062,8 @@ int merge_trees(struct merge_options *o,
 		string_list_clear(re_merge, 0);
 		string_list_clear(re_head, 0);
 		string_list_clear(entries, 1);
+		string_list_clear(&adds_head, 0);
+		string_list_clear(&adds_merge, 0);
 
 		free(re_merge);
 		free(re_head);
@@ -1867,6 +2074,12 @@ int merge_trees(struct merge_options *o,
 
 	if (o->call_depth)
 		*result = write_tree_from_memory(o);
+	else if (o->no_worktree)
+		/*
+		 * A conflicted in-core merge cannot be written as a
+		 * tree; leave the stages in the index for the caller.
+		 */
+		*result = clean ? write_tree_from_memory(o) : NULL;
 
 	return clean;
 }
@@ -1952,7 +2165,7 @@ int merge_recursive(struct merge_options *o,
 	}
 
 	discard_cache();
-	if (!o->call_depth)
+	if (!o->call_depth && !o->no_worktree)
 		read_cache();
 
 	o->ancestor = "merged common ancestors";
@@ -1963,7 +2176,9 @@ int merge_recursive(struct merge_options *o,
 		*result = make_virtual_commit(mrtree, "merged tree");
 		commit_list_insert(h1, &(*result)->parents);
 		commit_list_insert(h2, &(*result)->parents->next);
-	}
+	} else if (o->no_worktree)
+		*result = mrtree ? make_virtual_commit(mrtree, "merged tree")
+				 : NULL;
 	flush_output(o);
 	if (show(o, 2))
 		diff_warn_rename_limit("merge.renamelimit",
@@ -2026,6 +2241,8 @@ static void merge_recursive_config(struct merge_options *o)
 	git_config_get_int("merge.verbosity", &o->verbosity);
 	git_config_get_int("diff.renamelimit", &o->diff_rename_limit);
 	git_config_get_int("merge.renamelimit", &o->merge_rename_limit);
+	git_config_get_bool("merge.directoryrenames",
+			    &o->detect_directory_renames);
 	git_config(git_xmerge_config, NULL);
 }
 
@@ -2037,6 +2254,7 @@ void init_merge_options(struct merge_options *o)
 	o->diff_rename_limit = -1;
 	o->merge_rename_limit = -1;
 	o->renormalize = 0;
+	o->detect_directory_renames = 1;
 	merge_recursive_config(o);
 	if (getenv("GIT_MERGE_VERBOSITY"))
 		o->verbosity =
@@ -15,6 +15,14 @@ struct merge_options {
 	const char *subtree_shift;
 	unsigned buffer_output : 1;
 	unsigned renormalize : 1;
+	/*
+	 * Merge purely in core: neither the working tree nor the index
+	 * file is read or written.  The caller starts from a discarded
+	 * index; a clean merge leaves the result tree in *result, a
+	 * conflicted one leaves the conflicting stages in the in-core
+	 * index for the caller to inspect.
+	 */
+	unsigned no_worktree : 1;
 	long xdl_opts;
 	int verbosity;
 	int diff_rename_limit;
@@ -22,6 +30,7 @@ struct merge_options {
 	int rename_score;
 	int needed_rename_limit;
 	int show_rename_progress;
+	int detect_directory_renames;
 	int call_depth;
 	struct strbuf obuf;
 	struct string_list current_file_set;
@@ -0,0 +1,280 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "csum-file.h"
+#include "midx.h"
+
+#define MIDX_SIGNATURE 0x4d494458 /* "MIDX" */
+#define MIDX_VERSION 1
+#define MIDX_HEADER_SIZE 16
+#define MIDX_OBJECT_WIDTH 12
+
+/*
+ * The multi-pack-index covers every local pack in one object
+ * directory with a single sorted OID table, so that object lookup
+ * stays a single binary search no matter how many packs have piled up
+ * since the last repack.  Packs named by the index are resolved
+ * lazily against the packed_git list; an entry whose pack has gone
+ * away simply misses, and the caller falls back to walking the packs.
+ */
+static struct multi_pack_index {
+	void *map;
+	size_t map_size;
+	uint32_t nr_packs;
+	uint32_t nr_objects;
+	const char **pack_names;
+	struct packed_git **packs;
+	const unsigned char *oid_list;
+	const unsigned char *objects;
+} midx;
+
+/* -1: disabled or missing, 0: not yet tried, 1: loaded */
+static int midx_state;
+
+static void release_midx_maps(void)
+{
+	if (midx.map)
+		munmap(midx.map, midx.map_size);
+	free(midx.pack_names);
+	free(midx.packs);
+	memset(&midx, 0, sizeof(midx));
+}
+
+void close_midx(void)
+{
+	release_midx_maps();
+	midx_state = 0;
+}
+
+void prepare_midx(const char *obj_dir)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct stat st;
+	int fd, use_midx = 1;
+	uint32_t i;
+	unsigned char *data;
+	const char *name, *names_end;
+	size_t names_len;
+
+	if (midx_state)
+		return;
+	midx_state = -1;
+
+	if (!git_config_get_bool("core.multipackindex", &use_midx) && !use_midx)
+		return;
+
+	strbuf_addf(&path, "%s/pack/multi-pack-index", obj_dir);
+	fd = open(path.buf, O_RDONLY);
+	strbuf_release(&path);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || st.st_size < MIDX_HEADER_SIZE + 20) {
+		close(fd);
+		return;
+	}
+	data = xmmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (get_be32(data) != MIDX_SIGNATURE ||
+	    get_be32(data + 4) != MIDX_VERSION) {
+		warning("multi-pack-index file has unknown format; ignoring it");
+		munmap(data, st.st_size);
+		return;
+	}
+	midx.map = data;
+	midx.map_size = st.st_size;
+	midx.nr_packs = get_be32(data + 8);
+	midx.nr_objects = get_be32(data + 12);
+
+	names_len = get_be32(data + MIDX_HEADER_SIZE);
+	if (MIDX_HEADER_SIZE + 4 + names_len +
+	    (size_t)midx.nr_objects * (20 + MIDX_OBJECT_WIDTH) + 20 >
+	    (size_t)st.st_size) {
+		warning("multi-pack-index file is truncated; ignoring it");
+		release_midx_maps();
+		return;
+	}
+
+	midx.pack_names = xcalloc(midx.nr_packs, sizeof(*midx.pack_names));
+	midx.packs = xcalloc(midx.nr_packs, sizeof(*midx.packs));
+	name = (const char *)data + MIDX_HEADER_SIZE + 4;
+	names_end = name + names_len;
+	for (i = 0; i < midx.nr_packs; i++) {
+		if (name >= names_end) {
+			warning("multi-pack-index names pack %"PRIu32
+				" beyond its name chunk; ignoring it", i);
+			release_midx_maps();
+			return;
+		}
+		midx.pack_names[i] = name;
+		name += strlen(name) + 1;
+	}
+	midx.oid_list = (const unsigned char *)names_end;
+	midx.objects = midx.oid_list + (size_t)midx.nr_objects * 20;
+	midx_state = 1;
+}
+
+static struct packed_git *midx_pack(uint32_t pack_id)
+{
+	struct packed_git *p;
+	const char *want;
+
+	if (pack_id >= midx.nr_packs)
+		die("invalid pack position %"PRIu32" in multi-pack-index",
+		    pack_id);
+	if (midx.packs[pack_id])
+		return midx.packs[pack_id];
+
+	want = midx.pack_names[pack_id];
+	for (p = packed_git; p; p = p->next) {
+		const char *base = strrchr(p->pack_name, '/');
+		base = base ? base + 1 : p->pack_name;
+		if (p->pack_local && !strcmp(base, want)) {
+			midx.packs[pack_id] = p;
+			return p;
+		}
+	}
+	return NULL;
+}
+
+int midx_lookup(const unsigned char *sha1, struct packed_git **pack,
+		off_t *offset)
+{
+	uint32_t lo = 0, hi;
+	const unsigned char *rec;
+	struct packed_git *p;
+
+	if (midx_state <= 0)
+		return 0;
+
+	hi = midx.nr_objects;
+	while (lo < hi) {
+		uint32_t mi = lo + (hi - lo) / 2;
+		int cmp = hashcmp(sha1, midx.oid_list + (size_t)mi * 20);
+		if (!cmp) {
+			rec = midx.objects + (size_t)mi * MIDX_OBJECT_WIDTH;
+			p = midx_pack(get_be32(rec));
+			if (!p)
+				return 0;
+			*pack = p;
+			*offset = ((off_t)get_be32(rec + 4) << 16 << 16) |
+				  get_be32(rec + 8);
+			return 1;
+		}
+		if (cmp < 0)
+			hi = mi;
+		else
+			lo = mi + 1;
+	}
+	return 0;
+}
+
+struct midx_object {
+	const unsigned char *sha1;
+	uint32_t pack_id;
+	off_t offset;
+};
+
+static int midx_object_cmp(const void *a_, const void *b_)
+{
+	const struct midx_object *a = a_;
+	const struct midx_object *b = b_;
+	int cmp = hashcmp(a->sha1, b->sha1);
+	if (cmp)
+		return cmp;
+	/* prefer the pack earlier in the MRU-sorted pack list */
+	return (int)a->pack_id - (int)b->pack_id;
+}
+
+static int pack_in_dir(struct packed_git *p, const char *pack_dir,
+		       size_t pack_dir_len)
+{
+	return p->pack_local &&
+		!strncmp(p->pack_name, pack_dir, pack_dir_len) &&
+		p->pack_name[pack_dir_len] == '/' &&
+		!strchr(p->pack_name + pack_dir_len + 1, '/');
+}
+
+void write_midx_file(const char *obj_dir)
+{
+	struct strbuf pack_dir = STRBUF_INIT;
+	struct strbuf names = STRBUF_INIT;
+	struct strbuf path = STRBUF_INIT;
+	struct packed_git *p, **packs = NULL;
+	struct midx_object *objects = NULL;
+	uint32_t nr_packs = 0, nr_objects = 0, nr_unique, i;
+	int fd, packs_alloc = 0;
+	size_t nr_total = 0;
+	static struct lock_file lk;
+	struct sha1file *f;
+	unsigned char buf[MIDX_HEADER_SIZE + 4];
+
+	close_midx();
+	reprepare_packed_git();
+
+	strbuf_addf(&pack_dir, "%s/pack", obj_dir);
+	for (p = packed_git; p; p = p->next) {
+		if (!pack_in_dir(p, pack_dir.buf, pack_dir.len))
+			continue;
+		if (open_pack_index(p))
+			continue;
+		ALLOC_GROW(packs, nr_packs + 1, packs_alloc);
+		packs[nr_packs++] = p;
+		nr_total += p->num_objects;
+	}
+
+	objects = xcalloc(nr_total ? nr_total : 1, sizeof(*objects));
+	for (i = 0; i < nr_packs; i++) {
+		const char *base = strrchr(packs[i]->pack_name, '/') + 1;
+		uint32_t n;
+
+		strbuf_addstr(&names, base);
+		strbuf_addch(&names, '\0');
+		for (n = 0; n < packs[i]->num_objects; n++) {
+			struct midx_object *obj = &objects[nr_objects++];
+			obj->sha1 = nth_packed_object_sha1(packs[i], n);
+			obj->pack_id = i;
+			obj->offset = nth_packed_object_offset(packs[i], n);
+		}
+	}
+	qsort(objects, nr_objects, sizeof(*objects), midx_object_cmp);
+
+	strbuf_addf(&path, "%s/multi-pack-index", pack_dir.buf);
+	fd = hold_lock_file_for_update(&lk, path.buf, LOCK_DIE_ON_ERROR);
+	f = sha1fd(xdup(fd), path.buf);
+
+	nr_unique = 0;
+	for (i = 0; i < nr_objects; i++)
+		if (!i || hashcmp(objects[i].sha1, objects[i - 1].sha1))
+			nr_unique++;
+
+	put_be32(buf, MIDX_SIGNATURE);
+	put_be32(buf + 4, MIDX_VERSION);
+	put_be32(buf + 8, nr_packs);
+	put_be32(buf + 12, nr_unique);
+	put_be32(buf + 16, (uint32_t)names.len);
+	sha1write(f, buf, sizeof(buf));
+	sha1write(f, names.buf, names.len);
+	for (i = 0; i < nr_objects; i++) {
+		if (i && !hashcmp(objects[i].sha1, objects[i - 1].sha1))
+			continue;
+		sha1write(f, objects[i].sha1, 20);
+	}
+	for (i = 0; i < nr_objects; i++) {
+		if (i && !hashcmp(objects[i].sha1, objects[i - 1].sha1))
+			continue;
+		put_be32(buf, objects[i].pack_id);
+		put_be32(buf + 4, (uint32_t)(objects[i].offset >> 16 >> 16));
+		put_be32(buf + 8, (uint32_t)objects[i].offset);
+		sha1write(f, buf, MIDX_OBJECT_WIDTH);
+	}
+	sha1close(f, NULL, CSUM_CLOSE | CSUM_FSYNC);
+
+	if (commit_lock_file(&lk))
+		die_errno("unable to write multi-pack-index file");
+
+	free(packs);
+	free(objects);
+	strbuf_release(&pack_dir);
+	strbuf_release(&names);
+	strbuf_release(&path);
+}
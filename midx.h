@@ -0,0 +1,31 @@
+#ifndef MIDX_H
+#define MIDX_H
+
+struct packed_git;
+
+/*
+ * Load the multi-pack-index for the given object directory, if one
+ * exists and core.multiPackIndex is not disabled.  Safe to call more
+ * than once; subsequent calls are no-ops.
+ */
+void prepare_midx(const char *obj_dir);
+
+/*
+ * Look up an object in the multi-pack-index.  On a hit, return
+ * non-zero and fill in the containing pack and the offset within it.
+ * A miss (or a hit in a pack that has gone away since the index was
+ * written) returns zero; the caller falls back to the pack list.
+ */
+int midx_lookup(const unsigned char *sha1, struct packed_git **pack,
+		off_t *offset);
+
+/* Forget the loaded multi-pack-index, e.g. after repacking. */
+void close_midx(void);
+
+/*
+ * Rewrite the multi-pack-index to cover every local pack in the given
+ * object directory.  Dies on write errors.
+ */
+void write_midx_file(const char *obj_dir);
+
+#endif /* MIDX_H */
@@ -7,6 +7,7 @@
  */
 #define NO_THE_INDEX_COMPATIBILITY_MACROS
 #include "cache.h"
+#include "thread-utils.h"
 
 struct dir_entry {
 	struct hashmap_entry ent;
@@ -23,15 +24,22 @@ static int dir_entry_cmp(const struct dir_entry *e1,
 			name ? name : e2->ce->name, e1->namelen);
 }
 
-static struct dir_entry *find_dir_entry(struct index_state *istate,
-		const char *name, unsigned int namelen)
+static struct dir_entry *find_dir_entry__hash(struct index_state *istate,
+		const char *name, unsigned int namelen, unsigned int hash)
 {
 	struct dir_entry key;
-	hashmap_entry_init(&key, memihash(name, namelen));
+	hashmap_entry_init(&key, hash);
 	key.namelen = namelen;
 	return hashmap_get(&istate->dir_hash, &key, name);
 }
 
+static struct dir_entry *find_dir_entry(struct index_state *istate,
+		const char *name, unsigned int namelen)
+{
+	return find_dir_entry__hash(istate, name, namelen,
+				    memihash(name, namelen));
+}
+
 static struct dir_entry *hash_dir_entry(struct index_state *istate,
 		struct cache_entry *ce, int namelen)
 {
@@ -50,7 +58,9 @@ static struct dir_entry *hash_dir_entry(struct index_state *istate,
 	 * an exact cache_entry that's still active. It is very possible that
 	 * multiple dir_entries point to the same cache_entry.
 	 */
-	struct dir_entry *dir;
+	struct dir_entry *dir, *parent;
+	unsigned int hash = 0;
+	int i, prev;
 
 	/* get length of parent directory */
 	while (namelen > 0 && !is_dir_sep(ce->name[namelen - 1]))
@@ -61,16 +71,32 @@ static struct dir_entry *hash_dir_entry(struct index_state *istate,
 
 	/* lookup existing entry for that directory */
 	dir = find_dir_entry(istate, ce->name, namelen);
-	if (!dir) {
-		/* not found, create it and add to hash table */
-		dir = xcalloc(1, sizeof(struct dir_entry));
-		hashmap_entry_init(dir, memihash(ce->name, namelen));
-		dir->namelen = namelen;
-		dir->ce = ce;
-		hashmap_add(&istate->dir_hash, dir);
-
-		/* recursively add missing parent directories */
-		dir->parent = hash_dir_entry(istate, ce, namelen);
+	if (dir)
+		return dir;
+
+	/*
+	 * Not found; walk the path from the top, creating any missing
+	 * dir_entries along the way.  Hashing each prefix by continuing
+	 * from the hash of the previous one keeps this pass linear in
+	 * the length of the path instead of quadratic.
+	 */
+	parent = NULL;
+	for (i = 0, prev = 0; i <= namelen; i++) {
+		if (i < namelen && !is_dir_sep(ce->name[i]))
+			continue;
+		hash = prev ? memihash_cont(hash, ce->name + prev, i - prev)
+			    : memihash(ce->name, i);
+		dir = find_dir_entry__hash(istate, ce->name, i, hash);
+		if (!dir) {
+			dir = xcalloc(1, sizeof(struct dir_entry));
+			hashmap_entry_init(dir, hash);
+			dir->namelen = i;
+			dir->ce = ce;
+			dir->parent = parent;
+			hashmap_add(&istate->dir_hash, dir);
+		}
+		parent = dir;
+		prev = i;
 	}
 	return dir;
 }
@@ -121,17 +147,114 @@ static int cache_entry_cmp(const struct cache_entry *ce1,
 	return remove ? !(ce1 == ce2) : 0;
 }
 
+#ifndef NO_PTHREADS
+
+/*
+ * Building the name hash is dominated by running memihash() over
+ * every path in the index, which is embarrassingly parallel; the
+ * hashmap_add() calls that follow are cheap in comparison because
+ * they never compare entries.  So precompute the hash codes with a
+ * pool of threads and leave only the table insertion (and, on
+ * case-insensitive systems, the directory table, whose entries
+ * dedupe against each other while it is built) to the main thread.
+ */
+#define LAZY_THREAD_COST (2000)
+
+struct lazy_name_thread_data {
+	pthread_t pthread;
+	struct index_state *istate;
+	int start, nr;
+};
+
+static void *lazy_name_thread_proc(void *_data)
+{
+	struct lazy_name_thread_data *d = _data;
+	int k;
+
+	for (k = d->start; k < d->start + d->nr; k++) {
+		struct cache_entry *ce = d->istate->cache[k];
+		/*
+		 * An entry that is already hashed may sit in another
+		 * index's table (e.g. shared with the split-index
+		 * base); do not touch its hashmap linkage.
+		 */
+		if (ce->ce_flags & CE_HASHED)
+			continue;
+		hashmap_entry_init(ce, memihash(ce->name, ce_namelen(ce)));
+	}
+	return NULL;
+}
+
+/*
+ * Precompute the hash code of every cache entry in parallel.
+ * Returns non-zero when the index is too small to be worth the
+ * thread overhead (or threads cannot be started) and the caller
+ * should hash serially instead.
+ */
+static int threaded_hash_name_entries(struct index_state *istate)
+{
+	struct lazy_name_thread_data *data;
+	int nr_threads = online_cpus();
+	int i, start, per_thread, err = 0;
+
+	if (istate->cache_nr < LAZY_THREAD_COST || nr_threads < 2)
+		return -1;
+	if (nr_threads > istate->cache_nr / LAZY_THREAD_COST)
+		nr_threads = istate->cache_nr / LAZY_THREAD_COST;
+
+	data = xcalloc(nr_threads, sizeof(*data));
+	per_thread = DIV_ROUND_UP(istate->cache_nr, nr_threads);
+	for (i = start = 0; i < nr_threads; i++, start += per_thread) {
+		struct lazy_name_thread_data *d = &data[i];
+
+		d->istate = istate;
+		d->start = start;
+		d->nr = istate->cache_nr - start < per_thread ?
+			istate->cache_nr - start : per_thread;
+		if (pthread_create(&d->pthread, NULL,
+				   lazy_name_thread_proc, d))
+			die("unable to create lazy_name thread");
+	}
+	for (i = 0; i < nr_threads; i++)
+		if (pthread_join(data[i].pthread, NULL))
+			die("unable to join lazy_name thread");
+	free(data);
+	return err;
+}
+#endif
+
 static void lazy_init_name_hash(struct index_state *istate)
 {
 	int nr;
+	int precomputed = 0;
 
 	if (istate->name_hash_initialized)
 		return;
 	hashmap_init(&istate->name_hash, (hashmap_cmp_fn) cache_entry_cmp,
 			istate->cache_nr);
 	hashmap_init(&istate->dir_hash, (hashmap_cmp_fn) dir_entry_cmp, 0);
-	for (nr = 0; nr < istate->cache_nr; nr++)
-		hash_index_entry(istate, istate->cache[nr]);
+	/*
+	 * The tables are sized for the index as loaded; spread the cost
+	 * of any growth caused by later additions over the additions
+	 * themselves instead of pausing to rehash everything at once.
+	 */
+	hashmap_set_incremental_resize(&istate->name_hash, 1);
+	hashmap_set_incremental_resize(&istate->dir_hash, 1);
+#ifndef NO_PTHREADS
+	precomputed = !threaded_hash_name_entries(istate);
+#endif
+	for (nr = 0; nr < istate->cache_nr; nr++) {
+		struct cache_entry *ce = istate->cache[nr];
+
+		if (ce->ce_flags & CE_HASHED)
+			continue;
+		ce->ce_flags |= CE_HASHED;
+		if (!precomputed)
+			hashmap_entry_init(ce, memihash(ce->name, ce_namelen(ce)));
+		hashmap_add(&istate->name_hash, ce);
+		if (ignore_case)
+			add_dir_entry(istate, ce);
+	}
 	istate->name_hash_initialized = 1;
 }
 
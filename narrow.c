@@ -0,0 +1,141 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "string-list.h"
+#include "run-command.h"
+#include "narrow.h"
+
+int is_repository_narrow(void)
+{
+	return !access(git_path("narrow"), F_OK);
+}
+
+/* memoized; callers probe this once per index entry */
+static int blobless = -1;
+
+int is_repository_blobless(void)
+{
+	if (blobless < 0)
+		blobless = !access(git_path("no-blobs"), F_OK);
+	return blobless;
+}
+
+void register_blobless_origin(const char *url)
+{
+	static struct lock_file lock;
+	struct strbuf buf = STRBUF_INIT;
+	int fd;
+
+	strbuf_addf(&buf, "%s\n", url);
+	fd = hold_lock_file_for_update(&lock, git_path("no-blobs"),
+				       LOCK_DIE_ON_ERROR);
+	if (write_in_full(fd, buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lock))
+		die_errno("failed to write no-blobs file");
+	strbuf_release(&buf);
+	blobless = -1;
+}
+
+int fetch_missing_object(const unsigned char *sha1)
+{
+	static int fetching;
+	struct child_process cp = CHILD_PROCESS_INIT;
+	struct strbuf url = STRBUF_INIT;
+	int ret;
+
+	if (fetching || getenv("GIT_NO_LAZY_FETCH"))
+		return -1;
+	if (strbuf_read_file(&url, git_path("no-blobs"), 0) <= 0) {
+		strbuf_release(&url);
+		return -1;
+	}
+	strbuf_trim(&url);
+
+	fetching = 1;
+	argv_array_push(&cp.args, "fetch-pack");
+	argv_array_push(&cp.args, "--quiet");
+	argv_array_push(&cp.args, "--no-haves");
+	argv_array_push(&cp.args, url.buf);
+	argv_array_push(&cp.args, sha1_to_hex(sha1));
+	/* keep the helper from re-entering us on its own misses */
+	argv_array_push(&cp.env_array, "GIT_NO_LAZY_FETCH=1");
+	cp.git_cmd = 1;
+	cp.no_stdin = 1;
+	cp.no_stdout = 1;
+	ret = run_command(&cp);
+	fetching = 0;
+	strbuf_release(&url);
+
+	if (ret)
+		return -1;
+	reprepare_packed_git();
+	return 0;
+}
+
+/*
+ * Narrow paths travel over the wire and end up in pathspecs on the
+ * serving side, so be strict: relative, slash-separated and no
+ * magic, "." or ".." components.
+ */
+void check_narrow_path(const char *path)
+{
+	const char *p = path;
+
+	if (!*path || is_absolute_path(path) || path[strlen(path) - 1] == '/')
+		die("invalid narrow path '%s'", path);
+	while (*p) {
+		const char *slash = strchrnul(p, '/');
+		size_t len = slash - p;
+
+		if (!len ||
+		    (len <= 2 && !strncmp(p, "..", len)))
+			die("invalid narrow path '%s'", path);
+		p = *slash ? slash + 1 : slash;
+	}
+}
+
+/*
+ * Insert the recorded narrow paths into a sorted string list;
+ * harmless when the repository is not narrow.
+ */
+void get_narrow_paths(struct string_list *paths)
+{
+	char buf[PATH_MAX];
+	FILE *fp = fopen(git_path("narrow"), "r");
+
+	if (!fp)
+		return;
+	while (fgets(buf, sizeof(buf), fp)) {
+		int len = strlen(buf);
+
+		if (len && buf[len - 1] == '\n')
+			buf[--len] = 0;
+		if (!len)
+			continue;
+		string_list_insert(paths, buf);
+	}
+	fclose(fp);
+}
+
+void register_narrow_paths(const struct string_list *paths)
+{
+	static struct lock_file lock;
+	struct string_list merged = STRING_LIST_INIT_DUP;
+	struct string_list_item *item;
+	struct strbuf buf = STRBUF_INIT;
+	int fd;
+
+	get_narrow_paths(&merged);
+	for_each_string_list_item(item, paths)
+		string_list_insert(&merged, item->string);
+	for_each_string_list_item(item, &merged)
+		strbuf_addf(&buf, "%s\n", item->string);
+
+	fd = hold_lock_file_for_update(&lock, git_path("narrow"),
+				       LOCK_DIE_ON_ERROR);
+	if (write_in_full(fd, buf.buf, buf.len) < 0 ||
+	    commit_lock_file(&lock))
+		die_errno("failed to write narrow file");
+
+	strbuf_release(&buf);
+	string_list_clear(&merged, 0);
+}
@@ -0,0 +1,34 @@
+#ifndef NARROW_H
+#define NARROW_H
+
+struct string_list;
+
+/*
+ * A narrow repository holds only the objects needed for a subset of
+ * top-level paths.  Like $GIT_DIR/shallow records where history was
+ * cut, $GIT_DIR/narrow records which paths the object database
+ * covers, one per line, so later fetches keep asking the server for
+ * the same slice.
+ */
+extern int is_repository_narrow(void);
+extern void check_narrow_path(const char *path);
+extern void get_narrow_paths(struct string_list *paths);
+extern void register_narrow_paths(const struct string_list *paths);
+
+/*
+ * A blob-less repository goes one step further and holds no blobs at
+ * all; $GIT_DIR/no-blobs records the URL of the repository that
+ * promised to supply them on demand.
+ */
+extern int is_repository_blobless(void);
+extern void register_blobless_origin(const char *url);
+
+/*
+ * Fetch a single missing object from the recorded origin of a
+ * blob-less repository.  Returns 0 when the object was obtained,
+ * -1 when it was not (not a blob-less repository, recursion, or
+ * the transfer failed).
+ */
+extern int fetch_missing_object(const unsigned char *sha1);
+
+#endif /* NARROW_H */
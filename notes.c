@@ -1,4 +1,5 @@
 #include "cache.h"
+#include "lockfile.h"
 #include "notes.h"
 #include "blob.h"
 #include "tree.h"
@@ -68,6 +69,56 @@ struct non_note {
 #define SUBTREE_SHA1_PREFIXCMP(key_sha1, subtree_sha1) \
 	(memcmp(key_sha1, subtree_sha1, subtree_sha1[19]))
 
+/*
+ * $GIT_DIR/notes-index caches the fully fanned-out content of one
+ * notes tree as a sorted array of (object SHA-1, note SHA-1) pairs,
+ * so that get_note() can binary search it instead of faulting in tree
+ * objects one subtree at a time. The header records the root tree the
+ * index was built from; an index that does not match the tree behind
+ * the current notes ref is silently ignored, hence the file can only
+ * ever be stale, never wrong. It is rebuilt by 'git notes prune'.
+ */
+struct notes_index_header {
+	char signature[4];
+	uint32_t version;
+	unsigned char tree_sha1[20];
+};
+
+#define NOTES_INDEX_SIGNATURE "NIDX"
+#define NOTES_INDEX_VERSION 1
+#define NOTES_INDEX_ENTRYSZ 40
+
+static void load_notes_index(struct notes_tree *t,
+		const unsigned char *tree_sha1)
+{
+	const struct notes_index_header *hdr;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(git_path("notes-index"), O_RDONLY);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) ||
+	    st.st_size < (off_t) sizeof(*hdr) ||
+	    (st.st_size - sizeof(*hdr)) % NOTES_INDEX_ENTRYSZ) {
+		close(fd);
+		return;
+	}
+	map = xmmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	hdr = map;
+	if (memcmp(hdr->signature, NOTES_INDEX_SIGNATURE, 4) ||
+	    ntohl(hdr->version) != NOTES_INDEX_VERSION ||
+	    hashcmp(hdr->tree_sha1, tree_sha1)) {
+		munmap(map, st.st_size);
+		return;
+	}
+	t->index_map = map;
+	t->index_size = st.st_size;
+	t->index_nr = (st.st_size - sizeof(*hdr)) / NOTES_INDEX_ENTRYSZ;
+}
+
 struct notes_tree default_notes_tree;
 
 static struct string_list display_notes_refs;
@@ -1010,6 +1061,9 @@ void init_notes(struct notes_tree *t, const char *notes_ref,
 	t->combine_notes = combine_notes;
 	t->initialized = 1;
 	t->dirty = 0;
+	t->index_map = NULL;
+	t->index_size = 0;
+	t->index_nr = 0;
 
 	if (flags & NOTES_INIT_EMPTY || !notes_ref ||
 	    read_ref(notes_ref, object_sha1))
@@ -1020,6 +1074,7 @@ void init_notes(struct notes_tree *t, const char *notes_ref,
 
 	hashclr(root_tree.key_sha1);
 	hashcpy(root_tree.val_sha1, sha1);
+	load_notes_index(t, sha1);
 	load_subtree(t, &root_tree, t->root, 0);
 }
 
@@ -1112,6 +1167,27 @@ const unsigned char *get_note(struct notes_tree *t,
 	if (!t)
 		t = &default_notes_tree;
 	assert(t->initialized);
+
+	if (t->index_map && !t->dirty) {
+		const unsigned char *base = (const unsigned char *) t->index_map +
+			sizeof(struct notes_index_header);
+		size_t lo = 0, hi = t->index_nr;
+
+		while (lo < hi) {
+			size_t mi = lo + (hi - lo) / 2;
+			const unsigned char *entry = base + mi * NOTES_INDEX_ENTRYSZ;
+			int cmp = hashcmp(object_sha1, entry);
+
+			if (!cmp)
+				return entry + 20;
+			else if (cmp < 0)
+				hi = mi;
+			else
+				lo = mi + 1;
+		}
+		return NULL;
+	}
+
 	found = note_tree_find(t, t->root, 0, object_sha1);
 	return found ? found->val_sha1 : NULL;
 }
@@ -1153,6 +1229,48 @@ int write_notes_tree(struct notes_tree *t, unsigned char *result)
 	return ret;
 }
 
+static int index_one_note(const unsigned char *object_sha1,
+		const unsigned char *note_sha1, char *note_path,
+		void *cb_data)
+{
+	struct strbuf *buf = cb_data;
+
+	strbuf_add(buf, object_sha1, 20);
+	strbuf_add(buf, note_sha1, 20);
+	return 0;
+}
+
+int write_notes_index(struct notes_tree *t)
+{
+	static struct lock_file index_lock;
+	struct notes_index_header hdr;
+	struct strbuf buf = STRBUF_INIT;
+	unsigned char tree_sha1[20];
+	int fd, ret;
+
+	if (!t)
+		t = &default_notes_tree;
+	assert(t->initialized);
+
+	if (write_notes_tree(t, tree_sha1))
+		return -1;
+
+	fd = hold_lock_file_for_update(&index_lock,
+				       git_path("notes-index"), 0);
+	if (fd < 0)
+		return error("unable to lock notes index for writing");
+	memcpy(hdr.signature, NOTES_INDEX_SIGNATURE, 4);
+	hdr.version = htonl(NOTES_INDEX_VERSION);
+	hashcpy(hdr.tree_sha1, tree_sha1);
+	strbuf_add(&buf, &hdr, sizeof(hdr));
+	/* the in-order trie traversal yields notes sorted by object name */
+	for_each_note(t, 0, index_one_note, &buf);
+	ret = write_in_full(fd, buf.buf, buf.len) != (ssize_t) buf.len ||
+		commit_lock_file(&index_lock);
+	strbuf_release(&buf);
+	return ret ? -1 : 0;
+}
+
 void prune_notes(struct notes_tree *t, int flags)
 {
 	struct note_delete_list *l = NULL;
@@ -1179,6 +1297,8 @@ void free_notes(struct notes_tree *t)
 	if (t->root)
 		note_tree_free(t->root);
 	free(t->root);
+	if (t->index_map)
+		munmap(t->index_map, t->index_size);
 	while (t->first_non_note) {
 		t->prev_non_note = t->first_non_note->next;
 		free(t->first_non_note->path);
@@ -47,6 +47,10 @@ extern struct notes_tree {
 	combine_notes_fn combine_notes;
 	int initialized;
 	int dirty;
+	/* mmap'ed $GIT_DIR/notes-index consulted by get_note(); see notes.c */
+	void *index_map;
+	size_t index_size;
+	size_t index_nr;
 } default_notes_tree;
 
 /*
@@ -214,6 +218,20 @@ int for_each_note(struct notes_tree *t, int flags, each_note_fn fn,
  */
 int write_notes_tree(struct notes_tree *t, unsigned char *result);
 
+/*
+ * Write a flat, sorted object-to-note index for the given notes tree
+ * to $GIT_DIR/notes-index
+ *
+ * The index caches the fully fanned-out content of the notes tree so
+ * that later get_note() calls can binary search it instead of loading
+ * tree objects one subtree at a time. An index that does not match
+ * the tree behind the notes ref is ignored by readers, so the file
+ * can only become stale, never wrong.
+ *
+ * Returns zero on success, non-zero on failure.
+ */
+int write_notes_index(struct notes_tree *t);
+
 /* Flags controlling the operation of prune */
 #define NOTES_PRUNE_VERBOSE 1
 #define NOTES_PRUNE_DRYRUN 2
@@ -0,0 +1,186 @@
+/*
+ * A long-lived object info server.
+ *
+ * The daemon sits on a Unix domain socket inside one repository and
+ * answers object info and ref resolution queries for the short-lived
+ * git processes that run against it (see core.objectInfoServer in
+ * linkgit:git-config[1]).  Because the daemon stays alive, the pack
+ * index mappings and the packed-refs cache stay hot instead of being
+ * rebuilt by every process.  Staleness is handled the way any
+ * long-running git process handles it: object lookups re-scan the
+ * pack directory on a miss, and the packed-refs cache is validated
+ * against the file before each use.
+ */
+#include "cache.h"
+#include "refs.h"
+#include "object-info-server.h"
+#include "unix-socket.h"
+#include "sigchain.h"
+#include "parse-options.h"
+
+static const char *socket_path;
+
+static void cleanup_socket(void)
+{
+	if (socket_path)
+		unlink(socket_path);
+}
+
+static void cleanup_socket_on_signal(int sig)
+{
+	cleanup_socket();
+	sigchain_pop(sig);
+	raise(sig);
+}
+
+static void serve_object_query(const char *p, FILE *out)
+{
+	unsigned char sha1[20];
+	char *end;
+	unsigned flags;
+	enum object_type type;
+	unsigned long size, disk_size;
+	struct object_info oi = {NULL};
+
+	flags = strtoul(p, &end, 10);
+	if (*end != ' ' || get_sha1_hex(end + 1, sha1)) {
+		fprintf(out, "error\n");
+		return;
+	}
+	oi.typep = &type;
+	oi.sizep = &size;
+	oi.disk_sizep = &disk_size;
+	if (sha1_object_info_extended(sha1, &oi, flags) < 0)
+		fprintf(out, "missing\n");
+	else
+		fprintf(out, "%d %lu %lu\n", type, size, disk_size);
+}
+
+static void serve_ref_query(const char *p, FILE *out)
+{
+	unsigned char sha1[20];
+	char *end;
+	int resolve_flags;
+
+	resolve_flags = strtol(p, &end, 10);
+	if (*end != ' ' || !end[1]) {
+		fprintf(out, "error\n");
+		return;
+	}
+	if (!resolve_ref_unsafe(end + 1, resolve_flags, sha1, NULL))
+		fprintf(out, "missing\n");
+	else
+		fprintf(out, "%s\n", sha1_to_hex(sha1));
+}
+
+static void serve_one_client(FILE *in, FILE *out)
+{
+	struct strbuf line = STRBUF_INIT;
+	const char *p;
+
+	if (strbuf_getline(&line, in, '\n') == EOF)
+		; /* client went away without asking anything */
+	else if (skip_prefix(line.buf, "object ", &p))
+		serve_object_query(p, out);
+	else if (skip_prefix(line.buf, "ref ", &p))
+		serve_ref_query(p, out);
+	else if (!strcmp(line.buf, "exit"))
+		exit(0);
+	else
+		warning("info server client sent unknown request: %s",
+			line.buf);
+
+	strbuf_release(&line);
+}
+
+static int serve_loop(int fd)
+{
+	struct pollfd pfd;
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, -1) < 0) {
+		if (errno != EINTR)
+			die_errno("poll failed");
+		return 1;
+	}
+
+	if (pfd.revents & POLLIN) {
+		int client, client2;
+		FILE *in, *out;
+
+		client = accept(fd, NULL, NULL);
+		if (client < 0) {
+			warning("accept failed: %s", strerror(errno));
+			return 1;
+		}
+		client2 = dup(client);
+		if (client2 < 0) {
+			warning("dup failed: %s", strerror(errno));
+			close(client);
+			return 1;
+		}
+
+		in = xfdopen(client, "r");
+		out = xfdopen(client2, "w");
+		serve_one_client(in, out);
+		fclose(in);
+		fclose(out);
+	}
+	return 1;
+}
+
+static void serve(const char *socket_path, int debug)
+{
+	int fd;
+
+	fd = unix_stream_listen(socket_path);
+	if (fd < 0)
+		die_errno("unable to bind to '%s'", socket_path);
+
+	printf("ok\n");
+	fclose(stdout);
+	if (!debug) {
+		if (!freopen("/dev/null", "w", stderr))
+			die_errno("unable to point stderr to /dev/null");
+	}
+
+	while (serve_loop(fd))
+		; /* nothing */
+
+	close(fd);
+	unlink(socket_path);
+}
+
+int main(int argc, const char **argv)
+{
+	static const char *usage[] = {
+		"git-object-info--daemon [--debug] <socket_path>",
+		NULL
+	};
+	int debug = 0;
+	const struct option options[] = {
+		OPT_BOOL(0, "debug", &debug,
+			 N_("print debugging messages to stderr")),
+		OPT_END()
+	};
+
+	argc = parse_options(argc, argv, NULL, options, usage, 0);
+	socket_path = argv[0];
+
+	if (!socket_path)
+		usage_with_options(usage, options);
+
+	setup_git_directory();
+	git_config(git_default_config, NULL);
+
+	/* we must answer from the object database, never ask ourselves */
+	info_server_disable();
+
+	atexit(cleanup_socket);
+	sigchain_push_common(cleanup_socket_on_signal);
+
+	serve(socket_path, debug);
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Client side of the object info server (git object-info--daemon).
+ *
+ * When core.objectInfoServer (or GIT_OBJECT_INFO_SOCKET) points at a
+ * live daemon, a short-lived process can ask it for object info and
+ * ref resolutions instead of mapping the pack indexes and reading
+ * packed-refs itself.  Every query that cannot be answered makes the
+ * caller fall back to direct object database access, so a missing or
+ * wedged daemon costs one failed connect() and nothing else.
+ */
+#include "cache.h"
+#include "object-info-server.h"
+
+#ifndef NO_UNIX_SOCKETS
+
+#include "unix-socket.h"
+
+static int server_broken;
+
+void info_server_disable(void)
+{
+	server_broken = 1;
+}
+
+static const char *server_socket(void)
+{
+	const char *path = getenv("GIT_OBJECT_INFO_SOCKET");
+
+	if (!path)
+		path = object_info_server;
+	return path;
+}
+
+static int server_query(const struct strbuf *request, struct strbuf *reply)
+{
+	const char *path;
+	int fd;
+
+	if (server_broken)
+		return -1;
+	path = server_socket();
+	if (!path)
+		return -1;
+
+	fd = unix_stream_connect(path);
+	if (fd < 0)
+		goto broken;
+	if (write_in_full(fd, request->buf, request->len) < 0) {
+		close(fd);
+		goto broken;
+	}
+	shutdown(fd, SHUT_WR);
+	if (strbuf_read(reply, fd, 64) <= 0) {
+		close(fd);
+		goto broken;
+	}
+	close(fd);
+	strbuf_rtrim(reply);
+	return 0;
+
+broken:
+	/* do not knock on a dead daemon's door for every object */
+	server_broken = 1;
+	return -1;
+}
+
+int info_server_object_info(const unsigned char *sha1,
+			    struct object_info *oi, unsigned flags)
+{
+	struct strbuf request = STRBUF_INIT;
+	struct strbuf reply = STRBUF_INIT;
+	int type;
+	unsigned long size, disk_size;
+	int ret = -1;
+
+	if (server_broken)
+		return -1;
+
+	strbuf_addf(&request, "object %u %s\n", flags, sha1_to_hex(sha1));
+	if (server_query(&request, &reply))
+		goto out;
+	/* a "missing" or "error" reply simply fails the parse */
+	if (sscanf(reply.buf, "%d %lu %lu", &type, &size, &disk_size) != 3)
+		goto out;
+	if (oi->typep)
+		*oi->typep = type;
+	if (oi->sizep)
+		*oi->sizep = size;
+	if (oi->disk_sizep)
+		*oi->disk_sizep = disk_size;
+	ret = 0;
+
+out:
+	strbuf_release(&request);
+	strbuf_release(&reply);
+	return ret;
+}
+
+int info_server_resolve_ref(const char *refname, int resolve_flags,
+			    unsigned char *sha1)
+{
+	struct strbuf request = STRBUF_INIT;
+	struct strbuf reply = STRBUF_INIT;
+	int ret = -1;
+
+	if (server_broken)
+		return -1;
+
+	strbuf_addf(&request, "ref %d %s\n", resolve_flags, refname);
+	if (server_query(&request, &reply))
+		goto out;
+	if (reply.len != 40 || get_sha1_hex(reply.buf, sha1))
+		goto out;
+	ret = 0;
+
+out:
+	strbuf_release(&request);
+	strbuf_release(&reply);
+	return ret;
+}
+
+#else /* NO_UNIX_SOCKETS */
+
+void info_server_disable(void)
+{
+}
+
+int info_server_object_info(const unsigned char *sha1,
+			    struct object_info *oi, unsigned flags)
+{
+	return -1;
+}
+
+int info_server_resolve_ref(const char *refname, int resolve_flags,
+			    unsigned char *sha1)
+{
+	return -1;
+}
+
+#endif /* NO_UNIX_SOCKETS */
@@ -0,0 +1,33 @@
+#ifndef OBJECT_INFO_SERVER_H
+#define OBJECT_INFO_SERVER_H
+
+struct object_info;
+
+/*
+ * Ask the object info server (git object-info--daemon) configured via
+ * core.objectInfoServer or GIT_OBJECT_INFO_SOCKET for the type, size
+ * and on-disk size of an object.  Returns 0 and fills in the requested
+ * fields of "oi" when the server gave a positive answer; returns -1
+ * when no server is configured, the server could not be reached, or it
+ * did not know the object, in which case the caller must fall back to
+ * direct object database access.
+ */
+extern int info_server_object_info(const unsigned char *sha1,
+				   struct object_info *oi, unsigned flags);
+
+/*
+ * Ask the object info server to resolve a ref to a sha1, following
+ * symrefs as resolve_ref_unsafe() would with the given resolve_flags.
+ * Returns 0 and fills in sha1 on a positive answer, -1 when the caller
+ * must resolve the ref itself.
+ */
+extern int info_server_resolve_ref(const char *refname, int resolve_flags,
+				   unsigned char *sha1);
+
+/*
+ * Permanently stop this process from consulting the server; the daemon
+ * itself uses this so that its own lookups hit the object database.
+ */
+extern void info_server_disable(void);
+
+#endif /* OBJECT_INFO_SERVER_H */
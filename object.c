@@ -5,7 +5,17 @@
 #include "commit.h"
 #include "tag.h"
 
-static struct object **obj_hash;
+/*
+ * Each slot carries the full 32-bit hash of the object name next to
+ * the object pointer, so probing past collisions compares the cached
+ * hashes instead of chasing every struct object for its sha1.
+ */
+struct obj_hash_entry {
+	unsigned int hash;
+	struct object *obj;
+};
+
+static struct obj_hash_entry *obj_hash;
 static int nr_objs, obj_hash_size;
 
 unsigned int get_max_object_index(void)
@@ -15,7 +25,7 @@ unsigned int get_max_object_index(void)
 
 struct object *get_indexed_object(unsigned int idx)
 {
-	return obj_hash[idx];
+	return obj_hash[idx].obj;
 }
 
 static const char *object_type_strings[] = {
@@ -56,26 +66,22 @@ int type_from_string_gently(const char *str, ssize_t len, int gentle)
  * the specified sha1.  n must be a power of 2.  Please note that the
  * return value is *not* consistent across computer architectures.
  */
-static unsigned int hash_obj(const unsigned char *sha1, unsigned int n)
-{
-	return sha1hash(sha1) & (n - 1);
-}
-
 /*
- * Insert obj into the hash table hash, which has length size (which
- * must be a power of 2).  On collisions, simply overflow to the next
- * empty bucket.
+ * Insert an entry into the hash table hash, which has length size
+ * (which must be a power of 2).  On collisions, simply overflow to
+ * the next empty bucket.
  */
-static void insert_obj_hash(struct object *obj, struct object **hash, unsigned int size)
+static void insert_obj_hash(struct obj_hash_entry ent,
+			    struct obj_hash_entry *hash, unsigned int size)
 {
-	unsigned int j = hash_obj(obj->sha1, size);
+	unsigned int j = ent.hash & (size - 1);
 
-	while (hash[j]) {
+	while (hash[j].obj) {
 		j++;
 		if (j >= size)
 			j = 0;
 	}
-	hash[j] = obj;
+	hash[j] = ent;
 }
 
 /*
@@ -84,15 +90,16 @@ static void insert_obj_hash(struct object *obj, struct object **hash, unsigned i
  */
 struct object *lookup_object(const unsigned char *sha1)
 {
-	unsigned int i, first;
+	unsigned int i, first, hash;
 	struct object *obj;
 
 	if (!obj_hash)
 		return NULL;
 
-	first = i = hash_obj(sha1, obj_hash_size);
-	while ((obj = obj_hash[i]) != NULL) {
-		if (!hashcmp(sha1, obj->sha1))
+	hash = sha1hash(sha1);
+	first = i = hash & (obj_hash_size - 1);
+	while ((obj = obj_hash[i].obj) != NULL) {
+		if (obj_hash[i].hash == hash && !hashcmp(sha1, obj->sha1))
 			break;
 		i++;
 		if (i == obj_hash_size)
@@ -104,7 +111,7 @@ struct object *lookup_object(const unsigned char *sha1)
 		 * that we do not need to walk the hash table the next
 		 * time we look for it.
 		 */
-		struct object *tmp = obj_hash[i];
+		struct obj_hash_entry tmp = obj_hash[i];
 		obj_hash[i] = obj_hash[first];
 		obj_hash[first] = tmp;
 	}
@@ -112,35 +119,47 @@ struct object *lookup_object(const unsigned char *sha1)
 }
 
 /*
- * Increase the size of the hash map stored in obj_hash to the next
- * power of 2 (but at least 32).  Copy the existing values to the new
- * hash map.
+ * Resize the hash map stored in obj_hash to new_hash_size (a power of
+ * 2, to match the masking in insert_obj_hash).  Copy the existing
+ * entries to the new hash map; the cached hashes make this a pure
+ * memory shuffle with no re-hashing of object names.
  */
-static void grow_object_hash(void)
+static void resize_object_hash(int new_hash_size)
 {
 	int i;
-	/*
-	 * Note that this size must always be power-of-2 to match hash_obj
-	 * above.
-	 */
-	int new_hash_size = obj_hash_size < 32 ? 32 : 2 * obj_hash_size;
-	struct object **new_hash;
-
-	new_hash = xcalloc(new_hash_size, sizeof(struct object *));
+	struct obj_hash_entry *new_hash;
+
+	new_hash = xcalloc(new_hash_size, sizeof(*new_hash));
 	for (i = 0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
-		if (!obj)
+		if (!obj_hash[i].obj)
 			continue;
-		insert_obj_hash(obj, new_hash, new_hash_size);
+		insert_obj_hash(obj_hash[i], new_hash, new_hash_size);
 	}
 	free(obj_hash);
 	obj_hash = new_hash;
 	obj_hash_size = new_hash_size;
 }
 
+static void grow_object_hash(void)
+{
+	resize_object_hash(obj_hash_size < 32 ? 32 : 2 * obj_hash_size);
+}
+
+void prealloc_object_hash(unsigned long expected)
+{
+	int new_hash_size = 32;
+
+	while (new_hash_size >> 1 <= expected &&
+	       new_hash_size < INT_MAX / 2)
+		new_hash_size *= 2;
+	if (new_hash_size > obj_hash_size)
+		resize_object_hash(new_hash_size);
+}
+
 void *create_object(const unsigned char *sha1, void *o)
 {
 	struct object *obj = o;
+	struct obj_hash_entry ent;
 
 	obj->parsed = 0;
 	obj->used = 0;
@@ -150,7 +169,9 @@ void *create_object(const unsigned char *sha1, void *o)
 	if (obj_hash_size - 1 <= nr_objs * 2)
 		grow_object_hash();
 
-	insert_obj_hash(obj, obj_hash, obj_hash_size);
+	ent.hash = sha1hash(sha1);
+	ent.obj = obj;
+	insert_obj_hash(ent, obj_hash, obj_hash_size);
 	nr_objs++;
 	return obj;
 }
@@ -420,7 +441,7 @@ void clear_object_flags(unsigned flags)
 	int i;
 
 	for (i=0; i < obj_hash_size; i++) {
-		struct object *obj = obj_hash[i];
+		struct object *obj = obj_hash[i].obj;
 		if (obj)
 			obj->flags &= ~flags;
 	}
@@ -66,6 +66,15 @@ extern unsigned int get_max_object_index(void);
  */
 extern struct object *get_indexed_object(unsigned int);
 
+/*
+ * Size the object hashmap for the expected number of objects up
+ * front, so that commands that know how many objects they are about
+ * to see (e.g. from the pack index object counts) avoid the repeated
+ * rehashing pauses of growing it on demand.  A no-op if the table is
+ * already at least that large.
+ */
+extern void prealloc_object_hash(unsigned long expected);
+
 /*
  * This can be used to see if we have heard of the object before, but
  * it can return "yes we have, and here is a half-initialised object"
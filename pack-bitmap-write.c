@@ -138,7 +138,7 @@ static inline void reset_all_seen(void)
 
 static uint32_t find_object_pos(const unsigned char *sha1)
 {
-	struct object_entry *entry = packlist_find(writer.to_pack, sha1, NULL);
+	struct object_entry *entry = packlist_find(writer.to_pack, sha1);
 
 	if (!entry) {
 		die("Failed to write bitmap index. Packfile doesn't have full closure "
@@ -280,12 +280,27 @@ void bitmap_writer_build(struct packing_data *to_pack)
 		object = (struct object *)stored->commit;
 
 		if (stored->bitmap == NULL) {
-			if (i < writer.selected_nr - 1 &&
-			    (need_reset ||
-			     !in_merge_bases(writer.selected[i + 1].commit,
-					     stored->commit))) {
-			    bitmap_reset(base);
-			    reset_all_seen();
+			if (i < writer.selected_nr - 1) {
+				int ancestor =
+					in_merge_bases(writer.selected[i + 1].commit,
+						       stored->commit);
+
+				if (need_reset || !ancestor) {
+					bitmap_reset(base);
+					reset_all_seen();
+					/*
+					 * selected[i + 1] already has a
+					 * bitmap (e.g. one reused from the
+					 * previous index) even though the
+					 * incremental walk state is stale;
+					 * seed the walk with it instead of
+					 * rediscovering every object below
+					 * it.
+					 */
+					if (ancestor)
+						bitmap_or_ewah(base,
+							writer.selected[i + 1].bitmap);
+				}
 			}
 
 			add_pending_object(&revs, object, "");
@@ -396,6 +396,54 @@ static int bitmap_position(const unsigned char *sha1)
 	return (pos >= 0) ? pos : bitmap_position_extended(sha1);
 }
 
+/*
+ * Fetch negotiation support: the union of the reachability bitmaps of
+ * every "have" commit the other side has announced so far.
+ */
+static struct bitmap *haves_bitmap;
+
+int bitmap_note_have(const unsigned char *sha1)
+{
+	static int bitmaps_found = -1;
+	khiter_t pos;
+	struct stored_bitmap *st;
+
+	if (bitmaps_found < 0)
+		bitmaps_found = !prepare_bitmap_git();
+	if (!bitmaps_found)
+		return -1;
+
+	pos = kh_get_sha1(bitmap_git.bitmaps, sha1);
+	if (pos >= kh_end(bitmap_git.bitmaps))
+		return -1;
+
+	st = kh_value(bitmap_git.bitmaps, pos);
+	if (!haves_bitmap)
+		haves_bitmap = ewah_to_bitmap(lookup_stored_bitmap(st));
+	else
+		bitmap_or_ewah(haves_bitmap, lookup_stored_bitmap(st));
+	return 0;
+}
+
+int bitmap_reachable_from_haves(const unsigned char *sha1)
+{
+	int pos;
+
+	if (!haves_bitmap)
+		return -1;
+
+	/*
+	 * Only objects in the bitmapped packfile have a meaningful
+	 * position in the haves bitmap; everything else is too new to
+	 * be covered and the caller has to walk.
+	 */
+	pos = bitmap_position_packfile(sha1);
+	if (pos < 0)
+		return -1;
+
+	return bitmap_get(haves_bitmap, pos) != 0;
+}
+
 static int ext_index_add_object(struct object *object, const char *name)
 {
 	struct eindex *eindex = &bitmap_git.ext_index;
@@ -880,6 +928,52 @@ static uint32_t count_object_type(struct bitmap *objects,
 	return count;
 }
 
+/*
+ * Count the commits reachable from only one of two tips using the
+ * reachability bitmaps alone.  Both tips must have a bitmap stored in
+ * the index (i.e. they were ref tips when the pack was bitmapped);
+ * returns -1 without touching the counts when they do not, so the
+ * caller can fall back to a traversal.
+ */
+int bitmap_count_ahead_behind(const unsigned char *ours,
+			      const unsigned char *theirs,
+			      uint32_t *num_ours, uint32_t *num_theirs)
+{
+	struct ewah_bitmap *ours_ewah, *theirs_ewah;
+	struct bitmap *ours_full, *theirs_full, *only;
+	khiter_t pos;
+
+	if (prepare_bitmap_git() < 0)
+		return -1;
+
+	pos = kh_get_sha1(bitmap_git.bitmaps, ours);
+	if (pos >= kh_end(bitmap_git.bitmaps))
+		return -1;
+	ours_ewah = lookup_stored_bitmap(kh_value(bitmap_git.bitmaps, pos));
+
+	pos = kh_get_sha1(bitmap_git.bitmaps, theirs);
+	if (pos >= kh_end(bitmap_git.bitmaps))
+		return -1;
+	theirs_ewah = lookup_stored_bitmap(kh_value(bitmap_git.bitmaps, pos));
+
+	ours_full = ewah_to_bitmap(ours_ewah);
+	theirs_full = ewah_to_bitmap(theirs_ewah);
+
+	only = bitmap_dup(ours_full);
+	bitmap_and_not(only, theirs_full);
+	*num_ours = count_object_type(only, OBJ_COMMIT);
+	bitmap_free(only);
+
+	only = bitmap_dup(theirs_full);
+	bitmap_and_not(only, ours_full);
+	*num_theirs = count_object_type(only, OBJ_COMMIT);
+	bitmap_free(only);
+
+	bitmap_free(ours_full);
+	bitmap_free(theirs_full);
+	return 0;
+}
+
 void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees,
 			      uint32_t *blobs, uint32_t *tags)
 {
@@ -1047,7 +1141,7 @@ int rebuild_existing_bitmaps(struct packing_data *mapping,
 
 		entry = &bitmap_git.reverse_index->revindex[i];
 		sha1 = nth_packed_object_sha1(bitmap_git.pack, entry->nr);
-		oe = packlist_find(mapping, sha1, NULL);
+		oe = packlist_find(mapping, sha1);
 
 		if (oe)
 			reposition[i] = oe->in_pack_pos + 1;
@@ -35,7 +35,11 @@ typedef int (*show_reachable_fn)(
 	off_t found_offset);
 
 int prepare_bitmap_git(void);
+int bitmap_note_have(const unsigned char *sha1);
+int bitmap_reachable_from_haves(const unsigned char *sha1);
 void count_bitmap_commit_list(uint32_t *commits, uint32_t *trees, uint32_t *blobs, uint32_t *tags);
+int bitmap_count_ahead_behind(const unsigned char *ours, const unsigned char *theirs,
+			      uint32_t *num_ours, uint32_t *num_theirs);
 void traverse_bitmap_commit_list(show_reachable_fn show_reachable);
 void test_bitmap_walk(struct rev_info *revs);
 int prepare_bitmap_walk(struct rev_info *revs);
@@ -45,14 +45,15 @@ int check_pack_crc(struct packed_git *p, struct pack_window **w_curs,
 static int verify_packfile(struct packed_git *p,
 			   struct pack_window **w_curs,
 			   verify_fn fn,
-			   struct progress *progress, uint32_t base_count)
+			   struct progress *progress, uint32_t base_count,
+			   unsigned flags)
 
 {
 	off_t index_size = p->index_size;
 	const unsigned char *index_base = p->index_data;
 	git_SHA_CTX ctx;
 	unsigned char sha1[20], *pack_sig;
-	off_t offset = 0, pack_sig_ofs = 0;
+	off_t offset = 0, pack_sig_ofs = p->pack_size - 20;
 	uint32_t nr_objects, i;
 	int err = 0;
 	struct idx_entry *entries;
@@ -63,26 +64,26 @@ static int verify_packfile(struct packed_git *p,
 	 * immediately.
 	 */
 
-	git_SHA1_Init(&ctx);
-	do {
-		unsigned long remaining;
-		unsigned char *in = use_pack(p, w_curs, offset, &remaining);
-		offset += remaining;
-		if (!pack_sig_ofs)
-			pack_sig_ofs = p->pack_size - 20;
-		if (offset > pack_sig_ofs)
-			remaining -= (unsigned int)(offset - pack_sig_ofs);
-		git_SHA1_Update(&ctx, in, remaining);
-	} while (offset < pack_sig_ofs);
-	git_SHA1_Final(sha1, &ctx);
-	pack_sig = use_pack(p, w_curs, pack_sig_ofs, NULL);
-	if (hashcmp(sha1, pack_sig))
-		err = error("%s SHA1 checksum mismatch",
-			    p->pack_name);
-	if (hashcmp(index_base + index_size - 40, pack_sig))
-		err = error("%s SHA1 does not match its index",
-			    p->pack_name);
-	unuse_pack(w_curs);
+	if (!(flags & VERIFY_PACK_SKIP_CHECKSUMS)) {
+		git_SHA1_Init(&ctx);
+		do {
+			unsigned long remaining;
+			unsigned char *in = use_pack(p, w_curs, offset, &remaining);
+			offset += remaining;
+			if (offset > pack_sig_ofs)
+				remaining -= (unsigned int)(offset - pack_sig_ofs);
+			git_SHA1_Update(&ctx, in, remaining);
+		} while (offset < pack_sig_ofs);
+		git_SHA1_Final(sha1, &ctx);
+		pack_sig = use_pack(p, w_curs, pack_sig_ofs, NULL);
+		if (hashcmp(sha1, pack_sig))
+			err = error("%s SHA1 checksum mismatch",
+				    p->pack_name);
+		if (hashcmp(index_base + index_size - 40, pack_sig))
+			err = error("%s SHA1 does not match its index",
+				    p->pack_name);
+		unuse_pack(w_curs);
+	}
 
 	/* Make sure everything reachable from idx is valid.  Since we
 	 * have verified that nr_objects matches between idx and pack,
@@ -106,7 +107,8 @@ static int verify_packfile(struct packed_git *p,
 		enum object_type type;
 		unsigned long size;
 
-		if (p->index_version > 1) {
+		if (p->index_version > 1 &&
+		    !(flags & VERIFY_PACK_SKIP_CHECKSUMS)) {
 			off_t offset = entries[i].offset;
 			off_t len = entries[i+1].offset - offset;
 			unsigned int nr = entries[i].nr;
@@ -164,17 +166,142 @@ int verify_pack_index(struct packed_git *p)
 	return err;
 }
 
+/*
+ * Stream the pack file once through a private file descriptor,
+ * checking the pack checksum, its copy in the index trailer and (for
+ * v2 indexes) the per-object CRCs.  Unlike verify_pack(), this
+ * touches neither pack windows nor any other global state, so one
+ * thread per pack may run it concurrently; fsck uses that to overlap
+ * the checksum work for multiple packs.  The pack index must already
+ * be open.
+ */
+int verify_pack_checksums(struct packed_git *p)
+{
+	off_t index_size = p->index_size;
+	const unsigned char *index_base = p->index_data;
+	unsigned char buffer[8192];
+	unsigned char sha1[20], pack_sig[20];
+	git_SHA_CTX ctx;
+	uint32_t nr_objects = p->num_objects;
+	const uint32_t *index_crc = NULL;
+	struct idx_entry *entries = NULL;
+	uint32_t cur = 0, crc = crc32(0, NULL, 0);
+	off_t pos = 0, pack_sig_ofs = p->pack_size - 20;
+	uint32_t i;
+	int err = 0, read_err = 0, fd;
+
+	if (!index_base)
+		return -1;
+	fd = open(p->pack_name, O_RDONLY);
+	if (fd < 0)
+		return error("cannot open packfile %s (%s)",
+			     p->pack_name, strerror(errno));
+
+	if (p->index_version > 1) {
+		entries = xmalloc((nr_objects + 1) * sizeof(*entries));
+		entries[nr_objects].offset = pack_sig_ofs;
+		for (i = 0; i < nr_objects; i++) {
+			entries[i].sha1 = nth_packed_object_sha1(p, i);
+			if (!entries[i].sha1)
+				die("internal error pack-check nth-packed-object");
+			entries[i].offset = nth_packed_object_offset(p, i);
+			entries[i].nr = i;
+		}
+		qsort(entries, nr_objects, sizeof(*entries), compare_entries);
+		index_crc = (const uint32_t *)index_base;
+		index_crc += 2 + 256 + nr_objects * (20/4);
+	}
+
+	git_SHA1_Init(&ctx);
+	while (pos < pack_sig_ofs) {
+		ssize_t len = xread(fd, buffer, sizeof(buffer));
+		ssize_t consumed = 0;
+
+		if (len < 0) {
+			err = read_err = error("read error on %s (%s)",
+					       p->pack_name, strerror(errno));
+			break;
+		}
+		if (!len) {
+			err = read_err = error("packfile %s is truncated",
+					       p->pack_name);
+			break;
+		}
+		if (len > pack_sig_ofs - pos)
+			len = pack_sig_ofs - pos;
+		git_SHA1_Update(&ctx, buffer, len);
+
+		while (entries && consumed < len && cur < nr_objects) {
+			off_t bpos = pos + consumed;
+			off_t end;
+			ssize_t chunk;
+
+			if (bpos < entries[cur].offset) {
+				/* pack header, before the first object */
+				chunk = entries[cur].offset - bpos;
+				if (chunk > len - consumed)
+					chunk = len - consumed;
+				consumed += chunk;
+				continue;
+			}
+			end = entries[cur + 1].offset;
+			chunk = end - bpos;
+			if (chunk > len - consumed)
+				chunk = len - consumed;
+			crc = crc32(crc, buffer + consumed, chunk);
+			consumed += chunk;
+			if (bpos + chunk == end) {
+				if (crc != ntohl(index_crc[entries[cur].nr]))
+					err = error("index CRC mismatch for object %s "
+						    "from %s at offset %"PRIuMAX"",
+						    sha1_to_hex(entries[cur].sha1),
+						    p->pack_name,
+						    (uintmax_t)entries[cur].offset);
+				crc = crc32(0, NULL, 0);
+				cur++;
+			}
+		}
+		pos += len;
+	}
+	git_SHA1_Final(sha1, &ctx);
+
+	if (!read_err) {
+		if (lseek(fd, pack_sig_ofs, SEEK_SET) < 0 ||
+		    read_in_full(fd, pack_sig, sizeof(pack_sig)) != sizeof(pack_sig))
+			err = error("cannot read checksum of %s", p->pack_name);
+		else {
+			if (hashcmp(sha1, pack_sig))
+				err = error("%s SHA1 checksum mismatch",
+					    p->pack_name);
+			if (hashcmp(index_base + index_size - 40, pack_sig))
+				err = error("%s SHA1 does not match its index",
+					    p->pack_name);
+		}
+	}
+
+	close(fd);
+	free(entries);
+	return err;
+}
+
 int verify_pack(struct packed_git *p, verify_fn fn,
-		struct progress *progress, uint32_t base_count)
+		struct progress *progress, uint32_t base_count,
+		unsigned flags)
 {
 	int err = 0;
 	struct pack_window *w_curs = NULL;
 
-	err |= verify_pack_index(p);
+	if (flags & VERIFY_PACK_SKIP_CHECKSUMS)
+		open_pack_index(p);
+	else
+		err |= verify_pack_index(p);
 	if (!p->index_data)
 		return -1;
 
-	err |= verify_packfile(p, &w_curs, fn, progress, base_count);
+	/* we walk the packfile front to back exactly once */
+	set_pack_access_pattern(PACK_ACCESS_SEQUENTIAL);
+	err |= verify_packfile(p, &w_curs, fn, progress, base_count, flags);
+	set_pack_access_pattern(PACK_ACCESS_NORMAL);
 	unuse_pack(&w_curs);
 
 	return err;
@@ -3,96 +3,69 @@
 #include "pack.h"
 #include "pack-objects.h"
 
-static uint32_t locate_object_entry_hash(struct packing_data *pdata,
-					 const unsigned char *sha1,
-					 int *found)
+/*
+ * Re-point the hash keys at the (possibly moved) objects array.  The
+ * keys are pointers to the sha1 stored in each object_entry, so they
+ * go stale whenever the entry array is reallocated; since neither the
+ * hashes nor the bucket positions change, this is a single linear
+ * pass with no re-hashing.
+ */
+static void packlist_fix_index_keys(struct packing_data *pdata)
 {
-	uint32_t i, mask = (pdata->index_size - 1);
+	khiter_t pos;
 
-	i = sha1hash(sha1) & mask;
-
-	while (pdata->index[i] > 0) {
-		uint32_t pos = pdata->index[i] - 1;
-
-		if (!hashcmp(sha1, pdata->objects[pos].idx.sha1)) {
-			*found = 1;
-			return i;
-		}
-
-		i = (i + 1) & mask;
+	for (pos = kh_begin(pdata->index); pos != kh_end(pdata->index); pos++) {
+		if (!kh_exist(pdata->index, pos))
+			continue;
+		kh_key(pdata->index, pos) =
+			pdata->objects[kh_value(pdata->index, pos)].idx.sha1;
 	}
-
-	*found = 0;
-	return i;
 }
 
-static inline uint32_t closest_pow2(uint32_t v)
+void packlist_presize(struct packing_data *pdata, uint32_t expected)
 {
-	v = v - 1;
-	v |= v >> 1;
-	v |= v >> 2;
-	v |= v >> 4;
-	v |= v >> 8;
-	v |= v >> 16;
-	return v + 1;
-}
-
-static void rehash_objects(struct packing_data *pdata)
-{
-	uint32_t i;
-	struct object_entry *entry;
-
-	pdata->index_size = closest_pow2(pdata->nr_objects * 3);
-	if (pdata->index_size < 1024)
-		pdata->index_size = 1024;
-
-	free(pdata->index);
-	pdata->index = xcalloc(pdata->index_size, sizeof(*pdata->index));
-
-	entry = pdata->objects;
-
-	for (i = 0; i < pdata->nr_objects; i++) {
-		int found;
-		uint32_t ix = locate_object_entry_hash(pdata, entry->idx.sha1, &found);
-
-		if (found)
-			die("BUG: Duplicate object in hash");
-
-		pdata->index[ix] = i + 1;
-		entry++;
+	if (!pdata->index)
+		pdata->index = kh_init_sha1_pos();
+	/* leave headroom below the resize threshold (77% load) */
+	kh_resize_sha1_pos(pdata->index, expected * 13 / 10);
+	if (pdata->nr_alloc < expected) {
+		pdata->nr_alloc = expected;
+		REALLOC_ARRAY(pdata->objects, pdata->nr_alloc);
 	}
 }
 
 struct object_entry *packlist_find(struct packing_data *pdata,
-				   const unsigned char *sha1,
-				   uint32_t *index_pos)
+				   const unsigned char *sha1)
 {
-	uint32_t i;
-	int found;
+	khiter_t pos;
 
-	if (!pdata->index_size)
+	if (!pdata->index)
 		return NULL;
 
-	i = locate_object_entry_hash(pdata, sha1, &found);
-
-	if (index_pos)
-		*index_pos = i;
-
-	if (!found)
+	pos = kh_get_sha1_pos(pdata->index, sha1);
+	if (pos == kh_end(pdata->index))
 		return NULL;
 
-	return &pdata->objects[pdata->index[i] - 1];
+	return &pdata->objects[kh_value(pdata->index, pos)];
 }
 
 struct object_entry *packlist_alloc(struct packing_data *pdata,
-				    const unsigned char *sha1,
-				    uint32_t index_pos)
+				    const unsigned char *sha1)
 {
 	struct object_entry *new_entry;
+	khiter_t pos;
+	int ret;
+
+	if (!pdata->index)
+		pdata->index = kh_init_sha1_pos();
 
 	if (pdata->nr_objects >= pdata->nr_alloc) {
+		struct object_entry *old = pdata->objects;
+
 		pdata->nr_alloc = (pdata->nr_alloc  + 1024) * 3 / 2;
 		REALLOC_ARRAY(pdata->objects, pdata->nr_alloc);
+		if (pdata->objects != old)
+			packlist_fix_index_keys(pdata);
 	}
 
 	new_entry = pdata->objects + pdata->nr_objects++;
@@ -100,10 +73,10 @@ struct object_entry *packlist_alloc(struct packing_data *pdata,
 	memset(new_entry, 0, sizeof(*new_entry));
 	hashcpy(new_entry->idx.sha1, sha1);
 
-	if (pdata->index_size * 3 <= pdata->nr_objects * 4)
-		rehash_objects(pdata);
-	else
-		pdata->index[index_pos] = pdata->nr_objects;
+	pos = kh_put_sha1_pos(pdata->index, new_entry->idx.sha1, &ret);
+	if (!ret)
+		die("BUG: Duplicate object in hash");
+	kh_value(pdata->index, pos) = pdata->nr_objects - 1;
 
 	return new_entry;
 }
@@ -1,24 +1,35 @@
 #ifndef PACK_OBJECTS_H
 #define PACK_OBJECTS_H
 
+#include "khash.h"
+
+/*
+ * A server repack allocates one of these for every object in the
+ * repository, so the layout is deliberately tight: the delta chain is
+ * expressed as 32-bit indices into packing_data's object array (off
+ * by one, so 0 means "none") instead of pointers, the object types
+ * live in bitfields, and the cached delta data that used to occupy a
+ * pointer and a size here is kept in a side table in pack-objects
+ * because only a bounded number of entries ever have one.  Use the
+ * oe_*() accessors below for the delta chain fields.
+ */
 struct object_entry {
 	struct pack_idx_entry idx;
 	unsigned long size;	/* uncompressed size */
 	struct packed_git *in_pack;	/* already in pack */
 	off_t in_pack_offset;
-	struct object_entry *delta;	/* delta base object */
-	struct object_entry *delta_child; /* deltified objects who bases me */
-	struct object_entry *delta_sibling; /* other deltified objects who
-					     * uses the same base as me
-					     */
-	void *delta_data;	/* cached delta (uncompressed) */
+	uint32_t delta_idx;	/* delta base object */
+	uint32_t delta_child_idx; /* deltified objects who bases me */
+	uint32_t delta_sibling_idx; /* other deltified objects who
+				     * uses the same base as me
+				     */
 	unsigned long delta_size;	/* delta data size (uncompressed) */
-	unsigned long z_delta_size;	/* delta data size (compressed) */
-	enum object_type type;
-	enum object_type in_pack_type;	/* could be delta */
 	uint32_t hash;			/* name hint hash */
+	unsigned int tree_depth;	/* valid only with delta islands */
 	unsigned int in_pack_pos;
 	unsigned char in_pack_header_size;
+	signed int type:4;
+	signed int in_pack_type:4;	/* could be delta */
 	unsigned preferred_base:1; /*
 				    * we do not pack this, but is available
 				    * to be used as the base object to delta
@@ -33,17 +44,61 @@ struct packing_data {
 	struct object_entry *objects;
 	uint32_t nr_objects, nr_alloc;
 
-	int32_t *index;
-	uint32_t index_size;
+	/* maps an object name to its position in the objects array */
+	khash_sha1_pos *index;
 };
 
 struct object_entry *packlist_alloc(struct packing_data *pdata,
-				    const unsigned char *sha1,
-				    uint32_t index_pos);
+				    const unsigned char *sha1);
 
 struct object_entry *packlist_find(struct packing_data *pdata,
-				   const unsigned char *sha1,
-				   uint32_t *index_pos);
+				   const unsigned char *sha1);
+
+/*
+ * Size both the object array and its index for the expected number
+ * of objects, so that a whole-repository repack does not pay for
+ * repeated growth and re-hashing of the lookup table.
+ */
+void packlist_presize(struct packing_data *pdata, uint32_t expected);
+
+static inline struct object_entry *oe_delta(const struct packing_data *pack,
+					    const struct object_entry *e)
+{
+	return e->delta_idx ? &pack->objects[e->delta_idx - 1] : NULL;
+}
+
+static inline void oe_set_delta(struct packing_data *pack,
+				struct object_entry *e,
+				struct object_entry *delta)
+{
+	e->delta_idx = delta ? (uint32_t)(delta - pack->objects) + 1 : 0;
+}
+
+static inline struct object_entry *oe_delta_child(const struct packing_data *pack,
+						  const struct object_entry *e)
+{
+	return e->delta_child_idx ? &pack->objects[e->delta_child_idx - 1] : NULL;
+}
+
+static inline void oe_set_delta_child(struct packing_data *pack,
+				      struct object_entry *e,
+				      struct object_entry *child)
+{
+	e->delta_child_idx = child ? (uint32_t)(child - pack->objects) + 1 : 0;
+}
+
+static inline struct object_entry *oe_delta_sibling(const struct packing_data *pack,
+						    const struct object_entry *e)
+{
+	return e->delta_sibling_idx ? &pack->objects[e->delta_sibling_idx - 1] : NULL;
+}
+
+static inline void oe_set_delta_sibling(struct packing_data *pack,
+					struct object_entry *e,
+					struct object_entry *sibling)
+{
+	e->delta_sibling_idx = sibling ? (uint32_t)(sibling - pack->objects) + 1 : 0;
+}
 
 static inline uint32_t pack_name_hash(const char *name)
 {
@@ -1,4 +1,5 @@
 #include "cache.h"
+#include "pack.h"
 #include "pack-revindex.h"
 
 /*
@@ -196,6 +197,86 @@ static void create_pack_revindex(struct pack_revindex *rix)
 	sort_revindex(rix->revindex, num_ent, p->pack_size);
 }
 
+/*
+ * Try to load the reverse index from the .rev file next to the pack.
+ * The file stores the pack positions already sorted by offset, so a
+ * successful load replaces the radix sort in create_pack_revindex();
+ * the offsets themselves still come from the .idx.  Returns 0 on
+ * success; any validation failure leaves rix->revindex NULL so the
+ * caller falls back to the in-memory build.
+ */
+static int load_pack_revindex_from_disk(struct pack_revindex *rix)
+{
+	struct packed_git *p = rix->p;
+	unsigned num_ent = p->num_objects;
+	struct strbuf path = STRBUF_INIT;
+	size_t len, expected;
+	struct stat st;
+	const uint32_t *data;
+	void *map;
+	unsigned i;
+	int fd, ret = -1;
+
+	if (!p->index_data)
+		return -1;
+	if (!strip_suffix(p->pack_name, ".pack", &len))
+		return -1;
+	strbuf_add(&path, p->pack_name, len);
+	strbuf_addstr(&path, ".rev");
+
+	fd = open(path.buf, O_RDONLY);
+	if (fd < 0) {
+		strbuf_release(&path);
+		return -1;
+	}
+
+	expected = 12 + (size_t)num_ent * 4 + 40;
+	if (fstat(fd, &st) < 0 || st.st_size != expected) {
+		error("reverse index '%s' has the wrong size", path.buf);
+		close(fd);
+		strbuf_release(&path);
+		return -1;
+	}
+
+	map = xmmap(NULL, expected, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	data = map;
+
+	if (ntohl(data[0]) != RIDX_SIGNATURE ||
+	    ntohl(data[1]) != RIDX_VERSION ||
+	    ntohl(data[2]) != RIDX_HASH_SHA1 ||
+	    hashcmp((const unsigned char *)map + expected - 40, p->sha1)) {
+		error("reverse index '%s' does not match its pack", path.buf);
+		goto done;
+	}
+	data += 3;
+
+	rix->revindex = xmalloc(sizeof(*rix->revindex) * (num_ent + 1));
+	for (i = 0; i < num_ent; i++) {
+		uint32_t nr = ntohl(data[i]);
+
+		if (nr >= num_ent)
+			goto corrupt;
+		rix->revindex[i].offset = nth_packed_object_offset(p, nr);
+		rix->revindex[i].nr = nr;
+		if (i && rix->revindex[i].offset <= rix->revindex[i - 1].offset)
+			goto corrupt;
+	}
+	rix->revindex[num_ent].offset = p->pack_size - 20;
+	rix->revindex[num_ent].nr = -1;
+	ret = 0;
+	goto done;
+
+corrupt:
+	error("reverse index '%s' is corrupt", path.buf);
+	free(rix->revindex);
+	rix->revindex = NULL;
+done:
+	munmap(map, expected);
+	strbuf_release(&path);
+	return ret;
+}
+
 struct pack_revindex *revindex_for_pack(struct packed_git *p)
 {
 	int num;
@@ -209,7 +290,7 @@ struct pack_revindex *revindex_for_pack(struct packed_git *p)
 		die("internal error: pack revindex fubar");
 
 	rix = &pack_revindex[num];
-	if (!rix->revindex)
+	if (!rix->revindex && load_pack_revindex_from_disk(rix) < 0)
 		create_pack_revindex(rix);
 
 	return rix;
@@ -176,12 +176,106 @@ const char *write_idx_file(const char *index_name, struct pack_idx_entry **objec
 	return index_name;
 }
 
-off_t write_pack_header(struct sha1file *f, uint32_t nr_entries)
+struct rev_sort_entry {
+	off_t offset;
+	uint32_t nr;
+};
+
+static int rev_sort_compare(const void *_a, const void *_b)
+{
+	const struct rev_sort_entry *a = _a;
+	const struct rev_sort_entry *b = _b;
+	return (a->offset < b->offset) ? -1 : (a->offset != b->offset);
+}
+
+/*
+ * Write the reverse index (.rev) for a pack: the index positions of
+ * the objects sorted by their offset in the pack.  The objects array
+ * must already be sorted by object name, i.e. this must be called
+ * after write_idx_file().  Returns NULL when the caller did not ask
+ * for a reverse index via WRITE_REV.
+ */
+const char *write_rev_file(const char *rev_name,
+			   struct pack_idx_entry **objects,
+			   uint32_t nr_objects,
+			   const unsigned char *sha1,
+			   const struct pack_idx_option *opts)
+{
+	struct sha1file *f;
+	struct rev_sort_entry *by_offset;
+	uint32_t i, hdr[3];
+	int fd;
+
+	if (!(opts->flags & WRITE_REV))
+		return NULL;
+
+	by_offset = xmalloc(nr_objects * sizeof(*by_offset));
+	for (i = 0; i < nr_objects; i++) {
+		by_offset[i].offset = objects[i]->offset;
+		by_offset[i].nr = i;
+	}
+	qsort(by_offset, nr_objects, sizeof(*by_offset), rev_sort_compare);
+
+	if (!rev_name) {
+		static char tmp_file[PATH_MAX];
+		fd = odb_mkstemp(tmp_file, sizeof(tmp_file), "pack/tmp_rev_XXXXXX");
+		rev_name = xstrdup(tmp_file);
+	} else {
+		unlink(rev_name);
+		fd = open(rev_name, O_CREAT|O_EXCL|O_WRONLY, 0600);
+	}
+	if (fd < 0)
+		die_errno("unable to create '%s'", rev_name);
+	f = sha1fd(fd, rev_name);
+
+	hdr[0] = htonl(RIDX_SIGNATURE);
+	hdr[1] = htonl(RIDX_VERSION);
+	hdr[2] = htonl(RIDX_HASH_SHA1);
+	sha1write(f, hdr, sizeof(hdr));
+
+	for (i = 0; i < nr_objects; i++) {
+		uint32_t nr = htonl(by_offset[i].nr);
+		sha1write(f, &nr, 4);
+	}
+
+	sha1write(f, sha1, 20);
+	sha1close(f, NULL, CSUM_FSYNC);
+	free(by_offset);
+	return rev_name;
+}
+
+static const char *pack_codec_names[] = {
+	"zlib"
+};
+
+const char *pack_codec_name(enum pack_codec codec)
+{
+	if (codec < 0 || codec >= ARRAY_SIZE(pack_codec_names))
+		return NULL;
+	return pack_codec_names[codec];
+}
+
+int parse_pack_codec(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pack_codec_names); i++)
+		if (!strcmp(name, pack_codec_names[i]))
+			return i;
+	return -1;
+}
+
+off_t write_pack_header(struct sha1file *f, uint32_t nr_entries,
+			enum pack_codec codec)
 {
 	struct pack_header hdr;
 
 	hdr.hdr_signature = htonl(PACK_SIGNATURE);
-	hdr.hdr_version = htonl(PACK_VERSION);
+	if (codec == PACK_CODEC_ZLIB)
+		hdr.hdr_version = htonl(PACK_VERSION);
+	else
+		hdr.hdr_version = htonl((codec << PACK_CODEC_SHIFT) |
+					PACK_CODEC_VERSION);
 	hdr.hdr_entries = htonl(nr_entries);
 	sha1write(f, &hdr, sizeof(hdr));
 	return sizeof(hdr);
@@ -211,12 +305,12 @@ void fixup_pack_header_footer(int pack_fd,
 			 off_t partial_pack_offset)
 {
 	int aligned_sz, buf_sz = 8 * 1024;
-	git_SHA_CTX old_sha1_ctx, new_sha1_ctx;
+	git_hash_ctx old_sha1_ctx, new_sha1_ctx;
 	struct pack_header hdr;
 	char *buf;
 
-	git_SHA1_Init(&old_sha1_ctx);
-	git_SHA1_Init(&new_sha1_ctx);
+	the_hash_algo->init_fn(&old_sha1_ctx);
+	the_hash_algo->init_fn(&new_sha1_ctx);
 
 	if (lseek(pack_fd, 0, SEEK_SET) != 0)
 		die_errno("Failed seeking to start of '%s'", pack_name);
@@ -224,9 +318,9 @@ void fixup_pack_header_footer(int pack_fd,
 		die_errno("Unable to reread header of '%s'", pack_name);
 	if (lseek(pack_fd, 0, SEEK_SET) != 0)
 		die_errno("Failed seeking to start of '%s'", pack_name);
-	git_SHA1_Update(&old_sha1_ctx, &hdr, sizeof(hdr));
+	the_hash_algo->update_fn(&old_sha1_ctx, &hdr, sizeof(hdr));
 	hdr.hdr_entries = htonl(object_count);
-	git_SHA1_Update(&new_sha1_ctx, &hdr, sizeof(hdr));
+	the_hash_algo->update_fn(&new_sha1_ctx, &hdr, sizeof(hdr));
 	write_or_die(pack_fd, &hdr, sizeof(hdr));
 	partial_pack_offset -= sizeof(hdr);
 
@@ -241,7 +335,7 @@ void fixup_pack_header_footer(int pack_fd,
 			break;
 		if (n < 0)
 			die_errno("Failed to checksum '%s'", pack_name);
-		git_SHA1_Update(&new_sha1_ctx, buf, n);
+		the_hash_algo->update_fn(&new_sha1_ctx, buf, n);
 
 		aligned_sz -= n;
 		if (!aligned_sz)
@@ -250,11 +344,11 @@ void fixup_pack_header_footer(int pack_fd,
 		if (!partial_pack_sha1)
 			continue;
 
-		git_SHA1_Update(&old_sha1_ctx, buf, n);
+		the_hash_algo->update_fn(&old_sha1_ctx, buf, n);
 		partial_pack_offset -= n;
 		if (partial_pack_offset == 0) {
 			unsigned char sha1[20];
-			git_SHA1_Final(sha1, &old_sha1_ctx);
+			the_hash_algo->final_fn(sha1, &old_sha1_ctx);
 			if (hashcmp(sha1, partial_pack_sha1) != 0)
 				die("Unexpected checksum for %s "
 				    "(disk corruption?)", pack_name);
@@ -263,7 +357,7 @@ void fixup_pack_header_footer(int pack_fd,
 			 * pack, which also means making partial_pack_offset
 			 * big enough not to matter anymore.
 			 */
-			git_SHA1_Init(&old_sha1_ctx);
+			the_hash_algo->init_fn(&old_sha1_ctx);
 			partial_pack_offset = ~partial_pack_offset;
 			partial_pack_offset -= MSB(partial_pack_offset, 1);
 		}
@@ -271,8 +365,8 @@ void fixup_pack_header_footer(int pack_fd,
 	free(buf);
 
 	if (partial_pack_sha1)
-		git_SHA1_Final(partial_pack_sha1, &old_sha1_ctx);
-	git_SHA1_Final(new_pack_sha1, &new_sha1_ctx);
+		the_hash_algo->final_fn(partial_pack_sha1, &old_sha1_ctx);
+	the_hash_algo->final_fn(new_pack_sha1, &new_sha1_ctx);
 	write_or_die(pack_fd, new_pack_sha1, 20);
 	fsync_or_die(pack_fd, pack_name);
 }
@@ -342,7 +436,7 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 			 struct pack_idx_option *pack_idx_opts,
 			 unsigned char sha1[])
 {
-	const char *idx_tmp_name;
+	const char *idx_tmp_name, *rev_tmp_name;
 	int basename_len = name_buffer->len;
 
 	if (adjust_shared_perm(pack_tmp_name))
@@ -353,6 +447,11 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 	if (adjust_shared_perm(idx_tmp_name))
 		die_errno("unable to make temporary index file readable");
 
+	rev_tmp_name = write_rev_file(NULL, written_list, nr_written,
+				      sha1, pack_idx_opts);
+	if (rev_tmp_name && adjust_shared_perm(rev_tmp_name))
+		die_errno("unable to make temporary reverse index file readable");
+
 	strbuf_addf(name_buffer, "%s.pack", sha1_to_hex(sha1));
 	free_pack_by_name(name_buffer->buf);
 
@@ -361,6 +460,13 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 
 	strbuf_setlen(name_buffer, basename_len);
 
+	if (rev_tmp_name) {
+		strbuf_addf(name_buffer, "%s.rev", sha1_to_hex(sha1));
+		if (rename(rev_tmp_name, name_buffer->buf))
+			die_errno("unable to rename temporary reverse index file");
+		strbuf_setlen(name_buffer, basename_len);
+	}
+
 	strbuf_addf(name_buffer, "%s.idx", sha1_to_hex(sha1));
 	if (rename(idx_tmp_name, name_buffer->buf))
 		die_errno("unable to rename temporary index file");
@@ -368,4 +474,5 @@ void finish_tmp_packfile(struct strbuf *name_buffer,
 	strbuf_setlen(name_buffer, basename_len);
 
 	free((void *)idx_tmp_name);
+	free((void *)rev_tmp_name);
 }
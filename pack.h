@@ -9,7 +9,33 @@
  */
 #define PACK_SIGNATURE 0x5041434b	/* "PACK" */
 #define PACK_VERSION 2
-#define pack_version_ok(v) ((v) == htonl(2) || (v) == htonl(3))
+
+/*
+ * A pack whose entries are compressed with something other than zlib
+ * carries a codec identifier in the upper bits of the version word:
+ * the low 16 bits hold version 4 and the next 8 bits the codec id.
+ * Plain zlib packs keep writing version 2 so that every existing
+ * reader stays compatible; older readers refuse codec-tagged packs
+ * with their usual "try upgrading" error instead of misparsing the
+ * entries.  The header stays 12 bytes either way.
+ */
+#define PACK_CODEC_VERSION 4
+#define PACK_CODEC_SHIFT 16
+#define PACK_CODEC_MASK 0xff
+
+enum pack_codec {
+	PACK_CODEC_ZLIB = 0
+};
+
+#define pack_codec_version_ok(v) ((ntohl(v) & 0xffff) == PACK_CODEC_VERSION)
+#define pack_version_codec(v) \
+	((ntohl(v) >> PACK_CODEC_SHIFT) & PACK_CODEC_MASK)
+#define pack_version_ok(v) ((v) == htonl(2) || (v) == htonl(3) || \
+			    pack_codec_version_ok(v))
+
+extern const char *pack_codec_name(enum pack_codec codec);
+extern int parse_pack_codec(const char *name);
+
 struct pack_header {
 	uint32_t hdr_signature;
 	uint32_t hdr_version;
@@ -40,6 +66,7 @@ struct pack_idx_option {
 	/* flag bits */
 #define WRITE_IDX_VERIFY 01 /* verify only, do not write the idx file */
 #define WRITE_IDX_STRICT 02
+#define WRITE_REV 04 /* write a reverse index sidecar (.rev) */
 
 	uint32_t version;
 	uint32_t off32_limit;
@@ -63,6 +90,18 @@ struct pack_idx_header {
 	uint32_t idx_version;
 };
 
+/*
+ * Reverse index sidecar (.rev): a header, the pack positions of the
+ * objects sorted by pack offset (one network-order uint32 each), the
+ * checksum of the pack it describes and the usual trailing checksum
+ * of the file itself.  It saves readers from having to sort the
+ * offset table of the .idx on every use; when it is missing or does
+ * not validate, pack-revindex.c falls back to the in-memory build.
+ */
+#define RIDX_SIGNATURE 0x52494458	/* "RIDX" */
+#define RIDX_VERSION 1
+#define RIDX_HASH_SHA1 1
+
 /*
  * Common part of object structure used for write_idx_file
  */
@@ -77,10 +116,13 @@ struct progress;
 typedef int (*verify_fn)(const unsigned char*, enum object_type, unsigned long, void*, int*);
 
 extern const char *write_idx_file(const char *index_name, struct pack_idx_entry **objects, int nr_objects, const struct pack_idx_option *, const unsigned char *sha1);
+extern const char *write_rev_file(const char *rev_name, struct pack_idx_entry **objects, uint32_t nr_objects, const unsigned char *sha1, const struct pack_idx_option *);
 extern int check_pack_crc(struct packed_git *p, struct pack_window **w_curs, off_t offset, off_t len, unsigned int nr);
 extern int verify_pack_index(struct packed_git *);
-extern int verify_pack(struct packed_git *, verify_fn fn, struct progress *, uint32_t);
-extern off_t write_pack_header(struct sha1file *f, uint32_t);
+extern int verify_pack_checksums(struct packed_git *);
+#define VERIFY_PACK_SKIP_CHECKSUMS 01
+extern int verify_pack(struct packed_git *, verify_fn fn, struct progress *, uint32_t, unsigned flags);
+extern off_t write_pack_header(struct sha1file *f, uint32_t, enum pack_codec);
 extern void fixup_pack_header_footer(int, unsigned char *, const char *, uint32_t, unsigned char *, off_t);
 extern char *index_pack_lockfile(int fd);
 extern int encode_in_pack_object_header(enum object_type, uintmax_t, unsigned char *);
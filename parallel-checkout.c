@@ -0,0 +1,293 @@
+/*
+ * Parallel checkout: write queued working tree entries through a pool
+ * of "git checkout--worker" processes.
+ *
+ * The object database is not safe to read from multiple threads, so
+ * the workers are separate processes.  The parent decides which
+ * entries are eligible (regular files that need no content
+ * conversion), hands each worker a contiguous slice of the sorted
+ * entry list -- which keeps entries of one directory, the ones most
+ * likely to collide, on the same worker -- and retries whatever the
+ * workers could not write through the regular sequential code path.
+ */
+#include "cache.h"
+#include "parallel-checkout.h"
+#include "run-command.h"
+#include "streaming.h"
+#include "string-list.h"
+#include "thread-utils.h"
+
+struct parallel_checkout {
+	struct cache_entry **items;
+	int nr, alloc;
+};
+
+static struct parallel_checkout parallel_checkout;
+
+void get_parallel_checkout_configs(int *num_workers, int *threshold)
+{
+	if (git_config_get_int("checkout.workers", num_workers))
+		*num_workers = 1;
+	else if (*num_workers < 1)
+		*num_workers = online_cpus();
+
+	if (git_config_get_int("checkout.thresholdforparallelism", threshold))
+		*threshold = 100;
+}
+
+void init_parallel_checkout(void)
+{
+	if (parallel_checkout.nr)
+		die("BUG: parallel checkout queue is not empty");
+}
+
+int enqueue_checkout(struct cache_entry *ce)
+{
+	struct stream_filter *filter;
+	int eligible;
+
+	if ((ce->ce_mode & S_IFMT) != S_IFREG)
+		return -1;
+
+	/*
+	 * The workers have no view of the index being checked out, so
+	 * they cannot look up conversion attributes; only entries that
+	 * are written out verbatim may be handed to them.
+	 */
+	filter = get_stream_filter(ce->name, ce->sha1);
+	eligible = filter && is_null_stream_filter(filter);
+	free_stream_filter(filter);
+	if (!eligible)
+		return -1;
+
+	ALLOC_GROW(parallel_checkout.items, parallel_checkout.nr + 1,
+		   parallel_checkout.alloc);
+	parallel_checkout.items[parallel_checkout.nr++] = ce;
+	return 0;
+}
+
+static void send_items(int fd, int start, int nr)
+{
+	struct strbuf sb = STRBUF_INIT;
+	int i;
+
+	for (i = start; i < start + nr; i++) {
+		struct cache_entry *ce = parallel_checkout.items[i];
+		strbuf_addf(&sb, "%o %s %s", ce->ce_mode,
+			    sha1_to_hex(ce->sha1), ce->name);
+		strbuf_addch(&sb, '\0');
+	}
+	if (write_in_full(fd, sb.buf, sb.len) != sb.len)
+		die_errno("unable to feed checkout worker");
+	strbuf_release(&sb);
+}
+
+static void collect_failures(struct string_list *failed, struct strbuf *out)
+{
+	const char *p = out->buf;
+
+	while (p < out->buf + out->len) {
+		string_list_insert(failed, p);
+		p += strlen(p) + 1;
+	}
+}
+
+static int handle_results(const struct checkout *state,
+			  struct string_list *failed)
+{
+	int i, errs = 0;
+
+	for (i = 0; i < parallel_checkout.nr; i++) {
+		struct cache_entry *ce = parallel_checkout.items[i];
+		struct stat st;
+
+		if (string_list_has_string(failed, ce->name) ||
+		    (state->refresh_cache && lstat(ce->name, &st))) {
+			/*
+			 * Let the sequential machinery deal with
+			 * whatever got in the worker's way.
+			 */
+			errs |= checkout_entry(ce, state, NULL);
+			continue;
+		}
+		if (state->refresh_cache) {
+			assert(state->istate);
+			fill_stat_cache_info(ce, &st);
+			ce->ce_flags |= CE_UPDATE_IN_BASE;
+			state->istate->cache_changed |= CE_ENTRY_CHANGED;
+		}
+	}
+	return errs;
+}
+
+int run_parallel_checkout(const struct checkout *state,
+			  int num_workers, int threshold)
+{
+	struct child_process *workers;
+	struct string_list failed = STRING_LIST_INIT_DUP;
+	int i, start, errs = 0;
+
+	if (!parallel_checkout.nr)
+		return 0;
+
+	if (num_workers < 2 || parallel_checkout.nr < threshold) {
+		for (i = 0; i < parallel_checkout.nr; i++)
+			errs |= checkout_entry(parallel_checkout.items[i],
+					       state, NULL);
+		goto done;
+	}
+
+	if (num_workers > parallel_checkout.nr)
+		num_workers = parallel_checkout.nr;
+
+	workers = xcalloc(num_workers, sizeof(*workers));
+	for (i = start = 0; i < num_workers; i++) {
+		struct child_process *cp = &workers[i];
+		int nr = parallel_checkout.nr / num_workers +
+			(i < parallel_checkout.nr % num_workers);
+
+		child_process_init(cp);
+		cp->git_cmd = 1;
+		cp->in = -1;
+		cp->out = -1;
+		argv_array_push(&cp->args, "checkout--worker");
+		if (start_command(cp))
+			die("cannot spawn checkout worker");
+		send_items(cp->in, start, nr);
+		close(cp->in);
+		start += nr;
+	}
+
+	/*
+	 * The workers report the paths they failed to write, NUL
+	 * terminated, after consuming all their input.
+	 */
+	for (i = 0; i < num_workers; i++) {
+		struct child_process *cp = &workers[i];
+		struct strbuf out = STRBUF_INIT;
+
+		if (strbuf_read(&out, cp->out, 0) < 0)
+			errs = error("failed to read from checkout worker");
+		close(cp->out);
+		if (finish_command(cp))
+			errs = error("checkout worker exited abnormally");
+		collect_failures(&failed, &out);
+		strbuf_release(&out);
+	}
+	free(workers);
+
+	errs |= handle_results(state, &failed);
+
+done:
+	string_list_clear(&failed, 0);
+	free(parallel_checkout.items);
+	parallel_checkout.items = NULL;
+	parallel_checkout.nr = parallel_checkout.alloc = 0;
+	return errs;
+}
+
+static int write_one_entry(struct strbuf *record, const char **path)
+{
+	unsigned char sha1[20];
+	enum object_type type;
+	unsigned long size;
+	char *end;
+	unsigned int mode;
+	void *data;
+	int fd;
+
+	*path = NULL;
+	mode = strtoul(record->buf, &end, 8);
+	if (*end != ' ' || record->len < (end - record->buf) + 42 ||
+	    get_sha1_hex(end + 1, sha1) || end[41] != ' ')
+		return error("protocol error: bad checkout--worker input");
+	*path = end + 42;
+
+	/*
+	 * Write failures from here on are reported silently; the parent
+	 * retries the path through the sequential code, which prints
+	 * the appropriate diagnostic if the retry fails too.
+	 */
+	if (sha1_object_info(sha1, &size) != OBJ_BLOB)
+		return -1;
+
+	if (safe_create_leading_directories_const(*path))
+		return -1;
+
+	fd = open(*path, O_WRONLY | O_CREAT | O_EXCL,
+		  (mode & 0100) ? 0777 : 0666);
+	if (fd < 0 && errno == EEXIST) {
+		/*
+		 * The parent only feeds us when overwriting is allowed;
+		 * unlink to get the new file with the right permissions.
+		 * If the path is a directory or otherwise in the way,
+		 * the parent will retry it sequentially.
+		 */
+		unlink(*path);
+		fd = open(*path, O_WRONLY | O_CREAT | O_EXCL,
+			  (mode & 0100) ? 0777 : 0666);
+	}
+	if (fd < 0)
+		return -1;
+
+	/*
+	 * Stream large blobs straight to the file instead of holding
+	 * them in core; with several workers running at once, fully
+	 * materialized blobs multiply across the whole pool.
+	 */
+	if (size > big_file_threshold) {
+		if (stream_blob_to_fd(fd, sha1, NULL, 0)) {
+			close(fd);
+			unlink(*path);
+			return -1;
+		}
+	} else {
+		data = read_sha1_file(sha1, &type, &size);
+		if (!data || type != OBJ_BLOB) {
+			free(data);
+			close(fd);
+			unlink(*path);
+			return -1;
+		}
+		if (write_in_full(fd, data, size) != size) {
+			close(fd);
+			unlink(*path);
+			free(data);
+			return -1;
+		}
+		free(data);
+	}
+	if (close(fd))
+		return -1;
+	return 0;
+}
+
+int checkout_worker_loop(void)
+{
+	struct strbuf record = STRBUF_INIT;
+	struct strbuf failed = STRBUF_INIT;
+	int ret = 0;
+
+	while (strbuf_getline(&record, stdin, '\0') != EOF) {
+		const char *path;
+
+		if (write_one_entry(&record, &path)) {
+			if (!path)
+				return 1;
+			strbuf_addstr(&failed, path);
+			strbuf_addch(&failed, '\0');
+		}
+	}
+
+	/*
+	 * Failures are reported only after all input is consumed, so
+	 * that we never block on a full stdout pipe while the parent
+	 * is still feeding us.
+	 */
+	if (failed.len &&
+	    write_in_full(1, failed.buf, failed.len) != failed.len)
+		ret = error("unable to report results to parent process");
+	strbuf_release(&failed);
+	strbuf_release(&record);
+	return ret;
+}
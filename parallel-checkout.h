@@ -0,0 +1,37 @@
+#ifndef PARALLEL_CHECKOUT_H
+#define PARALLEL_CHECKOUT_H
+
+struct cache_entry;
+struct checkout;
+
+/*
+ * Read the checkout.workers and checkout.thresholdForParallelism
+ * settings.  A workers value below one means "one per online CPU".
+ */
+extern void get_parallel_checkout_configs(int *num_workers, int *threshold);
+
+/*
+ * Prepare the queue of entries to be written out by the workers.  Must
+ * be called before enqueue_checkout().
+ */
+extern void init_parallel_checkout(void);
+
+/*
+ * Add an entry to the parallel checkout queue.  Returns 0 on success;
+ * a negative value means the entry is not eligible (e.g. it needs
+ * content conversion) and the caller has to write it out itself.
+ */
+extern int enqueue_checkout(struct cache_entry *ce);
+
+/*
+ * Write out all queued entries and empty the queue.  Entries a worker
+ * could not write (e.g. because of a path collision) are retried
+ * sequentially through checkout_entry().  Returns 0 on success.
+ */
+extern int run_parallel_checkout(const struct checkout *state,
+				 int num_workers, int threshold);
+
+/* The main loop of "git checkout--worker". */
+extern int checkout_worker_loop(void);
+
+#endif /* PARALLEL_CHECKOUT_H */
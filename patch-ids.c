@@ -16,6 +16,131 @@ static int commit_patch_id(struct commit *commit, struct diff_options *options,
 	return diff_flush_patch_id(options, sha1);
 }
 
+/*
+ * Persistent cache of computed patch-ids, enabled by patchid.cache.
+ * A commit's patch-id depends only on the commit itself and on the
+ * diff options used to compute it, so .git/info/patch-id-cache opens
+ * with a "signature <sha1>" line summarizing those options; a file
+ * written under different options is ignored and replaced.  Every
+ * other line holds "<commit sha1> <patch-id sha1>".
+ */
+
+static int patch_id_cache_enabled = -1;
+
+static int use_patch_id_cache(void)
+{
+	if (patch_id_cache_enabled < 0) {
+		int val;
+		patch_id_cache_enabled =
+			!git_config_get_bool("patchid.cache", &val) && val;
+	}
+	return patch_id_cache_enabled;
+}
+
+static void diffopts_signature(struct diff_options *options,
+			       unsigned char *sig)
+{
+	git_SHA_CTX ctx;
+	int i;
+
+	git_SHA1_Init(&ctx);
+	git_SHA1_Update(&ctx, &options->flags, sizeof(options->flags));
+	for (i = 0; i < options->pathspec.nr; i++) {
+		const char *match = options->pathspec.items[i].match;
+		git_SHA1_Update(&ctx, match, strlen(match) + 1);
+	}
+	git_SHA1_Final(sig, &ctx);
+}
+
+static void prepare_patch_id_cache(struct patch_ids *ids)
+{
+	struct strbuf line = STRBUF_INIT;
+	FILE *fp;
+
+	if (ids->cache_state)
+		return;
+	if (!use_patch_id_cache()) {
+		ids->cache_state = -1;
+		return;
+	}
+	ids->cache_state = 1;
+	diffopts_signature(&ids->diffopts, ids->cache_sig);
+
+	fp = fopen(git_path("info/patch-id-cache"), "r");
+	if (fp) {
+		const char *hex;
+
+		if (strbuf_getline(&line, fp, '\n') == EOF ||
+		    !skip_prefix(line.buf, "signature ", &hex) ||
+		    strcmp(hex, sha1_to_hex(ids->cache_sig))) {
+			fclose(fp);
+			fp = NULL;
+		}
+	}
+	if (fp) {
+		while (strbuf_getline(&line, fp, '\n') != EOF) {
+			if (line.len != 81 || line.buf[40] != ' ')
+				continue;
+			line.buf[40] = '\0';
+			string_list_append(&ids->cache, line.buf)->util =
+				xstrdup(line.buf + 41);
+		}
+		fclose(fp);
+		string_list_sort(&ids->cache);
+	} else {
+		/* no cache yet, or one written under different options */
+		int fd = open(git_path("info/patch-id-cache"),
+			      O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		if (fd >= 0) {
+			struct strbuf out = STRBUF_INIT;
+			strbuf_addf(&out, "signature %s\n",
+				    sha1_to_hex(ids->cache_sig));
+			write_in_full(fd, out.buf, out.len);
+			close(fd);
+			strbuf_release(&out);
+		}
+	}
+	strbuf_release(&line);
+}
+
+static int patch_id_cache_get(struct patch_ids *ids, struct commit *commit,
+			      unsigned char *sha1)
+{
+	struct string_list_item *item;
+
+	if (ids->cache_state < 0)
+		return 0;
+	item = string_list_lookup(&ids->cache,
+				  sha1_to_hex(commit->object.sha1));
+	if (!item)
+		return 0;
+	return !get_sha1_hex(item->util, sha1);
+}
+
+static void patch_id_cache_add(struct patch_ids *ids, struct commit *commit,
+			       const unsigned char *sha1)
+{
+	int fd;
+
+	if (ids->cache_state < 0)
+		return;
+	string_list_insert(&ids->cache,
+			   sha1_to_hex(commit->object.sha1))->util =
+		xstrdup(sha1_to_hex(sha1));
+
+	/* best effort; concurrent appenders at worst duplicate a line */
+	fd = open(git_path("info/patch-id-cache"),
+		  O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd >= 0) {
+		struct strbuf out = STRBUF_INIT;
+		strbuf_addf(&out, "%s ", sha1_to_hex(commit->object.sha1));
+		strbuf_addf(&out, "%s\n", sha1_to_hex(sha1));
+		write_in_full(fd, out.buf, out.len);
+		close(fd);
+		strbuf_release(&out);
+	}
+}
+
 static const unsigned char *patch_id_access(size_t index, void *table)
 {
 	struct patch_id **id_table = table;
@@ -37,6 +162,7 @@ struct patch_id_bucket {
 int init_patch_ids(struct patch_ids *ids)
 {
 	memset(ids, 0, sizeof(*ids));
+	ids->cache.strdup_strings = 1;
 	diff_setup(&ids->diffopts);
 	DIFF_OPT_SET(&ids->diffopts, RECURSIVE);
 	diff_setup_done(&ids->diffopts);
@@ -47,6 +173,7 @@ int free_patch_ids(struct patch_ids *ids)
 {
 	struct patch_id_bucket *next, *patches;
 
+	string_list_clear(&ids->cache, 1);
 	free(ids->table);
 	for (patches = ids->patches; patches; patches = next) {
 		next = patches->next;
@@ -64,8 +191,12 @@ static struct patch_id *add_commit(struct commit *commit,
 	unsigned char sha1[20];
 	int pos;
 
-	if (commit_patch_id(commit, &ids->diffopts, sha1))
-		return NULL;
+	prepare_patch_id_cache(ids);
+	if (!patch_id_cache_get(ids, commit, sha1)) {
+		if (commit_patch_id(commit, &ids->diffopts, sha1))
+			return NULL;
+		patch_id_cache_add(ids, commit, sha1);
+	}
 	pos = patch_pos(ids->table, ids->nr, sha1);
 	if (0 <= pos)
 		return ids->table[pos];
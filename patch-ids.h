@@ -1,6 +1,8 @@
 #ifndef PATCH_IDS_H
 #define PATCH_IDS_H
 
+#include "string-list.h"
+
 struct patch_id {
 	unsigned char patch_id[20];
 	char seen;
@@ -11,6 +13,9 @@ struct patch_ids {
 	int nr, alloc;
 	struct patch_id **table;
 	struct patch_id_bucket *patches;
+	int cache_state; /* 0 = unchecked, 1 = active, -1 = disabled */
+	unsigned char cache_sig[20];
+	struct string_list cache;
 };
 
 int init_patch_ids(struct patch_ids *);
@@ -49,18 +49,61 @@ char *mksnpath(char *buf, size_t n, const char *fmt, ...)
 	return cleanup_path(buf);
 }
 
+/*
+ * $GIT_DIR entries that linked worktrees share with the main
+ * repository; they are resolved in $GIT_COMMON_DIR instead of the
+ * per-worktree git directory.  Names ending in '/' cover the whole
+ * directory.
+ */
+static const char *common_list[] = {
+	"branches/", "hooks/", "info/", "logs/", "lost-found/",
+	"modules/", "objects/", "refs/", "remotes/", "rr-cache/",
+	"svn/", "worktrees/", "config", "packed-refs", "shallow",
+	"ref-journal",
+	NULL
+};
+
+static int is_common_path(const char *path)
+{
+	const char **p;
+
+	if (!strcmp(path, "logs/HEAD"))
+		return 0;	/* each worktree has its own HEAD reflog */
+	if (starts_with(path, "sharedindex"))
+		return 1;	/* split-index base segments are shared */
+	for (p = common_list; *p; p++) {
+		const char *elem = *p;
+		size_t len = strlen(elem);
+
+		if (elem[len - 1] == '/') {
+			if (!strncmp(path, elem, len))
+				return 1;
+			if (!strncmp(path, elem, len - 1) && !path[len - 1])
+				return 1;
+		} else if (!strcmp(path, elem))
+			return 1;
+	}
+	return 0;
+}
+
 static char *vsnpath(char *buf, size_t n, const char *fmt, va_list args)
 {
-	const char *git_dir = get_git_dir();
+	char rel[PATH_MAX];
+	const char *base = get_git_dir();
 	size_t len;
 
-	len = strlen(git_dir);
+	if (vsnprintf(rel, sizeof(rel), fmt, args) >= sizeof(rel))
+		goto bad;
+	if (is_common_path(rel))
+		base = get_git_common_dir();
+
+	len = strlen(base);
 	if (n < len + 1)
 		goto bad;
-	memcpy(buf, git_dir, len);
-	if (len && !is_dir_sep(git_dir[len-1]))
+	memcpy(buf, base, len);
+	if (len && !is_dir_sep(base[len-1]))
 		buf[len++] = '/';
-	len += vsnprintf(buf + len, n - len, fmt, args);
+	len += snprintf(buf + len, n - len, "%s", rel);
 	if (len >= n)
 		goto bad;
 	return cleanup_path(buf);
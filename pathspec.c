@@ -33,7 +33,19 @@ void add_pathspec_matches_against_index(const struct pathspec *pathspec,
 		return;
 	for (i = 0; i < active_nr; i++) {
 		const struct cache_entry *ce = active_cache[i];
-		ce_path_match(ce, pathspec, seen);
+		if (ce_path_match(ce, pathspec, seen)) {
+			/*
+			 * Once every pathspec has achieved the best
+			 * possible match, walking the rest of a large
+			 * index cannot change seen[] any more.
+			 */
+			int j;
+			for (j = 0; j < pathspec->nr; j++)
+				if (seen[j] != MATCHED_EXACTLY)
+					break;
+			if (j == pathspec->nr)
+				return;
+		}
 	}
 }
 
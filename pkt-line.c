@@ -96,6 +96,78 @@ void packet_write(int fd, const char *fmt, ...)
 	write_or_die(fd, buf.buf, buf.len);
 }
 
+int packet_flush_gently(int fd)
+{
+	packet_trace("0000", 4, 1);
+	if (write_in_full(fd, "0000", 4) == 4)
+		return 0;
+	return error("flush packet write failed");
+}
+
+int packet_write_fmt_gently(int fd, const char *fmt, ...)
+{
+	static struct strbuf buf = STRBUF_INIT;
+	va_list args;
+
+	strbuf_reset(&buf);
+	va_start(args, fmt);
+	format_packet(&buf, fmt, args);
+	va_end(args);
+	if (write_in_full(fd, buf.buf, buf.len) == buf.len)
+		return 0;
+	return error("packet write failed");
+}
+
+static int packet_write_data_gently(int fd, const char *buf, size_t size)
+{
+	static char packet_write_buffer[LARGE_PACKET_MAX];
+
+	if (size > LARGE_PACKET_DATA_MAX)
+		return error("packet write failed - data exceeds max packet size");
+	packet_trace(buf, size, 1);
+	sprintf(packet_write_buffer, "%04x", (unsigned int)(size + 4));
+	memcpy(packet_write_buffer + 4, buf, size);
+	if (write_in_full(fd, packet_write_buffer, size + 4) == size + 4)
+		return 0;
+	return error("packet write failed");
+}
+
+int write_packetized_from_fd(int fd_in, int fd_out)
+{
+	static char buf[LARGE_PACKET_DATA_MAX];
+	int err = 0;
+	ssize_t bytes_to_write;
+
+	while (!err) {
+		bytes_to_write = xread(fd_in, buf, sizeof(buf));
+		if (bytes_to_write < 0)
+			return error("read error while packetizing data");
+		if (bytes_to_write == 0)
+			break;
+		err = packet_write_data_gently(fd_out, buf, bytes_to_write);
+	}
+	if (!err)
+		err = packet_flush_gently(fd_out);
+	return err;
+}
+
+int write_packetized_from_buf(const char *src, size_t len, int fd_out)
+{
+	int err = 0;
+	size_t written = 0;
+
+	while (!err && written < len) {
+		size_t chunk = len - written;
+		if (chunk > LARGE_PACKET_DATA_MAX)
+			chunk = LARGE_PACKET_DATA_MAX;
+		err = packet_write_data_gently(fd_out, src + written, chunk);
+		written += chunk;
+	}
+	if (!err)
+		err = packet_flush_gently(fd_out);
+	return err;
+}
+
 void packet_buf_write(struct strbuf *buf, const char *fmt, ...)
 {
 	va_list args;
@@ -105,6 +177,57 @@ void packet_buf_write(struct strbuf *buf, const char *fmt, ...)
 	va_end(args);
 }
 
+void packet_writer_init(struct packet_writer *writer, int dest_fd)
+{
+	writer->dest_fd = dest_fd;
+	strbuf_init(&writer->buf, LARGE_PACKET_MAX);
+	writer->corked = 0;
+}
+
+static void packet_writer_drain(struct packet_writer *writer)
+{
+	if (writer->buf.len) {
+		write_or_die(writer->dest_fd, writer->buf.buf,
+			     writer->buf.len);
+		strbuf_reset(&writer->buf);
+	}
+}
+
+void packet_writer_cork(struct packet_writer *writer)
+{
+	writer->corked = 1;
+}
+
+void packet_writer_uncork(struct packet_writer *writer)
+{
+	packet_writer_drain(writer);
+	writer->corked = 0;
+}
+
+void packet_writer_write(struct packet_writer *writer, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	format_packet(&writer->buf, fmt, args);
+	va_end(args);
+
+	/*
+	 * While corked, lines pile up so that many small packets go
+	 * out in a single write(); keep the buffer bounded anyway so
+	 * a huge advertisement does not balloon memory use.
+	 */
+	if (!writer->corked || writer->buf.len >= LARGE_PACKET_MAX)
+		packet_writer_drain(writer);
+}
+
+void packet_writer_flush(struct packet_writer *writer)
+{
+	packet_trace("0000", 4, 1);
+	strbuf_add(&writer->buf, "0000", 4);
+	packet_writer_drain(writer);
+}
+
 static int get_packet_data(int fd, char **src_buf, size_t *src_size,
 			   void *dst, unsigned size, int options)
 {
@@ -161,6 +284,25 @@ static int packet_length(const char *linelen)
 	return len;
 }
 
+int packet_read_header(int fd)
+{
+	int len;
+	char linelen[4];
+
+	get_packet_data(fd, NULL, NULL, linelen, 4, 0);
+	len = packet_length(linelen);
+	if (len < 0)
+		die("protocol error: bad line length character: %.4s", linelen);
+	if (!len) {
+		packet_trace("0000", 4, 0);
+		return 0;
+	}
+	len -= 4;
+	if (len >= LARGE_PACKET_MAX)
+		die("protocol error: bad line length %d", len);
+	return len;
+}
+
 int packet_read(int fd, char **src_buf, size_t *src_len,
 		char *buffer, unsigned size, int options)
 {
@@ -214,3 +356,30 @@ char *packet_read_line_buf(char **src, size_t *src_len, int *dst_len)
 {
 	return packet_read_line_generic(-1, src, src_len, dst_len);
 }
+
+ssize_t read_packetized_to_strbuf(int fd_in, struct strbuf *sb_out)
+{
+	int packet_len;
+	size_t orig_len = sb_out->len;
+
+	for (;;) {
+		strbuf_grow(sb_out, LARGE_PACKET_DATA_MAX);
+
+		/*
+		 * packet_read() insists on a buffer one byte larger
+		 * than the largest possible payload, for the NUL it
+		 * appends; strbuf_grow() has made room for it.
+		 */
+		packet_len = packet_read(fd_in, NULL, NULL,
+					 sb_out->buf + sb_out->len,
+					 LARGE_PACKET_DATA_MAX + 1,
+					 PACKET_READ_GENTLE_ON_EOF);
+		if (packet_len <= 0)
+			break;
+		strbuf_setlen(sb_out, sb_out->len + packet_len);
+	}
+
+	if (packet_len < 0)
+		return packet_len;
+	return sb_out->len - orig_len;
+}
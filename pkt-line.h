@@ -24,6 +24,25 @@ void packet_write(int fd, const char *fmt, ...) __attribute__((format (printf, 2
 void packet_buf_flush(struct strbuf *buf);
 void packet_buf_write(struct strbuf *buf, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
 
+/*
+ * A writer that can be "corked" to batch many small packets into a
+ * single write(), e.g. for the ref advertisement.  While corked,
+ * written packets accumulate in the buffer; uncorking (or filling
+ * the buffer) sends them out in one go.  Uncorked, it behaves like
+ * packet_write()/packet_flush() on the destination fd.
+ */
+struct packet_writer {
+	int dest_fd;
+	struct strbuf buf;
+	int corked;
+};
+
+void packet_writer_init(struct packet_writer *writer, int dest_fd);
+void packet_writer_write(struct packet_writer *writer, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+void packet_writer_flush(struct packet_writer *writer);
+void packet_writer_cork(struct packet_writer *writer);
+void packet_writer_uncork(struct packet_writer *writer);
+
 /*
  * Read a packetized line into the buffer, which must be at least size bytes
  * long. The return value specifies the number of bytes read into the buffer.
@@ -60,6 +79,15 @@ void packet_buf_write(struct strbuf *buf, const char *fmt, ...) __attribute__((f
 int packet_read(int fd, char **src_buffer, size_t *src_len, char
 		*buffer, unsigned size, int options);
 
+/*
+ * Read just the pkt-line header from fd and return the payload
+ * length (0 for a flush packet), dying on protocol errors and
+ * truncation like packet_read() does.  The payload is left unread on
+ * the descriptor so the caller can move it out of band, e.g. with
+ * splice(2).
+ */
+int packet_read_header(int fd);
+
 /*
  * Convenience wrapper for packet_read that is not gentle, and sets the
  * CHOMP_NEWLINE option. The return value is NULL for a flush packet,
@@ -75,8 +103,27 @@ char *packet_read_line(int fd, int *size);
  */
 char *packet_read_line_buf(char **src_buf, size_t *src_len, int *size);
 
+/*
+ * Gentle counterparts to the writers above, for long-lived helper
+ * processes where a vanished peer must not kill us: these report the
+ * problem with error() and return -1 instead of dying.
+ */
+int packet_flush_gently(int fd);
+int packet_write_fmt_gently(int fd, const char *fmt, ...) __attribute__((format (printf, 2, 3)));
+
+/*
+ * Move a stream of bytes as a sequence of maximum-sized packets
+ * followed by a flush packet, and read such a sequence back.  All
+ * three report errors with error() and return -1 (reading returns
+ * the number of payload bytes appended on success).
+ */
+int write_packetized_from_fd(int fd_in, int fd_out);
+int write_packetized_from_buf(const char *src, size_t len, int fd_out);
+ssize_t read_packetized_to_strbuf(int fd_in, struct strbuf *sb_out);
+
 #define DEFAULT_PACKET_MAX 1000
 #define LARGE_PACKET_MAX 65520
+#define LARGE_PACKET_DATA_MAX (LARGE_PACKET_MAX - 4)
 extern char packet_buffer[LARGE_PACKET_MAX];
 
 #endif
@@ -36,8 +36,11 @@ struct progress {
 	unsigned delay;
 	unsigned delayed_percent_treshold;
 	struct throughput *throughput;
+	uint64_t start_ns;
 };
 
+static struct trace_key trace_progress = TRACE_KEY_INIT(PROGRESS);
+
 static volatile sig_atomic_t progress_update;
 
 static void progress_interval(int signum)
@@ -72,6 +75,54 @@ static void clear_progress_signal(void)
 	progress_update = 0;
 }
 
+/*
+ * Estimate the remaining time from the rate observed since the
+ * progress meter was started.  An estimate is only offered once a
+ * couple of seconds have passed; before that the extrapolation is
+ * too noisy to be worth printing.
+ */
+static void eta_string(struct strbuf *buf, const struct progress *progress,
+		       unsigned n)
+{
+	uint64_t elapsed, remaining;
+
+	if (!n || n >= progress->total)
+		return;
+	elapsed = getnanotime() - progress->start_ns;
+	if (elapsed < 2000000000)
+		return;
+	remaining = (uint64_t)((double)elapsed / 1000000000 *
+			       (progress->total - n) / n);
+	strbuf_addf(buf, ", ETA %02u:%02u:%02u",
+		    (unsigned)(remaining / 3600),
+		    (unsigned)(remaining / 60 % 60),
+		    (unsigned)(remaining % 60));
+}
+
+/*
+ * Key-value sideband for tools that drive long-running commands; the
+ * free-form title comes last so that consumers can split the line on
+ * whitespace.  Emitted at the same cadence as the human display.
+ */
+static void display_trace(struct progress *progress, unsigned n, int done)
+{
+	struct throughput *tp = progress->throughput;
+
+	if (!trace_want(&trace_progress))
+		return;
+	if (tp)
+		trace_printf_key(&trace_progress,
+				 "progress: value=%u total=%u bytes=%"PRIuMAX
+				 " done=%d title=%s",
+				 n, progress->total,
+				 (uintmax_t)tp->curr_total, done,
+				 progress->title);
+	else
+		trace_printf_key(&trace_progress,
+				 "progress: value=%u total=%u done=%d title=%s",
+				 n, progress->total, done, progress->title);
+}
+
 static int display(struct progress *progress, unsigned n, const char *done)
 {
 	const char *eol, *tp;
@@ -97,17 +148,23 @@ static int display(struct progress *progress, unsigned n, const char *done)
 	if (progress->total) {
 		unsigned percent = n * 100 / progress->total;
 		if (percent != progress->last_percent || progress_update) {
+			struct strbuf eta = STRBUF_INIT;
 			progress->last_percent = percent;
-			fprintf(stderr, "%s: %3u%% (%u/%u)%s%s",
+			if (!done)
+				eta_string(&eta, progress, n);
+			fprintf(stderr, "%s: %3u%% (%u/%u)%s%s%s",
 				progress->title, percent, n,
-				progress->total, tp, eol);
+				progress->total, tp, eta.buf, eol);
 			fflush(stderr);
+			strbuf_release(&eta);
+			display_trace(progress, n, !!done);
 			progress_update = 0;
 			return 1;
 		}
 	} else if (progress_update) {
 		fprintf(stderr, "%s: %u%s%s", progress->title, n, tp, eol);
 		fflush(stderr);
+		display_trace(progress, n, !!done);
 		progress_update = 0;
 		return 1;
 	}
@@ -211,6 +268,7 @@ struct progress *start_progress_delay(const char *title, unsigned total,
 	progress->delayed_percent_treshold = percent_treshold;
 	progress->delay = delay;
 	progress->throughput = NULL;
+	progress->start_ns = getnanotime();
 	set_progress_signal();
 	return progress;
 }
@@ -6,6 +6,7 @@
 #define NO_THE_INDEX_COMPATIBILITY_MACROS
 #include "cache.h"
 #include "lockfile.h"
+#include "trace-event.h"
 #include "cache-tree.h"
 #include "refs.h"
 #include "dir.h"
@@ -16,8 +17,14 @@
 #include "strbuf.h"
 #include "varint.h"
 #include "split-index.h"
+#include "fsmonitor.h"
+#include "mem-pool.h"
 #include "sigchain.h"
 #include "utf8.h"
+#include "thread-utils.h"
+#ifndef NO_PTHREADS
+#include <pthread.h>
+#endif
 
 static struct cache_entry *refresh_cache_entry(struct cache_entry *ce,
 					       unsigned int options);
@@ -39,15 +46,90 @@ static struct cache_entry *refresh_cache_entry(struct cache_entry *ce,
 #define CACHE_EXT_TREE 0x54524545	/* "TREE" */
 #define CACHE_EXT_RESOLVE_UNDO 0x52455543 /* "REUC" */
 #define CACHE_EXT_LINK 0x6c696e6b	  /* "link" */
+#define CACHE_EXT_FSMONITOR 0x46534D4E	  /* "FSMN" */
+#define CACHE_EXT_UNTRACKED 0x554E5452	  /* "UNTR" */
+#define CACHE_EXT_ENDOFINDEXENTRIES 0x454F4945	/* "EOIE" */
+#define CACHE_EXT_INDEXENTRYOFFSETTABLE 0x49454F54 /* "IEOT" */
 
 /* changes that can be kept in $GIT_DIR/index (basically all extensions) */
 #define EXTMASK (RESOLVE_UNDO_CHANGED | CACHE_TREE_CHANGED | \
 		 CE_ENTRY_ADDED | CE_ENTRY_REMOVED | CE_ENTRY_CHANGED | \
-		 SPLIT_INDEX_ORDERED)
+		 SPLIT_INDEX_ORDERED | FSMONITOR_CHANGED | UNTRACKED_CHANGED)
 
 struct index_state the_index;
 static const char *alternate_index_output;
 
+/*
+ * The index entry offset table (IEOT) extension records the offset and
+ * entry count of every Nth cache entry so that blocks of entries can be
+ * parsed in parallel; the end of index entry (EOIE) extension records
+ * where the extension section starts so that both the IEOT and the
+ * other extensions can be found without walking all the entries first.
+ */
+struct index_entry_offset {
+	/* starting byte offset into index file, count of index entries in this block */
+	uint32_t offset;
+	uint32_t nr;
+};
+
+struct index_entry_offset_table {
+	int nr;
+	struct index_entry_offset entries[FLEX_ARRAY];
+};
+
+/* minimum number of cache entries worth spinning up a thread for */
+#define THREAD_COST (10000)
+
+#ifndef NO_PTHREADS
+static struct index_entry_offset_table *read_ieot_extension(const char *mmap, size_t mmap_size, size_t offset);
+static size_t read_eoie_extension(const char *mmap, size_t mmap_size);
+#endif
+static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_table *ieot);
+static void write_eoie_extension(struct strbuf *sb, git_SHA_CTX *eoie_context, size_t offset);
+
+/*
+ * Cache entries created while reading an index file are carved out of
+ * a few large blocks owned by the index_state instead of being
+ * malloc'ed one by one; reading a big index this way costs a handful
+ * of allocations instead of one per entry, and discarding it costs a
+ * handful of frees.  Entries created at run time (add_to_index(),
+ * make_cache_entry(), ...) are still allocated individually; the
+ * ce->pooled flag tells the two kinds apart, and every place that
+ * frees a cache entry must go through discard_cache_entry().
+ */
+/* allocate a pool big enough for 'nr' entries with short-ish names */
+static struct mem_pool *entry_pool_for_entries(unsigned int nr)
+{
+	struct mem_pool *pool = xcalloc(1, sizeof(*pool));
+
+	mem_pool_init(pool, (size_t)nr *
+		      (offsetof(struct cache_entry, name) + 32));
+	return pool;
+}
+
+static struct cache_entry *entry_pool_alloc(struct mem_pool *pool, size_t size)
+{
+	struct cache_entry *ce = mem_pool_alloc(pool, size);
+
+	ce->pooled = 1;
+	return ce;
+}
+
+static void free_entry_pool(struct index_state *istate)
+{
+	if (!istate->entry_pool)
+		return;
+	mem_pool_discard(istate->entry_pool);
+	free(istate->entry_pool);
+	istate->entry_pool = NULL;
+}
+
+void discard_cache_entry(struct cache_entry *ce)
+{
+	if (ce && !ce->pooled)
+		free(ce);
+}
+
 static void set_index_entry(struct index_state *istate, int nr, struct cache_entry *ce)
 {
 	istate->cache[nr] = ce;
@@ -60,7 +142,7 @@ static void replace_index_entry(struct index_state *istate, int nr, struct cache
 
 	replace_index_entry_in_base(istate, old, ce);
 	remove_name_hash(istate, old);
-	free(old);
+	discard_cache_entry(old);
 	set_index_entry(istate, nr, ce);
 	ce->ce_flags |= CE_UPDATE_IN_BASE;
 	istate->cache_changed |= CE_ENTRY_CHANGED;
@@ -72,6 +154,7 @@ void rename_index_entry_at(struct index_state *istate, int nr, const char *new_n
 	int namelen = strlen(new_name);
 
 	new = xmalloc(cache_entry_size(namelen));
+	new->pooled = 0;
 	copy_cache_entry(new, old);
 	new->ce_flags &= ~CE_HASHED;
 	new->ce_namelen = namelen;
@@ -498,6 +581,7 @@ int remove_index_entry_at(struct index_state *istate, int pos)
 	record_resolve_undo(istate, ce);
 	remove_name_hash(istate, ce);
 	save_or_free_index_entry(istate, ce);
+	untracked_cache_invalidate_path(istate, ce->name);
 	istate->cache_changed |= CE_ENTRY_REMOVED;
 	istate->cache_nr--;
 	if (pos >= istate->cache_nr)
@@ -972,6 +1056,7 @@ static int add_index_entry_with_check(struct index_state *istate, struct cache_e
 
 	if (!(option & ADD_CACHE_KEEP_CACHE_TREE))
 		cache_tree_invalidate_path(istate, ce->name);
+	untracked_cache_invalidate_path(istate, ce->name);
 	pos = index_name_stage_pos(istate, ce->name, ce_namelen(ce), ce_stage(ce));
 
 	/* existing match? Just replace it. */
@@ -1079,6 +1164,18 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 		return ce;
 	}
 
+	/*
+	 * The filesystem monitor vouches that nothing touched this
+	 * path since the last query, so the cached stat data is still
+	 * good and we can skip the lstat altogether.
+	 */
+	refresh_fsmonitor(istate);
+	if (!ignore_valid && core_fsmonitor &&
+	    (ce->ce_flags & CE_FSMONITOR_VALID)) {
+		ce_mark_uptodate(ce);
+		return ce;
+	}
+
 	if (has_symlink_leading_path(ce->name, ce_namelen(ce))) {
 		if (ignore_missing)
 			return ce;
@@ -1099,6 +1196,8 @@ static struct cache_entry *refresh_cache_ent(struct index_state *istate,
 	if (changed_ret)
 		*changed_ret = changed;
 	if (!changed) {
+		if (core_fsmonitor)
+			ce->ce_flags |= CE_FSMONITOR_VALID;
 		/*
 		 * The path is unchanged.  If we were told to ignore
 		 * valid bit, then we did the actual stat check and
@@ -1363,15 +1462,29 @@ static int read_index_extension(struct index_state *istate,
 {
 	switch (CACHE_EXT(ext)) {
 	case CACHE_EXT_TREE:
-		istate->cache_tree = cache_tree_read(data, sz);
+		/* parsed on first use; see index_cache_tree() */
+		istate->cache_tree_data = xmemdupz(data, sz);
+		istate->cache_tree_data_size = sz;
 		break;
 	case CACHE_EXT_RESOLVE_UNDO:
-		istate->resolve_undo = resolve_undo_read(data, sz);
+		/* parsed on first use; see index_resolve_undo() */
+		istate->resolve_undo_data = xmemdupz(data, sz);
+		istate->resolve_undo_data_size = sz;
 		break;
 	case CACHE_EXT_LINK:
 		if (read_link_extension(istate, data, sz))
 			return -1;
 		break;
+	case CACHE_EXT_FSMONITOR:
+		read_fsmonitor_extension(istate, data, sz);
+		break;
+	case CACHE_EXT_UNTRACKED:
+		istate->untracked = read_untracked_extension(data, sz);
+		break;
+	case CACHE_EXT_ENDOFINDEXENTRIES:
+	case CACHE_EXT_INDEXENTRYOFFSETTABLE:
+		/* already handled in do_read_index() */
+		break;
 	default:
 		if (*ext < 'A' || 'Z' < *ext)
 			return error("index uses %.4s extension, which we do not understand",
@@ -1395,61 +1508,26 @@ int read_index(struct index_state *istate)
 	return read_index_from(istate, get_index_file());
 }
 
-static struct cache_entry *cache_entry_from_ondisk(struct ondisk_cache_entry *ondisk,
-						   unsigned int flags,
-						   const char *name,
-						   size_t len)
-{
-	struct cache_entry *ce = xmalloc(cache_entry_size(len));
-
-	ce->ce_stat_data.sd_ctime.sec = get_be32(&ondisk->ctime.sec);
-	ce->ce_stat_data.sd_mtime.sec = get_be32(&ondisk->mtime.sec);
-	ce->ce_stat_data.sd_ctime.nsec = get_be32(&ondisk->ctime.nsec);
-	ce->ce_stat_data.sd_mtime.nsec = get_be32(&ondisk->mtime.nsec);
-	ce->ce_stat_data.sd_dev   = get_be32(&ondisk->dev);
-	ce->ce_stat_data.sd_ino   = get_be32(&ondisk->ino);
-	ce->ce_mode  = get_be32(&ondisk->mode);
-	ce->ce_stat_data.sd_uid   = get_be32(&ondisk->uid);
-	ce->ce_stat_data.sd_gid   = get_be32(&ondisk->gid);
-	ce->ce_stat_data.sd_size  = get_be32(&ondisk->size);
-	ce->ce_flags = flags & ~CE_NAMEMASK;
-	ce->ce_namelen = len;
-	ce->index = 0;
-	hashcpy(ce->sha1, ondisk->sha1);
-	memcpy(ce->name, name, len);
-	ce->name[len] = '\0';
-	return ce;
-}
-
-/*
- * Adjacent cache entries tend to share the leading paths, so it makes
- * sense to only store the differences in later entries.  In the v4
- * on-disk format of the index, each on-disk cache entry stores the
- * number of bytes to be stripped from the end of the previous name,
- * and the bytes to append to the result, to come up with its name.
- */
-static unsigned long expand_name_field(struct strbuf *name, const char *cp_)
-{
-	const unsigned char *ep, *cp = (const unsigned char *)cp_;
-	size_t len = decode_varint(&cp);
-
-	if (name->len < len)
-		die("malformed name field in the index");
-	strbuf_remove(name, name->len - len, len);
-	for (ep = cp; *ep; ep++)
-		; /* find the end */
-	strbuf_add(name, cp, ep - cp);
-	return (const char *)ep + 1 - cp_;
-}
-
-static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
+static struct cache_entry *create_from_disk(struct mem_pool *pool,
+					    unsigned int version,
+					    struct ondisk_cache_entry *ondisk,
 					    unsigned long *ent_size,
-					    struct strbuf *previous_name)
+					    const struct cache_entry *previous_ce)
 {
 	struct cache_entry *ce;
 	size_t len;
 	const char *name;
 	unsigned int flags;
+	size_t copy_len = 0;
+	/*
+	 * Adjacent cache entries tend to share the leading paths, so it
+	 * makes sense to only store the differences in later entries.  In
+	 * the v4 on-disk format of the index, each on-disk cache entry
+	 * stores the number of bytes to be stripped from the end of the
+	 * previous name, and the bytes to append to the result, to come up
+	 * with its name.
+	 */
+	int expand_name_field = version == 4;
 
 	/* On-disk flags are just 16 bits */
 	flags = get_be16(&ondisk->flags);
@@ -1469,21 +1547,53 @@ static struct cache_entry *create_from_disk(struct ondisk_cache_entry *ondisk,
 	else
 		name = ondisk->name;
 
-	if (!previous_name) {
-		/* v3 and earlier */
-		if (len == CE_NAMEMASK)
-			len = strlen(name);
-		ce = cache_entry_from_ondisk(ondisk, flags, name, len);
+	if (expand_name_field) {
+		const unsigned char *cp = (const unsigned char *)name;
+		size_t strip_len, previous_len;
+
+		/* If we're at the beginning of a block, ignore the previous name */
+		strip_len = decode_varint(&cp);
+		if (previous_ce) {
+			previous_len = previous_ce->ce_namelen;
+			if (previous_len < strip_len)
+				die("malformed name field in the index, near path '%s'",
+				    previous_ce->name);
+			copy_len = previous_len - strip_len;
+		}
+		name = (const char *)cp;
+	}
 
-		*ent_size = ondisk_ce_size(ce);
-	} else {
-		unsigned long consumed;
-		consumed = expand_name_field(previous_name, name);
-		ce = cache_entry_from_ondisk(ondisk, flags,
-					     previous_name->buf,
-					     previous_name->len);
+	if (len == CE_NAMEMASK) {
+		len = strlen(name);
+		if (expand_name_field)
+			len += copy_len;
+	}
+
+	ce = entry_pool_alloc(pool, cache_entry_size(len));
+
+	ce->ce_stat_data.sd_ctime.sec = get_be32(&ondisk->ctime.sec);
+	ce->ce_stat_data.sd_mtime.sec = get_be32(&ondisk->mtime.sec);
+	ce->ce_stat_data.sd_ctime.nsec = get_be32(&ondisk->ctime.nsec);
+	ce->ce_stat_data.sd_mtime.nsec = get_be32(&ondisk->mtime.nsec);
+	ce->ce_stat_data.sd_dev   = get_be32(&ondisk->dev);
+	ce->ce_stat_data.sd_ino   = get_be32(&ondisk->ino);
+	ce->ce_mode  = get_be32(&ondisk->mode);
+	ce->ce_stat_data.sd_uid   = get_be32(&ondisk->uid);
+	ce->ce_stat_data.sd_gid   = get_be32(&ondisk->gid);
+	ce->ce_stat_data.sd_size  = get_be32(&ondisk->size);
+	ce->ce_flags = flags & ~CE_NAMEMASK;
+	ce->ce_namelen = len;
+	ce->index = 0;
+	hashcpy(ce->sha1, ondisk->sha1);
 
-		*ent_size = (name - ((char *)ondisk)) + consumed;
+	if (expand_name_field) {
+		if (copy_len)
+			memcpy(ce->name, previous_ce->name, copy_len);
+		memcpy(ce->name + copy_len, name, len + 1 - copy_len);
+		*ent_size = (name - ((char *)ondisk)) + len + 1 - copy_len;
+	} else {
+		memcpy(ce->name, name, len + 1);
+		*ent_size = ondisk_ce_size(ce);
 	}
 	return ce;
 }
@@ -1510,16 +1620,213 @@ static void check_ce_order(struct index_state *istate)
 	}
 }
 
+struct load_index_extensions {
+#ifndef NO_PTHREADS
+	pthread_t pthread;
+#endif
+	struct index_state *istate;
+	const char *mmap;
+	size_t mmap_size;
+	unsigned long src_offset;
+};
+
+static void *load_index_extensions(void *_data)
+{
+	struct load_index_extensions *p = _data;
+	unsigned long src_offset = p->src_offset;
+
+	while (src_offset <= p->mmap_size - 20 - 8) {
+		/* After an array of active_nr index entries,
+		 * there can be arbitrary number of extended
+		 * sections, each of which is prefixed with
+		 * extension name (4-byte) and section length
+		 * in 4-byte network byte order.
+		 */
+		uint32_t extsize;
+		memcpy(&extsize, p->mmap + src_offset + 4, 4);
+		extsize = ntohl(extsize);
+		if (read_index_extension(p->istate,
+					 p->mmap + src_offset,
+					 (char *)p->mmap + src_offset + 8,
+					 extsize) < 0) {
+			munmap((void *)p->mmap, p->mmap_size);
+			die("index file corrupt");
+		}
+		src_offset += 8;
+		src_offset += extsize;
+	}
+
+	return NULL;
+}
+
+/*
+ * A helper function that will load the specified range of cache entries
+ * from the memory mapped file and add them to the given index.
+ */
+static unsigned long load_cache_entry_block(struct index_state *istate,
+					    struct mem_pool *pool,
+					    int offset, int nr,
+					    const char *mmap,
+					    unsigned long start_offset,
+					    const struct cache_entry *previous_ce)
+{
+	int i;
+	unsigned long src_offset = start_offset;
+
+	for (i = offset; i < offset + nr; i++) {
+		struct ondisk_cache_entry *disk_ce;
+		struct cache_entry *ce;
+		unsigned long consumed;
+
+		disk_ce = (struct ondisk_cache_entry *)(mmap + src_offset);
+		ce = create_from_disk(pool, istate->version, disk_ce,
+				      &consumed, previous_ce);
+		set_index_entry(istate, i, ce);
+
+		src_offset += consumed;
+		previous_ce = ce;
+	}
+	return src_offset - start_offset;
+}
+
+static unsigned long load_all_cache_entries(struct index_state *istate,
+					    const char *mmap, size_t mmap_size,
+					    unsigned long src_offset)
+{
+	if (!istate->cache_nr)
+		return 0;
+
+	istate->entry_pool = entry_pool_for_entries(istate->cache_nr);
+	return load_cache_entry_block(istate, istate->entry_pool, 0,
+				      istate->cache_nr, mmap, src_offset,
+				      NULL);
+}
+
+#ifndef NO_PTHREADS
+
+struct load_cache_entries_thread_data {
+	pthread_t pthread;
+	struct index_state *istate;
+	struct mem_pool *pool;
+	int offset;
+	const char *mmap;
+	struct index_entry_offset_table *ieot;
+	int ieot_start;		/* starting index into the ieot array */
+	int ieot_blocks;	/* count of ieot entries to process */
+	unsigned long consumed;	/* return # of bytes in index file processed */
+};
+
+/*
+ * A thread proc to run the load_cache_entries() computation
+ * across multiple background threads.
+ */
+static void *load_cache_entries_thread(void *_data)
+{
+	struct load_cache_entries_thread_data *p = _data;
+	int i;
+
+	/* iterate across all ieot blocks assigned to this thread */
+	for (i = p->ieot_start; i < p->ieot_start + p->ieot_blocks; i++) {
+		p->consumed += load_cache_entry_block(p->istate, p->pool,
+						      p->offset,
+						      p->ieot->entries[i].nr,
+						      p->mmap,
+						      p->ieot->entries[i].offset,
+						      NULL);
+		p->offset += p->ieot->entries[i].nr;
+	}
+	return NULL;
+}
+
+static unsigned long load_cache_entries_threaded(struct index_state *istate,
+						 const char *mmap,
+						 size_t mmap_size,
+						 int nr_threads,
+						 struct index_entry_offset_table *ieot)
+{
+	int i, offset, ieot_blocks, ieot_start, err;
+	struct load_cache_entries_thread_data *data;
+	unsigned long consumed = 0;
+
+	/* a little sanity checking */
+	if (istate->name_hash_initialized)
+		die("BUG: the name hash isn't thread safe");
+
+	/* ensure we have no more threads than we have blocks to process */
+	if (nr_threads > ieot->nr)
+		nr_threads = ieot->nr;
+	data = xcalloc(nr_threads, sizeof(*data));
+
+	offset = ieot_start = 0;
+	ieot_blocks = DIV_ROUND_UP(ieot->nr, nr_threads);
+	for (i = 0; i < nr_threads; i++) {
+		struct load_cache_entries_thread_data *p = &data[i];
+		int nr, j;
+
+		if (ieot_start + ieot_blocks > ieot->nr)
+			ieot_blocks = ieot->nr - ieot_start;
+
+		p->istate = istate;
+		p->offset = offset;
+		p->mmap = mmap;
+		p->ieot = ieot;
+		p->ieot_start = ieot_start;
+		p->ieot_blocks = ieot_blocks;
+
+		/* create an entry pool for each thread */
+		nr = 0;
+		for (j = p->ieot_start; j < p->ieot_start + p->ieot_blocks; j++)
+			nr += p->ieot->entries[j].nr;
+		p->pool = entry_pool_for_entries(nr);
+
+		err = pthread_create(&p->pthread, NULL, load_cache_entries_thread, p);
+		if (err)
+			die("unable to create load_cache_entries thread: %s",
+			    strerror(err));
+
+		/* increment by the number of cache entries in the ieot block being processed */
+		for (j = 0; j < ieot_blocks; j++)
+			offset += ieot->entries[ieot_start + j].nr;
+		ieot_start += ieot_blocks;
+	}
+
+	for (i = 0; i < nr_threads; i++) {
+		struct load_cache_entries_thread_data *p = &data[i];
+
+		err = pthread_join(p->pthread, NULL);
+		if (err)
+			die("unable to join load_cache_entries thread: %s",
+			    strerror(err));
+		if (!istate->entry_pool)
+			istate->entry_pool = p->pool;
+		else {
+			mem_pool_combine(istate->entry_pool, p->pool);
+			free(p->pool);
+		}
+		consumed += p->consumed;
+	}
+
+	free(data);
+
+	return consumed;
+}
+#endif
+
 /* remember to discard_cache() before reading a different cache! */
 int do_read_index(struct index_state *istate, const char *path, int must_exist)
 {
-	int fd, i;
+	int fd;
 	struct stat st;
 	unsigned long src_offset;
 	struct cache_header *hdr;
 	void *mmap;
 	size_t mmap_size;
-	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+	struct load_index_extensions p;
+#ifndef NO_PTHREADS
+	size_t extension_offset = 0;
+	int nr_threads, cpus;
+	struct index_entry_offset_table *ieot = NULL;
+#endif
 
 	if (istate->initialized)
 		return istate->cache_nr;
@@ -1540,7 +1847,12 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	if (mmap_size < sizeof(struct cache_header) + 20)
 		die("index file smaller than expected");
 
-	mmap = xmmap(NULL, mmap_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	/*
+	 * We never write through this mapping; mapping it read-only
+	 * keeps the kernel from ever copying the pages, so concurrent
+	 * readers of a large shared index all use the same page cache.
+	 */
+	mmap = xmmap(NULL, mmap_size, PROT_READ, MAP_PRIVATE, fd, 0);
 	if (mmap == MAP_FAILED)
 		die_errno("unable to map index file");
 	close(fd);
@@ -1556,44 +1868,72 @@ int do_read_index(struct index_state *istate, const char *path, int must_exist)
 	istate->cache = xcalloc(istate->cache_alloc, sizeof(*istate->cache));
 	istate->initialized = 1;
 
-	if (istate->version == 4)
-		previous_name = &previous_name_buf;
-	else
-		previous_name = NULL;
+	p.istate = istate;
+	p.mmap = mmap;
+	p.mmap_size = mmap_size;
 
 	src_offset = sizeof(*hdr);
-	for (i = 0; i < istate->cache_nr; i++) {
-		struct ondisk_cache_entry *disk_ce;
-		struct cache_entry *ce;
-		unsigned long consumed;
 
-		disk_ce = (struct ondisk_cache_entry *)((char *)mmap + src_offset);
-		ce = create_from_disk(disk_ce, &consumed, previous_name);
-		set_index_entry(istate, i, ce);
+#ifndef NO_PTHREADS
+	if (git_config_get_index_threads(&nr_threads))
+		nr_threads = 0;
+	if (!nr_threads) {
+		nr_threads = istate->cache_nr / THREAD_COST;
+		cpus = online_cpus();
+		if (nr_threads > cpus)
+			nr_threads = cpus;
+	}
+
+	if (nr_threads > 1) {
+		extension_offset = read_eoie_extension(mmap, mmap_size);
+		if (extension_offset) {
+			int err;
+
+			/* create a thread to load the index extensions */
+			p.src_offset = extension_offset;
+			err = pthread_create(&p.pthread, NULL,
+					     load_index_extensions, &p);
+			if (err)
+				die("unable to create load_index_extensions thread: %s",
+				    strerror(err));
 
-		src_offset += consumed;
+			/*
+			 * locate the index entry offset table so that we
+			 * can multi-thread the reading of the cache entries
+			 */
+			ieot = read_ieot_extension(mmap, mmap_size,
+						   extension_offset);
+		}
 	}
-	strbuf_release(&previous_name_buf);
+
+	if (ieot) {
+		src_offset += load_cache_entries_threaded(istate, mmap,
+							  mmap_size,
+							  nr_threads, ieot);
+		free(ieot);
+	} else
+#endif
+		src_offset += load_all_cache_entries(istate, mmap, mmap_size,
+						     src_offset);
+
 	istate->timestamp.sec = st.st_mtime;
 	istate->timestamp.nsec = ST_MTIME_NSEC(st);
 
-	while (src_offset <= mmap_size - 20 - 8) {
-		/* After an array of active_nr index entries,
-		 * there can be arbitrary number of extended
-		 * sections, each of which is prefixed with
-		 * extension name (4-byte) and section length
-		 * in 4-byte network byte order.
-		 */
-		uint32_t extsize;
-		memcpy(&extsize, (char *)mmap + src_offset + 4, 4);
-		extsize = ntohl(extsize);
-		if (read_index_extension(istate,
-					 (const char *) mmap + src_offset,
-					 (char *) mmap + src_offset + 8,
-					 extsize) < 0)
-			goto unmap;
-		src_offset += 8;
-		src_offset += extsize;
+	/*
+	 * If we spawned a thread for the extensions, join it; otherwise
+	 * load the extensions on the primary thread.
+	 */
+#ifndef NO_PTHREADS
+	if (extension_offset) {
+		int ret = pthread_join(p.pthread, NULL);
+		if (ret)
+			die("unable to join load_index_extensions thread: %s",
+			    strerror(ret));
+	} else
+#endif
+	{
+		p.src_offset = src_offset;
+		load_index_extensions(&p);
 	}
 	munmap(mmap, mmap_size);
 	return istate->cache_nr;
@@ -1603,6 +1943,28 @@ unmap:
 	die("index file corrupt");
 }
 
+static void tweak_split_index(struct index_state *istate)
+{
+	switch (git_config_get_split_index()) {
+	case -1: /* unset: do nothing */
+		break;
+	case 0: /* false */
+		remove_split_index(istate);
+		break;
+	case 1: /* true */
+		add_split_index(istate);
+		break;
+	default: /* unknown value: do nothing */
+		break;
+	}
+}
+
+static void post_read_index_from(struct index_state *istate)
+{
+	check_ce_order(istate);
+	tweak_split_index(istate);
+}
+
 int read_index_from(struct index_state *istate, const char *path)
 {
 	struct split_index *split_index;
@@ -1612,10 +1974,13 @@ int read_index_from(struct index_state *istate, const char *path)
 	if (istate->initialized)
 		return istate->cache_nr;
 
+	trace_event_region_enter("index", "do_read_index");
 	ret = do_read_index(istate, path, 0);
+	trace_event_region_leave("index", "do_read_index");
+	trace_event_counter_add("index_entries", istate->cache_nr);
 	split_index = istate->split_index;
 	if (!split_index || is_null_sha1(split_index->base_sha1)) {
-		check_ce_order(istate);
+		post_read_index_from(istate);
 		return ret;
 	}
 
@@ -1633,7 +1998,7 @@ int read_index_from(struct index_state *istate, const char *path)
 				     sha1_to_hex(split_index->base_sha1)),
 		    sha1_to_hex(split_index->base->sha1));
 	merge_base_index(istate);
-	check_ce_order(istate);
+	post_read_index_from(istate);
 	return ret;
 }
 
@@ -1653,20 +2018,28 @@ int discard_index(struct index_state *istate)
 		    istate->cache[i]->index <= istate->split_index->base->cache_nr &&
 		    istate->cache[i] == istate->split_index->base->cache[istate->cache[i]->index - 1])
 			continue;
-		free(istate->cache[i]);
+		discard_cache_entry(istate->cache[i]);
 	}
 	resolve_undo_clear_index(istate);
+	free_untracked_cache(istate->untracked);
+	istate->untracked = NULL;
 	istate->cache_nr = 0;
 	istate->cache_changed = 0;
 	istate->timestamp.sec = 0;
 	istate->timestamp.nsec = 0;
 	free_name_hash(istate);
-	cache_tree_free(&(istate->cache_tree));
+	cache_tree_discard(istate);
 	istate->initialized = 0;
 	free(istate->cache);
 	istate->cache = NULL;
 	istate->cache_alloc = 0;
 	discard_split_index(istate);
+	/*
+	 * Entries can be shared across a split index pair in either
+	 * direction, so the pool must not go away before both entry
+	 * lists above have been walked.
+	 */
+	free_entry_pool(istate);
 	return 0;
 }
 
@@ -1681,18 +2054,151 @@ int unmerged_index(const struct index_state *istate)
 }
 
 #define WRITE_BUFFER_SIZE 8192
-static unsigned char write_buffer[WRITE_BUFFER_SIZE];
+static unsigned char default_write_buffer[WRITE_BUFFER_SIZE];
+static unsigned char *write_buffer = default_write_buffer;
 static unsigned long write_buffer_len;
 
+#ifndef NO_PTHREADS
+/*
+ * Overlap index serialization with checksumming.  Filled write
+ * buffers are handed to a dedicated hashing thread; while it runs
+ * SHA-1 over one buffer, the main thread writes that buffer out and
+ * keeps serializing entries into the other one.  The hashing thread
+ * consumes buffers strictly in order, so the resulting checksum is
+ * identical to the synchronous one.
+ */
+struct index_hash_slot {
+	unsigned char buf[WRITE_BUFFER_SIZE];
+	unsigned int len;
+	unsigned int pending;
+};
+
+static struct {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	git_SHA_CTX *ctx;
+	struct index_hash_slot slot[2];
+	unsigned int in, out;
+	unsigned int active;
+	unsigned int stop;
+} index_hasher;
+
+static void *index_hash_thread(void *unused)
+{
+	for (;;) {
+		struct index_hash_slot *slot =
+			&index_hasher.slot[index_hasher.out % 2];
+
+		pthread_mutex_lock(&index_hasher.lock);
+		while (!slot->pending && !index_hasher.stop)
+			pthread_cond_wait(&index_hasher.cond,
+					  &index_hasher.lock);
+		if (!slot->pending) {
+			pthread_mutex_unlock(&index_hasher.lock);
+			break;
+		}
+		pthread_mutex_unlock(&index_hasher.lock);
+
+		git_SHA1_Update(index_hasher.ctx, slot->buf, slot->len);
+
+		pthread_mutex_lock(&index_hasher.lock);
+		slot->pending = 0;
+		index_hasher.out++;
+		pthread_cond_broadcast(&index_hasher.cond);
+		pthread_mutex_unlock(&index_hasher.lock);
+	}
+	return NULL;
+}
+
+static void index_hasher_start(git_SHA_CTX *ctx)
+{
+	if (index_hasher.active)
+		return;
+	memset(index_hasher.slot, 0, sizeof(index_hasher.slot));
+	index_hasher.in = index_hasher.out = 0;
+	index_hasher.stop = 0;
+	index_hasher.ctx = ctx;
+	pthread_mutex_init(&index_hasher.lock, NULL);
+	pthread_cond_init(&index_hasher.cond, NULL);
+	if (pthread_create(&index_hasher.thread, NULL,
+			   index_hash_thread, NULL)) {
+		/* fall back to hashing synchronously */
+		pthread_mutex_destroy(&index_hasher.lock);
+		pthread_cond_destroy(&index_hasher.cond);
+		return;
+	}
+	index_hasher.active = 1;
+	write_buffer = index_hasher.slot[0].buf;
+	write_buffer_len = 0;
+}
+
+/*
+ * Wait for all handed-off buffers to be hashed and reap the thread.
+ * Whatever is left in the current write buffer afterwards is hashed
+ * synchronously by ce_flush().  Safe to call when no thread runs.
+ */
+static void index_hasher_stop(void)
+{
+	if (!index_hasher.active)
+		return;
+	pthread_mutex_lock(&index_hasher.lock);
+	index_hasher.stop = 1;
+	pthread_cond_broadcast(&index_hasher.cond);
+	pthread_mutex_unlock(&index_hasher.lock);
+	pthread_join(index_hasher.thread, NULL);
+	pthread_mutex_destroy(&index_hasher.lock);
+	pthread_cond_destroy(&index_hasher.cond);
+	index_hasher.active = 0;
+}
+#else
+static void index_hasher_start(git_SHA_CTX *ctx)
+{
+}
+
+static void index_hasher_stop(void)
+{
+}
+#endif
+
 static int ce_write_flush(git_SHA_CTX *context, int fd)
 {
 	unsigned int buffered = write_buffer_len;
-	if (buffered) {
-		git_SHA1_Update(context, write_buffer, buffered);
-		if (write_in_full(fd, write_buffer, buffered) != buffered)
+	if (!buffered)
+		return 0;
+#ifndef NO_PTHREADS
+	if (index_hasher.active && context == index_hasher.ctx) {
+		struct index_hash_slot *cur =
+			&index_hasher.slot[index_hasher.in % 2];
+		struct index_hash_slot *next =
+			&index_hasher.slot[(index_hasher.in + 1) % 2];
+
+		cur->len = buffered;
+		pthread_mutex_lock(&index_hasher.lock);
+		cur->pending = 1;
+		pthread_cond_broadcast(&index_hasher.cond);
+		/*
+		 * The buffer being hashed is stable, so we can write
+		 * it out concurrently; only wait for the other buffer
+		 * to be drained before serializing into it.
+		 */
+		while (next->pending)
+			pthread_cond_wait(&index_hasher.cond,
+					  &index_hasher.lock);
+		pthread_mutex_unlock(&index_hasher.lock);
+
+		if (write_in_full(fd, cur->buf, buffered) != buffered)
 			return -1;
+		index_hasher.in++;
+		write_buffer = next->buf;
 		write_buffer_len = 0;
+		return 0;
 	}
+#endif
+	git_SHA1_Update(context, write_buffer, buffered);
+	if (write_in_full(fd, write_buffer, buffered) != buffered)
+		return -1;
+	write_buffer_len = 0;
 	return 0;
 }
 
@@ -1718,18 +2224,31 @@ static int ce_write(git_SHA_CTX *context, int fd, void *data, unsigned int len)
 	return 0;
 }
 
-static int write_index_ext_header(git_SHA_CTX *context, int fd,
-				  unsigned int ext, unsigned int sz)
+static int write_index_ext_header(git_SHA_CTX *context, git_SHA_CTX *eoie_context,
+				  int fd, unsigned int ext, unsigned int sz)
 {
 	ext = htonl(ext);
 	sz = htonl(sz);
+
+	if (eoie_context) {
+		git_SHA1_Update(eoie_context, &ext, 4);
+		git_SHA1_Update(eoie_context, &sz, 4);
+	}
 	return ((ce_write(context, fd, &ext, 4) < 0) ||
 		(ce_write(context, fd, &sz, 4) < 0)) ? -1 : 0;
 }
 
 static int ce_flush(git_SHA_CTX *context, int fd, unsigned char *sha1)
 {
-	unsigned int left = write_buffer_len;
+	unsigned int left;
+	int err = 0;
+
+	/*
+	 * Drain the hashing thread first; whatever it leaves in the
+	 * current write buffer is hashed synchronously below.
+	 */
+	index_hasher_stop();
+	left = write_buffer_len;
 
 	if (left) {
 		write_buffer_len = 0;
@@ -1739,15 +2258,20 @@ static int ce_flush(git_SHA_CTX *context, int fd, unsigned char *sha1)
 	/* Flush first if not enough space for SHA1 signature */
 	if (left + 20 > WRITE_BUFFER_SIZE) {
 		if (write_in_full(fd, write_buffer, left) != left)
-			return -1;
+			err = -1;
 		left = 0;
 	}
 
 	/* Append the SHA1 signature at the end */
-	git_SHA1_Final(write_buffer + left, context);
-	hashcpy(sha1, write_buffer + left);
-	left += 20;
-	return (write_in_full(fd, write_buffer, left) != left) ? -1 : 0;
+	if (!err) {
+		git_SHA1_Final(write_buffer + left, context);
+		hashcpy(sha1, write_buffer + left);
+		left += 20;
+		if (write_in_full(fd, write_buffer, left) != left)
+			err = -1;
+	}
+	write_buffer = default_write_buffer;
+	return err;
 }
 
 static void ce_smudge_racily_clean_entry(struct cache_entry *ce)
@@ -1954,16 +2478,43 @@ void update_index_if_able(struct index_state *istate, struct lock_file *lockfile
 		rollback_lock_file(lockfile);
 }
 
-static int do_write_index(struct index_state *istate, int newfd,
-			  int strip_extensions)
+/*
+ * The EOIE and IEOT extensions exist only to speed up the next reader.
+ * They are written by default only when the user explicitly enabled
+ * threaded index loading, so that index files stay byte-for-byte
+ * identical for everybody else.
+ */
+static int record_eoie(void)
 {
-	git_SHA_CTX c;
+	int val;
+
+	if (!git_config_get_bool("index.recordendofindexentries", &val))
+		return val;
+	return !git_config_get_index_threads(&val) && val != 1;
+}
+
+static int record_ieot(void)
+{
+	int val;
+
+	if (!git_config_get_bool("index.recordoffsettable", &val))
+		return val;
+	return !git_config_get_index_threads(&val) && val != 1;
+}
+
+static int do_write_index_body(struct index_state *istate, int newfd,
+			       int strip_extensions)
+{
+	git_SHA_CTX c, eoie_c;
 	struct cache_header hdr;
 	int i, err, removed, extended, hdr_version;
 	struct cache_entry **cache = istate->cache;
 	int entries = istate->cache_nr;
 	struct stat st;
 	struct strbuf previous_name_buf = STRBUF_INIT, *previous_name;
+	off_t offset, ext_start;
+	int nr, nr_threads, ieot_entries = 1;
+	struct index_entry_offset_table *ieot = NULL;
 
 	for (i = removed = extended = 0; i < entries; i++) {
 		if (cache[i]->ce_flags & CE_REMOVE)
@@ -1994,9 +2545,52 @@ static int do_write_index(struct index_state *istate, int newfd,
 	hdr.hdr_entries = htonl(entries - removed);
 
 	git_SHA1_Init(&c);
+	if (istate->cache_nr >= THREAD_COST)
+		index_hasher_start(&c);
 	if (ce_write(&c, newfd, &hdr, sizeof(hdr)) < 0)
 		return -1;
 
+	if (record_ieot()) {
+		if (git_config_get_index_threads(&nr_threads))
+			nr_threads = 0;
+		if (nr_threads != 1) {
+			int ieot_blocks, cpus;
+
+			/*
+			 * ensure default number of ieot blocks maps evenly to the
+			 * default number of threads that will process them leaving
+			 * room for the thread to load the index extensions.
+			 */
+			if (!nr_threads) {
+				ieot_blocks = istate->cache_nr / THREAD_COST;
+				cpus = online_cpus();
+				if (ieot_blocks > cpus - 1)
+					ieot_blocks = cpus - 1;
+			} else {
+				ieot_blocks = nr_threads;
+				if (ieot_blocks > istate->cache_nr)
+					ieot_blocks = istate->cache_nr;
+			}
+
+			/*
+			 * no reason to write out the IEOT extension if we don't
+			 * have enough blocks to utilize multi-threading
+			 */
+			if (ieot_blocks > 1) {
+				ieot = xcalloc(1, sizeof(struct index_entry_offset_table)
+					       + (ieot_blocks * sizeof(struct index_entry_offset)));
+				ieot_entries = DIV_ROUND_UP(entries, ieot_blocks);
+			}
+		}
+	}
+
+	offset = lseek(newfd, 0, SEEK_CUR);
+	if (offset < 0) {
+		free(ieot);
+		return -1;
+	}
+	offset += write_buffer_len;
+	nr = 0;
 	previous_name = (hdr_version == 4) ? &previous_name_buf : NULL;
 	for (i = 0; i < entries; i++) {
 		struct cache_entry *ce = cache[i];
@@ -2012,20 +2606,76 @@ static int do_write_index(struct index_state *istate, int newfd,
 				allow = git_env_bool("GIT_ALLOW_NULL_SHA1", 0);
 			if (allow)
 				warning(msg, ce->name);
-			else
+			else {
+				free(ieot);
 				return error(msg, ce->name);
+			}
 		}
-		if (ce_write_entry(&c, newfd, ce, previous_name) < 0)
+		if (ieot && i && (i % ieot_entries == 0)) {
+			ieot->entries[ieot->nr].nr = nr;
+			ieot->entries[ieot->nr].offset = offset;
+			ieot->nr++;
+			/*
+			 * If we have a V4 index, set the first byte to an invalid
+			 * character to ensure there is nothing common with the previous
+			 * entry
+			 */
+			if (previous_name)
+				previous_name->buf[0] = 0;
+			nr = 0;
+			offset = lseek(newfd, 0, SEEK_CUR);
+			if (offset < 0) {
+				free(ieot);
+				return -1;
+			}
+			offset += write_buffer_len;
+		}
+		if (ce_write_entry(&c, newfd, ce, previous_name) < 0) {
+			free(ieot);
 			return -1;
+		}
+		nr++;
+	}
+	if (ieot && nr) {
+		ieot->entries[ieot->nr].nr = nr;
+		ieot->entries[ieot->nr].offset = offset;
+		ieot->nr++;
 	}
 	strbuf_release(&previous_name_buf);
 
 	/* Write extension data here */
+	ext_start = lseek(newfd, 0, SEEK_CUR);
+	if (ext_start < 0) {
+		free(ieot);
+		return -1;
+	}
+	ext_start += write_buffer_len;
+	git_SHA1_Init(&eoie_c);
+
+	/*
+	 * Write the index entry offset table first so that a reader only
+	 * has to scan past a minimal number of extension headers to find
+	 * it.  It is written even when strip_extensions is set because the
+	 * shared index of a split index pair holds the bulk of the entries.
+	 */
+	if (ieot) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_ieot_extension(&sb, ieot);
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_INDEXENTRYOFFSETTABLE,
+					     sb.len) < 0
+			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		free(ieot);
+		if (err)
+			return -1;
+	}
 	if (!strip_extensions && istate->split_index) {
 		struct strbuf sb = STRBUF_INIT;
 
 		err = write_link_extension(&sb, istate) < 0 ||
-			write_index_ext_header(&c, newfd, CACHE_EXT_LINK,
+			write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_LINK,
 					       sb.len) < 0 ||
 			ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
@@ -2036,17 +2686,76 @@ static int do_write_index(struct index_state *istate, int newfd,
 		struct strbuf sb = STRBUF_INIT;
 
 		cache_tree_write(&sb, istate->cache_tree);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_TREE, sb.len) < 0
+		err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_TREE, sb.len) < 0
 			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
 		if (err)
 			return -1;
+	} else if (!strip_extensions && istate->cache_tree_data) {
+		/* never looked at; copy the extension through unparsed */
+		err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_TREE,
+					     istate->cache_tree_data_size) < 0
+			|| ce_write(&c, newfd, istate->cache_tree_data,
+				    istate->cache_tree_data_size) < 0;
+		if (err)
+			return -1;
 	}
 	if (!strip_extensions && istate->resolve_undo) {
 		struct strbuf sb = STRBUF_INIT;
 
 		resolve_undo_write(&sb, istate->resolve_undo);
-		err = write_index_ext_header(&c, newfd, CACHE_EXT_RESOLVE_UNDO,
+		err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_RESOLVE_UNDO,
+					     sb.len) < 0
+			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	} else if (!strip_extensions && istate->resolve_undo_data) {
+		/* never looked at; copy the extension through unparsed */
+		err = write_index_ext_header(&c, &eoie_c, newfd,
+					     CACHE_EXT_RESOLVE_UNDO,
+					     istate->resolve_undo_data_size) < 0
+			|| ce_write(&c, newfd, istate->resolve_undo_data,
+				    istate->resolve_undo_data_size) < 0;
+		if (err)
+			return -1;
+	}
+	if (!strip_extensions && istate->untracked) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_untracked_extension(&sb, istate->untracked);
+		err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_UNTRACKED,
+					     sb.len) < 0
+			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
+	if (!strip_extensions && core_fsmonitor) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_fsmonitor_extension(&sb, istate);
+		err = write_index_ext_header(&c, &eoie_c, newfd, CACHE_EXT_FSMONITOR,
+					     sb.len) < 0
+			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
+		strbuf_release(&sb);
+		if (err)
+			return -1;
+	}
+
+	/*
+	 * The end of index entry extension must be written last so that a
+	 * reader can find it by scanning backwards from the trailing hash.
+	 * Skip it when no other extension was written; there would be
+	 * nothing for it to point at.
+	 */
+	if (lseek(newfd, 0, SEEK_CUR) + write_buffer_len != ext_start &&
+	    record_eoie()) {
+		struct strbuf sb = STRBUF_INIT;
+
+		write_eoie_extension(&sb, &eoie_c, ext_start);
+		err = write_index_ext_header(&c, NULL, newfd,
+					     CACHE_EXT_ENDOFINDEXENTRIES,
 					     sb.len) < 0
 			|| ce_write(&c, newfd, sb.buf, sb.len) < 0;
 		strbuf_release(&sb);
@@ -2061,6 +2770,24 @@ static int do_write_index(struct index_state *istate, int newfd,
 	return 0;
 }
 
+static int do_write_index(struct index_state *istate, int newfd,
+			  int strip_extensions)
+{
+	int ret = do_write_index_body(istate, newfd, strip_extensions);
+
+	if (ret) {
+		/*
+		 * The error paths bail out without reaching ce_flush();
+		 * reap the hashing thread and reset the writer state so
+		 * that a later write starts from a clean slate.
+		 */
+		index_hasher_stop();
+		write_buffer = default_write_buffer;
+		write_buffer_len = 0;
+	}
+	return ret;
+}
+
 void set_alternate_index_output(const char *name)
 {
 	alternate_index_output = name;
@@ -2154,6 +2881,38 @@ static int write_shared_index(struct index_state *istate,
 	return ret;
 }
 
+static const int default_max_percent_split_change = 20;
+
+static int too_many_not_shared_entries(struct index_state *istate)
+{
+	int i, not_shared = 0;
+	int max_split = git_config_get_max_percent_split_change();
+
+	switch (max_split) {
+	case -1:
+		/* not or badly set, use default */
+		max_split = default_max_percent_split_change;
+		break;
+	case 0:
+		/* 0% means always write a new shared index */
+		return 1;
+	case 100:
+		/* 100% means never write a new shared index */
+		return 0;
+	default:
+		break; /* just use the configured value */
+	}
+
+	/* Count not shared entries */
+	for (i = 0; i < istate->cache_nr; i++) {
+		struct cache_entry *ce = istate->cache[i];
+		if (!ce->index)
+			not_shared++;
+	}
+
+	return (int64_t)istate->cache_nr * max_split < (int64_t)not_shared * 100;
+}
+
 int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		       unsigned flags)
 {
@@ -2171,6 +2930,8 @@ int write_locked_index(struct index_state *istate, struct lock_file *lock,
 		if ((v & 15) < 6)
 			istate->cache_changed |= SPLIT_INDEX_ORDERED;
 	}
+	if (too_many_not_shared_entries(istate))
+		istate->cache_changed |= SPLIT_INDEX_ORDERED;
 	if (istate->cache_changed & SPLIT_INDEX_ORDERED) {
 		int ret = write_shared_index(istate, lock, flags);
 		if (ret)
@@ -2306,3 +3067,182 @@ void stat_validity_update(struct stat_validity *sv, int fd)
 		fill_stat_data(sv->sd, &st);
 	}
 }
+
+/*
+ * An end of index entry (EOIE) extension:
+ *
+ *  - 32-bit offset to the end of the index entries
+ *
+ *  - 160-bit SHA-1 over the extension types and their sizes (but not
+ *    their contents), from the first extension up to but not including
+ *    this one.
+ *
+ * It is always written out as the last extension so that it can be
+ * found by scanning backwards from the trailing SHA-1.
+ */
+#define EOIE_SIZE (4 + 20)
+#define EOIE_SIZE_WITH_HEADER (4 + 4 + EOIE_SIZE)
+
+#ifndef NO_PTHREADS
+static size_t read_eoie_extension(const char *mmap, size_t mmap_size)
+{
+	const char *index, *eoie;
+	uint32_t extsize;
+	size_t offset, src_offset;
+	unsigned char hash[20];
+	git_SHA_CTX c;
+
+	/* ensure we have an index big enough to contain an EOIE extension */
+	if (mmap_size < sizeof(struct cache_header) + EOIE_SIZE_WITH_HEADER + 20)
+		return 0;
+
+	/* validate the extension signature */
+	index = eoie = mmap + mmap_size - EOIE_SIZE_WITH_HEADER - 20;
+	if (CACHE_EXT(index) != CACHE_EXT_ENDOFINDEXENTRIES)
+		return 0;
+	index += sizeof(uint32_t);
+
+	/* validate the extension size */
+	extsize = get_be32(index);
+	if (extsize != EOIE_SIZE)
+		return 0;
+	index += sizeof(uint32_t);
+
+	/*
+	 * Validate the offset we're going to look for the first extension
+	 * signature is after the index header and before the eoie extension.
+	 */
+	offset = get_be32(index);
+	if (mmap + offset < mmap + sizeof(struct cache_header))
+		return 0;
+	if (mmap + offset >= eoie)
+		return 0;
+	index += sizeof(uint32_t);
+
+	/*
+	 * The hash is computed over extension types and their sizes (but not
+	 * their contents).  E.g. if we have "TREE" extension that is N-bytes
+	 * long, "REUC" extension that is M-bytes long, followed by "EOIE",
+	 * then the hash would be:
+	 *
+	 * SHA-1("TREE" + <binary representation of N> +
+	 *	 "REUC" + <binary representation of M>)
+	 */
+	src_offset = offset;
+	git_SHA1_Init(&c);
+	while (src_offset < mmap_size - 20 - EOIE_SIZE_WITH_HEADER) {
+		/* After an array of active_nr index entries,
+		 * there can be arbitrary number of extended
+		 * sections, each of which is prefixed with
+		 * extension name (4-byte) and section length
+		 * in 4-byte network byte order.
+		 */
+		uint32_t size;
+		memcpy(&size, mmap + src_offset + 4, 4);
+
+		/* hash the 4-byte extension name and 4-byte size */
+		git_SHA1_Update(&c, mmap + src_offset, 8);
+
+		src_offset += 8;
+		src_offset += ntohl(size);
+	}
+	git_SHA1_Final(hash, &c);
+	if (hashcmp(hash, (const unsigned char *)index))
+		return 0;
+
+	/* Validate that the extension offsets returned us back to the eoie extension. */
+	if (src_offset != mmap_size - 20 - EOIE_SIZE_WITH_HEADER)
+		return 0;
+
+	return offset;
+}
+#endif
+
+static void write_eoie_extension(struct strbuf *sb, git_SHA_CTX *eoie_context, size_t offset)
+{
+	uint32_t buffer;
+	unsigned char hash[20];
+
+	/* offset */
+	put_be32(&buffer, offset);
+	strbuf_add(sb, &buffer, sizeof(uint32_t));
+
+	/* hash */
+	git_SHA1_Final(hash, eoie_context);
+	strbuf_add(sb, hash, 20);
+}
+
+#define IEOT_VERSION	(1)
+
+#ifndef NO_PTHREADS
+static struct index_entry_offset_table *read_ieot_extension(const char *mmap, size_t mmap_size, size_t offset)
+{
+	const char *index = NULL;
+	uint32_t extsize, ext_version;
+	struct index_entry_offset_table *ieot;
+	int i, nr;
+
+	/* find the IEOT extension */
+	if (!offset)
+		return NULL;
+	while (offset <= mmap_size - 20 - 8) {
+		memcpy(&extsize, mmap + offset + 4, 4);
+		extsize = ntohl(extsize);
+		if (CACHE_EXT((mmap + offset)) == CACHE_EXT_INDEXENTRYOFFSETTABLE) {
+			index = mmap + offset + 4 + 4;
+			break;
+		}
+		offset += 8;
+		offset += extsize;
+	}
+	if (!index)
+		return NULL;
+
+	/* validate the version is IEOT_VERSION */
+	ext_version = get_be32(index);
+	if (ext_version != IEOT_VERSION) {
+		error("invalid IEOT version %d", ext_version);
+		return NULL;
+	}
+	index += sizeof(uint32_t);
+
+	/* extension size - version bytes / bytes per entry */
+	nr = (extsize - sizeof(uint32_t)) / (sizeof(uint32_t) + sizeof(uint32_t));
+	if (!nr) {
+		error("invalid number of IEOT entries %d", nr);
+		return NULL;
+	}
+	ieot = xmalloc(sizeof(struct index_entry_offset_table)
+		       + (nr * sizeof(struct index_entry_offset)));
+	ieot->nr = nr;
+	for (i = 0; i < nr; i++) {
+		ieot->entries[i].offset = get_be32(index);
+		index += sizeof(uint32_t);
+		ieot->entries[i].nr = get_be32(index);
+		index += sizeof(uint32_t);
+	}
+
+	return ieot;
+}
+#endif
+
+static void write_ieot_extension(struct strbuf *sb, struct index_entry_offset_table *ieot)
+{
+	uint32_t buffer;
+	int i;
+
+	/* version */
+	put_be32(&buffer, IEOT_VERSION);
+	strbuf_add(sb, &buffer, sizeof(uint32_t));
+
+	/* ieot */
+	for (i = 0; i < ieot->nr; i++) {
+		/* offset */
+		put_be32(&buffer, ieot->entries[i].offset);
+		strbuf_add(sb, &buffer, sizeof(uint32_t));
+
+		/* count */
+		put_be32(&buffer, ieot->entries[i].nr);
+		strbuf_add(sb, &buffer, sizeof(uint32_t));
+	}
+}
@@ -1,10 +1,13 @@
 #include "cache.h"
 #include "lockfile.h"
+#include "mem-pool.h"
+#include "trace-event.h"
 #include "refs.h"
 #include "object.h"
 #include "tag.h"
 #include "dir.h"
 #include "string-list.h"
+#include "object-info-server.h"
 
 struct ref_lock {
 	char *ref_name;
@@ -334,6 +337,22 @@ static int refname_is_safe(const char *refname)
 	return 1;
 }
 
+/*
+ * All ref_entry structs come out of one process-lifetime pool; like
+ * the object allocator in alloc.c, individual entries are never given
+ * back to the system.  Dropping a ref cache only frees the entries[]
+ * arrays of its directories; the entries themselves are retained
+ * until exit, which is cheap since caches are rarely invalidated.
+ */
+static struct mem_pool ref_entry_pool;
+
+static void *alloc_ref_entry(size_t size)
+{
+	if (!ref_entry_pool.block_alloc)
+		mem_pool_init(&ref_entry_pool, 16 * 1024);
+	return mem_pool_alloc(&ref_entry_pool, size);
+}
+
 static struct ref_entry *create_ref_entry(const char *refname,
 					  const unsigned char *sha1, int flag,
 					  int check_name)
@@ -347,7 +366,7 @@ static struct ref_entry *create_ref_entry(const char *refname,
 	if (!check_name && !refname_is_safe(refname))
 		die("Reference has invalid name: '%s'", refname);
 	len = strlen(refname) + 1;
-	ref = xmalloc(sizeof(struct ref_entry) + len);
+	ref = alloc_ref_entry(sizeof(struct ref_entry) + len);
 	hashcpy(ref->u.value.sha1, sha1);
 	hashclr(ref->u.value.peeled);
 	memcpy(ref->name, refname, len);
@@ -366,7 +385,7 @@ static void free_ref_entry(struct ref_entry *entry)
 		 */
 		clear_ref_dir(&entry->u.subdir);
 	}
-	free(entry);
+	/* the entry itself belongs to ref_entry_pool */
 }
 
 /*
@@ -409,7 +428,8 @@ static struct ref_entry *create_dir_entry(struct ref_cache *ref_cache,
 					  int incomplete)
 {
 	struct ref_entry *direntry;
-	direntry = xcalloc(1, sizeof(struct ref_entry) + len + 1);
+	direntry = alloc_ref_entry(sizeof(struct ref_entry) + len + 1);
+	memset(direntry, 0, sizeof(struct ref_entry) + len + 1);
 	memcpy(direntry->name, dirname, len);
 	direntry->name[len] = '\0';
 	direntry->u.subdir.ref_cache = ref_cache;
@@ -959,8 +979,48 @@ static int is_refname_available(const char *refname,
 }
 
 struct packed_ref_cache {
+	/*
+	 * The ref_cache that this packed_ref_cache belongs to (needed
+	 * when lazily creating the root ref_dir).
+	 */
+	struct ref_cache *refs;
+
+	/*
+	 * The entries from the packed-refs file, parsed into a ref_dir,
+	 * or NULL if they have not been needed in their entirety yet.
+	 * Single-reference lookups and prefix iterations are answered
+	 * directly from the mmapped file when it is sorted, so that we
+	 * do not pay for parsing refs we never look at.
+	 */
 	struct ref_entry *root;
 
+	/*
+	 * The contents of the packed-refs file, mmapped into memory, or
+	 * NULL if the file was missing or empty.
+	 */
+	char *buf;
+	size_t size;
+
+	/* The first byte in buf following the header line, if any. */
+	const char *start;
+
+	/* Which references in the file have peeled values (see below). */
+	enum { PEELED_NONE, PEELED_TAGS, PEELED_FULLY } peeled;
+
+	/*
+	 * True if the header declared the "sorted" trait, i.e. the
+	 * references appear in strcmp() order and buf can be binary
+	 * searched directly.
+	 */
+	int sorted;
+
+	/*
+	 * Scratch entry handed out by lookups that were answered from
+	 * buf without populating root.  Valid only until the next such
+	 * lookup.
+	 */
+	struct ref_entry *lookup_entry;
+
 	/*
 	 * Count of references to the data structure in this instance,
 	 * including the pointer from ref_cache::packed if any.  The
@@ -1016,7 +1076,12 @@ static void acquire_packed_ref_cache(struct packed_ref_cache *packed_refs)
 static int release_packed_ref_cache(struct packed_ref_cache *packed_refs)
 {
 	if (!--packed_refs->referrers) {
-		free_ref_entry(packed_refs->root);
+		if (packed_refs->root)
+			free_ref_entry(packed_refs->root);
+		if (packed_refs->lookup_entry)
+			free_ref_entry(packed_refs->lookup_entry);
+		if (packed_refs->buf)
+			munmap(packed_refs->buf, packed_refs->size);
 		stat_validity_clear(&packed_refs->validity);
 		free(packed_refs);
 		return 1;
@@ -1045,6 +1110,12 @@ static void clear_loose_ref_cache(struct ref_cache *refs)
 	}
 }
 
+void invalidate_cached_refs(void)
+{
+	clear_packed_ref_cache(&ref_cache);
+	clear_loose_ref_cache(&ref_cache);
+}
+
 static struct ref_cache *create_ref_cache(const char *submodule)
 {
 	int len;
@@ -1088,7 +1159,7 @@ static struct ref_cache *get_ref_cache(const char *submodule)
  * traits will be added later.  The trailing space is required.
  */
 static const char PACKED_REFS_HEADER[] =
-	"# pack-refs with: peeled fully-peeled \n";
+	"# pack-refs with: peeled fully-peeled sorted \n";
 
 /*
  * Parse one line from a packed-refs file.  Write the SHA1 to sha1.
@@ -1127,7 +1198,8 @@ static const char *parse_ref_line(struct strbuf *line, unsigned char *sha1)
 }
 
 /*
- * Read f, which is a packed-refs file, into dir.
+ * Mmap the packed-refs file at path into cache and parse its header
+ * line, if any.
  *
  * A comment line of the form "# pack-refs with: " may contain zero or
  * more traits. We interpret the traits as follows:
@@ -1152,38 +1224,92 @@ static const char *parse_ref_line(struct strbuf *line, unsigned char *sha1)
  *      trait should typically be written alongside "peeled" for
  *      compatibility with older clients, but we do not require it
  *      (i.e., "peeled" is a no-op if "fully-peeled" is set).
+ *
+ *   sorted:
+ *
+ *      The references are written in strcmp() order of their names, so
+ *      single references can be found by binary searching the file
+ *      directly instead of parsing it in its entirety.
  */
-static void read_packed_refs(FILE *f, struct ref_dir *dir)
+static void load_packed_refs_file(struct packed_ref_cache *cache,
+				  const char *packed_refs_file)
 {
-	struct ref_entry *last = NULL;
-	struct strbuf line = STRBUF_INIT;
-	enum { PEELED_NONE, PEELED_TAGS, PEELED_FULLY } peeled = PEELED_NONE;
+	int fd;
+	struct stat st;
 
-	while (strbuf_getwholeline(&line, f, '\n') != EOF) {
-		unsigned char sha1[20];
-		const char *refname;
+	fd = open(packed_refs_file, O_RDONLY);
+	if (fd < 0)
+		return; /* treat a missing file as empty */
+	if (fstat(fd, &st) < 0)
+		die_errno("couldn't stat %s", packed_refs_file);
+	stat_validity_update(&cache->validity, fd);
+	cache->size = xsize_t(st.st_size);
+	if (cache->size)
+		cache->buf = xmmap(NULL, cache->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	cache->start = cache->buf;
+	if (cache->size) {
+		const char *eol = memchr(cache->buf, '\n', cache->size);
+		struct strbuf line = STRBUF_INIT;
 		const char *traits;
 
+		if (!eol)
+			eol = cache->buf + cache->size - 1; /* no final newline */
+		strbuf_add(&line, cache->buf, eol - cache->buf);
 		if (skip_prefix(line.buf, "# pack-refs with:", &traits)) {
 			if (strstr(traits, " fully-peeled "))
-				peeled = PEELED_FULLY;
+				cache->peeled = PEELED_FULLY;
 			else if (strstr(traits, " peeled "))
-				peeled = PEELED_TAGS;
+				cache->peeled = PEELED_TAGS;
+			if (strstr(traits, " sorted "))
+				cache->sorted = 1;
 			/* perhaps other traits later as well */
-			continue;
+			cache->start = eol + 1;
 		}
+		strbuf_release(&line);
+	}
+}
+
+/*
+ * Parse the packed-refs records starting at pos (which must be the
+ * start of a reference line within cache->buf) into dir.  If prefix is
+ * non-empty, stop at the first reference whose name does not start
+ * with prefix; since the interesting records of a sorted file are
+ * contiguous, this reads only the relevant part of the file.
+ */
+static void read_packed_refs(struct packed_ref_cache *cache,
+			     struct ref_dir *dir,
+			     const char *pos, const char *prefix)
+{
+	const char *eof = cache->buf + cache->size;
+	struct ref_entry *last = NULL;
+	struct strbuf line = STRBUF_INIT;
+
+	while (pos < eof) {
+		const char *eol = memchr(pos, '\n', eof - pos);
+		unsigned char sha1[20];
+		const char *refname;
+
+		strbuf_reset(&line);
+		strbuf_add(&line, pos, (eol ? eol : eof) - pos);
+		strbuf_addch(&line, '\n');
+		pos = eol ? eol + 1 : eof;
 
 		refname = parse_ref_line(&line, sha1);
 		if (refname) {
 			int flag = REF_ISPACKED;
 
+			if (*prefix && !starts_with(refname, prefix))
+				break;
 			if (check_refname_format(refname, REFNAME_ALLOW_ONELEVEL)) {
 				hashclr(sha1);
 				flag |= REF_BAD_NAME | REF_ISBROKEN;
 			}
 			last = create_ref_entry(refname, sha1, flag, 0);
-			if (peeled == PEELED_FULLY ||
-			    (peeled == PEELED_TAGS && starts_with(refname, "refs/tags/")))
+			if (cache->peeled == PEELED_FULLY ||
+			    (cache->peeled == PEELED_TAGS &&
+			     starts_with(refname, "refs/tags/")))
 				last->flag |= REF_KNOWS_PEELED;
 			add_ref(dir, last);
 			continue;
@@ -1206,6 +1332,150 @@ static void read_packed_refs(FILE *f, struct ref_dir *dir)
 	strbuf_release(&line);
 }
 
+/*
+ * Compare the name of the reference record at rec ("<sha1> <refname>\n")
+ * against refname, returning less than, equal to, or greater than zero
+ * in strcmp() fashion.  eof limits how far the record may extend.
+ */
+static int cmp_packed_record(const char *rec, const char *eof,
+			     const char *refname)
+{
+	const char *p = rec + 41;
+
+	while (p < eof && *p != '\n' && *refname) {
+		if (*p != *refname)
+			return (unsigned char)*p - (unsigned char)*refname;
+		p++;
+		refname++;
+	}
+	if (p < eof && *p != '\n')
+		return 1; /* record name is longer */
+	return *refname ? -1 : 0;
+}
+
+/*
+ * Back up from pos (which may point into the middle of a record) to
+ * the start of the record containing it, skipping over a peeled "^"
+ * line onto the reference line that owns it.  lo must be the start of
+ * a reference record at or before pos.
+ */
+static const char *find_start_of_record(const char *lo, const char *pos)
+{
+	while (pos > lo && pos[-1] != '\n')
+		pos--;
+	if (pos > lo && *pos == '^') {
+		pos--;
+		while (pos > lo && pos[-1] != '\n')
+			pos--;
+	}
+	return pos;
+}
+
+/*
+ * Return a pointer just past the record starting at rec (including any
+ * peeled "^" line that follows it), capped at eof.
+ */
+static const char *find_end_of_record(const char *rec, const char *eof)
+{
+	const char *eol = memchr(rec, '\n', eof - rec);
+
+	rec = eol ? eol + 1 : eof;
+	if (rec < eof && *rec == '^') {
+		eol = memchr(rec, '\n', eof - rec);
+		rec = eol ? eol + 1 : eof;
+	}
+	return rec;
+}
+
+/*
+ * Binary search a sorted packed-refs file for refname.  Return a
+ * pointer to the start of its record, or NULL if it is not present.
+ */
+static const char *find_packed_ref_record(struct packed_ref_cache *cache,
+					  const char *refname)
+{
+	const char *lo = cache->start;
+	const char *hi = cache->buf + cache->size;
+
+	while (lo < hi) {
+		const char *rec = find_start_of_record(lo, lo + (hi - lo) / 2);
+		int cmp = cmp_packed_record(rec, hi, refname);
+
+		if (!cmp)
+			return rec;
+		else if (cmp < 0)
+			lo = find_end_of_record(rec, hi);
+		else
+			hi = rec;
+	}
+	return NULL;
+}
+
+/*
+ * Binary search a sorted packed-refs file for the first record whose
+ * refname is greater than or equal to prefix; all references starting
+ * with prefix follow contiguously from there.
+ */
+static const char *find_packed_prefix_start(struct packed_ref_cache *cache,
+					    const char *prefix)
+{
+	const char *lo = cache->start;
+	const char *hi = cache->buf + cache->size;
+	const char *eof = hi;
+
+	while (lo < hi) {
+		const char *rec = find_start_of_record(lo, lo + (hi - lo) / 2);
+
+		if (cmp_packed_record(rec, eof, prefix) < 0)
+			lo = find_end_of_record(rec, eof);
+		else
+			hi = rec;
+	}
+	return lo;
+}
+
+/*
+ * Create a ref_entry for the record at rec, which must point at a
+ * reference line within cache->buf.
+ */
+static struct ref_entry *packed_ref_from_record(struct packed_ref_cache *cache,
+						const char *rec)
+{
+	const char *eof = cache->buf + cache->size;
+	unsigned char sha1[20];
+	struct strbuf name = STRBUF_INIT;
+	struct ref_entry *entry;
+	const char *p, *eol;
+	int flag = REF_ISPACKED;
+
+	if (rec + 41 >= eof || get_sha1_hex(rec, sha1) || !isspace(rec[40]))
+		return NULL;
+	p = rec + 41;
+	eol = memchr(p, '\n', eof - p);
+	if (!eol)
+		eol = eof;
+	strbuf_add(&name, p, eol - p);
+	if (check_refname_format(name.buf, REFNAME_ALLOW_ONELEVEL)) {
+		hashclr(sha1);
+		flag |= REF_BAD_NAME | REF_ISBROKEN;
+	}
+	entry = create_ref_entry(name.buf, sha1, flag, 0);
+	if (cache->peeled == PEELED_FULLY ||
+	    (cache->peeled == PEELED_TAGS && starts_with(name.buf, "refs/tags/")))
+		entry->flag |= REF_KNOWS_PEELED;
+	strbuf_release(&name);
+
+	p = eol < eof ? eol + 1 : eof;
+	if (p < eof && *p == '^' &&
+	    p + PEELED_LINE_LENGTH <= eof &&
+	    p[PEELED_LINE_LENGTH - 1] == '\n' &&
+	    !get_sha1_hex(p + 1, sha1)) {
+		hashcpy(entry->u.value.peeled, sha1);
+		entry->flag |= REF_KNOWS_PEELED;
+	}
+	return entry;
+}
+
 /*
  * Get the packed_ref_cache for the specified ref_cache, creating it
  * if necessary.
@@ -1224,23 +1494,23 @@ static struct packed_ref_cache *get_packed_ref_cache(struct ref_cache *refs)
 		clear_packed_ref_cache(refs);
 
 	if (!refs->packed) {
-		FILE *f;
-
 		refs->packed = xcalloc(1, sizeof(*refs->packed));
 		acquire_packed_ref_cache(refs->packed);
-		refs->packed->root = create_dir_entry(refs, "", 0, 0);
-		f = fopen(packed_refs_file, "r");
-		if (f) {
-			stat_validity_update(&refs->packed->validity, fileno(f));
-			read_packed_refs(f, get_ref_dir(refs->packed->root));
-			fclose(f);
-		}
+		refs->packed->refs = refs;
+		load_packed_refs_file(refs->packed, packed_refs_file);
 	}
 	return refs->packed;
 }
 
 static struct ref_dir *get_packed_ref_dir(struct packed_ref_cache *packed_ref_cache)
 {
+	if (!packed_ref_cache->root) {
+		packed_ref_cache->root =
+			create_dir_entry(packed_ref_cache->refs, "", 0, 0);
+		read_packed_refs(packed_ref_cache,
+				 get_ref_dir(packed_ref_cache->root),
+				 packed_ref_cache->start, "");
+	}
 	return get_ref_dir(packed_ref_cache->root);
 }
 
@@ -1439,7 +1709,30 @@ int resolve_gitlink_ref(const char *path, const char *refname, unsigned char *sh
  */
 static struct ref_entry *get_packed_ref(const char *refname)
 {
-	return find_ref(get_packed_refs(&ref_cache), refname);
+	struct packed_ref_cache *packed_ref_cache =
+		get_packed_ref_cache(&ref_cache);
+
+	if (!packed_ref_cache->root && packed_ref_cache->sorted) {
+		/*
+		 * Answer the lookup by binary searching the mmapped
+		 * file, so that a single-reference lookup does not pay
+		 * for parsing every packed ref.
+		 */
+		const char *rec = find_packed_ref_record(packed_ref_cache,
+							 refname);
+
+		if (packed_ref_cache->lookup_entry) {
+			free_ref_entry(packed_ref_cache->lookup_entry);
+			packed_ref_cache->lookup_entry = NULL;
+		}
+		if (!rec)
+			return NULL;
+		packed_ref_cache->lookup_entry =
+			packed_ref_from_record(packed_ref_cache, rec);
+		return packed_ref_cache->lookup_entry;
+	}
+
+	return find_ref(get_packed_ref_dir(packed_ref_cache), refname);
 }
 
 /*
@@ -1657,6 +1950,13 @@ struct ref_filter {
 
 int read_ref_full(const char *refname, int resolve_flags, unsigned char *sha1, int *flags)
 {
+	/*
+	 * A configured object info server can resolve the ref without
+	 * us reading packed-refs; it cannot report the ref's flags, so
+	 * only plain sha1 queries are eligible.
+	 */
+	if (!flags && !info_server_resolve_ref(refname, resolve_flags, sha1))
+		return 0;
 	if (resolve_ref_unsafe(refname, resolve_flags, sha1, flags))
 		return 0;
 	return -1;
@@ -1716,8 +2016,13 @@ enum peel_status {
  */
 static enum peel_status peel_object(const unsigned char *name, unsigned char *sha1)
 {
-	struct object *o = lookup_unknown_object(name);
+	struct object *o;
+
+	/* A tag that has been peeled before need not be inflated again. */
+	if (!lookup_tag_target(name, sha1))
+		return PEEL_PEELED;
 
+	o = lookup_unknown_object(name);
 	if (o->type == OBJ_NONE) {
 		int type = sha1_object_info(name, NULL);
 		if (type < 0 || !object_as_type(o, type, 0))
@@ -1755,8 +2060,16 @@ static enum peel_status peel_entry(struct ref_entry *entry, int repeel)
 			entry->flag &= ~REF_KNOWS_PEELED;
 			hashclr(entry->u.value.peeled);
 		} else {
-			return is_null_sha1(entry->u.value.peeled) ?
-				PEEL_NON_TAG : PEEL_PEELED;
+			if (is_null_sha1(entry->u.value.peeled))
+				return PEEL_NON_TAG;
+			/*
+			 * Seed the tag-target memo from the persisted
+			 * hint, so peeling the same tag through another
+			 * (e.g. loose) ref does not inflate it either.
+			 */
+			record_tag_target(entry->u.value.sha1,
+					  entry->u.value.peeled);
+			return PEEL_PEELED;
 		}
 	}
 	if (entry->flag & REF_ISBROKEN)
@@ -1870,6 +2183,7 @@ static int do_for_each_entry(struct ref_cache *refs, const char *base,
 			     each_ref_entry_fn fn, void *cb_data)
 {
 	struct packed_ref_cache *packed_ref_cache;
+	struct ref_entry *packed_base = NULL;
 	struct ref_dir *loose_dir;
 	struct ref_dir *packed_dir;
 	int retval = 0;
@@ -1891,9 +2205,24 @@ static int do_for_each_entry(struct ref_cache *refs, const char *base,
 
 	packed_ref_cache = get_packed_ref_cache(refs);
 	acquire_packed_ref_cache(packed_ref_cache);
-	packed_dir = get_packed_ref_dir(packed_ref_cache);
-	if (base && *base) {
-		packed_dir = find_containing_dir(packed_dir, base, 0);
+	if (base && *base &&
+	    !packed_ref_cache->root && packed_ref_cache->sorted) {
+		/*
+		 * The records for refs under base occupy a contiguous
+		 * range of the sorted file; parse only that range
+		 * instead of materializing the whole file.
+		 */
+		packed_base = create_dir_entry(refs, "", 0, 0);
+		read_packed_refs(packed_ref_cache, get_ref_dir(packed_base),
+				 find_packed_prefix_start(packed_ref_cache, base),
+				 base);
+		packed_dir = find_containing_dir(get_ref_dir(packed_base),
+						 base, 0);
+	} else {
+		packed_dir = get_packed_ref_dir(packed_ref_cache);
+		if (base && *base) {
+			packed_dir = find_containing_dir(packed_dir, base, 0);
+		}
 	}
 
 	if (packed_dir && loose_dir) {
@@ -1911,6 +2240,8 @@ static int do_for_each_entry(struct ref_cache *refs, const char *base,
 				loose_dir, 0, fn, cb_data);
 	}
 
+	if (packed_base)
+		free_ref_entry(packed_base);
 	release_packed_ref_cache(packed_ref_cache);
 	return retval;
 }
@@ -1927,6 +2258,7 @@ static int do_for_each_entry(struct ref_cache *refs, const char *base,
 static int do_for_each_ref(struct ref_cache *refs, const char *base,
 			   each_ref_fn fn, int trim, int flags, void *cb_data)
 {
+	int retval;
 	struct ref_entry_cb data;
 	data.base = base;
 	data.trim = trim;
@@ -1939,7 +2271,10 @@ static int do_for_each_ref(struct ref_cache *refs, const char *base,
 	if (ref_paranoia)
 		data.flags |= DO_FOR_EACH_INCLUDE_BROKEN;
 
-	return do_for_each_entry(refs, base, do_one_ref, &data);
+	trace_event_region_enter("refs", "iterate");
+	retval = do_for_each_entry(refs, base, do_one_ref, &data);
+	trace_event_region_leave("refs", "iterate");
+	return retval;
 }
 
 static int do_head_ref(const char *submodule, each_ref_fn fn, void *cb_data)
@@ -1985,6 +2320,11 @@ int for_each_ref_in(const char *prefix, each_ref_fn fn, void *cb_data)
 	return do_for_each_ref(&ref_cache, prefix, fn, strlen(prefix), 0, cb_data);
 }
 
+int for_each_fullref_in(const char *prefix, each_ref_fn fn, void *cb_data)
+{
+	return do_for_each_ref(&ref_cache, prefix, fn, 0, 0, cb_data);
+}
+
 int for_each_ref_in_submodule(const char *submodule, const char *prefix,
 		each_ref_fn fn, void *cb_data)
 {
@@ -2092,6 +2432,12 @@ int for_each_rawref(each_ref_fn fn, void *cb_data)
 			       DO_FOR_EACH_INCLUDE_BROKEN, cb_data);
 }
 
+int for_each_rawref_in(const char *prefix, each_ref_fn fn, void *cb_data)
+{
+	return do_for_each_ref(&ref_cache, prefix, fn, 0,
+			       DO_FOR_EACH_INCLUDE_BROKEN, cb_data);
+}
+
 const char *prettify_refname(const char *name)
 {
 	return name + (
@@ -2125,6 +2471,23 @@ int refname_match(const char *abbrev_name, const char *full_name)
 	return 0;
 }
 
+int refname_expand(const char *abbrev_name,
+		   int (*fn)(const char *full_name, void *cb_data),
+		   void *cb_data)
+{
+	const char **p;
+	const int abbrev_name_len = strlen(abbrev_name);
+	int ret;
+
+	for (p = ref_rev_parse_rules; *p; p++) {
+		ret = fn(mkpath(*p, abbrev_name_len, abbrev_name), cb_data);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
 static void unlock_ref(struct ref_lock *lock)
 {
 	/* Do not free lock->lk -- atexit() still looks at them */
@@ -3719,6 +4082,292 @@ static int ref_update_reject_duplicates(struct ref_update **updates, int n,
 	return 0;
 }
 
+/*
+ * The minimum number of updates in a transaction before we try to
+ * carry them all out with a single rewrite of the packed-refs file
+ * instead of one loose-ref lock/rename cycle per update.  Configured
+ * via refs.packedTransactionThreshold; zero disables the optimization.
+ */
+static int packed_transaction_threshold = -1;
+
+/*
+ * Return true if every update in the transaction is a plain creation
+ * or value update of a reference under "refs/", i.e. nothing that
+ * needs the loose-ref machinery (deletions, symref handling, HEAD and
+ * other pseudorefs).
+ */
+static int transaction_is_packable(struct ref_update **updates, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		unsigned int flags = updates[i]->flags;
+
+		if (!(flags & REF_HAVE_NEW) || is_null_sha1(updates[i]->new_sha1))
+			return 0;
+		if (flags & (REF_NODEREF | REF_DELETING | REF_ISPRUNING))
+			return 0;
+		if (!starts_with(updates[i]->refname, "refs/"))
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Try to commit the (sorted, duplicate-free) updates with a single
+ * atomic rewrite of the packed-refs file.  Return 0 on success, a
+ * TRANSACTION_* error (with a message appended to err) on failure, or
+ * 1 if the transaction cannot be applied this way -- e.g. because one
+ * of the references also exists in its loose form, which would hide
+ * whatever we write to the packed storage -- and the caller should
+ * fall back to the per-reference path.  No reference has been
+ * modified unless 0 is returned.
+ */
+static int commit_packed_transaction(struct ref_update **updates, int n,
+				     struct strbuf *err)
+{
+	struct ref_dir *packed;
+	unsigned char (*old_values)[20];
+	int i, ret = 0;
+
+	if (lock_packed_refs(0)) {
+		unable_to_lock_message(git_path("packed-refs"), errno, err);
+		return TRANSACTION_GENERIC_ERROR;
+	}
+	packed = get_packed_refs(&ref_cache);
+
+	for (i = 0; i < n; i++) {
+		char path[PATH_MAX];
+		struct stat st;
+
+		git_snpath(path, sizeof(path), "%s", updates[i]->refname);
+		if (!lstat(path, &st) || errno != ENOENT) {
+			rollback_packed_refs();
+			return 1;
+		}
+	}
+
+	/*
+	 * Verify the expected old values against the packed storage
+	 * before modifying anything, so that a failed transaction
+	 * leaves every reference untouched.
+	 */
+	old_values = xmalloc(n * sizeof(*old_values));
+	for (i = 0; i < n; i++) {
+		struct ref_update *update = updates[i];
+		struct ref_entry *entry = find_ref(packed, update->refname);
+
+		if (entry)
+			hashcpy(old_values[i], entry->u.value.sha1);
+		else
+			hashclr(old_values[i]);
+		if ((update->flags & REF_HAVE_OLD) &&
+		    hashcmp(update->old_sha1, old_values[i])) {
+			strbuf_addf(err, "Cannot lock the ref '%s'.",
+				    update->refname);
+			ret = TRANSACTION_GENERIC_ERROR;
+			goto rollback;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		struct ref_update *update = updates[i];
+		struct ref_entry *entry = find_ref(packed, update->refname);
+
+		if (entry) {
+			hashcpy(entry->u.value.sha1, update->new_sha1);
+			hashclr(entry->u.value.peeled);
+			entry->flag &= ~REF_KNOWS_PEELED;
+		} else {
+			if (!is_refname_available(update->refname, NULL,
+						  packed)) {
+				strbuf_addf(err, "Cannot lock the ref '%s'.",
+					    update->refname);
+				ret = TRANSACTION_NAME_CONFLICT;
+				goto rollback;
+			}
+			add_packed_ref(update->refname, update->new_sha1);
+		}
+	}
+
+	if (commit_packed_refs()) {
+		strbuf_addf(err, "unable to overwrite old ref-pack file: %s",
+			    strerror(errno));
+		free(old_values);
+		return TRANSACTION_GENERIC_ERROR;
+	}
+
+	/* Reflogs, for the (rare) refs that have one: */
+	for (i = 0; i < n; i++)
+		log_ref_write(updates[i]->refname, old_values[i],
+			      updates[i]->new_sha1, updates[i]->msg);
+
+	free(old_values);
+	return 0;
+
+rollback:
+	rollback_packed_refs();
+	free(old_values);
+	return ret;
+}
+
+/*
+ * Verify the expected old values of a large transaction against one
+ * snapshot of the involved parts of the ref store, so that a doomed
+ * transaction fails after a single pass over the refs instead of
+ * locking its way to the mismatch.  The loose refs below each
+ * distinct directory involved are read in one scan, and the
+ * packed-refs file is loaded at most once.  The locks taken later
+ * remain authoritative; this pass can only reject early, never
+ * approve.  Returns 0 if no mismatch was found, -1 (with a message
+ * appended to err) otherwise.
+ */
+static int verify_old_values_quick(struct ref_update **updates, int n,
+				   struct strbuf *err)
+{
+	struct ref_dir *loose = get_loose_refs(&ref_cache);
+	struct string_list prefixes = STRING_LIST_INIT_DUP;
+	int i;
+
+	/* One readdir pass over each directory involved: */
+	for (i = 0; i < n; i++) {
+		const char *slash = strrchr(updates[i]->refname, '/');
+		char *prefix;
+		struct ref_dir *dir;
+
+		if (!slash)
+			continue;
+		prefix = xmemdupz(updates[i]->refname,
+				  slash - updates[i]->refname + 1);
+		if (string_list_has_string(&prefixes, prefix)) {
+			free(prefix);
+			continue;
+		}
+		string_list_insert(&prefixes, prefix);
+		dir = find_containing_dir(loose, prefix, 0);
+		if (dir)
+			prime_ref_dir(dir);
+		free(prefix);
+	}
+	string_list_clear(&prefixes, 0);
+
+	for (i = 0; i < n; i++) {
+		struct ref_update *update = updates[i];
+		struct ref_entry *entry;
+		const unsigned char *current = NULL;
+
+		if (!(update->flags & REF_HAVE_OLD) ||
+		    (update->flags & REF_NODEREF) ||
+		    !starts_with(update->refname, "refs/"))
+			continue;
+		entry = find_ref(loose, update->refname);
+		if (!entry)
+			entry = get_packed_ref(update->refname);
+		if (entry && (entry->flag & (REF_ISBROKEN | REF_BAD_NAME)))
+			continue; /* leave it to the locking pass */
+		if (entry)
+			current = entry->u.value.sha1;
+		if (current ? !hashcmp(current, update->old_sha1)
+			    : is_null_sha1(update->old_sha1))
+			continue;
+		strbuf_addf(err, "Cannot lock the ref '%s'.",
+			    update->refname);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * An append-only journal of completed ref updates, enabled by setting
+ * refs.journal.  Each record is one line, "<seq> <old> <new> <ref>",
+ * with a sequence number that grows by one per record, so an external
+ * consumer can ask for everything since the last sequence it saw (see
+ * git-ref-journal(1)) instead of rediffing full for_each_ref()
+ * snapshots.  Journaling is best effort; a transaction never fails
+ * because its journal records could not be written.
+ */
+static int ref_journal_enabled(void)
+{
+	static int enabled = -1;
+
+	if (enabled == -1 && git_config_get_bool("refs.journal", &enabled))
+		enabled = 0;
+	return enabled;
+}
+
+static void ref_journal_record(struct string_list *records,
+			       const unsigned char *old_sha1,
+			       const unsigned char *new_sha1,
+			       const char *refname)
+{
+	struct strbuf sb = STRBUF_INIT;
+
+	strbuf_addf(&sb, "%s %s %s", sha1_to_hex(old_sha1),
+		    sha1_to_hex(new_sha1), refname);
+	string_list_append(records, sb.buf);
+	strbuf_release(&sb);
+}
+
+static uint64_t ref_journal_last_seq(int fd)
+{
+	struct stat st;
+	char buf[4096];
+	ssize_t len;
+	off_t pos = 0;
+	char *line;
+
+	if (fstat(fd, &st) || !st.st_size)
+		return 0;
+	if (st.st_size > (off_t)sizeof(buf) - 1)
+		pos = st.st_size - ((off_t)sizeof(buf) - 1);
+	if (lseek(fd, pos, SEEK_SET) < 0)
+		return 0;
+	len = read_in_full(fd, buf, sizeof(buf) - 1);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
+	while (len && buf[len - 1] == '\n')
+		buf[--len] = '\0';
+	line = strrchr(buf, '\n');
+	return strtoumax(line ? line + 1 : buf, NULL, 10);
+}
+
+static void ref_journal_append(struct string_list *records)
+{
+	static struct lock_file journal_lock;
+	struct strbuf sb = STRBUF_INIT;
+	struct string_list_item *item;
+	uint64_t seq;
+	int fd;
+
+	/*
+	 * The lock file only serializes writers; the journal itself is
+	 * appended in place so a reader never sees it vanish.
+	 */
+	if (hold_lock_file_for_update(&journal_lock,
+				      git_path("ref-journal"), 0) < 0) {
+		warning("could not lock ref journal; %d update(s) not journaled",
+			records->nr);
+		return;
+	}
+	fd = open(git_path("ref-journal"), O_RDWR | O_CREAT | O_APPEND, 0666);
+	if (fd < 0) {
+		warning("could not open ref journal; %d update(s) not journaled",
+			records->nr);
+		rollback_lock_file(&journal_lock);
+		return;
+	}
+	seq = ref_journal_last_seq(fd);
+	for_each_string_list_item(item, records)
+		strbuf_addf(&sb, "%" PRIuMAX " %s\n",
+			    (uintmax_t)++seq, item->string);
+	if (write_in_full(fd, sb.buf, sb.len) != sb.len)
+		warning("could not write to ref journal");
+	close(fd);
+	rollback_lock_file(&journal_lock);
+	strbuf_release(&sb);
+}
+
 int ref_transaction_commit(struct ref_transaction *transaction,
 			   struct strbuf *err)
 {
@@ -3727,6 +4376,8 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 	struct ref_update **updates = transaction->updates;
 	struct string_list refs_to_delete = STRING_LIST_INIT_NODUP;
 	struct string_list_item *ref_to_delete;
+	struct string_list journal = STRING_LIST_INIT_DUP;
+	int journal_updates;
 
 	assert(err);
 
@@ -3745,6 +4396,48 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 		goto cleanup;
 	}
 
+	journal_updates = ref_journal_enabled();
+
+	if (packed_transaction_threshold == -1 &&
+	    git_config_get_int("refs.packedtransactionthreshold",
+			       &packed_transaction_threshold))
+		packed_transaction_threshold = 100;
+
+	if (packed_transaction_threshold > 0 &&
+	    n >= packed_transaction_threshold &&
+	    transaction_is_packable(updates, n)) {
+		ret = commit_packed_transaction(updates, n, err);
+		if (ret <= 0) {
+			if (!ret && journal_updates)
+				/*
+				 * The packed rewrite does not report the
+				 * values it replaced; record the old value
+				 * only when the caller had it verified.
+				 */
+				for (i = 0; i < n; i++)
+					ref_journal_record(&journal,
+							   (updates[i]->flags & REF_HAVE_OLD) ?
+							   updates[i]->old_sha1 : null_sha1,
+							   updates[i]->new_sha1,
+							   updates[i]->refname);
+			goto cleanup;
+		}
+		ret = 0; /* fall back to per-reference locks */
+	}
+
+	/*
+	 * For large transactions, check the expected old values
+	 * against one snapshot of the involved refs before taking a
+	 * single lock; a mismatch then costs one scan instead of
+	 * thousands of lock/unlock cycles.
+	 */
+	if (packed_transaction_threshold > 0 &&
+	    n >= packed_transaction_threshold &&
+	    verify_old_values_quick(updates, n, err)) {
+		ret = TRANSACTION_GENERIC_ERROR;
+		goto cleanup;
+	}
+
 	/* Acquire all locks while verifying old values */
 	for (i = 0; i < n; i++) {
 		struct ref_update *update = updates[i];
@@ -3778,6 +4471,10 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 			int overwriting_symref = ((update->type & REF_ISSYMREF) &&
 						  (update->flags & REF_NODEREF));
 
+			unsigned char old_sha1[20];
+			char *locked_name = xstrdup(update->lock->ref_name);
+
+			hashcpy(old_sha1, update->lock->old_sha1);
 			if (!overwriting_symref
 			    && !hashcmp(update->lock->old_sha1, update->new_sha1)) {
 				/*
@@ -3796,7 +4493,12 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 			} else {
 				/* freed by write_ref_sha1(): */
 				update->lock = NULL;
+				if (journal_updates)
+					ref_journal_record(&journal, old_sha1,
+							   update->new_sha1,
+							   locked_name);
 			}
+			free(locked_name);
 		}
 	}
 
@@ -3806,10 +4508,17 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 		int flags = update->flags;
 
 		if ((flags & REF_HAVE_NEW) && is_null_sha1(update->new_sha1)) {
+			unsigned char old_sha1[20];
+
+			hashcpy(old_sha1, update->lock->old_sha1);
 			if (delete_ref_loose(update->lock, update->type, err)) {
 				ret = TRANSACTION_GENERIC_ERROR;
 				goto cleanup;
 			}
+			if (journal_updates)
+				ref_journal_record(&journal, old_sha1,
+						   null_sha1,
+						   update->lock->ref_name);
 
 			if (!(flags & REF_ISPRUNING))
 				string_list_append(&refs_to_delete,
@@ -3825,13 +4534,28 @@ int ref_transaction_commit(struct ref_transaction *transaction,
 		unlink_or_warn(git_path("logs/%s", ref_to_delete->string));
 	clear_loose_ref_cache(&ref_cache);
 
+	/* an object replacement may have been added or removed */
+	for (i = 0; i < n; i++)
+		if (starts_with(updates[i]->refname, "refs/replace/")) {
+			invalidate_replace_refs();
+			break;
+		}
+
 cleanup:
 	transaction->state = REF_TRANSACTION_CLOSED;
 
+	/*
+	 * A failed transaction is not rolled back, so journal whatever
+	 * part of it did complete.
+	 */
+	if (journal.nr)
+		ref_journal_append(&journal);
+
 	for (i = 0; i < n; i++)
 		if (updates[i]->lock)
 			unlock_ref(updates[i]->lock);
 	string_list_clear(&refs_to_delete, 0);
+	string_list_clear(&journal, 0);
 	return ret;
 }
 
@@ -3977,6 +4701,8 @@ struct expire_reflog_cb {
 	void *policy_cb;
 	FILE *newlog;
 	unsigned char last_kept_sha1[20];
+	/* set when the rewritten log differs from what is on disk */
+	unsigned int dirty : 1;
 };
 
 static int expire_reflog_ent(unsigned char *osha1, unsigned char *nsha1,
@@ -3986,11 +4712,15 @@ static int expire_reflog_ent(unsigned char *osha1, unsigned char *nsha1,
 	struct expire_reflog_cb *cb = cb_data;
 	struct expire_reflog_policy_cb *policy_cb = cb->policy_cb;
 
-	if (cb->flags & EXPIRE_REFLOGS_REWRITE)
+	if (cb->flags & EXPIRE_REFLOGS_REWRITE) {
+		if (hashcmp(osha1, cb->last_kept_sha1))
+			cb->dirty = 1;
 		osha1 = cb->last_kept_sha1;
+	}
 
 	if ((*cb->should_prune_fn)(osha1, nsha1, email, timestamp, tz,
 				   message, policy_cb)) {
+		cb->dirty = 1;
 		if (!cb->newlog)
 			printf("would prune %s", message);
 		else if (cb->flags & EXPIRE_REFLOGS_VERBOSE)
@@ -4080,7 +4810,20 @@ int reflog_expire(const char *refname, const unsigned char *sha1,
 			!(type & REF_ISSYMREF) &&
 			!is_null_sha1(cb.last_kept_sha1);
 
-		if (close_lock_file(&reflog_lock)) {
+		if (!cb.dirty) {
+			/*
+			 * Nothing was pruned and no old SHA-1 was
+			 * rewritten; throw away the copy instead of
+			 * renaming an identical log into place.  When
+			 * expiring every reflog in a large repository
+			 * this is the common case, and skipping the
+			 * rewrite avoids churning each log's inode.
+			 * The ref itself would be set to the value it
+			 * already has, so that update can be skipped,
+			 * too.
+			 */
+			rollback_lock_file(&reflog_lock);
+		} else if (close_lock_file(&reflog_lock)) {
 			status |= error("couldn't write %s: %s", log_file,
 					strerror(errno));
 		} else if (update &&
@@ -81,6 +81,7 @@ typedef int each_ref_fn(const char *refname,
 extern int head_ref(each_ref_fn, void *);
 extern int for_each_ref(each_ref_fn, void *);
 extern int for_each_ref_in(const char *, each_ref_fn, void *);
+extern int for_each_fullref_in(const char *, each_ref_fn, void *);
 extern int for_each_tag_ref(each_ref_fn, void *);
 extern int for_each_branch_ref(each_ref_fn, void *);
 extern int for_each_remote_ref(each_ref_fn, void *);
@@ -107,6 +108,18 @@ static inline const char *has_glob_specials(const char *pattern)
 /* can be used to learn about broken ref and symref */
 extern int for_each_rawref(each_ref_fn, void *);
 
+/*
+ * Like for_each_rawref(), but iterate only over refs under prefix,
+ * without trimming the prefix from the refnames given to fn.
+ */
+extern int for_each_rawref_in(const char *prefix, each_ref_fn, void *);
+
+/*
+ * Throw away the cached view of the main repository's refs, so that
+ * a long-running process notices updates made by others.
+ */
+extern void invalidate_cached_refs(void);
+
 extern void warn_dangling_symref(FILE *fp, const char *msg_fmt, const char *refname);
 extern void warn_dangling_symrefs(FILE *fp, const char *msg_fmt, const struct string_list *refnames);
 
@@ -8,6 +8,8 @@
 #include "tag.h"
 #include "string-list.h"
 #include "mergesort.h"
+#include "pack.h"
+#include "pack-bitmap.h"
 
 enum map_direction { FROM_SRC, FROM_DST };
 
@@ -466,6 +468,9 @@ static int handle_config(const char *key, const char *value, void *cb)
 			remote->uploadpack = v;
 		else
 			error("more than one uploadpack given, using the first");
+	} else if (!strcmp(subkey, ".negotiationalgorithm")) {
+		return git_config_string(&remote->negotiation_algorithm,
+					 key, value);
 	} else if (!strcmp(subkey, ".tagopt")) {
 		if (!strcmp(value, "--no-tags"))
 			remote->fetch_tags = -1;
@@ -1034,6 +1039,89 @@ void sort_ref_list(struct ref **l, int (*cmp)(const void *, const void *))
 	*l = llist_mergesort(*l, ref_list_get_next, ref_list_set_next, cmp);
 }
 
+struct ref_index_entry {
+	struct hashmap_entry ent;
+	struct ref *ref;
+};
+
+static int ref_index_entry_cmp(const void *entry, const void *entry_or_key,
+			       const void *keydata)
+{
+	const struct ref_index_entry *a = entry;
+	const struct ref_index_entry *b = entry_or_key;
+	const char *name = keydata ? keydata : b->ref->name;
+
+	return strcmp(a->ref->name, name);
+}
+
+void ref_index_init(struct ref_index *index, struct ref *list)
+{
+	size_t nr = 0;
+	struct ref *r;
+
+	for (r = list; r; r = r->next)
+		nr++;
+	hashmap_init(&index->map, ref_index_entry_cmp, nr);
+	for (; list; list = list->next)
+		ref_index_add(index, list);
+}
+
+void ref_index_add(struct ref_index *index, struct ref *ref)
+{
+	struct ref_index_entry *e = xmalloc(sizeof(*e));
+
+	hashmap_entry_init(e, strhash(ref->name));
+	e->ref = ref;
+	hashmap_add(&index->map, e);
+}
+
+struct ref *ref_index_find(const struct ref_index *index, const char *name)
+{
+	struct ref_index_entry *e;
+
+	e = hashmap_get_from_hash(&index->map, strhash(name), name);
+	return e ? e->ref : NULL;
+}
+
+void ref_index_clear(struct ref_index *index)
+{
+	hashmap_free(&index->map, 1);
+}
+
+static void count_one_refspec_match(struct ref *ref, int patlen,
+				    struct ref **matched_weak, int *weak_match,
+				    struct ref **matched, int *match)
+{
+	int namelen = strlen(ref->name);
+
+	/* A match is "weak" if it is with refs outside
+	 * heads or tags, and did not specify the pattern
+	 * in full (e.g. "refs/remotes/origin/master") or at
+	 * least from the toplevel (e.g. "remotes/origin/master");
+	 * otherwise "git push $URL master" would result in
+	 * ambiguity between remotes/origin/master and heads/master
+	 * at the remote site.
+	 */
+	if (namelen != patlen &&
+	    patlen != namelen - 5 &&
+	    !starts_with(ref->name, "refs/heads/") &&
+	    !starts_with(ref->name, "refs/tags/")) {
+		/* We want to catch the case where only weak
+		 * matches are found and there are multiple
+		 * matches, and where more than one strong
+		 * matches are found, as ambiguous.  One
+		 * strong match with zero or more weak matches
+		 * are acceptable as a unique match.
+		 */
+		(*matched_weak) = ref;
+		(*weak_match)++;
+	}
+	else {
+		(*matched) = ref;
+		(*match)++;
+	}
+}
+
 int count_refspec_match(const char *pattern,
 			struct ref *refs,
 			struct ref **matched_ref)
@@ -1045,38 +1133,11 @@ int count_refspec_match(const char *pattern,
 	int match = 0;
 
 	for (weak_match = match = 0; refs; refs = refs->next) {
-		char *name = refs->name;
-		int namelen = strlen(name);
-
-		if (!refname_match(pattern, name))
+		if (!refname_match(pattern, refs->name))
 			continue;
-
-		/* A match is "weak" if it is with refs outside
-		 * heads or tags, and did not specify the pattern
-		 * in full (e.g. "refs/remotes/origin/master") or at
-		 * least from the toplevel (e.g. "remotes/origin/master");
-		 * otherwise "git push $URL master" would result in
-		 * ambiguity between remotes/origin/master and heads/master
-		 * at the remote site.
-		 */
-		if (namelen != patlen &&
-		    patlen != namelen - 5 &&
-		    !starts_with(name, "refs/heads/") &&
-		    !starts_with(name, "refs/tags/")) {
-			/* We want to catch the case where only weak
-			 * matches are found and there are multiple
-			 * matches, and where more than one strong
-			 * matches are found, as ambiguous.  One
-			 * strong match with zero or more weak matches
-			 * are acceptable as a unique match.
-			 */
-			matched_weak = refs;
-			weak_match++;
-		}
-		else {
-			matched = refs;
-			match++;
-		}
+		count_one_refspec_match(refs, patlen,
+					&matched_weak, &weak_match,
+					&matched, &match);
 	}
 	if (!matched) {
 		if (matched_ref)
@@ -1090,6 +1151,58 @@ int count_refspec_match(const char *pattern,
 	}
 }
 
+struct refspec_match_state {
+	const struct ref_index *index;
+	int patlen;
+	struct ref *matched_weak;
+	struct ref *matched;
+	int weak_match;
+	int match;
+};
+
+static int count_expanded_matches(const char *full_name, void *cb_data)
+{
+	struct refspec_match_state *state = cb_data;
+	struct ref_index_entry *e;
+
+	e = hashmap_get_from_hash(&state->index->map,
+				  strhash(full_name), full_name);
+	for (; e; e = hashmap_get_next(&state->index->map, e))
+		count_one_refspec_match(e->ref, state->patlen,
+					&state->matched_weak,
+					&state->weak_match,
+					&state->matched, &state->match);
+	return 0;
+}
+
+/*
+ * Same as count_refspec_match(), but probing an index instead of
+ * walking the whole ref list: a name can match at most one expansion
+ * of the pattern, so enumerating the expansions visits exactly the
+ * refs the list walk would have counted.
+ */
+static int count_refspec_match_index(const char *pattern,
+				     const struct ref_index *index,
+				     struct ref **matched_ref)
+{
+	struct refspec_match_state state;
+
+	memset(&state, 0, sizeof(state));
+	state.index = index;
+	state.patlen = strlen(pattern);
+	refname_expand(pattern, count_expanded_matches, &state);
+	if (!state.matched) {
+		if (matched_ref)
+			*matched_ref = state.matched_weak;
+		return state.weak_match;
+	}
+	else {
+		if (matched_ref)
+			*matched_ref = state.matched;
+		return state.match;
+	}
+}
+
 static void tail_link_ref(struct ref *ref, struct ref ***tail)
 {
 	**tail = ref;
@@ -1154,12 +1267,12 @@ static char *guess_ref(const char *name, struct ref *peer)
 	return strbuf_detach(&buf, NULL);
 }
 
-static int match_explicit_lhs(struct ref *src,
+static int match_explicit_lhs(const struct ref_index *src_index,
 			      struct refspec *rs,
 			      struct ref **match,
 			      int *allocated_match)
 {
-	switch (count_refspec_match(rs->src, src, match)) {
+	switch (count_refspec_match_index(rs->src, src_index, match)) {
 	case 1:
 		if (allocated_match)
 			*allocated_match = 0;
@@ -1179,7 +1292,8 @@ static int match_explicit_lhs(struct ref *src,
 	}
 }
 
-static int match_explicit(struct ref *src, struct ref *dst,
+static int match_explicit(const struct ref_index *src_index,
+			  const struct ref_index *dst_index,
 			  struct ref ***dst_tail,
 			  struct refspec *rs)
 {
@@ -1193,7 +1307,7 @@ static int match_explicit(struct ref *src, struct ref *dst,
 		return 0;
 
 	matched_src = matched_dst = NULL;
-	if (match_explicit_lhs(src, rs, &matched_src, &allocated_src) < 0)
+	if (match_explicit_lhs(src_index, rs, &matched_src, &allocated_src) < 0)
 		return -1;
 
 	if (!dst_value) {
@@ -1210,7 +1324,7 @@ static int match_explicit(struct ref *src, struct ref *dst,
 			    matched_src->name);
 	}
 
-	switch (count_refspec_match(dst_value, dst, &matched_dst)) {
+	switch (count_refspec_match_index(dst_value, dst_index, &matched_dst)) {
 	case 1:
 		break;
 	case 0:
@@ -1228,6 +1342,12 @@ static int match_explicit(struct ref *src, struct ref *dst,
 			      "begins with refs/, and we are unable to "
 			      "guess a prefix based on the source ref.",
 			      dst_value);
+		/*
+		 * Do not index the new ref: only refs the remote
+		 * advertised take part in matching, so a later refspec
+		 * aiming at the same destination creates its own entry
+		 * and the remote decides its fate, as it always has.
+		 */
 		break;
 	default:
 		matched_dst = NULL;
@@ -1249,13 +1369,14 @@ static int match_explicit(struct ref *src, struct ref *dst,
 	return 0;
 }
 
-static int match_explicit_refs(struct ref *src, struct ref *dst,
+static int match_explicit_refs(const struct ref_index *src_index,
+			       const struct ref_index *dst_index,
 			       struct ref ***dst_tail, struct refspec *rs,
 			       int rs_nr)
 {
 	int i, errs;
 	for (i = errs = 0; i < rs_nr; i++)
-		errs += match_explicit(src, dst, dst_tail, &rs[i]);
+		errs += match_explicit(src_index, dst_index, dst_tail, &rs[i]);
 	return errs;
 }
 
@@ -1416,14 +1537,6 @@ struct ref *find_ref_by_name(const struct ref *list, const char *name)
 	return NULL;
 }
 
-static void prepare_ref_index(struct string_list *ref_index, struct ref *ref)
-{
-	for ( ; ref; ref = ref->next)
-		string_list_append_nodup(ref_index, ref->name)->util = ref;
-
-	string_list_sort(ref_index);
-}
-
 /*
  * Given only the set of local refs, sanity-check the set of push
  * refspecs. We can't catch all errors that match_push_refs would,
@@ -1433,18 +1546,21 @@ static void prepare_ref_index(struct string_list *ref_index, struct ref *ref)
 int check_push_refs(struct ref *src, int nr_refspec, const char **refspec_names)
 {
 	struct refspec *refspec = parse_push_refspec(nr_refspec, refspec_names);
+	struct ref_index src_index;
 	int ret = 0;
 	int i;
 
+	ref_index_init(&src_index, src);
 	for (i = 0; i < nr_refspec; i++) {
 		struct refspec *rs = refspec + i;
 
 		if (rs->pattern || rs->matching)
 			continue;
 
-		ret |= match_explicit_lhs(src, rs, NULL, NULL);
+		ret |= match_explicit_lhs(&src_index, rs, NULL, NULL);
 	}
 
+	ref_index_clear(&src_index);
 	free_refspec(nr_refspec, refspec);
 	return ret;
 }
@@ -1467,18 +1583,20 @@ int match_push_refs(struct ref *src, struct ref **dst,
 	int errs;
 	static const char *default_refspec[] = { ":", NULL };
 	struct ref *ref, **dst_tail = tail_ref(dst);
-	struct string_list dst_ref_index = STRING_LIST_INIT_NODUP;
+	struct ref_index src_index, dst_index;
 
 	if (!nr_refspec) {
 		nr_refspec = 1;
 		refspec = default_refspec;
 	}
 	rs = parse_push_refspec(nr_refspec, (const char **) refspec);
-	errs = match_explicit_refs(src, *dst, &dst_tail, rs, nr_refspec);
+	ref_index_init(&src_index, src);
+	ref_index_init(&dst_index, *dst);
+	errs = match_explicit_refs(&src_index, &dst_index, &dst_tail,
+				   rs, nr_refspec);
 
 	/* pick the remainder */
 	for (ref = src; ref; ref = ref->next) {
-		struct string_list_item *dst_item;
 		struct ref *dst_peer;
 		const struct refspec *pat = NULL;
 		char *dst_name;
@@ -1487,11 +1605,7 @@ int match_push_refs(struct ref *src, struct ref **dst,
 		if (!dst_name)
 			continue;
 
-		if (!dst_ref_index.nr)
-			prepare_ref_index(&dst_ref_index, *dst);
-
-		dst_item = string_list_lookup(&dst_ref_index, dst_name);
-		dst_peer = dst_item ? dst_item->util : NULL;
+		dst_peer = ref_index_find(&dst_index, dst_name);
 		if (dst_peer) {
 			if (dst_peer->peer_ref)
 				/* We're already sending something to this ref. */
@@ -1508,8 +1622,7 @@ int match_push_refs(struct ref *src, struct ref **dst,
 			/* Create a new one and link it */
 			dst_peer = make_linked_ref(dst_name, &dst_tail);
 			hashcpy(dst_peer->new_sha1, ref->new_sha1);
-			string_list_insert(&dst_ref_index,
-				dst_peer->name)->util = dst_peer;
+			ref_index_add(&dst_index, dst_peer);
 		}
 		dst_peer->peer_ref = copy_ref(ref);
 		dst_peer->force = pat->force;
@@ -1517,13 +1630,12 @@ int match_push_refs(struct ref *src, struct ref **dst,
 		free(dst_name);
 	}
 
-	string_list_clear(&dst_ref_index, 0);
+	ref_index_clear(&dst_index);
 
 	if (flags & MATCH_REFS_FOLLOW_TAGS)
 		add_missing_tags(src, dst, &dst_tail);
 
 	if (send_prune) {
-		struct string_list src_ref_index = STRING_LIST_INIT_NODUP;
 		/* check for missing refs on the remote */
 		for (ref = *dst; ref; ref = ref->next) {
 			char *src_name;
@@ -1534,16 +1646,13 @@ int match_push_refs(struct ref *src, struct ref **dst,
 
 			src_name = get_ref_match(rs, nr_refspec, ref, send_mirror, FROM_DST, NULL);
 			if (src_name) {
-				if (!src_ref_index.nr)
-					prepare_ref_index(&src_ref_index, src);
-				if (!string_list_has_string(&src_ref_index,
-					    src_name))
+				if (!ref_index_find(&src_index, src_name))
 					ref->peer_ref = alloc_delete_ref();
 				free(src_name);
 			}
 		}
-		string_list_clear(&src_ref_index, 0);
 	}
+	ref_index_clear(&src_index);
 	if (errs)
 		return -1;
 	return 0;
@@ -1886,10 +1995,8 @@ int stat_tracking_info(struct branch *branch, int *num_ours, int *num_theirs)
 {
 	unsigned char sha1[20];
 	struct commit *ours, *theirs;
-	char symmetric[84];
-	struct rev_info revs;
-	const char *rev_argv[10], *base;
-	int rev_argc;
+	uint32_t ahead, behind;
+	const char *base;
 
 	/* Cannot stat unless we are marked to build on top of somebody else. */
 	if (!branch ||
@@ -1916,39 +2023,22 @@ int stat_tracking_info(struct branch *branch, int *num_ours, int *num_theirs)
 		return 1;
 	}
 
-	/* Run "rev-list --left-right ours...theirs" internally... */
-	rev_argc = 0;
-	rev_argv[rev_argc++] = NULL;
-	rev_argv[rev_argc++] = "--left-right";
-	rev_argv[rev_argc++] = symmetric;
-	rev_argv[rev_argc++] = "--";
-	rev_argv[rev_argc] = NULL;
-
-	strcpy(symmetric, sha1_to_hex(ours->object.sha1));
-	strcpy(symmetric + 40, "...");
-	strcpy(symmetric + 43, sha1_to_hex(theirs->object.sha1));
-
-	init_revisions(&revs, NULL);
-	setup_revisions(rev_argc, rev_argv, &revs, NULL);
-	if (prepare_revision_walk(&revs))
-		die("revision walk setup failed");
-
-	/* ... and count the commits on each side. */
-	*num_ours = 0;
-	*num_theirs = 0;
-	while (1) {
-		struct commit *c = get_revision(&revs);
-		if (!c)
-			break;
-		if (c->object.flags & SYMMETRIC_LEFT)
-			(*num_ours)++;
-		else
-			(*num_theirs)++;
+	/*
+	 * If both tips carry reachability bitmaps, the counts come
+	 * straight out of the bitmap index without walking a single
+	 * commit; otherwise paint down the history, which stops at
+	 * the common ancestors instead of setting up the full
+	 * revision machinery for each branch.
+	 */
+	if (!bitmap_count_ahead_behind(ours->object.sha1,
+				       theirs->object.sha1,
+				       &ahead, &behind)) {
+		*num_ours = ahead;
+		*num_theirs = behind;
+		return 1;
 	}
 
-	/* clear object flags smudged by the above traversal */
-	clear_commit_marks(ours, ALL_REV_FLAGS);
-	clear_commit_marks(theirs, ALL_REV_FLAGS);
+	count_commit_ahead_behind(ours, theirs, num_ours, num_theirs);
 	return 1;
 }
 
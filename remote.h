@@ -49,6 +49,7 @@ struct remote {
 
 	const char *receivepack;
 	const char *uploadpack;
+	const char *negotiation_algorithm;
 
 	/*
 	 * for curl remotes only
@@ -129,6 +130,22 @@ struct ref {
 
 extern struct ref *find_ref_by_name(const struct ref *list, const char *name);
 
+/*
+ * A name-keyed index over a ref list, for callers that look up many
+ * names in the same list; a lookup costs O(1) instead of a walk over
+ * the whole list.  The index borrows the refs, so entries must be
+ * added with ref_index_add() whenever the list grows, and the index
+ * must be cleared before the list is freed.
+ */
+struct ref_index {
+	struct hashmap map;
+};
+
+void ref_index_init(struct ref_index *index, struct ref *list);
+void ref_index_add(struct ref_index *index, struct ref *ref);
+struct ref *ref_index_find(const struct ref_index *index, const char *name);
+void ref_index_clear(struct ref_index *index);
+
 struct ref *alloc_ref(const char *name);
 struct ref *copy_ref(const struct ref *ref);
 struct ref *copy_ref_list(const struct ref *ref);
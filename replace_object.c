@@ -77,17 +77,44 @@ static int register_replace_ref(const char *refname,
 	return 0;
 }
 
+static int replace_object_prepared;
+
+/*
+ * Set when prepare_replace_object() cleared check_replace_refs
+ * because the map turned out to be empty, as opposed to the user
+ * suppressing replacement (e.g. --no-replace-objects); only the
+ * former may be undone by invalidate_replace_refs().
+ */
+static int replace_refs_auto_off;
+
 static void prepare_replace_object(void)
 {
-	static int replace_object_prepared;
-
 	if (replace_object_prepared)
 		return;
 
 	for_each_replace_ref(register_replace_ref, NULL);
 	replace_object_prepared = 1;
-	if (!replace_object_nr)
+	if (!replace_object_nr) {
 		check_replace_refs = 0;
+		replace_refs_auto_off = 1;
+	}
+}
+
+void invalidate_replace_refs(void)
+{
+	int i;
+
+	if (!replace_object_prepared)
+		return;
+
+	for (i = 0; i < replace_object_nr; i++)
+		free(replace_object[i]);
+	replace_object_nr = 0;
+	replace_object_prepared = 0;
+	if (replace_refs_auto_off) {
+		check_replace_refs = 1;
+		replace_refs_auto_off = 0;
+	}
 }
 
 /* We allow "recursive" replacement. Only within reason, though */
@@ -105,7 +132,10 @@ const unsigned char *do_lookup_replace_object(const unsigned char *sha1)
 	int pos, depth = MAXREPLACEDEPTH;
 	const unsigned char *cur = sha1;
 
+	/* the replace map is lazily built and must not race */
+	obj_read_lock();
 	prepare_replace_object();
+	obj_read_unlock();
 
 	/* Try to recursively replace the object */
 	do {
@@ -3,6 +3,24 @@
 #include "resolve-undo.h"
 #include "string-list.h"
 
+/*
+ * The REUC extension is kept raw at index load time and parsed here
+ * on first use, so commands that never look at the resolve-undo
+ * information do not pay for parsing it.
+ */
+struct string_list *index_resolve_undo(struct index_state *istate)
+{
+	if (!istate->resolve_undo && istate->resolve_undo_data) {
+		istate->resolve_undo =
+			resolve_undo_read(istate->resolve_undo_data,
+					  istate->resolve_undo_data_size);
+		free(istate->resolve_undo_data);
+		istate->resolve_undo_data = NULL;
+		istate->resolve_undo_data_size = 0;
+	}
+	return istate->resolve_undo;
+}
+
 /* The only error case is to run out of memory in string-list */
 void record_resolve_undo(struct index_state *istate, struct cache_entry *ce)
 {
@@ -14,7 +32,7 @@ void record_resolve_undo(struct index_state *istate, struct cache_entry *ce)
 	if (!stage)
 		return;
 
-	if (!istate->resolve_undo) {
+	if (!index_resolve_undo(istate)) {
 		resolve_undo = xcalloc(1, sizeof(*resolve_undo));
 		resolve_undo->strdup_strings = 1;
 		istate->resolve_undo = resolve_undo;
@@ -105,6 +123,13 @@ error:
 void resolve_undo_clear_index(struct index_state *istate)
 {
 	struct string_list *resolve_undo = istate->resolve_undo;
+
+	if (istate->resolve_undo_data) {
+		free(istate->resolve_undo_data);
+		istate->resolve_undo_data = NULL;
+		istate->resolve_undo_data_size = 0;
+		istate->cache_changed |= RESOLVE_UNDO_CHANGED;
+	}
 	if (!resolve_undo)
 		return;
 	string_list_clear(resolve_undo, 1);
@@ -121,7 +146,7 @@ int unmerge_index_entry_at(struct index_state *istate, int pos)
 	int i, err = 0, matched;
 	char *name;
 
-	if (!istate->resolve_undo)
+	if (!index_resolve_undo(istate))
 		return pos;
 
 	ce = istate->cache[pos];
@@ -166,7 +191,7 @@ void unmerge_marked_index(struct index_state *istate)
 {
 	int i;
 
-	if (!istate->resolve_undo)
+	if (!index_resolve_undo(istate))
 		return;
 
 	for (i = 0; i < istate->cache_nr; i++) {
@@ -180,7 +205,7 @@ void unmerge_index(struct index_state *istate, const struct pathspec *pathspec)
 {
 	int i;
 
-	if (!istate->resolve_undo)
+	if (!index_resolve_undo(istate))
 		return;
 
 	for (i = 0; i < istate->cache_nr; i++) {
@@ -6,6 +6,8 @@ struct resolve_undo_info {
 	unsigned char sha1[3][20];
 };
 
+/* Return the index's resolve-undo list, parsing the REUC extension on first use. */
+extern struct string_list *index_resolve_undo(struct index_state *);
 extern void record_resolve_undo(struct index_state *, struct cache_entry *);
 extern void resolve_undo_write(struct strbuf *, struct string_list *);
 extern struct string_list *resolve_undo_read(const char *, unsigned long);
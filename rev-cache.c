@@ -0,0 +1,111 @@
+#include "cache.h"
+#include "lockfile.h"
+#include "rev-cache.h"
+
+/*
+ * Each entry is one line, "<key> <left> <right> <same>", with the key
+ * in hex.  New results are appended, and a lookup takes the last
+ * match, so a rewrite is only ever needed to keep the file small.
+ */
+#define REV_CACHE_MAX_ENTRIES 1024
+
+static const char *rev_cache_path(void)
+{
+	return git_path("info/rev-cache");
+}
+
+int rev_cache_enabled(void)
+{
+	static int enabled = -1;
+
+	if (enabled < 0 &&
+	    git_config_get_bool("revlist.countcache", &enabled))
+		enabled = 0;
+	return enabled;
+}
+
+int rev_cache_lookup(const unsigned char *key,
+		     int *left, int *right, int *same)
+{
+	struct strbuf buf = STRBUF_INIT;
+	struct strbuf **lines, **it;
+	const char *hex = sha1_to_hex(key);
+	int found = 0;
+
+	if (strbuf_read_file(&buf, rev_cache_path(), 0) < 0) {
+		strbuf_release(&buf);
+		return 0;
+	}
+	lines = strbuf_split(&buf, '\n');
+	for (it = lines; *it; it++) {
+		int l, r, s;
+
+		if ((*it)->len <= 40 || memcmp((*it)->buf, hex, 40))
+			continue;
+		if (sscanf((*it)->buf + 40, " %d %d %d", &l, &r, &s) != 3)
+			continue;
+		*left = l;
+		*right = r;
+		*same = s;
+		found = 1;
+	}
+	strbuf_list_free(lines);
+	strbuf_release(&buf);
+	return found;
+}
+
+void rev_cache_store(const unsigned char *key, int left, int right, int same)
+{
+	static struct lock_file lock;
+	struct strbuf buf = STRBUF_INIT;
+	char *p;
+	int fd, nr;
+
+	fd = hold_lock_file_for_update(&lock, rev_cache_path(), 0);
+	if (fd < 0)
+		return;	/* somebody else is writing; not worth waiting for */
+
+	if (strbuf_read_file(&buf, rev_cache_path(), 0) < 0)
+		strbuf_reset(&buf);
+
+	strbuf_addf(&buf, "%s %d %d %d\n", sha1_to_hex(key),
+		    left, right, same);
+
+	/*
+	 * Entries keyed by tips that have moved on never match again;
+	 * once there are too many, drop the older half.
+	 */
+	nr = 0;
+	for (p = buf.buf; (p = memchr(p, '\n', buf.buf + buf.len - p)); p++)
+		nr++;
+	if (nr > REV_CACHE_MAX_ENTRIES) {
+		p = memchr(buf.buf + buf.len / 2, '\n',
+			   buf.len - buf.len / 2);
+		if (p)
+			strbuf_remove(&buf, 0, p + 1 - buf.buf);
+	}
+
+	if (write_in_full(fd, buf.buf, buf.len) != buf.len)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+	strbuf_release(&buf);
+}
+
+int rev_cache_show(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	if (strbuf_read_file(&buf, rev_cache_path(), 0) < 0) {
+		strbuf_release(&buf);
+		return 0;
+	}
+	fwrite(buf.buf, 1, buf.len, stdout);
+	strbuf_release(&buf);
+	return 0;
+}
+
+void rev_cache_clear(void)
+{
+	unlink_or_warn(rev_cache_path());
+}
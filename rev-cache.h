@@ -0,0 +1,31 @@
+#ifndef REV_CACHE_H
+#define REV_CACHE_H
+
+/*
+ * A small persistent cache of revision-walk count results, kept in
+ * $GIT_DIR/info/rev-cache and enabled by revlist.countCache.  Entries
+ * are keyed by a hash over the query and the resolved tips it starts
+ * from, so a key can never map to a stale answer; entries merely go
+ * dead when refs move and are pruned when the file grows too large.
+ */
+
+extern int rev_cache_enabled(void);
+
+/*
+ * Look up a key; returns 1 and fills in the three counters on a hit,
+ * 0 on a miss.
+ */
+extern int rev_cache_lookup(const unsigned char *key,
+			    int *left, int *right, int *same);
+
+/* Record the result of a walk.  Failure to write is not an error. */
+extern void rev_cache_store(const unsigned char *key,
+			    int left, int right, int same);
+
+/* Write the raw cache contents to stdout. */
+extern int rev_cache_show(void);
+
+/* Discard all cached results. */
+extern void rev_cache_clear(void);
+
+#endif /* REV_CACHE_H */
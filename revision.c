@@ -18,6 +18,8 @@
 #include "commit-slab.h"
 #include "dir.h"
 #include "cache-tree.h"
+#include "bloom.h"
+#include "commit-graph.h"
 
 volatile show_early_output_fn_t show_early_output;
 
@@ -345,19 +347,6 @@ static struct commit *handle_commit(struct rev_info *revs,
 	die("%s is unknown object", name);
 }
 
-static int everybody_uninteresting(struct commit_list *orig)
-{
-	struct commit_list *list = orig;
-	while (list) {
-		struct commit *commit = list->item;
-		list = list->next;
-		if (commit->object.flags & UNINTERESTING)
-			continue;
-		return 0;
-	}
-	return 1;
-}
-
 /*
  * A definition of "relevant" commit that we can use to simplify limited graphs
  * by eliminating side branches.
@@ -468,8 +457,52 @@ static void file_change(struct diff_options *options,
 	DIFF_OPT_SET(options, HAS_CHANGES);
 }
 
+/*
+ * Decide whether the pathspec can be answered from the commits'
+ * changed-path Bloom filters: a single literal path, which we hash
+ * once up front.  Filters record every changed path and its leading
+ * directories, so the same key works for files and subdirectories.
+ */
+static void prepare_to_use_bloom_filter(struct rev_info *revs)
+{
+	struct pathspec_item *pi;
+	size_t len;
+
+	if (revs->prune_data.nr != 1)
+		return;
+	pi = &revs->prune_data.items[0];
+	if (pi->magic || pi->nowildcard_len != pi->len)
+		return;
+
+	len = pi->len;
+	while (len && pi->match[len - 1] == '/')
+		len--;
+	if (!len)
+		return;
+
+	revs->bloom_key = xmalloc(sizeof(*revs->bloom_key));
+	fill_bloom_key(pi->match, len, revs->bloom_key);
+}
+
+/*
+ * May "commit" have changed the path we are limited to, relative to
+ * its first parent?  Zero means definitely not; non-zero means we
+ * have to run the tree diff to find out.
+ */
+static int maybe_changed_path(struct rev_info *revs, struct commit *commit)
+{
+	struct bloom_filter filter;
+
+	if (!revs->bloom_key)
+		return 1;
+	if (!get_changed_paths_filter(commit, &filter))
+		return 1;
+	return bloom_filter_contains(&filter, revs->bloom_key);
+}
+
 static int rev_compare_tree(struct rev_info *revs,
-			    struct commit *parent, struct commit *commit)
+			    struct commit *parent, struct commit *commit,
+			    int nth_parent)
 {
 	struct tree *t1 = parent->tree;
 	struct tree *t2 = commit->tree;
@@ -497,6 +530,14 @@ static int rev_compare_tree(struct rev_info *revs,
 			return REV_TREE_SAME;
 	}
 
+	/*
+	 * The stored filters describe each commit against its first
+	 * parent, so they cannot answer for the later parents of a
+	 * merge.
+	 */
+	if (!nth_parent && !maybe_changed_path(revs, commit))
+		return REV_TREE_SAME;
+
 	tree_difference = REV_TREE_SAME;
 	DIFF_OPT_CLR(&revs->pruning, HAS_CHANGES);
 	if (diff_tree_sha1(t1->object.sha1, t2->object.sha1, "",
@@ -650,7 +691,13 @@ static void try_to_simplify_commit(struct rev_info *revs, struct commit *commit)
 		return;
 
 	if (!commit->parents) {
-		if (rev_same_tree_as_empty(revs, commit))
+		/*
+		 * A root commit's filter was computed against the empty
+		 * tree, so a negative answer means the pathspec-limited
+		 * diff is empty without running it.
+		 */
+		if (!maybe_changed_path(revs, commit) ||
+		    rev_same_tree_as_empty(revs, commit))
 			commit->object.flags |= TREESAME;
 		return;
 	}
@@ -699,7 +746,7 @@ static void try_to_simplify_commit(struct rev_info *revs, struct commit *commit)
 			die("cannot simplify commit %s (because of %s)",
 			    sha1_to_hex(commit->object.sha1),
 			    sha1_to_hex(p->object.sha1));
-		switch (rev_compare_tree(revs, p, commit)) {
+		switch (rev_compare_tree(revs, p, commit, nth_parent)) {
 		case REV_TREE_SAME:
 			if (!revs->simplify_history || !relevant_commit(p)) {
 				/* Even if a merge with an uninteresting
@@ -940,8 +987,12 @@ static void cherry_pick_list(struct commit_list *list, struct rev_info *revs)
 /* How many extra uninteresting commits we want to see.. */
 #define SLOP 5
 
-static int still_interesting(struct commit_list *src, unsigned long date, int slop)
+static int still_interesting(struct commit_list *src, unsigned long date, int slop,
+			     uint32_t interesting_gen_floor)
 {
+	uint32_t max_pending_gen = 0;
+	struct commit_list *list;
+
 	/*
 	 * No source list at all? We're definitely done..
 	 */
@@ -949,17 +1000,38 @@ static int still_interesting(struct commit_list *src, unsigned long date, int sl
 		return 0;
 
 	/*
-	 * Does the destination list contain entries with a date
-	 * before the source list? Definitely _not_ done.
+	 * Does the source list still have interesting commits in
+	 * it? Definitely not done..
 	 */
-	if (date <= src->item->date)
-		return SLOP;
+	for (list = src; list; list = list->next) {
+		struct commit *commit = list->item;
+		uint32_t generation;
+
+		if (!(commit->object.flags & UNINTERESTING))
+			return SLOP;
+		generation = commit_graph_generation(commit);
+		if (!generation)
+			generation = GENERATION_NUMBER_INFINITY;
+		if (generation > max_pending_gen)
+			max_pending_gen = generation;
+	}
 
 	/*
-	 * Does the source list still have interesting commits in
-	 * it? Definitely not done..
+	 * Everything pending is uninteresting, and generation numbers
+	 * prove that none of it can reach a commit we have kept: the
+	 * uninteresting marks are already complete, no matter how
+	 * skewed the committer dates are.
+	 */
+	if (max_pending_gen != GENERATION_NUMBER_INFINITY &&
+	    max_pending_gen <= interesting_gen_floor &&
+	    interesting_gen_floor < GENERATION_NUMBER_MAX)
+		return 0;
+
+	/*
+	 * Does the destination list contain entries with a date
+	 * before the source list? Definitely _not_ done.
 	 */
-	if (!everybody_uninteresting(src))
+	if (date <= src->item->date)
 		return SLOP;
 
 	/* Ok, we're closing in.. */
@@ -1074,6 +1146,7 @@ static int limit_list(struct rev_info *revs)
 {
 	int slop = SLOP;
 	unsigned long date = ~0ul;
+	uint32_t interesting_gen_floor = GENERATION_NUMBER_INFINITY;
 	struct commit_list *list = revs->commits;
 	struct commit_list *newlist = NULL;
 	struct commit_list **p = &newlist;
@@ -1102,7 +1175,15 @@ static int limit_list(struct rev_info *revs)
 			mark_parents_uninteresting(commit);
 			if (revs->show_all)
 				p = &commit_list_insert(commit, p)->next;
-			slop = still_interesting(list, date, slop);
+			else if (!revs->boundary)
+				/*
+				 * Never shown (and not a boundary
+				 * candidate either); no point keeping
+				 * its message text around.
+				 */
+				free_commit_buffer(commit);
+			slop = still_interesting(list, date, slop,
+						 interesting_gen_floor);
 			if (slop)
 				continue;
 			/* If showing all, add the whole pending list to the end */
@@ -1110,9 +1191,17 @@ static int limit_list(struct rev_info *revs)
 				*p = list;
 			break;
 		}
-		if (revs->min_age != -1 && (commit->date > revs->min_age))
+		if (revs->min_age != -1 && (commit->date > revs->min_age)) {
+			free_commit_buffer(commit);
 			continue;
+		}
 		date = commit->date;
+		/*
+		 * A kept commit not covered by the graph file could be
+		 * anywhere, which disables the generation-based stop.
+		 */
+		if (commit_graph_generation(commit) < interesting_gen_floor)
+			interesting_gen_floor = commit_graph_generation(commit);
 		p = &commit_list_insert(commit, p)->next;
 
 		show = show_early_output;
@@ -1334,9 +1423,9 @@ void add_index_objects_to_pending(struct rev_info *revs, unsigned flags)
 					     ce->ce_mode, ce->name);
 	}
 
-	if (active_cache_tree) {
+	if (index_cache_tree(&the_index)) {
 		struct strbuf path = STRBUF_INIT;
-		add_cache_tree(active_cache_tree, revs, &path);
+		add_cache_tree(the_index.cache_tree, revs, &path);
 		strbuf_release(&path);
 	}
 }
@@ -1864,6 +1953,14 @@ static int handle_revision_opt(struct rev_info *revs, int argc, const char **arg
 		revs->tree_objects = 1;
 		revs->blob_objects = 1;
 		revs->verify_objects = 1;
+	} else if (starts_with(arg, "--object-type=")) {
+		revs->filter_object_type = type_from_string(arg + 14);
+	} else if (starts_with(arg, "--min-object-size=")) {
+		if (!git_parse_ulong(arg + 18, &revs->filter_min_size))
+			die("unable to parse --min-object-size=%s", arg + 18);
+	} else if (starts_with(arg, "--max-object-size=")) {
+		if (!git_parse_ulong(arg + 18, &revs->filter_max_size))
+			die("unable to parse --max-object-size=%s", arg + 18);
 	} else if (!strcmp(arg, "--unpacked")) {
 		revs->unpacked = 1;
 	} else if (starts_with(arg, "--unpacked=")) {
@@ -2756,6 +2853,9 @@ int prepare_revision_walk(struct rev_info *revs)
 	    (revs->limited && limiting_can_increase_treesame(revs)))
 		revs->treesame.name = "treesame";
 
+	if (revs->prune)
+		prepare_to_use_bloom_filter(revs);
+
 	if (revs->no_walk != REVISION_WALK_NO_WALK_UNSORTED)
 		commit_list_sort_by_date(&revs->commits);
 	if (revs->no_walk)
@@ -3108,6 +3208,19 @@ static struct commit *get_revision_1(struct rev_info *revs)
 
 		switch (simplify_commit(revs, commit)) {
 		case commit_ignore:
+			/*
+			 * This commit will never be shown, so its
+			 * message is dead weight; e.g. a --grep walk
+			 * over a big history would otherwise hold on
+			 * to the text of every non-matching commit.
+			 * Reflog walks may revisit (and show) the
+			 * commit under another reflog entry, so leave
+			 * those alone; anybody else who still needs
+			 * the text re-reads it lazily through
+			 * get_commit_buffer().
+			 */
+			if (!revs->reflog_info && !revs->boundary)
+				free_commit_buffer(commit);
 			continue;
 		case commit_error:
 			die("Failed to simplify parents of commit %s",
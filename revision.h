@@ -28,6 +28,7 @@
 struct rev_info;
 struct log_info;
 struct string_list;
+struct bloom_key;
 struct saved_parents;
 
 struct rev_cmdline_info {
@@ -91,6 +92,8 @@ struct rev_info {
 			tag_objects:1,
 			tree_objects:1,
 			blob_objects:1,
+			/* apply the pathspec to blobs only, keep all trees */
+			narrow_objects:1,
 			verify_objects:1,
 			edge_hint:1,
 			edge_hint_aggressive:1,
@@ -185,10 +188,21 @@ struct rev_info {
 	int (*include_check)(struct commit *, void *);
 	void *include_check_data;
 
+	/* threads used to walk trees in traverse_commit_list() */
+	int traverse_threads;
+
+	/* enumeration-time object filtering in traverse_commit_list() */
+	int filter_object_type;		/* OBJ_NONE = show every type */
+	unsigned long filter_min_size;	/* applies to blobs only */
+	unsigned long filter_max_size;	/* 0 = no upper bound */
+
 	/* diff info for patches and for paths limiting */
 	struct diff_options diffopt;
 	struct diff_options pruning;
 
+	/* changed-path filter key, when the pathspec allows using one */
+	struct bloom_key *bloom_key;
+
 	struct reflog_walk_info *reflog_info;
 	struct decoration children;
 	struct decoration merge_simplification;
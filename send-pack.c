@@ -27,6 +27,70 @@ static int feed_object(const unsigned char *sha1, int fd, int negative)
 	return write_or_whine(fd, buf, 41 + negative, "send-pack: send refs");
 }
 
+#define MAX_NEGOTIATION_PROBES 32
+
+static void add_negotiation_probes(struct sha1_array *probes,
+				   const unsigned char *tip)
+{
+	struct commit *c = lookup_commit_reference_gently(tip, 1);
+	unsigned depth = 0, next = 0;
+
+	/*
+	 * Sample the first-parent chain at exponentially growing
+	 * depths; one of the early samples usually hits history the
+	 * receiver already has, and the deeper ones bound the damage
+	 * when our tip is many commits ahead of anything advertised.
+	 */
+	while (c && probes->nr < MAX_NEGOTIATION_PROBES) {
+		if (depth == next) {
+			if (sha1_array_lookup(probes, c->object.sha1) < 0)
+				sha1_array_append(probes, c->object.sha1);
+			next = next ? 2 * next : 1;
+		}
+		if (parse_commit(c))
+			break;
+		c = c->parents ? c->parents->item : NULL;
+		depth++;
+	}
+}
+
+/*
+ * Ask the receiving end which of the commits leading up to what we are
+ * about to push it already has, and record the acknowledged ones so
+ * that pack-objects can exclude everything reachable from them.
+ */
+static void negotiate_commons(int in, int out, struct ref *refs,
+			      struct sha1_array *commons)
+{
+	struct sha1_array probes = SHA1_ARRAY_INIT;
+	int i;
+
+	for (; refs; refs = refs->next)
+		if (!is_null_sha1(refs->new_sha1))
+			add_negotiation_probes(&probes, refs->new_sha1);
+
+	if (!probes.nr)
+		return;
+
+	for (i = 0; i < probes.nr; i++)
+		packet_write(out, "probe %s", sha1_to_hex(probes.sha1[i]));
+	packet_flush(out);
+	sha1_array_clear(&probes);
+
+	for (;;) {
+		unsigned char sha1[20];
+		int len;
+		char *line = packet_read_line(in, &len);
+
+		if (!line)
+			break;
+		if (len != 44 || !starts_with(line, "ack ") ||
+		    get_sha1_hex(line + 4, sha1))
+			die("invalid probe response: '%s'", line);
+		sha1_array_append(commons, sha1);
+	}
+}
+
 /*
  * Make a pack stream and spit it out into file descriptor fd
  */
@@ -370,6 +434,10 @@ int send_pack(struct send_pack_args *args,
 		args->use_thin_pack = 0;
 	if (server_supports("atomic"))
 		atomic_supported = 1;
+	if (args->push_negotiate && !args->stateless_rpc &&
+	    !args->dry_run && extra_have &&
+	    server_supports("push-negotiate"))
+		negotiate_commons(in, out, remote_refs, extra_have);
 	if (args->push_cert) {
 		int len;
 
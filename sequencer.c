@@ -14,6 +14,7 @@
 #include "rerere.h"
 #include "merge-recursive.h"
 #include "refs.h"
+#include "log-tree.h"
 #include "argv-array.h"
 
 #define GIT_REFLOG_ACTION "GIT_REFLOG_ACTION"
@@ -219,6 +220,33 @@ static struct tree *empty_tree(void)
 	return lookup_tree(EMPTY_TREE_SHA1_BIN);
 }
 
+/*
+ * We keep the index in core between picks; index_validity records the
+ * stat information of the index file the in-core copy corresponds to,
+ * so that a pick only goes back to the disk when somebody else (most
+ * commonly the "git commit" we run for the previous pick) has
+ * rewritten the index file behind our back.
+ */
+static struct stat_validity index_validity;
+
+static void record_index_validity(void)
+{
+	int fd = open(get_index_file(), O_RDONLY);
+
+	stat_validity_update(&index_validity, fd);
+	if (fd >= 0)
+		close(fd);
+}
+
+static void reread_cache_if_changed(void)
+{
+	if (stat_validity_check(&index_validity, get_index_file()))
+		return;
+	discard_cache();
+	read_cache();
+	record_index_validity();
+}
+
 static int error_dirty_index(struct replay_opts *opts)
 {
 	if (read_cache_unmerged())
@@ -320,6 +348,7 @@ static int do_recursive_merge(struct commit *base, struct commit *next,
 		/* TRANSLATORS: %s will be "revert" or "cherry-pick" */
 		die(_("%s: Unable to write new index file"), action_name(opts));
 	rollback_lock_file(&index_lock);
+	record_index_validity();
 
 	if (opts->signoff)
 		append_signoff(msgbuf, 0, 0);
@@ -351,7 +380,7 @@ static int is_index_unchanged(void)
 	if (parse_commit(head_commit))
 		return -1;
 
-	if (!active_cache_tree)
+	if (!index_cache_tree(&the_index))
 		active_cache_tree = cache_tree();
 
 	if (!cache_tree_fully_valid(active_cache_tree))
@@ -471,6 +500,8 @@ static int do_pick_commit(struct commit *commit, struct replay_opts *opts)
 	struct strbuf msgbuf = STRBUF_INIT;
 	int res, unborn = 0, allow;
 
+	reread_cache_if_changed();
+
 	if (opts->no_commit) {
 		/*
 		 * We do not intend to commit immediately.  We just want to
@@ -487,7 +518,6 @@ static int do_pick_commit(struct commit *commit, struct replay_opts *opts)
 		if (index_differs_from(unborn ? EMPTY_TREE_SHA1_HEX : "HEAD", 0))
 			return error_dirty_index(opts);
 	}
-	discard_cache();
 
 	if (!commit->parents) {
 		parent = NULL;
@@ -598,6 +628,12 @@ static int do_pick_commit(struct commit *commit, struct replay_opts *opts)
 					common, sha1_to_hex(head), remotes);
 		free_commit_list(common);
 		free_commit_list(remotes);
+		/*
+		 * The merge strategy worked on the index file directly;
+		 * our in-core copy is stale now.
+		 */
+		stat_validity_clear(&index_validity);
+		discard_cache();
 	}
 
 	/*
@@ -637,6 +673,221 @@ leave:
 	return res;
 }
 
+/*
+ * A run of consecutive picks whose commits were created directly at
+ * the tree level.  HEAD has already been advanced from "from" to
+ * "to"; the index and worktree still show "from" and are rolled
+ * forward once, when the run ends.
+ */
+struct pick_batch {
+	unsigned char from[20];
+	unsigned char to[20];
+	int nr;
+};
+
+static char *get_commit_author(const char *message)
+{
+	const char *p = message;
+
+	while (*p && *p != '\n') {
+		const char *eol = strchrnul(p, '\n');
+
+		if (starts_with(p, "author "))
+			return xmemdupz(p + 7, eol - (p + 7));
+		p = eol + (*eol == '\n');
+	}
+	return NULL;
+}
+
+/*
+ * Report a commit created by do_tree_level_pick() the way the "git
+ * commit" run from do_pick_commit() would have, so that the user
+ * cannot tell the two code paths apart.
+ */
+static void print_pick_summary(const unsigned char *sha1)
+{
+	struct rev_info rev;
+	struct commit *commit;
+	struct strbuf format = STRBUF_INIT;
+	unsigned char junk_sha1[20];
+	const char *head;
+	struct pretty_print_context pctx = {0};
+	struct strbuf author_ident = STRBUF_INIT;
+	struct strbuf committer_ident = STRBUF_INIT;
+	struct strbuf date = STRBUF_INIT;
+
+	commit = lookup_commit(sha1);
+	if (!commit || parse_commit(commit))
+		die(_("couldn't look up newly created commit"));
+
+	strbuf_addstr(&format, "format:%h] %s");
+
+	format_commit_message(commit, "%an <%ae>", &author_ident, &pctx);
+	format_commit_message(commit, "%cn <%ce>", &committer_ident, &pctx);
+	if (strbuf_cmp(&author_ident, &committer_ident)) {
+		strbuf_addstr(&format, "\n Author: ");
+		strbuf_addbuf_percentquote(&format, &author_ident);
+	}
+	/* the author date is always kept from the picked commit */
+	format_commit_message(commit, "%ad", &date, &pctx);
+	strbuf_addstr(&format, "\n Date: ");
+	strbuf_addbuf_percentquote(&format, &date);
+	strbuf_release(&author_ident);
+	strbuf_release(&committer_ident);
+	strbuf_release(&date);
+
+	init_revisions(&rev, NULL);
+	setup_revisions(0, NULL, &rev, NULL);
+
+	rev.diff = 1;
+	rev.diffopt.output_format =
+		DIFF_FORMAT_SHORTSTAT | DIFF_FORMAT_SUMMARY;
+
+	rev.verbose_header = 1;
+	get_commit_format(format.buf, &rev);
+	rev.always_show_header = 0;
+	rev.diffopt.detect_rename = 1;
+	rev.diffopt.break_opt = 0;
+	diff_setup_done(&rev.diffopt);
+
+	head = resolve_ref_unsafe("HEAD", 0, junk_sha1, NULL);
+	if (!strcmp(head, "HEAD"))
+		head = _("detached HEAD");
+	else
+		skip_prefix(head, "refs/heads/", &head);
+	printf("[%s ", head);
+
+	if (!log_tree_commit(&rev, commit)) {
+		rev.always_show_header = 1;
+		rev.use_terminator = 1;
+		log_tree_commit(&rev, commit);
+	}
+
+	strbuf_release(&format);
+}
+
+/*
+ * When the commit to pick is based on the exact tree that HEAD has,
+ * replaying its change must reproduce its tree verbatim; there is
+ * nothing for the merge machinery to do.  Create the new commit
+ * directly from that tree and advance HEAD, leaving the index and
+ * worktree alone; pick_commits() rolls both forward once at the end
+ * of such a run.  Returns 1 when the commit was picked this way, 0
+ * when the caller must use the full machinery, and -1 on error (the
+ * caller still must conclude the batch).
+ */
+static int do_tree_level_pick(struct commit *commit, struct replay_opts *opts,
+			      struct pick_batch *batch)
+{
+	unsigned char head[20], newhead[20];
+	struct commit *parent, *head_commit;
+	struct commit_message msg = { NULL, NULL, NULL, NULL };
+	struct commit_list *parents = NULL;
+	struct ref_transaction *transaction;
+	struct strbuf sb = STRBUF_INIT;
+	struct strbuf err = STRBUF_INIT;
+	const char *body;
+	char *author = NULL;
+	int res = 0;
+
+	if (opts->action != REPLAY_PICK || opts->no_commit ||
+	    opts->edit || opts->signoff || opts->record_origin ||
+	    opts->xopts_nr ||
+	    (opts->strategy && strcmp(opts->strategy, "recursive")))
+		return 0;
+	/* let "git commit" give its implicit-identity advice */
+	if (!committer_ident_sufficiently_given())
+		return 0;
+	if (!commit->parents || commit->parents->next || 0 < opts->mainline)
+		return 0;
+	parent = commit->parents->item;
+	if (get_sha1("HEAD", head))
+		return 0;
+	/* prefer the plain fast-forward when it is allowed */
+	if (opts->allow_ff && !hashcmp(parent->object.sha1, head))
+		return 0;
+	head_commit = lookup_commit_reference_gently(head, 1);
+	if (!head_commit || parse_commit(head_commit) < 0 ||
+	    parse_commit(parent) < 0 || parse_commit(commit) < 0)
+		return 0;
+	if (hashcmp(parent->tree->object.sha1,
+		    head_commit->tree->object.sha1))
+		return 0;
+	/* an empty pick still wants the normal allow_empty() handling */
+	if (!hashcmp(commit->tree->object.sha1, parent->tree->object.sha1))
+		return 0;
+	/*
+	 * Before the first tree-level pick the index must match HEAD,
+	 * just as do_pick_commit() insists; during a run it lags
+	 * behind by design.
+	 */
+	if (!batch->nr && index_differs_from("HEAD", 0))
+		return 0;
+
+	if (get_message(commit, &msg))
+		return 0;
+	author = get_commit_author(msg.message);
+	if (!author) {
+		free_message(commit, &msg);
+		return 0;
+	}
+
+	body = strstr(msg.message, "\n\n");
+	body = body ? body + 2 : "";
+
+	commit_list_insert(head_commit, &parents);
+	/* commit_tree() consumes the parent list */
+	if (commit_tree(body, strlen(body), commit->tree->object.sha1,
+			parents, newhead, author, opts->gpg_sign)) {
+		res = error(_("could not commit tree for %s"),
+			    sha1_to_hex(commit->object.sha1));
+		goto leave;
+	}
+
+	strbuf_addf(&sb, "%s: %s", action_name(opts), msg.subject);
+	transaction = ref_transaction_begin(&err);
+	if (!transaction ||
+	    ref_transaction_update(transaction, "HEAD", newhead, head,
+				   0, sb.buf, &err) ||
+	    ref_transaction_commit(transaction, &err)) {
+		error("%s", err.buf);
+		res = -1;
+	}
+	ref_transaction_free(transaction);
+	if (res)
+		goto leave;
+
+	if (!batch->nr)
+		hashcpy(batch->from, head);
+	hashcpy(batch->to, newhead);
+	batch->nr++;
+	print_pick_summary(newhead);
+	res = 1;
+
+leave:
+	free(author);
+	free_message(commit, &msg);
+	strbuf_release(&sb);
+	strbuf_release(&err);
+	return res;
+}
+
+/*
+ * Bring the index and worktree up to date with the HEAD that a run
+ * of tree-level picks has left behind.
+ */
+static int conclude_pick_batch(struct pick_batch *batch)
+{
+	if (!batch->nr)
+		return 0;
+	batch->nr = 0;
+	read_cache();
+	if (checkout_fast_forward(batch->from, batch->to, 1))
+		return -1;
+	stat_validity_clear(&index_validity);
+	return 0;
+}
+
 static void prepare_revs(struct replay_opts *opts)
 {
 	/*
@@ -665,6 +916,7 @@ static void read_and_refresh_cache(struct replay_opts *opts)
 			die(_("git %s: failed to refresh the index"), action_name(opts));
 	}
 	rollback_lock_file(&index_lock);
+	record_index_validity();
 }
 
 static int format_todo(struct strbuf *buf, struct commit_list *todo_list,
@@ -986,6 +1238,7 @@ static void save_opts(struct replay_opts *opts)
 static int pick_commits(struct commit_list *todo_list, struct replay_opts *opts)
 {
 	struct commit_list *cur;
+	struct pick_batch batch = { {0}, {0}, 0 };
 	int res;
 
 	setenv(GIT_REFLOG_ACTION, action_name(opts), 0);
@@ -996,10 +1249,22 @@ static int pick_commits(struct commit_list *todo_list, struct replay_opts *opts)
 
 	for (cur = todo_list; cur; cur = cur->next) {
 		save_todo(cur, opts);
+		res = do_tree_level_pick(cur->item, opts, &batch);
+		if (res < 0) {
+			conclude_pick_batch(&batch);
+			return res;
+		}
+		if (res > 0)
+			continue;
+		/* catch the worktree up before using the full machinery */
+		if (conclude_pick_batch(&batch))
+			return -1;
 		res = do_pick_commit(cur->item, opts);
 		if (res)
 			return res;
 	}
+	if (conclude_pick_batch(&batch))
+		return -1;
 
 	/*
 	 * Sequence of picks finished successfully; cleanup by
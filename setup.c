@@ -225,6 +225,34 @@ void verify_non_filename(const char *prefix, const char *arg)
 }
 
 
+void get_common_dir(struct strbuf *sb, const char *gitdir)
+{
+	struct strbuf data = STRBUF_INIT;
+	struct strbuf path = STRBUF_INIT;
+	const char *git_common_dir = getenv(GIT_COMMON_DIR_ENVIRONMENT);
+
+	if (git_common_dir) {
+		strbuf_addstr(sb, git_common_dir);
+		return;
+	}
+	strbuf_addf(&path, "%s/commondir", gitdir);
+	if (file_exists(path.buf)) {
+		if (strbuf_read_file(&data, path.buf, 0) <= 0)
+			die_errno(_("failed to read %s"), path.buf);
+		while (data.len &&
+		       (data.buf[data.len - 1] == '\n' ||
+			data.buf[data.len - 1] == '\r'))
+			data.len--;
+		data.buf[data.len] = '\0';
+		if (!is_absolute_path(data.buf))
+			strbuf_addf(sb, "%s/", gitdir);
+		strbuf_addbuf(sb, &data);
+	} else
+		strbuf_addstr(sb, gitdir);
+	strbuf_release(&data);
+	strbuf_release(&path);
+}
+
 /*
  * Test if it looks like we're at a git directory.
  * We want to see:
@@ -235,34 +263,45 @@ void verify_non_filename(const char *prefix, const char *arg)
  *  - either a HEAD symlink or a HEAD file that is formatted as
  *    a proper "ref:", or a regular file HEAD that has a properly
  *    formatted sha1 object name.
+ *
+ * The objects/ and refs/ directories of a linked worktree's git
+ * directory live in the main repository; they are looked for in
+ * $GIT_COMMON_DIR while HEAD stays per-worktree.
  */
 int is_git_directory(const char *suspect)
 {
-	char path[PATH_MAX];
-	size_t len = strlen(suspect);
+	struct strbuf path = STRBUF_INIT;
+	int ret = 0;
+	size_t len;
+
+	/* Check per-worktree signature */
+	strbuf_addf(&path, "%s/HEAD", suspect);
+	if (validate_headref(path.buf))
+		goto done;
 
-	if (PATH_MAX <= len + strlen("/objects"))
-		die("Too long path: %.*s", 60, suspect);
-	strcpy(path, suspect);
+	strbuf_reset(&path);
+	get_common_dir(&path, suspect);
+	len = path.len;
+
+	/* Check shared signatures */
 	if (getenv(DB_ENVIRONMENT)) {
 		if (access(getenv(DB_ENVIRONMENT), X_OK))
-			return 0;
-	}
-	else {
-		strcpy(path + len, "/objects");
-		if (access(path, X_OK))
-			return 0;
+			goto done;
+	} else {
+		strbuf_addstr(&path, "/objects");
+		if (access(path.buf, X_OK))
+			goto done;
 	}
 
-	strcpy(path + len, "/refs");
-	if (access(path, X_OK))
-		return 0;
-
-	strcpy(path + len, "/HEAD");
-	if (validate_headref(path))
-		return 0;
+	strbuf_setlen(&path, len);
+	strbuf_addstr(&path, "/refs");
+	if (access(path.buf, X_OK))
+		goto done;
 
-	return 1;
+	ret = 1;
+done:
+	strbuf_release(&path);
+	return ret;
 }
 
 int is_inside_git_dir(void)
@@ -304,9 +343,12 @@ void setup_work_tree(void)
 	initialized = 1;
 }
 
+static int repository_format_hash_algo = GIT_HASH_SHA1;
+static struct string_list unknown_extensions = STRING_LIST_INIT_DUP;
+
 static int check_repository_format_gently(const char *gitdir, int *nongit_ok)
 {
-	char repo_config[PATH_MAX+1];
+	struct strbuf repo_config = STRBUF_INIT;
 
 	/*
 	 * git_config() can't be used here because it calls git_pathdup()
@@ -316,19 +358,39 @@ static int check_repository_format_gently(const char *gitdir, int *nongit_ok)
 	 * We are in gitdir setup, no git dir has been found useable yet.
 	 * Use a gentler version of git_config() to check if this repo
 	 * is a good one.
+	 *
+	 * A linked worktree's git directory has no config of its own;
+	 * the shared one lives in $GIT_COMMON_DIR.
 	 */
-	snprintf(repo_config, PATH_MAX, "%s/config", gitdir);
-	git_config_early(check_repository_format_version, NULL, repo_config);
-	if (GIT_REPO_VERSION < repository_format_version) {
+	get_common_dir(&repo_config, gitdir);
+	strbuf_addstr(&repo_config, "/config");
+	string_list_clear(&unknown_extensions, 0);
+	git_config_early(check_repository_format_version, NULL, repo_config.buf);
+	strbuf_release(&repo_config);
+	if (GIT_REPO_VERSION_READ < repository_format_version) {
 		if (!nongit_ok)
 			die ("Expected git repo version <= %d, found %d",
-			     GIT_REPO_VERSION, repository_format_version);
+			     GIT_REPO_VERSION_READ, repository_format_version);
 		warning("Expected git repo version <= %d, found %d",
-			GIT_REPO_VERSION, repository_format_version);
+			GIT_REPO_VERSION_READ, repository_format_version);
 		warning("Please upgrade Git");
 		*nongit_ok = -1;
 		return -1;
 	}
+	if (repository_format_version >= 1 && unknown_extensions.nr) {
+		/*
+		 * Version 0 predates extensions; stray extensions.* keys
+		 * found there are ignored for compatibility.
+		 */
+		if (!nongit_ok)
+			die("unknown repository extension: %s",
+			    unknown_extensions.items[0].string);
+		warning("unknown repository extension: %s",
+			unknown_extensions.items[0].string);
+		*nongit_ok = -1;
+		return -1;
+	}
+	the_hash_algo = &hash_algos[repository_format_hash_algo];
 	return 0;
 }
 
@@ -799,9 +861,29 @@ int git_config_perm(const char *var, const char *value)
 
 int check_repository_format_version(const char *var, const char *value, void *cb)
 {
+	const char *ext;
+
 	if (strcmp(var, "core.repositoryformatversion") == 0)
 		repository_format_version = git_config_int(var, value);
-	else if (strcmp(var, "core.sharedrepository") == 0)
+	else if (skip_prefix(var, "extensions.", &ext)) {
+		/*
+		 * Record any extension keys we do not understand; whether
+		 * they are fatal depends on the format version, which we
+		 * only know once the whole file has been read.
+		 */
+		if (!strcmp(ext, "objectformat")) {
+			int algo;
+
+			if (!value)
+				return config_error_nonbool(var);
+			algo = hash_algo_by_name(value);
+			if (algo == GIT_HASH_UNKNOWN)
+				die("invalid value for 'extensions.objectformat': '%s'",
+				    value);
+			repository_format_hash_algo = algo;
+		} else
+			string_list_append(&unknown_extensions, ext);
+	} else if (strcmp(var, "core.sharedrepository") == 0)
 		shared_repository = git_config_perm(var, value);
 	else if (strcmp(var, "core.bare") == 0) {
 		is_bare_repository_cfg = git_config_bool(var, value);
@@ -21,8 +21,13 @@
 #include "pack-revindex.h"
 #include "sha1-lookup.h"
 #include "bulk-checkin.h"
+#include "trace-event.h"
 #include "streaming.h"
 #include "dir.h"
+#include "midx.h"
+#include "thread-utils.h"
+#include "object-info-server.h"
+#include "narrow.h"
 
 #ifndef O_NOATIME
 #if defined(__linux__) && (defined(__i386__) || defined(__PPC__))
@@ -37,6 +42,131 @@ static inline uintmax_t sz_fmt(size_t s) { return s; }
 
 const unsigned char null_sha1[20];
 
+static void git_hash_sha1_init(git_hash_ctx *ctx)
+{
+	git_SHA1_Init(&ctx->sha1);
+}
+
+static void git_hash_sha1_update(git_hash_ctx *ctx, const void *data, size_t len)
+{
+	git_SHA1_Update(&ctx->sha1, data, len);
+}
+
+static void git_hash_sha1_final(unsigned char *hash, git_hash_ctx *ctx)
+{
+	git_SHA1_Final(hash, &ctx->sha1);
+}
+
+static void git_hash_unknown_init(git_hash_ctx *ctx)
+{
+	die("trying to init unknown hash");
+}
+
+static void git_hash_unknown_update(git_hash_ctx *ctx, const void *data, size_t len)
+{
+	die("trying to update unknown hash");
+}
+
+static void git_hash_unknown_final(unsigned char *hash, git_hash_ctx *ctx)
+{
+	die("trying to finalize unknown hash");
+}
+
+const struct git_hash_algo hash_algos[GIT_HASH_NALGOS] = {
+	{
+		NULL,
+		0x00000000,
+		0,
+		0,
+		git_hash_unknown_init,
+		git_hash_unknown_update,
+		git_hash_unknown_final,
+	},
+	{
+		"sha1",
+		/* "sha1", big-endian */
+		0x73686131,
+		GIT_SHA1_RAWSZ,
+		GIT_SHA1_HEXSZ,
+		git_hash_sha1_init,
+		git_hash_sha1_update,
+		git_hash_sha1_final,
+	},
+};
+
+int hash_algo_by_name(const char *name)
+{
+	int i;
+
+	if (!name)
+		return GIT_HASH_UNKNOWN;
+	for (i = 1; i < GIT_HASH_NALGOS; i++)
+		if (!strcmp(name, hash_algos[i].name))
+			return i;
+	return GIT_HASH_UNKNOWN;
+}
+
+/*
+ * The object read path keeps a fair amount of global state: the
+ * packed_git list, the pack windows and their LRU counters, the delta
+ * base cache and so on.  Commands that want several threads to read
+ * objects concurrently call enable_obj_read_lock() before spawning
+ * them, and every entry point into the read path then serializes on
+ * this mutex.  It is recursive because object reads nest (e.g. when
+ * following a delta chain into another read).  The lock is dropped
+ * around zlib inflation, where the pack window in use is pinned by
+ * its inuse_cnt and cannot go away under us, so that is where
+ * concurrent readers actually overlap.
+ */
+#ifndef NO_PTHREADS
+static pthread_mutex_t obj_read_mutex;
+static int obj_read_use_lock;
+
+void enable_obj_read_lock(void)
+{
+	if (obj_read_use_lock)
+		return;
+	obj_read_use_lock = 1;
+	init_recursive_mutex(&obj_read_mutex);
+}
+
+void disable_obj_read_lock(void)
+{
+	if (!obj_read_use_lock)
+		return;
+	obj_read_use_lock = 0;
+	pthread_mutex_destroy(&obj_read_mutex);
+}
+
+void obj_read_lock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_lock(&obj_read_mutex);
+}
+
+void obj_read_unlock(void)
+{
+	if (obj_read_use_lock)
+		pthread_mutex_unlock(&obj_read_mutex);
+}
+#else
+void enable_obj_read_lock(void)
+{
+}
+
+void disable_obj_read_lock(void)
+{
+}
+
+void obj_read_lock(void)
+{
+}
+
+void obj_read_unlock(void)
+{
+}
+#endif
+
 /*
  * This is meant to hold a *small* number of objects that you would
  * want read_sha1_file() to be able to return, but yet you do not want
@@ -266,12 +396,84 @@ static struct alternate_object_database **alt_odb_tail;
  * SHA1, an extra slash for the first level indirection, and the
  * terminating NUL.
  */
+static struct alternate_object_database *alloc_alt_odb(const char *dir,
+						       int pfxlen)
+{
+	struct alternate_object_database *ent;
+	int entlen = pfxlen + 43; /* '/' + 2 hex + '/' + 38 hex + NUL */
+
+	ent = xmalloc(sizeof(*ent) + entlen);
+	memcpy(ent->base, dir, pfxlen);
+	ent->name = ent->base + pfxlen + 1;
+	ent->base[pfxlen + 3] = '/';
+	ent->base[pfxlen] = ent->base[entlen-1] = 0;
+	return ent;
+}
+
+/*
+ * A cross-process cache of the resolved alternates graph and of the
+ * pack lists of the alternates, kept in objects/info/alternates.cache
+ * and enabled by core.alternatesCache.  Hosts with long alternate
+ * chains shared by many repositories pay a stat() per recorded file
+ * on startup instead of re-reading and re-normalizing every
+ * info/alternates in the chain and re-scanning every alternate's
+ * pack directory.
+ *
+ * The cache records the identity (mtime and size) of every
+ * info/alternates file the resolution consulted, including the ones
+ * that did not exist, and of every alternate's pack directory.  If
+ * any of them does not match any more the cache is ignored as a
+ * whole and rewritten after the next full scan.
+ */
+#define ODB_CACHE_SIGNATURE "alternates cache v1"
+
+static int odb_cache_valid;
+static int odb_cache_recording;
+static struct strbuf odb_cache_alt_record = STRBUF_INIT;
+static struct strbuf odb_cache_pack_record = STRBUF_INIT;
+static struct string_list odb_cache_packs = STRING_LIST_INIT_DUP;
+
+static int odb_cache_enabled(void)
+{
+	static int enabled = -1;
+
+	if (enabled < 0 &&
+	    git_config_get_bool("core.alternatescache", &enabled))
+		enabled = 0;
+	return enabled;
+}
+
+static char *odb_cache_path(void)
+{
+	return xstrfmt("%s/info/alternates.cache", get_object_directory());
+}
+
+static void odb_cache_note_file(const char *path, struct stat *st)
+{
+	if (odb_cache_recording)
+		strbuf_addf(&odb_cache_alt_record, "file %ju %ju %s\n",
+			    (uintmax_t)st->st_mtime, (uintmax_t)st->st_size,
+			    path);
+}
+
+static void odb_cache_note_absent(const char *path)
+{
+	if (odb_cache_recording)
+		strbuf_addf(&odb_cache_alt_record, "absent %s\n", path);
+}
+
+static void odb_cache_note_odb(const char *dir)
+{
+	if (odb_cache_recording)
+		strbuf_addf(&odb_cache_alt_record, "odb %s\n", dir);
+}
+
 static int link_alt_odb_entry(const char *entry, const char *relative_base,
 	int depth, const char *normalized_objdir)
 {
 	struct alternate_object_database *ent;
 	struct alternate_object_database *alt;
-	int pfxlen, entlen;
+	int pfxlen;
 	struct strbuf pathbuf = STRBUF_INIT;
 
 	if (!is_absolute_path(entry) && relative_base) {
@@ -291,15 +493,9 @@ static int link_alt_odb_entry(const char *entry, const char *relative_base,
 	while (pfxlen && pathbuf.buf[pfxlen-1] == '/')
 		pfxlen -= 1;
 
-	entlen = pfxlen + 43; /* '/' + 2 hex + '/' + 38 hex + NUL */
-	ent = xmalloc(sizeof(*ent) + entlen);
-	memcpy(ent->base, pathbuf.buf, pfxlen);
+	ent = alloc_alt_odb(pathbuf.buf, pfxlen);
 	strbuf_release(&pathbuf);
 
-	ent->name = ent->base + pfxlen + 1;
-	ent->base[pfxlen + 3] = '/';
-	ent->base[pfxlen] = ent->base[entlen-1] = 0;
-
 	/* Detect cases where alternate disappeared */
 	if (!is_directory(ent->base)) {
 		error("object directory %s does not exist; "
@@ -328,6 +524,7 @@ static int link_alt_odb_entry(const char *entry, const char *relative_base,
 	*alt_odb_tail = ent;
 	alt_odb_tail = &(ent->next);
 	ent->next = NULL;
+	odb_cache_note_odb(ent->base);
 
 	/* recursively add alternates */
 	read_info_alternates(ent->base, depth + 1);
@@ -360,7 +557,7 @@ static void link_alt_odb_entries(const char *alt, int len, int sep,
 		const char *entry = entries.items[i].string;
 		if (entry[0] == '\0' || entry[0] == '#')
 			continue;
-		if (!is_absolute_path(entry) && depth) {
+		if (!is_absolute_path(entry) && depth && !relative_base) {
 			error("%s: ignoring relative alternate object store %s",
 					relative_base, entry);
 		} else {
@@ -386,9 +583,20 @@ void read_info_alternates(const char * relative_base, int depth)
 
 	sprintf(path, "%s/%s", relative_base, alt_file_name);
 	fd = git_open_noatime(path);
-	if (fd < 0)
+	if (fd < 0) {
+		if (errno == ENOENT)
+			odb_cache_note_absent(path);
+		else
+			odb_cache_recording = 0;
+		return;
+	}
+	if (fstat(fd, &st)) {
+		odb_cache_recording = 0;
+		close(fd);
 		return;
-	if (fstat(fd, &st) || (st.st_size == 0)) {
+	}
+	odb_cache_note_file(path, &st);
+	if (st.st_size == 0) {
 		close(fd);
 		return;
 	}
@@ -401,6 +609,134 @@ void read_info_alternates(const char * relative_base, int depth)
 	munmap(map, mapsz);
 }
 
+static int odb_cache_check_stamp(const char *args, const char **rest)
+{
+	uintmax_t mtime, size;
+	char *end;
+	struct stat st;
+
+	mtime = strtoumax(args, &end, 10);
+	if (*end != ' ')
+		return -1;
+	size = strtoumax(end + 1, &end, 10);
+	if (*end != ' ')
+		return -1;
+	*rest = end + 1;
+	if (stat(*rest, &st) ||
+	    (uintmax_t)st.st_mtime != mtime ||
+	    (uintmax_t)st.st_size != size)
+		return -1;
+	return 0;
+}
+
+static int load_odb_cache(void)
+{
+	char *path = odb_cache_path();
+	struct strbuf buf = STRBUF_INIT;
+	struct string_list odbs = STRING_LIST_INIT_NODUP;
+	struct string_list packs = STRING_LIST_INIT_NODUP;
+	const char *cur_packdir = NULL;
+	char *line, *next = NULL;
+	int i, ok = 0;
+
+	if (strbuf_read_file(&buf, path, 0) < 0 || !buf.len)
+		goto out;
+	for (line = buf.buf; *line; line = next) {
+		char *eol = strchr(line, '\n');
+		const char *args, *stamped;
+		struct stat st;
+
+		if (!eol)
+			goto out; /* truncated */
+		*eol = '\0';
+		next = eol + 1;
+		if (line == buf.buf) {
+			if (strcmp(line, ODB_CACHE_SIGNATURE))
+				goto out;
+		} else if (skip_prefix(line, "file ", &args)) {
+			if (odb_cache_check_stamp(args, &stamped))
+				goto out;
+		} else if (skip_prefix(line, "absent ", &args)) {
+			if (!access(args, F_OK))
+				goto out;
+		} else if (skip_prefix(line, "odb ", &args)) {
+			if (!is_directory(args))
+				goto out;
+			string_list_append(&odbs, args);
+		} else if (skip_prefix(line, "packdir ", &args)) {
+			uintmax_t mtime, size;
+			char *end;
+
+			mtime = strtoumax(args, &end, 10);
+			if (*end != ' ')
+				goto out;
+			size = strtoumax(end + 1, &end, 10);
+			if (*end != ' ')
+				goto out;
+			cur_packdir = end + 1;
+			if (stat(mkpath("%s/pack", cur_packdir), &st) ||
+			    (uintmax_t)st.st_mtime != mtime ||
+			    (uintmax_t)st.st_size != size)
+				goto out;
+		} else if (skip_prefix(line, "nopack ", &args)) {
+			if (!stat(mkpath("%s/pack", args), &st))
+				goto out;
+			cur_packdir = NULL;
+		} else if (skip_prefix(line, "packfile ", &args)) {
+			if (!cur_packdir)
+				goto out;
+			string_list_append(&packs, args)->util =
+				(void *)cur_packdir;
+		} else
+			goto out;
+	}
+
+	for (i = 0; i < odbs.nr; i++) {
+		const char *dir = odbs.items[i].string;
+		int pfxlen = strlen(dir);
+		struct alternate_object_database *ent;
+
+		ent = alloc_alt_odb(dir, pfxlen);
+		ent->base[pfxlen] = '/';
+		*alt_odb_tail = ent;
+		alt_odb_tail = &(ent->next);
+		ent->next = NULL;
+	}
+	for (i = 0; i < packs.nr; i++)
+		string_list_append(&odb_cache_packs,
+				   packs.items[i].string)->util =
+			xstrdup(packs.items[i].util);
+	odb_cache_valid = 1;
+	ok = 1;
+out:
+	string_list_clear(&odbs, 0);
+	string_list_clear(&packs, 0);
+	strbuf_release(&buf);
+	free(path);
+	return ok;
+}
+
+static void write_odb_cache(void)
+{
+	static struct lock_file lock;
+	struct strbuf buf = STRBUF_INIT;
+	char *path = odb_cache_path();
+	int fd;
+
+	fd = hold_lock_file_for_update(&lock, path, 0);
+	free(path);
+	if (fd < 0)
+		return; /* somebody else is writing it, or no permission */
+	strbuf_addstr(&buf, ODB_CACHE_SIGNATURE "\n");
+	strbuf_addbuf(&buf, &odb_cache_alt_record);
+	strbuf_addbuf(&buf, &odb_cache_pack_record);
+	if (write_in_full(fd, buf.buf, buf.len) != buf.len)
+		rollback_lock_file(&lock);
+	else
+		commit_lock_file(&lock);
+	strbuf_release(&buf);
+}
+
 void add_to_alternates_file(const char *reference)
 {
 	struct lock_file *lock = xcalloc(1, sizeof(struct lock_file));
@@ -409,8 +745,24 @@ void add_to_alternates_file(const char *reference)
 	write_or_die(fd, alt, strlen(alt));
 	if (commit_lock_file(lock))
 		die("could not close alternates file");
-	if (alt_odb_tail)
+	if (alt_odb_tail) {
+		/* the stamps recorded so far no longer tell the truth */
+		odb_cache_recording = 0;
 		link_alt_odb_entries(alt, strlen(alt), '\n', NULL, 0);
+	}
+}
+
+void add_to_alternates_memory(const char *reference)
+{
+	/*
+	 * Make sure alternates are initialized, or else our entry may be
+	 * overwritten when they are.
+	 */
+	prepare_alt_odb();
+
+	/* an in-core-only alternate must never end up in the cache */
+	odb_cache_recording = 0;
+	link_alt_odb_entries(reference, strlen(reference), '\n', NULL, 0);
 }
 
 int foreach_alt_odb(alt_odb_fn fn, void *cb)
@@ -438,6 +790,11 @@ void prepare_alt_odb(void)
 	if (!alt) alt = "";
 
 	alt_odb_tail = &alt_odb_list;
+	if (!*alt && odb_cache_enabled()) {
+		if (load_odb_cache())
+			return;
+		odb_cache_recording = 1;
+	}
 	link_alt_odb_entries(alt, strlen(alt), PATH_SEP, NULL, 0);
 
 	read_info_alternates(get_object_directory(), 0);
@@ -833,6 +1190,8 @@ void close_pack_index(struct packed_git *p)
 		munmap((void *)p->index_data, p->index_size);
 		p->index_data = NULL;
 	}
+	free(p->sha1_prefixes);
+	p->sha1_prefixes = NULL;
 }
 
 /*
@@ -971,6 +1330,10 @@ static int open_packed_git_1(struct packed_git *p)
 		return error("packfile %s is version %"PRIu32" and not"
 			" supported (try upgrading GIT to a newer version)",
 			p->pack_name, ntohl(hdr.hdr_version));
+	p->pack_codec = pack_version_codec(hdr.hdr_version);
+	if (!pack_codec_name(p->pack_codec))
+		return error("packfile %s uses unsupported codec %d",
+			     p->pack_name, p->pack_codec);
 
 	/* Verify the pack matches its index. */
 	if (p->num_objects != ntohl(hdr.hdr_entries))
@@ -1013,6 +1376,66 @@ static int in_window(struct pack_window *win, off_t offset)
 		&& (offset + 20) <= (win_off + win->len);
 }
 
+#if defined(MADV_SEQUENTIAL) && defined(MADV_RANDOM) && defined(MADV_WILLNEED)
+#define PACK_WINDOW_MADVISE 1
+#endif
+
+static enum pack_access_pattern pack_access_pattern;
+
+void set_pack_access_pattern(enum pack_access_pattern pattern)
+{
+	pack_access_pattern = pattern;
+}
+
+/*
+ * Pass the declared access pattern (and, if asked for, a transparent
+ * hugepage hint) on to the kernel for a freshly mapped window.  All
+ * of this is advisory; where madvise() does not exist the window
+ * behaves as it always did.
+ */
+static void advise_pack_window(struct pack_window *win)
+{
+#ifdef PACK_WINDOW_MADVISE
+	switch (pack_access_pattern) {
+	case PACK_ACCESS_SEQUENTIAL:
+		madvise(win->base, win->len, MADV_SEQUENTIAL);
+		madvise(win->base, win->len, MADV_WILLNEED);
+		break;
+	case PACK_ACCESS_RANDOM:
+		madvise(win->base, win->len, MADV_RANDOM);
+		break;
+	default:
+		break;
+	}
+#ifdef MADV_HUGEPAGE
+	if (packed_git_huge_pages)
+		madvise(win->base, win->len, MADV_HUGEPAGE);
+#endif
+#endif
+}
+
+void pack_window_prefetch(struct packed_git *p, off_t start, off_t end)
+{
+#ifdef PACK_WINDOW_MADVISE
+	struct pack_window *win;
+
+	if (end <= start)
+		return;
+	for (win = p->windows; win; win = win->next) {
+		off_t lo, hi;
+
+		if (win->offset >= end ||
+		    (off_t)(win->offset + win->len) <= start)
+			continue;
+		lo = start > win->offset ? start - win->offset : 0;
+		hi = end - win->offset;
+		if (hi > win->len)
+			hi = win->len;
+		madvise(win->base + lo, xsize_t(hi - lo), MADV_WILLNEED);
+	}
+#endif
+}
+
 unsigned char *use_pack(struct packed_git *p,
 		struct pack_window **w_cursor,
 		off_t offset,
@@ -1061,6 +1484,7 @@ unsigned char *use_pack(struct packed_git *p,
 				die("packfile %s cannot be mapped: %s",
 					p->pack_name,
 					strerror(errno));
+			advise_pack_window(win);
 			if (!win->offset && win->len == p->pack_size
 				&& !p->do_not_close) {
 				close(p->pack_fd);
@@ -1225,6 +1649,42 @@ static void report_pack_garbage(struct string_list *list)
 	report_helper(list, seen_bits, first, list->nr);
 }
 
+/*
+ * Re-create the effect of scanning an alternate's pack directory
+ * from the pack list recorded in the alternates cache.
+ */
+static void prepare_cached_packs(const char *objdir)
+{
+	struct strbuf path = STRBUF_INIT;
+	int i;
+
+	for (i = 0; i < odb_cache_packs.nr; i++) {
+		struct packed_git *p;
+		size_t base_len;
+
+		if (strcmp(odb_cache_packs.items[i].util, objdir))
+			continue;
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/pack/%s", objdir,
+			    odb_cache_packs.items[i].string);
+		base_len = path.len;
+		if (!strip_suffix_mem(path.buf, &base_len, ".idx"))
+			continue;
+		/* Don't reopen a pack we already have. */
+		for (p = packed_git; p; p = p->next) {
+			size_t len;
+			if (strip_suffix(p->pack_name, ".pack", &len) &&
+			    len == base_len &&
+			    !memcmp(p->pack_name, path.buf, len))
+				break;
+		}
+		if (p == NULL &&
+		    (p = add_packed_git(path.buf, path.len, 0)) != NULL)
+			install_packed_git(p);
+	}
+	strbuf_release(&path);
+}
+
 static void prepare_packed_git_one(char *objdir, int local)
 {
 	struct strbuf path = STRBUF_INIT;
@@ -1233,16 +1693,36 @@ static void prepare_packed_git_one(char *objdir, int local)
 	struct dirent *de;
 	struct string_list garbage = STRING_LIST_INIT_DUP;
 
+	if (!local && odb_cache_valid && !report_garbage) {
+		prepare_cached_packs(objdir);
+		return;
+	}
+
 	strbuf_addstr(&path, objdir);
 	strbuf_addstr(&path, "/pack");
 	dir = opendir(path.buf);
 	if (!dir) {
-		if (errno != ENOENT)
+		if (errno != ENOENT) {
 			error("unable to open object pack directory: %s: %s",
 			      path.buf, strerror(errno));
+			odb_cache_recording = 0;
+		} else if (!local && odb_cache_recording) {
+			strbuf_addf(&odb_cache_pack_record, "nopack %s\n",
+				    objdir);
+		}
 		strbuf_release(&path);
 		return;
 	}
+	if (!local && odb_cache_recording) {
+		struct stat st;
+		if (stat(path.buf, &st))
+			odb_cache_recording = 0;
+		else
+			strbuf_addf(&odb_cache_pack_record,
+				    "packdir %ju %ju %s\n",
+				    (uintmax_t)st.st_mtime,
+				    (uintmax_t)st.st_size, objdir);
+	}
 	strbuf_addch(&path, '/');
 	dirnamelen = path.len;
 	while ((de = readdir(dir)) != NULL) {
@@ -1257,6 +1737,9 @@ static void prepare_packed_git_one(char *objdir, int local)
 
 		base_len = path.len;
 		if (strip_suffix_mem(path.buf, &base_len, ".idx")) {
+			if (!local && odb_cache_recording)
+				strbuf_addf(&odb_cache_pack_record,
+					    "packfile %s\n", de->d_name);
 			/* Don't reopen a pack we already have. */
 			for (p = packed_git; p; p = p->next) {
 				size_t len;
@@ -1360,11 +1843,48 @@ void prepare_packed_git(void)
 		alt->name[-1] = '/';
 	}
 	rearrange_packed_git();
+	prepare_midx(get_object_directory());
+	if (odb_cache_recording) {
+		write_odb_cache();
+		odb_cache_recording = 0;
+	}
 	prepare_packed_git_run_once = 1;
 }
 
+/*
+ * Give a fast, rough count of the number of objects in the repository,
+ * by adding up the object counts recorded in the pack index headers.
+ * Loose objects are ignored; in any repository large enough for the
+ * count to matter they are insignificant next to the packed ones.
+ */
+unsigned long approximate_object_count(void)
+{
+	static unsigned long count = (unsigned long)-1;
+
+	if (count == (unsigned long)-1) {
+		struct packed_git *p;
+
+		prepare_packed_git();
+		count = 0;
+		for (p = packed_git; p; p = p->next) {
+			if (open_pack_index(p))
+				continue;
+			count += p->num_objects;
+		}
+	}
+	return count;
+}
+
 void reprepare_packed_git(void)
 {
+	close_midx();
+	/*
+	 * A pack may have appeared after the cache stamps were taken
+	 * but within the same second; do a real directory walk and do
+	 * not overwrite the cache from this incomplete picture.
+	 */
+	odb_cache_valid = 0;
+	odb_cache_recording = 0;
 	prepare_packed_git_run_once = 0;
 	prepare_packed_git();
 }
@@ -1405,7 +1925,7 @@ int check_sha1_signature(const unsigned char *sha1, void *map,
 	unsigned char real_sha1[20];
 	enum object_type obj_type;
 	struct git_istream *st;
-	git_SHA_CTX c;
+	git_hash_ctx c;
 	char hdr[32];
 	int hdrlen;
 
@@ -1422,8 +1942,8 @@ int check_sha1_signature(const unsigned char *sha1, void *map,
 	hdrlen = sprintf(hdr, "%s %lu", typename(obj_type), size) + 1;
 
 	/* Sha1.. */
-	git_SHA1_Init(&c);
-	git_SHA1_Update(&c, hdr, hdrlen);
+	the_hash_algo->init_fn(&c);
+	the_hash_algo->update_fn(&c, hdr, hdrlen);
 	for (;;) {
 		char buf[1024 * 16];
 		ssize_t readlen = read_istream(st, buf, sizeof(buf));
@@ -1434,9 +1954,9 @@ int check_sha1_signature(const unsigned char *sha1, void *map,
 		}
 		if (!readlen)
 			break;
-		git_SHA1_Update(&c, buf, readlen);
+		the_hash_algo->update_fn(&c, buf, readlen);
 	}
-	git_SHA1_Final(real_sha1, &c);
+	the_hash_algo->final_fn(real_sha1, &c);
 	close_istream(st);
 	return hashcmp(sha1, real_sha1) ? -1 : 0;
 }
@@ -1609,6 +2129,39 @@ static void *unpack_sha1_rest(git_zstream *stream, void *buffer, unsigned long s
 	return NULL;
 }
 
+/*
+ * Every well-formed header starts with one of the four standard type
+ * names followed by a space; recognize those with one comparison each
+ * instead of scanning byte by byte and then strcmp()ing the result in
+ * type_from_string().  All callers hand us a buffer of at least 32
+ * bytes, so the fixed-width compares cannot run off the end.
+ *
+ * Returns the type and advances *hdr past the space, or -1 if the
+ * header does not start with a known type name.
+ */
+static int parse_sha1_header_type(const char **hdr)
+{
+	const char *p = *hdr;
+
+	if (!memcmp(p, "blob ", 5)) {
+		*hdr = p + 5;
+		return OBJ_BLOB;
+	}
+	if (!memcmp(p, "tree ", 5)) {
+		*hdr = p + 5;
+		return OBJ_TREE;
+	}
+	if (!memcmp(p, "commit ", 7)) {
+		*hdr = p + 7;
+		return OBJ_COMMIT;
+	}
+	if (!memcmp(p, "tag ", 4)) {
+		*hdr = p + 4;
+		return OBJ_TAG;
+	}
+	return -1;
+}
+
 /*
  * We used to just use "sscanf()", but that's actually way
  * too permissive for what we want to check. So do an anal
@@ -1616,25 +2169,32 @@ static void *unpack_sha1_rest(git_zstream *stream, void *buffer, unsigned long s
  */
 int parse_sha1_header(const char *hdr, unsigned long *sizep)
 {
-	char type[10];
-	int i;
+	char type_name[10];
+	int type;
 	unsigned long size;
 
-	/*
-	 * The type can be at most ten bytes (including the
-	 * terminating '\0' that we add), and is followed by
-	 * a space.
-	 */
-	i = 0;
-	for (;;) {
-		char c = *hdr++;
-		if (c == ' ')
-			break;
-		type[i++] = c;
-		if (i >= sizeof(type))
-			return -1;
+	type = parse_sha1_header_type(&hdr);
+	if (type < 0) {
+		/*
+		 * Not one of the standard types; scan out the name and
+		 * let type_from_string() deal with it below.
+		 *
+		 * The type can be at most ten bytes (including the
+		 * terminating '\0' that we add), and is followed by
+		 * a space.
+		 */
+		int i = 0;
+
+		for (;;) {
+			char c = *hdr++;
+			if (c == ' ')
+				break;
+			type_name[i++] = c;
+			if (i >= sizeof(type_name))
+				return -1;
+		}
+		type_name[i] = 0;
 	}
-	type[i] = 0;
 
 	/*
 	 * The length must follow immediately, and be in canonical
@@ -1657,7 +2217,9 @@ int parse_sha1_header(const char *hdr, unsigned long *sizep)
 	/*
 	 * The length must be followed by a zero byte
 	 */
-	return *hdr ? -1 : type_from_string(type);
+	if (*hdr)
+		return -1;
+	return type < 0 ? type_from_string(type_name) : type;
 }
 
 static void *unpack_sha1_file(void *map, unsigned long mapsize, enum object_type *type, unsigned long *size, const unsigned char *sha1)
@@ -1981,7 +2543,19 @@ static void *unpack_compressed_entry(struct packed_git *p,
 	do {
 		in = use_pack(p, w_curs, curpos, &stream.avail_in);
 		stream.next_in = in;
+		/*
+		 * Note: we must ensure the window section returned by
+		 * use_pack() will be available throughout git_inflate()'s
+		 * execution.  To do so, we pick a section as large as the
+		 * maximum the zlib machinery is willing to consume, and
+		 * keep w_curs pinned (which stops the window from being
+		 * unmapped) while the lock is dropped for the inflation
+		 * itself, which is where concurrent readers spend their
+		 * time.
+		 */
+		obj_read_unlock();
 		st = git_inflate(&stream, Z_FINISH);
+		obj_read_lock();
 		if (!stream.avail_out)
 			break; /* the payload is larger than it should be */
 		curpos += stream.next_in - in;
@@ -1995,59 +2569,154 @@ static void *unpack_compressed_entry(struct packed_git *p,
 	return buffer;
 }
 
-#define MAX_DELTA_CACHE (256)
-
 static size_t delta_base_cached;
 
-static struct delta_base_cache_lru_list {
-	struct delta_base_cache_lru_list *prev;
-	struct delta_base_cache_lru_list *next;
-} delta_base_cache_lru = { &delta_base_cache_lru, &delta_base_cache_lru };
+static unsigned long delta_base_cache_hits;
+static unsigned long delta_base_cache_misses;
+static unsigned long delta_base_cache_evictions;
+static struct trace_key trace_delta_base_cache = TRACE_KEY_INIT(DELTA_BASE_CACHE);
 
-static struct delta_base_cache_entry {
-	struct delta_base_cache_lru_list lru;
-	void *data;
+struct delta_base_cache_key {
 	struct packed_git *p;
 	off_t base_offset;
+};
+
+struct delta_base_cache_entry {
+	struct hashmap_entry ent;
+	struct delta_base_cache_key key;
+	struct delta_base_cache_entry *lru_prev, *lru_next;
+	void *data;
 	unsigned long size;
 	enum object_type type;
-} delta_base_cache[MAX_DELTA_CACHE];
+};
+
+/*
+ * The cached entries live in a hashmap keyed by pack and offset, and
+ * on a doubly-linked LRU chain; eviction walks the chain starting at
+ * lru_oldest, and a cache hit moves the entry back to lru_newest.
+ * Total memory held is bounded by core.deltaBaseCacheLimit.
+ */
+static struct hashmap delta_base_cache;
+static struct delta_base_cache_entry *lru_oldest, *lru_newest;
+
+static void lru_remove(struct delta_base_cache_entry *ent)
+{
+	if (ent->lru_prev)
+		ent->lru_prev->lru_next = ent->lru_next;
+	else
+		lru_oldest = ent->lru_next;
+	if (ent->lru_next)
+		ent->lru_next->lru_prev = ent->lru_prev;
+	else
+		lru_newest = ent->lru_prev;
+}
+
+static void lru_append(struct delta_base_cache_entry *ent)
+{
+	ent->lru_next = NULL;
+	ent->lru_prev = lru_newest;
+	if (lru_newest)
+		lru_newest->lru_next = ent;
+	else
+		lru_oldest = ent;
+	lru_newest = ent;
+}
+
+static void log_delta_base_cache_stats(void)
+{
+	trace_printf_key(&trace_delta_base_cache,
+			 "delta base cache: %lu hits, %lu misses, "
+			 "%lu evictions, %"PRIuMAX" bytes cached at exit\n",
+			 delta_base_cache_hits, delta_base_cache_misses,
+			 delta_base_cache_evictions,
+			 (uintmax_t)delta_base_cached);
+}
+
+static void count_delta_base_cache_event(unsigned long *counter)
+{
+	static int atexit_registered;
+
+	if (!trace_want(&trace_delta_base_cache))
+		return;
+	if (!atexit_registered) {
+		atexit(log_delta_base_cache_stats);
+		atexit_registered = 1;
+	}
+	(*counter)++;
+}
 
-static unsigned long pack_entry_hash(struct packed_git *p, off_t base_offset)
+static unsigned int pack_entry_hash(struct packed_git *p, off_t base_offset)
 {
-	unsigned long hash;
+	unsigned int hash;
 
-	hash = (unsigned long)p + (unsigned long)base_offset;
+	hash = (unsigned int)(intptr_t)p + (unsigned int)base_offset;
 	hash += (hash >> 8) + (hash >> 16);
-	return hash % MAX_DELTA_CACHE;
+	return hash;
+}
+
+static int delta_base_cache_key_eq(const struct delta_base_cache_key *a,
+				   const struct delta_base_cache_key *b)
+{
+	return a->p == b->p && a->base_offset == b->base_offset;
+}
+
+static int delta_base_cache_hash_cmp(const void *va, const void *vb,
+				     const void *vkey)
+{
+	const struct delta_base_cache_entry *a = va, *b = vb;
+	const struct delta_base_cache_key *key = vkey;
+	if (key)
+		return !delta_base_cache_key_eq(&a->key, key);
+	else
+		return !delta_base_cache_key_eq(&a->key, &b->key);
 }
 
 static struct delta_base_cache_entry *
-get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
+lookup_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	unsigned long hash = pack_entry_hash(p, base_offset);
-	return delta_base_cache + hash;
+	struct hashmap_entry entry;
+	struct delta_base_cache_key key;
+
+	if (!delta_base_cache.cmpfn)
+		return NULL;
+
+	hashmap_entry_init(&entry, pack_entry_hash(p, base_offset));
+	key.p = p;
+	key.base_offset = base_offset;
+	return hashmap_get(&delta_base_cache, &entry, &key);
 }
 
-static int eq_delta_base_cache_entry(struct delta_base_cache_entry *ent,
-				     struct packed_git *p, off_t base_offset)
+/*
+ * Like lookup_delta_base_cache(), but counts the lookup as a hit or a
+ * miss; use it for lookups made on behalf of an object access, not for
+ * mere existence probes.
+ */
+static struct delta_base_cache_entry *
+get_delta_base_cache_entry(struct packed_git *p, off_t base_offset)
 {
-	return (ent->data && ent->p == p && ent->base_offset == base_offset);
+	struct delta_base_cache_entry *ent;
+
+	ent = lookup_delta_base_cache(p, base_offset);
+	count_delta_base_cache_event(ent ? &delta_base_cache_hits
+					 : &delta_base_cache_misses);
+	return ent;
 }
 
 static int in_delta_base_cache(struct packed_git *p, off_t base_offset)
 {
-	struct delta_base_cache_entry *ent;
-	ent = get_delta_base_cache_entry(p, base_offset);
-	return eq_delta_base_cache_entry(ent, p, base_offset);
+	return !!lookup_delta_base_cache(p, base_offset);
 }
 
-static void clear_delta_base_cache_entry(struct delta_base_cache_entry *ent)
+/*
+ * Remove the entry from the cache, but do NOT free its data; the
+ * caller takes ownership of it.
+ */
+static void detach_delta_base_cache_entry(struct delta_base_cache_entry *ent)
 {
-	ent->data = NULL;
-	ent->lru.next->prev = ent->lru.prev;
-	ent->lru.prev->next = ent->lru.next;
+	hashmap_remove(&delta_base_cache, ent, &ent->key);
+	lru_remove(ent);
 	delta_base_cached -= ent->size;
+	free(ent);
 }
 
 static void *cache_or_unpack_entry(struct packed_git *p, off_t base_offset,
@@ -2057,74 +2726,81 @@ static void *cache_or_unpack_entry(struct packed_git *p, off_t base_offset,
 	void *ret;
 
 	ent = get_delta_base_cache_entry(p, base_offset);
-
-	if (!eq_delta_base_cache_entry(ent, p, base_offset))
+	if (!ent)
 		return unpack_entry(p, base_offset, type, base_size);
 
-	ret = ent->data;
-
-	if (!keep_cache)
-		clear_delta_base_cache_entry(ent);
-	else
-		ret = xmemdupz(ent->data, ent->size);
 	*type = ent->type;
 	*base_size = ent->size;
+	if (!keep_cache) {
+		ret = ent->data;
+		detach_delta_base_cache_entry(ent);
+	} else {
+		ret = xmemdupz(ent->data, ent->size);
+		/* a hit makes the entry the most recently used again */
+		lru_remove(ent);
+		lru_append(ent);
+	}
 	return ret;
 }
 
-static inline void release_delta_base_cache(struct delta_base_cache_entry *ent)
+static void release_delta_base_cache(struct delta_base_cache_entry *ent)
 {
-	if (ent->data) {
-		free(ent->data);
-		ent->data = NULL;
-		ent->lru.next->prev = ent->lru.prev;
-		ent->lru.prev->next = ent->lru.next;
-		delta_base_cached -= ent->size;
-	}
+	free(ent->data);
+	detach_delta_base_cache_entry(ent);
 }
 
 void clear_delta_base_cache(void)
 {
-	unsigned long p;
-	for (p = 0; p < MAX_DELTA_CACHE; p++)
-		release_delta_base_cache(&delta_base_cache[p]);
+	while (lru_oldest)
+		release_delta_base_cache(lru_oldest);
 }
 
 static void add_delta_base_cache(struct packed_git *p, off_t base_offset,
 	void *base, unsigned long base_size, enum object_type type)
 {
-	unsigned long hash = pack_entry_hash(p, base_offset);
-	struct delta_base_cache_entry *ent = delta_base_cache + hash;
-	struct delta_base_cache_lru_list *lru;
+	struct delta_base_cache_entry *ent, *next;
+
+	/*
+	 * Drilling down through a long chain can come back to a base
+	 * that is already cached; do not add a duplicate entry.
+	 */
+	if (in_delta_base_cache(p, base_offset)) {
+		free(base);
+		return;
+	}
 
-	release_delta_base_cache(ent);
 	delta_base_cached += base_size;
 
-	for (lru = delta_base_cache_lru.next;
-	     delta_base_cached > delta_base_cache_limit
-	     && lru != &delta_base_cache_lru;
-	     lru = lru->next) {
-		struct delta_base_cache_entry *f = (void *)lru;
-		if (f->type == OBJ_BLOB)
-			release_delta_base_cache(f);
+	/* evict blobs first, they are the least likely to be reused */
+	for (ent = lru_oldest;
+	     delta_base_cached > delta_base_cache_limit && ent;
+	     ent = next) {
+		next = ent->lru_next;
+		if (ent->type == OBJ_BLOB) {
+			release_delta_base_cache(ent);
+			count_delta_base_cache_event(&delta_base_cache_evictions);
+		}
 	}
-	for (lru = delta_base_cache_lru.next;
-	     delta_base_cached > delta_base_cache_limit
-	     && lru != &delta_base_cache_lru;
-	     lru = lru->next) {
-		struct delta_base_cache_entry *f = (void *)lru;
-		release_delta_base_cache(f);
+	for (ent = lru_oldest;
+	     delta_base_cached > delta_base_cache_limit && ent;
+	     ent = next) {
+		next = ent->lru_next;
+		release_delta_base_cache(ent);
+		count_delta_base_cache_event(&delta_base_cache_evictions);
 	}
 
-	ent->p = p;
-	ent->base_offset = base_offset;
+	ent = xmalloc(sizeof(*ent));
+	ent->key.p = p;
+	ent->key.base_offset = base_offset;
 	ent->type = type;
 	ent->data = base;
 	ent->size = base_size;
-	ent->lru.next = &delta_base_cache_lru;
-	ent->lru.prev = delta_base_cache_lru.prev;
-	delta_base_cache_lru.prev->next = &ent->lru;
-	delta_base_cache_lru.prev = &ent->lru;
+	lru_append(ent);
+
+	if (!delta_base_cache.cmpfn)
+		hashmap_init(&delta_base_cache, delta_base_cache_hash_cmp, 0);
+	hashmap_entry_init(ent, pack_entry_hash(p, base_offset));
+	hashmap_add(&delta_base_cache, ent);
 }
 
 static void *read_object(const unsigned char *sha1, enum object_type *type,
@@ -2168,11 +2844,11 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		struct delta_base_cache_entry *ent;
 
 		ent = get_delta_base_cache_entry(p, curpos);
-		if (eq_delta_base_cache_entry(ent, p, curpos)) {
+		if (ent) {
 			type = ent->type;
 			data = ent->data;
 			size = ent->size;
-			clear_delta_base_cache_entry(ent);
+			detach_delta_base_cache_entry(ent);
 			base_from_cache = 1;
 			break;
 		}
@@ -2223,6 +2899,21 @@ void *unpack_entry(struct packed_git *p, off_t obj_offset,
 		curpos = obj_offset = base_offset;
 	}
 
+	/*
+	 * The chain we just walked typically sits between the innermost
+	 * base (lowest offset) and the outermost delta; ask the OS to
+	 * start paging the span in before we begin inflating it.  Keep
+	 * the hint bounded so a pathological chain does not madvise
+	 * half the pack.
+	 */
+	if (delta_stack_nr && !base_from_cache) {
+		off_t span_start = curpos < obj_offset ? curpos : obj_offset;
+		off_t span_end = curpos > obj_offset ? curpos : obj_offset;
+
+		if (span_end - span_start <= 32 * 1024 * 1024)
+			pack_window_prefetch(p, span_start, span_end);
+	}
+
 	/* PHASE 2: handle the base */
 	switch (type) {
 	case OBJ_OFS_DELTA:
@@ -2365,12 +3056,36 @@ off_t nth_packed_object_offset(const struct packed_git *p, uint32_t n)
 	}
 }
 
+/*
+ * The 20-byte-per-entry SHA-1 table is unkind to binary search: every
+ * probe drags in a cache line that is mostly bytes the comparison
+ * never looks at.  Build a dense table of the first four bytes of
+ * each object name, so the search mostly runs over a packed uint32_t
+ * array and touches the full-width table only to confirm, or break a
+ * tie on, a matching prefix.
+ */
+static void load_sha1_prefixes(struct packed_git *p)
+{
+	uint32_t i;
+
+	p->sha1_prefixes = xmalloc(p->num_objects * sizeof(uint32_t));
+	for (i = 0; i < p->num_objects; i++) {
+		const unsigned char *sha1 = nth_packed_object_sha1(p, i);
+
+		p->sha1_prefixes[i] = ((uint32_t)sha1[0] << 24) |
+				      ((uint32_t)sha1[1] << 16) |
+				      ((uint32_t)sha1[2] << 8) |
+				       (uint32_t)sha1[3];
+	}
+}
+
 off_t find_pack_entry_one(const unsigned char *sha1,
 				  struct packed_git *p)
 {
 	const uint32_t *level1_ofs = p->index_data;
 	const unsigned char *index = p->index_data;
 	unsigned hi, lo, stride;
+	uint32_t prefix;
 	static int use_lookup = -1;
 	static int debug_lookup = -1;
 
@@ -2411,16 +3126,30 @@ off_t find_pack_entry_one(const unsigned char *sha1,
 		return nth_packed_object_offset(p, pos);
 	}
 
+	if (!p->sha1_prefixes)
+		load_sha1_prefixes(p);
+	prefix = ((uint32_t)sha1[0] << 24) | ((uint32_t)sha1[1] << 16) |
+		 ((uint32_t)sha1[2] << 8) | (uint32_t)sha1[3];
+
 	do {
 		unsigned mi = (lo + hi) / 2;
-		int cmp = hashcmp(index + mi * stride, sha1);
+		int cmp;
+
+		/*
+		 * The dense prefix table decides almost every probe;
+		 * only a matching prefix needs the full-width entry.
+		 */
+		if (prefix != p->sha1_prefixes[mi])
+			cmp = prefix < p->sha1_prefixes[mi] ? -1 : 1;
+		else
+			cmp = hashcmp(sha1, index + mi * stride);
 
 		if (debug_lookup)
 			printf("lo %u hi %u rg %u mi %u\n",
 			       lo, hi, hi - lo, mi);
 		if (!cmp)
 			return nth_packed_object_offset(p, mi);
-		if (cmp > 0)
+		if (cmp < 0)
 			hi = mi;
 		else
 			lo = mi+1;
@@ -2483,6 +3212,29 @@ static int fill_pack_entry(const unsigned char *sha1,
 	return 1;
 }
 
+static int fill_midx_entry(const unsigned char *sha1, struct pack_entry *e)
+{
+	struct packed_git *p;
+	off_t offset;
+
+	if (!midx_lookup(sha1, &p, &offset))
+		return 0;
+
+	if (p->num_bad_objects) {
+		unsigned i;
+		for (i = 0; i < p->num_bad_objects; i++)
+			if (!hashcmp(sha1, p->bad_object_sha1 + 20 * i))
+				return 0;
+	}
+
+	if (!is_pack_valid(p))
+		return 0;
+	e->offset = offset;
+	e->p = p;
+	hashcpy(e->sha1, sha1);
+	return 1;
+}
+
 /*
  * Iff a pack file contains the object named by sha1, return true and
  * store its location to e.
@@ -2498,6 +3250,9 @@ static int find_pack_entry(const unsigned char *sha1, struct pack_entry *e)
 	if (last_found_pack && fill_pack_entry(sha1, e, last_found_pack))
 		return 1;
 
+	if (fill_midx_entry(sha1, e))
+		return 1;
+
 	for (p = packed_git; p; p = p->next) {
 		if (p == last_found_pack)
 			continue; /* we already checked this one */
@@ -2523,6 +3278,71 @@ struct packed_git *find_sha1_pack(const unsigned char *sha1,
 
 }
 
+/*
+ * The object store is content addressed, so the type and size behind
+ * a given sha1 can never change; remember headers we have parsed so
+ * that repeated info queries (common during status and log bursts in
+ * a repository with many loose objects) do not pay an mmap and an
+ * inflate every time.
+ *
+ * Only accessed from sha1_loose_object_info(), which runs under
+ * obj_read_lock() when object reading is threaded.
+ */
+struct loose_info_cache_entry {
+	struct hashmap_entry ent;
+	unsigned char sha1[20];
+	enum object_type type;
+	unsigned long size;
+	unsigned long disk_size;
+};
+
+static struct hashmap loose_info_cache;
+
+/*
+ * Entries are small, but a pre-gc repository can hold millions of
+ * loose objects; rather than grow without bound, throw the cache away
+ * and start over when it fills up.
+ */
+#define LOOSE_INFO_CACHE_LIMIT (64 * 1024)
+
+static int loose_info_cache_cmp(const void *va, const void *vb,
+				const void *vkey)
+{
+	const struct loose_info_cache_entry *a = va, *b = vb;
+	const unsigned char *key = vkey;
+
+	return hashcmp(a->sha1, key ? key : b->sha1);
+}
+
+static struct loose_info_cache_entry *
+lookup_loose_info_cache(const unsigned char *sha1)
+{
+	if (!loose_info_cache.cmpfn)
+		return NULL;
+	return hashmap_get_from_hash(&loose_info_cache, sha1hash(sha1), sha1);
+}
+
+static void add_loose_info_cache(const unsigned char *sha1,
+				 enum object_type type, unsigned long size,
+				 unsigned long disk_size)
+{
+	struct loose_info_cache_entry *ent;
+
+	if (loose_info_cache.cmpfn &&
+	    loose_info_cache.size >= LOOSE_INFO_CACHE_LIMIT)
+		hashmap_free(&loose_info_cache, 1);
+	if (!loose_info_cache.cmpfn)
+		hashmap_init(&loose_info_cache, loose_info_cache_cmp, 0);
+
+	ent = xmalloc(sizeof(*ent));
+	hashmap_entry_init(ent, sha1hash(sha1));
+	hashcpy(ent->sha1, sha1);
+	ent->type = type;
+	ent->size = size;
+	ent->disk_size = disk_size;
+	hashmap_add(&loose_info_cache, ent);
+}
+
 static int sha1_loose_object_info(const unsigned char *sha1,
 				  struct object_info *oi)
 {
@@ -2531,10 +3351,27 @@ static int sha1_loose_object_info(const unsigned char *sha1,
 	void *map;
 	git_zstream stream;
 	char hdr[32];
+	struct loose_info_cache_entry *cached;
 
 	if (oi->delta_base_sha1)
 		hashclr(oi->delta_base_sha1);
 
+	/*
+	 * A header we parsed earlier in this process is still good;
+	 * this also answers pure existence checks without even a
+	 * stat().
+	 */
+	cached = lookup_loose_info_cache(sha1);
+	if (cached) {
+		if (oi->typep)
+			*oi->typep = cached->type;
+		if (oi->sizep)
+			*oi->sizep = cached->size;
+		if (oi->disk_sizep)
+			*oi->disk_sizep = cached->disk_size;
+		return 0;
+	}
+
 	/*
 	 * If we don't care about type or size, then we don't
 	 * need to look inside the object at all. Note that we
@@ -2565,13 +3402,15 @@ static int sha1_loose_object_info(const unsigned char *sha1,
 	else if (oi->sizep)
 		*oi->sizep = size;
 	git_inflate_end(&stream);
+	if (status >= 0)
+		add_loose_info_cache(sha1, status, size, mapsize);
 	munmap(map, mapsize);
 	if (oi->typep)
 		*oi->typep = status;
 	return 0;
 }
 
-int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi, unsigned flags)
+static int do_sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi, unsigned flags)
 {
 	struct cached_object *co;
 	struct pack_entry e;
@@ -2592,6 +3431,15 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 		return 0;
 	}
 
+	if (bulk_checkin_pending_object(real, oi->typep, oi->sizep, NULL)) {
+		if (oi->disk_sizep)
+			*oi->disk_sizep = 0;
+		if (oi->delta_base_sha1)
+			hashclr(oi->delta_base_sha1);
+		oi->whence = OI_CACHED;
+		return 0;
+	}
+
 	if (!find_pack_entry(real, &e)) {
 		/* Most likely it's a loose object. */
 		if (!sha1_loose_object_info(real, oi)) {
@@ -2608,7 +3456,7 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 	rtype = packed_object_info(e.p, e.offset, oi);
 	if (rtype < 0) {
 		mark_bad_packed_object(e.p, real);
-		return sha1_object_info_extended(real, oi, 0);
+		return do_sha1_object_info_extended(real, oi, 0);
 	} else if (in_delta_base_cache(e.p, e.offset)) {
 		oi->whence = OI_DBCACHED;
 	} else {
@@ -2622,6 +3470,29 @@ int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi,
 	return 0;
 }
 
+int sha1_object_info_extended(const unsigned char *sha1, struct object_info *oi, unsigned flags)
+{
+	int ret;
+
+	/*
+	 * A configured object info server can answer the common
+	 * type/size queries without this process mapping any pack
+	 * index.  Anything it cannot answer falls through to the
+	 * regular lookup.
+	 */
+	if (!oi->delta_base_sha1 && !info_server_object_info(sha1, oi, flags)) {
+		oi->whence = OI_DBCACHED;
+		return 0;
+	}
+
+	obj_read_lock();
+	ret = do_sha1_object_info_extended(sha1, oi, flags);
+	if (ret < 0 && !fetch_missing_object(sha1))
+		ret = do_sha1_object_info_extended(sha1, oi, flags);
+	obj_read_unlock();
+	return ret;
+}
+
 /* returns enum object_type or negative */
 int sha1_object_info(const unsigned char *sha1, unsigned long *sizep)
 {
@@ -2684,24 +3555,57 @@ static void *read_object(const unsigned char *sha1, enum object_type *type,
 	void *map, *buf;
 	struct cached_object *co;
 
+	obj_read_lock();
+
+	trace_event_counter_add("objects_read", 1);
+
 	co = find_cached_object(sha1);
 	if (co) {
 		*type = co->type;
 		*size = co->size;
-		return xmemdupz(co->buf, co->size);
+		buf = xmemdupz(co->buf, co->size);
+		goto out;
 	}
 
+	if (bulk_checkin_pending_object(sha1, type, size, &buf))
+		goto out;
+
 	buf = read_packed_sha1(sha1, type, size);
 	if (buf)
-		return buf;
+		goto out;
 	map = map_sha1_file(sha1, &mapsize);
 	if (map) {
+		/*
+		 * The mapping is private to us; only the inflation
+		 * machinery runs on it, so other readers need not wait.
+		 */
+		obj_read_unlock();
 		buf = unpack_sha1_file(map, mapsize, type, size, sha1);
 		munmap(map, mapsize);
 		return buf;
 	}
 	reprepare_packed_git();
-	return read_packed_sha1(sha1, type, size);
+	buf = read_packed_sha1(sha1, type, size);
+
+	/*
+	 * A blob-less repository can still ask the origin it was
+	 * cloned from to supply the object on demand.
+	 */
+	if (!buf && !fetch_missing_object(sha1)) {
+		buf = read_packed_sha1(sha1, type, size);
+		if (!buf) {
+			map = map_sha1_file(sha1, &mapsize);
+			if (map) {
+				obj_read_unlock();
+				buf = unpack_sha1_file(map, mapsize, type, size, sha1);
+				munmap(map, mapsize);
+				return buf;
+			}
+		}
+	}
+out:
+	obj_read_unlock();
+	return buf;
 }
 
 /*
@@ -2797,16 +3701,16 @@ static void write_sha1_file_prepare(const void *buf, unsigned long len,
                                     const char *type, unsigned char *sha1,
                                     char *hdr, int *hdrlen)
 {
-	git_SHA_CTX c;
+	git_hash_ctx c;
 
 	/* Generate the header */
 	*hdrlen = sprintf(hdr, "%s %lu", type, len)+1;
 
 	/* Sha1.. */
-	git_SHA1_Init(&c);
-	git_SHA1_Update(&c, hdr, *hdrlen);
-	git_SHA1_Update(&c, buf, len);
-	git_SHA1_Final(sha1, &c);
+	the_hash_algo->init_fn(&c);
+	the_hash_algo->update_fn(&c, hdr, *hdrlen);
+	the_hash_algo->update_fn(&c, buf, len);
+	the_hash_algo->final_fn(sha1, &c);
 }
 
 /*
@@ -2874,7 +3778,10 @@ int hash_sha1_file(const void *buf, unsigned long len, const char *type,
 /* Finalize a file on disk, and close it. */
 static void close_sha1_file(int fd)
 {
-	if (fsync_object_files)
+	if (fsync_object_files == FSYNC_OBJECT_FILES_BATCH &&
+	    bulk_checkin_defer_fsync(fd))
+		; /* one flush at unplug time covers this object */
+	else if (fsync_object_files)
 		fsync_or_die(fd, "sha1 file");
 	if (close(fd) != 0)
 		die_errno("error when closing sha1 file");
@@ -2923,13 +3830,132 @@ static int create_tmpfile(char *buffer, size_t bufsiz, const char *filename)
 	return fd;
 }
 
+/*
+ * Book-keeping for "gc --auto": objects/info/loose-object-count grows
+ * by one byte for every loose object we create, so its size is an
+ * exact count of the loose objects written since the file was last
+ * reset by gc.  The single-byte O_APPEND writes are atomic, which
+ * lets any number of processes maintain the count without locking.
+ * The count can only drift upwards (nothing decrements it when
+ * objects are pruned outside of gc), so at worst it triggers a gc a
+ * little early, and gc resets it from a real scan when it is done.
+ */
+#define LOOSE_OBJECT_COUNT_FILE "info/loose-object-count"
+
+static void count_loose_object_write(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	int fd;
+
+	strbuf_addf(&path, "%s/%s", get_object_directory(),
+		    LOOSE_OBJECT_COUNT_FILE);
+	fd = open(path.buf, O_WRONLY | O_APPEND);
+	if (fd < 0 && errno == ENOENT) {
+		fd = open(path.buf, O_WRONLY | O_APPEND | O_CREAT, 0666);
+		if (0 <= fd)
+			adjust_shared_perm(path.buf);
+	}
+	if (0 <= fd) {
+		if (write_in_full(fd, "\n", 1) < 0)
+			; /* best effort; the fallback is a scan */
+		close(fd);
+	}
+	strbuf_release(&path);
+}
+
+int get_loose_object_count(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	struct stat st;
+	int ret = -1;
+
+	strbuf_addf(&path, "%s/%s", get_object_directory(),
+		    LOOSE_OBJECT_COUNT_FILE);
+	if (!stat(path.buf, &st))
+		ret = st.st_size < INT_MAX ? (int)st.st_size : INT_MAX;
+	strbuf_release(&path);
+	return ret;
+}
+
+void reset_loose_object_count(void)
+{
+	struct strbuf path = STRBUF_INIT;
+	const char *objdir = get_object_directory();
+	unsigned long count = 0;
+	char chunk[1024];
+	int i, fd;
+
+	for (i = 0; i < 256; i++) {
+		DIR *dir;
+		struct dirent *ent;
+
+		strbuf_reset(&path);
+		strbuf_addf(&path, "%s/%02x", objdir, i);
+		dir = opendir(path.buf);
+		if (!dir)
+			continue;
+		while ((ent = readdir(dir)) != NULL) {
+			if (strspn(ent->d_name, "0123456789abcdef") == 38 &&
+			    ent->d_name[38] == '\0')
+				count++;
+		}
+		closedir(dir);
+	}
+
+	strbuf_reset(&path);
+	strbuf_addf(&path, "%s/%s", objdir, LOOSE_OBJECT_COUNT_FILE);
+	fd = open(path.buf, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (fd < 0) {
+		strbuf_release(&path);
+		return;
+	}
+	adjust_shared_perm(path.buf);
+	memset(chunk, '\n', sizeof(chunk));
+	while (count) {
+		unsigned long n = count < sizeof(chunk) ? count : sizeof(chunk);
+
+		if (write_in_full(fd, chunk, n) < 0)
+			break;
+		count -= n;
+	}
+	close(fd);
+	strbuf_release(&path);
+}
+
+/*
+ * Append a creation-time record for a loose object to
+ * objects/info/object-times.  The log is advisory: prune uses it to
+ * recognize objects too young to expire without stat()ing them and
+ * falls back to lstat() for anything the log does not cover, so a
+ * failed append costs a stat later but is never wrong.
+ */
+static void log_object_time(const unsigned char *sha1, time_t mtime)
+{
+	struct strbuf line = STRBUF_INIT;
+	int fd;
+
+	if (!log_object_times)
+		return;
+	fd = open(mkpath("%s/info/object-times", get_object_directory()),
+		  O_WRONLY | O_CREAT | O_APPEND, 0666);
+	if (fd < 0)
+		return;
+	strbuf_addf(&line, "%lu %s\n",
+		    (unsigned long)(mtime ? mtime : time(NULL)),
+		    sha1_to_hex(sha1));
+	/* advisory only; if this fails the next prune will stat instead */
+	write_in_full(fd, line.buf, line.len);
+	close(fd);
+	strbuf_release(&line);
+}
+
 static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 			      const void *buf, unsigned long len, time_t mtime)
 {
 	int fd, ret;
 	unsigned char compressed[4096];
 	git_zstream stream;
-	git_SHA_CTX c;
+	git_hash_ctx c;
 	unsigned char parano_sha1[20];
 	static char tmp_file[PATH_MAX];
 	const char *filename = sha1_file_name(sha1);
@@ -2946,14 +3972,14 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 	git_deflate_init(&stream, zlib_compression_level);
 	stream.next_out = compressed;
 	stream.avail_out = sizeof(compressed);
-	git_SHA1_Init(&c);
+	the_hash_algo->init_fn(&c);
 
 	/* First header.. */
 	stream.next_in = (unsigned char *)hdr;
 	stream.avail_in = hdrlen;
 	while (git_deflate(&stream, 0) == Z_OK)
 		; /* nothing */
-	git_SHA1_Update(&c, hdr, hdrlen);
+	the_hash_algo->update_fn(&c, hdr, hdrlen);
 
 	/* Then the data itself.. */
 	stream.next_in = (void *)buf;
@@ -2961,7 +3987,7 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 	do {
 		unsigned char *in0 = stream.next_in;
 		ret = git_deflate(&stream, Z_FINISH);
-		git_SHA1_Update(&c, in0, stream.next_in - in0);
+		the_hash_algo->update_fn(&c, in0, stream.next_in - in0);
 		if (write_buffer(fd, compressed, stream.next_out - compressed) < 0)
 			die("unable to write sha1 file");
 		stream.next_out = compressed;
@@ -2973,7 +3999,7 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 	ret = git_deflate_end_gently(&stream);
 	if (ret != Z_OK)
 		die("deflateEnd on object %s failed (%d)", sha1_to_hex(sha1), ret);
-	git_SHA1_Final(parano_sha1, &c);
+	the_hash_algo->final_fn(parano_sha1, &c);
 	if (hashcmp(sha1, parano_sha1) != 0)
 		die("confused by unstable object source data for %s", sha1_to_hex(sha1));
 
@@ -2988,7 +4014,12 @@ static int write_loose_object(const unsigned char *sha1, char *hdr, int hdrlen,
 				tmp_file, strerror(errno));
 	}
 
-	return move_temp_to_file(tmp_file, filename);
+	ret = move_temp_to_file(tmp_file, filename);
+	if (!ret) {
+		count_loose_object_write();
+		log_object_time(sha1, mtime);
+	}
+	return ret;
 }
 
 static int freshen_loose_object(const unsigned char *sha1)
@@ -3021,7 +4052,13 @@ int write_sha1_file(const void *buf, unsigned long len, const char *type, unsign
 	write_sha1_file_prepare(buf, len, type, sha1, hdr, &hdrlen);
 	if (returnsha1)
 		hashcpy(returnsha1, sha1);
-	if (freshen_packed_object(sha1) || freshen_loose_object(sha1))
+	if (freshen_packed_object(sha1))
+		return 0;
+	if (freshen_loose_object(sha1)) {
+		log_object_time(sha1, 0);
+		return 0;
+	}
+	if (!bulk_checkin_write_object(sha1, buf, len, type))
 		return 0;
 	return write_loose_object(sha1, hdr, hdrlen, buf, len, 0);
 }
@@ -3064,13 +4101,21 @@ int has_sha1_pack(const unsigned char *sha1)
 int has_sha1_file(const unsigned char *sha1)
 {
 	struct pack_entry e;
+	int ret = 1;
 
+	obj_read_lock();
 	if (find_pack_entry(sha1, &e))
-		return 1;
-	if (has_loose_object(sha1))
-		return 1;
-	reprepare_packed_git();
-	return find_pack_entry(sha1, &e);
+		; /* found in a pack */
+	else if (has_loose_object(sha1))
+		; /* found loose */
+	else if (bulk_checkin_pending_object(sha1, NULL, NULL, NULL))
+		; /* pending in the bulk-checkin pack */
+	else {
+		reprepare_packed_git();
+		ret = find_pack_entry(sha1, &e);
+	}
+	obj_read_unlock();
+	return ret;
 }
 
 static void check_tree(const void *buf, size_t size)
@@ -367,6 +367,34 @@ int for_each_abbrev(const char *prefix, each_abbrev_fn fn, void *cb_data)
 	return ds.ambiguous;
 }
 
+/*
+ * Estimate the shortest abbreviation length expected to be unique
+ * across the whole repository, based on the object count from the
+ * pack indexes.  With on the order of 2^n objects, collisions are
+ * expected once abbreviations carry fewer than 2n bits, i.e. n/2 hex
+ * digits.  This is only a starting point for the probe loop below,
+ * which still verifies uniqueness of each individual abbreviation;
+ * computing it once saves the repeated short-name lookups that the
+ * loop would otherwise spend growing past lengths that cannot
+ * possibly be unique in a large repository.
+ */
+static int estimate_abbrev_len(void)
+{
+	static int cached_len = -1;
+
+	if (cached_len < 0) {
+		unsigned long count = approximate_object_count();
+		int bits = 0;
+
+		while (count) {
+			bits++;
+			count >>= 1;
+		}
+		cached_len = DIV_ROUND_UP(bits, 2);
+	}
+	return cached_len;
+}
+
 const char *find_unique_abbrev(const unsigned char *sha1, int len)
 {
 	int status, exists;
@@ -375,6 +403,8 @@ const char *find_unique_abbrev(const unsigned char *sha1, int len)
 	memcpy(hex, sha1_to_hex(sha1), 40);
 	if (len == 40 || !len)
 		return hex;
+	if (len == DEFAULT_ABBREV && len < estimate_abbrev_len())
+		len = estimate_abbrev_len();
 	exists = has_sha1_file(sha1);
 	while (len < 40) {
 		unsigned char sha1_ret[20];
@@ -137,6 +137,121 @@ struct commit_list *get_shallow_commits(struct object_array *heads, int depth,
 	return result;
 }
 
+/*
+ * The shallow boundary for a given depth is fully determined by the
+ * tips it was computed from, so a cached result never goes stale; it
+ * only becomes unusable if a cached commit has been pruned away.
+ * Cache files live under objects/info/shallow-cache/, keyed by a hash
+ * over the depth and the sorted tip set, one boundary commit per
+ * line.
+ */
+static void hash_one_tip(const unsigned char sha1[20], void *cb_data)
+{
+	git_hash_ctx *ctx = cb_data;
+	the_hash_algo->update_fn(ctx, sha1, 20);
+}
+
+static char *shallow_cache_path(struct object_array *heads, int depth)
+{
+	struct sha1_array tips = SHA1_ARRAY_INIT;
+	git_hash_ctx ctx;
+	unsigned char key[GIT_MAX_RAWSZ];
+	uint32_t depth_be = htonl(depth);
+	int i;
+
+	for (i = 0; i < heads->nr; i++) {
+		struct object *o =
+			deref_tag(heads->objects[i].item, NULL, 0);
+		if (o && o->type == OBJ_COMMIT)
+			sha1_array_append(&tips, o->sha1);
+	}
+	if (!tips.nr)
+		return NULL;
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, &depth_be, sizeof(depth_be));
+	sha1_array_for_each_unique(&tips, hash_one_tip, &ctx);
+	the_hash_algo->final_fn(key, &ctx);
+	sha1_array_clear(&tips);
+	return git_pathdup("objects/info/shallow-cache/%s",
+			   sha1_to_hex(key));
+}
+
+struct commit_list *get_cached_shallow_commits(struct object_array *heads,
+					       int depth, int shallow_flag)
+{
+	struct commit_list *result = NULL;
+	char *path;
+	FILE *fp;
+	char buf[1024];
+
+	if (depth == INFINITE_DEPTH || is_repository_shallow())
+		return NULL;
+	path = shallow_cache_path(heads, depth);
+	if (!path)
+		return NULL;
+	fp = fopen(path, "r");
+	free(path);
+	if (!fp)
+		return NULL;
+	while (fgets(buf, sizeof(buf), fp)) {
+		unsigned char sha1[20];
+		struct commit *commit;
+		if (get_sha1_hex(buf, sha1) ||
+		    !(commit = lookup_commit_reference_gently(sha1, 1))) {
+			/* pruned or corrupt; fall back to the real walk */
+			struct commit_list *p;
+			for (p = result; p; p = p->next)
+				p->item->object.flags &= ~shallow_flag;
+			free_commit_list(result);
+			fclose(fp);
+			return NULL;
+		}
+		commit->object.flags |= shallow_flag;
+		commit_list_insert(commit, &result);
+	}
+	fclose(fp);
+	return result;
+}
+
+void cache_shallow_commits(struct object_array *heads, int depth,
+			   const struct commit_list *result,
+			   int not_shallow_flag)
+{
+	struct strbuf sb = STRBUF_INIT;
+	struct strbuf tmp = STRBUF_INIT;
+	char *path;
+	int fd;
+
+	if (depth == INFINITE_DEPTH || is_repository_shallow())
+		return;
+	path = shallow_cache_path(heads, depth);
+	if (!path)
+		return;
+	for (; result; result = result->next) {
+		if (result->item->object.flags & not_shallow_flag)
+			continue;
+		strbuf_addf(&sb, "%s\n",
+			    sha1_to_hex(result->item->object.sha1));
+	}
+	/*
+	 * Purely best effort: upload-pack may well be serving a
+	 * repository it has no permission to write to.
+	 */
+	if (safe_create_leading_directories(path))
+		goto done;
+	strbuf_addf(&tmp, "%s.XXXXXX", path);
+	fd = mkstemp(tmp.buf);
+	if (fd < 0)
+		goto done;
+	if (write_in_full(fd, sb.buf, sb.len) != sb.len || close(fd) ||
+	    rename(tmp.buf, path))
+		unlink(tmp.buf);
+done:
+	free(path);
+	strbuf_release(&tmp);
+	strbuf_release(&sb);
+}
+
 static void check_shallow_file_for_update(void)
 {
 	if (is_shallow == -1)
@@ -280,17 +395,18 @@ void setup_alternate_shallow(struct lock_file *shallow_lock,
 
 static int advertise_shallow_grafts_cb(const struct commit_graft *graft, void *cb)
 {
-	int fd = *(int *)cb;
+	struct packet_writer *writer = cb;
 	if (graft->nr_parent == -1)
-		packet_write(fd, "shallow %s\n", oid_to_hex(&graft->oid));
+		packet_writer_write(writer, "shallow %s\n",
+				    oid_to_hex(&graft->oid));
 	return 0;
 }
 
-void advertise_shallow_grafts(int fd)
+void advertise_shallow_grafts(struct packet_writer *writer)
 {
 	if (!is_repository_shallow())
 		return;
-	for_each_commit_graft(advertise_shallow_grafts_cb, &fd);
+	for_each_commit_graft(advertise_shallow_grafts_cb, writer);
 }
 
 /*
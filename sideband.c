@@ -20,6 +20,55 @@
 
 #define FIX_SIZE 10  /* large enough for any of the above */
 
+/*
+ * Number of frames we are willing to hand to a single writev().
+ * POSIX only guarantees IOV_MAX >= 16, and send_sideband() uses two
+ * iovecs per frame (header plus payload), so stay at eight.
+ */
+#define SIDEBAND_WRITEV_FRAMES 8
+
+/*
+ * Flush the accumulated band #1 payloads in a single vectored write.
+ */
+static void demux_flush(int out, struct iovec *iov, int *cnt, size_t *used)
+{
+	if (*cnt)
+		write_or_die_iov(out, iov, *cnt);
+	*cnt = 0;
+	*used = 0;
+}
+
+#ifdef HAVE_SPLICE
+/*
+ * Move len band-1 payload bytes from in_stream to out in the kernel.
+ * Returns -1 with nothing consumed when splice(2) cannot handle this
+ * fd pair (neither side is a pipe), so the caller can fall back to
+ * copying through userspace; dies if the stream breaks once payload
+ * has started moving.
+ */
+static int splice_payload(int in_stream, int out, int len)
+{
+	int spliced = 0;
+
+	while (len) {
+		ssize_t n = splice(in_stream, NULL, out, NULL, len,
+				   SPLICE_F_MORE);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			if (!spliced && (errno == EINVAL || errno == ENOSYS))
+				return -1;
+			die_errno("read error");
+		}
+		if (!n)
+			die("The remote end hung up unexpectedly");
+		spliced += n;
+		len -= n;
+	}
+	return 0;
+}
+#endif
+
 int recv_sideband(const char *me, int in_stream, int out)
 {
 	unsigned pf = strlen(PREFIX);
@@ -27,6 +76,14 @@ int recv_sideband(const char *me, int in_stream, int out)
 	char buf[LARGE_PACKET_MAX + 2*FIX_SIZE];
 	char *suffix, *term;
 	int skip_pf = 0;
+	char *payload_buf = xmalloc((size_t)SIDEBAND_WRITEV_FRAMES * LARGE_PACKET_MAX);
+	struct iovec payload_iov[SIDEBAND_WRITEV_FRAMES];
+	int payload_cnt = 0;
+	size_t payload_used = 0;
+	int retval = 0;
+#ifdef HAVE_SPLICE
+	int use_splice = 1;
+#endif
 
 	memcpy(buf, PREFIX, pf);
 	term = getenv("TERM");
@@ -38,22 +95,62 @@ int recv_sideband(const char *me, int in_stream, int out)
 
 	while (1) {
 		int band, len;
-		len = packet_read(in_stream, NULL, NULL, buf + pf, LARGE_PACKET_MAX, 0);
-		if (len == 0)
-			break;
-		if (len < 1) {
-			fprintf(stderr, "%s: protocol error: no band designator\n", me);
-			return SIDEBAND_PROTOCOL_ERROR;
+		char *frame = payload_buf + payload_used;
+
+#ifdef HAVE_SPLICE
+		if (use_splice) {
+			/*
+			 * Read only the header and band designator in
+			 * userspace; band #1 payload can then go from
+			 * the remote to out entirely in the kernel.
+			 */
+			len = packet_read_header(in_stream);
+			if (len == 0)
+				break;
+			if (read_in_full(in_stream, frame, 1) != 1)
+				die("The remote end hung up unexpectedly");
+			band = frame[0] & 0xff;
+			len--;
+			if (band == 1) {
+				if (!splice_payload(in_stream, out, len))
+					continue;
+				/* fd pair not spliceable; copy instead */
+				use_splice = 0;
+			}
+			if (read_in_full(in_stream, frame + 1, len) != len)
+				die("The remote end hung up unexpectedly");
+			frame[1 + len] = '\0';
+		} else
+#endif
+		{
+			len = packet_read(in_stream, NULL, NULL, frame,
+					  LARGE_PACKET_MAX, 0);
+			if (len == 0)
+				break;
+			if (len < 1) {
+				demux_flush(out, payload_iov, &payload_cnt,
+					    &payload_used);
+				fprintf(stderr, "%s: protocol error: no band designator\n", me);
+				retval = SIDEBAND_PROTOCOL_ERROR;
+				goto cleanup;
+			}
+			band = frame[0] & 0xff;
+			len--;
 		}
-		band = buf[pf] & 0xff;
-		len--;
 		switch (band) {
 		case 3:
+			demux_flush(out, payload_iov, &payload_cnt,
+				    &payload_used);
+			memcpy(buf + pf + 1, frame + 1, len);
 			buf[pf] = ' ';
 			buf[pf+1+len] = '\0';
 			fprintf(stderr, "%s\n", buf);
-			return SIDEBAND_REMOTE_ERROR;
+			retval = SIDEBAND_REMOTE_ERROR;
+			goto cleanup;
 		case 2:
+			demux_flush(out, payload_iov, &payload_cnt,
+				    &payload_used);
+			memcpy(buf + pf + 1, frame + 1, len);
 			buf[pf] = ' ';
 			do {
 				char *b = buf;
@@ -109,20 +206,42 @@ int recv_sideband(const char *me, int in_stream, int out)
 			} while (len);
 			continue;
 		case 1:
-			write_or_die(out, buf + pf+1, len);
+			/*
+			 * The payload stays where packet_read() put it;
+			 * just point an iovec past the band designator so
+			 * consecutive frames go out in one writev().
+			 */
+			payload_iov[payload_cnt].iov_base = frame + 1;
+			payload_iov[payload_cnt].iov_len = len;
+			payload_cnt++;
+			payload_used += len + 1;
+			if (payload_cnt == SIDEBAND_WRITEV_FRAMES ||
+			    payload_used + LARGE_PACKET_MAX >
+			    (size_t)SIDEBAND_WRITEV_FRAMES * LARGE_PACKET_MAX)
+				demux_flush(out, payload_iov, &payload_cnt,
+					    &payload_used);
 			continue;
 		default:
+			demux_flush(out, payload_iov, &payload_cnt,
+				    &payload_used);
 			fprintf(stderr, "%s: protocol error: bad band #%d\n",
 				me, band);
-			return SIDEBAND_PROTOCOL_ERROR;
+			retval = SIDEBAND_PROTOCOL_ERROR;
+			goto cleanup;
 		}
 	}
-	return 0;
+	demux_flush(out, payload_iov, &payload_cnt, &payload_used);
+cleanup:
+	free(payload_buf);
+	return retval;
 }
 
 /*
  * fd is connected to the remote side; send the sideband data
- * over multiplexed packet stream.
+ * over multiplexed packet stream.  Frames are batched so that a
+ * large payload costs one writev() per SIDEBAND_WRITEV_FRAMES
+ * frames instead of two write()s per frame, and the payload bytes
+ * go to the kernel straight from the caller's buffer.
  */
 ssize_t send_sideband(int fd, int band, const char *data, ssize_t sz, int packet_max)
 {
@@ -130,23 +249,33 @@ ssize_t send_sideband(int fd, int band, const char *data, ssize_t sz, int packet
 	const char *p = data;
 
 	while (sz) {
-		unsigned n;
-		char hdr[5];
-
-		n = sz;
-		if (packet_max - 5 < n)
-			n = packet_max - 5;
-		if (0 <= band) {
-			sprintf(hdr, "%04x", n + 5);
-			hdr[4] = band;
-			write_or_die(fd, hdr, 5);
-		} else {
-			sprintf(hdr, "%04x", n + 4);
-			write_or_die(fd, hdr, 4);
+		struct iovec iov[2 * SIDEBAND_WRITEV_FRAMES];
+		char hdr[SIDEBAND_WRITEV_FRAMES][5];
+		int frames = 0;
+
+		while (sz && frames < SIDEBAND_WRITEV_FRAMES) {
+			unsigned n = sz;
+			unsigned hn;
+
+			if (packet_max - 5 < n)
+				n = packet_max - 5;
+			if (0 <= band) {
+				sprintf(hdr[frames], "%04x", n + 5);
+				hdr[frames][4] = band;
+				hn = 5;
+			} else {
+				sprintf(hdr[frames], "%04x", n + 4);
+				hn = 4;
+			}
+			iov[2 * frames].iov_base = hdr[frames];
+			iov[2 * frames].iov_len = hn;
+			iov[2 * frames + 1].iov_base = (char *)p;
+			iov[2 * frames + 1].iov_len = n;
+			frames++;
+			p += n;
+			sz -= n;
 		}
-		write_or_die(fd, p, n);
-		p += n;
-		sz -= n;
+		write_or_die_iov(fd, iov, 2 * frames);
 	}
 	return ssz;
 }
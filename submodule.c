@@ -685,39 +685,30 @@ static void calculate_changed_submodule_paths(void)
 	initialized_fetch_ref_tips = 0;
 }
 
-int fetch_populated_submodules(const struct argv_array *options,
-			       const char *prefix, int command_line_option,
-			       int quiet)
+struct submodule_parallel_fetch {
+	int count;
+	struct argv_array args;
+	const char *work_tree;
+	const char *prefix;
+	int command_line_option;
+	int quiet;
+	int result;
+};
+#define SPF_INIT {0, ARGV_ARRAY_INIT, NULL, NULL, 0, 0, 0}
+
+static int get_next_submodule(struct child_process *cp,
+			      struct strbuf *err, void *data, void **task_cb)
 {
-	int i, result = 0;
-	struct child_process cp = CHILD_PROCESS_INIT;
-	struct argv_array argv = ARGV_ARRAY_INIT;
-	struct string_list_item *name_for_path;
-	const char *work_tree = get_git_work_tree();
-	if (!work_tree)
-		goto out;
-
-	if (read_cache() < 0)
-		die("index file corrupt");
-
-	argv_array_push(&argv, "fetch");
-	for (i = 0; i < options->argc; i++)
-		argv_array_push(&argv, options->argv[i]);
-	argv_array_push(&argv, "--recurse-submodules-default");
-	/* default value, "--submodule-prefix" and its value are added later */
-
-	cp.env = local_repo_env;
-	cp.git_cmd = 1;
-	cp.no_stdin = 1;
-
-	calculate_changed_submodule_paths();
+	int ret = 0;
+	struct submodule_parallel_fetch *spf = data;
 
-	for (i = 0; i < active_nr; i++) {
+	for (; spf->count < active_nr; spf->count++) {
 		struct strbuf submodule_path = STRBUF_INIT;
 		struct strbuf submodule_git_dir = STRBUF_INIT;
 		struct strbuf submodule_prefix = STRBUF_INIT;
-		const struct cache_entry *ce = active_cache[i];
+		const struct cache_entry *ce = active_cache[spf->count];
 		const char *git_dir, *name, *default_argv;
+		struct string_list_item *name_for_path;
 
 		if (!S_ISGITLINK(ce->ce_mode))
 			continue;
@@ -728,7 +719,7 @@ int fetch_populated_submodules(const struct argv_array *options,
 			name = name_for_path->util;
 
 		default_argv = "yes";
-		if (command_line_option == RECURSE_SUBMODULES_DEFAULT) {
+		if (spf->command_line_option == RECURSE_SUBMODULES_DEFAULT) {
 			struct string_list_item *fetch_recurse_submodules_option;
 			fetch_recurse_submodules_option = unsorted_string_list_lookup(&config_fetch_recurse_submodules_for_name, name);
 			if (fetch_recurse_submodules_option) {
@@ -749,40 +740,166 @@ int fetch_populated_submodules(const struct argv_array *options,
 					default_argv = "on-demand";
 				}
 			}
-		} else if (command_line_option == RECURSE_SUBMODULES_ON_DEMAND) {
+		} else if (spf->command_line_option == RECURSE_SUBMODULES_ON_DEMAND) {
 			if (!unsorted_string_list_lookup(&changed_submodule_paths, ce->name))
 				continue;
 			default_argv = "on-demand";
 		}
 
-		strbuf_addf(&submodule_path, "%s/%s", work_tree, ce->name);
+		strbuf_addf(&submodule_path, "%s/%s", spf->work_tree, ce->name);
 		strbuf_addf(&submodule_git_dir, "%s/.git", submodule_path.buf);
-		strbuf_addf(&submodule_prefix, "%s%s/", prefix, ce->name);
+		strbuf_addf(&submodule_prefix, "%s%s/", spf->prefix, ce->name);
 		git_dir = read_gitfile(submodule_git_dir.buf);
 		if (!git_dir)
 			git_dir = submodule_git_dir.buf;
 		if (is_directory(git_dir)) {
-			if (!quiet)
-				printf("Fetching submodule %s%s\n", prefix, ce->name);
-			cp.dir = submodule_path.buf;
-			argv_array_push(&argv, default_argv);
-			argv_array_push(&argv, "--submodule-prefix");
-			argv_array_push(&argv, submodule_prefix.buf);
-			cp.argv = argv.argv;
-			if (run_command(&cp))
-				result = 1;
-			argv_array_pop(&argv);
-			argv_array_pop(&argv);
-			argv_array_pop(&argv);
+			child_process_init(cp);
+			cp->dir = strbuf_detach(&submodule_path, NULL);
+			cp->env = local_repo_env;
+			cp->git_cmd = 1;
+			if (!spf->quiet)
+				strbuf_addf(err, "Fetching submodule %s%s\n",
+					    spf->prefix, ce->name);
+			argv_array_pushv(&cp->args, spf->args.argv);
+			argv_array_push(&cp->args, default_argv);
+			argv_array_push(&cp->args, "--submodule-prefix");
+			argv_array_push(&cp->args, submodule_prefix.buf);
+			ret = 1;
 		}
 		strbuf_release(&submodule_path);
 		strbuf_release(&submodule_git_dir);
 		strbuf_release(&submodule_prefix);
+		if (ret) {
+			spf->count++;
+			return 1;
+		}
 	}
-	argv_array_clear(&argv);
+	return 0;
+}
+
+static int fetch_start_failure(struct strbuf *err,
+			       void *cb, void *task_cb)
+{
+	struct submodule_parallel_fetch *spf = cb;
+
+	spf->result = 1;
+
+	return 0;
+}
+
+static int fetch_finish(int retvalue, struct strbuf *err,
+			void *cb, void *task_cb)
+{
+	struct submodule_parallel_fetch *spf = cb;
+
+	if (retvalue)
+		spf->result = 1;
+
+	return 0;
+}
+
+int fetch_populated_submodules(const struct argv_array *options,
+			       const char *prefix, int command_line_option,
+			       int quiet, int max_parallel_jobs)
+{
+	int i;
+	struct submodule_parallel_fetch spf = SPF_INIT;
+
+	spf.work_tree = get_git_work_tree();
+	spf.command_line_option = command_line_option;
+	spf.quiet = quiet;
+	spf.prefix = prefix;
+
+	if (!spf.work_tree)
+		goto out;
+
+	if (read_cache() < 0)
+		die("index file corrupt");
+
+	argv_array_push(&spf.args, "fetch");
+	for (i = 0; i < options->argc; i++)
+		argv_array_push(&spf.args, options->argv[i]);
+	argv_array_push(&spf.args, "--recurse-submodules-default");
+	/* default value, "--submodule-prefix" and its value are added later */
+
+	calculate_changed_submodule_paths();
+	run_processes_parallel(max_parallel_jobs,
+			       get_next_submodule,
+			       fetch_start_failure,
+			       fetch_finish,
+			       &spf);
+
+	argv_array_clear(&spf.args);
 out:
 	string_list_clear(&changed_submodule_paths, 1);
-	return result;
+	return spf.result;
+}
+
+/*
+ * Dirty-checking a submodule means running a "git status --porcelain"
+ * child, which is expensive enough that a single command should not do
+ * it twice for the same submodule (status asks once for the worktree
+ * diff and once for the diff against HEAD).  Remember the answer for
+ * the lifetime of the process; the answer depends on whether untracked
+ * files were ignored, so keep one slot for each variant.
+ */
+struct dirty_submodule_result {
+	unsigned dirty[2];
+	unsigned have[2];
+};
+
+static struct string_list dirty_submodule_cache = STRING_LIST_INIT_DUP;
+
+static struct dirty_submodule_result *dirty_cache_entry(const char *path)
+{
+	struct string_list_item *item;
+
+	item = string_list_insert(&dirty_submodule_cache, path);
+	if (!item->util)
+		item->util = xcalloc(1, sizeof(struct dirty_submodule_result));
+	return item->util;
+}
+
+static unsigned parse_status_porcelain(const char *line, ssize_t len,
+				       int ignore_untracked)
+{
+	unsigned dirty_submodule = 0;
+	const char *next_line;
+
+	while (len > 2) {
+		if ((line[0] == '?') && (line[1] == '?')) {
+			dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
+			if (dirty_submodule & DIRTY_SUBMODULE_MODIFIED)
+				break;
+		} else {
+			dirty_submodule |= DIRTY_SUBMODULE_MODIFIED;
+			if (ignore_untracked ||
+			    (dirty_submodule & DIRTY_SUBMODULE_UNTRACKED))
+				break;
+		}
+		next_line = strchr(line, '\n');
+		if (!next_line)
+			break;
+		next_line++;
+		len -= (next_line - line);
+		line = next_line;
+	}
+	return dirty_submodule;
+}
+
+static int submodule_checked_out(const char *path)
+{
+	struct strbuf buf = STRBUF_INIT;
+	const char *git_dir;
+	int ret;
+
+	strbuf_addf(&buf, "%s/.git", path);
+	git_dir = read_gitfile(buf.buf);
+	if (!git_dir)
+		git_dir = buf.buf;
+	ret = is_directory(git_dir);
+	strbuf_release(&buf);
+	return ret;
 }
 
 unsigned is_submodule_modified(const char *path, int ignore_untracked)
@@ -796,22 +913,18 @@ unsigned is_submodule_modified(const char *path, int ignore_untracked)
 		NULL,
 	};
 	struct strbuf buf = STRBUF_INIT;
-	unsigned dirty_submodule = 0;
-	const char *line, *next_line;
-	const char *git_dir;
+	unsigned dirty_submodule;
+	struct dirty_submodule_result *cached;
 
-	strbuf_addf(&buf, "%s/.git", path);
-	git_dir = read_gitfile(buf.buf);
-	if (!git_dir)
-		git_dir = buf.buf;
-	if (!is_directory(git_dir)) {
-		strbuf_release(&buf);
+	ignore_untracked = !!ignore_untracked;
+	cached = dirty_cache_entry(path);
+	if (cached->have[ignore_untracked])
+		return cached->dirty[ignore_untracked];
+
+	if (!submodule_checked_out(path))
 		/* The submodule is not checked out, so it is not modified */
 		return 0;
 
-	}
-	strbuf_reset(&buf);
-
 	if (ignore_untracked)
 		argv[2] = "-uno";
 
@@ -825,34 +938,115 @@ unsigned is_submodule_modified(const char *path, int ignore_untracked)
 		die("Could not run 'git status --porcelain' in submodule %s", path);
 
 	len = strbuf_read(&buf, cp.out, 1024);
-	line = buf.buf;
-	while (len > 2) {
-		if ((line[0] == '?') && (line[1] == '?')) {
-			dirty_submodule |= DIRTY_SUBMODULE_UNTRACKED;
-			if (dirty_submodule & DIRTY_SUBMODULE_MODIFIED)
-				break;
-		} else {
-			dirty_submodule |= DIRTY_SUBMODULE_MODIFIED;
-			if (ignore_untracked ||
-			    (dirty_submodule & DIRTY_SUBMODULE_UNTRACKED))
-				break;
-		}
-		next_line = strchr(line, '\n');
-		if (!next_line)
-			break;
-		next_line++;
-		len -= (next_line - line);
-		line = next_line;
-	}
+	dirty_submodule = parse_status_porcelain(buf.buf, len, ignore_untracked);
 	close(cp.out);
 
 	if (finish_command(&cp))
 		die("'git status --porcelain' failed in submodule %s", path);
 
 	strbuf_release(&buf);
+	cached->dirty[ignore_untracked] = dirty_submodule;
+	cached->have[ignore_untracked] = 1;
 	return dirty_submodule;
 }
 
+struct submodule_dirty_prefetch {
+	struct string_list *submodules;
+	int index;
+};
+
+struct dirty_check_task {
+	const char *path;
+	int ignore_untracked;
+};
+
+static int dirty_check_next(struct child_process *cp,
+			    struct strbuf *err,
+			    void *cb, void **task_cb)
+{
+	struct submodule_dirty_prefetch *sdp = cb;
+
+	while (sdp->index < sdp->submodules->nr) {
+		struct string_list_item *item =
+			&sdp->submodules->items[sdp->index++];
+		const char *path = item->string;
+		int ignore_untracked = !!(intptr_t)item->util;
+		struct dirty_check_task *task;
+
+		if (dirty_cache_entry(path)->have[ignore_untracked])
+			continue;
+		if (!submodule_checked_out(path))
+			continue;
+
+		argv_array_push(&cp->args, "status");
+		argv_array_push(&cp->args, "--porcelain");
+		if (ignore_untracked)
+			argv_array_push(&cp->args, "-uno");
+		cp->env = local_repo_env;
+		cp->git_cmd = 1;
+		cp->no_stdin = 1;
+		cp->dir = path;
+
+		task = xmalloc(sizeof(*task));
+		task->path = path;
+		task->ignore_untracked = ignore_untracked;
+		*task_cb = task;
+		return 1;
+	}
+	return 0;
+}
+
+static int dirty_check_finish(int retvalue, struct strbuf *out,
+			      void *cb, void *task_cb)
+{
+	struct dirty_check_task *task = task_cb;
+
+	if (!retvalue) {
+		struct dirty_submodule_result *cached =
+			dirty_cache_entry(task->path);
+
+		cached->dirty[task->ignore_untracked] =
+			parse_status_porcelain(out->buf, out->len,
+					       task->ignore_untracked);
+		cached->have[task->ignore_untracked] = 1;
+		strbuf_reset(out);
+	}
+	/*
+	 * On failure, leave the entry uncached (and the child's output
+	 * in the buffer, to be shown); is_submodule_modified() will run
+	 * the check again and die with its usual message.
+	 */
+	free(task);
+	return 0;
+}
+
+/*
+ * Run the dirty checks for the given submodules on a bounded pool of
+ * child processes and prime the cache consulted by
+ * is_submodule_modified(), so that a superproject with many submodules
+ * is not serialized on one "git status" child after another.  The util
+ * field of each list item says whether untracked files are to be
+ * ignored for that path.  Paths already cached or not checked out cost
+ * nothing.  Failures are not reported here; they surface when the
+ * caller asks about the affected submodule.
+ */
+void prefetch_submodule_dirtiness(struct string_list *submodules,
+				  int max_parallel_jobs)
+{
+	struct submodule_dirty_prefetch sdp;
+
+	if (submodules->nr < 2)
+		return;
+
+	sdp.submodules = submodules;
+	sdp.index = 0;
+	run_processes_parallel_collect(max_parallel_jobs,
+				       dirty_check_next,
+				       NULL,
+				       dirty_check_finish,
+				       &sdp);
+}
+
 int submodule_uses_gitfile(const char *path)
 {
 	struct child_process cp = CHILD_PROCESS_INIT;
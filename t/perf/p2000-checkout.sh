@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description='Tests checkout performance when switching branches'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_expect_success 'populate the worktree and an older branch' '
+	git read-tree HEAD &&
+	test_checkout_worktree &&
+	git reset -q HEAD &&
+	git checkout -q master &&
+	git branch old master~100
+'
+
+test_perf 'git checkout between branches' '
+	git checkout -q old &&
+	git checkout -q master
+'
+
+test_perf 'git checkout -- . (no changes)' '
+	git checkout -- .
+'
+
+test_perf 'git reset --hard' '
+	git reset -q --hard
+'
+
+test_done
@@ -0,0 +1,34 @@
+#!/bin/sh
+
+test_description='Tests pathspec matching performance on a large index'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_expect_success 'populate the worktree' '
+	git read-tree HEAD
+'
+test_checkout_worktree
+
+test_perf 'ls-files with literal pathspecs' '
+	git ls-files -- dir000/file00001 dir001/file00002 dir002/file00003 \
+		>/dev/null
+'
+
+test_perf 'ls-files with wildcard pathspec' '
+	git ls-files -- "dir00*/file*1" >/dev/null
+'
+
+test_perf 'ls-files with mixed pathspecs' '
+	git ls-files -- dir000 "dir00*/file*1" ":(exclude)dir005" >/dev/null
+'
+
+test_perf 'add --dry-run with literal pathspecs' '
+	git add --dry-run -- dir000/file00001 dir001/file00002 >/dev/null
+'
+
+test_perf 'log -1 with a directory pathspec' '
+	git log -1 --oneline -- dir000 >/dev/null
+'
+
+test_done
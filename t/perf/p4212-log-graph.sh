@@ -0,0 +1,20 @@
+#!/bin/sh
+
+test_description='Tests log --graph performance'
+. ./perf-lib.sh
+
+test_perf_default_repo
+
+test_perf 'git log --oneline (baseline)' '
+	git log --oneline --all >/dev/null
+'
+
+test_perf 'git log --graph --oneline' '
+	git log --graph --oneline --all >/dev/null
+'
+
+test_perf 'git log --graph --color --oneline' '
+	git log --graph --color --oneline --all >/dev/null
+'
+
+test_done
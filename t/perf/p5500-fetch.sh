@@ -0,0 +1,24 @@
+#!/bin/sh
+
+test_description='Tests fetch negotiation performance with many refs'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_expect_success 'create a client repository' '
+	git clone -q --bare . client.git
+'
+
+test_perf 'git ls-remote' '
+	git ls-remote client.git >/dev/null
+'
+
+test_perf 'git fetch (everything up to date)' '
+	git -C client.git fetch -q origin
+'
+
+test_perf 'git fetch --all --dry-run' '
+	git -C client.git fetch -q --all --dry-run
+'
+
+test_done
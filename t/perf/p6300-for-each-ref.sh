@@ -0,0 +1,28 @@
+#!/bin/sh
+
+test_description='Tests ref iteration performance with many refs'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_perf 'git for-each-ref (loose)' '
+	git for-each-ref >/dev/null
+'
+
+test_perf 'git branch --list' '
+	git branch --list >/dev/null
+'
+
+test_expect_success 'pack the refs' '
+	git pack-refs --all
+'
+
+test_perf 'git for-each-ref (packed)' '
+	git for-each-ref >/dev/null
+'
+
+test_perf 'git rev-parse a generated ref' '
+	git rev-parse refs/heads/gen/ref-000000 >/dev/null
+'
+
+test_done
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+test_description='Tests status performance on a large synthetic worktree'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_expect_success 'populate the worktree' '
+	git read-tree HEAD &&
+	test_checkout_worktree
+'
+
+test_perf 'git status' '
+	git status >/dev/null
+'
+
+test_perf 'git status -uno' '
+	git status -uno >/dev/null
+'
+
+test_perf 'git status --porcelain' '
+	git status --porcelain >/dev/null
+'
+
+test_perf 'git diff-index HEAD' '
+	git diff-index HEAD >/dev/null
+'
+
+test_done
@@ -0,0 +1,20 @@
+#!/bin/sh
+
+test_description='Tests repack performance'
+. ./perf-lib.sh
+
+test_perf_synthetic_repo
+
+test_perf 'git repack -ad (reusing deltas)' '
+	git repack -adq
+'
+
+test_perf 'git repack -adf (recomputing deltas)' '
+	git repack -adqf
+'
+
+test_perf 'git count-objects -v' '
+	git count-objects -v >/dev/null
+'
+
+test_done
@@ -118,6 +118,61 @@ test_checkout_worktree () {
 	error "git checkout-index failed"
 }
 
+# Generate a synthetic repository in "$1" (default: the trash
+# directory) whose size is controlled by environment variables, so the
+# same script can be run at different scales:
+#
+#	GIT_PERF_GEN_FILES	number of files in the tree (default 10000)
+#	GIT_PERF_GEN_DEPTH	length of the history (default 1000)
+#	GIT_PERF_GEN_REFS	number of extra refs (default 1000)
+#
+# The first commit adds all files; each later commit modifies one of
+# them.  The extra refs are spread over the generated history.  The
+# worktree is left empty; scripts that need one should run
+# "git read-tree HEAD" followed by test_checkout_worktree.
+test_perf_synthetic_repo () {
+	repo="${1:-$TRASH_DIRECTORY}"
+	mkdir -p "$repo"
+	(
+		cd "$repo" &&
+		git init -q &&
+		mv .git/hooks .git/hooks-disabled 2>/dev/null
+		perl -e '
+			my ($files, $depth, $refs) = @ARGV;
+			my $ident = "P Erf <perf\@example.com> 1234567890 +0000";
+			print "commit refs/heads/master\nmark :1\n";
+			print "committer $ident\ndata 7\ninitial\n";
+			for (my $i = 0; $i < $files; $i++) {
+				my $path = sprintf("dir%03d/file%05d",
+						   $i % 100, $i);
+				my $data = "content of file $i\n";
+				printf "M 100644 inline %s\ndata %d\n%s",
+					$path, length($data), $data;
+			}
+			for (my $c = 2; $c <= $depth; $c++) {
+				my $msg = sprintf("commit %d", $c);
+				printf "commit refs/heads/master\nmark :%d\n",
+					$c;
+				printf "committer %s\ndata %d\n%s\n",
+					$ident, length($msg), $msg;
+				my $i = $c % $files;
+				my $path = sprintf("dir%03d/file%05d",
+						   $i % 100, $i);
+				my $data = "content from commit $c\n";
+				printf "M 100644 inline %s\ndata %d\n%s",
+					$path, length($data), $data;
+			}
+			for (my $r = 0; $r < $refs; $r++) {
+				printf "reset refs/heads/gen/ref-%06d\nfrom :%d\n",
+					$r, 1 + $r % $depth;
+			}
+		' "${GIT_PERF_GEN_FILES:-10000}" \
+			"${GIT_PERF_GEN_DEPTH:-1000}" \
+			"${GIT_PERF_GEN_REFS:-1000}" |
+		git fast-import --quiet
+	) || error "failed to generate synthetic repository in '$repo'"
+}
+
 # Performance tests should never fail.  If they do, stop immediately
 immediate=t
 
@@ -237,6 +237,63 @@ test_expect_success 'grow / shrink' '
 
 '
 
+test_expect_success 'grow / shrink (incremental resize)' '
+
+	rm -f in &&
+	rm -f expect &&
+	for n in $(test_seq 51)
+	do
+		echo put key$n value$n >> in &&
+		echo NULL >> expect
+	done &&
+	echo size >> in &&
+	echo 64 51 >> expect &&
+	echo put key52 value52 >> in &&
+	echo NULL >> expect &&
+	echo size >> in &&
+	echo 256 52 >> expect &&
+	for n in $(test_seq 52)
+	do
+		echo get key$n >> in &&
+		echo value$n >> expect
+	done &&
+	for n in $(test_seq 12)
+	do
+		echo remove key$n >> in &&
+		echo value$n >> expect
+	done &&
+	echo size >> in &&
+	echo 256 40 >> expect &&
+	echo remove key40 >> in &&
+	echo value40 >> expect &&
+	echo size >> in &&
+	echo 64 39 >> expect &&
+	cat in | test-hashmap incremental > out &&
+	test_cmp expect out
+
+'
+
+test_expect_success 'duplicates split across pending resize' '
+
+	rm -f in &&
+	rm -f expect &&
+	for n in $(test_seq 52)
+	do
+		echo add key$n value$n >> in
+	done &&
+	echo add key1 value1b >> in &&
+	echo get key1 >> in &&
+	echo value1b >> expect &&
+	echo value1 >> expect &&
+	echo get key52 >> in &&
+	echo value52 >> expect &&
+	echo size >> in &&
+	echo 256 53 >> expect &&
+	cat in | test-hashmap incremental > out &&
+	test_cmp expect out
+
+'
+
 test_expect_success 'string interning' '
 
 test_hashmap "intern value1
@@ -216,4 +216,94 @@ test_expect_success EXPENSIVE 'filter large file' '
 	! test -s err
 '
 
+filter_process="\"$PERL_PATH\" \"$TEST_DIRECTORY/t0021/rot13-filter.pl\""
+
+test_expect_success PERL 'required process filter should filter data' '
+	test_when_finished "rm -rf proc" &&
+	git init proc &&
+	(
+		cd proc &&
+		git config filter.protocol.process "$filter_process" &&
+		git config filter.protocol.required true &&
+		echo "*.r filter=protocol" >.gitattributes &&
+
+		cat ../test.o >test.r &&
+		cat ../test.o >other.r &&
+		git add .gitattributes test.r other.r &&
+		rm -f test.r other.r &&
+		git checkout -- test.r other.r &&
+		cmp ../test.o test.r &&
+		cmp ../test.o other.r &&
+
+		../rot13.sh <../test.o >expect &&
+		git cat-file blob :test.r >actual &&
+		cmp expect actual &&
+
+		# one process per git invocation, not one per path
+		grep -c "init handshake complete" rot13-filter.log >handshakes &&
+		echo 2 >expect.count &&
+		cmp expect.count handshakes
+	)
+'
+
+test_expect_success PERL 'process filter takes precedence over clean filter' '
+	test_when_finished "rm -rf proc" &&
+	git init proc &&
+	(
+		cd proc &&
+		git config filter.protocol.process "$filter_process" &&
+		git config filter.protocol.clean false &&
+		echo "*.r filter=protocol" >.gitattributes &&
+
+		cat ../test.o >test.r &&
+		git add .gitattributes test.r &&
+
+		../rot13.sh <../test.o >expect &&
+		git cat-file blob :test.r >actual &&
+		cmp expect actual
+	)
+'
+
+test_expect_success PERL 'delayed checkout with process filter' '
+	test_when_finished "rm -rf proc" &&
+	git init proc &&
+	(
+		cd proc &&
+		git config filter.protocol.process "$filter_process" &&
+		git config filter.protocol.required true &&
+		echo "*.r filter=protocol" >.gitattributes &&
+
+		cat ../test.o >quick.r &&
+		cat ../test.o >delay-a.r &&
+		cat ../test.o >delay-b.r &&
+		git add .gitattributes quick.r delay-a.r delay-b.r &&
+		git commit -m files &&
+
+		rm -f quick.r delay-a.r delay-b.r &&
+		git checkout -- quick.r delay-a.r delay-b.r &&
+		cmp ../test.o quick.r &&
+		cmp ../test.o delay-a.r &&
+		cmp ../test.o delay-b.r &&
+
+		grep "\[DELAYED\]" rot13-filter.log >delayed.log &&
+		test_line_count = 2 delayed.log &&
+		grep "list_available_blobs \[delay-a.r delay-b.r\]" rot13-filter.log
+	)
+'
+
+test_expect_success PERL 'process filter reporting an error passes the file through' '
+	test_when_finished "rm -rf proc" &&
+	git init proc &&
+	(
+		cd proc &&
+		git config filter.protocol.process "$filter_process" &&
+		echo "*.r filter=protocol" >.gitattributes &&
+
+		cat ../test.o >error.r &&
+		git add .gitattributes error.r &&
+		git cat-file blob :error.r >actual &&
+		cmp ../test.o actual
+	)
+'
+
 test_done
@@ -0,0 +1,132 @@
+#
+# Example implementation for the Git filter protocol version 2
+# See Documentation/gitattributes.txt, section "Filter Protocol"
+#
+# The script applies the ROT13 encryption to the file content and
+# logs every command it gets to "rot13-filter.log" in the current
+# directory, so that the tests can check what was exchanged.
+#
+use strict;
+use warnings;
+
+my $MAX_PACKET_CONTENT_SIZE = 65516;
+
+open my $log, ">>", "rot13-filter.log" or die "cannot open log: $!";
+select $log; $| = 1; select STDOUT; $| = 1;
+binmode STDIN;
+binmode STDOUT;
+
+sub rot13 {
+	my ($str) = @_;
+	$str =~ y/A-Za-z/N-ZA-Mn-za-m/;
+	return $str;
+}
+
+sub packet_read {
+	my $buf;
+	my $bytes = read STDIN, $buf, 4;
+	if ( $bytes == 0 ) {
+		# EOF - Git closed its end; we are done
+		print $log "STOP\n";
+		exit;
+	}
+	die "invalid packet size '$buf'" unless $buf =~ /^[0-9a-f]{4}$/;
+	my $size = hex($buf);
+	return ( 1, "" ) if $size == 0;
+	$size -= 4;
+	read STDIN, $buf, $size;
+	die "invalid packet" unless length $buf == $size;
+	return ( 0, $buf );
+}
+
+sub packet_write {
+	my ($packet) = @_;
+	print STDOUT sprintf( "%04x", length($packet) + 4 );
+	print STDOUT $packet;
+	STDOUT->flush();
+}
+
+sub packet_flush {
+	print STDOUT sprintf("%04x", 0);
+	STDOUT->flush();
+}
+
+( packet_read() ) [1] eq "git-filter-client\n" or die "bad welcome";
+( packet_read() ) [1] eq "version=2\n"         or die "bad version";
+( packet_read() ) [0] eq 1                     or die "expected flush";
+print $log "init handshake complete\n";
+
+packet_write("git-filter-server\n");
+packet_write("version=2\n");
+packet_flush();
+
+for (;;) {
+	my ( $flush, $cap ) = packet_read();
+	last if $flush;
+	# announce everything Git offered
+	packet_write($cap);
+}
+packet_flush();
+
+my %delayed;
+
+for (;;) {
+	my %request;
+	for (;;) {
+		my ( $flush, $line ) = packet_read();
+		last if $flush;
+		chomp $line;
+		my ( $key, $value ) = split /=/, $line, 2;
+		$request{$key} = $value;
+	}
+	my $command  = $request{"command"}  or die "missing command";
+	my $pathname = $request{"pathname"};
+
+	if ( $command eq "list_available_blobs" ) {
+		print $log "$command [" . join( " ", sort keys %delayed ) . "]\n";
+		packet_write("pathname=$_\n") for sort keys %delayed;
+		packet_flush();
+		packet_write("status=success\n");
+		packet_flush();
+		%delayed = ();
+		next;
+	}
+
+	defined $pathname or die "missing pathname";
+
+	my $input = "";
+	for (;;) {
+		my ( $flush, $chunk ) = packet_read();
+		last if $flush;
+		$input .= $chunk;
+	}
+
+	if ( $request{"can-delay"} && $pathname =~ /delay/ ) {
+		print $log "$command $pathname " . length($input) . " [DELAYED]\n";
+		$delayed{$pathname} = 1;
+		packet_write("status=delayed\n");
+		packet_flush();
+		next;
+	}
+	print $log "$command $pathname " . length($input) . " [OK]\n";
+
+	if ( $pathname eq "error.r" ) {
+		packet_write("status=error\n");
+		packet_flush();
+		next;
+	}
+	if ( $pathname eq "abort.r" ) {
+		packet_write("status=abort\n");
+		packet_flush();
+		next;
+	}
+
+	my $output = rot13($input);
+	packet_write("status=success\n");
+	packet_flush();
+	while ( length $output ) {
+		packet_write( substr( $output, 0, $MAX_PACKET_CONTENT_SIZE, "" ) );
+	}
+	packet_flush();	# end of content
+	packet_flush();	# status unchanged
+}
@@ -0,0 +1,42 @@
+#!/bin/sh
+
+test_description='structured telemetry via GIT_TRACE_EVENT'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one
+'
+
+test_expect_success 'start and exit events are emitted' '
+	GIT_TRACE_EVENT="$(pwd)/events" git log --oneline >/dev/null &&
+	grep "\"event\":\"start\"" events >start &&
+	test_line_count = 1 start &&
+	grep "\"event\":\"exit\"" events >exit &&
+	test_line_count = 1 exit &&
+	grep "\"code\":0" exit
+'
+
+test_expect_success 'region events balance and carry elapsed time' '
+	rm -f events &&
+	GIT_TRACE_EVENT="$(pwd)/events" git for-each-ref >/dev/null &&
+	grep "\"event\":\"region_enter\"" events >enter &&
+	grep "\"event\":\"region_leave\"" events >leave &&
+	test_line_count = $(wc -l <enter) leave &&
+	grep "\"t_rel\":" leave
+'
+
+test_expect_success 'child processes are accounted for' '
+	rm -f events &&
+	test_config alias.rev-parsed "!git rev-parse HEAD" &&
+	GIT_TRACE_EVENT="$(pwd)/events" git rev-parsed >/dev/null &&
+	grep "\"event\":\"child_start\"" events &&
+	grep "\"event\":\"child_exit\"" events
+'
+
+test_expect_success 'no telemetry output without GIT_TRACE_EVENT' '
+	rm -f events &&
+	git log --oneline >/dev/null &&
+	test_path_is_missing events
+'
+
+test_done
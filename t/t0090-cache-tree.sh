@@ -169,6 +169,18 @@ test_expect_success 'commit in child dir has cache-tree' '
 	test_cache_tree
 '
 
+test_expect_success 'commit without cache-tree borrows subtrees from HEAD' '
+	mkdir dirb &&
+	>dirb/child.t &&
+	git add dirb/child.t &&
+	git commit -m dirb/child.t &&
+	echo "I changed this file" >dir/child.t &&
+	git add dir/child.t &&
+	test-scrap-cache-tree &&
+	git commit -m "change dir/child.t" &&
+	test_cache_tree
+'
+
 test_expect_success 'reset --hard gives cache-tree' '
 	test-scrap-cache-tree &&
 	git reset --hard &&
@@ -0,0 +1,79 @@
+#!/bin/sh
+
+test_description='git serve-commands resident command server'
+. ./test-lib.sh
+
+test -z "$NO_UNIX_SOCKETS" || {
+	skip_all='skipping serve-commands tests, unix sockets not available'
+	test_done
+}
+
+SOCKET="$TRASH_DIRECTORY/.git/commands.sock"
+
+# don't leave a stale server running
+trap 'code=$?; git serve-commands --call "$SOCKET" exit 2>/dev/null; (exit $code); die' EXIT
+
+call () {
+	git serve-commands --call "$SOCKET" "$@"
+}
+
+test_expect_success 'start the server' '
+	test_commit one &&
+	git serve-commands "$SOCKET" >server.log 2>&1 &
+	for i in 1 2 3 4 5
+	do
+		test -S "$SOCKET" && break
+		sleep 1
+	done &&
+	test -S "$SOCKET"
+'
+
+test_expect_success 'served output matches direct invocation' '
+	git rev-parse HEAD >expect &&
+	call rev-parse HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'exit status is relayed' '
+	test_must_fail call rev-parse --verify refs/heads/no-such-branch
+'
+
+test_expect_success 'client stdin reaches the command' '
+	echo content | git hash-object --stdin >expect &&
+	echo content | call hash-object --stdin >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'commands run relative to the client directory' '
+	mkdir sub &&
+	echo tracked >sub/file &&
+	git add sub/file &&
+	echo file >expect &&
+	(cd sub && call ls-files .) >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'one request sees the ref updates of another' '
+	call update-ref refs/heads/side HEAD &&
+	git rev-parse HEAD >expect &&
+	call rev-parse refs/heads/side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'commands needing a fresh repository are refused' '
+	test_must_fail call clone . elsewhere &&
+	test_path_is_missing elsewhere
+'
+
+test_expect_success 'exit stops the server and removes the socket' '
+	call exit &&
+	for i in 1 2 3 4 5
+	do
+		test -S "$SOCKET" || break
+		sleep 1
+	done &&
+	! test -S "$SOCKET"
+'
+
+trap - EXIT
+test_done
@@ -296,4 +296,26 @@ test_expect_success '%(deltabase) reports packed delta bases' '
 	}
 '
 
+test_expect_success '--batch-check --unordered reports the same objects' '
+	git rev-list --objects HEAD >tmp &&
+	cut -d" " -f1 <tmp >objects &&
+	git cat-file --batch-check <objects >ordered &&
+	git cat-file --batch-check --unordered <objects >unordered &&
+	sort <ordered >ordered.sorted &&
+	sort <unordered >unordered.sorted &&
+	test_cmp ordered.sorted unordered.sorted
+'
+
+test_expect_success '--unordered carries %(rest) tags through the reorder' '
+	sed "s/\$/ tag/" <objects |
+	git cat-file --batch-check="%(objectname) %(rest)" --unordered >tagged &&
+	sed "s/\$/ tag/" <objects | sort >expect &&
+	sort <tagged >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--unordered requires a batch mode' '
+	test_must_fail git cat-file --unordered </dev/null
+'
+
 test_done
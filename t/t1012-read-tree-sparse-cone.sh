@@ -0,0 +1,72 @@
+#!/bin/sh
+
+test_description='sparse checkout with cone patterns
+
+With core.sparseCheckoutCone, the sparse-checkout file is restricted
+to directory prefixes that are matched with hash lookups instead of
+scanning the whole pattern list for every index entry.'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir -p A/B A/X C D &&
+	echo root >root.txt &&
+	echo afile >A/file &&
+	echo deep >A/B/deep &&
+	echo skip >A/X/skip &&
+	echo keep >C/keep &&
+	echo skip >D/skip &&
+	git add -A &&
+	git commit -m init &&
+	git config core.sparseCheckout true &&
+	git config core.sparseCheckoutCone true
+'
+
+test_expect_success 'cone patterns select directory cones' '
+	cat >.git/info/sparse-checkout <<-\EOF &&
+	/*
+	!/*/
+	/A/
+	!/A/*/
+	/A/B/
+	/C/
+	EOF
+	git read-tree -mu HEAD &&
+	cat >expect <<-\EOF &&
+	A/B/deep
+	A/file
+	C/keep
+	root.txt
+	EOF
+	git ls-files -t | sed -n "s/^H //p" | sort >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'cone matching agrees with the generic matcher' '
+	git ls-files -t >expect &&
+	git config core.sparseCheckoutCone false &&
+	git read-tree -mu HEAD &&
+	git ls-files -t >actual &&
+	test_cmp expect actual &&
+	git config core.sparseCheckoutCone true
+'
+
+test_expect_success 'a lone top-level wildcard includes everything' '
+	echo "/*" >.git/info/sparse-checkout &&
+	git read-tree -mu HEAD &&
+	git ls-files -t | sed -n "s/^S //p" >sparse &&
+	test_must_be_empty sparse
+'
+
+test_expect_success 'non-cone pattern warns and falls back' '
+	cat >.git/info/sparse-checkout <<-\EOF &&
+	*.txt
+	EOF
+	git read-tree -mu HEAD 2>err &&
+	test_i18ngrep "disabling cone pattern matching" err &&
+	echo root.txt >expect &&
+	git ls-files -t | sed -n "s/^H //p" >actual &&
+	test_cmp expect actual
+'
+
+test_done
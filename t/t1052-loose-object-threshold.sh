@@ -0,0 +1,87 @@
+#!/bin/sh
+# Copyright (c) 2015 Twitter, Inc
+
+test_description='packing small objects during a transaction (core.looseObjectThreshold)'
+. ./test-lib.sh
+
+count_loose () {
+	find .git/objects -type f |
+	grep -v -e pack -e info |
+	wc -l
+}
+
+count_packs () {
+	ls .git/objects/pack/pack-*.pack | wc -l
+}
+
+test_expect_success setup '
+	git config core.looseObjectThreshold 1m &&
+	for i in 1 2 3 4 5
+	do
+		echo "content $i" >file$i || return
+	done
+'
+
+test_expect_success 'add and commit create no loose objects' '
+	git add . &&
+	git commit -m initial &&
+	test "$(count_loose)" = 0 &&
+	git fsck --strict &&
+	echo "content 3" >expect &&
+	git cat-file blob HEAD:file3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'objects over the threshold are still written loose' '
+	git config core.looseObjectThreshold 16 &&
+	test-genrandom large 1024 >large &&
+	echo tiny >small &&
+	git add large small &&
+	git commit -m mixed &&
+	git fsck --strict &&
+	test "$(count_loose)" != 0 &&
+	git config core.looseObjectThreshold 1m
+'
+
+test_expect_success 'a merge with conflicts keeps its stages readable' '
+	git checkout -b side master &&
+	echo side >file1 &&
+	git commit -am side &&
+	git checkout master &&
+	echo master >file1 &&
+	git commit -am master &&
+	test_must_fail git merge side &&
+	git cat-file blob :2:file1 >ours &&
+	echo master >expect &&
+	test_cmp expect ours &&
+	git fsck --strict &&
+	echo resolved >file1 &&
+	git add file1 &&
+	git commit -m resolved
+'
+
+test_expect_success 'pack size limit splits the transaction into packs' '
+	git config pack.packSizeLimit 4096 &&
+	packs_before=$(count_packs) &&
+	loose_before=$(count_loose) &&
+	for i in 1 2 3 4 5 6
+	do
+		test-genrandom "seed$i" 2000 >rand$i || return
+	done &&
+	git add rand1 rand2 rand3 rand4 rand5 rand6 &&
+	git commit -m rollover &&
+	git config --unset pack.packSizeLimit &&
+	git fsck --strict &&
+	test "$(count_loose)" = "$loose_before" &&
+	test $(count_packs) -gt $(($packs_before + 1))
+'
+
+test_expect_success 'feature is off by default' '
+	git config --unset core.looseObjectThreshold &&
+	echo brand-new >loose-me &&
+	git add loose-me &&
+	git commit -m loose &&
+	test "$(count_loose)" != 0
+'
+
+test_done
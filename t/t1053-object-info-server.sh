@@ -0,0 +1,91 @@
+#!/bin/sh
+
+test_description='object info server daemon'
+. ./test-lib.sh
+
+test -z "$NO_UNIX_SOCKETS" || {
+	skip_all='skipping object info server tests, unix sockets not available'
+	test_done
+}
+
+SOCKET="$TRASH_DIRECTORY/info.sock"
+
+# don't leave a stale daemon running
+trap 'code=$?; test -z "$daemon_pid" || kill "$daemon_pid" 2>/dev/null; (exit $code); die' EXIT
+
+test_expect_success 'setup repository' '
+	test_commit one &&
+	git repack -ad &&
+	blob=$(git rev-parse one:one.t) &&
+	git cat-file -s $blob >expect.size &&
+	git cat-file -t $blob >expect.type
+'
+
+test_expect_success 'start daemon' '
+	git object-info--daemon "$SOCKET" >daemon.out &
+	daemon_pid=$! &&
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		test -S "$SOCKET" && break
+		sleep 1
+	done &&
+	test -S "$SOCKET" &&
+	echo ok >expect.ok &&
+	test_cmp expect.ok daemon.out
+'
+
+test_expect_success 'object size through the server matches direct access' '
+	GIT_OBJECT_INFO_SOCKET="$SOCKET" git cat-file -s $blob >actual &&
+	test_cmp expect.size actual
+'
+
+test_expect_success 'object type through the server matches direct access' '
+	GIT_OBJECT_INFO_SOCKET="$SOCKET" git cat-file -t $blob >actual &&
+	test_cmp expect.type actual
+'
+
+test_expect_success 'the server really answers: client repo lacks the object' '
+	git init --bare other.git &&
+	GIT_OBJECT_INFO_SOCKET="$SOCKET" \
+		git --git-dir=other.git cat-file -s $blob >actual &&
+	test_cmp expect.size actual
+'
+
+test_expect_success 'ref resolution through the server matches direct access' '
+	git rev-parse --verify refs/heads/master >expect &&
+	GIT_OBJECT_INFO_SOCKET="$SOCKET" \
+		git rev-parse --verify refs/heads/master >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'new objects are visible without restarting the daemon' '
+	test_commit two &&
+	blob2=$(git rev-parse two:two.t) &&
+	git cat-file -s $blob2 >expect &&
+	GIT_OBJECT_INFO_SOCKET="$SOCKET" git cat-file -s $blob2 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'a dead socket falls back to direct access' '
+	GIT_OBJECT_INFO_SOCKET="$TRASH_DIRECTORY/no-such.sock" \
+		git cat-file -s $blob >actual &&
+	test_cmp expect.size actual
+'
+
+test_expect_success 'core.objectInfoServer configures the socket' '
+	git -c core.objectInfoServer="$SOCKET" cat-file -s $blob >actual &&
+	test_cmp expect.size actual
+'
+
+test_expect_success 'daemon removes its socket on termination' '
+	kill "$daemon_pid" &&
+	daemon_pid= &&
+	for i in 1 2 3 4 5
+	do
+		test -S "$SOCKET" || break
+		sleep 1
+	done &&
+	! test -S "$SOCKET"
+'
+
+test_done
@@ -1169,6 +1169,64 @@ test_expect_failure 'adding a key into an empty section reuses header' '
 	test_cmp expect .git/config
 '
 
+test_expect_success 'config cache is written and replayed' '
+	test_when_finished "rm -rf cachedir && unset GIT_CONFIG_CACHE_DIR" &&
+	mkdir cachedir &&
+	GIT_CONFIG_CACHE_DIR="$(pwd)/cachedir" &&
+	export GIT_CONFIG_CACHE_DIR &&
+	git config cache.one first &&
+	git config cache.one &&
+	test -n "$(ls cachedir)" &&
+	test-chmtime -60 .git/config &&
+	git config cache.one >/dev/null &&
+	test "$(git config cache.one)" = first
+'
+
+test_expect_success 'no cache is written without GIT_CONFIG_CACHE_DIR' '
+	test_when_finished "rm -rf cachedir" &&
+	mkdir cachedir &&
+	git config cache.none value &&
+	git config cache.none >/dev/null &&
+	test -z "$(ls cachedir)"
+'
+
+test_expect_success 'stale config cache is ignored' '
+	test_when_finished "rm -rf cachedir && unset GIT_CONFIG_CACHE_DIR" &&
+	mkdir cachedir &&
+	GIT_CONFIG_CACHE_DIR="$(pwd)/cachedir" &&
+	export GIT_CONFIG_CACHE_DIR &&
+	git config cache.two old &&
+	git config cache.two >/dev/null &&
+	git config cache.two new &&
+	test "$(git config cache.two)" = new
+'
+
+test_expect_success 'corrupt config cache falls back to parsing' '
+	test_when_finished "rm -rf cachedir && unset GIT_CONFIG_CACHE_DIR" &&
+	mkdir cachedir &&
+	GIT_CONFIG_CACHE_DIR="$(pwd)/cachedir" &&
+	export GIT_CONFIG_CACHE_DIR &&
+	git config cache.three value &&
+	test-chmtime -60 .git/config &&
+	git config cache.three >/dev/null &&
+	for f in cachedir/*.cache
+	do
+		echo garbage >"$f" || return 1
+	done &&
+	test "$(git config cache.three)" = value
+'
+
+test_expect_success 'GIT_CONFIG_NOCACHE disables the cache' '
+	test_when_finished "rm -rf cachedir && unset GIT_CONFIG_CACHE_DIR" &&
+	mkdir cachedir &&
+	GIT_CONFIG_CACHE_DIR="$(pwd)/cachedir" &&
+	export GIT_CONFIG_CACHE_DIR &&
+	git config cache.four value &&
+	rm -f cachedir/* &&
+	GIT_CONFIG_NOCACHE=1 git config cache.four >/dev/null &&
+	test -z "$(ls cachedir)"
+'
+
 test_expect_success POSIXPERM,PERL 'preserves existing permissions' '
 	chmod 0600 .git/config &&
 	git config imap.pass Hunter2 &&
@@ -67,4 +67,47 @@ test_expect_success 'gitdir required mode' '
 	)
 '
 
+mkconfig () {
+	echo '[core]' &&
+	echo "repositoryformatversion = $1" &&
+	shift &&
+
+	if test $# -gt 0
+	then
+		echo '[extensions]' &&
+		for i in "$@"
+		do
+			echo "$i"
+		done
+	fi
+}
+
+while read outcome version extensions
+do
+	test_expect_success "$outcome version=$version $extensions" "
+		test_when_finished 'rm -rf extensions-repo' &&
+		git init extensions-repo &&
+		mkconfig $version $extensions >extensions-repo/.git/config &&
+		if test $outcome = allow
+		then
+			git -C extensions-repo rev-parse --git-dir
+		else
+			test_must_fail git -C extensions-repo rev-parse --git-dir
+		fi
+	"
+done <<\EOF
+allow 0
+allow 1
+allow 1 objectformat=sha1
+abort 1 no-such-extension
+allow 0 no-such-extension
+EOF
+
+test_expect_success 'unsupported extensions.objectformat is always an error' '
+	test_when_finished "rm -rf extensions-repo" &&
+	git init extensions-repo &&
+	mkconfig 1 objectformat=no-such-hash >extensions-repo/.git/config &&
+	test_must_fail git -C extensions-repo rev-parse --git-dir
+'
+
 test_done
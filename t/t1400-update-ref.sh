@@ -1065,4 +1065,47 @@ test_expect_success 'stdin -z delete refs works with packed and loose refs' '
 	test_must_fail git rev-parse --verify -q $c
 '
 
+test_expect_success 'stdin large verify batch succeeds' '
+	sha1=$(git rev-parse $m) &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		git update-ref refs/heads/batch/ref-$i $m || return 1
+	done &&
+	for i in 1 2 3 4 5 6 7 8
+	do
+		echo "verify refs/heads/batch/ref-$i $sha1" || return 1
+	done >stdin &&
+	git -c refs.packedtransactionthreshold=4 update-ref --stdin <stdin
+'
+
+test_expect_success 'stdin large verify batch fails early on wrong old value' '
+	for i in 1 2 3 4 5 6 7
+	do
+		echo "verify refs/heads/batch/ref-$i $sha1" || return 1
+	done >stdin &&
+	echo "verify refs/heads/batch/ref-8 $(git rev-parse $m~1)" >>stdin &&
+	test_must_fail git -c refs.packedtransactionthreshold=4 \
+		update-ref --stdin <stdin 2>err &&
+	grep "fatal: Cannot lock the ref '"'"'refs/heads/batch/ref-8'"'"'" err
+'
+
+test_expect_success 'stdin large mixed batch updates and deletes refs' '
+	{
+		for i in 1 2 3 4
+		do
+			echo "update refs/heads/batch/ref-$i $m~1 $sha1" ||
+			return 1
+		done &&
+		for i in 5 6 7 8
+		do
+			echo "delete refs/heads/batch/ref-$i $sha1" || return 1
+		done
+	} >stdin &&
+	git -c refs.packedtransactionthreshold=4 update-ref --stdin <stdin &&
+	git rev-parse $m~1 >expect &&
+	git rev-parse refs/heads/batch/ref-1 >actual &&
+	test_cmp expect actual &&
+	test_must_fail git rev-parse --verify -q refs/heads/batch/ref-8
+'
+
 test_done
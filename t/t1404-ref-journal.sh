@@ -0,0 +1,67 @@
+#!/bin/sh
+
+test_description='ref update journal
+
+With refs.journal enabled, committed ref transactions append
+sequence-numbered records that git ref-journal reads back.'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	git config refs.journal true &&
+	test_commit one &&
+	test_commit two
+'
+
+test_expect_success 'ref updates are journaled in sequence' '
+	git ref-journal >out &&
+	head=$(git rev-parse HEAD) &&
+	prev=$(git rev-parse HEAD~1) &&
+	grep "^1 $_z40 $prev refs/heads/master" out &&
+	grep " $prev $head refs/heads/master" out
+'
+
+test_expect_success 'branch creation and deletion are journaled' '
+	git branch topic &&
+	git branch -d topic &&
+	head=$(git rev-parse HEAD) &&
+	git ref-journal >out &&
+	grep " $_z40 $head refs/heads/topic" out &&
+	grep " $head $_z40 refs/heads/topic" out
+'
+
+test_expect_success '--since shows only newer records' '
+	git ref-journal >all &&
+	last=$(tail -n 1 all | cut -d" " -f1) &&
+	git ref-journal --since=$last >out &&
+	test_must_be_empty out &&
+	since=$(($last - 1)) &&
+	git ref-journal --since=$since >out &&
+	test_line_count = 1 out &&
+	tail -n 1 all >expect &&
+	test_cmp expect out
+'
+
+test_expect_success 'sequence numbers keep increasing by one' '
+	test_commit three &&
+	git ref-journal >out &&
+	cut -d" " -f1 out >actual &&
+	test_write_lines $(test_seq $(wc -l <out)) >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'journal is not written when disabled' '
+	git config refs.journal false &&
+	git ref-journal >before &&
+	test_commit four &&
+	git ref-journal >after &&
+	test_cmp before after &&
+	git config refs.journal true
+'
+
+test_expect_success 'ref-journal without a journal prints nothing' '
+	git init empty &&
+	git -C empty ref-journal >out &&
+	test_must_be_empty out
+'
+
+test_done
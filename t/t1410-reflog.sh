@@ -317,4 +317,20 @@ test_expect_success 'parsing reverse reflogs at BUFSIZ boundaries' '
 	test_cmp expect actual
 '
 
+test_expect_success 'expire that prunes nothing leaves the log file alone' '
+	git checkout -b untouched &&
+	test_commit untouched-commit &&
+	test-chmtime =1234567890 .git/logs/refs/heads/untouched &&
+	git reflog expire --expire=never refs/heads/untouched &&
+	test-chmtime -v +0 .git/logs/refs/heads/untouched >actual &&
+	grep ^1234567890 actual
+'
+
+test_expect_success 'expire that prunes entries still rewrites the log file' '
+	test-chmtime =1234567890 .git/logs/refs/heads/untouched &&
+	git reflog expire --expire=now refs/heads/untouched &&
+	test-chmtime -v +0 .git/logs/refs/heads/untouched >actual &&
+	! grep ^1234567890 actual
+'
+
 test_done
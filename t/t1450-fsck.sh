@@ -420,4 +420,20 @@ test_expect_success 'fsck notices ref pointing to missing tag' '
 	test_must_fail git -C missing fsck
 '
 
+test_expect_success 'threaded checksum pass notices pack corruption' '
+	git init corrupt-pack &&
+	(
+		cd corrupt-pack &&
+		test_commit foo &&
+		git repack -ad &&
+		pack=$(echo .git/objects/pack/*.pack) &&
+		chmod +w $pack &&
+		printf xxxx |
+		dd of=$pack bs=1 seek=$(($(wc -c <$pack) - 4)) conv=notrunc &&
+		test_must_fail git fsck --full --threads=2 2>err &&
+		grep "SHA1 checksum mismatch" err &&
+		test_must_fail git fsck --full --threads=1
+	)
+'
+
 test_done
@@ -73,4 +73,49 @@ test_expect_success 'GIT_INDEX_VERSION takes precedence over config' '
 	)
 '
 
+test_expect_success 'index.threads records the offset table and EOIE extensions' '
+	(
+		sane_unset GIT_INDEX_VERSION &&
+		rm -f .git/index &&
+		echo 2 >b &&
+		git -c index.threads=2 update-index --add a b &&
+		"$PERL_PATH" -0777 -ne "exit(index(\$_, \"IEOT\") < 0)" .git/index &&
+		"$PERL_PATH" -0777 -ne "exit(index(\$_, \"EOIE\") < 0)" .git/index
+	)
+'
+
+test_expect_success 'extensions are not recorded without index.threads' '
+	(
+		sane_unset GIT_INDEX_VERSION &&
+		rm -f .git/index &&
+		git update-index --add a b &&
+		! "$PERL_PATH" -0777 -ne "exit(index(\$_, \"IEOT\") < 0)" .git/index &&
+		! "$PERL_PATH" -0777 -ne "exit(index(\$_, \"EOIE\") < 0)" .git/index
+	)
+'
+
+test_expect_success 'threaded index load gives the same index' '
+	(
+		sane_unset GIT_INDEX_VERSION &&
+		rm -f .git/index &&
+		for i in $(test_seq 1 30)
+		do
+			echo $i >file$i || exit 1
+		done &&
+		git -c index.threads=3 add a b file* &&
+		GIT_TEST_INDEX_THREADS=3 git ls-files -s >actual.threaded &&
+		GIT_TEST_INDEX_THREADS=1 git ls-files -s >actual.single &&
+		test_cmp actual.single actual.threaded
+	)
+'
+
+test_expect_success 'threaded load of a version 4 index' '
+	(
+		git -c index.threads=3 update-index --index-version 4 &&
+		GIT_TEST_INDEX_THREADS=3 git ls-files -s >actual.threaded &&
+		GIT_TEST_INDEX_THREADS=1 git ls-files -s >actual.single &&
+		test_cmp actual.single actual.threaded
+	)
+'
+
 test_done
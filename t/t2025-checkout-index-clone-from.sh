@@ -0,0 +1,44 @@
+#!/bin/sh
+
+test_description='git checkout-index --clone-from
+
+Provision a worktree by cloning verified-clean files from an
+existing worktree instead of inflating blobs from the object store.'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir sub &&
+	echo one >one &&
+	echo two >sub/two &&
+	git update-index --add one sub/two &&
+	test-chmtime -60 one sub/two &&
+	git update-index --refresh
+'
+
+test_expect_success 'provision a tree from a clean source worktree' '
+	git checkout-index --clone-from=. --prefix=dest/ -a &&
+	test_cmp one dest/one &&
+	test_cmp sub/two dest/sub/two
+'
+
+test_expect_success 'modified source file falls back to the object store' '
+	echo changed >one &&
+	git checkout-index --clone-from=. --prefix=dest2/ -a &&
+	echo one >expect &&
+	test_cmp expect dest2/one &&
+	git checkout-index -f one
+'
+
+test_expect_success 'missing source file falls back to the object store' '
+	rm sub/two &&
+	git checkout-index --clone-from=. --prefix=dest3/ -a &&
+	echo two >expect &&
+	test_cmp expect dest3/sub/two &&
+	git checkout-index -f sub/two
+'
+
+test_expect_success '--clone-from refuses a directory that is not a worktree' '
+	test_must_fail git checkout-index --clone-from=dest --prefix=dest4/ -a
+'
+
+test_done
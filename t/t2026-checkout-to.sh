@@ -0,0 +1,62 @@
+#!/bin/sh
+
+test_description='checkout --to <path>
+
+Linked worktrees share the object store, refs and config with the
+main repository; only HEAD, the index and their reflog stay private.'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit init &&
+	git branch side
+'
+
+test_expect_success 'checkout --to refuses a non-empty existing target' '
+	mkdir occupied &&
+	>occupied/file &&
+	test_must_fail git checkout --to occupied side
+'
+
+test_expect_success 'checkout --to a new linked worktree' '
+	git checkout --to here side &&
+	test -f here/.git &&
+	test_cmp init.t here/init.t &&
+	git -C here log --format=%s -1 >actual &&
+	echo init >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'linked worktree has its own HEAD and index' '
+	test_path_is_file .git/worktrees/here/HEAD &&
+	test_path_is_file .git/worktrees/here/index &&
+	test_path_is_file .git/worktrees/here/commondir
+'
+
+test_expect_success 'commits in the linked worktree update shared refs' '
+	(
+		cd here &&
+		echo more >new-file &&
+		git add new-file &&
+		git commit -m in-linked
+	) &&
+	git log --format=%s -1 side >actual &&
+	echo in-linked >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'rev-parse --git-common-dir points at the main repository' '
+	git -C here rev-parse --git-common-dir >actual &&
+	grep "\.git/worktrees/here/\.\./\.\.$" actual
+'
+
+test_expect_success 'split-index base segments land in the common dir' '
+	git -C here update-index --split-index &&
+	ls .git/sharedindex.* &&
+	test $(ls .git/worktrees/here | grep sharedindex | wc -l) = 0
+'
+
+test_expect_success 'checkout --to refuses to mix in pathspecs' '
+	test_must_fail git checkout --to elsewhere side -- init.t
+'
+
+test_done
@@ -0,0 +1,111 @@
+#!/bin/sh
+
+test_description='parallel checkout'
+. ./test-lib.sh
+
+# Force the workers on even for small checkouts, so that all of these
+# tests actually exercise the parallel code path.
+GIT_TEST_CONFIG="-c checkout.workers=2 -c checkout.thresholdForParallelism=0"
+
+# A worktree checks out correctly iff nothing is missing or modified
+# with respect to the index that was just written.
+verify_checkout () {
+	git -C "$1" status --porcelain >status.out &&
+	test_must_be_empty status.out
+}
+
+test_expect_success 'setup' '
+	git init source &&
+	(
+		cd source &&
+		mkdir -p a/b c &&
+		for f in top a/b/deep c/one c/two c/exe
+		do
+			echo "content of $f" >$f || return 1
+		done &&
+		chmod +x c/exe &&
+		git add . &&
+		test_tick &&
+		git commit -m initial &&
+		for f in top a/b/deep
+		do
+			echo "changed $f" >$f || return 1
+		done &&
+		git commit -a -m second
+	)
+'
+
+test_expect_success 'parallel clone produces a correct working tree' '
+	git $GIT_TEST_CONFIG clone source parallel &&
+	verify_checkout parallel &&
+	echo "changed top" >expect &&
+	test_cmp expect parallel/top
+'
+
+test_expect_success 'executable bit is preserved' '
+	test -x parallel/c/exe
+'
+
+test_expect_success 'parallel branch switching updates files' '
+	(
+		cd parallel &&
+		git $GIT_TEST_CONFIG checkout HEAD^ &&
+		echo "content of top" >../expect &&
+		test_cmp ../expect top &&
+		git $GIT_TEST_CONFIG checkout master &&
+		echo "changed top" >../expect &&
+		test_cmp ../expect top
+	) &&
+	verify_checkout parallel
+'
+
+test_expect_success 'path collisions are resolved sequentially' '
+	(
+		cd parallel &&
+		rm -rf a &&
+		>a &&
+		git $GIT_TEST_CONFIG checkout -f master 2>../err &&
+		! grep error ../err &&
+		echo "changed a/b/deep" >../expect &&
+		test_cmp ../expect a/b/deep
+	) &&
+	verify_checkout parallel
+'
+
+test_expect_success SYMLINKS 'symlinks and conversion fall back gracefully' '
+	(
+		cd source &&
+		ln -s top link &&
+		echo "c/one ident" >.gitattributes &&
+		git add link .gitattributes &&
+		test_tick &&
+		git commit -m attrs
+	) &&
+	git $GIT_TEST_CONFIG clone source converted &&
+	verify_checkout converted &&
+	test -h converted/link &&
+	echo "content of c/one" >expect &&
+	test_cmp expect converted/c/one
+'
+
+test_expect_success 'parallel checkout with a threshold stays correct' '
+	git -c checkout.workers=8 -c checkout.thresholdForParallelism=4 \
+		clone source parallel2 &&
+	verify_checkout parallel2
+'
+
+test_expect_success 'blobs over core.bigFileThreshold are streamed' '
+	(
+		cd source &&
+		test-genrandom big 65536 >big.bin &&
+		git add big.bin &&
+		test_tick &&
+		git commit -m big
+	) &&
+	git -c core.bigFileThreshold=1k $GIT_TEST_CONFIG \
+		clone source streamed &&
+	verify_checkout streamed &&
+	test_cmp source/big.bin streamed/big.bin
+'
+
+test_done
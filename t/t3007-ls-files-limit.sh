@@ -0,0 +1,61 @@
+#!/bin/sh
+
+test_description='ls-files and ls-tree --skip/--max-count'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir sub &&
+	for i in 0 1 2 3 4 5 6 7 8 9
+	do
+		echo $i >f$i &&
+		echo $i >sub/s$i || return 1
+	done &&
+	git add . &&
+	git commit -m init
+'
+
+test_expect_success 'ls-files --skip/--max-count pages through the index' '
+	git ls-files >all &&
+	sed -n "4,6p" all >expect &&
+	git ls-files --skip=3 --max-count=3 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-files --max-count=0 shows nothing' '
+	git ls-files --max-count=0 >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'ls-files --skip past the end shows nothing' '
+	git ls-files --skip=1000 >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'ls-files limits apply to --others' '
+	git ls-files -o >others &&
+	head -n 2 others >expect &&
+	git ls-files -o --max-count=2 >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-files rejects --error-unmatch with a limit' '
+	test_must_fail git ls-files --error-unmatch --max-count=1 f1
+'
+
+test_expect_success 'ls-tree --skip/--max-count pages through the tree' '
+	git ls-tree -r --name-only HEAD >all &&
+	sed -n "4,7p" all >expect &&
+	git ls-tree -r --name-only --skip=3 --max-count=4 HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'ls-tree --max-count=0 shows nothing and succeeds' '
+	git ls-tree --max-count=0 HEAD >actual &&
+	test_must_be_empty actual
+'
+
+test_expect_success 'ls-tree rejects a negative --skip' '
+	test_must_fail git ls-tree --skip=-1 HEAD
+'
+
+test_done
@@ -187,4 +187,26 @@ test_expect_success 'notice d/f conflict with existing ref' '
 	test_must_fail git branch foo/bar/baz/lots/of/extra/components
 '
 
+test_expect_success 'packed-refs header declares the sorted trait' '
+	git pack-refs --all --prune &&
+	head -n 1 .git/packed-refs >header &&
+	grep " sorted " header
+'
+
+test_expect_success 'refs are packed in sorted order' '
+	sed -e "/^#/d" -e "/^\^/d" -e "s/^[0-9a-f]* //" <.git/packed-refs >actual &&
+	sort <actual >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'resolve and iterate an unsorted packed-refs file' '
+	git for-each-ref >expect &&
+	sed -e "/^#/d" -e "/^\^/d" <.git/packed-refs |
+	sort -r >refs.unsorted &&
+	cp refs.unsorted .git/packed-refs &&
+	git rev-parse --verify refs/top &&
+	git for-each-ref >actual &&
+	test_cmp expect actual
+'
+
 test_done
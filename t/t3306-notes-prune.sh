@@ -138,4 +138,19 @@ test_expect_success 'verify that notes are gone' '
 	git notes show ab5f302035f2e7aaf04265f08b42034c23256e1f
 '
 
+test_expect_success 'prune leaves behind a notes index answering lookups' '
+
+	test_path_is_file .git/notes-index &&
+	git notes show ab5f302035f2e7aaf04265f08b42034c23256e1f &&
+	test_must_fail git notes show 08341ad9e94faa089d60fd3f523affb25c6da189
+'
+
+test_expect_success 'a stale notes index is ignored' '
+
+	test_commit newest &&
+	git notes add -m "newest note" &&
+	git notes show HEAD &&
+	git notes show ab5f302035f2e7aaf04265f08b42034c23256e1f
+'
+
 test_done
@@ -55,4 +55,32 @@ test_expect_success \
      expr "$(echo $(git cherry master my-topic-branch) )" : "+ [^ ]* - .*"
 '
 
+test_expect_success 'patchid.cache records computed patch-ids' '
+     test_config patchid.cache true &&
+     rm -f .git/info/patch-id-cache &&
+     git cherry master my-topic-branch &&
+     head -n 1 .git/info/patch-id-cache | grep "^signature " &&
+     grep "^$(git rev-parse my-topic-branch) " .git/info/patch-id-cache &&
+     grep "^$(git rev-parse my-topic-branch^) " .git/info/patch-id-cache
+'
+
+test_expect_success 'cached patch-ids are used without rediffing' '
+     test_config patchid.cache true &&
+     B=$(git rev-parse my-topic-branch^) &&
+     C=$(git rev-parse my-topic-branch) &&
+     id=$(sed -n "s/^$C //p" .git/info/patch-id-cache) &&
+     sed "s/^$B .*/$B $id/" .git/info/patch-id-cache >cache.tmp &&
+     mv cache.tmp .git/info/patch-id-cache &&
+     expr "$(echo $(git cherry master my-topic-branch) )" : "- [^ ]* - .*"
+'
+
+test_expect_success 'corrupt options signature discards the cache' '
+     test_config patchid.cache true &&
+     sed "1s/^signature .*/signature $_z40/" .git/info/patch-id-cache >cache.tmp &&
+     mv cache.tmp .git/info/patch-id-cache &&
+     expr "$(echo $(git cherry master my-topic-branch) )" : "+ [^ ]* - .*" &&
+     head -n 1 .git/info/patch-id-cache >actual &&
+     ! grep "$_z40" actual
+'
+
 test_done
@@ -332,4 +332,17 @@ test_expect_success 'git add --dry-run --ignore-missing of non-existing file out
 	test_i18ncmp expect.err actual.err
 '
 
+test_expect_success 'git add with core.fsyncObjectFiles=batch' '
+	echo batched-content >batched &&
+	git -c core.fsyncobjectfiles=batch add batched &&
+	echo batched-content >expect &&
+	git cat-file blob :batched >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'core.fsyncObjectFiles rejects unknown values' '
+	echo more >>batched &&
+	test_must_fail git -c core.fsyncobjectfiles=bogus add batched
+'
+
 test_done
@@ -156,4 +156,25 @@ test_expect_success 'rename pretty print common prefix and suffix overlap' '
 	test_i18ngrep " d/f/{ => f}/e " output
 '
 
+test_expect_success 'threaded rename scoring matches single-threaded' '
+	git checkout -b many-renames &&
+	mkdir from &&
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		test_seq $i $(($i + 20)) >from/file-$i || return 1
+	done &&
+	git add from &&
+	git commit -m "rename sources" &&
+	mkdir to &&
+	for i in 1 2 3 4 5 6 7 8 9 10
+	do
+		git mv from/file-$i to/moved-$i &&
+		echo edited >>to/moved-$i || return 1
+	done &&
+	git commit -a -m "rename destinations" &&
+	git -c diff.renameThreads=1 diff -M --name-status HEAD^ HEAD >expect &&
+	git -c diff.renameThreads=4 diff -M --name-status HEAD^ HEAD >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -0,0 +1,52 @@
+#!/bin/sh
+
+test_description='threaded xdiff produces the same output as sequential
+
+diff.parallelThreshold lets the classic diff algorithm fork worker
+threads for the halves of a split; the result must not depend on it.'
+
+. ./test-lib.sh
+
+# Lines must repeat on both sides, or the preparation pass discards
+# them before the split machinery ever runs.
+test_expect_success 'setup' '
+	for i in $(test_seq 1 2000)
+	do
+		echo "pattern line $(($i % 100))"
+	done >old &&
+	for i in $(test_seq 1 2000)
+	do
+		if test $(($i % 300)) = 17
+		then
+			echo "edited line $i"
+		else
+			echo "pattern line $(($i % 100))"
+		fi
+	done >new
+'
+
+test_expect_success 'threaded diff output matches sequential' '
+	test_expect_code 1 git diff --no-index old new >expect &&
+	test_expect_code 1 git -c diff.parallelthreshold=100 \
+		diff --no-index old new >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'minimal diff is unaffected' '
+	test_expect_code 1 git diff --minimal --no-index old new >expect &&
+	test_expect_code 1 git -c diff.parallelthreshold=100 \
+		diff --minimal --no-index old new >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'blame works with a threshold configured' '
+	git add old new &&
+	git commit -m base &&
+	cp new old &&
+	git commit -am update &&
+	git -c diff.parallelthreshold=100 blame old >actual &&
+	git blame old >expect &&
+	test_cmp expect actual
+'
+
+test_done
@@ -0,0 +1,46 @@
+#!/bin/sh
+
+test_description='git apply --write-tree'
+
+. ./test-lib.sh
+
+test_expect_success setup '
+	test_write_lines 1 2 3 4 5 >file &&
+	git add file &&
+	git commit -m initial &&
+	test_write_lines 1 2 three 4 5 >file &&
+	git diff >patch &&
+	git checkout file
+'
+
+test_expect_success '--write-tree reports the tree of the updated index' '
+	git apply --index --write-tree patch >actual &&
+	git write-tree >expect &&
+	test_cmp expect actual &&
+	git read-tree HEAD &&
+	git checkout file
+'
+
+test_expect_success '--cached --write-tree leaves the working tree alone' '
+	git apply --cached --write-tree patch >actual &&
+	git write-tree >expect &&
+	test_cmp expect actual &&
+	test_write_lines 1 2 3 4 5 >expect.file &&
+	test_cmp expect.file file &&
+	git read-tree HEAD
+'
+
+test_expect_success '--write-tree requires --index or --cached' '
+	test_must_fail git apply --write-tree patch
+'
+
+test_expect_success 'nothing is printed when applying fails' '
+	test_write_lines a b c >file &&
+	git add file &&
+	test_must_fail git apply --cached --write-tree patch >actual &&
+	test_must_be_empty actual &&
+	git read-tree HEAD &&
+	git checkout file
+'
+
+test_done
@@ -352,4 +352,35 @@ test_expect_success 'turn tree to file' '
 	test_cmp expect actual
 '
 
+test_expect_success '--write-tree prints the tree of a clean merge' '
+	git reset --hard initial &&
+	test_commit "wt-side" "side-file" "AAA" &&
+	git reset --hard initial &&
+	test_commit "wt-master" "master-file" "BBB" &&
+	git merge-tree --write-tree wt-master wt-side >actual &&
+	git merge -m merged wt-side &&
+	git rev-parse HEAD^{tree} >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--write-tree reports conflicting stages' '
+	git reset --hard initial &&
+	test_commit "wt-conflict-a" "conflicted" "AAA" &&
+	git reset --hard initial &&
+	test_commit "wt-conflict-b" "conflicted" "BBB" &&
+	git reset --hard initial &&
+	test_must_fail git merge-tree --write-tree wt-conflict-a wt-conflict-b >actual &&
+	grep "2	conflicted" actual &&
+	grep "3	conflicted" actual &&
+	git diff-index --quiet HEAD
+'
+
+test_expect_success '--write-tree works in a bare repository' '
+	git clone --bare . bare.git &&
+	git -C bare.git merge-tree --write-tree wt-master wt-side >actual &&
+	git rev-parse wt-master^{tree} >/dev/null &&
+	git merge-tree --write-tree wt-master wt-side >expect &&
+	test_cmp expect actual
+'
+
 test_done
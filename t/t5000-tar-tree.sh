@@ -319,4 +319,25 @@ test_expect_success 'catch non-matching pathspec' '
 	test_must_fail git archive -v HEAD -- "*.abc" >/dev/null
 '
 
+test_expect_success 'archive.cacheDir caches archives of commits' '
+	test_config archive.cacheDir "$PWD/archive-cache" &&
+	git archive HEAD >cached1.tar &&
+	ls archive-cache/*.tar >entries &&
+	test_line_count = 1 entries &&
+	git archive HEAD >cached2.tar &&
+	test_cmp_bin cached1.tar cached2.tar &&
+	git archive HEAD >plain.tar &&
+	test_cmp_bin plain.tar cached1.tar
+'
+
+test_expect_success 'archive cache distinguishes options and skips trees' '
+	test_config archive.cacheDir "$PWD/archive-cache" &&
+	git archive --prefix=sub/ HEAD >prefixed.tar &&
+	ls archive-cache/*.tar >entries &&
+	test_line_count = 2 entries &&
+	git archive $(git rev-parse HEAD^{tree}) >tree.tar &&
+	ls archive-cache/*.tar >entries &&
+	test_line_count = 2 entries
+'
+
 test_done
@@ -214,6 +214,22 @@ test_expect_success \
 			test-2-${packname_2}.idx \
 			test-3-${packname_3}.idx'
 
+test_expect_success \
+    'verify pack --stats' \
+    'git verify-pack --stats test-1-${packname_1}.idx >stats &&
+     grep "^objects: " stats &&
+     grep "^blob-count: " stats &&
+     grep "^delta-count: 0" stats'
+
+test_expect_success \
+    'verify pack --stats counts deltas' \
+    'git verify-pack --stats test-2-${packname_2}.idx >stats &&
+     nondelta=$(git verify-pack -v test-2-${packname_2}.idx |
+		sed -n "s/^non delta: \([0-9]*\) objects\$/\1/p") &&
+     objects=$(sed -n "s/^objects: //p" stats) &&
+     deltas=$(sed -n "s/^delta-count: //p" stats) &&
+     test "$objects" = "$(($nondelta + $deltas))"'
+
 test_expect_success \
     'verify-pack catches mismatched .idx and .pack files' \
     'cat test-1-${packname_1}.idx >test-3.idx &&
@@ -241,6 +257,19 @@ test_expect_success \
      else :;
      fi'
 
+test_expect_success \
+    'index-pack rejects a pack tagged with an unknown codec' \
+    'cat test-1-${packname_1}.pack >test-4.pack &&
+     printf "\0\1\0\4" | dd of=test-4.pack count=4 bs=1 conv=notrunc seek=4 &&
+     if git index-pack test-4.pack
+     then false
+     else :;
+     fi &&
+     if git unpack-objects -n <test-4.pack
+     then false
+     else :;
+     fi'
+
 test_expect_success \
     'verify-pack catches a corrupted type/size of the 1st packed object data' \
     'cat test-1-${packname_1}.pack >test-3.pack &&
@@ -261,4 +261,16 @@ test_expect_success 'prune: handle alternate object database' '
 	git -C B prune
 '
 
+test_expect_success 'prune consults the object creation-time log' '
+	test_config core.logObjectTimes true &&
+	BLOB=$(echo time-logged | git hash-object -w --stdin) &&
+	grep $BLOB .git/objects/info/object-times &&
+	git prune --expire=1.hour.ago &&
+	verbose git cat-file -e $BLOB &&
+	grep $BLOB .git/objects/info/object-times &&
+	git prune --expire=now &&
+	test_must_fail git cat-file -e $BLOB &&
+	! grep $BLOB .git/objects/info/object-times
+'
+
 test_done
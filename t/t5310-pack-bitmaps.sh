@@ -119,6 +119,19 @@ test_expect_success 'fetch (full bitmap)' '
 	test_cmp expect actual
 '
 
+test_expect_success 'quiet object walk uses bitmaps without output' '
+	git rev-list --use-bitmap-index --objects --quiet HEAD >actual &&
+	! test -s actual
+'
+
+test_expect_success 'fetch of ancestor negotiates via bitmaps' '
+	git branch old HEAD~5 &&
+	git --git-dir=clone.git fetch origin old:old &&
+	git rev-parse old >expect &&
+	git --git-dir=clone.git rev-parse old >actual &&
+	test_cmp expect actual
+'
+
 test_expect_success 'create objects for missing-HAVE tests' '
 	blob=$(echo "missing have" | git hash-object -w --stdin) &&
 	tree=$(printf "100644 blob $blob\tfile\n" | git mktree) &&
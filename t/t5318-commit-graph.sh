@@ -0,0 +1,88 @@
+#!/bin/sh
+
+test_description='commit graph'
+. ./test-lib.sh
+
+test_expect_success 'setup repo with history' '
+	for i in 1 2 3 4 5
+	do
+		echo $i >file &&
+		git add file &&
+		test_tick &&
+		git commit -m "commit $i" || return 1
+	done &&
+	git checkout -b side HEAD~2 &&
+	echo side >side-file &&
+	git add side-file &&
+	test_tick &&
+	git commit -m side &&
+	git checkout master &&
+	test_tick &&
+	git merge -m merge side
+'
+
+test_expect_success 'gc does not write commit graph by default' '
+	git gc --quiet &&
+	test_path_is_missing .git/objects/info/commit-graph
+'
+
+test_expect_success 'gc writes commit graph when configured' '
+	git config gc.writeCommitGraph true &&
+	git gc --quiet &&
+	test_path_is_file .git/objects/info/commit-graph
+'
+
+test_expect_success 'log output unchanged by commit graph' '
+	git -c core.commitGraph=false log --oneline --topo-order --all >expect &&
+	git -c core.commitGraph=true log --oneline --topo-order --all >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'merge-base unchanged by commit graph' '
+	git -c core.commitGraph=false merge-base master side >expect &&
+	git -c core.commitGraph=true merge-base master side >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'pathspec-limited log unchanged by commit graph' '
+	for path in file side-file
+	do
+		git -c core.commitGraph=false log --oneline -- $path >expect &&
+		git -c core.commitGraph=true log --oneline -- $path >actual &&
+		test_cmp expect actual || return 1
+	done
+'
+
+test_expect_success 'graph is rewritten as history grows' '
+	echo more >file &&
+	test_tick &&
+	git commit -a -m more &&
+	git log --oneline --all >expect &&
+	git gc --quiet &&
+	git log --oneline --all >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'walks stay correct with skewed committer dates' '
+	test_when_finished "git checkout master" &&
+	git checkout -b skew master &&
+	GIT_COMMITTER_DATE="1971-01-01 00:00" git commit --allow-empty -m old-date &&
+	test_tick &&
+	git commit --allow-empty -m newer &&
+	git gc --quiet &&
+	git -c core.commitGraph=false merge-base master skew >expect &&
+	git -c core.commitGraph=true merge-base master skew >actual &&
+	test_cmp expect actual &&
+	git -c core.commitGraph=false rev-list --topo-order master..skew >expect &&
+	git -c core.commitGraph=true rev-list --topo-order master..skew >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'corrupt graph is ignored' '
+	echo garbage >.git/objects/info/commit-graph &&
+	git log --oneline --all >actual &&
+	git -c core.commitGraph=false log --oneline --all >expect &&
+	test_cmp expect actual
+'
+
+test_done
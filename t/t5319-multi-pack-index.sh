@@ -0,0 +1,66 @@
+#!/bin/sh
+
+test_description='multi-pack-index'
+. ./test-lib.sh
+
+objdir=.git/objects
+midx=$objdir/pack/multi-pack-index
+
+commit_and_pack () {
+	echo "$1" >"file-$1" &&
+	git add "file-$1" &&
+	test_tick &&
+	git commit -m "commit $1" &&
+	git repack -d
+}
+
+test_expect_success 'setup several packs' '
+	git config core.multiPackIndex false &&
+	for i in 1 2 3 4 5
+	do
+		commit_and_pack $i || return 1
+	done &&
+	test $(ls $objdir/pack/pack-*.idx | wc -l) -gt 1 &&
+	test_path_is_missing $midx
+'
+
+test_expect_success 'repack writes multi-pack-index when configured' '
+	git config core.multiPackIndex true &&
+	git repack &&
+	test_path_is_file $midx
+'
+
+test_expect_success 'object lookup through multi-pack-index' '
+	git rev-list --objects --all >expect.raw &&
+	git -c core.multiPackIndex=false rev-list --objects --all >actual.raw &&
+	sort expect.raw >expect &&
+	sort actual.raw >actual &&
+	test_cmp expect actual &&
+	git cat-file commit HEAD >/dev/null
+'
+
+test_expect_success 'index-pack refreshes multi-pack-index on fetch' '
+	git clone --bare . other.git &&
+	git -C other.git config core.multiPackIndex true &&
+	commit_and_pack 6 &&
+	git -C other.git fetch .. master:refs/heads/master &&
+	test_path_is_file other.git/objects/pack/multi-pack-index &&
+	git -C other.git rev-list master >/dev/null
+'
+
+test_expect_success 'stale multi-pack-index entries fall back to packs' '
+	git repack &&
+	commit_and_pack 7 &&
+	git -c core.multiPackIndex=false repack -a -d &&
+	git fsck &&
+	git rev-list --all >/dev/null
+'
+
+test_expect_success 'corrupt multi-pack-index is ignored' '
+	git repack &&
+	echo garbage >$midx &&
+	git rev-list --all >/dev/null &&
+	git cat-file commit HEAD >/dev/null
+'
+
+test_done
@@ -0,0 +1,68 @@
+#!/bin/sh
+
+test_description='delta islands keep deltas reusable per ref namespace'
+. ./test-lib.sh
+
+# Print "<sha1> <base-sha1>" for every packed blob; full objects get
+# the base "-".
+packed_blob_bases () {
+	git verify-pack -v .git/objects/pack/*.idx |
+	perl -lne '
+		next unless /^([0-9a-f]{40}) blob/;
+		my @f = split;
+		print "$f[0] ", defined $f[6] ? $f[6] : "-";
+	' | sort
+}
+
+test_expect_success 'setup repo with two similar branches' '
+	echo base >README &&
+	git add README &&
+	test_tick &&
+	git commit -m base &&
+	git checkout -b one master &&
+	test_seq 1 3000 >data &&
+	git add data &&
+	git commit -m one &&
+	git checkout -b two master &&
+	test_seq 0 2999 >data &&
+	git add data &&
+	git commit -m two &&
+	blob_one=$(git rev-parse one:data) &&
+	blob_two=$(git rev-parse two:data)
+'
+
+test_expect_success 'vanilla repack deltas across branches' '
+	git repack -adf &&
+	packed_blob_bases >bases &&
+	grep -E "^$blob_one $blob_two|^$blob_two $blob_one" bases
+'
+
+test_expect_success 'delta islands forbid cross-island deltas' '
+	git config pack.island "refs/heads/([^/]+)" &&
+	git repack -adf --delta-islands &&
+	packed_blob_bases >bases &&
+	! grep "^$blob_one $blob_two" bases &&
+	! grep "^$blob_two $blob_one" bases
+'
+
+test_expect_success 'cross-island blobs are stored in full' '
+	grep "^$blob_one -" bases &&
+	grep "^$blob_two -" bases
+'
+
+test_expect_success 'clones of a single branch still work' '
+	git clone --no-local --single-branch -b one . clone-one &&
+	git clone --no-local --single-branch -b two . clone-two &&
+	git -C clone-one fsck &&
+	git -C clone-two fsck
+'
+
+test_expect_success 'repack.useDeltaIslands config enables islands' '
+	git config repack.useDeltaIslands true &&
+	git repack -adf &&
+	packed_blob_bases >bases &&
+	! grep "^$blob_one $blob_two" bases &&
+	! grep "^$blob_two $blob_one" bases
+'
+
+test_done
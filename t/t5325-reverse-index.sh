@@ -0,0 +1,77 @@
+#!/bin/sh
+
+test_description='pack reverse index (.rev files)'
+. ./test-lib.sh
+
+packdir=.git/objects/pack
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	test_commit three
+'
+
+test_expect_success 'repack does not write .rev by default' '
+	git repack -ad &&
+	test -z "$(find $packdir -name "*.rev")"
+'
+
+test_expect_success 'repack with pack.writeReverseIndex writes .rev' '
+	git config pack.writeReverseIndex true &&
+	git repack -ad &&
+	ls $packdir/pack-*.rev >revs &&
+	test_line_count = 1 revs
+'
+
+test_expect_success 'object reads use the reverse index' '
+	git rev-list --objects HEAD >tmp &&
+	cut -d" " -f1 <tmp >objects &&
+	git cat-file --batch-check="%(objectname) %(objectsize:disk)" \
+		<objects >with.rev &&
+	rev="$(ls $packdir/pack-*.rev)" &&
+	mv "$rev" rev.bak &&
+	git cat-file --batch-check="%(objectname) %(objectsize:disk)" \
+		<objects >without.rev &&
+	mv rev.bak "$rev" &&
+	test_cmp with.rev without.rev
+'
+
+test_expect_success 'corrupt .rev falls back to in-memory build' '
+	rev="$(ls $packdir/pack-*.rev)" &&
+	cp "$rev" rev.bak &&
+	printf XXXX | dd of="$rev" bs=1 count=4 conv=notrunc &&
+	git cat-file --batch-check="%(objectname) %(objectsize:disk)" \
+		<objects >corrupt.out 2>corrupt.err &&
+	mv rev.bak "$rev" &&
+	test_cmp with.rev corrupt.out &&
+	grep "reverse index" corrupt.err
+'
+
+test_expect_success 'truncated .rev falls back to in-memory build' '
+	rev="$(ls $packdir/pack-*.rev)" &&
+	cp "$rev" rev.bak &&
+	head -c 20 rev.bak >"$rev" &&
+	git cat-file --batch-check="%(objectname) %(objectsize:disk)" \
+		<objects >truncated.out 2>truncated.err &&
+	mv rev.bak "$rev" &&
+	test_cmp with.rev truncated.out &&
+	grep "wrong size" truncated.err
+'
+
+test_expect_success 'index-pack writes .rev alongside the index' '
+	git pack-objects --revs mypack <<-\EOF &&
+	HEAD
+	EOF
+	git index-pack -o other.idx mypack-*.pack &&
+	test_path_is_file other.rev
+'
+
+test_expect_success 'repack removes stale .rev files' '
+	old="$(ls $packdir/pack-*.rev)" &&
+	git config pack.writeReverseIndex false &&
+	test_commit four &&
+	git repack -ad &&
+	test_path_is_missing "$old"
+'
+
+test_done
@@ -135,6 +135,32 @@ test_expect_success 'send-pack stderr contains hook messages' '
 	test_cmp expect actual
 '
 
+test_expect_success 'hook.<name>.refPrefix limits what the hooks see' '
+	git init --bare filtered.git &&
+	git -C filtered.git config hook.pre-receive.refPrefix refs/heads/seen/ &&
+	git -C filtered.git config hook.update.refPrefix refs/heads/seen/ &&
+	write_script filtered.git/hooks/pre-receive <<-\EOF &&
+	cat >"$GIT_DIR"/pre-receive.stdin
+	EOF
+	write_script filtered.git/hooks/update <<-\EOF &&
+	echo "$1" >>"$GIT_DIR"/update.args
+	EOF
+	git push ./filtered.git $commit1:refs/heads/seen/a \
+		$commit1:refs/heads/other/b &&
+	echo refs/heads/seen/a >expect &&
+	test_cmp expect filtered.git/update.args &&
+	grep refs/heads/seen/a filtered.git/pre-receive.stdin &&
+	! grep refs/heads/other/b filtered.git/pre-receive.stdin
+'
+
+test_expect_success 'push touching no interesting ref skips the hook' '
+	write_script filtered.git/hooks/pre-receive <<-\EOF &&
+	: >"$GIT_DIR"/pre-receive.ran
+	EOF
+	git push ./filtered.git $commit1:refs/heads/other/c &&
+	test_path_is_missing filtered.git/pre-receive.ran
+'
+
 test_expect_success 'pre-receive hook that forgets to read its input' '
 	write_script victim.git/hooks/pre-receive <<-\EOF &&
 	exit 0
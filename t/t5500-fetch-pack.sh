@@ -637,4 +637,77 @@ test_expect_success MINGW 'fetch-pack --diag-url c:repo' '
 	check_prot_path c:repo file c:repo
 '
 
+setup_negotiation_client () {
+	rm -rf "$1" &&
+	git clone negotiation-server "$1" &&
+	(
+		cd "$1" &&
+		# plain commits, not test_commit: a tag on every commit
+		# would put each of them on the tip of the rev walk and
+		# defeat any skipping
+		for i in $(test_seq 1 100)
+		do
+			test_tick &&
+			git commit --allow-empty -m c$i || exit 1
+		done
+	)
+}
+
+test_expect_success 'set up tests of fetch negotiation' '
+	rm -rf negotiation-server &&
+	git init negotiation-server &&
+	(
+		cd negotiation-server &&
+		test_commit both
+	) &&
+	setup_negotiation_client nego-default &&
+	setup_negotiation_client nego-skipping &&
+	setup_negotiation_client nego-remote &&
+	(
+		cd negotiation-server &&
+		test_commit theirs
+	)
+'
+
+test_expect_success 'fetch.negotiationAlgorithm=skipping sends fewer haves' '
+	(
+		cd nego-default &&
+		GIT_TRACE_PACKET="$TRASH_DIRECTORY/default.log" \
+			git fetch origin master &&
+		git cat-file commit FETCH_HEAD
+	) &&
+	(
+		cd nego-skipping &&
+		GIT_TRACE_PACKET="$TRASH_DIRECTORY/skipping.log" \
+			git -c fetch.negotiationAlgorithm=skipping \
+			fetch origin master &&
+		git cat-file commit FETCH_HEAD
+	) &&
+	test $(grep -c "have " skipping.log) -lt $(grep -c "have " default.log)
+'
+
+test_expect_success 'remote.<name>.negotiationAlgorithm is honored' '
+	(
+		cd nego-remote &&
+		git config remote.origin.negotiationAlgorithm skipping &&
+		GIT_TRACE_PACKET="$TRASH_DIRECTORY/remote.log" \
+			git fetch origin master &&
+		git cat-file commit FETCH_HEAD
+	) &&
+	test $(grep -c "have " remote.log) -lt $(grep -c "have " default.log)
+'
+
+test_expect_success 'unknown fetch.negotiationAlgorithm falls back with warning' '
+	(
+		cd negotiation-server &&
+		test_commit more
+	) &&
+	(
+		cd nego-default &&
+		git -c fetch.negotiationAlgorithm=invalid \
+			fetch origin master 2>err &&
+		test_i18ngrep "unknown fetch negotiation algorithm" err
+	)
+'
+
 test_done
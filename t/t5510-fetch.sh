@@ -708,4 +708,78 @@ test_expect_success 'fetching a one-level ref works' '
 	)
 '
 
+test_expect_success 'fetch --atomic updates all refs in one transaction' '
+	git clone . atomic &&
+	git branch atomic-one &&
+	git branch atomic-two &&
+	(
+		cd atomic &&
+		git fetch --atomic origin &&
+		git rev-parse --verify refs/remotes/origin/atomic-one &&
+		git rev-parse --verify refs/remotes/origin/atomic-two
+	)
+'
+
+test_expect_success 'failed fetch --atomic leaves all refs untouched' '
+	git branch atomic-three &&
+	(
+		cd atomic &&
+		git update-ref refs/remotes/origin/atomic-one extra^0 &&
+		test_must_fail git fetch --atomic origin \
+			"refs/heads/atomic-one:refs/remotes/origin/atomic-one" \
+			"refs/heads/atomic-three:refs/remotes/origin/atomic-three" &&
+		test_must_fail git rev-parse --verify refs/remotes/origin/atomic-three
+	)
+'
+
+test_expect_success 'large atomic fetch rewrites packed-refs in one go' '
+	(
+		cd atomic &&
+		git config refs.packedTransactionThreshold 2 &&
+		git pack-refs --all --prune &&
+		git fetch --atomic --force origin \
+			"refs/heads/*:refs/remotes/origin/*" &&
+		git rev-parse --verify refs/remotes/origin/atomic-three &&
+		grep atomic-three .git/packed-refs &&
+		test_path_is_missing .git/refs/remotes/origin/atomic-three
+	)
+'
+
+test_expect_success 'fetch with refspec limits the ref advertisement' '
+	(
+		cd "$D" &&
+		git clone . limit &&
+		cd limit &&
+		GIT_TRACE_PACKET="$(pwd)/trace" \
+			git fetch --no-tags origin master &&
+		! grep "refs/tags" trace
+	)
+'
+
+test_expect_success 'fetch.quickCheck skips a no-op fetch' '
+	(
+		cd "$D" &&
+		git clone . quickcheck &&
+		cd quickcheck &&
+		git config fetch.quickcheck true &&
+		git fetch origin &&
+		test_path_is_file .git/fetch-state/origin &&
+		rm -f .git/FETCH_HEAD &&
+		git fetch origin &&
+		test_path_is_missing .git/FETCH_HEAD
+	)
+'
+
+test_expect_success 'fetch.quickCheck still notices remote changes' '
+	(
+		cd "$D" &&
+		git commit --allow-empty -m quickcheck-probe &&
+		cd quickcheck &&
+		git fetch origin &&
+		git rev-parse origin/master >actual &&
+		git -C .. rev-parse master >expect &&
+		test_cmp expect actual
+	)
+'
+
 test_done
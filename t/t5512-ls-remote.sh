@@ -140,4 +140,19 @@ do
 	'
 done
 
+test_expect_success 'advertisement is limited to full-refname patterns' '
+	GIT_TRACE_PACKET="$(pwd)/trace" git ls-remote . refs/heads/master >actual &&
+	git ls-remote . |
+	sed -ne "/	refs\/heads\/master/p" >expect &&
+	test_cmp expect actual &&
+	! grep "refs/tags" trace
+'
+
+test_expect_success 'full advertisement for patterns that are not prefixes' '
+	GIT_TRACE_PACKET="$(pwd)/trace" git ls-remote . master >actual &&
+	git ls-remote . refs/heads/master >expect &&
+	test_cmp expect actual &&
+	grep "refs/tags/mark" trace
+'
+
 test_done
@@ -181,4 +181,23 @@ test_expect_success 'git fetch --all --tags' '
 	test_cmp expect test8/output
 '
 
+test_expect_success 'git fetch --multiple --jobs=4 (works the same as serial)' '
+	(git clone one test9 &&
+	 cd test9 &&
+	 git remote add one ../one &&
+	 git remote add two ../two &&
+	 git remote add three ../three &&
+	 git fetch --multiple --jobs=4 one two three &&
+	 git branch -r > output &&
+	 test_cmp ../test/expect output)
+'
+
+test_expect_success 'fetch.parallel drives --all fetches' '
+	(
+		cd test9 &&
+		GIT_TRACE=$(pwd)/trace.out git -c fetch.parallel=5 fetch --all &&
+		grep "5 tasks" trace.out
+	)
+'
+
 test_done
@@ -0,0 +1,59 @@
+#!/bin/sh
+
+test_description='push negotiation (push.negotiate)'
+. ./test-lib.sh
+
+objects_in_newest_pack () {
+	pack=$(ls -t "$1"/objects/pack/*.pack | head -n 1) &&
+	git verify-pack -v "$pack" | grep -c "^$_x40"
+}
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	test_commit three &&
+	for dir in server.git server2.git server3.git
+	do
+		git clone --bare . $dir &&
+		git -C $dir branch -m master hidden &&
+		git -C $dir config transfer.hideRefs refs/heads/hidden &&
+		git -C $dir config --add transfer.hideRefs refs/tags &&
+		git -C $dir config receive.unpackLimit 1 || return 1
+	done &&
+	test_commit four
+'
+
+test_expect_success 'push without negotiation resends shared history' '
+	git push server.git master:topic1 &&
+	objects_in_newest_pack server.git >count &&
+	test 4 -lt $(cat count)
+'
+
+test_expect_success 'push with negotiation probes the server' '
+	GIT_TRACE_PACKET="$(pwd)/trace" \
+		git -c push.negotiate=true push server2.git master:topic2 &&
+	grep "push> probe" trace &&
+	grep "push< ack" trace
+'
+
+test_expect_success 'negotiated push sends only the new objects' '
+	objects_in_newest_pack server2.git >count &&
+	test 4 -ge $(cat count) &&
+	git -C server2.git rev-parse refs/heads/topic2 &&
+	git -C server2.git fsck
+'
+
+test_expect_success 'negotiation is a no-op against an empty server' '
+	git init --bare empty.git &&
+	git -c push.negotiate=true push empty.git master &&
+	git -C empty.git rev-parse refs/heads/master &&
+	git -C empty.git fsck
+'
+
+test_expect_success 'negotiation is skipped when the config is unset' '
+	GIT_TRACE_PACKET="$(pwd)/trace2" \
+		git push server3.git master:topic3 &&
+	! grep "push> probe" trace2
+'
+
+test_done
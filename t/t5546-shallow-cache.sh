@@ -0,0 +1,68 @@
+#!/bin/sh
+
+test_description='upload-pack caches shallow boundaries
+
+Repeated depth-limited clones of the same tips reuse a boundary
+cached under objects/info/shallow-cache/ instead of redoing the
+depth-bounded walk.'
+. ./test-lib.sh
+
+test_expect_success 'setup deep history' '
+	for i in 1 2 3 4 5 6 7 8
+	do
+		echo $i >file &&
+		git add file &&
+		git commit -m commit$i || return 1
+	done
+'
+
+test_expect_success 'first shallow clone populates the cache' '
+	git clone --depth 2 "file://$(pwd)/." first &&
+	git -C first log --format=%s >actual &&
+	test_write_lines commit8 commit7 >expect &&
+	test_cmp expect actual &&
+	cache=$(ls .git/objects/info/shallow-cache) &&
+	test -n "$cache"
+'
+
+test_expect_success 'cached boundary matches the walked one' '
+	git -C first log --format=%H -1 HEAD~1 >expect &&
+	cat .git/objects/info/shallow-cache/* >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'second clone of the same depth reuses the cache' '
+	git clone --depth 2 "file://$(pwd)/." second &&
+	git -C second fsck &&
+	git -C first log --format=%H >expect &&
+	git -C second log --format=%H >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'different depth gets its own cache entry' '
+	git clone --depth 3 "file://$(pwd)/." third &&
+	git -C third log --format=%s >actual &&
+	test_write_lines commit8 commit7 commit6 >expect &&
+	test_cmp expect actual &&
+	test $(ls .git/objects/info/shallow-cache | wc -l) = 2
+'
+
+test_expect_success 'stale cache entry falls back to the real walk' '
+	for f in .git/objects/info/shallow-cache/*
+	do
+		echo 0000000000000000000000000000000000000001 >"$f" || return 1
+	done &&
+	git clone --depth 2 "file://$(pwd)/." fourth &&
+	git -C fourth log --format=%s >actual &&
+	test_write_lines commit8 commit7 >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success 'deepening an existing shallow clone bypasses the cache' '
+	git -C first fetch --depth 4 origin &&
+	git -C first log --format=%s origin/master >actual &&
+	test_write_lines commit8 commit7 commit6 commit5 >expect &&
+	test_cmp expect actual
+'
+
+test_done
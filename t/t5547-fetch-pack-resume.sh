@@ -0,0 +1,92 @@
+#!/bin/sh
+
+test_description='resumable pack transfer with fetch-pack --resume-to'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	test_commit three &&
+	git config uploadpack.allowResume true
+'
+
+test_expect_success 'resumable fetch populates the pack cache' '
+	git init client &&
+	(
+		cd client &&
+		git fetch-pack --all --resume-to=state .. >refs &&
+		grep refs/heads/master refs &&
+		git cat-file -t $(git -C .. rev-parse HEAD)
+	) &&
+	ls .git/objects/pack-cache/*.pack >cached &&
+	test_line_count = 1 cached
+'
+
+test_expect_success 'completed transfer leaves no resume state behind' '
+	test_path_is_missing client/state &&
+	test_path_is_missing client/state.info
+'
+
+test_expect_success 'an interrupted transfer is continued from the offset' '
+	pack=$(ls .git/objects/pack-cache/*.pack) &&
+	id=$(basename $pack .pack) &&
+	size=$(wc -c <$pack) &&
+	git init resumer &&
+	(
+		cd resumer &&
+		head -c $((size / 2)) ../$pack >state &&
+		echo "pack $id" >state.info &&
+		echo "ref $(git -C .. rev-parse HEAD) refs/heads/master" \
+			>>state.info &&
+		git fetch-pack --all --resume-to=state .. >refs &&
+		grep refs/heads/master refs &&
+		git cat-file commit $(git -C .. rev-parse HEAD) &&
+		test_path_is_missing state &&
+		test_path_is_missing state.info
+	)
+'
+
+test_expect_success 'a pruned cached pack falls back to a fresh transfer' '
+	pack=$(ls .git/objects/pack-cache/*.pack) &&
+	git init fallback &&
+	(
+		cd fallback &&
+		head -c 100 ../$pack >state &&
+		echo "pack $_z40" >state.info &&
+		echo "ref $(git -C .. rev-parse HEAD) refs/heads/master" \
+			>>state.info &&
+		git fetch-pack --all --resume-to=state .. >refs 2>err &&
+		test_i18ngrep "no longer has the cached pack" err &&
+		git cat-file -t $(git -C .. rev-parse HEAD) &&
+		test_path_is_missing state &&
+		test_path_is_missing state.info
+	)
+'
+
+test_expect_success 'a fetch with common commits is not served from the cache' '
+	test_commit four &&
+	(
+		cd client &&
+		git update-ref refs/heads/master \
+			$(git -C .. rev-parse three^0) &&
+		git fetch-pack --all --resume-to=state .. >refs &&
+		git cat-file -t $(git -C .. rev-parse HEAD) &&
+		test_path_is_missing state &&
+		test_path_is_missing state.info
+	)
+'
+
+test_expect_success '--resume-to without server support fetches normally' '
+	git config uploadpack.allowResume false &&
+	git init plain &&
+	(
+		cd plain &&
+		git fetch-pack --all --resume-to=state .. >refs &&
+		grep refs/heads/master refs &&
+		test_path_is_missing state &&
+		test_path_is_missing state.info
+	)
+'
+
+test_done
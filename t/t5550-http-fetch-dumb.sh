@@ -135,6 +135,11 @@ test_expect_success 'fetch packed objects' '
 	git clone $HTTPD_URL/dumb/repo_pack.git
 '
 
+test_expect_success 'fetch packed objects with http.maxRanges' '
+	git -c http.maxRanges=4 clone $HTTPD_URL/dumb/repo_pack.git clone-ranged &&
+	git --git-dir=clone-ranged/.git fsck
+'
+
 test_expect_success 'fetch notices corrupt pack' '
 	cp -R "$HTTPD_DOCUMENT_ROOT_PATH"/repo_pack.git "$HTTPD_DOCUMENT_ROOT_PATH"/repo_bad1.git &&
 	(cd "$HTTPD_DOCUMENT_ROOT_PATH"/repo_bad1.git &&
@@ -0,0 +1,60 @@
+#!/bin/sh
+
+test_description='narrow clone'
+
+. ./test-lib.sh
+
+test_expect_success 'setup server repository' '
+	git init server &&
+	(
+		cd server &&
+		mkdir dir-a dir-b &&
+		echo alpha >dir-a/file-a &&
+		echo beta >dir-b/file-b &&
+		echo top >top-file &&
+		git add . &&
+		git commit -m one &&
+		echo alpha2 >>dir-a/file-a &&
+		echo beta2 >>dir-b/file-b &&
+		git add . &&
+		git commit -m two
+	)
+'
+
+test_expect_success 'narrow clone gets only requested paths' '
+	git clone --narrow=dir-a "file://$PWD/server" narrow &&
+	test_path_is_file narrow/dir-a/file-a &&
+	test_path_is_missing narrow/dir-b &&
+	test_path_is_missing narrow/top-file &&
+	echo dir-a >expect &&
+	test_cmp expect narrow/.git/narrow &&
+	(
+		cd narrow &&
+		git cat-file -e $(git rev-parse HEAD:dir-a/file-a) &&
+		test_must_fail git cat-file -e $(git rev-parse HEAD:dir-b/file-b)
+	)
+'
+
+test_expect_success 'fetch into a narrow clone stays narrow' '
+	(
+		cd server &&
+		echo alpha3 >>dir-a/file-a &&
+		echo beta3 >>dir-b/file-b &&
+		git add . &&
+		git commit -m three
+	) &&
+	(
+		cd narrow &&
+		git fetch origin &&
+		# --quiet: the diffstat would need blobs outside dir-a
+		git merge --quiet origin/master &&
+		git cat-file -e $(git rev-parse HEAD:dir-a/file-a) &&
+		test_must_fail git cat-file -e $(git rev-parse HEAD:dir-b/file-b)
+	)
+'
+
+test_expect_success 'narrow paths are validated' '
+	test_must_fail git clone --narrow=../escape "file://$PWD/server" bad
+'
+
+test_done
@@ -0,0 +1,72 @@
+#!/bin/sh
+
+test_description='blob-less clone with on-demand blob fetching'
+
+. ./test-lib.sh
+
+test_expect_success 'setup server repository' '
+	git init server &&
+	(
+		cd server &&
+		mkdir dir-a &&
+		echo alpha >dir-a/file-a &&
+		echo top >top-file &&
+		git add . &&
+		git commit -m one &&
+		echo alpha2 >>dir-a/file-a &&
+		git add . &&
+		git commit -m two &&
+		git config uploadpack.allowanysha1inwant true
+	)
+'
+
+test_expect_success 'blob-less clone transfers no blobs' '
+	git clone -n --no-blobs "file://$PWD/server" blobless &&
+	echo "file://$PWD/server" >expect &&
+	test_cmp expect blobless/.git/no-blobs &&
+	(
+		cd blobless &&
+		git log --oneline origin/master >log &&
+		test_line_count = 2 log &&
+		test_must_fail git cat-file -e \
+			$(git rev-parse origin/master:top-file)
+	)
+'
+
+test_expect_success 'checkout fetches missing blobs on demand' '
+	(
+		cd blobless &&
+		git checkout master &&
+		echo top >expect &&
+		test_cmp expect top-file &&
+		git cat-file -e $(git rev-parse HEAD:top-file)
+	)
+'
+
+test_expect_success 'diff fetches the blobs it needs' '
+	(
+		cd blobless &&
+		git log -1 --stat >stat &&
+		grep "1 insertion" stat
+	)
+'
+
+test_expect_success 'fetch into a blob-less clone stays blob-less' '
+	(
+		cd server &&
+		echo gamma >dir-a/new-file &&
+		git add . &&
+		git commit -m three
+	) &&
+	(
+		cd blobless &&
+		git fetch origin &&
+		test_must_fail git cat-file -e \
+			$(git rev-parse origin/master:dir-a/new-file) &&
+		git merge --quiet origin/master &&
+		echo gamma >expect &&
+		test_cmp expect dir-a/new-file
+	)
+'
+
+test_done
@@ -0,0 +1,58 @@
+#!/bin/sh
+
+test_description='upload-notify ref change notification'
+
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	git clone --bare . server.git &&
+	packetize() {
+		printf "%04x%s\n" $((5 + $(printf "%s" "$1" | wc -c))) "$1"
+	} &&
+	{
+		packetize "watch refs/heads/*" &&
+		printf 0000
+	} >watch-input
+'
+
+test_expect_success 'a push bumps the notify stamp' '
+	git clone --bare . push.git &&
+	test_path_is_missing push.git/notify-stamp &&
+	git push push.git master:pushed &&
+	test_path_is_file push.git/notify-stamp
+'
+
+test_expect_success 'upload-notify reports a ref update' '
+	{
+		git upload-notify --once --interval=1 server.git \
+			<watch-input >notify-output
+		echo $? >notify-status
+	} &
+	sleep 2 &&
+	oldsha1=$(git -C server.git rev-parse refs/heads/master) &&
+	git -C server.git update-ref refs/heads/master $(git rev-parse one) &&
+	wait &&
+	echo 0 >expect &&
+	test_cmp expect notify-status &&
+	tr "[\000-\037]" "\n" <notify-output >notify-lines &&
+	grep "change $oldsha1 $(git rev-parse one) refs/heads/master" \
+		notify-lines
+'
+
+test_expect_success 'unwatched refs are not reported' '
+	{
+		git upload-notify --once --interval=1 server.git \
+			<watch-input >notify-output
+	} &
+	sleep 2 &&
+	git -C server.git update-ref refs/tags/ignored $(git rev-parse one) &&
+	git -C server.git update-ref refs/heads/seen $(git rev-parse one) &&
+	wait &&
+	tr "[\000-\037]" "\n" <notify-output >notify-lines &&
+	grep "refs/heads/seen" notify-lines &&
+	! grep "refs/tags/ignored" notify-lines
+'
+
+test_done
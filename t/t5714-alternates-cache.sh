@@ -0,0 +1,52 @@
+#!/bin/sh
+
+test_description='caching of resolved alternates (core.alternatesCache)'
+. ./test-lib.sh
+
+test_expect_success 'set up a chain of alternates' '
+	test_commit one &&
+	git repack -ad &&
+	git clone -s . mid &&
+	(
+		cd mid &&
+		test_commit two &&
+		git repack -ad
+	) &&
+	git clone -s mid leaf &&
+	git -C leaf config core.alternatesCache true
+'
+
+test_expect_success 'first access writes the cache' '
+	git -C leaf log --oneline >/dev/null &&
+	test_path_is_file leaf/.git/objects/info/alternates.cache
+'
+
+test_expect_success 'cached startup still sees borrowed objects' '
+	git -C leaf cat-file -e $(git rev-parse one) &&
+	git -C leaf cat-file -e $(git -C mid rev-parse two) &&
+	git -C leaf fsck
+'
+
+test_expect_success 'touching an info/alternates file invalidates the cache' '
+	cp leaf/.git/objects/info/alternates.cache before &&
+	test-chmtime +10 mid/.git/objects/info/alternates &&
+	git -C leaf log --oneline >/dev/null &&
+	! test_cmp before leaf/.git/objects/info/alternates.cache
+'
+
+test_expect_success 'a new pack in an alternate invalidates the cache' '
+	cp leaf/.git/objects/info/alternates.cache before &&
+	test_commit three &&
+	git repack -ad &&
+	test-chmtime +10 .git/objects/pack &&
+	git -C leaf cat-file -e $(git rev-parse three) &&
+	! test_cmp before leaf/.git/objects/info/alternates.cache
+'
+
+test_expect_success 'count-objects ignores the cache and still sees garbage' '
+	: >mid/.git/objects/pack/garbage &&
+	git -C leaf count-objects -v 2>warnings &&
+	grep garbage warnings
+'
+
+test_done
@@ -100,4 +100,43 @@ test_expect_success '--bisect and --first-parent can not be combined' '
 	test_must_fail git rev-list --bisect --first-parent HEAD
 '
 
+test_expect_success '--threads lists the same objects' '
+	git rev-list --objects --all >out &&
+	cut -d" " -f1 <out | sort >expect &&
+	git rev-list --objects --all --threads=4 >out &&
+	cut -d" " -f1 <out | sort >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success '--object-type limits the output to one type' '
+	git rev-list --objects --object-type=blob HEAD >out &&
+	sort out >actual &&
+	git rev-list --objects HEAD >all &&
+	while read sha1 path
+	do
+		test "$(git cat-file -t $sha1)" != blob || echo "$sha1 $path"
+	done <all | sort >expect &&
+	test_cmp expect actual
+'
+
+test_expect_success '--min-object-size and --max-object-size limit blobs' '
+	test-genrandom big 65536 >big_file &&
+	git add big_file &&
+	git commit -m big &&
+	big=$(git rev-parse HEAD:big_file) &&
+	git rev-list --objects --object-type=blob --min-object-size=64k HEAD >actual &&
+	echo "$big big_file" >expect &&
+	test_cmp expect actual &&
+	git rev-list --objects --object-type=blob --max-object-size=32k HEAD >actual &&
+	! grep "^$big" actual &&
+	grep "^$(git rev-parse HEAD:only-in-index)" actual
+'
+
+test_expect_success 'size filters see through packed objects' '
+	git repack -ad &&
+	git rev-list --objects --object-type=blob --min-object-size=64k HEAD >actual &&
+	echo "$big big_file" >expect &&
+	test_cmp expect actual
+'
+
 test_done
@@ -297,4 +297,31 @@ test_expect_success 'merge-base --octopus --all for complex tree' '
 	test_cmp expected actual
 '
 
+test_expect_success 'merge-base --batch answers one query per input line' '
+	git merge-base JB JC >expected &&
+	git merge-base JAA JDD >>expected &&
+	{
+		echo JB JC &&
+		echo JAA JDD
+	} | git merge-base --batch >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'merge-base --batch --all lists all bases on one line' '
+	echo $(git merge-base --all JAA JDD) >expected &&
+	echo JAA JDD | git merge-base --all --batch >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success 'merge-base --batch notes pairs without common ancestor' '
+	disjoint=$(echo disjoint | git commit-tree $(git mktree </dev/null)) &&
+	git merge-base JB JC >expected &&
+	echo >>expected &&
+	{
+		echo JB JC &&
+		echo $disjoint JC
+	} | test_expect_code 1 git merge-base --batch >actual &&
+	test_cmp expected actual
+'
+
 test_done
@@ -62,13 +62,14 @@ test_expect_success 'set diff.renamelimit to 4' '
 	git config diff.renamelimit 4
 '
 test_rename 4 ok
-test_rename 5 fail
+# over the limit, the pruned candidate pass still finds these
+test_rename 5 ok
 
 test_expect_success 'set merge.renamelimit to 5' '
 	git config merge.renamelimit 5
 '
 test_rename 5 ok
-test_rename 6 fail
+test_rename 6 ok
 
 test_expect_success 'setup large simple rename' '
 	git config --unset merge.renamelimit &&
@@ -0,0 +1,93 @@
+#!/bin/sh
+
+test_description='merge with directory rename detection
+
+When one side of a merge renames a directory and the other side adds
+new files inside the old directory, the new files should follow the
+rename instead of being left behind as stray paths.'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	mkdir dir &&
+	test_write_lines 1 2 3 4 5 6 7 8 9 10 >dir/a &&
+	test_write_lines a b c d e f g h i j >dir/b &&
+	git add dir &&
+	git commit -m base &&
+	git branch side
+'
+
+test_expect_success 'add on one side follows rename on the other' '
+	git checkout -b rename-side master &&
+	git mv dir newdir &&
+	git commit -m "rename dir to newdir" &&
+
+	git checkout -b add-side side &&
+	echo 11 >>dir/a &&
+	echo new >dir/c &&
+	git add dir &&
+	git commit -m "modify dir/a, add dir/c" &&
+
+	git checkout rename-side &&
+	git merge add-side &&
+	test_path_is_file newdir/c &&
+	test_path_is_missing dir &&
+	grep 11 newdir/a
+'
+
+test_expect_success 'rename on the merged branch moves additions in HEAD' '
+	git checkout -b add-side-2 master &&
+	echo 11 >>dir/a &&
+	echo new >dir/c &&
+	git add dir &&
+	git commit -m "modify dir/a, add dir/c" &&
+
+	git checkout -b rename-side-2 master &&
+	git mv dir newdir &&
+	git commit -m "rename dir to newdir" &&
+
+	git checkout add-side-2 &&
+	git merge rename-side-2 &&
+	test_path_is_file newdir/c &&
+	test_path_is_missing dir &&
+	grep 11 newdir/a
+'
+
+test_expect_success 'occupied destination leaves the addition in place' '
+	git checkout -b rename-side-3 master &&
+	git mv dir newdir &&
+	echo other >newdir/c &&
+	git add newdir/c &&
+	git commit -m "rename dir to newdir, add newdir/c" &&
+
+	git checkout -b add-side-3 master &&
+	echo 11 >>dir/a &&
+	echo new >dir/c &&
+	git add dir &&
+	git commit -m "modify dir/a, add dir/c" &&
+
+	git checkout rename-side-3 &&
+	git merge add-side-3 &&
+	echo other >expect &&
+	test_cmp expect newdir/c &&
+	echo new >expect &&
+	test_cmp expect dir/c
+'
+
+test_expect_success 'merge.directoryRenames=false disables the detection' '
+	git checkout -b rename-side-4 master &&
+	git mv dir newdir &&
+	git commit -m "rename dir to newdir" &&
+
+	git checkout -b add-side-4 master &&
+	echo 11 >>dir/a &&
+	echo new >dir/c &&
+	git add dir &&
+	git commit -m "modify dir/a, add dir/c" &&
+
+	git checkout rename-side-4 &&
+	git -c merge.directoryRenames=false merge add-side-4 &&
+	test_path_is_file dir/c &&
+	test_path_is_missing newdir/c
+'
+
+test_done
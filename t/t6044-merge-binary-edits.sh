@@ -0,0 +1,85 @@
+#!/bin/sh
+
+test_description='chunk-based merging of non-overlapping binary edits
+
+Binary files whose two sides changed disjoint byte ranges of the
+common ancestor merge cleanly; overlapping edits still conflict.'
+
+. ./test-lib.sh
+
+# Build a file binary enough to defeat the text merge: a NUL followed
+# by numbered lines so that edits at both ends are far apart.
+test_expect_success 'setup' '
+	printf "\000" >art.bin &&
+	test_seq 1 200 | sed "s/^/payload line /" >>art.bin &&
+	git add art.bin &&
+	git commit -m base &&
+
+	git checkout -b ours &&
+	printf "\000" >art.bin &&
+	test_seq 1 200 | sed -e "s/^/payload line /" \
+		-e "s/^payload line 3\$/OURS/" >>art.bin &&
+	git commit -am ours &&
+
+	git checkout -b theirs master &&
+	printf "\000" >art.bin &&
+	test_seq 1 200 | sed -e "s/^/payload line /" \
+		-e "s/^payload line 197\$/THEIRS/" >>art.bin &&
+	git commit -am theirs
+'
+
+test_expect_success 'disjoint binary edits merge cleanly' '
+	git checkout -B test ours &&
+	git merge theirs &&
+	grep -a OURS art.bin &&
+	grep -a THEIRS art.bin
+'
+
+test_expect_success 'merged file contains both edits and nothing else' '
+	printf "\000" >expect &&
+	test_seq 1 200 | sed -e "s/^/payload line /" \
+		-e "s/^payload line 3\$/OURS/" \
+		-e "s/^payload line 197\$/THEIRS/" >>expect &&
+	test_cmp expect art.bin
+'
+
+test_expect_success 'overlapping binary edits still conflict' '
+	git checkout -b ours2 master &&
+	printf "\000" >art.bin &&
+	test_seq 1 200 | sed -e "s/^/payload line /" \
+		-e "s/^payload line 100\$/AAAA/" >>art.bin &&
+	git commit -am ours2 &&
+
+	git checkout -b theirs2 master &&
+	printf "\000" >art.bin &&
+	test_seq 1 200 | sed -e "s/^/payload line /" \
+		-e "s/^payload line 100\$/BBBB/" >>art.bin &&
+	git commit -am theirs2 &&
+
+	git checkout ours2 &&
+	test_must_fail git merge theirs2 &&
+	grep -a AAAA art.bin &&
+	! grep -a BBBB art.bin &&
+	git merge --abort
+'
+
+test_expect_success 'both sides appending still conflicts' '
+	git checkout -b append1 master &&
+	printf "tail one" >>art.bin &&
+	git commit -am append1 &&
+	git checkout -b append2 master &&
+	printf "tail two" >>art.bin &&
+	git commit -am append2 &&
+	test_must_fail git merge append1 &&
+	git merge --abort
+'
+
+test_expect_success 'diff --stat reports delta-derived changed bytes' '
+	git checkout master &&
+	git -c diff.statBinaryBytes=true diff --stat master ours >stat &&
+	test_i18ngrep "Bin .* bytes (.* changed)" stat &&
+	git diff --stat master ours >stat &&
+	! grep "changed)" stat
+'
+
+test_done
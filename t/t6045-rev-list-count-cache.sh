@@ -0,0 +1,64 @@
+#!/bin/sh
+
+test_description='rev-list count cache (revlist.countCache)'
+. ./test-lib.sh
+
+test_expect_success 'setup' '
+	test_commit one &&
+	test_commit two &&
+	test_commit three &&
+	git branch base HEAD~2 &&
+	git config revlist.countCache true
+'
+
+test_expect_success 'a counting query populates the cache' '
+	git rev-list --count HEAD ^base >expect &&
+	echo 2 >count &&
+	test_cmp count expect &&
+	test_path_is_file .git/info/rev-cache
+'
+
+test_expect_success 'a repeated query is answered from the cache' '
+	git rev-list --count-cache=show >before &&
+	git rev-list --count HEAD ^base >actual &&
+	test_cmp expect actual &&
+	git rev-list --count-cache=show >after &&
+	test_cmp before after
+'
+
+test_expect_success 'cached and uncached answers agree after a ref moves' '
+	test_commit four &&
+	git rev-list --count HEAD ^base >expect &&
+	git rev-list --count HEAD ^base >actual &&
+	test_cmp expect actual &&
+	echo 3 >count &&
+	test_cmp count actual
+'
+
+test_expect_success '--left-right and --cherry-mark counts are cached correctly' '
+	git rev-list --count --left-right base...HEAD >expect &&
+	git rev-list --count --left-right base...HEAD >actual &&
+	test_cmp expect actual &&
+	git rev-list --count --cherry-mark base...HEAD >expect &&
+	git rev-list --count --cherry-mark base...HEAD >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'the plain listing is not cached' '
+	git rev-list HEAD ^base >expect &&
+	git rev-list HEAD ^base >actual &&
+	test_cmp expect actual &&
+	test_line_count = 3 actual
+'
+
+test_expect_success '--count-cache=flush discards the cache' '
+	git rev-list --count-cache=flush &&
+	test_path_is_missing .git/info/rev-cache
+'
+
+test_expect_success 'the cache is not written when disabled' '
+	git -c revlist.countCache=false rev-list --count HEAD ^base &&
+	test_path_is_missing .git/info/rev-cache
+'
+
+test_done
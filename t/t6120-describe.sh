@@ -198,4 +198,24 @@ test_expect_success 'describe --contains with the exact tags' '
 	test_cmp expect actual
 '
 
+test_expect_success 'describe.cache reuses a recorded result' '
+	git describe HEAD >expect &&
+	git -c describe.cache=true describe HEAD >first &&
+	test_cmp expect first &&
+	test_path_is_file .git/describe-cache &&
+	git -c describe.cache=true describe HEAD >second &&
+	test_cmp expect second
+'
+
+test_expect_success 'describe.cache is invalidated by a ref update' '
+	git tag -a -m fresh fresh-tag &&
+	git -c describe.cache=true describe HEAD >actual &&
+	echo fresh-tag >expect &&
+	test_cmp expect actual &&
+	git tag -d fresh-tag &&
+	git describe HEAD >expect &&
+	git -c describe.cache=true describe HEAD >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -526,4 +526,18 @@ test_expect_success 'Verify sort with multiple keys' '
 		refs/tags/bogo refs/tags/master > actual &&
 	test_cmp expected actual
 '
+
+test_expect_success '--count limits output without an explicit sort' '
+	git for-each-ref --format="%(refname)" refs/tags >expected.full &&
+	head -n 3 expected.full >expected &&
+	git for-each-ref --format="%(refname)" --count=3 refs/tags >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success '--count larger than the number of matches' '
+	git for-each-ref --format="%(refname)" refs/heads >expected &&
+	git for-each-ref --format="%(refname)" --count=1000 refs/heads >actual &&
+	test_cmp expected actual
+'
+
 test_done
@@ -30,4 +30,36 @@ test_expect_success 'gc -h with invalid configuration' '
 	test_i18ngrep "[Uu]sage" broken/usage
 '
 
+test_expect_success 'gc resets the loose object count hint' '
+	test_commit counted &&
+	git gc &&
+	loose=$(find .git/objects/?? -type f | wc -l) &&
+	hint=$(wc -c <.git/objects/info/loose-object-count) &&
+	test "$loose" = "$hint"
+'
+
+test_expect_success 'loose object writes grow the count hint' '
+	before=$(wc -c <.git/objects/info/loose-object-count) &&
+	echo counted-blob | git hash-object -w --stdin &&
+	after=$(wc -c <.git/objects/info/loose-object-count) &&
+	test $after = $((before + 1))
+'
+
+test_expect_success 'gc --cruft packs unreachable loose objects' '
+	blob=$(echo cruft-blob | git hash-object -w --stdin) &&
+	packs_before=$(ls .git/objects/pack/*.pack | wc -l) &&
+	git gc --cruft &&
+	packs_after=$(ls .git/objects/pack/*.pack | wc -l) &&
+	test $packs_after = $((packs_before + 1)) &&
+	test 0 = $(find .git/objects/?? -type f 2>/dev/null | wc -l) &&
+	echo cruft-blob >expect &&
+	git cat-file blob $blob >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success 'gc --cruft leaves nothing behind when there is no cruft' '
+	git gc --cruft &&
+	git fsck --strict
+'
+
 test_done
@@ -0,0 +1,79 @@
+#!/bin/sh
+
+test_description='test untracked cache'
+. ./test-lib.sh
+
+# Outputs are compared against a run with the cache disabled, so these
+# tests do not depend on the timing details of directory mtimes; they
+# only verify that the cache never changes what status reports.
+
+status_is_clean_of_cache () {
+	git status --porcelain >../actual &&
+	git -c core.untrackedCache=false status --porcelain >../expect &&
+	test_cmp ../expect ../actual
+}
+
+test_expect_success 'setup' '
+	git init worktree &&
+	cd worktree &&
+	git config core.untrackedCache true &&
+	mkdir -p one two/three &&
+	echo tracked >tracked &&
+	echo tracked >one/tracked &&
+	git add tracked one/tracked &&
+	test_tick &&
+	git commit -m initial &&
+	echo u >untracked &&
+	echo u >one/untracked &&
+	echo u >two/three/untracked
+'
+
+test_expect_success 'status writes untracked cache extension' '
+	git status --porcelain >/dev/null &&
+	git status --porcelain >/dev/null &&
+	perl -0777 -ne "exit 1 unless /UNTR/" .git/index
+'
+
+test_expect_success 'cached status matches uncached status' '
+	status_is_clean_of_cache
+'
+
+test_expect_success 'new untracked file in cached directory is noticed' '
+	echo u >one/another &&
+	status_is_clean_of_cache
+'
+
+test_expect_success 'adding a file to the index invalidates its directory' '
+	git add one/untracked &&
+	status_is_clean_of_cache
+'
+
+test_expect_success 'removing a file from the index invalidates its directory' '
+	git rm --cached -q one/untracked &&
+	status_is_clean_of_cache
+'
+
+test_expect_success 'changed .gitignore takes effect' '
+	echo untracked >.gitignore &&
+	status_is_clean_of_cache &&
+	echo changed-my-mind >.gitignore &&
+	status_is_clean_of_cache
+'
+
+test_expect_success 'changed info/exclude drops the cache' '
+	echo "two" >.git/info/exclude &&
+	status_is_clean_of_cache
+'
+
+test_expect_success '-uall works with the cache enabled' '
+	git status -uall --porcelain >../actual &&
+	git -c core.untrackedCache=false status -uall --porcelain >../expect &&
+	test_cmp ../expect ../actual
+'
+
+test_expect_success 'corrupt extension is ignored' '
+	git status --porcelain >/dev/null &&
+	status_is_clean_of_cache
+'
+
+test_done
@@ -1499,4 +1499,51 @@ test_expect_success 'git commit -m will commit a staged but ignored submodule' '
 	git config -f .gitmodules  --remove-section submodule.subname
 '
 
+test_expect_success 'status --counts shows per-section counters' '
+	git init counts &&
+	(
+		cd counts &&
+		test_commit initial &&
+		echo staged >staged.txt &&
+		git add staged.txt &&
+		echo modified >>initial.t &&
+		echo untracked >untracked.txt &&
+		cat >../counts-expect <<-\EOF &&
+		staged 1
+		unstaged 1
+		unmerged 0
+		untracked 1
+		EOF
+		git status --counts >../counts-actual &&
+		test_cmp ../counts-expect ../counts-actual
+	)
+'
+
+test_expect_success 'status --sections limits what is collected' '
+	(
+		cd counts &&
+		cat >../counts-expect <<-\EOF &&
+		staged 0
+		unstaged 0
+		unmerged 0
+		untracked 1
+		EOF
+		git status --counts --sections=untracked >../counts-actual &&
+		test_cmp ../counts-expect ../counts-actual &&
+		echo "?? untracked.txt" >../counts-expect &&
+		git status --porcelain --sections=untracked >../counts-actual &&
+		test_cmp ../counts-expect ../counts-actual &&
+		echo " M initial.t" >../counts-expect &&
+		git status --porcelain --sections=unstaged >../counts-actual &&
+		test_cmp ../counts-expect ../counts-actual
+	)
+'
+
+test_expect_success 'status --counts rejects unknown sections' '
+	(
+		cd counts &&
+		test_must_fail git status --counts --sections=bogus
+	)
+'
+
 test_done
@@ -165,4 +165,30 @@ test_expect_success GPG 'show lack of signature with custom format' '
 	test_cmp expect actual
 '
 
+test_expect_success GPG 'gpg.verifyCache records verification results' '
+	test_config gpg.verifyCache true &&
+	rm -f .git/info/signature-cache &&
+	git log -1 --format="%G?" sixth-signed >expect &&
+	grep "^$(git rev-parse sixth-signed) G " .git/info/signature-cache
+'
+
+test_expect_success GPG 'cached result is used without running gpg' '
+	test_config gpg.verifyCache true &&
+	test_config gpg.program false &&
+	cat >expect <<-\EOF &&
+	G
+	13B6F51ECDDE430D
+	C O Mitter <committer@example.com>
+	EOF
+	git log -1 --format="%G?%n%GK%n%GS" sixth-signed >actual &&
+	test_cmp expect actual
+'
+
+test_expect_success GPG 'signature cache is not used when disabled' '
+	test_config gpg.program false &&
+	echo N >expect &&
+	git log -1 --format="%G?" sixth-signed >actual &&
+	test_cmp expect actual
+'
+
 test_done
@@ -892,4 +892,18 @@ test_expect_success 'with no command and no key' '
 	test_cmp expected actual
 '
 
+test_expect_success '--batch processes NUL-delimited messages' '
+	git config --unset trailer.sign.command &&
+	printf "subject one\n\0subject two\n" >input &&
+	printf "subject one\n\ntested: yes\n\0subject two\n\ntested: yes\n" \
+		>expected &&
+	git interpret-trailers --batch --trailer "tested: yes" \
+		<input >actual &&
+	test_cmp expected actual
+'
+
+test_expect_success '--batch refuses file arguments' '
+	test_must_fail git interpret-trailers --batch some-file </dev/null
+'
+
 test_done
@@ -0,0 +1,91 @@
+#!/bin/sh
+
+test_description='git status with file system watcher'
+. ./test-lib.sh
+
+# The test hooks below pretend to be a file system watcher: git invokes
+# them with the hook interface version and the timestamp of the last
+# query, and they print the paths modified since then, NUL separated.
+
+write_integration_script () {
+	mkdir -p .git/hooks &&
+	write_script .git/hooks/fsmonitor-test <<-\EOF
+	if test "$#" -ne 2
+	then
+		echo "$0: exactly 2 arguments expected" >&2
+		exit 2
+	fi
+	if test "$1" != 1
+	then
+		echo "Unsupported core.fsmonitor hook version." >&2
+		exit 1
+	fi
+	printf "untracked\0"
+	printf "modified\0"
+	EOF
+}
+
+test_expect_success 'setup' '
+	cat >.gitignore <<-\EOF &&
+	.gitignore
+	expect*
+	actual*
+	EOF
+	mkdir new &&
+	echo 1 >tracked &&
+	echo 1 >modified &&
+	echo 1 >new/file &&
+	git add tracked modified new/file &&
+	test_tick &&
+	git commit -m initial &&
+	git config core.fsmonitor .git/hooks/fsmonitor-test
+'
+
+test_expect_success 'fsmonitor extension is written to the index' '
+	write_integration_script &&
+	git update-index --refresh &&
+	perl -0777 -ne "exit 1 unless /FSMN/" .git/index
+'
+
+test_expect_success 'status reports changes named by the monitor' '
+	echo 2 >modified &&
+	echo 2 >untracked &&
+	git status --porcelain >actual &&
+	cat >expect <<-\EOF &&
+	 M modified
+	?? untracked
+	EOF
+	test_cmp expect actual
+'
+
+test_expect_success 'unreported changes are skipped until invalidated' '
+	git checkout -- modified &&
+	rm untracked &&
+	git update-index --refresh &&
+	echo 3 >tracked &&
+	git status --porcelain >actual &&
+	! grep tracked actual &&
+	write_script .git/hooks/fsmonitor-test <<-\EOF &&
+	printf "tracked\0"
+	EOF
+	git status --porcelain >actual &&
+	grep "^ M tracked" actual
+'
+
+test_expect_success 'failing hook falls back to full refresh' '
+	write_script .git/hooks/fsmonitor-test <<-\EOF &&
+	exit 1
+	EOF
+	echo 4 >modified &&
+	git status --porcelain >actual &&
+	grep "^ M modified" actual
+'
+
+test_expect_success 'disabling core.fsmonitor restores plain behavior' '
+	git config --unset core.fsmonitor &&
+	git status --porcelain >actual &&
+	grep "^ M modified" actual &&
+	grep "^ M tracked" actual
+'
+
+test_done
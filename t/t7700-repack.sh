@@ -196,5 +196,105 @@ test_expect_success 'objects made unreachable by grafts only are kept' '
 	git cat-file -t $H1
 	'
 
+test_expect_success 'geometric repack rolls up small packs' '
+	git init geometric &&
+	(
+		cd geometric &&
+		for i in 1 2 3 4 5
+		do
+			echo $i >file$i &&
+			git add file$i &&
+			git commit -m $i &&
+			git repack -q || exit 1
+		done &&
+		git repack -d --geometric=2 &&
+		test 1 = $(ls .git/objects/pack/*.pack | wc -l) &&
+		git fsck
+	)
+'
+
+test_expect_success 'geometric repack leaves the big base pack alone' '
+	(
+		cd geometric &&
+		for i in 1 2 3 4 5 6 7 8 9 10
+		do
+			test-genrandom base$i 8192 >big$i &&
+			git add big$i || exit 1
+		done &&
+		git commit -m base &&
+		git repack -adq &&
+		base=$(ls .git/objects/pack/*.pack) &&
+		for i in 6 7
+		do
+			echo $i >file$i &&
+			git add file$i &&
+			git commit -m $i &&
+			git repack -q || exit 1
+		done &&
+		git repack -d --geometric=2 &&
+		test -f "$base" &&
+		test 2 = $(ls .git/objects/pack/*.pack | wc -l) &&
+		git fsck
+	)
+'
+
+test_expect_success 'geometric repack with nothing to do' '
+	(
+		cd geometric &&
+		git repack -d --geometric=2 >output &&
+		grep "Nothing to roll up" output
+	)
+'
+
+test_expect_success 'geometric repack is incompatible with -a' '
+	(
+		cd geometric &&
+		test_must_fail git repack -a --geometric=2
+	)
+'
+
+test_expect_success 'repack.packExpire retains redundant packs' '
+	git init expire &&
+	(
+		cd expire &&
+		echo one >file &&
+		git add file &&
+		git commit -m one &&
+		git repack -adq &&
+		old=$(ls .git/objects/pack/*.pack) &&
+		echo two >file &&
+		git commit -am two &&
+		git -c repack.packExpire=1.hour.ago repack -adq &&
+		test -f "$old" &&
+		test -f "${old%.pack}.redundant" &&
+		git cat-file commit HEAD^ >/dev/null &&
+		git fsck
+	)
+'
+
+test_expect_success 'expired redundant packs are removed' '
+	(
+		cd expire &&
+		old=$(ls .git/objects/pack/*.redundant) &&
+		test-chmtime =-7200 "$old" &&
+		git -c repack.packExpire=1.hour.ago repack -adq &&
+		test ! -f "$old" &&
+		test ! -f "${old%.redundant}.pack" &&
+		git fsck
+	)
+'
+
+test_expect_success 'repack.packExpire=now deletes immediately' '
+	(
+		cd expire &&
+		echo three >file &&
+		git commit -am three &&
+		git repack -adq &&
+		test 1 = $(ls .git/objects/pack/*.pack | wc -l) &&
+		ls .git/objects/pack/*.redundant >remaining 2>/dev/null;
+		test ! -s remaining
+	)
+'
+
 test_done
 
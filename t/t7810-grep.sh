@@ -364,6 +364,14 @@ test_expect_success 'grep -L -C' '
 	test_cmp expected actual
 '
 
+test_expect_success 'grep --unordered finds the same matches' '
+	git grep mmap >expected.raw &&
+	sort expected.raw >expected &&
+	git grep --unordered mmap >actual.raw &&
+	sort actual.raw >actual &&
+	test_cmp expected actual
+'
+
 cat >expected <<EOF
 file:foo mmap bar_mmap
 EOF
@@ -522,4 +522,20 @@ test_expect_success 'delete refspec' '
 	test_cmp expected actual
 '
 
+test_expect_success 'streamed large blobs survive an export/import roundtrip' '
+	test_create_repo streamed &&
+	(
+		cd streamed &&
+		test-genrandom giant 262144 >giant &&
+		echo tiny >tiny &&
+		git add giant tiny &&
+		git commit -m giant &&
+		git -c core.bigfilethreshold=4k fast-export master >stream &&
+		git init --quiet copy &&
+		git -C copy fast-import <stream &&
+		git -C copy cat-file blob master:giant >giant.roundtrip &&
+		test_cmp giant giant.roundtrip
+	)
+'
+
 test_done
@@ -3,11 +3,67 @@
 #include "commit.h"
 #include "tree.h"
 #include "blob.h"
+#include "hashmap.h"
 
 const char *tag_type = "tag";
 
+/*
+ * Memo of fully-dereferenced tag targets, so that each tag (and any
+ * chain of nested tags behind it) is inflated at most once per
+ * process no matter how many refs point at it or how often it is
+ * peeled.
+ */
+struct tag_target {
+	struct hashmap_entry ent;
+	unsigned char sha1[20];
+	unsigned char target[20];
+};
+
+static struct hashmap tag_target_map;
+
+static int tag_target_cmp(const void *entry, const void *entry_or_key,
+			  const void *keydata)
+{
+	const struct tag_target *a = entry;
+	const struct tag_target *b = entry_or_key;
+
+	return hashcmp(a->sha1, keydata ? keydata : b->sha1);
+}
+
+int lookup_tag_target(const unsigned char *sha1, unsigned char *target)
+{
+	struct tag_target key, *found;
+
+	if (!tag_target_map.tablesize)
+		return -1;
+	hashmap_entry_init(&key, sha1hash(sha1));
+	found = hashmap_get(&tag_target_map, &key, sha1);
+	if (!found)
+		return -1;
+	hashcpy(target, found->target);
+	return 0;
+}
+
+void record_tag_target(const unsigned char *sha1, const unsigned char *target)
+{
+	struct tag_target *entry;
+	unsigned char dummy[20];
+
+	if (!lookup_tag_target(sha1, dummy))
+		return;
+	if (!tag_target_map.tablesize)
+		hashmap_init(&tag_target_map, tag_target_cmp, 0);
+	entry = xmalloc(sizeof(*entry));
+	hashmap_entry_init(entry, sha1hash(sha1));
+	hashcpy(entry->sha1, sha1);
+	hashcpy(entry->target, target);
+	hashmap_add(&tag_target_map, entry);
+}
+
 struct object *deref_tag(struct object *o, const char *warn, int warnlen)
 {
+	const unsigned char *tag_sha1 = o ? o->sha1 : NULL;
+
 	while (o && o->type == OBJ_TAG)
 		if (((struct tag *)o)->tagged)
 			o = parse_object(((struct tag *)o)->tagged->sha1);
@@ -18,11 +74,15 @@ struct object *deref_tag(struct object *o, const char *warn, int warnlen)
 			warnlen = strlen(warn);
 		error("missing object referenced by '%.*s'", warnlen, warn);
 	}
+	if (o && o->sha1 != tag_sha1)
+		record_tag_target(tag_sha1, o->sha1);
 	return o;
 }
 
 struct object *deref_tag_noverify(struct object *o)
 {
+	const unsigned char *tag_sha1 = o ? o->sha1 : NULL;
+
 	while (o && o->type == OBJ_TAG) {
 		o = parse_object(o->sha1);
 		if (o && o->type == OBJ_TAG && ((struct tag *)o)->tagged)
@@ -30,6 +90,8 @@ struct object *deref_tag_noverify(struct object *o)
 		else
 			o = NULL;
 	}
+	if (o && o->sha1 != tag_sha1)
+		record_tag_target(tag_sha1, o->sha1);
 	return o;
 }
 
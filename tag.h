@@ -18,4 +18,13 @@ extern int parse_tag(struct tag *item);
 extern struct object *deref_tag(struct object *, const char *, int);
 extern struct object *deref_tag_noverify(struct object *);
 
+/*
+ * In-process memo of fully-dereferenced tag targets, filled whenever
+ * a tag is peeled.  lookup_tag_target() copies the memoized target of
+ * the given tag into "target" and returns 0, or returns -1 if the tag
+ * has not been peeled yet.
+ */
+extern int lookup_tag_target(const unsigned char *sha1, unsigned char *target);
+extern void record_tag_target(const unsigned char *sha1, const unsigned char *target);
+
 #endif /* TAG_H */
@@ -142,12 +142,15 @@ int main(int argc, char *argv[])
 {
 	char line[1024];
 	struct hashmap map;
-	int icase;
+	int icase, incremental;
 
 	/* init hash map */
 	icase = argc > 1 && !strcmp("ignorecase", argv[1]);
+	incremental = argc > 1 && !strcmp("incremental", argv[argc - 1]);
 	hashmap_init(&map, (hashmap_cmp_fn) (icase ? test_entry_cmp_icase
 			: test_entry_cmp), 0);
+	if (incremental)
+		hashmap_set_incremental_resize(&map, 1);
 
 	/* process commands from stdin */
 	while (fgets(line, sizeof(line), stdin)) {
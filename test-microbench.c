@@ -0,0 +1,275 @@
+/*
+ * Microbenchmark harness for core primitives.
+ *
+ * Times selected internal APIs in isolation, with warmup and
+ * repetition, and reports nanoseconds per operation.  This is for
+ * evaluating data-structure and algorithm changes without the noise
+ * of a full git command.
+ *
+ * usage: test-microbench [--reps=<n>] [<name>...]
+ *
+ * With no names, all benchmarks are run.
+ */
+#include "cache.h"
+#include "hashmap.h"
+#include "delta.h"
+#include "wildmatch.h"
+
+static unsigned long reps = 100000;
+
+/* Simple deterministic pseudo-random bytes, so runs are comparable. */
+static void fill_random(unsigned char *buf, size_t len, uint32_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		seed = seed * 1103515245 + 12345;
+		buf[i] = seed >> 16;
+	}
+}
+
+struct int_entry {
+	struct hashmap_entry ent;
+	unsigned int key;
+};
+
+static int int_entry_cmp(const void *entry, const void *entry_or_key,
+			 const void *keydata)
+{
+	const struct int_entry *e1 = entry;
+	const struct int_entry *e2 = entry_or_key;
+
+	return e1->key != e2->key;
+}
+
+static void bench_hashmap(unsigned long n)
+{
+	struct hashmap map;
+	struct int_entry *entries;
+	unsigned long i, nr = 1024;
+
+	hashmap_init(&map, int_entry_cmp, nr);
+	entries = xmalloc(nr * sizeof(*entries));
+	for (i = 0; i < nr; i++) {
+		entries[i].key = i;
+		hashmap_entry_init(&entries[i], memhash(&entries[i].key,
+							sizeof(unsigned int)));
+		hashmap_add(&map, &entries[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		struct int_entry key;
+
+		key.key = i % nr;
+		hashmap_entry_init(&key, memhash(&key.key,
+						 sizeof(unsigned int)));
+		if (!hashmap_get(&map, &key, NULL))
+			die("hashmap lookup failed");
+	}
+
+	hashmap_free(&map, 0);
+	free(entries);
+}
+
+#define DELTA_BUF_SIZE (64 * 1024)
+
+static void delta_test_buffers(unsigned char **src, unsigned char **trg)
+{
+	*src = xmalloc(DELTA_BUF_SIZE);
+	*trg = xmalloc(DELTA_BUF_SIZE);
+	fill_random(*src, DELTA_BUF_SIZE, 1);
+	/* target is the source with a few scattered edits */
+	memcpy(*trg, *src, DELTA_BUF_SIZE);
+	fill_random(*trg + DELTA_BUF_SIZE / 2, 512, 2);
+	fill_random(*trg + DELTA_BUF_SIZE - 256, 256, 3);
+}
+
+static void bench_create_delta(unsigned long n)
+{
+	unsigned char *src, *trg;
+	struct delta_index *index;
+	unsigned long i, delta_size;
+
+	delta_test_buffers(&src, &trg);
+	index = create_delta_index(src, DELTA_BUF_SIZE);
+	if (!index)
+		die("create_delta_index failed");
+
+	for (i = 0; i < n; i++) {
+		void *delta = create_delta(index, trg, DELTA_BUF_SIZE,
+					   &delta_size, 0);
+		if (!delta)
+			die("create_delta failed");
+		free(delta);
+	}
+
+	free_delta_index(index);
+	free(src);
+	free(trg);
+}
+
+static void bench_patch_delta(unsigned long n)
+{
+	unsigned char *src, *trg;
+	unsigned long i, delta_size, result_size;
+	void *delta;
+
+	delta_test_buffers(&src, &trg);
+	delta = diff_delta(src, DELTA_BUF_SIZE, trg, DELTA_BUF_SIZE,
+			   &delta_size, 0);
+	if (!delta)
+		die("diff_delta failed");
+
+	for (i = 0; i < n; i++) {
+		void *result = patch_delta(src, DELTA_BUF_SIZE,
+					   delta, delta_size, &result_size);
+		if (!result || result_size != DELTA_BUF_SIZE)
+			die("patch_delta failed");
+		free(result);
+	}
+
+	free(delta);
+	free(src);
+	free(trg);
+}
+
+static void bench_strbuf(unsigned long n)
+{
+	unsigned long i;
+	int j;
+
+	for (i = 0; i < n; i++) {
+		struct strbuf buf = STRBUF_INIT;
+
+		for (j = 0; j < 64; j++)
+			strbuf_addstr(&buf, "0123456789abcdef0123456789abcdef");
+		strbuf_release(&buf);
+	}
+}
+
+static void bench_wildmatch(unsigned long n)
+{
+	static const char pattern[] = "some/*/literal/*.c";
+	static const char text[] = "some/long/literal/name.c";
+	unsigned long i;
+
+	for (i = 0; i < n; i++) {
+		if (wildmatch(pattern, text, WM_PATHNAME, NULL))
+			die("wildmatch failed");
+	}
+}
+
+static void bench_zlib(unsigned long n)
+{
+	unsigned char *plain, *compressed, *back;
+	unsigned long i, bound;
+
+	plain = xmalloc(DELTA_BUF_SIZE);
+	fill_random(plain, DELTA_BUF_SIZE, 4);
+	/* make it compressible */
+	memset(plain, 'x', DELTA_BUF_SIZE / 2);
+	bound = git_deflate_bound(NULL, DELTA_BUF_SIZE);
+	compressed = xmalloc(bound);
+	back = xmalloc(DELTA_BUF_SIZE);
+
+	for (i = 0; i < n; i++) {
+		git_zstream s;
+		unsigned long compressed_size;
+
+		memset(&s, 0, sizeof(s));
+		git_deflate_init(&s, zlib_compression_level);
+		s.next_in = plain;
+		s.avail_in = DELTA_BUF_SIZE;
+		s.next_out = compressed;
+		s.avail_out = bound;
+		if (git_deflate(&s, Z_FINISH) != Z_STREAM_END)
+			die("deflate failed");
+		compressed_size = s.total_out;
+		git_deflate_end(&s);
+
+		memset(&s, 0, sizeof(s));
+		git_inflate_init(&s);
+		s.next_in = compressed;
+		s.avail_in = compressed_size;
+		s.next_out = back;
+		s.avail_out = DELTA_BUF_SIZE;
+		if (git_inflate(&s, Z_FINISH) != Z_STREAM_END)
+			die("inflate failed");
+		git_inflate_end(&s);
+	}
+
+	free(plain);
+	free(compressed);
+	free(back);
+}
+
+static struct benchmark {
+	const char *name;
+	void (*fn)(unsigned long n);
+	/* scale down benchmarks whose single operation is heavy */
+	unsigned long divisor;
+} benchmarks[] = {
+	{ "hashmap", bench_hashmap, 1 },
+	{ "create_delta", bench_create_delta, 100 },
+	{ "patch_delta", bench_patch_delta, 10 },
+	{ "strbuf", bench_strbuf, 10 },
+	{ "wildmatch", bench_wildmatch, 1 },
+	{ "zlib", bench_zlib, 100 },
+};
+
+static void run_benchmark(const struct benchmark *b)
+{
+	unsigned long n = reps / b->divisor;
+	uint64_t start, elapsed;
+
+	if (!n)
+		n = 1;
+
+	/* warmup: touch caches and fault in pages before timing */
+	b->fn(n / 10 ? n / 10 : 1);
+
+	start = getnanotime();
+	b->fn(n);
+	elapsed = getnanotime() - start;
+
+	printf("%-14s %10lu ops %12.1f ns/op\n",
+	       b->name, n, (double)elapsed / n);
+}
+
+int main(int argc, char **argv)
+{
+	int i, j, done = 0;
+
+	for (i = 1; i < argc; i++) {
+		const char *arg;
+
+		if (skip_prefix(argv[i], "--reps=", &arg)) {
+			reps = strtoul(arg, NULL, 10);
+			if (!reps)
+				die("invalid repetition count: %s", arg);
+		} else if (!strcmp(argv[i], "--help")) {
+			usage("test-microbench [--reps=<n>] [<name>...]");
+		}
+	}
+
+	for (j = 0; j < ARRAY_SIZE(benchmarks); j++) {
+		int wanted = 1;
+
+		for (i = 1; i < argc; i++) {
+			if (starts_with(argv[i], "--"))
+				continue;
+			wanted = !strcmp(argv[i], benchmarks[j].name);
+			if (wanted)
+				break;
+		}
+		if (!wanted)
+			continue;
+		run_benchmark(&benchmarks[j]);
+		done++;
+	}
+
+	if (!done)
+		die("no matching benchmark; try one of hashmap, "
+		    "create_delta, patch_delta, strbuf, wildmatch, zlib");
+	return 0;
+}
@@ -0,0 +1,235 @@
+#include "cache.h"
+#include "tmp-objdir.h"
+#include "dir.h"
+#include "sigchain.h"
+#include "string-list.h"
+
+struct tmp_objdir {
+	struct strbuf path;
+	char *saved_objdir_env;
+	char *saved_alt_env;
+	unsigned env_exported : 1;
+};
+
+/*
+ * We only ever have one tmp_objdir at a time, so we store it here for
+ * the benefit of the atexit and signal handlers.
+ */
+static struct tmp_objdir *the_tmp_objdir;
+
+static void tmp_objdir_unexport_env(struct tmp_objdir *t)
+{
+	if (!t->env_exported)
+		return;
+
+	if (t->saved_objdir_env)
+		setenv(DB_ENVIRONMENT, t->saved_objdir_env, 1);
+	else
+		unsetenv(DB_ENVIRONMENT);
+	if (t->saved_alt_env)
+		setenv(ALTERNATE_DB_ENVIRONMENT, t->saved_alt_env, 1);
+	else
+		unsetenv(ALTERNATE_DB_ENVIRONMENT);
+	t->env_exported = 0;
+}
+
+static void tmp_objdir_free(struct tmp_objdir *t)
+{
+	if (t == the_tmp_objdir)
+		the_tmp_objdir = NULL;
+	strbuf_release(&t->path);
+	free(t->saved_objdir_env);
+	free(t->saved_alt_env);
+	free(t);
+}
+
+int tmp_objdir_destroy(struct tmp_objdir *t)
+{
+	int err;
+
+	if (!t)
+		return 0;
+
+	tmp_objdir_unexport_env(t);
+	err = remove_dir_recursively(&t->path, 0);
+	tmp_objdir_free(t);
+	return err;
+}
+
+static void remove_tmp_objdir(void)
+{
+	tmp_objdir_destroy(the_tmp_objdir);
+}
+
+static void remove_tmp_objdir_on_signal(int signo)
+{
+	remove_tmp_objdir();
+	sigchain_pop(signo);
+	raise(signo);
+}
+
+struct tmp_objdir *tmp_objdir_create(void)
+{
+	static int installed_handlers;
+	struct tmp_objdir *t;
+
+	if (the_tmp_objdir)
+		die("BUG: only one tmp_objdir can be used at a time");
+
+	t = xcalloc(1, sizeof(*t));
+	strbuf_init(&t->path, 0);
+
+	strbuf_addf(&t->path, "%s/incoming-XXXXXX", get_object_directory());
+	if (!mkdtemp(t->path.buf)) {
+		strbuf_release(&t->path);
+		free(t);
+		return NULL;
+	}
+
+	the_tmp_objdir = t;
+	if (!installed_handlers) {
+		atexit(remove_tmp_objdir);
+		sigchain_push_common(remove_tmp_objdir_on_signal);
+		installed_handlers = 1;
+	}
+
+	return t;
+}
+
+void tmp_objdir_export_env(struct tmp_objdir *t)
+{
+	const char *old_alt = getenv(ALTERNATE_DB_ENVIRONMENT);
+	struct strbuf alt = STRBUF_INIT;
+
+	t->saved_objdir_env = xstrdup_or_null(getenv(DB_ENVIRONMENT));
+	t->saved_alt_env = xstrdup_or_null(old_alt);
+
+	if (old_alt && *old_alt)
+		strbuf_addf(&alt, "%s%c", old_alt, PATH_SEP);
+	strbuf_addstr(&alt, absolute_path(get_object_directory()));
+
+	setenv(DB_ENVIRONMENT, absolute_path(t->path.buf), 1);
+	setenv(ALTERNATE_DB_ENVIRONMENT, alt.buf, 1);
+	strbuf_release(&alt);
+	t->env_exported = 1;
+}
+
+void tmp_objdir_add_as_alternate(const struct tmp_objdir *t)
+{
+	add_to_alternates_memory(t->path.buf);
+}
+
+/*
+ * Make sure that the object name never appears in the destination
+ * before its content does: within the pack directory, data files
+ * must land before the .idx that makes them discoverable.
+ */
+static int pack_copy_priority(const char *name)
+{
+	if (!starts_with(name, "pack"))
+		return 0;
+	if (ends_with(name, ".keep"))
+		return 1;
+	if (ends_with(name, ".pack"))
+		return 2;
+	if (ends_with(name, ".rev"))
+		return 3;
+	if (ends_with(name, ".idx"))
+		return 4;
+	return 5;
+}
+
+static int pack_copy_cmp(const char *a, const char *b)
+{
+	int prio_a = pack_copy_priority(a);
+	int prio_b = pack_copy_priority(b);
+
+	if (prio_a != prio_b)
+		return prio_a - prio_b;
+	return strcmp(a, b);
+}
+
+static int read_dir_paths(struct string_list *out, const char *path)
+{
+	DIR *dh;
+	struct dirent *de;
+
+	dh = opendir(path);
+	if (!dh)
+		return -1;
+
+	while ((de = readdir(dh)))
+		if (!is_dot_or_dotdot(de->d_name))
+			string_list_append(out, de->d_name);
+
+	closedir(dh);
+	return 0;
+}
+
+static int migrate_paths(struct strbuf *src, struct strbuf *dst);
+
+static int migrate_one(struct strbuf *src, struct strbuf *dst)
+{
+	struct stat st;
+
+	if (stat(src->buf, &st) < 0)
+		return -1;
+	if (S_ISDIR(st.st_mode)) {
+		if (!mkdir(dst->buf, 0777)) {
+			if (adjust_shared_perm(dst->buf))
+				return -1;
+		} else if (errno != EEXIST)
+			return -1;
+		return migrate_paths(src, dst);
+	}
+	return move_temp_to_file(src->buf, dst->buf);
+}
+
+static int migrate_paths(struct strbuf *src, struct strbuf *dst)
+{
+	size_t src_len = src->len, dst_len = dst->len;
+	struct string_list paths = STRING_LIST_INIT_DUP;
+	int i, ret = 0;
+
+	if (read_dir_paths(&paths, src->buf) < 0)
+		return -1;
+	paths.cmp = pack_copy_cmp;
+	string_list_sort(&paths);
+
+	for (i = 0; i < paths.nr; i++) {
+		const char *name = paths.items[i].string;
+
+		strbuf_addf(src, "/%s", name);
+		strbuf_addf(dst, "/%s", name);
+
+		ret |= migrate_one(src, dst);
+
+		strbuf_setlen(src, src_len);
+		strbuf_setlen(dst, dst_len);
+	}
+
+	string_list_clear(&paths, 0);
+	return ret;
+}
+
+int tmp_objdir_migrate(struct tmp_objdir *t)
+{
+	struct strbuf src = STRBUF_INIT, dst = STRBUF_INIT;
+	int ret;
+
+	if (!t)
+		return 0;
+
+	tmp_objdir_unexport_env(t);
+
+	strbuf_addbuf(&src, &t->path);
+	strbuf_addstr(&dst, get_object_directory());
+
+	ret = migrate_paths(&src, &dst);
+
+	strbuf_release(&src);
+	strbuf_release(&dst);
+
+	tmp_objdir_destroy(t);
+	return ret;
+}
@@ -0,0 +1,67 @@
+#ifndef TMP_OBJDIR_H
+#define TMP_OBJDIR_H
+
+/*
+ * This API allows you to create a temporary object directory, with
+ * the primary object directory as an alternate, so that incoming
+ * objects are quarantined until we decide to keep them.  Accepting
+ * them is a cheap migration of the files into the primary object
+ * directory; rejecting them is a simple recursive delete.
+ *
+ * Example:
+ *
+ *	struct tmp_objdir *t = tmp_objdir_create();
+ *	if (!t)
+ *		die_errno("unable to create temporary object directory");
+ *	tmp_objdir_export_env(t);
+ *	tmp_objdir_add_as_alternate(t);
+ *
+ *	if (spawn_object_writing_commands() || other_checks())
+ *		tmp_objdir_destroy(t);
+ *	else
+ *		tmp_objdir_migrate(t);
+ */
+
+struct tmp_objdir;
+
+/*
+ * Create a new temporary object directory inside the current
+ * object directory; returns NULL on failure.
+ */
+struct tmp_objdir *tmp_objdir_create(void);
+
+/*
+ * Redirect object writes into the temporary directory by exporting
+ * GIT_OBJECT_DIRECTORY (pointing at the quarantine) and
+ * GIT_ALTERNATE_OBJECT_DIRECTORIES (adding the real object
+ * directory) into the environment.  Every sub-process spawned while
+ * the quarantine is active writes there; the variables are restored
+ * when the quarantine is migrated or destroyed.  Note that the
+ * current process keeps using the real object directory for its own
+ * writes; use tmp_objdir_add_as_alternate() to read the quarantined
+ * objects.
+ */
+void tmp_objdir_export_env(struct tmp_objdir *);
+
+/*
+ * Make the objects in the temporary directory visible to the current
+ * process by registering it as an in-memory alternate.
+ */
+void tmp_objdir_add_as_alternate(const struct tmp_objdir *);
+
+/*
+ * Finalize a temporary object directory by migrating its objects
+ * into the main object directory, closing off the tmp_objdir, and
+ * freeing its memory.  After this, the tmp_objdir is gone for good.
+ * Returns 0 on success, non-zero when some objects could not be
+ * moved (in which case the migration may be partially done).
+ */
+int tmp_objdir_migrate(struct tmp_objdir *);
+
+/*
+ * Destroy a temporary object directory, discarding any objects it
+ * contains, and freeing the tmp_objdir.
+ */
+int tmp_objdir_destroy(struct tmp_objdir *);
+
+#endif /* TMP_OBJDIR_H */
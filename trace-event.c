@@ -0,0 +1,231 @@
+/*
+ * Structured performance telemetry, emitted as JSON lines to the sink
+ * named by GIT_TRACE_EVENT.  See trace-event.h for the API.
+ */
+#include "cache.h"
+#include "trace-event.h"
+
+static struct trace_key trace_event = TRACE_KEY_INIT(EVENT);
+
+static uint64_t cmd_start_time;
+static int exit_code = -1;
+static int exit_event_sent;
+
+#define MAX_REGION_DEPTH 100
+static uint64_t region_start[MAX_REGION_DEPTH];
+static int region_depth;
+
+static struct event_counter {
+	const char *name;
+	uint64_t value;
+} *counters;
+static int counter_nr, counter_alloc;
+
+static uint64_t *child_start_times;
+static int child_nr, child_alloc;
+
+/*
+ * Append s to buf as a JSON string literal, including the
+ * surrounding double quotes.
+ */
+static void event_quote_string(struct strbuf *buf, const char *s)
+{
+	strbuf_addch(buf, '"');
+	for (; *s; s++) {
+		switch (*s) {
+		case '"':
+			strbuf_addstr(buf, "\\\"");
+			break;
+		case '\\':
+			strbuf_addstr(buf, "\\\\");
+			break;
+		case '\n':
+			strbuf_addstr(buf, "\\n");
+			break;
+		case '\t':
+			strbuf_addstr(buf, "\\t");
+			break;
+		default:
+			if ((unsigned char)*s < 0x20)
+				strbuf_addf(buf, "\\u%04x", *s);
+			else
+				strbuf_addch(buf, *s);
+		}
+	}
+	strbuf_addch(buf, '"');
+}
+
+static void event_quote_argv(struct strbuf *buf, const char **argv)
+{
+	int i;
+
+	strbuf_addch(buf, '[');
+	for (i = 0; argv[i]; i++) {
+		if (i)
+			strbuf_addch(buf, ',');
+		event_quote_string(buf, argv[i]);
+	}
+	strbuf_addch(buf, ']');
+}
+
+/* Start an event object with the fields every event carries. */
+static void event_begin(struct strbuf *buf, const char *event)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	strbuf_addf(buf, "{\"event\":\"%s\",\"pid\":%d,"
+		    "\"time\":%ld.%06ld",
+		    event, (int)getpid(),
+		    (long)tv.tv_sec, (long)tv.tv_usec);
+}
+
+static void event_end(struct strbuf *buf)
+{
+	strbuf_addstr(buf, "}\n");
+	write_in_full(trace_event.fd, buf->buf, buf->len);
+	strbuf_release(buf);
+}
+
+static void emit_exit_event(void)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	if (exit_event_sent)
+		return;
+	exit_event_sent = 1;
+
+	for (i = 0; i < counter_nr; i++) {
+		event_begin(&buf, "counter");
+		strbuf_addf(&buf, ",\"name\":\"%s\",\"value\":%"PRIuMAX,
+			    counters[i].name, (uintmax_t)counters[i].value);
+		event_end(&buf);
+	}
+
+	event_begin(&buf, "exit");
+	if (exit_code >= 0)
+		strbuf_addf(&buf, ",\"code\":%d", exit_code);
+	strbuf_addf(&buf, ",\"t_abs\":%.6f",
+		    (getnanotime() - cmd_start_time) / 1.0e9);
+	event_end(&buf);
+}
+
+void trace_event_cmd_start(const char **argv)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	if (!trace_want(&trace_event))
+		return;
+
+	cmd_start_time = getnanotime();
+	atexit(emit_exit_event);
+
+	event_begin(&buf, "start");
+	strbuf_addstr(&buf, ",\"argv\":");
+	event_quote_argv(&buf, argv);
+	event_end(&buf);
+}
+
+void trace_event_cmd_exit(int code)
+{
+	if (!trace_want(&trace_event))
+		return;
+	exit_code = code;
+}
+
+void trace_event_region_enter(const char *category, const char *label)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	if (!trace_want(&trace_event))
+		return;
+
+	if (region_depth < MAX_REGION_DEPTH)
+		region_start[region_depth] = getnanotime();
+	region_depth++;
+
+	event_begin(&buf, "region_enter");
+	strbuf_addf(&buf, ",\"depth\":%d", region_depth);
+	strbuf_addstr(&buf, ",\"category\":");
+	event_quote_string(&buf, category);
+	strbuf_addstr(&buf, ",\"label\":");
+	event_quote_string(&buf, label);
+	event_end(&buf);
+}
+
+void trace_event_region_leave(const char *category, const char *label)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	if (!trace_want(&trace_event))
+		return;
+
+	if (!region_depth)
+		die("BUG: trace_event_region_leave without matching enter");
+	region_depth--;
+
+	event_begin(&buf, "region_leave");
+	strbuf_addf(&buf, ",\"depth\":%d", region_depth + 1);
+	strbuf_addstr(&buf, ",\"category\":");
+	event_quote_string(&buf, category);
+	strbuf_addstr(&buf, ",\"label\":");
+	event_quote_string(&buf, label);
+	if (region_depth < MAX_REGION_DEPTH)
+		strbuf_addf(&buf, ",\"t_rel\":%.6f",
+			    (getnanotime() - region_start[region_depth]) / 1.0e9);
+	event_end(&buf);
+}
+
+void trace_event_counter_add(const char *name, uint64_t value)
+{
+	int i;
+
+	if (!trace_want(&trace_event))
+		return;
+
+	for (i = 0; i < counter_nr; i++) {
+		if (!strcmp(counters[i].name, name)) {
+			counters[i].value += value;
+			return;
+		}
+	}
+	ALLOC_GROW(counters, counter_nr + 1, counter_alloc);
+	counters[counter_nr].name = name;
+	counters[counter_nr].value = value;
+	counter_nr++;
+}
+
+int trace_event_child_start(const char **argv)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int id;
+
+	if (!trace_want(&trace_event))
+		return -1;
+
+	id = child_nr;
+	ALLOC_GROW(child_start_times, child_nr + 1, child_alloc);
+	child_start_times[child_nr++] = getnanotime();
+
+	event_begin(&buf, "child_start");
+	strbuf_addf(&buf, ",\"child_id\":%d", id);
+	strbuf_addstr(&buf, ",\"argv\":");
+	event_quote_argv(&buf, argv);
+	event_end(&buf);
+	return id;
+}
+
+void trace_event_child_exit(int child_id, int code)
+{
+	struct strbuf buf = STRBUF_INIT;
+
+	if (child_id < 0 || child_id >= child_nr || !trace_want(&trace_event))
+		return;
+
+	event_begin(&buf, "child_exit");
+	strbuf_addf(&buf, ",\"child_id\":%d,\"code\":%d", child_id, code);
+	strbuf_addf(&buf, ",\"t_rel\":%.6f",
+		    (getnanotime() - child_start_times[child_id]) / 1.0e9);
+	event_end(&buf);
+}
@@ -0,0 +1,52 @@
+#ifndef TRACE_EVENT_H
+#define TRACE_EVENT_H
+
+#include "git-compat-util.h"
+
+/*
+ * Structured performance telemetry.
+ *
+ * When GIT_TRACE_EVENT is set (to an absolute path, a file descriptor
+ * number, or "1" for stderr, like the other GIT_TRACE_* variables),
+ * git emits one JSON object per line describing what the process is
+ * doing: command start and exit, timed regions with nesting, child
+ * process accounting and accumulated counters.  When the variable is
+ * unset every entry point below is a cheap no-op.
+ */
+
+/*
+ * Emit the "start" event with the command line, and arrange for an
+ * "exit" event to be emitted when the process ends, even on die().
+ */
+void trace_event_cmd_start(const char **argv);
+
+/*
+ * Record the exit code to be reported by the "exit" event.  Exits
+ * that bypass this call (e.g. die()) still get an exit event, but
+ * without a "code" field.
+ */
+void trace_event_cmd_exit(int code);
+
+/*
+ * Mark the start and end of a timed phase.  Regions may nest; the
+ * "region_leave" event carries the time spent in the region.  The
+ * category/label pair in the leave call must match the enter call.
+ */
+void trace_event_region_enter(const char *category, const char *label);
+void trace_event_region_leave(const char *category, const char *label);
+
+/*
+ * Add to a named process-wide counter.  Counters are accumulated in
+ * memory and emitted as "counter" events just before the exit event.
+ */
+void trace_event_counter_add(const char *name, uint64_t value);
+
+/*
+ * Report that a child process is being spawned with the given
+ * command line.  Returns an id to pass to trace_event_child_exit()
+ * when the child has been waited for, or -1 if telemetry is disabled.
+ */
+int trace_event_child_start(const char **argv);
+void trace_event_child_exit(int child_id, int code);
+
+#endif /* TRACE_EVENT_H */
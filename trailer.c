@@ -833,19 +833,32 @@ static void free_all(struct trailer_item **first)
 	}
 }
 
-void process_trailers(const char *file, int trim_empty, struct string_list *trailers)
+/*
+ * The trailer configuration cannot change within one process, so it
+ * is parsed into first_conf_item (and default_conf_info) only once,
+ * no matter how many messages go through; this is what makes
+ * processing many messages per invocation cheap.
+ */
+static void ensure_configured(void)
 {
-	struct trailer_item *in_tok_first = NULL;
-	struct trailer_item *in_tok_last = NULL;
-	struct trailer_item *arg_tok_first;
-	struct strbuf **lines;
-	int trailer_end;
+	static int configured;
+
+	if (configured)
+		return;
+	configured = 1;
 
 	/* Default config must be setup first */
 	git_config(git_trailer_default_config, NULL);
 	git_config(git_trailer_config, NULL);
+}
 
-	lines = read_input_file(file);
+static void process_trailer_lines(struct strbuf **lines, int trim_empty,
+				  struct string_list *trailers)
+{
+	struct trailer_item *in_tok_first = NULL;
+	struct trailer_item *in_tok_last = NULL;
+	struct trailer_item *arg_tok_first;
+	int trailer_end;
 
 	/* Print the lines before the trailers */
 	trailer_end = process_input_file(lines, &in_tok_first, &in_tok_last);
@@ -860,6 +873,30 @@ void process_trailers(const char *file, int trim_empty, struct string_list *trai
 
 	/* Print the lines after the trailers as is */
 	print_lines(lines, trailer_end, INT_MAX);
+}
+
+void process_trailers(const char *file, int trim_empty, struct string_list *trailers)
+{
+	struct strbuf **lines;
 
+	ensure_configured();
+
+	lines = read_input_file(file);
+	process_trailer_lines(lines, trim_empty, trailers);
+	strbuf_list_free(lines);
+}
+
+void process_trailers_buffer(const char *buf, size_t len, int trim_empty,
+			     struct string_list *trailers)
+{
+	struct strbuf sb = STRBUF_INIT;
+	struct strbuf **lines;
+
+	ensure_configured();
+
+	strbuf_add(&sb, buf, len);
+	lines = strbuf_split(&sb, '\n');
+	strbuf_release(&sb);
+	process_trailer_lines(lines, trim_empty, trailers);
 	strbuf_list_free(lines);
 }
@@ -2,5 +2,7 @@
 #define TRAILER_H
 
 void process_trailers(const char *file, int trim_empty, struct string_list *trailers);
+void process_trailers_buffer(const char *buf, size_t len, int trim_empty,
+			     struct string_list *trailers);
 
 #endif /* TRAILER_H */
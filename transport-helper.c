@@ -260,14 +260,16 @@ static const char *boolean_options[] = {
 	TRANS_OPT_PUSH_CERT
 	};
 
-static int set_helper_option(struct transport *transport,
-			  const char *name, const char *value)
+/*
+ * Append an "option" command to 'out' so that several of them can be
+ * sent to the helper in a single write.  Returns 1 (without touching
+ * 'out') when the option cannot be sent at all, 0 when it was queued
+ * and a reply must be collected with read_helper_option_status().
+ */
+static int write_helper_option(struct helper_data *data, struct strbuf *out,
+			       const char *name, const char *value)
 {
-	struct helper_data *data = transport->data;
-	struct strbuf buf = STRBUF_INIT;
-	int i, ret, is_bool = 0;
-
-	get_helper(transport);
+	int i, is_bool = 0;
 
 	if (!data->option)
 		return 1;
@@ -284,22 +286,28 @@ static int set_helper_option(struct transport *transport,
 		}
 	}
 
-	strbuf_addf(&buf, "option %s ", name);
+	strbuf_addf(out, "option %s ", name);
 	if (is_bool)
-		strbuf_addstr(&buf, value ? "true" : "false");
+		strbuf_addstr(out, value ? "true" : "false");
 	else
-		quote_c_style(value, &buf, NULL, 0);
-	strbuf_addch(&buf, '\n');
+		quote_c_style(value, out, NULL, 0);
+	strbuf_addch(out, '\n');
+	return 0;
+}
+
+static int read_helper_option_status(struct helper_data *data)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int ret;
 
-	sendline(data, &buf);
 	if (recvline(data, &buf))
 		exit(128);
 
 	if (!strcmp(buf.buf, "ok"))
 		ret = 0;
-	else if (starts_with(buf.buf, "error")) {
+	else if (starts_with(buf.buf, "error"))
 		ret = -1;
-	} else if (!strcmp(buf.buf, "unsupported"))
+	else if (!strcmp(buf.buf, "unsupported"))
 		ret = 1;
 	else {
 		warning("%s unexpectedly said: '%s'", data->name, buf.buf);
@@ -309,18 +317,71 @@ static int set_helper_option(struct transport *transport,
 	return ret;
 }
 
+static int set_helper_option(struct transport *transport,
+			  const char *name, const char *value)
+{
+	struct helper_data *data = transport->data;
+	struct strbuf buf = STRBUF_INIT;
+
+	get_helper(transport);
+
+	if (write_helper_option(data, &buf, name, value)) {
+		strbuf_release(&buf);
+		return 1;
+	}
+
+	sendline(data, &buf);
+	strbuf_release(&buf);
+	return read_helper_option_status(data);
+}
+
+/*
+ * Like set_helper_option() for several options at once, but with a
+ * single IPC turnaround: all commands are pushed down the pipe in one
+ * write before any reply is read back.  Failures are ignored, just as
+ * the callers of the one-shot version ignore them for these options.
+ */
+static void set_helper_options(struct transport *transport,
+			       const char **name, const char **value, int nr)
+{
+	struct helper_data *data = transport->data;
+	struct strbuf buf = STRBUF_INIT;
+	int queued = 0;
+	int i;
+
+	get_helper(transport);
+
+	for (i = 0; i < nr; i++)
+		if (!write_helper_option(data, &buf, name[i], value[i]))
+			queued++;
+
+	if (!queued) {
+		strbuf_release(&buf);
+		return;
+	}
+
+	sendline(data, &buf);
+	strbuf_release(&buf);
+	while (queued--)
+		read_helper_option_status(data);
+}
+
 static void standard_options(struct transport *t)
 {
+	const char *names[2] = { "progress", "verbosity" };
+	const char *values[2];
 	char buf[16];
 	int n;
 	int v = t->verbose;
 
-	set_helper_option(t, "progress", t->progress ? "true" : "false");
+	values[0] = t->progress ? "true" : "false";
 
 	n = snprintf(buf, sizeof(buf), "%d", v + 1);
 	if (n >= sizeof(buf))
 		die("impossibly large verbosity value");
-	set_helper_option(t, "verbosity", buf);
+	values[1] = buf;
+
+	set_helper_options(t, names, values, 2);
 }
 
 static int release_helper(struct transport *transport)
@@ -448,11 +509,8 @@ static int fetch_with_import(struct transport *transport,
 
 		strbuf_addf(&buf, "import %s\n",
 			    posn->symref ? posn->symref : posn->name);
-		sendline(data, &buf);
-		strbuf_reset(&buf);
 	}
 
-	write_constant(data->helper->in, "\n");
 	/*
 	 * remote-helpers that advertise the bidi-import capability are required to
 	 * buffer the complete batch of import commands until this newline before
@@ -460,6 +518,9 @@ static int fetch_with_import(struct transport *transport,
 	 * These helpers read back data from fast-import on their stdin, which could
 	 * be mixed with import commands, otherwise.
 	 */
+	strbuf_addch(&buf, '\n');
+	sendline(data, &buf);
+	strbuf_reset(&buf);
 
 	if (finish_command(&fastimport))
 		die("Error while running fast-import");
@@ -599,7 +660,8 @@ static int fetch(struct transport *transport,
 		 int nr_heads, struct ref **to_fetch)
 {
 	struct helper_data *data = transport->data;
-	int i, count;
+	const char *opt_names[3], *opt_values[3];
+	int i, count, opt_nr;
 
 	if (process_connect(transport, 0)) {
 		do_take_over(transport);
@@ -614,15 +676,18 @@ static int fetch(struct transport *transport,
 	if (!count)
 		return 0;
 
+	opt_nr = 0;
 	if (data->check_connectivity &&
 	    data->transport_options.check_self_contained_and_connected)
-		set_helper_option(transport, "check-connectivity", "true");
-
+		opt_names[opt_nr++] = "check-connectivity";
 	if (transport->cloning)
-		set_helper_option(transport, "cloning", "true");
-
+		opt_names[opt_nr++] = "cloning";
 	if (data->transport_options.update_shallow)
-		set_helper_option(transport, "update-shallow", "true");
+		opt_names[opt_nr++] = "update-shallow";
+	for (i = 0; i < opt_nr; i++)
+		opt_values[i] = "true";
+	if (opt_nr)
+		set_helper_options(transport, opt_names, opt_values, opt_nr);
 
 	if (data->fetch)
 		return fetch_with_fetch(transport, nr_heads, to_fetch);
@@ -1,5 +1,6 @@
 #include "cache.h"
 #include "transport.h"
+#include "trace-event.h"
 #include "run-command.h"
 #include "pkt-line.h"
 #include "fetch-pack.h"
@@ -478,9 +479,18 @@ static int set_git_option(struct git_transport_options *opts,
 				die("transport: invalid depth option '%s'", value);
 		}
 		return 0;
+	} else if (!strcmp(name, TRANS_OPT_NARROW)) {
+		opts->narrow_paths = value;
+		return 0;
+	} else if (!strcmp(name, TRANS_OPT_NO_BLOBS)) {
+		opts->no_blobs = !!value;
+		return 0;
 	} else if (!strcmp(name, TRANS_OPT_PUSH_CERT)) {
 		opts->push_cert = !!value;
 		return 0;
+	} else if (!strcmp(name, TRANS_OPT_NEGOTIATION_ALGORITHM)) {
+		opts->negotiation_algorithm = value;
+		return 0;
 	}
 	return 1;
 }
@@ -488,15 +498,44 @@ static int set_git_option(struct git_transport_options *opts,
 static int connect_setup(struct transport *transport, int for_push, int verbose)
 {
 	struct git_transport_data *data = transport->data;
+	int set_prefixes = 0;
 
 	if (data->conn)
 		return 0;
 
+	/*
+	 * Ask the other side to limit its advertisement to the refs
+	 * we care about.  The request travels in the environment: a
+	 * local upload-pack inherits it directly, and git_connect()
+	 * forwards it to git-daemon as hidden extra arguments.  Sides
+	 * that do not understand the request advertise everything,
+	 * which is a safe superset.  Pushes always see the full
+	 * advertisement.
+	 */
+	if (!for_push && transport->ref_prefixes &&
+	    transport->ref_prefixes->nr) {
+		struct strbuf joined = STRBUF_INIT;
+		int i;
+
+		for (i = 0; i < transport->ref_prefixes->nr; i++) {
+			if (i)
+				strbuf_addch(&joined, ' ');
+			strbuf_addstr(&joined,
+				      transport->ref_prefixes->items[i].string);
+		}
+		setenv("GIT_REF_PREFIXES", joined.buf, 1);
+		strbuf_release(&joined);
+		set_prefixes = 1;
+	}
+
 	data->conn = git_connect(data->fd, transport->url,
 				 for_push ? data->options.receivepack :
 				 data->options.uploadpack,
 				 verbose ? CONNECT_VERBOSE : 0);
 
+	if (set_prefixes)
+		unsetenv("GIT_REF_PREFIXES");
+
 	return 0;
 }
 
@@ -534,10 +573,13 @@ static int fetch_refs_via_pack(struct transport *transport,
 	args.quiet = (transport->verbose < 0);
 	args.no_progress = !transport->progress;
 	args.depth = data->options.depth;
+	args.narrow_paths = data->options.narrow_paths;
+	args.no_blobs = data->options.no_blobs;
 	args.check_self_contained_and_connected =
 		data->options.check_self_contained_and_connected;
 	args.cloning = transport->cloning;
 	args.update_shallow = data->options.update_shallow;
+	args.negotiation_algorithm = data->options.negotiation_algorithm;
 
 	if (!data->got_remote_heads) {
 		connect_setup(transport, 0, 0);
@@ -811,6 +853,7 @@ static int git_transport_push(struct transport *transport, struct ref *remote_re
 {
 	struct git_transport_data *data = transport->data;
 	struct send_pack_args args;
+	int negotiate;
 	int ret;
 
 	if (!data->got_remote_heads) {
@@ -835,6 +878,9 @@ static int git_transport_push(struct transport *transport, struct ref *remote_re
 	args.atomic = !!(flags & TRANSPORT_PUSH_ATOMIC);
 	args.url = transport->url;
 
+	if (!git_config_get_bool("push.negotiate", &negotiate))
+		args.push_negotiate = negotiate;
+
 	ret = send_pack(&args, data->fd, data->conn, remote_refs,
 			&data->extra_have);
 
@@ -990,6 +1036,8 @@ struct transport *transport_get(struct remote *remote, const char *url)
 		ret->smart_options->receivepack = "git-receive-pack";
 		if (remote->receivepack)
 			ret->smart_options->receivepack = remote->receivepack;
+		ret->smart_options->negotiation_algorithm =
+			remote->negotiation_algorithm;
 	}
 
 	return ret;
@@ -1193,7 +1241,9 @@ int transport_push(struct transport *transport,
 					die_with_unpushed_submodules(&needs_pushing);
 		}
 
+		trace_event_region_enter("transport", "push_refs");
 		push_ret = transport->push_refs(transport, remote_refs, flags);
+		trace_event_region_leave("transport", "push_refs");
 		err = push_had_errors(remote_refs);
 		ret = push_ret | err;
 
@@ -1224,7 +1274,9 @@ int transport_push(struct transport *transport,
 const struct ref *transport_get_remote_refs(struct transport *transport)
 {
 	if (!transport->got_remote_refs) {
+		trace_event_region_enter("transport", "get_remote_refs");
 		transport->remote_refs = transport->get_refs_list(transport, 0);
+		trace_event_region_leave("transport", "get_remote_refs");
 		transport->got_remote_refs = 1;
 	}
 
@@ -1261,7 +1313,9 @@ int transport_fetch_refs(struct transport *transport, struct ref *refs)
 			heads[nr_heads++] = rm;
 	}
 
+	trace_event_region_enter("transport", "fetch_refs");
 	rc = transport->fetch(transport, nr_heads, heads);
+	trace_event_region_leave("transport", "fetch_refs");
 
 	free(heads);
 	return rc;
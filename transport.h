@@ -13,9 +13,13 @@ struct git_transport_options {
 	unsigned self_contained_and_connected : 1;
 	unsigned update_shallow : 1;
 	unsigned push_cert : 1;
+	unsigned no_blobs : 1;
 	int depth;
+	/* newline-separated paths to narrow the fetch to */
+	const char *narrow_paths;
 	const char *uploadpack;
 	const char *receivepack;
+	const char *negotiation_algorithm;
 	struct push_cas_option *cas;
 };
 
@@ -43,6 +47,16 @@ struct transport {
 	 */
 	unsigned cloning : 1;
 
+	/*
+	 * Ref prefixes the caller is interested in; transports that
+	 * can do so ask the other side to limit its ref advertisement
+	 * to refs matching one of these prefixes.  This is only a
+	 * hint: the advertisement may still contain refs outside the
+	 * requested prefixes.  NULL or an empty list asks for all
+	 * refs.
+	 */
+	const struct string_list *ref_prefixes;
+
 	/**
 	 * Returns 0 if successful, positive if the option is not
 	 * recognized or is inapplicable, and negative if the option
@@ -153,6 +167,12 @@ struct transport *transport_get(struct remote *, const char *);
 /* Limit the depth of the fetch if not null */
 #define TRANS_OPT_DEPTH "depth"
 
+/* Narrow the fetch to newline-separated paths if not null */
+#define TRANS_OPT_NARROW "narrow"
+
+/* Leave all blobs out of the fetched pack if not null */
+#define TRANS_OPT_NO_BLOBS "no-blobs"
+
 /* Aggressively fetch annotated tags if possible */
 #define TRANS_OPT_FOLLOWTAGS "followtags"
 
@@ -162,6 +182,9 @@ struct transport *transport_get(struct remote *, const char *);
 /* Send push certificates */
 #define TRANS_OPT_PUSH_CERT "pushcert"
 
+/* The algorithm to use to negotiate common commits with the server */
+#define TRANS_OPT_NEGOTIATION_ALGORITHM "negotiationalgorithm"
+
 /**
  * Returns 0 if the option was used, non-zero otherwise. Prints a
  * message to stderr if the option is not used.
@@ -5,6 +5,7 @@
 #include "diff.h"
 #include "diffcore.h"
 #include "tree.h"
+#include "streaming.h"
 
 /*
  * internal mode marker, saying a tree entry != entry of tp[imin]
@@ -35,6 +36,149 @@ static int ll_diff_tree_sha1(const unsigned char *old, const unsigned char *new,
  *      Due to this convention, if trees are scanned in sorted order, all
  *      non-empty descriptors will be processed first.
  */
+/*
+ * A tree being diffed.  Normally the whole object is read up front, as
+ * fill_tree_descriptor() always did; for pathspec-limited walks the
+ * object is instead inflated incrementally through the streaming
+ * machinery, and the descriptor is handed successive windows of
+ * complete entries, so that the walk can stop inflating once it is
+ * past everything the pathspec can match.
+ */
+struct tree_desc_source {
+	struct git_istream *st;	/* non-NULL while more bytes to stream */
+	struct strbuf buf;	/* bytes streamed in so far */
+	unsigned long remaining;	/* bytes of the object still to read */
+	size_t window;		/* end of the entries handed out so far */
+	void *whole;		/* non-streaming mode: the full buffer */
+	unsigned char sha1[20];
+	/*
+	 * set once tree_entry_interesting() has declared the rest of
+	 * this tree all-interesting, so the remaining entries need
+	 * not be matched against the pathspec at all
+	 */
+	unsigned all_interesting : 1;
+};
+
+#define TREE_SOURCE_CHUNK (16 * 1024)
+
+static void tree_source_close(struct tree_desc_source *ts)
+{
+	if (ts->st) {
+		close_istream(ts->st);
+		ts->st = NULL;
+		ts->remaining = 0;
+	}
+}
+
+/*
+ * Hand out the next window of complete entries, streaming more of the
+ * object in if none are pending.  No-op while the descriptor still
+ * has entries left, or when the tree was read whole up front.
+ */
+static void tree_source_refill(struct tree_desc_source *ts,
+			       struct tree_desc *desc)
+{
+	size_t end = ts->window;
+
+	if (desc->size || !ts->st)
+		return;
+
+	for (;;) {
+		/* extend over the entries that are complete */
+		for (;;) {
+			const char *b = ts->buf.buf;
+			const char *nul = memchr(b + end, '\0',
+						 ts->buf.len - end);
+			if (!nul || nul + 1 + 20 > b + ts->buf.len)
+				break;
+			end = nul + 1 + 20 - b;
+		}
+		if (end != ts->window || !ts->remaining)
+			break;
+
+		{
+			size_t cnt = ts->remaining < TREE_SOURCE_CHUNK ?
+				ts->remaining : TREE_SOURCE_CHUNK;
+			ssize_t got;
+
+			strbuf_grow(&ts->buf, cnt);
+			got = read_istream(ts->st, ts->buf.buf + ts->buf.len,
+					   cnt);
+			if (got <= 0)
+				die("unable to read tree %s",
+				    sha1_to_hex(ts->sha1));
+			strbuf_setlen(&ts->buf, ts->buf.len + got);
+			ts->remaining -= got;
+		}
+	}
+
+	if (!ts->remaining && end != ts->buf.len)
+		die("corrupt tree %s", sha1_to_hex(ts->sha1));
+
+	if (end == ts->window) {
+		tree_source_close(ts);
+		return;
+	}
+	init_tree_desc(desc, ts->buf.buf + ts->window, end - ts->window);
+	ts->window = end;
+	if (!ts->remaining)
+		tree_source_close(ts);
+}
+
+static void tree_source_init(struct tree_desc_source *ts,
+			     struct tree_desc *desc,
+			     const unsigned char *sha1, int stream)
+{
+	enum object_type type;
+	unsigned long size;
+
+	memset(ts, 0, sizeof(*ts));
+	strbuf_init(&ts->buf, 0);
+	if (sha1)
+		hashcpy(ts->sha1, sha1);
+
+	if (sha1 && stream) {
+		ts->st = open_istream(sha1, &type, &size, NULL);
+		if (ts->st && type != OBJ_TREE) {
+			close_istream(ts->st);
+			ts->st = NULL;
+		}
+		if (ts->st) {
+			ts->remaining = size;
+			init_tree_desc(desc, NULL, 0);
+			tree_source_refill(ts, desc);
+			return;
+		}
+		/* fall back to reading the object whole */
+	}
+	ts->whole = fill_tree_descriptor(desc, sha1);
+}
+
+/*
+ * Initialize a descriptor over the same tree that another
+ * (non-streaming) source has already read, sharing its buffer; the
+ * two descriptors still iterate independently.  Octopus merges
+ * routinely have several parents with identical subtrees, and this
+ * saves re-inflating the object for each of them.
+ */
+static void tree_source_init_shared(struct tree_desc_source *ts,
+				    struct tree_desc *desc,
+				    const struct tree_desc_source *src_ts,
+				    const struct tree_desc *src_desc)
+{
+	memset(ts, 0, sizeof(*ts));
+	strbuf_init(&ts->buf, 0);
+	hashcpy(ts->sha1, src_ts->sha1);
+	init_tree_desc(desc, src_desc->buffer, src_desc->size);
+}
+
+static void tree_source_release(struct tree_desc_source *ts)
+{
+	tree_source_close(ts);
+	strbuf_release(&ts->buf);
+	free(ts->whole);
+}
+
 static int tree_entry_pathcmp(struct tree_desc *t1, struct tree_desc *t2)
 {
 	struct name_entry *e1, *e2;
@@ -284,16 +428,33 @@ static struct combine_diff_path *emit_path(struct combine_diff_path *p,
 	return p;
 }
 
-static void skip_uninteresting(struct tree_desc *t, struct strbuf *base,
-			       struct diff_options *opt)
+static void skip_uninteresting(struct tree_desc *t, struct tree_desc_source *ts,
+			       struct strbuf *base, struct diff_options *opt)
 {
 	enum interesting match;
 
-	while (t->size) {
+	for (;;) {
+		if (!t->size) {
+			tree_source_refill(ts, t);
+			if (!t->size)
+				break;
+		}
+		/*
+		 * Tree entries are sorted, so an all-interesting (or
+		 * all-uninteresting) verdict holds for the rest of
+		 * the tree; remember it across calls for this frame
+		 * instead of re-matching every later entry.
+		 */
+		if (ts->all_interesting)
+			break;
 		match = tree_entry_interesting(&t->entry, base, 0, &opt->pathspec);
 		if (match) {
-			if (match == all_entries_not_interesting)
+			if (match == all_entries_not_interesting) {
 				t->size = 0;
+				/* nothing below this point can match */
+				tree_source_close(ts);
+			} else if (match == all_entries_interesting)
+				ts->all_interesting = 1;
 			break;
 		}
 		update_tree_entry(t);
@@ -399,11 +560,12 @@ static struct combine_diff_path *ll_diff_tree_paths(
 	struct strbuf *base, struct diff_options *opt)
 {
 	struct tree_desc t, *tp;
-	void *ttree, **tptree;
+	struct tree_desc_source tsrc, *tpsrc;
 	int i;
+	int stream = opt->pathspec.nr > 0;
 
-	tp     = xalloca(nparent * sizeof(tp[0]));
-	tptree = xalloca(nparent * sizeof(tptree[0]));
+	tp    = xalloca(nparent * sizeof(tp[0]));
+	tpsrc = xalloca(nparent * sizeof(tpsrc[0]));
 
 	/*
 	 * load parents first, as they are probably already cached.
@@ -411,9 +573,21 @@ static struct combine_diff_path *ll_diff_tree_paths(
 	 * ( log_tree_diff() parses commit->parent before calling here via
 	 *   diff_tree_sha1(parent, commit) )
 	 */
-	for (i = 0; i < nparent; ++i)
-		tptree[i] = fill_tree_descriptor(&tp[i], parents_sha1[i]);
-	ttree = fill_tree_descriptor(&t, sha1);
+	for (i = 0; i < nparent; ++i) {
+		int j;
+
+		for (j = 0; j < i; j++)
+			if (!stream && parents_sha1[i] && parents_sha1[j] &&
+			    !hashcmp(parents_sha1[i], parents_sha1[j]) &&
+			    tpsrc[j].whole)
+				break;
+		if (j < i)
+			tree_source_init_shared(&tpsrc[i], &tp[i],
+						&tpsrc[j], &tp[j]);
+		else
+			tree_source_init(&tpsrc[i], &tp[i], parents_sha1[i], stream);
+	}
+	tree_source_init(&tsrc, &t, sha1, stream);
 
 	/* Enable recursion indefinitely */
 	opt->pathspec.recursive = DIFF_OPT_TST(opt, RECURSIVE);
@@ -425,9 +599,9 @@ static struct combine_diff_path *ll_diff_tree_paths(
 			break;
 
 		if (opt->pathspec.nr) {
-			skip_uninteresting(&t, base, opt);
+			skip_uninteresting(&t, &tsrc, base, opt);
 			for (i = 0; i < nparent; i++)
-				skip_uninteresting(&tp[i], base, opt);
+				skip_uninteresting(&tp[i], &tpsrc[i], base, opt);
 		}
 
 		/* comparing is finished when all trees are done */
@@ -528,10 +702,10 @@ static struct combine_diff_path *ll_diff_tree_paths(
 		}
 	}
 
-	free(ttree);
+	tree_source_release(&tsrc);
 	for (i = nparent-1; i >= 0; i--)
-		free(tptree[i]);
-	xalloca_free(tptree);
+		tree_source_release(&tpsrc[i]);
+	xalloca_free(tpsrc);
 	xalloca_free(tp);
 
 	return p;
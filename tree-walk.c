@@ -4,6 +4,7 @@
 #include "dir.h"
 #include "tree.h"
 #include "pathspec.h"
+#include "hashmap.h"
 
 static const char *get_mode(const char *str, unsigned int *modep)
 {
@@ -49,13 +50,162 @@ void init_tree_desc(struct tree_desc *desc, const void *buffer, unsigned long si
 		decode_tree_entry(desc, buffer, size);
 }
 
+static size_t tree_cache_used;
+
+static unsigned long tree_cache_hits;
+static unsigned long tree_cache_misses;
+static unsigned long tree_cache_evictions;
+static struct trace_key trace_tree_cache = TRACE_KEY_INIT(TREE_CACHE);
+
+struct tree_cache_entry {
+	struct hashmap_entry ent;
+	struct tree_cache_entry *lru_prev, *lru_next;
+	unsigned long size;
+	void *data;
+	unsigned char sha1[20];
+};
+
+/*
+ * LRU cache of inflated tree buffers.  Revision walks and merges read
+ * the same trees over and over; lookup_tree() caches the object
+ * struct, but the buffer itself is freed and re-inflated per use.  A
+ * hit hands out a private copy, so callers keep their usual free()
+ * semantics.  Total memory held is bounded by core.treeCacheLimit;
+ * eviction walks the LRU chain starting at lru_oldest, and a hit
+ * moves the entry back to lru_newest.
+ */
+static struct hashmap tree_cache;
+static struct tree_cache_entry *lru_oldest, *lru_newest;
+
+static void lru_remove(struct tree_cache_entry *ent)
+{
+	if (ent->lru_prev)
+		ent->lru_prev->lru_next = ent->lru_next;
+	else
+		lru_oldest = ent->lru_next;
+	if (ent->lru_next)
+		ent->lru_next->lru_prev = ent->lru_prev;
+	else
+		lru_newest = ent->lru_prev;
+}
+
+static void lru_append(struct tree_cache_entry *ent)
+{
+	ent->lru_next = NULL;
+	ent->lru_prev = lru_newest;
+	if (lru_newest)
+		lru_newest->lru_next = ent;
+	else
+		lru_oldest = ent;
+	lru_newest = ent;
+}
+
+static void log_tree_cache_stats(void)
+{
+	trace_printf_key(&trace_tree_cache,
+			 "tree cache: %lu hits, %lu misses, "
+			 "%lu evictions, %"PRIuMAX" bytes cached at exit\n",
+			 tree_cache_hits, tree_cache_misses,
+			 tree_cache_evictions,
+			 (uintmax_t)tree_cache_used);
+}
+
+static void count_tree_cache_event(unsigned long *counter)
+{
+	static int atexit_registered;
+
+	if (!trace_want(&trace_tree_cache))
+		return;
+	if (!atexit_registered) {
+		atexit(log_tree_cache_stats);
+		atexit_registered = 1;
+	}
+	(*counter)++;
+}
+
+static int tree_cache_hash_cmp(const void *va, const void *vb,
+			       const void *vkey)
+{
+	const struct tree_cache_entry *a = va, *b = vb;
+	const unsigned char *key = vkey;
+
+	return hashcmp(a->sha1, key ? key : b->sha1);
+}
+
+static struct tree_cache_entry *lookup_tree_cache(const unsigned char *sha1)
+{
+	struct hashmap_entry entry;
+
+	if (!tree_cache.cmpfn)
+		return NULL;
+
+	hashmap_entry_init(&entry, sha1hash(sha1));
+	return hashmap_get(&tree_cache, &entry, sha1);
+}
+
+static void release_tree_cache(struct tree_cache_entry *ent)
+{
+	hashmap_remove(&tree_cache, ent, ent->sha1);
+	lru_remove(ent);
+	tree_cache_used -= ent->size;
+	free(ent->data);
+	free(ent);
+}
+
+static void add_tree_cache(const unsigned char *sha1,
+			   const void *data, unsigned long size)
+{
+	struct tree_cache_entry *ent;
+
+	/* a single tree hogging the cache would evict everything else */
+	if (size > tree_cache_limit / 4)
+		return;
+
+	while (tree_cache_used + size > tree_cache_limit && lru_oldest) {
+		release_tree_cache(lru_oldest);
+		count_tree_cache_event(&tree_cache_evictions);
+	}
+
+	ent = xmalloc(sizeof(*ent));
+	hashmap_entry_init(ent, sha1hash(sha1));
+	hashcpy(ent->sha1, sha1);
+	ent->size = size;
+	ent->data = xmemdupz(data, size);
+	if (!tree_cache.cmpfn)
+		hashmap_init(&tree_cache, tree_cache_hash_cmp, 0);
+	hashmap_add(&tree_cache, ent);
+	lru_append(ent);
+	tree_cache_used += size;
+}
+
+static void *read_tree_buffer(const unsigned char *sha1, unsigned long *size)
+{
+	struct tree_cache_entry *ent;
+	void *buf;
+
+	ent = lookup_tree_cache(sha1);
+	count_tree_cache_event(ent ? &tree_cache_hits : &tree_cache_misses);
+	if (ent) {
+		/* a hit makes the entry the most recently used again */
+		lru_remove(ent);
+		lru_append(ent);
+		*size = ent->size;
+		return xmemdupz(ent->data, ent->size);
+	}
+
+	buf = read_object_with_reference(sha1, tree_type, size, NULL);
+	if (buf && tree_cache_limit)
+		add_tree_cache(sha1, buf, *size);
+	return buf;
+}
+
 void *fill_tree_descriptor(struct tree_desc *desc, const unsigned char *sha1)
 {
 	unsigned long size = 0;
 	void *buf = NULL;
 
 	if (sha1) {
-		buf = read_object_with_reference(sha1, tree_type, &size, NULL);
+		buf = read_tree_buffer(sha1, &size);
 		if (!buf)
 			die("unable to read tree %s", sha1_to_hex(sha1));
 	}
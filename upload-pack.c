@@ -14,6 +14,10 @@
 #include "sigchain.h"
 #include "version.h"
 #include "string-list.h"
+#include "sha1-array.h"
+#include "narrow.h"
+#include "pack.h"
+#include "pack-bitmap.h"
 
 static const char upload_pack_usage[] = "git upload-pack [--strict] [--timeout=<n>] <dir>";
 
@@ -31,12 +35,22 @@ static const char upload_pack_usage[] = "git upload-pack [--strict] [--timeout=<
 
 static unsigned long oldest_have;
 
+/*
+ * Whether every "have" commit announced so far was covered by a pack
+ * bitmap; only then is a negative reachability answer from the
+ * bitmaps conclusive.
+ */
+static int haves_all_bitmapped = 1;
+
 static int multi_ack;
 static int no_done;
 static int use_thin_pack, use_ofs_delta, use_include_tag;
 static int no_progress, daemon_mode;
 static int allow_tip_sha1_in_want;
+static int allow_any_sha1_in_want;
+static int no_blobs;
 static int shallow_nr;
+static struct string_list narrow_paths = STRING_LIST_INIT_DUP;
 static struct object_array have_obj;
 static struct object_array want_obj;
 static struct object_array extra_edge_obj;
@@ -48,6 +62,12 @@ static int keepalive = 5;
 static int use_sideband;
 static int advertise_refs;
 static int stateless_rpc;
+static const char *pack_objects_hook;
+static int allow_resume;
+static int client_wants_resume;
+static int resume_request;
+static char resume_id[41];
+static off_t resume_offset;
 
 static void reset_timeout(void)
 {
@@ -78,48 +98,48 @@ static int write_one_shallow(const struct commit_graft *graft, void *cb_data)
 	return 0;
 }
 
-static void create_pack_file(void)
+static void prepare_pack_objects(struct child_process *pack_objects)
 {
-	struct child_process pack_objects = CHILD_PROCESS_INIT;
-	char data[8193], progress[128];
-	char abort_msg[] = "aborting due to possible repository "
-		"corruption on the remote side.";
-	int buffered = -1;
-	ssize_t sz;
-	const char *argv[13];
-	int i, arg = 0;
-	FILE *pipe_fd;
+	if (!pack_objects_hook)
+		pack_objects->git_cmd = 1;
+	else {
+		argv_array_push(&pack_objects->args, pack_objects_hook);
+		argv_array_push(&pack_objects->args, "git");
+		pack_objects->use_shell = 1;
+	}
 
 	if (shallow_nr) {
-		argv[arg++] = "--shallow-file";
-		argv[arg++] = "";
+		argv_array_push(&pack_objects->args, "--shallow-file");
+		argv_array_push(&pack_objects->args, "");
 	}
-	argv[arg++] = "pack-objects";
-	argv[arg++] = "--revs";
+	argv_array_push(&pack_objects->args, "pack-objects");
+	argv_array_push(&pack_objects->args, "--revs");
 	if (use_thin_pack)
-		argv[arg++] = "--thin";
+		argv_array_push(&pack_objects->args, "--thin");
 
-	argv[arg++] = "--stdout";
+	argv_array_push(&pack_objects->args, "--stdout");
 	if (shallow_nr)
-		argv[arg++] = "--shallow";
+		argv_array_push(&pack_objects->args, "--shallow");
 	if (!no_progress)
-		argv[arg++] = "--progress";
+		argv_array_push(&pack_objects->args, "--progress");
 	if (use_ofs_delta)
-		argv[arg++] = "--delta-base-offset";
+		argv_array_push(&pack_objects->args, "--delta-base-offset");
 	if (use_include_tag)
-		argv[arg++] = "--include-tag";
-	argv[arg++] = NULL;
-
-	pack_objects.in = -1;
-	pack_objects.out = -1;
-	pack_objects.err = -1;
-	pack_objects.git_cmd = 1;
-	pack_objects.argv = argv;
-
-	if (start_command(&pack_objects))
-		die("git upload-pack: unable to fork git-pack-objects");
+		argv_array_push(&pack_objects->args, "--include-tag");
+	if (narrow_paths.nr) {
+		struct string_list_item *item;
+		for_each_string_list_item(item, &narrow_paths)
+			argv_array_pushf(&pack_objects->args,
+					 "--filter-path=%s", item->string);
+	}
+	if (no_blobs)
+		argv_array_push(&pack_objects->args, "--no-blobs");
+}
 
-	pipe_fd = xfdopen(pack_objects.in, "w");
+static void send_pack_objects_revs(struct child_process *pack_objects)
+{
+	FILE *pipe_fd = xfdopen(pack_objects->in, "w");
+	int i;
 
 	if (shallow_nr)
 		for_each_commit_graft(write_one_shallow, pipe_fd);
@@ -137,6 +157,27 @@ static void create_pack_file(void)
 	fprintf(pipe_fd, "\n");
 	fflush(pipe_fd);
 	fclose(pipe_fd);
+}
+
+static void create_pack_file(void)
+{
+	struct child_process pack_objects = CHILD_PROCESS_INIT;
+	char data[8193], progress[128];
+	char abort_msg[] = "aborting due to possible repository "
+		"corruption on the remote side.";
+	int buffered = -1;
+	ssize_t sz;
+
+	prepare_pack_objects(&pack_objects);
+
+	pack_objects.in = -1;
+	pack_objects.out = -1;
+	pack_objects.err = -1;
+
+	if (start_command(&pack_objects))
+		die("git upload-pack: unable to fork git-pack-objects");
+
+	send_pack_objects_revs(&pack_objects);
 
 	/* We read from pack_objects.err to capture stderr output for
 	 * progress bar, and pack_objects.out to capture the pack data.
@@ -272,6 +313,194 @@ static void create_pack_file(void)
 	die("git upload-pack: %s", abort_msg);
 }
 
+/*
+ * A resumable pack is identified by a hash over the sorted want tips
+ * and the options that influence the pack encoding, so that a client
+ * reconnecting with the same request finds the very same bytes.  The
+ * cached file under objects/pack-cache/ is the identity; it does not
+ * have to match what pack-objects would produce today, only what the
+ * interrupted transfer started out with.
+ */
+static void hash_one_want(const unsigned char sha1[20], void *cb_data)
+{
+	git_hash_ctx *ctx = cb_data;
+	the_hash_algo->update_fn(ctx, sha1, 20);
+}
+
+static void compute_resume_id(char *hex)
+{
+	struct sha1_array tips = SHA1_ARRAY_INIT;
+	git_hash_ctx ctx;
+	unsigned char key[GIT_MAX_RAWSZ];
+	unsigned char flags;
+	int i;
+
+	for (i = 0; i < want_obj.nr; i++)
+		sha1_array_append(&tips, want_obj.objects[i].item->sha1);
+
+	flags = (use_thin_pack ? 1 : 0) |
+		(use_ofs_delta ? 2 : 0) |
+		(use_include_tag ? 4 : 0);
+	the_hash_algo->init_fn(&ctx);
+	the_hash_algo->update_fn(&ctx, &flags, 1);
+	sha1_array_for_each_unique(&tips, hash_one_want, &ctx);
+	the_hash_algo->final_fn(key, &ctx);
+	sha1_array_clear(&tips);
+	memcpy(hex, sha1_to_hex(key), 41);
+}
+
+static char *cached_pack_path(const char *hex)
+{
+	return git_pathdup("objects/pack-cache/%s.pack", hex);
+}
+
+/*
+ * Run pack-objects to completion with its output going to a cache
+ * file instead of the client, relaying its progress on band #2 so
+ * the other side knows we are still alive.
+ */
+static void create_cached_pack(const char *path)
+{
+	struct child_process pack_objects = CHILD_PROCESS_INIT;
+	struct strbuf tmp = STRBUF_INIT;
+	char progress[128];
+	ssize_t sz;
+	int fd;
+
+	if (safe_create_leading_directories_const(path))
+		die("git upload-pack: cannot create pack cache directory");
+	strbuf_addf(&tmp, "%s.XXXXXX", path);
+	fd = xmkstemp(tmp.buf);
+
+	prepare_pack_objects(&pack_objects);
+
+	pack_objects.in = -1;
+	pack_objects.out = fd;
+	pack_objects.err = -1;
+
+	if (start_command(&pack_objects))
+		die("git upload-pack: unable to fork git-pack-objects");
+
+	send_pack_objects_revs(&pack_objects);
+
+	while (0 <= pack_objects.err) {
+		struct pollfd pfd;
+		int ret;
+
+		reset_timeout();
+		pfd.fd = pack_objects.err;
+		pfd.events = POLLIN;
+		ret = poll(&pfd, 1, keepalive < 0 ? -1 : 1000 * keepalive);
+		if (ret < 0) {
+			if (errno != EINTR) {
+				error("poll failed, resuming: %s",
+				      strerror(errno));
+				sleep(1);
+			}
+			continue;
+		}
+		if (!ret) {
+			if (use_sideband) {
+				static const char buf[] = "0005\1";
+				write_or_die(1, buf, 5);
+			}
+			continue;
+		}
+		sz = xread(pack_objects.err, progress, sizeof(progress));
+		if (0 < sz)
+			send_client_data(2, progress, sz);
+		else if (sz == 0) {
+			close(pack_objects.err);
+			pack_objects.err = -1;
+		} else {
+			unlink(tmp.buf);
+			die("git upload-pack: broken pipe to git-pack-objects");
+		}
+	}
+
+	if (finish_command(&pack_objects)) {
+		unlink(tmp.buf);
+		die("git upload-pack: git-pack-objects died with error.");
+	}
+	if (rename(tmp.buf, path)) {
+		unlink(tmp.buf);
+		die_errno("git upload-pack: cannot finalize cached pack");
+	}
+	strbuf_release(&tmp);
+}
+
+static void stream_cached_pack(int fd, off_t offset)
+{
+	char data[8192];
+	ssize_t sz;
+
+	if (lseek(fd, offset, SEEK_SET) < 0)
+		die_errno("git upload-pack: cannot seek in cached pack");
+	while ((sz = xread(fd, data, sizeof(data))) > 0) {
+		reset_timeout();
+		if (send_client_data(1, data, sz) < 0)
+			die("git upload-pack: aborted while sending cached pack");
+	}
+	if (sz < 0)
+		die_errno("git upload-pack: cannot read cached pack");
+	if (use_sideband)
+		packet_flush(1);
+}
+
+/*
+ * Serve a fresh request from the pack cache, generating the cached
+ * pack first if this is the first time we see this particular want
+ * set.  The identity is announced before any pack data so that the
+ * client can record it even if the transfer is cut short.
+ */
+static void send_cached_pack(void)
+{
+	char hex[41];
+	char *path;
+	int fd;
+
+	compute_resume_id(hex);
+	path = cached_pack_path(hex);
+	packet_write(1, "resume-id %s\n", hex);
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		create_cached_pack(path);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			die_errno("git upload-pack: cannot open cached pack");
+	}
+	stream_cached_pack(fd, 0);
+	close(fd);
+	free(path);
+}
+
+/*
+ * Serve a "resume <id> <offset>" request.  If the cached pack is
+ * gone (or never completed), tell the client so; it will start over
+ * with an ordinary request on the same connection.
+ */
+static int send_resumed_pack(void)
+{
+	char *path = cached_pack_path(resume_id);
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0 || fstat(fd, &st) || st.st_size < resume_offset) {
+		if (0 <= fd)
+			close(fd);
+		free(path);
+		packet_write(1, "resume-id none\n");
+		return 0;
+	}
+	packet_write(1, "resume-id %s %"PRIuMAX"\n",
+		     resume_id, (uintmax_t)st.st_size);
+	use_sideband = LARGE_PACKET_MAX;
+	stream_cached_pack(fd, resume_offset);
+	close(fd);
+	free(path);
+	return 1;
+}
+
 static int got_sha1(char *hex, unsigned char *sha1)
 {
 	struct object *o;
@@ -298,6 +527,8 @@ static int got_sha1(char *hex, unsigned char *sha1)
 		     parents;
 		     parents = parents->next)
 			parents->item->object.flags |= THEY_HAVE;
+		if (bitmap_note_have(sha1) < 0)
+			haves_all_bitmapped = 0;
 	}
 	if (!we_knew_they_have) {
 		add_object_array(o, NULL, &have_obj);
@@ -310,6 +541,21 @@ static int reachable(struct commit *want)
 {
 	struct commit_list *work = NULL;
 
+	/*
+	 * For bitmap-covered history we can answer without walking a
+	 * single commit: the want is reachable from the haves iff its
+	 * bit is set in the union of their reachability bitmaps.
+	 */
+	switch (bitmap_reachable_from_haves(want->object.sha1)) {
+	case 1:
+		want->object.flags |= COMMON_KNOWN;
+		return 1;
+	case 0:
+		if (haves_all_bitmapped)
+			return 0;
+		break;
+	}
+
 	commit_list_insert_by_date(want, &work);
 	while (work) {
 		struct commit_list *list = work->next;
@@ -442,6 +688,8 @@ static int get_common_commits(void)
 
 static int is_our_ref(struct object *o)
 {
+	if (allow_any_sha1_in_want)
+		return 1;
 	return o->flags &
 		((allow_tip_sha1_in_want ? HIDDEN_REF : 0) | OUR_REF);
 }
@@ -570,6 +818,27 @@ static void receive_needs(void)
 				die("Invalid deepen: %s", line);
 			continue;
 		}
+		if (starts_with(line, "narrow ")) {
+			check_narrow_path(line + 7);
+			string_list_insert(&narrow_paths, line + 7);
+			continue;
+		}
+		if (starts_with(line, "resume ")) {
+			const char *arg = line + 7;
+			char *end;
+
+			if (!allow_resume)
+				die("git upload-pack: resumable packs not allowed");
+			if (get_sha1_hex(arg, sha1_buf) || arg[40] != ' ')
+				die("invalid resume line: %s", line);
+			memcpy(resume_id, arg, 40);
+			resume_id[40] = '\0';
+			resume_offset = strtoumax(arg + 41, &end, 10);
+			if (end == arg + 41 || *end)
+				die("invalid resume line: %s", line);
+			resume_request = 1;
+			continue;
+		}
 		if (!starts_with(line, "want ") ||
 		    get_sha1_hex(line+5, sha1_buf))
 			die("git upload-pack: protocol error, "
@@ -595,6 +864,10 @@ static void receive_needs(void)
 			no_progress = 1;
 		if (parse_feature_request(features, "include-tag"))
 			use_include_tag = 1;
+		if (parse_feature_request(features, "no-blobs"))
+			no_blobs = 1;
+		if (parse_feature_request(features, "resume"))
+			client_wants_resume = 1;
 
 		o = parse_object(sha1_buf);
 		if (!o)
@@ -631,10 +904,24 @@ static void receive_needs(void)
 				struct object *object = shallows.objects[i].item;
 				object->flags |= NOT_SHALLOW;
 			}
-		else
+		else if (shallows.nr == 0 &&
+			 (result = get_cached_shallow_commits(&want_obj, depth,
+							      SHALLOW)) != NULL)
+			backup = result;
+		else {
 			backup = result =
 				get_shallow_commits(&want_obj, depth,
 						    SHALLOW, NOT_SHALLOW);
+			/*
+			 * Only a clean depth-limited clone may reuse a
+			 * cached boundary; client-side shallow lines
+			 * need the NOT_SHALLOW marks from a real walk
+			 * to compute unshallow updates.
+			 */
+			if (shallows.nr == 0)
+				cache_shallow_commits(&want_obj, depth,
+						      result, NOT_SHALLOW);
+		}
 		while (result) {
 			struct object *object = &result->item->object;
 			if (!(object->flags & (CLIENT_SHALLOW|NOT_SHALLOW))) {
@@ -709,10 +996,12 @@ static void format_symref_info(struct strbuf *buf, struct string_list *symref)
 		strbuf_addf(buf, " symref=%s:%s", item->string, (char *)item->util);
 }
 
+static struct packet_writer writer;
+
 static int send_ref(const char *refname, const unsigned char *sha1, int flag, void *cb_data)
 {
 	static const char *capabilities = "multi_ack thin-pack side-band"
-		" side-band-64k ofs-delta shallow no-progress"
+		" side-band-64k ofs-delta shallow narrow no-blobs no-progress"
 		" include-tag multi_ack_detailed";
 	const char *refname_nons = strip_namespace(refname);
 	unsigned char peeled[20];
@@ -724,23 +1013,90 @@ static int send_ref(const char *refname, const unsigned char *sha1, int flag, vo
 		struct strbuf symref_info = STRBUF_INIT;
 
 		format_symref_info(&symref_info, cb_data);
-		packet_write(1, "%s %s%c%s%s%s%s agent=%s\n",
-			     sha1_to_hex(sha1), refname_nons,
-			     0, capabilities,
-			     allow_tip_sha1_in_want ? " allow-tip-sha1-in-want" : "",
-			     stateless_rpc ? " no-done" : "",
-			     symref_info.buf,
-			     git_user_agent_sanitized());
+		packet_writer_write(&writer, "%s %s%c%s%s%s%s%s agent=%s\n",
+				    sha1_to_hex(sha1), refname_nons,
+				    0, capabilities,
+				    (allow_tip_sha1_in_want || allow_any_sha1_in_want) ?
+					    " allow-tip-sha1-in-want" : "",
+				    allow_resume ? " resume" : "",
+				    stateless_rpc ? " no-done" : "",
+				    symref_info.buf,
+				    git_user_agent_sanitized());
 		strbuf_release(&symref_info);
 	} else {
-		packet_write(1, "%s %s\n", sha1_to_hex(sha1), refname_nons);
+		packet_writer_write(&writer, "%s %s\n",
+				    sha1_to_hex(sha1), refname_nons);
 	}
 	capabilities = NULL;
 	if (!peel_ref(refname, peeled))
-		packet_write(1, "%s %s^{}\n", sha1_to_hex(peeled), refname_nons);
+		packet_writer_write(&writer, "%s %s^{}\n",
+				    sha1_to_hex(peeled), refname_nons);
 	return 0;
 }
 
+/*
+ * Ref prefixes requested by the client (via the GIT_REF_PREFIXES
+ * channel) to limit the advertisement to.  An empty list means
+ * advertise everything, as before.
+ */
+static struct string_list ref_prefixes = STRING_LIST_INIT_DUP;
+
+static void parse_ref_prefixes(void)
+{
+	const char *env = getenv("GIT_REF_PREFIXES");
+	int i, j;
+
+	if (!env || !*env)
+		return;
+	string_list_split(&ref_prefixes, env, ' ', -1);
+
+	/*
+	 * The client speaks first and cannot know whether we honor
+	 * the prefixes, so over-advertising is always safe; if
+	 * anything looks fishy, fall back to the full advertisement.
+	 */
+	for (i = 0; i < ref_prefixes.nr; i++) {
+		const char *prefix = ref_prefixes.items[i].string;
+		if (strcmp(prefix, "HEAD") && !starts_with(prefix, "refs/")) {
+			string_list_clear(&ref_prefixes, 0);
+			return;
+		}
+	}
+
+	/* drop prefixes covered by a shorter one to avoid duplicates */
+	string_list_sort(&ref_prefixes);
+	for (i = j = 0; i < ref_prefixes.nr; i++) {
+		if (j && starts_with(ref_prefixes.items[i].string,
+				     ref_prefixes.items[j - 1].string)) {
+			free(ref_prefixes.items[i].string);
+			continue;
+		}
+		ref_prefixes.items[j++] = ref_prefixes.items[i];
+	}
+	ref_prefixes.nr = j;
+}
+
+static void for_each_advertised_ref(each_ref_fn fn, void *cb_data)
+{
+	struct strbuf buf = STRBUF_INIT;
+	int i;
+
+	if (!ref_prefixes.nr) {
+		for_each_namespaced_ref(fn, cb_data);
+		return;
+	}
+	for (i = 0; i < ref_prefixes.nr; i++) {
+		const char *prefix = ref_prefixes.items[i].string;
+
+		if (!strcmp(prefix, "HEAD"))
+			continue; /* always advertised below */
+		strbuf_reset(&buf);
+		strbuf_addf(&buf, "%s%s", get_git_namespace(), prefix);
+		for_each_fullref_in(buf.buf, fn, cb_data);
+	}
+	strbuf_release(&buf);
+}
+
 static int find_symref(const char *refname, const unsigned char *sha1, int flag,
 		       void *cb_data)
 {
@@ -766,10 +1122,20 @@ static void upload_pack(void)
 
 	if (advertise_refs || !stateless_rpc) {
 		reset_timeout();
+		packet_writer_init(&writer, 1);
+		packet_writer_cork(&writer);
 		head_ref_namespaced(send_ref, &symref);
-		for_each_namespaced_ref(send_ref, &symref);
-		advertise_shallow_grafts(1);
-		packet_flush(1);
+		for_each_advertised_ref(send_ref, &symref);
+		/*
+		 * Refs outside the advertised prefixes must still be
+		 * marked as ours, so that "want"s for their tips
+		 * (e.g. via allowtipsha1inwant) keep working.
+		 */
+		if (ref_prefixes.nr)
+			for_each_namespaced_ref(check_ref, NULL);
+		advertise_shallow_grafts(&writer);
+		packet_writer_flush(&writer);
+		packet_writer_uncork(&writer);
 	} else {
 		head_ref_namespaced(check_ref, NULL);
 		for_each_namespaced_ref(check_ref, NULL);
@@ -779,8 +1145,26 @@ static void upload_pack(void)
 		return;
 
 	receive_needs();
+	if (resume_request) {
+		if (send_resumed_pack())
+			return;
+		/*
+		 * The cached pack is gone; the client falls back to an
+		 * ordinary request on the same connection.
+		 */
+		resume_request = 0;
+		receive_needs();
+	}
 	if (want_obj.nr) {
 		get_common_commits();
+		if (client_wants_resume && allow_resume && !stateless_rpc &&
+		    !have_obj.nr && !shallow_nr &&
+		    !narrow_paths.nr && !no_blobs) {
+			send_cached_pack();
+			return;
+		}
+		if (client_wants_resume)
+			packet_write(1, "resume-id none\n");
 		create_pack_file();
 	}
 }
@@ -789,10 +1173,18 @@ static int upload_pack_config(const char *var, const char *value, void *unused)
 {
 	if (!strcmp("uploadpack.allowtipsha1inwant", var))
 		allow_tip_sha1_in_want = git_config_bool(var, value);
+	else if (!strcmp("uploadpack.allowanysha1inwant", var))
+		allow_any_sha1_in_want = git_config_bool(var, value);
+	else if (!strcmp("uploadpack.allowresume", var))
+		allow_resume = git_config_bool(var, value);
 	else if (!strcmp("uploadpack.keepalive", var)) {
 		keepalive = git_config_int(var, value);
 		if (!keepalive)
 			keepalive = -1;
+	} else if (current_config_scope() != CONFIG_SCOPE_REPO) {
+		/* ignore dangerous settings in the repository config */
+		if (!strcmp("uploadpack.packobjectshook", var))
+			return git_config_string(&pack_objects_hook, var, value);
 	}
 	return parse_hide_refs_config(var, value, "uploadpack");
 }
@@ -848,6 +1240,7 @@ int main(int argc, char **argv)
 		die("'%s' does not appear to be a git repository", dir);
 
 	git_config(upload_pack_config, NULL);
+	parse_ref_prefixes();
 	upload_pack();
 	return 0;
 }
@@ -271,9 +271,63 @@ static int dowild(const uchar *p, const uchar *text, unsigned int flags)
 	return *text ? WM_NOMATCH : WM_MATCH;
 }
 
+/* Internal: pattern is not simple enough for dosimple(). */
+#define WM_NOT_SIMPLE -3
+
+/*
+ * Fast paths for the pattern shapes that dominate hot callers such as
+ * for_each_glob_ref() and the pathspec code: fully literal patterns
+ * and a literal prefix followed by one trailing "*".  These need
+ * neither recursion nor backtracking; anything else falls through to
+ * the dowild() interpreter.  Return values mirror dowild() exactly.
+ */
+static int dosimple(const uchar *p, const uchar *text, unsigned int flags)
+{
+	const uchar *q;
+	int trailing_star = 0;
+	uchar p_ch, t_ch;
+
+	for (q = p; (p_ch = *q) != '\0'; q++) {
+		if (p_ch == '*') {
+			if (q[1] != '\0')
+				return WM_NOT_SIMPLE;
+			trailing_star = 1;
+			break;
+		}
+		if (p_ch == '?' || p_ch == '[' || p_ch == '\\')
+			return WM_NOT_SIMPLE;
+	}
+
+	for (; p < q; p++, text++) {
+		if ((t_ch = *text) == '\0')
+			return WM_ABORT_ALL;
+		p_ch = *p;
+		if ((flags & WM_CASEFOLD) && ISUPPER(t_ch))
+			t_ch = tolower(t_ch);
+		if ((flags & WM_CASEFOLD) && ISUPPER(p_ch))
+			p_ch = tolower(p_ch);
+		if (t_ch != p_ch)
+			return WM_NOMATCH;
+	}
+
+	if (!trailing_star)
+		return *text ? WM_NOMATCH : WM_MATCH;
+
+	/*
+	 * A trailing "*" matches everything; with WM_PATHNAME it must
+	 * not cross a directory boundary.
+	 */
+	if ((flags & WM_PATHNAME) && strchr((const char *)text, '/'))
+		return WM_NOMATCH;
+	return WM_MATCH;
+}
+
 /* Match the "pattern" against the "text" string. */
 int wildmatch(const char *pattern, const char *text,
 	      unsigned int flags, struct wildopts *wo)
 {
+	int res = dosimple((const uchar*)pattern, (const uchar*)text, flags);
+	if (res != WM_NOT_SIMPLE)
+		return res;
 	return dowild((const uchar*)pattern, (const uchar*)text, flags);
 }
@@ -79,6 +79,33 @@ void write_or_die(int fd, const void *buf, size_t count)
 	}
 }
 
+/*
+ * Write out a full vector of buffers with as few system calls as
+ * writev() allows.  The iovec array is clobbered as partial writes
+ * are accounted for.
+ */
+void write_or_die_iov(int fd, struct iovec *iov, int iovcnt)
+{
+	while (iovcnt) {
+		ssize_t cnt = writev(fd, iov, iovcnt);
+		if (cnt < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			check_pipe(errno);
+			die_errno("write error");
+		}
+		while (iovcnt && cnt >= iov[0].iov_len) {
+			cnt -= iov[0].iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt && cnt) {
+			iov[0].iov_base = (char *)iov[0].iov_base + cnt;
+			iov[0].iov_len -= cnt;
+		}
+	}
+}
+
 int write_or_whine_pipe(int fd, const void *buf, size_t count, const char *msg)
 {
 	if (write_in_full(fd, buf, count) < 0) {
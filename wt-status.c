@@ -126,6 +126,8 @@ void wt_status_prepare(struct wt_status *s)
 	memcpy(s->color_palette, default_wt_status_colors,
 	       sizeof(default_wt_status_colors));
 	s->show_untracked_files = SHOW_NORMAL_UNTRACKED_FILES;
+	s->show_staged_changes = 1;
+	s->show_unstaged_changes = 1;
 	s->use_color = -1;
 	s->relative_paths = 1;
 	s->branch = resolve_refdup("HEAD", 0, sha1, NULL);
@@ -587,8 +589,19 @@ static void wt_status_collect_untracked(struct wt_status *s)
 		dir.flags |= DIR_SHOW_IGNORED_TOO;
 	setup_standard_excludes(&dir);
 
+	if (core_untracked_cache) {
+		if (!the_index.untracked)
+			the_index.untracked = xcalloc(1, sizeof(*the_index.untracked));
+		dir.untracked = the_index.untracked;
+	}
+
 	fill_directory(&dir, &s->pathspec);
 
+	if (dir.untracked && dir.untracked->changed) {
+		dir.untracked->changed = 0;
+		the_index.cache_changed |= UNTRACKED_CHANGED;
+	}
+
 	for (i = 0; i < dir.nr; i++) {
 		struct dir_entry *ent = dir.entries[i];
 		if (cache_name_is_other(ent->name, ent->len) &&
@@ -613,15 +626,56 @@ static void wt_status_collect_untracked(struct wt_status *s)
 		s->untracked_in_ms = (getnanotime() - t_begin) / 1000000;
 }
 
+static void wt_status_clear_collected(struct wt_status *s)
+{
+	int i;
+
+	for (i = 0; i < s->change.nr; i++) {
+		struct wt_status_change_data *d = s->change.items[i].util;
+		free(d->head_path);
+		free(d);
+	}
+	string_list_clear(&s->change, 0);
+	string_list_clear(&s->untracked, 0);
+	string_list_clear(&s->ignored, 0);
+}
+
 void wt_status_collect(struct wt_status *s)
 {
-	wt_status_collect_changes_worktree(s);
+	unsigned char head_sha1[20];
 
-	if (s->is_initial)
+	if (s->is_initial || get_sha1(s->reference, head_sha1))
+		hashclr(head_sha1);
+
+	/*
+	 * 'git commit' asks for the status twice when there is nothing
+	 * to commit: once for the commit template and once to tell the
+	 * user.  As long as the in-core index and the tree it is
+	 * compared against are still the same, the first answer is
+	 * just as good the second time around.
+	 */
+	if (s->collect_valid &&
+	    !hashcmp(s->collect_head_sha1, head_sha1) &&
+	    !hashcmp(s->collect_index_sha1, the_index.sha1) &&
+	    s->collect_cache_changed == the_index.cache_changed)
+		return;
+	wt_status_clear_collected(s);
+
+	if (s->show_unstaged_changes)
+		wt_status_collect_changes_worktree(s);
+
+	if (!s->show_staged_changes)
+		; /* leave the index diff uncollected */
+	else if (s->is_initial)
 		wt_status_collect_changes_initial(s);
 	else
 		wt_status_collect_changes_index(s);
 	wt_status_collect_untracked(s);
+
+	hashcpy(s->collect_head_sha1, head_sha1);
+	hashcpy(s->collect_index_sha1, the_index.sha1);
+	s->collect_cache_changed = the_index.cache_changed;
+	s->collect_valid = 1;
 }
 
 static void wt_status_print_unmerged(struct wt_status *s)
@@ -1619,3 +1673,29 @@ void wt_porcelain_print(struct wt_status *s)
 	s->no_gettext = 1;
 	wt_shortstatus_print(s);
 }
+
+void wt_counts_print(struct wt_status *s)
+{
+	int staged = 0, unstaged = 0, unmerged = 0;
+	char eol = s->null_termination ? '\0' : '\n';
+	int i;
+
+	for (i = 0; i < s->change.nr; i++) {
+		struct wt_status_change_data *d = s->change.items[i].util;
+
+		if (d->stagemask) {
+			unmerged++;
+			continue;
+		}
+		if (d->index_status)
+			staged++;
+		if (d->worktree_status)
+			unstaged++;
+	}
+	printf("staged %d%c", staged, eol);
+	printf("unstaged %d%c", unstaged, eol);
+	printf("unmerged %d%c", unmerged, eol);
+	printf("untracked %d%c", s->untracked.nr, eol);
+	if (s->show_ignored_files)
+		printf("ignored %d%c", s->ignored.nr, eol);
+}
@@ -56,6 +56,13 @@ struct wt_status {
 	int submodule_summary;
 	int show_ignored_files;
 	enum untracked_status_type show_untracked_files;
+	/*
+	 * Section selection: clearing these makes wt_status_collect()
+	 * skip the corresponding (possibly expensive) diff entirely,
+	 * for callers that only care about some of the sections.
+	 */
+	int show_staged_changes;
+	int show_unstaged_changes;
 	const char *ignore_submodule_arg;
 	char color_palette[WT_STATUS_MAXSLOT][COLOR_MAXLEN];
 	unsigned colopts;
@@ -73,6 +80,16 @@ struct wt_status {
 	struct string_list untracked;
 	struct string_list ignored;
 	uint32_t untracked_in_ms;
+
+	/*
+	 * Memo for wt_status_collect(): while the index and the tree
+	 * it is compared against are unchanged, a repeated collection
+	 * reuses the lists above instead of running the diffs again.
+	 */
+	unsigned collect_valid : 1;
+	unsigned collect_cache_changed;
+	unsigned char collect_head_sha1[20];
+	unsigned char collect_index_sha1[20];
 };
 
 struct wt_status_state {
@@ -102,6 +119,7 @@ void wt_status_get_state(struct wt_status_state *state, int get_detached_from);
 
 void wt_shortstatus_print(struct wt_status *s);
 void wt_porcelain_print(struct wt_status *s);
+void wt_counts_print(struct wt_status *s);
 
 __attribute__((format (printf, 3, 4)))
 void status_printf_ln(struct wt_status *s, const char *color, const char *fmt, ...);
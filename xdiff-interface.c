@@ -126,13 +126,37 @@ static void trim_common_tail(mmfile_t *a, mmfile_t *b, long ctx)
 	b->size -= trimmed - recovered;
 }
 
+/*
+ * Number of lines both halves of a split must exceed before xdiff
+ * forks a worker thread for one of them; zero keeps it sequential.
+ * Cached on first use so the lookup serves diff, blame and merge
+ * without each of them growing a config callback.
+ */
+unsigned long xdiff_parallel_lines(void)
+{
+	static int threshold = -1;
+
+	if (threshold < 0 &&
+	    (git_config_get_int("diff.parallelthreshold", &threshold) ||
+	     threshold < 0))
+		threshold = 0;
+	return threshold;
+}
+
 int xdi_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp, xdemitconf_t const *xecfg, xdemitcb_t *xecb)
 {
 	mmfile_t a = *mf1;
 	mmfile_t b = *mf2;
+	xpparam_t par;
 
 	trim_common_tail(&a, &b, xecfg->ctxlen);
 
+	if (!xpp->parallel_lines && xdiff_parallel_lines()) {
+		par = *xpp;
+		par.parallel_lines = xdiff_parallel_lines();
+		xpp = &par;
+	}
+
 	return xdl_diff(&a, &b, xpp, xecfg, xecb);
 }
 
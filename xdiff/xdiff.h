@@ -77,8 +77,36 @@ typedef struct s_mmbuffer {
 	long size;
 } mmbuffer_t;
 
+typedef struct s_xdprehash_rec {
+	long offset;
+	long size;
+	unsigned long ha;
+} xdprehash_rec_t;
+
+typedef struct s_xdprehash {
+	xdprehash_rec_t *recs;
+	long nrec;
+} xdprehash_t;
+
 typedef struct s_xpparam {
 	unsigned long flags;
+
+	/*
+	 * Optional line records prepared by xdl_prehash_mmfile(); when
+	 * set, file preparation reuses them instead of splitting and
+	 * hashing the input again.  The offsets must describe exactly
+	 * the mmfile handed to xdl_diff(), hashed with the same flags.
+	 */
+	xdprehash_t const *prehash1;
+	xdprehash_t const *prehash2;
+
+	/*
+	 * When non-zero, the classic diff algorithm may process the
+	 * two halves of a split box on separate threads, provided
+	 * each half still holds at least this many records.  Zero
+	 * keeps the computation sequential.
+	 */
+	unsigned long parallel_lines;
 } xpparam_t;
 
 typedef struct s_xdemitcb {
@@ -116,6 +144,8 @@ long xdl_mmfile_size(mmfile_t *mmf);
 int xdl_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 	     xdemitconf_t const *xecfg, xdemitcb_t *ecb);
 
+int xdl_prehash_mmfile(mmfile_t *mf, xpparam_t const *xpp, xdprehash_t *ph);
+
 typedef struct s_xmparam {
 	xpparam_t xpp;
 	int marker_size;
@@ -22,6 +22,10 @@
 
 #include "xinclude.h"
 
+#if !defined(NO_PTHREADS)
+#include <pthread.h>
+#endif
+
 
 
 #define XDL_MAX_COST_MIN 256
@@ -260,6 +264,41 @@ static long xdl_split(unsigned long const *ha1, long off1, long lim1,
 }
 
 
+#if !defined(NO_PTHREADS)
+
+typedef struct s_xdlcmpjob {
+	diffdata_t *dd1, *dd2;
+	long off1, lim1, off2, lim2;
+	int need_min;
+	xdalgoenv_t xenv;
+	int ret;
+} xdlcmpjob_t;
+
+/*
+ * Sub-boxes on either side of a split can share diagonal indexes in
+ * the K vectors, so a worker thread gets a private pair laid out the
+ * same way xdl_do_diff() lays out the main one.
+ */
+static void *xdl_recs_cmp_thread(void *arg) {
+	xdlcmpjob_t *job = arg;
+	long *kvd, *kvdf, *kvdb;
+
+	if (!(kvd = (long *) xdl_malloc((2 * job->xenv.ndiags + 2) * sizeof(long)))) {
+		job->ret = -1;
+		return NULL;
+	}
+	kvdf = kvd + job->xenv.kvdoff;
+	kvdb = kvd + job->xenv.ndiags + job->xenv.kvdoff;
+	job->ret = xdl_recs_cmp(job->dd1, job->off1, job->lim1,
+				job->dd2, job->off2, job->lim2,
+				kvdf, kvdb, job->need_min, &job->xenv);
+	xdl_free(kvd);
+	return NULL;
+}
+
+#endif
+
+
 /*
  * Rule: "Divide et Impera". Recursively split the box in sub-boxes by calling
  * the box splitting function. Note that the real job (marking changed lines)
@@ -308,6 +347,39 @@ int xdl_recs_cmp(diffdata_t *dd1, long off1, long lim1,
 		/*
 		 * ... et Impera.
 		 */
+#if !defined(NO_PTHREADS)
+		if (xenv->parallel_depth > 0 &&
+		    (spl.i1 - off1) + (spl.i2 - off2) >= xenv->parallel_min &&
+		    (lim1 - spl.i1) + (lim2 - spl.i2) >= xenv->parallel_min) {
+			xdlcmpjob_t job;
+			xdalgoenv_t sub;
+			pthread_t thread;
+			int ret;
+
+			job.dd1 = dd1;
+			job.off1 = off1;
+			job.lim1 = spl.i1;
+			job.dd2 = dd2;
+			job.off2 = off2;
+			job.lim2 = spl.i2;
+			job.need_min = spl.min_lo;
+			job.xenv = *xenv;
+			job.xenv.parallel_depth--;
+			job.ret = -1;
+			sub = *xenv;
+			sub.parallel_depth--;
+			if (!pthread_create(&thread, NULL, xdl_recs_cmp_thread, &job)) {
+				ret = xdl_recs_cmp(dd1, spl.i1, lim1,
+						   dd2, spl.i2, lim2,
+						   kvdf, kvdb, spl.min_hi, &sub);
+				if (pthread_join(thread, NULL) ||
+				    ret < 0 || job.ret < 0)
+					return -1;
+				return 0;
+			}
+			/* could not fork a thread; do it all here instead */
+		}
+#endif
 		if (xdl_recs_cmp(dd1, off1, spl.i1, dd2, off2, spl.i2,
 				 kvdf, kvdb, spl.min_lo, xenv) < 0 ||
 		    xdl_recs_cmp(dd1, spl.i1, lim1, dd2, spl.i2, lim2,
@@ -359,6 +431,10 @@ int xdl_do_diff(mmfile_t *mf1, mmfile_t *mf2, xpparam_t const *xpp,
 		xenv.mxcost = XDL_MAX_COST_MIN;
 	xenv.snake_cnt = XDL_SNAKE_CNT;
 	xenv.heur_min = XDL_HEUR_MIN_COST;
+	xenv.parallel_min = (long) xpp->parallel_lines;
+	xenv.parallel_depth = xpp->parallel_lines ? 2 : 0;
+	xenv.ndiags = ndiags;
+	xenv.kvdoff = xe->xdf2.nreff + 1;
 
 	dd1.nrec = xe->xdf1.nreff;
 	dd1.ha = xe->xdf1.ha;
@@ -35,6 +35,17 @@ typedef struct s_xdalgoenv {
 	long mxcost;
 	long snake_cnt;
 	long heur_min;
+	/*
+	 * Threaded divide-and-conquer: after a split, the low box may
+	 * be handed to a worker thread when both boxes still hold at
+	 * least parallel_min records and parallel_depth levels of
+	 * forking remain.  The worker needs its own K vectors, hence
+	 * the allocation geometry (ndiags, kvdoff) is carried along.
+	 */
+	long parallel_min;
+	int parallel_depth;
+	long ndiags;
+	long kvdoff;
 } xdalgoenv_t;
 
 typedef struct s_xdchange {
@@ -159,6 +159,7 @@ static int xdl_classify_record(unsigned int pass, xdlclassifier_t *cf, xrecord_t
 
 static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_t const *xpp,
 			   xdlclassifier_t *cf, xdfile_t *xdf) {
+	xdprehash_t const *prehash = pass == 1 ? xpp->prehash1 : xpp->prehash2;
 	unsigned int hbits;
 	long nrec, hsize, bsize;
 	unsigned long hav;
@@ -192,7 +193,31 @@ static int xdl_prepare_ctx(unsigned int pass, mmfile_t *mf, long narec, xpparam_
 	}
 
 	nrec = 0;
-	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
+	if (prehash) {
+		long i;
+
+		blk = xdl_mmfile_first(mf, &bsize);
+		for (i = 0; i < prehash->nrec; i++) {
+			xdprehash_rec_t const *pr = prehash->recs + i;
+
+			if (nrec >= narec) {
+				narec *= 2;
+				if (!(rrecs = (xrecord_t **) xdl_realloc(recs, narec * sizeof(xrecord_t *))))
+					goto abort;
+				recs = rrecs;
+			}
+			if (!(crec = xdl_cha_alloc(&xdf->rcha)))
+				goto abort;
+			crec->ptr = blk + pr->offset;
+			crec->size = pr->size;
+			crec->ha = pr->ha;
+			recs[nrec++] = crec;
+
+			if ((XDF_DIFF_ALG(xpp->flags) != XDF_HISTOGRAM_DIFF) &&
+			    xdl_classify_record(pass, cf, rhash, hbits, crec) < 0)
+				goto abort;
+		}
+	} else if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
 		for (top = blk + bsize; cur < top; ) {
 			prev = cur;
 			hav = xdl_hash_record(&cur, top, xpp->flags);
@@ -318,6 +343,45 @@ void xdl_free_env(xdfenv_t *xe) {
 }
 
 
+/*
+ * Split a file into line records and hash them, exactly as
+ * xdl_prepare_ctx() would, but into a form the caller can keep and
+ * hand back through xpparam_t to later xdl_diff() invocations on the
+ * same content.
+ */
+int xdl_prehash_mmfile(mmfile_t *mf, xpparam_t const *xpp, xdprehash_t *ph) {
+	long narec, bsize, nrec = 0;
+	char const *blk, *cur, *top, *prev;
+	xdprehash_rec_t *recs, *rrecs;
+
+	narec = xdl_guess_lines(mf, XDL_GUESS_NLINES1) + 1;
+	if (!(recs = (xdprehash_rec_t *) xdl_malloc(narec * sizeof(xdprehash_rec_t))))
+		return -1;
+
+	if ((cur = blk = xdl_mmfile_first(mf, &bsize)) != NULL) {
+		for (top = blk + bsize; cur < top; ) {
+			prev = cur;
+			if (nrec >= narec) {
+				narec *= 2;
+				if (!(rrecs = (xdprehash_rec_t *) xdl_realloc(recs, narec * sizeof(xdprehash_rec_t)))) {
+					xdl_free(recs);
+					return -1;
+				}
+				recs = rrecs;
+			}
+			recs[nrec].ha = xdl_hash_record(&cur, top, xpp->flags);
+			recs[nrec].offset = (long) (prev - blk);
+			recs[nrec].size = (long) (cur - prev);
+			nrec++;
+		}
+	}
+
+	ph->recs = recs;
+	ph->nrec = nrec;
+	return 0;
+}
+
+
 static int xdl_clean_mmatch(char const *dis, long i, long s, long e) {
 	long r, rdis0, rpdis0, rdis1, rpdis1;
 
@@ -3,6 +3,9 @@
  * at init time.
  */
 #include "cache.h"
+#ifndef NO_PTHREADS
+#include <pthread.h>
+#endif
 
 static const char *zerr_to_string(int status)
 {
@@ -34,47 +37,130 @@ static inline uInt zlib_buf_cap(unsigned long len)
 	return (ZLIB_BUF_MAX < len) ? ZLIB_BUF_MAX : len;
 }
 
-static void zlib_pre_call(git_zstream *s)
+static void zlib_pre_call(git_zstream *s, z_stream *z)
 {
-	s->z.next_in = s->next_in;
-	s->z.next_out = s->next_out;
-	s->z.total_in = s->total_in;
-	s->z.total_out = s->total_out;
-	s->z.avail_in = zlib_buf_cap(s->avail_in);
-	s->z.avail_out = zlib_buf_cap(s->avail_out);
+	z->next_in = s->next_in;
+	z->next_out = s->next_out;
+	z->total_in = s->total_in;
+	z->total_out = s->total_out;
+	z->avail_in = zlib_buf_cap(s->avail_in);
+	z->avail_out = zlib_buf_cap(s->avail_out);
 }
 
-static void zlib_post_call(git_zstream *s)
+static void zlib_post_call(git_zstream *s, z_stream *z)
 {
 	unsigned long bytes_consumed;
 	unsigned long bytes_produced;
 
-	bytes_consumed = s->z.next_in - s->next_in;
-	bytes_produced = s->z.next_out - s->next_out;
-	if (s->z.total_out != s->total_out + bytes_produced)
+	bytes_consumed = z->next_in - s->next_in;
+	bytes_produced = z->next_out - s->next_out;
+	if (z->total_out != s->total_out + bytes_produced)
 		die("BUG: total_out mismatch");
-	if (s->z.total_in != s->total_in + bytes_consumed)
+	if (z->total_in != s->total_in + bytes_consumed)
 		die("BUG: total_in mismatch");
 
-	s->total_out = s->z.total_out;
-	s->total_in = s->z.total_in;
-	s->next_in = s->z.next_in;
-	s->next_out = s->z.next_out;
+	s->total_out = z->total_out;
+	s->total_in = z->total_in;
+	s->next_in = z->next_in;
+	s->next_out = z->next_out;
 	s->avail_in -= bytes_consumed;
 	s->avail_out -= bytes_produced;
 }
 
-void git_inflate_init(git_zstream *strm)
+/*
+ * inflateInit() and inflateEnd() allocate and free the inflate window
+ * on every call, which adds up when a revision walk inflates millions
+ * of small tree and commit objects.  Instead of tearing the state
+ * down, git_inflate_end() parks it in a small pool and a later
+ * git_inflate_init() revives it with inflateReset2(), which keeps the
+ * window allocation.
+ *
+ * zlib keeps a pointer from its internal state back to the z_stream,
+ * so an inflate state must stay at a stable address for its whole
+ * life; each git_zstream therefore borrows a heap-allocated z_stream
+ * through ->zp instead of using the embedded one.  The pool is shared
+ * by all threads and only locked on init/end, mirroring how threaded
+ * object readers already serialize on obj_read_lock().
+ */
+#if ZLIB_VERNUM < 0x1240
+/*
+ * No inflateReset2(); reviving a parked state falls back to setting
+ * up a fresh one.
+ */
+#define inflateReset2(z, windowBits) (Z_STREAM_ERROR)
+#endif
+
+#define INFLATE_POOL_SIZE 8
+static z_stream *inflate_pool[INFLATE_POOL_SIZE];
+static int inflate_pool_nr;
+
+#ifndef NO_PTHREADS
+static pthread_mutex_t inflate_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define inflate_pool_lock() pthread_mutex_lock(&inflate_pool_mutex)
+#define inflate_pool_unlock() pthread_mutex_unlock(&inflate_pool_mutex)
+#else
+#define inflate_pool_lock()
+#define inflate_pool_unlock()
+#endif
+
+static z_stream *acquire_inflate_stream(void)
+{
+	z_stream *z = NULL;
+
+	inflate_pool_lock();
+	if (inflate_pool_nr)
+		z = inflate_pool[--inflate_pool_nr];
+	inflate_pool_unlock();
+	return z;
+}
+
+static int release_inflate_stream(z_stream *z)
+{
+	int pooled = 0;
+
+	inflate_pool_lock();
+	if (inflate_pool_nr < INFLATE_POOL_SIZE) {
+		inflate_pool[inflate_pool_nr++] = z;
+		pooled = 1;
+	}
+	inflate_pool_unlock();
+	return pooled;
+}
+
+static void do_git_inflate_init(git_zstream *strm, int windowBits,
+				const char *err)
 {
 	int status;
+	z_stream *z = acquire_inflate_stream();
+
+	if (z) {
+		zlib_pre_call(strm, z);
+		status = inflateReset2(z, windowBits);
+		if (status == Z_OK) {
+			zlib_post_call(strm, z);
+			strm->zp = z;
+			return;
+		}
+		/* should not happen; fall back to a fresh state */
+		inflateEnd(z);
+		free(z);
+	}
 
-	zlib_pre_call(strm);
-	status = inflateInit(&strm->z);
-	zlib_post_call(strm);
+	z = xcalloc(1, sizeof(*z));
+	zlib_pre_call(strm, z);
+	status = inflateInit2(z, windowBits);
+	zlib_post_call(strm, z);
+	strm->zp = z;
 	if (status == Z_OK)
 		return;
-	die("inflateInit: %s (%s)", zerr_to_string(status),
-	    strm->z.msg ? strm->z.msg : "no message");
+	die("%s: %s (%s)", err, zerr_to_string(status),
+	    z->msg ? z->msg : "no message");
+}
+
+void git_inflate_init(git_zstream *strm)
+{
+	/* Default 15 bits, the same as inflateInit() would use. */
+	do_git_inflate_init(strm, 15, "inflateInit");
 }
 
 void git_inflate_init_gzip_only(git_zstream *strm)
@@ -83,50 +169,46 @@ void git_inflate_init_gzip_only(git_zstream *strm)
 	 * Use default 15 bits, +16 is to accept only gzip and to
 	 * yield Z_DATA_ERROR when fed zlib format.
 	 */
-	const int windowBits = 15 + 16;
-	int status;
-
-	zlib_pre_call(strm);
-	status = inflateInit2(&strm->z, windowBits);
-	zlib_post_call(strm);
-	if (status == Z_OK)
-		return;
-	die("inflateInit2: %s (%s)", zerr_to_string(status),
-	    strm->z.msg ? strm->z.msg : "no message");
+	do_git_inflate_init(strm, 15 + 16, "inflateInit2");
 }
 
 void git_inflate_end(git_zstream *strm)
 {
 	int status;
+	z_stream *z = strm->zp;
 
-	zlib_pre_call(strm);
-	status = inflateEnd(&strm->z);
-	zlib_post_call(strm);
-	if (status == Z_OK)
+	if (!z)
 		return;
-	error("inflateEnd: %s (%s)", zerr_to_string(status),
-	      strm->z.msg ? strm->z.msg : "no message");
+	strm->zp = NULL;
+	if (release_inflate_stream(z))
+		return;
+	status = inflateEnd(z);
+	if (status != Z_OK)
+		error("inflateEnd: %s (%s)", zerr_to_string(status),
+		      z->msg ? z->msg : "no message");
+	free(z);
 }
 
 int git_inflate(git_zstream *strm, int flush)
 {
+	z_stream *z = strm->zp;
 	int status;
 
 	for (;;) {
-		zlib_pre_call(strm);
+		zlib_pre_call(strm, z);
 		/* Never say Z_FINISH unless we are feeding everything */
-		status = inflate(&strm->z,
-				 (strm->z.avail_in != strm->avail_in)
+		status = inflate(z,
+				 (z->avail_in != strm->avail_in)
 				 ? 0 : flush);
 		if (status == Z_MEM_ERROR)
 			die("inflate: out of memory");
-		zlib_post_call(strm);
+		zlib_post_call(strm, z);
 
 		/*
 		 * Let zlib work another round, while we can still
 		 * make progress.
 		 */
-		if ((strm->avail_out && !strm->z.avail_out) &&
+		if ((strm->avail_out && !z->avail_out) &&
 		    (status == Z_OK || status == Z_BUF_ERROR))
 			continue;
 		break;
@@ -142,7 +224,7 @@ int git_inflate(git_zstream *strm, int flush)
 		break;
 	}
 	error("inflate: %s (%s)", zerr_to_string(status),
-	      strm->z.msg ? strm->z.msg : "no message");
+	      z->msg ? z->msg : "no message");
 	return status;
 }
 
@@ -160,9 +242,9 @@ void git_deflate_init(git_zstream *strm, int level)
 	int status;
 
 	memset(strm, 0, sizeof(*strm));
-	zlib_pre_call(strm);
+	zlib_pre_call(strm, &strm->z);
 	status = deflateInit(&strm->z, level);
-	zlib_post_call(strm);
+	zlib_post_call(strm, &strm->z);
 	if (status == Z_OK)
 		return;
 	die("deflateInit: %s (%s)", zerr_to_string(status),
@@ -174,11 +256,11 @@ static void do_git_deflate_init(git_zstream *strm, int level, int windowBits)
 	int status;
 
 	memset(strm, 0, sizeof(*strm));
-	zlib_pre_call(strm);
+	zlib_pre_call(strm, &strm->z);
 	status = deflateInit2(&strm->z, level,
 				  Z_DEFLATED, windowBits,
 				  8, Z_DEFAULT_STRATEGY);
-	zlib_post_call(strm);
+	zlib_post_call(strm, &strm->z);
 	if (status == Z_OK)
 		return;
 	die("deflateInit2: %s (%s)", zerr_to_string(status),
@@ -207,9 +289,9 @@ int git_deflate_abort(git_zstream *strm)
 {
 	int status;
 
-	zlib_pre_call(strm);
+	zlib_pre_call(strm, &strm->z);
 	status = deflateEnd(&strm->z);
-	zlib_post_call(strm);
+	zlib_post_call(strm, &strm->z);
 	return status;
 }
 
@@ -227,9 +309,9 @@ int git_deflate_end_gently(git_zstream *strm)
 {
 	int status;
 
-	zlib_pre_call(strm);
+	zlib_pre_call(strm, &strm->z);
 	status = deflateEnd(&strm->z);
-	zlib_post_call(strm);
+	zlib_post_call(strm, &strm->z);
 	return status;
 }
 
@@ -238,7 +320,7 @@ int git_deflate(git_zstream *strm, int flush)
 	int status;
 
 	for (;;) {
-		zlib_pre_call(strm);
+		zlib_pre_call(strm, &strm->z);
 
 		/* Never say Z_FINISH unless we are feeding everything */
 		status = deflate(&strm->z,
@@ -246,7 +328,7 @@ int git_deflate(git_zstream *strm, int flush)
 				 ? 0 : flush);
 		if (status == Z_MEM_ERROR)
 			die("deflate: out of memory");
-		zlib_post_call(strm);
+		zlib_post_call(strm, &strm->z);
 
 		/*
 		 * Let zlib work another round, while we can still